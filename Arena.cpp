@@ -0,0 +1,69 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "Arena.h"
+#include "DIAG.h"
+
+// 8 byte types (double, uint64_t) need 8 byte alignment on 32 bit cores
+#if defined(ARDUINO_ARCH_AVR)
+static const byte ARENA_ALIGN = 1;
+#else
+static const byte ARENA_ALIGN = 8;
+#endif
+
+byte * Arena::chunk = NULL;
+uint16_t Arena::chunkFree = 0;
+uint16_t Arena::chunks = 0;
+uint16_t Arena::wasted = 0;
+uint32_t Arena::used[Arena::ARENA_OWNERS];
+
+void * Arena::alloc(size_t size, Owner owner) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  void * p;
+  if (size > ARENA_CHUNK / 2) {
+    // large, a block of its own would not save anything
+    p = malloc(size);
+  } else {
+    if (size > chunkFree) {
+      byte * next = (byte *)malloc(ARENA_CHUNK);
+      if (!next) return NULL;
+      if (chunk) wasted += chunkFree;
+      chunk = next;
+      chunkFree = ARENA_CHUNK;
+      chunks++;
+    }
+    p = chunk;
+    chunk += size;
+    chunkFree -= size;
+  }
+  if (p) used[owner] += size;
+  return p;
+}
+
+void Arena::show() {
+  static const char names[] PROGMEM =
+    "SERIAL\0RING\0HAL\0EXRAIL\0OTHER\0";
+  const char * name = names;
+  for (byte n = 0; n < ARENA_OWNERS; n++) {
+    if (used[n]) DIAG(F("Arena %S %l bytes"), (const FSH *)name, used[n]);
+    name += strlen_P(name) + 1;
+  }
+  DIAG(F("Arena %d blocks of %d, %d unused at block ends, %d free in last"),
+       chunks, ARENA_CHUNK, wasted, chunkFree);
+}
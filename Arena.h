@@ -0,0 +1,59 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef Arena_h
+#define Arena_h
+#include <Arduino.h>
+#include "defines.h"
+
+// Bump allocator for objects that are created once and never freed
+// (serial managers, rings, HAL devices, EX-RAIL tables). Small
+// allocations are carved out of ARENA_CHUNK sized blocks taken from the
+// heap, saving the per allocation overhead and the fragmentation
+// between them. Use through a class operator new, or alloc() for
+// arrays. Usage per owner is shown by <D ARENA>.
+#ifndef ARENA_CHUNK
+#if defined(ARDUINO_ARCH_AVR)
+#define ARENA_CHUNK 128
+#else
+#define ARENA_CHUNK 512
+#endif
+#endif
+
+class Arena {
+public:
+  enum Owner : byte {
+    ARENA_SERIAL, ARENA_RING, ARENA_HAL, ARENA_EXRAIL, ARENA_OTHER,
+    ARENA_OWNERS
+  };
+  static void * alloc(size_t size, Owner owner);
+  static void show();
+private:
+  static byte * chunk;        // current block, NULL before the first
+  static uint16_t chunkFree;  // bytes left in it
+  static uint16_t chunks;
+  static uint16_t wasted;     // block tails too small for the next request
+  static uint32_t used[ARENA_OWNERS];
+};
+
+// Add to a class that is never deleted to allocate it from the arena
+#define ARENA_NEW(owner) \
+  static void * operator new(size_t size) { return Arena::alloc(size, Arena::owner); } \
+  static void operator delete(void *) {}
+#endif
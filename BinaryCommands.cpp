@@ -0,0 +1,67 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "BinaryCommands.h"
+#ifdef BINARY_COMMANDS
+#include "DCCEXParser.h"
+#include "DIAG.h"
+
+// Only opcodes whose parameters are plain numbers may arrive in binary,
+// others (strings, AT passthrough) read from the command text.
+bool BinaryCommands::allowed(byte opcode) {
+  switch (opcode) {
+  case 't': case 'f': case 'F': case 'a': case 'A':
+  case 'T': case 'Q': case '!': case '-':
+    return true;
+  default:
+    return false;
+  }
+}
+
+void BinaryCommands::parse(Print * stream, const byte * frame, byte length) {
+  byte opcode=frame[0];
+  if (!allowed(opcode) || (length & 1)==0) {
+    DIAG(F("Binary opcode %x len %d rejected"), opcode, length);
+    return;
+  }
+  int16_t p[DCCEXParser::MAX_COMMAND_PARAMS]={0};
+  byte count=length/2;
+  for (byte i=0; i<count; i++)
+    p[i]=(int16_t)((frame[1+2*i]<<8) | frame[2+2*i]);
+  byte com[2]={opcode,'\0'};
+  DCCEXParser::parseSplit(stream, com, p, count, NULL);
+}
+
+void BinaryCommands::send(Print * stream, byte opcode, const int16_t p[], byte count) {
+  byte frame[3+MAX_LENGTH];
+  byte length=1+2*count;
+  frame[0]=SYNC;
+  frame[1]=length;
+  frame[2]=opcode;
+  byte check=length^opcode;
+  for (byte i=0; i<count; i++) {
+    frame[3+2*i]=highByte(p[i]);
+    frame[4+2*i]=lowByte(p[i]);
+    check^=frame[3+2*i]^frame[4+2*i];
+  }
+  frame[2+length]=check;
+  stream->write(frame, 3+length);
+}
+#endif
@@ -0,0 +1,58 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BinaryCommands_h
+#define BinaryCommands_h
+#include <Arduino.h>
+#include "defines.h"
+
+// Compact binary framing of the most frequent commands and broadcasts,
+// for serial throttles that send at high rates. Enabled by defining
+// BINARY_COMMANDS in config.h.
+//
+// Frame:  SYNC LEN OPCODE P0hi P0lo ... Pnhi Pnlo CHECK
+//   SYNC   0xDC, which can never start a text command
+//   LEN    number of bytes from OPCODE to the last parameter
+//   OPCODE the text protocol opcode letter
+//   Pn     parameters as big endian int16, as splitValues would give
+//   CHECK  XOR of LEN to the last parameter byte
+//
+// Commands enter DCCEXParser::parseSplit exactly as the text form
+// would, so <t cab speed dir> is sent as 't' with 3 parameters.
+// Replies that are not broadcasts stay in text form.
+// A serial port switches to binary broadcasts after its first good
+// frame: <l>, <Q>/<q> and <H> are then sent as frames with the same
+// opcode and parameters. The 32 bit function map of <l> is sent as
+// two parameters, high word first.
+
+#ifdef BINARY_COMMANDS
+class BinaryCommands {
+public:
+  static const byte SYNC=0xDC;
+  static const byte MAX_PARAMS=6;
+  static const byte MAX_LENGTH=1+2*MAX_PARAMS;
+
+  // frame points at the opcode, length is LEN from the frame
+  static void parse(Print * stream, const byte * frame, byte length);
+  static void send(Print * stream, byte opcode, const int16_t p[], byte count);
+private:
+  static bool allowed(byte opcode);
+};
+#endif
+#endif
@@ -0,0 +1,144 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CVCache.h"
+#ifdef CV_CACHE
+#include "DCCACK.h"
+#include "DIAG.h"
+
+CVCache::ENTRY CVCache::entries[CV_CACHE_SIZE];
+byte CVCache::nextEntry=0;
+int16_t CVCache::progLoco=0;
+unsigned long CVCache::progLocoTime=0;
+CVCache::PendingOp CVCache::pendingOp=PENDING_READ;
+int16_t CVCache::pendingCv=0;
+int16_t CVCache::pendingValue=0;
+ACK_CALLBACK CVCache::pendingCallback=NULL;
+
+CVCache::ENTRY * CVCache::find(int16_t loco, int16_t cv) {
+  if (loco<=0) return NULL;
+  for (byte i=0; i<CV_CACHE_SIZE; i++)
+    if (entries[i].loco==loco && entries[i].cv==cv) return &entries[i];
+  return NULL;
+}
+
+void CVCache::store(int16_t loco, int16_t cv, byte value) {
+  if (loco<=0) return;
+  ENTRY * e=find(loco, cv);
+  if (!e) {
+    e=&entries[nextEntry];
+    nextEntry=(nextEntry+1) % CV_CACHE_SIZE;
+    e->loco=loco;
+    e->cv=cv;
+  }
+  e->value=value;
+}
+
+// Only a bit of a known value can be updated, otherwise it stays unknown
+void CVCache::storeBit(int16_t loco, int16_t cv, byte bitNum, bool bitValue) {
+  ENTRY * e=find(loco, cv);
+  if (e) bitWrite(e->value, bitNum, bitValue);
+}
+
+void CVCache::forget(int16_t loco, int16_t cv) {
+  ENTRY * e=find(loco, cv);
+  if (e) e->loco=0;
+}
+
+void CVCache::forgetLoco(int16_t loco) {
+  for (byte i=0; i<CV_CACHE_SIZE; i++)
+    if (entries[i].loco==loco) entries[i].loco=0;
+}
+
+void CVCache::clear() {
+  memset(entries, 0, sizeof(entries));
+  progLoco=0;
+}
+
+// CVs that change the address the loco answers to
+bool CVCache::isAddressCV(int16_t cv) {
+  return cv==1 || cv==17 || cv==18 || cv==19 || cv==20 || cv==29;
+}
+
+int16_t CVCache::identifiedLoco() {
+  if (progLoco && millis()-progLocoTime > CV_CACHE_HOLD) progLoco=0;
+  return progLoco;
+}
+
+bool CVCache::answer(int16_t cv, ACK_CALLBACK callback) {
+  ENTRY * e=find(identifiedLoco(), cv);
+  if (!e) return false;
+  progLocoTime=millis();
+  callback(e->value);
+  return true;
+}
+
+ACK_CALLBACK CVCache::wrap(PendingOp op, int16_t cv, int16_t value, ACK_CALLBACK callback) {
+  // DCCACK will refuse a second operation, so leave its callback alone
+  if (DCCACK::isActive()) return callback;
+  pendingOp=op;
+  pendingCv=cv;
+  pendingValue=value;
+  pendingCallback=callback;
+  return ackCallback;
+}
+
+void CVCache::ackCallback(int16_t result) {
+  int16_t loco=identifiedLoco();
+  switch (pendingOp) {
+  case PENDING_READ:
+    if (result>=0) store(loco, pendingCv, result);
+    else progLoco=0;  // no loco or a different one
+    break;
+  case PENDING_WRITE:
+    if (result==1) store(loco, pendingCv, pendingValue);
+    else forget(loco, pendingCv);
+    break;
+  case PENDING_BIT:
+    if (result==1) storeBit(loco, pendingCv, pendingValue>>1, pendingValue & 1);
+    else forget(loco, pendingCv);
+    break;
+  case PENDING_LOCOID:
+    progLoco = result>0 ? result : 0;
+    break;
+  case PENDING_SETID:
+    forgetLoco(loco);
+    if (result==1) {
+      forgetLoco(pendingValue);  // whatever was known came from another decoder
+      progLoco=pendingValue;
+    }
+    else progLoco=0;
+    break;
+  }
+  if ((pendingOp==PENDING_WRITE || pendingOp==PENDING_BIT) && isAddressCV(pendingCv)) {
+    forgetLoco(loco);
+    progLoco=0;
+  }
+  progLocoTime=millis();
+  if (pendingCallback) pendingCallback(result);
+}
+
+void CVCache::show() {
+  DIAG(F("CV cache, prog track loco %d"), identifiedLoco());
+  for (byte i=0; i<CV_CACHE_SIZE; i++)
+    if (entries[i].loco)
+      DIAG(F("  loco %d CV%d = %d"), entries[i].loco, entries[i].cv, entries[i].value);
+}
+#endif
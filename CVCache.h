@@ -0,0 +1,86 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CVCache_h
+#define CVCache_h
+#include <Arduino.h>
+#include "DCC.h"
+
+// Decoder CV values remembered per loco so that throttles reading the 
+// same CVs over and over (1, 17, 18, 29, identification) are answered at
+// once instead of by seconds of ACK programming.  Only compiled in when 
+// CV_CACHE is set in DCC.h.
+// Programming track values belong to the loco last identified there by 
+// DCC::getLocoId (<R>) or given its address by DCC::setLocoId.  Nothing 
+// is cached or answered on the programming track until a loco has been 
+// identified, nor CV_CACHE_HOLD ms after the last operation on it (the
+// loco may have been changed), after a failed read, after an address CV
+// is written or after the programming track is switched off by command.
+// Writes on main update the entry for that loco.  Writes from any path
+// update or drop the entry.  Entries are reused oldest first.
+//   <D CVCACHE>        list the entries
+//   <D CVCACHE CLEAR>  empty the cache
+#ifdef CV_CACHE
+#ifndef CV_CACHE_SIZE
+#define CV_CACHE_SIZE 32  // entries, 5 bytes each
+#endif
+#ifndef CV_CACHE_HOLD
+#define CV_CACHE_HOLD 30000 // ms
+#endif
+
+class CVCache {
+public:
+  enum PendingOp : byte { PENDING_READ, PENDING_WRITE, PENDING_BIT, PENDING_LOCOID, PENDING_SETID };
+  // Answers a prog track read from the cache, true if it did
+  static bool answer(int16_t cv, ACK_CALLBACK callback);
+  // The callback to give DCCACK so that the result updates the cache
+  // before it is passed on. value is the byte written, the bit number 
+  // and value (bitNum<<1 | bitValue) or the new loco id.
+  static ACK_CALLBACK wrap(PendingOp op, int16_t cv, int16_t value, ACK_CALLBACK callback);
+  // writes on main
+  static void store(int16_t loco, int16_t cv, byte value);
+  static void storeBit(int16_t loco, int16_t cv, byte bitNum, bool bitValue);
+  static inline void progTrackOff() { progLoco=0; }
+  static void show();
+  static void clear();
+
+private:
+  struct ENTRY {
+    int16_t loco;  // 0 for a free entry
+    int16_t cv;
+    byte value;
+  };
+  static ENTRY * find(int16_t loco, int16_t cv);
+  static void forget(int16_t loco, int16_t cv);
+  static void forgetLoco(int16_t loco);
+  static bool isAddressCV(int16_t cv);
+  static int16_t identifiedLoco();
+  static void ackCallback(int16_t result);
+
+  static ENTRY entries[CV_CACHE_SIZE];
+  static byte nextEntry;
+  static int16_t progLoco;  // 0 when not known
+  static unsigned long progLocoTime;
+  static PendingOp pendingOp;
+  static int16_t pendingCv;
+  static int16_t pendingValue;
+  static ACK_CALLBACK pendingCallback;
+};
+#endif
+#endif
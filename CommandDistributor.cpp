@@ -31,6 +31,21 @@
 #include "DCC.h"
 #include "TrackManager.h"
 #include "StringFormatter.h"
+#include "WebSocketInterface.h"
+#include "CommandTrace.h"
+
+#ifdef VLCD_DIFF
+// FNV-1a, so rows can be compared with the last text sent without
+// keeping a second copy
+static uint32_t textHash(const char * text) {
+  uint32_t hash=2166136261UL;
+  while (*text) {
+    hash ^= (byte)*text++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+#endif
 
 // variables to hold clock time
 int16_t lastclocktime;
@@ -39,18 +54,33 @@ int8_t lastclockrate;
 
 #if WIFI_ON || ETHERNET_ON || defined(SERIAL1_COMMANDS) || defined(SERIAL2_COMMANDS) || defined(SERIAL3_COMMANDS) || defined(SERIAL4_COMMANDS) || defined(SERIAL5_COMMANDS) || defined(SERIAL6_COMMANDS)
 // use a buffer to allow broadcast
-StringBuffer * CommandDistributor::broadcastBufferWriter=new StringBuffer();
+StringBuffer * CommandDistributor::broadcastBufferWriter=new StringBuffer(BROADCAST_MAX);
 template<typename... Targs> void CommandDistributor::broadcastReply(clientType type, Targs... msg){
   broadcastBufferWriter->flush();
   StringFormatter::send(broadcastBufferWriter, msg...);
   broadcastToClients(type);
 }
+template<typename... Targs> void CommandDistributor::broadcastEmit(clientType type, Targs... msg){
+  broadcastBufferWriter->flush();
+  StringFormatter::emit(broadcastBufferWriter, msg...);
+  broadcastToClients(type);
+}
 #else
 // on a single USB connection config, write direct to Serial and ignore flush/shove
 template<typename... Targs> void CommandDistributor::broadcastReply(clientType type, Targs... msg){
   (void)type; //shut up compiler warning
+#ifdef BINARY_COMMANDS
+  if (SerialManager::binaryCovered && SerialManager::isBinary(&USB_SERIAL)) return;
+#endif
   StringFormatter::send(&USB_SERIAL, msg...);
 }
+template<typename... Targs> void CommandDistributor::broadcastEmit(clientType type, Targs... msg){
+  (void)type;
+#ifdef BINARY_COMMANDS
+  if (SerialManager::binaryCovered && SerialManager::isBinary(&USB_SERIAL)) return;
+#endif
+  StringFormatter::emit(&USB_SERIAL, msg...);
+}
 #endif 
 
 #ifdef CD_HANDLE_RING
@@ -58,13 +88,51 @@ template<typename... Targs> void CommandDistributor::broadcastReply(clientType t
   RingStream *  CommandDistributor::ring=0;
   CommandDistributor::clientType  CommandDistributor::clients[8]={
     NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE};
+  CommandDistributor::SUBSCRIPTION CommandDistributor::subscriptions[8];
+  byte CommandDistributor::broadcastCategory=0;
+  int16_t CommandDistributor::broadcastId=0;
+  byte CommandDistributor::slowBroadcasts[8];
+  byte CommandDistributor::currentClients=0;
+  uint16_t CommandDistributor::currentInterval=1000;
+  unsigned long CommandDistributor::lastCurrentFrame=0;
+#ifdef CD_FAIR_SHARE
+  unsigned long CommandDistributor::clientBusyUntil[8];
+
+// One COMMAND_COST for each command in the buffer, a WiThrottle line being
+// one command. Credit saved while idle is capped by mayParse.
+void CommandDistributor::charge(byte clientId, byte * buffer) {
+  unsigned long now=millis();
+  if ((long)(now - clientBusyUntil[clientId]) > 0) clientBusyUntil[clientId]=now;
+  byte commands=0;
+  if (clients[clientId]==COMMAND_TYPE) {
+    for (byte * c=buffer; *c; c++) if (*c=='<') commands++;
+  }
+  if (commands==0) commands=1;
+  clientBusyUntil[clientId] += commands*COMMAND_COST;
+}
+#endif
 
 // Parse is called by Withrottle or Ethernet interface to determine which
 // protocol the client is using and call the appropriate part of dcc++Ex
 void  CommandDistributor::parse(byte clientId,byte * buffer, RingStream * stream) {
-  if (Diag::WIFI && Diag::CMD)
-    DIAG(F("Parse C=%d T=%d B=%s"),clientId, clients[clientId], buffer);
+  TRACE_COMMAND(clientId, buffer, strlen((char *)buffer));
+  if (Diag::WIFI)
+    DIAGLOG(Diag::CMD, F("Parse C=%d T=%d B=%s"),clientId, clients[clientId], buffer);
   ring=stream;
+#ifdef CD_LIST_STREAMS
+  // replies must not land in the middle of a list still being sent
+  LIST_STREAM * s=findListStream(clientId);
+  if (s) {
+    int length=strlen((char *)buffer);
+    if (s->heldLength+length<CD_LIST_HOLD) {
+      memcpy(s->held+s->heldLength, buffer, length);
+      s->heldLength+=length;
+      return;
+    }
+    DIAG(F("List to client %d cut short"), clientId);
+    endListStream(s); // parses the held commands before this one
+  }
+#endif
 
   // First check if the client is not known
   // yet and in that case determinine type
@@ -78,6 +146,10 @@ void  CommandDistributor::parse(byte clientId,byte * buffer, RingStream * stream
       clients[clientId]=WITHROTTLE_TYPE;
   }
 
+#ifdef CD_FAIR_SHARE
+  charge(clientId, buffer);
+#endif
+
   // mark buffer that is sent to parser
   ring->mark(clientId);
 
@@ -96,6 +168,11 @@ void  CommandDistributor::parse(byte clientId,byte * buffer, RingStream * stream
     // the buffer
     if (!ring->commit()) {
       DIAG(F("OUTBOUND FULL processing cmd:%s"),buffer);
+#ifdef CD_LIST_STREAMS
+      // the start of any list went with it
+      LIST_STREAM * s=findListStream(clientId);
+      if (s) s->clientId=RingStream::NO_CLIENT;
+#endif
     }
   } else {
     DIAG(F("CD parse: was alredy committed")); //XXX Could have been committed by broadcastClient?!
@@ -103,20 +180,296 @@ void  CommandDistributor::parse(byte clientId,byte * buffer, RingStream * stream
 }
 
 void CommandDistributor::forget(byte clientId) {
+#ifdef CD_LIST_STREAMS
+  LIST_STREAM * s=findListStream(clientId);
+  if (s) s->clientId=RingStream::NO_CLIENT;
+#endif
   if (clients[clientId]==WITHROTTLE_TYPE) WiThrottle::forget(clientId);
   clients[clientId]=NONE_TYPE;
-  if (virtualLCDClient==clientId) virtualLCDClient=RingStream::NO_CLIENT;
+  subscriptions[clientId].filtering=false;
+  slowBroadcasts[clientId]=0;
+  currentClients &= ~(1<<clientId);
+#ifdef CD_FAIR_SHARE
+  clientBusyUntil[clientId]=millis();
+#endif
+  if (virtualLCDClient==clientId) {
+    virtualLCDClient=RingStream::NO_CLIENT;
+#ifdef VLCD_DIFF
+    forgetVirtualLCDRows();
+#endif
+  }
+}
+
+// index into SUBSCRIPTION ranges, -1 if the category has no ids
+static int8_t subscriptionRange(byte category) {
+  switch (category) {
+    case CommandDistributor::SUB_LOCO:    return 0;
+    case CommandDistributor::SUB_SENSOR:  return 1;
+    case CommandDistributor::SUB_TURNOUT: return 2;
+    default: return -1;
+  }
+}
+
+// A client that has not read its share of the ring misses broadcasts
+// until it catches up, and is disconnected if it stays behind.
+// Replies to its own commands are still queued.
+bool CommandDistributor::keepingUp(byte clientId) {
+  if (ring->pending(clientId) <= ring->quota(clientId)) {
+    slowBroadcasts[clientId]=0;
+    return true;
+  }
+  if (slowBroadcasts[clientId] < SLOW_CLIENT_LIMIT) {
+    if (++slowBroadcasts[clientId] == SLOW_CLIENT_LIMIT) {
+      DIAG(F("Client %d too slow, disconnecting"), clientId);
+      ring->evict(clientId);
+    }
+  }
+  return false;
+}
+
+#ifdef CD_LIST_STREAMS
+CommandDistributor::LIST_STREAM CommandDistributor::listStreams[CD_LIST_STREAMS]={
+  {NULL,NULL,0,RingStream::NO_CLIENT,0,{0}},
+  {NULL,NULL,0,RingStream::NO_CLIENT,0,{0}},
+  {NULL,NULL,0,RingStream::NO_CLIENT,0,{0}}};
+
+CommandDistributor::LIST_STREAM * CommandDistributor::findListStream(byte clientId) {
+  for (byte i=0; i<CD_LIST_STREAMS; i++)
+    if (listStreams[i].clientId==clientId) return &listStreams[i];
+  return NULL;
+}
+
+// Bytes of list that may be written for clientId now. The closing > and
+// a short reply to someone else always still fit.
+int16_t CommandDistributor::listRoom(RingStream * ring, byte clientId) {
+  int16_t room=ring->freeSpace();
+  int16_t quota=ring->quota(clientId)-ring->pending(clientId);
+  if (quota<room) room=quota;
+  return room-16;
+}
+
+// Close the list, complete or not, and parse what its client sent meanwhile
+void CommandDistributor::endListStream(LIST_STREAM * s) {
+  byte clientId=s->clientId;
+  RingStream * r=s->ring;
+  byte held[CD_LIST_HOLD];
+  byte heldLength=s->heldLength;
+  memcpy(held, s->held, heldLength);
+  held[heldLength]=0;
+  s->clientId=RingStream::NO_CLIENT;
+  r->mark(clientId);
+  StringFormatter::send(r, F(">\n"));
+  r->commit();
+  if (heldLength) parse(clientId, held, r);
+}
+#endif
+
+bool CommandDistributor::listing(byte clientId) {
+#ifdef CD_LIST_STREAMS
+  return findListStream(clientId)!=NULL;
+#else
+  (void)clientId;
+  return false;
+#endif
+}
+
+bool CommandDistributor::wants(byte clientId) {
+  if (broadcastCategory==SUB_CURRENT) return currentClients & (1<<clientId);
+  SUBSCRIPTION & s=subscriptions[clientId];
+  if (!s.filtering || broadcastCategory==0) return true;
+  if (!(s.categories & broadcastCategory)) return false;
+  int8_t r=subscriptionRange(broadcastCategory);
+  if (r<0) return true;
+  return broadcastId>=s.from[r] && broadcastId<=s.to[r];
 }
 #endif 
 
+void CommandDistributor::sendList(Print * stream, const FSH * header, LIST_WRITER writer,
+                                  REPLY_QUERY query, uint16_t generation) {
+#ifdef REPLY_CACHE
+  if (query!=REPLY_NONE && sendCachedList(stream, header, writer, query, generation)) return;
+#else
+  (void)query; (void)generation;
+#endif
+  StringFormatter::send(stream, header);
+  uint16_t position=0;
+#ifdef CD_LIST_STREAMS
+  if (ring && stream==ring) {
+    byte clientId=ring->peekTargetMark();
+    if (clientId<sizeof(clients) && !findListStream(clientId)) {
+      if (writer(stream, position, listRoom(ring, clientId))) {
+        StringFormatter::send(stream, F(">\n"));
+        return;
+      }
+      LIST_STREAM * s=findListStream(RingStream::NO_CLIENT);
+      if (s) {
+        s->ring=ring;
+        s->writer=writer;
+        s->position=position;
+        s->clientId=clientId;
+        s->heldLength=0;
+        return;
+      }
+      // no free slot, so the reply overflows as it always did
+    }
+  }
+#endif
+  while (!writer(stream, position, INT16_MAX)) {}
+  StringFormatter::send(stream, F(">\n"));
+}
+
+#ifdef REPLY_CACHE
+// The list is cached whole, header to closing >. False if it is too long
+// to cache, or a network client has no room for it now and must get it
+// in chunks as usual.
+bool CommandDistributor::sendCachedList(Print * stream, const FSH * header, LIST_WRITER writer,
+                                        REPLY_QUERY query, uint16_t generation) {
+  uint16_t length;
+  const char * reply=ReplyCache::get(query, generation, length);
+  if (!reply) {
+    Print * capture=ReplyCache::begin();
+    StringFormatter::send(capture, header);
+    uint16_t position=0;
+    while (!writer(capture, position, INT16_MAX)) {}
+    StringFormatter::send(capture, F(">\n"));
+    reply=ReplyCache::end(query, generation, length);
+    if (!reply) return false;
+  }
+#ifdef CD_LIST_STREAMS
+  if (ring && stream==ring) {
+    byte clientId=ring->peekTargetMark();
+    if (clientId<sizeof(clients) && !findListStream(clientId)
+        && (int16_t)length>listRoom(ring, clientId)) return false;
+  }
+#endif
+  stream->write((const uint8_t *)reply, length);
+  return true;
+}
+#endif
+
+// Called from loop(). Each streaming client gets one more chunk if the 
+// ring has space, and when its list is complete any commands held back.
+void CommandDistributor::streamLists() {
+#ifdef CD_LIST_STREAMS
+  for (byte i=0; i<CD_LIST_STREAMS; i++) {
+    LIST_STREAM * s=&listStreams[i];
+    if (s->clientId==RingStream::NO_CLIENT) continue;
+    RingStream * r=s->ring;
+    if (r->peekTargetMark()!=RingStream::NO_CLIENT) return; // mid reply
+    int16_t room=listRoom(r, s->clientId);
+    if (room<LIST_ENTRY_SIZE) continue; // wait for the client to read
+    r->mark(s->clientId);
+    bool done=s->writer(r, s->position, room);
+    r->commit();
+    if (done) endListStream(s);
+  }
+#endif
+}
+
+bool CommandDistributor::holdCommands(Print * stream, byte * rest) {
+#ifdef CD_LIST_STREAMS
+  if (!ring || stream!=ring) return false;
+  LIST_STREAM * s=findListStream(ring->peekTargetMark());
+  if (!s) return false;
+  int length=strlen((char *)rest);
+  if (length<CD_LIST_HOLD) {
+    memcpy(s->held, rest, length);
+    s->heldLength=length;
+    return true;
+  }
+  // Too much to hold, so end the list here and parse the rest at once
+  // rather than lose part of it.
+  byte clientId=s->clientId;
+  DIAG(F("List to client %d cut short"), clientId);
+  if (ring->commit()) endListStream(s);
+  else s->clientId=RingStream::NO_CLIENT; // the start of the list went too
+  ring->mark(clientId);
+  return false;
+#else
+  (void)stream; (void)rest;
+  return false;
+#endif
+}
+
+bool CommandDistributor::subscribe(byte category, int16_t from, int16_t to) {
+#ifdef CD_HANDLE_RING
+  if (!ring) return false;
+  byte clientId=ring->peekTargetMark();
+  if (clientId>=sizeof(clients)) return false; // not a network client
+  SUBSCRIPTION & s=subscriptions[clientId];
+  if (category==SUB_ALL) {
+    s.filtering=false;
+    return true;
+  }
+  if (!s.filtering) {
+    s.filtering=true;
+    s.categories=0;
+  }
+  s.categories|=category;
+  int8_t r=subscriptionRange(category);
+  if (r>=0) {
+    s.from[r]=from;
+    s.to[r]=to;
+  }
+  return true;
+#else
+  (void)category; (void)from; (void)to;
+  return false; // serial clients always get everything
+#endif
+}
+
+// <JI ms> from a network client: send it <jI> every ms, 0 to stop.
+// The rate is shared by all streaming clients, the last request wins.
+bool CommandDistributor::subscribeCurrent(uint16_t interval) {
+#ifdef CD_HANDLE_RING
+  if (!ring) return false;
+  byte clientId=ring->peekTargetMark();
+  if (clientId>=sizeof(clients)) return false; // not a network client
+  if (interval==0) {
+    currentClients &= ~(1<<clientId);
+    return true;
+  }
+  currentInterval = interval<CURRENT_STREAM_MIN ? CURRENT_STREAM_MIN : interval;
+  currentClients |= 1<<clientId;
+  return true;
+#else
+  (void)interval;
+  return false; // serial clients poll with <JI>
+#endif
+}
+
+void CommandDistributor::streamCurrent() {
+#ifdef CD_HANDLE_RING
+  if (currentClients==0 || !ring) return;
+  unsigned long now=millis();
+  if (now-lastCurrentFrame < currentInterval) return;
+  lastCurrentFrame=now;
+  broadcastSubject(SUB_CURRENT,0);
+  broadcastBufferWriter->flush();
+  TrackManager::reportCurrent(broadcastBufferWriter);
+  broadcastToClients(COMMAND_TYPE);
+  broadcastSubject(0,0);
+#endif
+}
+
 // This will not be called on a uno 
 void CommandDistributor::broadcastToClients(clientType type) {
 
   byte rememberClient;
   (void)rememberClient; // shut up compiler warning
 
+  bool toSerial=(type==COMMAND_TYPE);
+#ifdef CD_HANDLE_RING
+  if (broadcastCategory==SUB_CURRENT) toSerial=false; // streamed to subscribers only
+#endif
   // Broadcast to Serials
-  if (type==COMMAND_TYPE) SerialManager::broadcast(broadcastBufferWriter->getString());
+  const char * message=broadcastBufferWriter->getString();
+  int16_t length=broadcastBufferWriter->length();
+  if (toSerial) SerialManager::broadcast(message, length);
+#if defined(ARDUINO_ARCH_ESP32)
+  // one unfragmented frame shared by all browser clients
+  if (toSerial) WebSocketInterface::broadcast(message, length);
+#endif
 
 #ifdef CD_HANDLE_RING
   // If we are broadcasting from a wifi/eth process we need to complete its output
@@ -127,16 +480,24 @@ void CommandDistributor::broadcastToClients(clientType type) {
       //DIAG(F("CD precommit client %d"), rememberClient);
       ring->commit();
     }
-    // loop through ring clients
+    // Collect the ring clients that want this and write the
+    // message once for all of them
+    byte clientMask=0;
+    byte clientCount=0;
+    byte lastClient=0;
     for (byte clientId=0; clientId<sizeof(clients); clientId++) {
-      if (clients[clientId]==type)  {
-	//DIAG(F("CD mark client %d"), clientId);
-	ring->mark(clientId);
-	ring->print(broadcastBufferWriter->getString());
-	//DIAG(F("CD commit client %d"), clientId);
-	ring->commit();
+      if (clients[clientId]==type && wants(clientId) && !listing(clientId) && keepingUp(clientId))  {
+	clientMask |= 1<<clientId;
+	clientCount++;
+	lastClient=clientId;
       }
     }
+    if (clientCount) {
+      if (clientCount==1) ring->mark(lastClient);
+      else ring->markMulticast(clientMask);
+      ring->write((const uint8_t *)message, length);
+      ring->commit();
+    }
     // at this point ring is committed (NO_CLIENT) either from
     // 4 or 13 lines above.
     if (rememberClient != RingStream::NO_CLIENT) {
@@ -148,18 +509,84 @@ void CommandDistributor::broadcastToClients(clientType type) {
 }
 
 // Public broadcast functions below 
+#ifdef HAS_ENOUGH_MEMORY
+CommandDistributor::BATCH_ENTRY CommandDistributor::batchPending[BATCH_PENDING];
+byte CommandDistributor::batchCount=0;
+bool CommandDistributor::batching=false;
+
+void CommandDistributor::beginBatch() {
+  batching=true;
+  batchCount=0;
+}
+
+void CommandDistributor::endBatch() {
+  batching=false;
+  for (byte i=0; i<batchCount; i++) {
+    BATCH_ENTRY & e=batchPending[i];
+    if (e.kind & BATCH_TURNOUT) broadcastTurnout(e.id, e.kind & BATCH_STATE);
+    else broadcastSensor(e.id, e.kind & BATCH_STATE);
+  }
+  batchCount=0;
+}
+
+// returns false if the broadcast must be sent now
+bool CommandDistributor::deferBroadcast(int16_t id, byte kind) {
+  if (!batching) return false;
+  for (byte i=0; i<batchCount; i++) {
+    if (batchPending[i].id==id && (batchPending[i].kind & BATCH_TURNOUT)==(kind & BATCH_TURNOUT)) {
+      batchPending[i].kind=kind;
+      return true;
+    }
+  }
+  if (batchCount>=BATCH_PENDING) return false;
+  batchPending[batchCount].id=id;
+  batchPending[batchCount].kind=kind;
+  batchCount++;
+  return true;
+}
+#endif
+
 void  CommandDistributor::broadcastSensor(int16_t id, bool on ) {
-  broadcastReply(COMMAND_TYPE, F("<%c %d>\n"), on?'Q':'q', id);
+#ifdef HAS_ENOUGH_MEMORY
+  if (deferBroadcast(id, on ? BATCH_STATE : 0)) return;
+#endif
+  TRACE_SENSOR(id, on);
+  broadcastSubject(SUB_SENSOR,id);
+#ifdef BINARY_COMMANDS
+  SerialManager::broadcastBinary(on?'Q':'q', &id, 1);
+  SerialManager::binaryCovered=true;
+#endif
+  broadcastEmit(COMMAND_TYPE, on?F("<Q "):F("<q "), id, F(">\n"));
+#ifdef BINARY_COMMANDS
+  SerialManager::binaryCovered=false;
+#endif
+  broadcastSubject(0,0);
 }
 
 void  CommandDistributor::broadcastTurnout(int16_t id, bool isClosed ) {
+#ifdef HAS_ENOUGH_MEMORY
+  if (deferBroadcast(id, BATCH_TURNOUT | (isClosed ? BATCH_STATE : 0))) return;
+#endif
+  TRACE_TURNOUT(id, isClosed);
+  broadcastSubject(SUB_TURNOUT,id);
   // For DCC++ classic compatibility, state reported to JMRI is 1 for thrown and 0 for closed;
   // The string below contains serial and Withrottle protocols which should
   // be safe for both types.
+#ifdef BINARY_COMMANDS
+  {
+    int16_t p[]={id, !isClosed};
+    SerialManager::broadcastBinary('H', p, 2);
+  }
+  SerialManager::binaryCovered=true;
+#endif
   broadcastReply(COMMAND_TYPE, F("<H %d %d>\n"),id, !isClosed);
+#ifdef BINARY_COMMANDS
+  SerialManager::binaryCovered=false;
+#endif
 #ifdef CD_HANDLE_RING
   broadcastReply(WITHROTTLE_TYPE, F("PTA%c%d\n"), isClosed?'2':'4', id);
 #endif
+  broadcastSubject(0,0);
 }
 
 void CommandDistributor::broadcastTurntable(int16_t id, uint8_t position, bool moving) {
@@ -208,13 +635,27 @@ int16_t CommandDistributor::retClockTime() {
 }
 
 void  CommandDistributor::broadcastLoco(byte slot) {
-  DCC::LOCO * sp=&DCC::speedTable[slot];
-  broadcastReply(COMMAND_TYPE, F("<l %d %d %d %l>\n"), sp->loco,slot,sp->speedCode,sp->functions);
+  broadcastSubject(SUB_LOCO,DCC::speedTable.loco[slot]);
+  int loco=DCC::speedTable.loco[slot];
+  byte speedCode=DCC::speedTable.speedCode[slot];
+#ifdef BINARY_COMMANDS
+  {
+    uint32_t functions=DCC::speedTable.functions[slot];
+    int16_t p[]={(int16_t)loco, slot, speedCode, (int16_t)(functions>>16), (int16_t)functions};
+    SerialManager::broadcastBinary('l', p, 5);
+  }
+  SerialManager::binaryCovered=true;
+#endif
+  broadcastEmit(COMMAND_TYPE, F("<l "), loco, ' ', slot, ' ', speedCode, ' ',
+                (long)DCC::speedTable.functions[slot], F(">\n"));
+#ifdef BINARY_COMMANDS
+  SerialManager::binaryCovered=false;
+#endif
 #ifdef SABERTOOTH
-  if (Serial2 && sp->loco == SABERTOOTH) {
+  if (Serial2 && loco == SABERTOOTH) {
     static uint8_t rampingmode = 0;
-    bool direction = (sp->speedCode & 0x80) !=0; // true for forward
-    int32_t speed = sp->speedCode & 0x7f;
+    bool direction = (speedCode & 0x80) !=0; // true for forward
+    int32_t speed = speedCode & 0x7f;
     if (speed == 1) { // emergency stop
       if (rampingmode != 1) {
 	rampingmode = 1;
@@ -244,51 +685,29 @@ void  CommandDistributor::broadcastLoco(byte slot) {
   }
 #endif
 #ifdef CD_HANDLE_RING
-  WiThrottle::markForBroadcast(sp->loco);
+  WiThrottle::markForBroadcast(loco);
 #endif
+  broadcastSubject(0,0);
 }
 
 void  CommandDistributor::broadcastForgetLoco(int16_t loco) {
+  broadcastSubject(SUB_LOCO,loco);
   broadcastReply(COMMAND_TYPE, F("<l %d 0 1 0>\n<- %d>\n"), loco,loco);
+  broadcastSubject(0,0);
 }
 
-void  CommandDistributor::broadcastPower() {
+void  CommandDistributor::broadcastPower(byte tracks) {
+  broadcastSubject(SUB_POWER,0);
   char pstr[] = "? x";
-  byte trackcount=0;
-  byte oncount=0;
-  byte offcount=0;
   uint8_t numTracks = TrackManager::numTracks();
   {
     char trackLetter[numTracks+1];
-    trackLetter[numTracks] = '\0';
 
     for(byte t=0; t<numTracks; t++) {
-      if (TrackManager::getPower(t, pstr))
+      if ((tracks & (1<<t)) && TrackManager::getPower(t, pstr))
 	broadcastReply(COMMAND_TYPE, F("<p%s>\n"),pstr);
-      if (TrackManager::isActive(t)) {
-	trackcount++;
-	// do not call getPower(t) unless isActive(t)!
-	if (TrackManager::getPower(t) == POWERMODE::ON) {
-	  oncount++;
-	  trackLetter[t] = t + 'A';
-	} else if (TrackManager::getPower(t) == POWERMODE::OFF) {
-	  offcount++;
-	  trackLetter[t] = t + 'a';
-	} else {
-	  trackLetter[t] = 'X';
-	}
-      } else {
-	trackLetter[t] = '_';
-      }
-    }
-    //DIAG(F("t=%d on=%d off=%d"), trackcount, oncount, offcount);
-
-    char state='2';
-    if (oncount==0 || offcount == trackcount) // none on or all active off
-      state = '0';
-    else if (oncount == numTracks) {          // all on, no inactive tracks
-      state = '1';
     }
+    char state=powerState(trackLetter);
 
     if (state != '2')
       broadcastReply(COMMAND_TYPE, F("<p%c>\n"),state);
@@ -322,6 +741,44 @@ void  CommandDistributor::broadcastPower() {
     LCD(2,F("PWR %s%S"),trackLetter ,reason);
 #endif
   }
+  broadcastSubject(0,0);
+}
+
+// '0' none on or all active off, '1' all on and no inactive tracks,
+// '2' anything else. trackLetter, if given, gets a letter per track,
+// upper case on, lower case off.
+char CommandDistributor::powerState(char * trackLetter) {
+  byte trackcount=0;
+  byte oncount=0;
+  byte offcount=0;
+  uint8_t numTracks = TrackManager::numTracks();
+  char unused;
+  for(byte t=0; t<numTracks; t++) {
+    char & letter = trackLetter ? trackLetter[t] : unused;
+    if (TrackManager::isActive(t)) {
+      trackcount++;
+      // do not call getPower(t) unless isActive(t)!
+      if (TrackManager::getPower(t) == POWERMODE::ON) {
+        oncount++;
+        letter = t + 'A';
+      } else if (TrackManager::getPower(t) == POWERMODE::OFF) {
+        offcount++;
+        letter = t + 'a';
+      } else {
+        letter = 'X';
+      }
+    } else {
+      letter = '_';
+    }
+  }
+  if (trackLetter) trackLetter[numTracks] = '\0';
+  //DIAG(F("t=%d on=%d off=%d"), trackcount, oncount, offcount);
+
+  if (oncount==0 || offcount == trackcount) // none on or all active off
+    return '0';
+  if (oncount == numTracks)                 // all on, no inactive tracks
+    return '1';
+  return '2';
 }
 
 void CommandDistributor::broadcastRaw(clientType type, char * msg) {
@@ -333,6 +790,15 @@ void CommandDistributor::broadcastMessage(char * message) {
   broadcastReply(WITHROTTLE_TYPE, F("Hm%s\n"),message);
 }
 
+void CommandDistributor::broadcastFar(clientType type, uint32_t strfar) {
+  broadcastReply(type, F("%F"), (unsigned long)strfar);
+}
+
+void CommandDistributor::broadcastFarMessage(uint32_t strfar) {
+  broadcastReply(COMMAND_TYPE, F("<m \"%F\">\n"), (unsigned long)strfar);
+  broadcastReply(WITHROTTLE_TYPE, F("Hm%F\n"), (unsigned long)strfar);
+}
+
 void CommandDistributor::broadcastTrackState(const FSH* format, byte trackLetter, const FSH *modename, int16_t dcAddr) {
   broadcastReply(COMMAND_TYPE, format, trackLetter, modename, dcAddr);
 }
@@ -346,6 +812,49 @@ void  CommandDistributor::broadcastRouteCaption(int16_t routeId, const FSH* capt
 }
 
 Print * CommandDistributor::getVirtualLCDSerial(byte screen, byte row) {
+#ifdef VLCD_DIFF
+  // the row is collected here and compared in commitVirtualLCDSerial
+  if (!virtualLCDSerial && virtualLCDClient==RingStream::NO_CLIENT) return NULL;
+  if (!vlcdLine) vlcdLine=new VLCDLine();
+  if (!vlcdLine) return NULL;
+  vlcdLine->start(screen, row);
+  return vlcdLine;
+#else
+  return beginVirtualLCDRow(screen, row);
+#endif
+}
+
+void CommandDistributor::commitVirtualLCDSerial() {
+#ifdef VLCD_DIFF
+  char * text=vlcdLine->text;
+  VLCD_ROW * r=findVirtualLCDRow(vlcdLine->screen, vlcdLine->row);
+  if (vlcdLine->tooLong) {
+    if (vlcdLine->direct) endVirtualLCDRow();
+    // the table no longer knows what the client shows in this row
+    if (r) r->state=VLCD_FREE;
+    return;
+  }
+  if (!r) {
+    Print * stream=beginVirtualLCDRow(vlcdLine->screen, vlcdLine->row);
+    if (stream) {
+      stream->write(text, vlcdLine->length);
+      endVirtualLCDRow();
+    }
+    return;
+  }
+  uint32_t hash=textHash(text);
+  if (r->state!=VLCD_FREE && hash==r->sent) {
+    r->state=VLCD_SENT; // unchanged, or changed back before it was sent
+    return;
+  }
+  strcpy(r->text, text);
+  r->state=VLCD_PENDING;
+#else
+  endVirtualLCDRow();
+#endif
+}
+
+Print * CommandDistributor::beginVirtualLCDRow(byte screen, byte row) {
   Print * stream=virtualLCDSerial;
   #ifdef  CD_HANDLE_RING
   rememberVLCDClient=RingStream::NO_CLIENT;
@@ -364,7 +873,7 @@ Print * CommandDistributor::getVirtualLCDSerial(byte screen, byte row) {
   return stream;  
 }
 
-void CommandDistributor::commitVirtualLCDSerial() {
+void CommandDistributor::endVirtualLCDRow() {
   #ifdef  CD_HANDLE_RING
   if (virtualLCDClient!=RingStream::NO_CLIENT) {
     StringFormatter::send(ring,F("\">\n"));
@@ -377,6 +886,9 @@ void CommandDistributor::commitVirtualLCDSerial() {
 }
 
 void CommandDistributor::setVirtualLCDSerial(Print * stream) {
+#ifdef VLCD_DIFF
+  forgetVirtualLCDRows(); // a new client gets every row again
+#endif
   #ifdef  CD_HANDLE_RING
   virtualLCDClient=RingStream::NO_CLIENT;
   if (stream && stream->availableForWrite()==RingStream::THIS_IS_A_RINGSTREAM) {
@@ -391,3 +903,78 @@ void CommandDistributor::setVirtualLCDSerial(Print * stream) {
 Print* CommandDistributor::virtualLCDSerial=&USB_SERIAL;
 byte CommandDistributor::virtualLCDClient=0xFF;
 byte CommandDistributor::rememberVLCDClient=0;
+
+#ifdef VLCD_DIFF
+CommandDistributor::VLCD_ROW * CommandDistributor::vlcdRows=NULL;
+CommandDistributor::VLCDLine * CommandDistributor::vlcdLine=NULL;
+
+void CommandDistributor::VLCDLine::start(byte toScreen, byte toRow) {
+  screen=toScreen;
+  row=toRow;
+  tooLong=false;
+  direct=NULL;
+  length=0;
+  text[0]='\0';
+}
+
+size_t CommandDistributor::VLCDLine::write(uint8_t b) {
+  if (!tooLong && length<VLCD_TEXT_MAX) {
+    text[length++]=b;
+    text[length]='\0';
+    return 1;
+  }
+  if (!tooLong) {
+    // send what there is so far and the rest as it comes
+    tooLong=true;
+    direct=beginVirtualLCDRow(screen, row);
+    if (direct) direct->write(text, length);
+  }
+  return direct ? direct->write(b) : 0;
+}
+
+bool CommandDistributor::virtualLCDOnUSB() {
+  return virtualLCDSerial==&USB_SERIAL;
+}
+
+// The table entry of a row, or a free one for it. NULL if full.
+CommandDistributor::VLCD_ROW * CommandDistributor::findVirtualLCDRow(byte screen, byte row) {
+  if (!vlcdRows) {
+    vlcdRows=(VLCD_ROW *)calloc(VLCD_ROWS, sizeof(VLCD_ROW));
+    if (!vlcdRows) return NULL;
+  }
+  VLCD_ROW * unused=NULL;
+  for (byte i=0; i<VLCD_ROWS; i++) {
+    VLCD_ROW * r=&vlcdRows[i];
+    if (r->state==VLCD_FREE) {
+      if (!unused) unused=r;
+    }
+    else if (r->screen==screen && r->row==row) return r;
+  }
+  if (unused) {
+    unused->screen=screen;
+    unused->row=row;
+  }
+  return unused;
+}
+
+void CommandDistributor::forgetVirtualLCDRows() {
+  if (vlcdRows) memset(vlcdRows, 0, VLCD_ROWS*sizeof(VLCD_ROW));
+}
+
+// Called from loop() every VLCD_REFRESH_MS to send the rows that
+// changed since, each once with its latest text.
+void CommandDistributor::flushVirtualLCD() {
+  if (!vlcdRows) return;
+  for (byte i=0; i<VLCD_ROWS; i++) {
+    VLCD_ROW * r=&vlcdRows[i];
+    if (r->state!=VLCD_PENDING) continue;
+    Print * stream=beginVirtualLCDRow(r->screen, r->row);
+    if (stream) {
+      stream->write(r->text, strlen(r->text));
+      endVirtualLCDRow();
+    }
+    r->sent=textHash(r->text);
+    r->state=VLCD_SENT;
+  }
+}
+#endif
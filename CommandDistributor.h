@@ -28,21 +28,134 @@
 #include "StringBuffer.h"
 #include "defines.h"
 #include "EXRAIL2.h"
+#include "ReplyCache.h"
 
 #if WIFI_ON | ETHERNET_ON 
   // Command Distributor must handle a RingStream of clients
   #define CD_HANDLE_RING
 #endif 
+// Longest broadcast, formatted once and written from the same buffer to 
+// every serial, ring and websocket client. Fits the serial output queue.
+#ifndef BROADCAST_MAX
+  #if defined(ARDUINO_ARCH_AVR)
+    #define BROADCAST_MAX 120
+  #else
+    #define BROADCAST_MAX 500
+  #endif
+#endif
+#if defined(CD_HANDLE_RING) && defined(HAS_ENOUGH_MEMORY)
+  // <J> lists too long for the outbound ring are sent in chunks, 
+  // see sendList
+  #define CD_LIST_STREAMS 3
+  #define CD_LIST_HOLD 64  // bytes of commands held per streaming client
+#endif
+#if defined(CD_HANDLE_RING) && defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_FAIR_SHARE)
+  // Each network client may send CD_CLIENT_RATE commands a second, in
+  // bursts of up to CD_CLIENT_BURST. A client over its share is not read
+  // by the interface until it is back under, so its commands wait in the
+  // socket rather than hold up everyone else. 32 bytes of RAM.
+  #define CD_FAIR_SHARE
+  #ifndef CD_CLIENT_RATE
+    #define CD_CLIENT_RATE 100
+  #endif
+  #ifndef CD_CLIENT_BURST
+    #define CD_CLIENT_BURST 32
+  #endif
+#endif
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_VDPY) && !defined(DISABLE_VLCD_DIFF)
+  // Virtual LCD rows (<@ screen row "text">) are held in a row table and
+  // sent from loop() at most once per VLCD_REFRESH_MS, and only if the
+  // text differs from what the client was last sent. Rows longer than
+  // VLCD_TEXT_MAX, or with no room left in the table, go out at once.
+  #define VLCD_DIFF
+  #ifndef VLCD_ROWS
+    #if defined(ARDUINO_ARCH_AVR)
+      #define VLCD_ROWS 8
+    #else
+      #define VLCD_ROWS 32
+    #endif
+  #endif
+  #ifndef VLCD_TEXT_MAX
+    #define VLCD_TEXT_MAX 40
+  #endif
+  #ifndef VLCD_REFRESH_MS
+    #define VLCD_REFRESH_MS 100
+  #endif
+#endif
 
 class CommandDistributor {
 public:
   enum clientType: byte {NONE_TYPE,COMMAND_TYPE,WITHROTTLE_TYPE};
+  // Broadcast categories a network client can subscribe to with <JS>
+  enum : byte {SUB_LOCO=0x01, SUB_SENSOR=0x02, SUB_TURNOUT=0x04, SUB_POWER=0x08, SUB_ALL=0xFF};
+  // Current frames are only sent to clients that asked for them with <JI ms>
+  enum : byte {SUB_CURRENT=0x10};
+  static const uint16_t CURRENT_STREAM_MIN=100; // ms
 private:
   static void broadcastToClients(clientType type);
+  static inline void broadcastSubject(byte category, int16_t id) {
+  #ifdef CD_HANDLE_RING
+    broadcastCategory=category;
+    broadcastId=id;
+  #else
+    (void)category; (void)id;
+  #endif
+  }
   static StringBuffer * broadcastBufferWriter;
   #ifdef CD_HANDLE_RING
     static RingStream * ring;
     static clientType clients[8];
+    // Clients that have not subscribed get everything.
+    // Ranges are indexed loco, sensor, turnout.
+    struct SUBSCRIPTION {
+      bool filtering;
+      byte categories;
+      int16_t from[3];
+      int16_t to[3];
+    };
+    static SUBSCRIPTION subscriptions[8];
+    static byte broadcastCategory;  // 0 for broadcasts no one can filter
+    static int16_t broadcastId;
+    static bool wants(byte clientId);
+    // broadcasts skipped in a row because the client is over its quota
+    static byte slowBroadcasts[8];
+    static const byte SLOW_CLIENT_LIMIT=50;
+    static bool keepingUp(byte clientId);
+    static bool listing(byte clientId);   // part way through a sendList
+    static byte currentClients;           // bit per client streaming <jI>
+    static uint16_t currentInterval;      // ms between frames
+    static unsigned long lastCurrentFrame;
+  #endif
+  #ifdef CD_FAIR_SHARE
+    static const unsigned long COMMAND_COST=1000UL/CD_CLIENT_RATE; // ms
+    // when each client will have spent its commands so far
+    static unsigned long clientBusyUntil[8];
+    static void charge(byte clientId, byte * buffer);
+  #endif
+public :
+  // Writes one id list entry after another from position, moving position
+  // on, while they fit in room bytes. Returns true after the last entry.
+  typedef bool (*LIST_WRITER)(Print * stream, uint16_t & position, int16_t room);
+  static const byte LIST_ENTRY_SIZE=7; // " -32768"
+  static const byte SNAPSHOT_ENTRY_SIZE=32; // longest <JZ> line, an <l>
+private :
+  #ifdef CD_LIST_STREAMS
+    struct LIST_STREAM {
+      RingStream * ring;
+      LIST_WRITER writer;
+      uint16_t position;
+      byte clientId;      // NO_CLIENT when the slot is free
+      byte heldLength;
+      byte held[CD_LIST_HOLD]; // commands that arrived during the list
+    };
+    static LIST_STREAM listStreams[CD_LIST_STREAMS];
+    static LIST_STREAM * findListStream(byte clientId);
+    static int16_t listRoom(RingStream * ring, byte clientId);
+    static void endListStream(LIST_STREAM * s);
+  #endif
+  #ifdef REPLY_CACHE
+    static bool sendCachedList(Print * stream, const FSH * header, LIST_WRITER writer,
+                               REPLY_QUERY query, uint16_t generation);
   #endif
 public :
   static void parse(byte clientId,byte* buffer, RingStream * ring);
@@ -54,23 +167,102 @@ public :
   static void broadcastClockTime(int16_t time, int8_t rate);
   static void setClockTime(int16_t time, int8_t rate, byte opt);
   static int16_t retClockTime();
-  static void broadcastPower();
+  // <p> for each of tracks, all by default, then the summary lines
+  static void broadcastPower(byte tracks=0xFF);
+  // summary state for <p0>, <p1> or none ('2'), see broadcastPower
+  static char powerState(char * trackLetter=NULL);
   static void broadcastRaw(clientType type,char * msg);
   static void broadcastTrackState(const FSH* format,byte trackLetter, const FSH* modename, int16_t dcAddr);
   template<typename... Targs> static void broadcastReply(clientType type, Targs... msg);
+  // as broadcastReply but the pieces go through StringFormatter::emit
+  template<typename... Targs> static void broadcastEmit(clientType type, Targs... msg);
   static void forget(byte clientId);
+#ifdef CD_FAIR_SHARE
+  // Interfaces: false while the client has used up its share, leave its
+  // data unread until then. Only reads state so may be called from core 0.
+  static inline bool mayParse(byte clientId) {
+    return (long)(clientBusyUntil[clientId] - millis()) < (long)(CD_CLIENT_BURST*COMMAND_COST);
+  }
+#else
+  static inline bool mayParse(byte clientId) { (void)clientId; return true; }
+#endif
+  // subscribe the network client being parsed, SUB_ALL resets
+  static bool subscribe(byte category, int16_t from, int16_t to);
+  static bool subscribeCurrent(uint16_t interval);
+  static void streamCurrent();
   static void broadcastRouteState(int16_t routeId,byte state);
   static void broadcastRouteCaption(int16_t routeId,const FSH * caption);
   static void broadcastMessage(char * message);
+  // the same from EXRAIL strings in HIGHFLASH, see StringFormatter::printFar
+  static void broadcastFar(clientType type, uint32_t strfar);
+  static void broadcastFarMessage(uint32_t strfar);
+  // Sends header, the entries from writer and the closing >. A network
+  // client gets at most its ring quota now and the rest from streamLists
+  // as the ring drains. It misses broadcasts meanwhile, and any commands
+  // it sends wait until the list is complete.
+  // A query and generation make the whole list a cached reply, see ReplyCache.h
+  static void sendList(Print * stream, const FSH * header, LIST_WRITER writer,
+                       REPLY_QUERY query=REPLY_NONE, uint16_t generation=0);
+  static void streamLists();
+  // DCCEXParser: true if the rest of a command buffer must wait
+  static bool holdCommands(Print * stream, byte * rest);
+#ifdef HAS_ENOUGH_MEMORY
+  // Hold back turnout and sensor broadcasts, keeping only the
+  // latest state of each, until endBatch
+  static void beginBatch();
+  static void endBatch();
+#endif
   
   // Handling code for virtual LCD receiver.
   static Print * getVirtualLCDSerial(byte screen, byte row);
   static void commitVirtualLCDSerial();
   static void setVirtualLCDSerial(Print * stream); 
+#ifdef VLCD_DIFF
+  static bool virtualLCDOnUSB();
+  static void flushVirtualLCD();
+#endif
   private:
     static Print * virtualLCDSerial;
     static byte virtualLCDClient;
     static byte rememberVLCDClient;
+    static Print * beginVirtualLCDRow(byte screen, byte row);
+    static void endVirtualLCDRow();
+#ifdef VLCD_DIFF
+    enum : byte { VLCD_FREE, VLCD_SENT, VLCD_PENDING };
+    struct VLCD_ROW {
+      byte screen;
+      byte row;
+      byte state;
+      uint32_t sent; // hash of the text last sent
+      char text[VLCD_TEXT_MAX+1];
+    };
+    static VLCD_ROW * vlcdRows;
+    // Collects a row for the table. A row that turns out longer than
+    // VLCD_TEXT_MAX is streamed straight out from there on instead.
+    class VLCDLine : public Print {
+    public:
+      size_t write(uint8_t b) override;
+      void start(byte toScreen, byte toRow);
+      byte screen;
+      byte row;
+      bool tooLong;
+      Print * direct;   // where a long row is going, NULL if nowhere
+      uint16_t length;
+      char text[VLCD_TEXT_MAX+1];
+    };
+    static VLCDLine * vlcdLine;
+    static VLCD_ROW * findVirtualLCDRow(byte screen, byte row);
+    static void forgetVirtualLCDRows();
+#endif
+#ifdef HAS_ENOUGH_MEMORY
+    static const byte BATCH_PENDING=16;
+    enum : byte { BATCH_TURNOUT=0x02, BATCH_STATE=0x01 };
+    struct BATCH_ENTRY { int16_t id; byte kind; };
+    static BATCH_ENTRY batchPending[BATCH_PENDING];
+    static byte batchCount;
+    static bool batching;
+    static bool deferBroadcast(int16_t id, byte kind);
+#endif
 };
 
 #endif
@@ -52,6 +52,10 @@
 #include "DCCEX.h"
 #include "Display_Implementation.h"
 #include "WebSocketInterface.h"
+#include "LoopProfile.h"
+#include "LoopScheduler.h"
+#include "DiagLog.h"
+#include "HotRestart.h"
 
 #ifdef ARDUINO_ARCH_ESP32
 #include "Sniffer.h"
@@ -108,7 +112,16 @@ void setup()
     LCD(1,F("Lic GPLv3"));
   );
 
-  // Responsibility 2: Start all the communications before the DCC engine
+  // Responsibility 2: Start the DCC engine (EEPROM contents and the
+  // waveform) before the communications, as bringing up the network can
+  // take many seconds and the track should have a signal meanwhile.
+  DCC::begin();
+#ifdef HOT_RESTART
+  HotRestart::begin();  // resume locos and tracks after a watchdog reset
+#endif
+  DIAG(F("DCC running %Lms after reset"), millis());
+
+  // Responsibility 3: Start all the communications
   // Start the WiFi interface on a MEGA, Uno cannot currently handle WiFi
   // Start Ethernet if it exists
 #ifndef ARDUINO_ARCH_ESP32
@@ -126,9 +139,6 @@ void setup()
   EthernetInterface::setup();
 #endif // ETHERNET_ON
   
-  // Responsibility 3: Start the DCC engine.
-  DCC::begin();
-
   // Start RMFT aka EX-RAIL (ignored if no automnation)
   RMFT::begin();
 
@@ -154,12 +164,20 @@ WebSocketInterface::setup();
   LCN_SERIAL.begin(115200);
   LCN::init(LCN_SERIAL);
   #endif
+
+  #if defined(TRACE_SERIAL)
+  TRACE_SERIAL.begin(TRACE_SERIAL_SPEED);
+  CommandTrace::init(TRACE_SERIAL);
+  #endif
   LCD(3, F("Ready"));
   CommandDistributor::broadcastPower();
+  DIAG(F("Setup complete %Lms after reset"), millis());
 }
 
 void loop()
 {
+  LOOP_PROFILE_BEGIN();
+  LoopScheduler::begin();
 #ifdef ARDUINO_ARCH_ESP32
 #ifdef BOOSTER_INPUT
   static bool oldactive = false;
@@ -169,25 +187,36 @@ void loop()
       RMFT2::railsyncEvent(newactive);
       oldactive = newactive;
     }
-    DCCPacket p = dccSniffer->fetchPacket();
-    if (p.len() != 0) {
+    // drain the ring, each packet is parsed in place
+    while (true) {
+      DCCPacket p = dccSniffer->peekPacket();
+      if (p.len() == 0) break;
       if (DCCDecoder::parse(p)) {
 	if (Diag::SNIFFER)
 	  p.print();
       }
+      dccSniffer->releasePacket();
     }
+    static uint32_t oldoverruns = 0;
+    uint32_t overruns = dccSniffer->getOverruns();
+    if (Diag::SNIFFER && overruns != oldoverruns)
+      DIAG(F("Sniffer overruns %l errors %l"), overruns, dccSniffer->getErrors());
+    oldoverruns = overruns;
   }
 #endif // BOOSTER_INPUT
 #endif // ARDUINO_ARCH_ESP32
+  LOOP_PROFILE_MARK(SNIFFER);
 
   // The main sketch has responsibilities during loop()
 
   // Responsibility 1: Handle DCC background processes
   //                   (loco reminders and power checks)
   DCC::loop();
+  LOOP_PROFILE_MARK(DCC);
  
   // Responsibility 2: handle any incoming commands on USB connection
   SerialManager::loop();
+  LOOP_PROFILE_MARK(SERIAL);
  
   // Responsibility 3: Optionally handle any incoming WiFi traffic
 #ifndef ARDUINO_ARCH_ESP32
@@ -198,34 +227,79 @@ void loop()
 #else  //ARDUINO_ARCH_ESP32
 #ifndef WIFI_TASK_ON_CORE0
   WifiESP::loop();
+#else
+  WifiESP::parseLoop();  // network I/O itself is on core 0
 #endif
 #endif //ARDUINO_ARCH_ESP32
+  LOOP_PROFILE_MARK(WIFI);
 #if ETHERNET_ON
   EthernetInterface::loop();
 #endif
-  
+  LOOP_PROFILE_MARK(ETHERNET);
+  CommandDistributor::streamLists(); // rest of long <J> lists to network clients
   
 
   RMFT::loop();  // ignored if no automation
+#ifdef TURNOUT_PACING
+  Turnout::paceLoop();  // queued solenoid throws
+#endif
+  LOOP_PROFILE_MARK(RMFT);
 
   #if defined(LCN_SERIAL)
   LCN::loop();
   #endif
+  LOOP_PROFILE_MARK(LCN);
 
-  // Display refresh
-  DisplayInterface::loop();
+  #if defined(TRACE_SERIAL)
+  CommandTrace::loop();
+  #endif
 
   // Handle/update IO devices.
   IODevice::loop();
+  LOOP_PROFILE_MARK(IO);
 
   Sensor::checkAll(); // Update and print changes
+  LOOP_PROFILE_MARK(SENSORS);
+
+  // Background work from here on, only in time left over (see LoopScheduler.h)
+
+  // Display refresh
+  static unsigned long lastDisplay = 0;
+  if (LoopScheduler::due(lastDisplay)) DisplayInterface::loop();
+#ifdef VLCD_DIFF
+  static unsigned long lastVirtualLCD = 0;
+  if (LoopScheduler::due(lastVirtualLCD, VLCD_REFRESH_MS)) CommandDistributor::flushVirtualLCD();
+#endif
+  LOOP_PROFILE_MARK(DISPLAY);
+
+#ifndef DISABLE_EEPROM
+  static unsigned long lastEEStore = 0;
+  if (LoopScheduler::due(lastEEStore)) EEStore::loop(); // Write any queued state changes
+#endif
+#ifdef HOT_RESTART
+  static unsigned long lastHotRestart = 0;
+  if (LoopScheduler::due(lastHotRestart)) HotRestart::loop(); // snapshot changes for a restart
+#endif
+  LOOP_PROFILE_MARK(EEPROM);
+
+#ifdef DIAG_LOG
+  DiagLog::loop(); // Write a queued category diag
+#endif
+  LOOP_PROFILE_MARK(DIAGLOG);
 
   // Report any decrease in memory (will automatically trigger on first call)
   static int ramLowWatermark = __INT_MAX__; // replaced on first loop
-
-  int freeNow = DCCTimer::getMinimumFreeMemory();
-  if (freeNow < ramLowWatermark) {
-    ramLowWatermark = freeNow;
-    LCD(3,F("Free RAM=%5db"), ramLowWatermark);
+  static unsigned long lastMemory = 0;
+  if (LoopScheduler::due(lastMemory, 100)) {
+    int freeNow = DCCTimer::getMinimumFreeMemory();
+    if (freeNow < ramLowWatermark) {
+      ramLowWatermark = freeNow;
+      LCD(3,F("Free RAM=%5db"), ramLowWatermark);
+    }
   }
+  LOOP_PROFILE_MARK(MEMORY);
+
+#ifdef USB_PACKETS
+  USB_SERIAL.flush(); // send whatever this pass left part way through a packet
+#endif
 }
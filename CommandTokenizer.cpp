@@ -0,0 +1,115 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CommandTokenizer.h"
+
+void CommandTokenizer::begin(int16_t * _result, bool _usehex) {
+  result=_result;
+  usehex=_usehex;
+  state=1;
+  parameterCount=0;
+  runningValue=0;
+  signNegative=false;
+  // clear all parameters in case not enough found
+  for (byte i = 0; i < DCCEXParser::MAX_COMMAND_PARAMS; i++)
+    result[i] = 0;
+}
+
+CommandTokenizer::RESULT CommandTokenizer::feed(byte & hot, int16_t offset) {
+  for (;;) {
+    switch (state) {
+    case 1: // skipping spaces before a param
+      if (hot == ' ')
+        return TOKEN_MORE;
+      if (hot == '\0')
+        return TOKEN_ERROR;
+      if (hot == '>') {
+        hot = '\0';  // terminate the cmd string with 0 instead of '>'
+        state = 0;
+        return TOKEN_DONE;
+      }
+      state = 2;
+      continue;
+
+    case 2: // checking sign or quoted string
+#ifdef HAS_ENOUGH_MEMORY
+      if (hot == '"') {
+        // this inserts an extra parameter 0x7777 in front
+        // of each string parameter as a marker that can
+        // be checked that a string parameter follows
+        // This clashes of course with the real value
+        // 0x7777 which we hope is used seldom
+        if (parameterCount + 2 >= DCCEXParser::MAX_COMMAND_PARAMS)
+          return TOKEN_ERROR;
+        result[parameterCount++] = (int16_t)0x7777;
+        result[parameterCount++] = offset + 1;
+        state = 4;
+        return TOKEN_MORE;
+      }
+#endif
+      signNegative = false;
+      runningValue = 0;
+      state = 3;
+      if (hot != '-')
+        continue;
+      signNegative = true;
+      return TOKEN_MORE;
+
+    case 3: { // building a parameter
+      byte c = hot;
+      if (c >= '0' && c <= '9') {
+        runningValue = (usehex?16:10) * runningValue + (c - '0');
+        return TOKEN_MORE;
+      }
+      if (c >= 'a' && c <= 'z') c=c-'a'+'A'; // uppercase a..z
+      if (usehex && c>='A' && c<='F') {
+        // treat A..F as hex not keyword
+        runningValue = 16 * runningValue + (c - 'A' + 10);
+        return TOKEN_MORE;
+      }
+      if (c=='_' || (c >= 'A' && c <= 'Z')) {
+        // Since JMRI got modified to send keywords in some rare cases, we need this
+        // Super Kluge to turn keywords into a hash value that can be recognised later
+        runningValue = ((runningValue << 5) + runningValue) ^ c;
+        return TOKEN_MORE;
+      }
+      result[parameterCount++] = runningValue * (signNegative ? -1 : 1);
+      if (parameterCount >= DCCEXParser::MAX_COMMAND_PARAMS)
+        return TOKEN_ERROR;
+      state = 1;
+      continue;
+    }
+
+#ifdef HAS_ENOUGH_MEMORY
+    case 4: // skipover text
+      if (hot == '\0')        // We did run to end of buffer without finding the "
+        return TOKEN_ERROR;
+      if (hot == '"') {
+        hot = '\0'; // overwrite " in command buffer with the end-of-string
+        state = 1;
+      }
+      return TOKEN_MORE;
+#endif
+
+    default: // already done
+      return TOKEN_ERROR;
+    }
+  }
+}
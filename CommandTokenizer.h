@@ -0,0 +1,50 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CommandTokenizer_h
+#define CommandTokenizer_h
+#include <Arduino.h>
+#include "DCCEXParser.h"
+
+// CommandTokenizer splits the parameters of a command one character
+// at a time, so it can be fed as bytes arrive on a stream and the
+// parameters are ready when the closing '>' is seen.
+// Characters are passed by reference because the end of a quoted
+// string and the closing '>' are overwritten with '\0' in the caller's
+// buffer, as parseOne expects. Keywords are hashed as in KeywordHasher.h.
+
+class CommandTokenizer {
+public:
+  enum RESULT : byte { TOKEN_MORE, TOKEN_DONE, TOKEN_ERROR };
+
+  // start splitting the parameters following an opcode
+  void begin(int16_t * result, bool usehex);
+  // offset is the position of hot counted from the opcode
+  RESULT feed(byte & hot, int16_t offset);
+  inline byte count() { return parameterCount; }
+
+private:
+  int16_t * result;
+  int16_t runningValue;
+  byte state;
+  byte parameterCount;
+  bool signNegative;
+  bool usehex;
+};
+#endif
@@ -0,0 +1,142 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CommandTrace.h"
+#if defined(TRACE_SERIAL)
+
+Stream * CommandTrace::stream=NULL;
+bool CommandTrace::unbuffered=false;
+bool CommandTrace::active=false;
+byte CommandTrace::ring[TRACE_BUFFER_SIZE];
+uint16_t CommandTrace::head=0;
+uint16_t CommandTrace::tail=0;
+uint16_t CommandTrace::lost=0;
+unsigned long CommandTrace::lastMicros=0;
+
+void CommandTrace::init(Stream & traceStream) {
+  stream=&traceStream;
+  // The port has been started, so its TX buffer is empty.
+  unbuffered=stream->availableForWrite() <= 0;
+}
+
+void CommandTrace::setActive(bool on) {
+  if (on && !active) {
+    active=true;
+    lastMicros=micros();
+    if (!begin(TRACE_RECORD_START, 5)) return;
+    put(FORMAT_VERSION);
+    put32(lastMicros);
+  }
+  active=on;
+}
+
+// Write as much of the ring as the port will take without blocking
+void CommandTrace::loop() {
+  if (!stream) return;
+  while (tail != head) {
+    uint16_t length = (head > tail ? head : TRACE_BUFFER_SIZE) - tail;
+    if (!unbuffered) {
+      int room = stream->availableForWrite();
+      if (room <= 0) return;
+      if (length > (uint16_t)room) length = room;
+    }
+    stream->write(ring + tail, length);
+    tail = (tail + length) % TRACE_BUFFER_SIZE;
+  }
+}
+
+// Start a record if there is room for it, preceded by a TIME record if 
+// the gap since the last one does not fit in 16 bits and a LOST record 
+// if any have been dropped.
+bool CommandTrace::begin(TraceRecordType type, byte length) {
+  if (!active) return false;
+  unsigned long now=micros();
+  unsigned long delta=now - lastMicros;
+  uint16_t needed=HEADER_SIZE + length;
+  if (delta > 0xFFFF) needed += HEADER_SIZE + 4;
+  if (lost) needed += HEADER_SIZE + 2;
+  uint16_t used=(head + TRACE_BUFFER_SIZE - tail) % TRACE_BUFFER_SIZE;
+  if (needed > TRACE_BUFFER_SIZE - 1 - used) {
+    if (lost < 0xFFFF) lost++;
+    return false;
+  }
+  if (delta > 0xFFFF) {
+    put(TRACE_RECORD_TIME); put(4); put16(0);
+    put32(now);
+    delta=0;
+  }
+  if (lost) {
+    put(TRACE_RECORD_LOST); put(2); put16(delta);
+    put16(lost);
+    lost=0;
+    delta=0;
+  }
+  put(type); put(length); put16(delta);
+  lastMicros=now;
+  return true;
+}
+
+void CommandTrace::put(byte b) {
+  ring[head]=b;
+  head=(head + 1) % TRACE_BUFFER_SIZE;
+}
+
+void CommandTrace::put16(uint16_t value) {
+  put(value & 0xFF);
+  put(value >> 8);
+}
+
+void CommandTrace::put32(uint32_t value) {
+  put16(value & 0xFFFF);
+  put16(value >> 16);
+}
+
+// Serial commands arrive without the < > which are put back here, along 
+// with any closing quotes the tokenizer has replaced with '\0'.
+void CommandTrace::command(byte clientId, const byte * text, byte length) {
+  bool serial = clientId == TRACE_SERIAL_CLIENT;
+  if (length > 252) length=252;
+  if (!begin(TRACE_RECORD_COMMAND, length + (serial ? 3 : 1))) return;
+  put(clientId);
+  if (serial) put('<');
+  for (byte i=0; i<length; i++) put(text[i] ? text[i] : '"');
+  if (serial) put('>');
+}
+
+void CommandTrace::packet(bool mainTrack, byte priority, byte repeats, const byte * data, byte length) {
+  if (!begin(TRACE_RECORD_PACKET, length + 3)) return;
+  put(mainTrack ? 0 : 1);
+  put(priority);
+  put(repeats);
+  for (byte i=0; i<length; i++) put(data[i]);
+}
+
+void CommandTrace::sensor(int16_t id, bool state) {
+  if (!begin(TRACE_RECORD_SENSOR, 3)) return;
+  put16(id);
+  put(state);
+}
+
+void CommandTrace::turnout(int16_t id, bool closed) {
+  if (!begin(TRACE_RECORD_TURNOUT, 3)) return;
+  put16(id);
+  put(closed);
+}
+#endif
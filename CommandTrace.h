@@ -0,0 +1,97 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CommandTrace_h
+#define CommandTrace_h
+#include <Arduino.h>
+#include "defines.h"
+
+// Binary trace of inbound commands, scheduled DCC packets and sensor and 
+// turnout changes, only compiled in when TRACE_SERIAL is defined in 
+// config.h, e.g.
+//   #define TRACE_SERIAL Serial3
+// Recording is started and stopped by <D TRACE ON/OFF>.  Records are 
+// collected in a ring of TRACE_BUFFER_SIZE bytes and written to 
+// TRACE_SERIAL in the main loop.  If the ring fills up, records are 
+// dropped and counted in a TRACE_RECORD_LOST record.  The trace can be 
+// replayed by the host benchmark (host/HostBench.cpp -b).
+//
+// Each record is a type byte, a payload length byte, the microseconds 
+// since the previous record (16 bits, little endian) then the payload:
+//   START    version, micros() (32 bits)
+//   TIME     micros() (32 bits), when the gap is too long for 16 bits
+//   COMMAND  client id (TRACE_SERIAL_CLIENT for serial), command text
+//   PACKET   track (0 main, 1 prog), priority, repeats, packet bytes
+//   SENSOR   sensor id (16 bits), state
+//   TURNOUT  turnout id (16 bits), closed
+//   LOST     records dropped (16 bits)
+enum TraceRecordType : byte {
+  TRACE_RECORD_START, TRACE_RECORD_TIME, TRACE_RECORD_COMMAND, 
+  TRACE_RECORD_PACKET, TRACE_RECORD_SENSOR, TRACE_RECORD_TURNOUT, TRACE_RECORD_LOST
+};
+
+#if defined(TRACE_SERIAL)
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 1024
+#endif
+#ifndef TRACE_SERIAL_SPEED
+#define TRACE_SERIAL_SPEED 115200
+#endif
+
+class CommandTrace {
+public:
+  static const byte FORMAT_VERSION = 1;
+  static const byte TRACE_SERIAL_CLIENT = 0xFF;
+  static const byte HEADER_SIZE = 4;
+
+  static void init(Stream & stream);
+  static void loop();
+  static void setActive(bool on);
+  static void command(byte clientId, const byte * text, byte length);  // serial: without < >
+  static void packet(bool mainTrack, byte priority, byte repeats, const byte * data, byte length);
+  static void sensor(int16_t id, bool state);
+  static void turnout(int16_t id, bool closed);
+
+private:
+  static bool begin(TraceRecordType type, byte length);
+  static void put(byte b);
+  static void put16(uint16_t value);
+  static void put32(uint32_t value);
+  static Stream * stream;
+  static bool unbuffered;  // port can't say how much room it has
+  static bool active;
+  static byte ring[TRACE_BUFFER_SIZE];
+  static uint16_t head;   // next byte to be written
+  static uint16_t tail;   // next byte to be sent
+  static uint16_t lost;
+  static unsigned long lastMicros;
+};
+
+#define TRACE_COMMAND(client, text, length) CommandTrace::command(client, text, length)
+#define TRACE_PACKET(main, priority, repeats, data, length) \
+  CommandTrace::packet(main, priority, repeats, data, length)
+#define TRACE_SENSOR(id, state) CommandTrace::sensor(id, state)
+#define TRACE_TURNOUT(id, closed) CommandTrace::turnout(id, closed)
+#else
+#define TRACE_COMMAND(client, text, length)
+#define TRACE_PACKET(main, priority, repeats, data, length)
+#define TRACE_SENSOR(id, state)
+#define TRACE_TURNOUT(id, closed)
+#endif
+#endif
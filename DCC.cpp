@@ -37,6 +37,9 @@
 #include "CommandDistributor.h"
 #include "TrackManager.h"
 #include "DCCTimer.h"
+#include "Railcom.h"
+#include "DCCConsist.h"
+#include "CVCache.h"
 
 // This module is responsible for converting API calls into
 // messages to be sent to the waveform generator.
@@ -57,10 +60,31 @@ const byte FN_GROUP_3=0x04;
 const byte FN_GROUP_4=0x08;
 const byte FN_GROUP_5=0x10;
 
+// Reminder scheduling weights.
+// Speed is reminded on every visit to a loco. After a speed change the
+// loco gets REMINDER_BOOST extra speed reminders interleaved with the
+// normal round robin. Function groups are reminded on every visit
+// for FN_REMINDER_FRESH cycles after a function change, after that
+// only on one cycle in (FN_REMINDER_SLOW_MASK+1).
+const byte REMINDER_BOOST=3;
+const byte FN_REMINDER_FRESH=16;
+const byte FN_REMINDER_SLOW_MASK=0x07;
+#ifdef LOCO_EXT_FUNCTIONS
+// F29 and up are mostly sound and rarely changed, so at an even lower rate
+const byte FN_REMINDER_EXT_SLOW_MASK=0x1F;
+const byte FN_GROUP_EXT=0xD8;  // 1101 1GGG feature expansion, group 0 is F29-F36
+const byte REMINDER_PHASES=6+EXT_FN_GROUPS; // speed, 5 basic groups, extended groups
+#else
+const byte REMINDER_PHASES=6;  // speed and 5 function groups
+#endif
+
 FSH* DCC::shieldName=NULL;
 byte DCC::globalSpeedsteps=128;
 
 void DCC::begin() {
+#ifdef LOCO_TABLE_GROWS
+  growTable();
+#endif
   StringFormatter::send(&USB_SERIAL,F("<iDCC-EX V-%S / %S / %S G-%S>\n"), F(VERSION), F(ARDUINO_TYPE), shieldName, F(GITHUB_SHA));
 #ifndef DISABLE_EEPROM
   // Load stuff from EEprom
@@ -70,22 +94,92 @@ void DCC::begin() {
 #ifndef ARDUINO_ARCH_ESP32 /* On ESP32 started in TrackManager::setTrackMode() */
   DCCWaveform::begin();
 #endif
+#ifdef RAILCOM_SERIAL
+  Railcom::begin();
+#endif
 }
 
 
 void DCC::setThrottle( uint16_t cab, uint8_t tSpeed, bool tDirection)  {
   byte speedCode = (tSpeed & 0x7F)  + tDirection * 128;
-  setThrottle2(cab, speedCode);
+#ifdef LOCO_MOMENTUM
+  // A loco with momentum just gets a new target, issueMomentum does the 
+  // rest. Emergency stops and broadcasts happen at once and end any ramp.
+  if (cab != 0 && (tSpeed & 0x7F) != 1) {
+    int reg=lookupSpeedTable(cab, true);
+    if (reg>=0 && (speedTable.accelRate[reg] || speedTable.decelRate[reg])) {
+      if (speedTable.speedCode[reg]==speedTable.targetSpeedCode[reg])
+        speedTable.momentumCredit[reg]=0;  // starting a new ramp
+      speedTable.targetSpeedCode[reg]=speedCode;
+      if (speedTable.speedCode[reg]!=speedCode && !momentumPending) {
+        momentumPending=true;
+        lastMomentumTick=millis();
+      }
+      return;
+    }
+  }
+#endif
+  applyThrottle(cab, speedCode);
+#ifdef LOCO_MOMENTUM
+  if (cab==0) {
+    for (int reg = 0; reg <= highestUsedReg; reg++) 
+      speedTable.targetSpeedCode[reg]=speedTable.speedCode[reg];
+  }
+  else {
+    int reg=lookupSpeedTable(cab, false);
+    if (reg>=0) speedTable.targetSpeedCode[reg]=speedCode;
+  }
+#endif
+}
+
+// Send a speed change and make it the one reminded
+void DCC::applyThrottle(uint16_t cab, byte speedCode) {
+  setThrottle2(cab, speedCode, (speedCode & 0x7F)==1 ? PRIORITY_ESTOP : PRIORITY_THROTTLE);
   TrackManager::setDCSignal(cab,speedCode); // in case this is a dcc track on this addr
   // retain speed for loco reminders
   updateLocoReminder(cab, speedCode );
 }
 
-void DCC::setThrottle2( uint16_t cab, byte speedCode)  {
-
+void DCC::setThrottle2( uint16_t cab, byte speedCode, PACKET_PRIORITY priority)  {
   uint8_t b[4];
-  uint8_t nB = 0;
   // DIAG(F("setSpeedInternal %d %x"),cab,speedCode);
+#ifdef LOCO_CONSISTS
+  DCCConsist::CONSIST * consist=DCCConsist::findLegacy(cab);
+  if (consist) {
+    for (byte i=0; i<CONSIST_MEMBERS && consist->member[i]; i++) {
+      int16_t member=consist->member[i];
+      uint8_t nB = buildSpeedPacket(b, abs(member), member<0 ? speedCode ^ 0x80 : speedCode);
+      scheduleLoco(abs(member), b, nB, 0, priority);
+    }
+    return;
+  }
+#endif
+  uint8_t nB = buildSpeedPacket(b, cab, speedCode);
+  scheduleLoco(cab, b, nB, 0, priority);
+}
+
+// Loco packets go out on the MAIN stream of the loco's district, or on
+// all of them for a loco in no district. Reminders stay on the stream
+// being reminded.
+void DCC::scheduleLoco(int cab, const byte b[], byte nB, byte repeats, PACKET_PRIORITY priority) {
+#ifdef DCC_DISTRICTS
+  if (reminderStream!=ALL_STREAMS) {
+    DCCWaveform::mainStream(reminderStream).schedulePacket(b, nB, repeats, priority);
+    return;
+  }
+  int reg=lookupSpeedTable(cab, false);
+  if (reg>=0 && speedTable.district[reg]) 
+    DCCWaveform::mainStream(speedTable.district[reg]-1).schedulePacket(b, nB, repeats, priority);
+  else DCCWaveform::scheduleMain(b, nB, repeats, priority);
+#else
+  (void)cab;
+  DCCWaveform::mainTrack.schedulePacket(b, nB, repeats, priority);
+#endif
+}
+
+// Fills b with the speed packet (without checksum) and returns its length
+byte DCC::buildSpeedPacket(byte b[], uint16_t cab, byte speedCode) {
+  uint8_t nB = 0;
 
   if (cab > HIGHEST_SHORT_ADDR)
     b[nB++] = highByte(cab) | 0xC0;    // convert train number into a two-byte address
@@ -118,14 +212,47 @@ void DCC::setThrottle2( uint16_t cab, byte speedCode)  {
     b[nB++] = speedCode; // for encoding see setThrottle
 
   }
+  return nB;
+}
 
-  DCCWaveform::mainTrack.schedulePacket(b, nB, 0);
+// Speed reminders reuse the packet built at the last speed change
+void DCC::remindSpeed(int reg) {
+#ifdef DCC_PACKET_STATS
+  noteRefresh(reg);
+#endif
+#ifdef LOCO_PACKET_CACHE
+#ifdef LOCO_CONSISTS
+  if (DCCConsist::findLegacy(speedTable.loco[reg])) {
+    setThrottle2(speedTable.loco[reg], speedTable.speedCode[reg], PRIORITY_REMINDER);
+    return;
+  }
+#endif
+  if (speedTable.speedPacketLength[reg]==0)
+    speedTable.speedPacketLength[reg]=buildSpeedPacket(speedTable.speedPacket[reg],
+                                                       speedTable.loco[reg], speedTable.speedCode[reg]);
+  scheduleLoco(speedTable.loco[reg], speedTable.speedPacket[reg], speedTable.speedPacketLength[reg],
+               0, PRIORITY_REMINDER);
+#else
+  setThrottle2(speedTable.loco[reg], speedTable.speedCode[reg], PRIORITY_REMINDER);
+#endif
+}
+
+void DCC::setGlobalSpeedsteps(byte s) {
+  globalSpeedsteps = s;
+#ifdef LOCO_PACKET_CACHE
+  // speed step mode changes the encoding of every speed packet
+  memset(speedTable.speedPacketLength, 0, tableSlots);
+#endif
 }
 
-void DCC::setFunctionInternal(int cab, byte byte1, byte byte2, byte count) {
+void DCC::setFunctionInternal(int cab, byte byte1, byte byte2, byte count, PACKET_PRIORITY priority) {
   // DIAG(F("setFunctionInternal %d %x %x"),cab,byte1,byte2);
   byte b[4];
   byte nB = 0;
+#ifdef LOCO_CONSISTS
+  DCCConsist::CONSIST * consist=DCCConsist::findLegacy(cab);
+  if (consist) cab=abs(consist->member[0]);  // functions go to the lead loco
+#endif
 
   if (cab > HIGHEST_SHORT_ADDR)
     b[nB++] = highByte(cab) | 0xC0;    // convert train number into a two-byte address
@@ -133,7 +260,7 @@ void DCC::setFunctionInternal(int cab, byte byte1, byte byte2, byte count) {
   if (byte1!=0) b[nB++] = byte1;
   b[nB++] = byte2;
 
-  DCCWaveform::mainTrack.schedulePacket(b, nB, count);
+  scheduleLoco(cab, b, nB, count, priority);
 }
 
 // returns speed steps 0 to 127 (1 == emergency stop)
@@ -141,7 +268,7 @@ void DCC::setFunctionInternal(int cab, byte byte1, byte byte2, byte count) {
 int8_t DCC::getThrottleSpeed(int cab) {
   int reg=lookupSpeedTable(cab, true);
   if (reg<0) return -1;
-  return speedTable[reg].speedCode & 0x7F;
+  return speedTable.speedCode[reg] & 0x7F;
 }
 
 // returns speed code byte
@@ -150,7 +277,7 @@ uint8_t DCC::getThrottleSpeedByte(int cab) {
   int reg=lookupSpeedTable(cab, true);
   if (reg<0)
     return 128;
-  return speedTable[reg].speedCode;
+  return speedTable.speedCode[reg];
 }
 
 // returns 0 to 7 for frequency
@@ -163,8 +290,8 @@ uint8_t DCC::getThrottleFrequency(int cab) {
   if (reg<0)
     return 0; // use default frequency
   // shift out first 29 bits so we have the 3 "frequency bits" left
-  uint8_t res = (uint8_t)(speedTable[reg].functions >>29);
-  //DIAG(F("Speed table %d functions %l shifted %d"), reg, speedTable[reg].functions, res);
+  uint8_t res = (uint8_t)(speedTable.functions[reg] >>29);
+  //DIAG(F("Speed table %d functions %l shifted %d"), reg, speedTable.functions[reg], res);
   return res;
 #endif
 }
@@ -174,7 +301,7 @@ uint8_t DCC::getThrottleFrequency(int cab) {
 bool DCC::getThrottleDirection(int cab) {
   int reg=lookupSpeedTable(cab, true);
   if (reg<0) return true;
-  return (speedTable[reg].speedCode & 0x80) !=0;
+  return (speedTable.speedCode[reg] & 0x80) !=0;
 }
 
 // Set function to value on or off
@@ -183,22 +310,41 @@ bool DCC::setFn( int cab, int16_t functionNumber, bool on) {
   if (functionNumber < 0) return false;
 
   if (functionNumber>28) {
-    //non reminding advanced binary bit set
-    byte b[5];
-    byte nB = 0;
-    if (cab > HIGHEST_SHORT_ADDR)
-      b[nB++] = highByte(cab) | 0xC0;    // convert train number into a two-byte address
-    b[nB++] = lowByte(cab);
-    if (functionNumber <= 127) {
-       b[nB++] = 0b11011101;   // Binary State Control Instruction short form
-       b[nB++] = functionNumber | (on ? 0x80 : 0);
-    }
-    else  {
-       b[nB++] = 0b11000000;   // Binary State Control Instruction long form
-       b[nB++] = (functionNumber & 0x7F) | (on ? 0x80 : 0);  // low order bits and state flag
-       b[nB++] = functionNumber >>7 ;  // high order bits
+#ifdef LOCO_EXT_FUNCTIONS
+    // kept, sent at once in its group of 8 and then by the reminders
+    if (functionNumber<=MAX_EXT_FUNCTION) {
+      int reg = lookupSpeedTable(cab, true);
+      if (reg<0) return false;
+      byte bit=functionNumber-29;
+      byte & group=speedTable.extFunctions[reg][bit>>3];
+      byte previous=group;
+      if (on) group |= 1<<(bit & 7);
+      else group &= ~(1<<(bit & 7));
+      if (group!=previous) {
+        setFunctionInternal(cab, FN_GROUP_EXT+(bit>>3), group, 0, PRIORITY_THROTTLE);
+        speedTable.extGroupFlags[reg] |= 1<<(bit>>3);
+        speedTable.functionAge[reg]=0;
+      }
+    } else
+#endif
+    {
+      //non reminding advanced binary bit set
+      byte b[5];
+      byte nB = 0;
+      if (cab > HIGHEST_SHORT_ADDR)
+        b[nB++] = highByte(cab) | 0xC0;    // convert train number into a two-byte address
+      b[nB++] = lowByte(cab);
+      if (functionNumber <= 127) {
+         b[nB++] = 0b11011101;   // Binary State Control Instruction short form
+         b[nB++] = functionNumber | (on ? 0x80 : 0);
+      }
+      else  {
+         b[nB++] = 0b11000000;   // Binary State Control Instruction long form
+         b[nB++] = (functionNumber & 0x7F) | (on ? 0x80 : 0);  // low order bits and state flag
+         b[nB++] = functionNumber >>7 ;  // high order bits
+      }
+      scheduleLoco(cab, b, nB, 4, PRIORITY_THROTTLE);
     }
-    DCCWaveform::mainTrack.schedulePacket(b, nB, 4);
   }
   // We use the reminder table up to 28 for normal functions.
   // We use 29 to 31 for DC frequency as well so up to 28
@@ -212,21 +358,41 @@ bool DCC::setFn( int cab, int16_t functionNumber, bool on) {
 
   // Take care of functions:
   // Set state of function
-  uint32_t previous=speedTable[reg].functions;
+  uint32_t previous=speedTable.functions[reg];
   uint32_t funcmask = (1UL<<functionNumber);
   if (on) {
-      speedTable[reg].functions |= funcmask;
+      speedTable.functions[reg] |= funcmask;
   } else {
-      speedTable[reg].functions &= ~funcmask;
+      speedTable.functions[reg] &= ~funcmask;
   }
-  if (speedTable[reg].functions != previous) {
-    if (functionNumber <= 28)
-      updateGroupflags(speedTable[reg].groupFlags, functionNumber);
-    CommandDistributor::broadcastLoco(reg);
+  if (speedTable.functions[reg] != previous) {
+    if (functionNumber <= 28) {
+      updateGroupflags(speedTable.groupFlags[reg], functionNumber);
+      speedTable.functionAge[reg]=0;
+    }
+    markForBroadcast(reg);
   }
   return true;
 }
 
+#ifdef HOT_RESTART
+void DCC::restoreLoco(int cab, byte speedCode, uint32_t functions) {
+  int reg=lookupSpeedTable(cab, true);
+  if (reg<0) return;
+  speedTable.speedCode[reg]=speedCode;
+#ifdef LOCO_MOMENTUM
+  speedTable.targetSpeedCode[reg]=speedCode;
+#endif
+  invalidateSpeedPacket(reg);
+  speedTable.functions[reg]=functions;
+  for (byte f=0; f<=28; f++)
+    if (functions & (1UL<<f)) updateGroupflags(speedTable.groupFlags[reg], f);
+  speedTable.speedBoost[reg]=REMINDER_BOOST;
+  boostPending=true;
+  markForBroadcast(reg);
+}
+#endif
+
 // Flip function state (used from withrottle protocol)
 void DCC::changeFn( int cab, int16_t functionNumber) {
   auto currentValue=getFn(cab,functionNumber);
@@ -237,14 +403,26 @@ void DCC::changeFn( int cab, int16_t functionNumber) {
 // Report function state (used from withrottle protocol)
 // returns 0 false, 1 true or -1 for do not know
 int8_t DCC::getFn( int cab, int16_t functionNumber) {
+#ifdef LOCO_EXT_FUNCTIONS
+  if (cab<=0 || functionNumber<0 || functionNumber>MAX_EXT_FUNCTION)
+    return -1;  // unknown
+  int reg = lookupSpeedTable(cab, false);
+  if (reg<0)
+    return -1;
+  if (functionNumber>31) {
+    byte bit=functionNumber-29;
+    return (speedTable.extFunctions[reg][bit>>3] >> (bit & 7)) & 1;
+  }
+#else
   if (cab<=0 || functionNumber>31)
     return -1;  // unknown
   int reg = lookupSpeedTable(cab, false);
   if (reg<0)
     return -1;
+#endif
 
   unsigned long funcmask = (1UL<<functionNumber);
-  return  (speedTable[reg].functions & funcmask)? 1 : 0;
+  return  (speedTable.functions[reg] & funcmask)? 1 : 0;
 }
 
 // Set the group flag to say we have touched the particular group.
@@ -262,7 +440,7 @@ void DCC::updateGroupflags(byte & flags, int16_t functionNumber) {
 uint32_t DCC::getFunctionMap(int cab) {
   if (cab<=0) return 0;  // unknown pretend all functions off
   int reg = lookupSpeedTable(cab, false);
-  return (reg<0)?0:speedTable[reg].functions;
+  return (reg<0)?0:speedTable.functions[reg];
 }
 
 // saves DC frequency (0..3) in spare functions 29,30,31
@@ -271,15 +449,33 @@ void DCC::setDCFreq(int cab,byte freq) {
   auto reg=lookupSpeedTable(cab,true);
   if (reg < 0) return;
   // drop and replace F29,30,31 (top 3 bits) 
-  auto newFunctions=speedTable[reg].functions & 0x1FFFFFFFUL;
+  auto newFunctions=speedTable.functions[reg] & 0x1FFFFFFFUL;
   if (freq==1)      newFunctions |= (1UL<<29); // F29
   else if (freq==2) newFunctions |= (1UL<<30); // F30
   else if (freq==3) newFunctions |= (1UL<<31); // F31
-  if (newFunctions==speedTable[reg].functions) return; // no change 
-  speedTable[reg].functions=newFunctions;
-  CommandDistributor::broadcastLoco(reg);
+  if (newFunctions==speedTable.functions[reg]) return; // no change 
+  speedTable.functions[reg]=newFunctions;
+  markForBroadcast(reg);
+  // a DC track running this loco changes frequency now
+  TrackManager::setDCSignal(cab,speedTable.speedCode[reg]);
+}
+
+#ifdef DC_KICKSTART
+void DCC::setDCKick(int cab, byte ms) {
+  if (cab==0) return;
+  auto reg=lookupSpeedTable(cab,true);
+  if (reg < 0) return;
+  speedTable.dcKick[reg]=ms;
 }
 
+// returns 0 for no kick-start or "loco not found"
+byte DCC::getThrottleKick(int cab) {
+  int reg=lookupSpeedTable(cab, false);
+  if (reg<0) return 0;
+  return speedTable.dcKick[reg];
+}
+#endif
+
 void DCC::setAccessory(int address, byte port, bool gate, byte onoff /*= 2*/) {
   // onoff is tristate:
   // 0  => send off packet
@@ -303,18 +499,138 @@ void DCC::setAccessory(int address, byte port, bool gate, byte onoff /*= 2*/) {
   // second byte is of the form 1AAACPPG, where C is 1 for on, PP the ports 0 to 3 and G the gate (coil).
   b[0] = address % 64 + 128;
   b[1] = ((((address / 64) % 8) << 4) + (port % 4 << 1) + gate % 2) ^ 0xF8;
+#ifdef ACCESSORY_GANG
+  // Four copies each of the on and/or off packet
+  gangAccessory(b, 2, onoff != 0 ? 4 : 0, onoff != 1 ? 4 : 0);
+#if defined(EXRAIL_ACTIVE)
+  if (onoff != 0) RMFT2::activateEvent(address<<2|port,gate);
+#endif
+#else
   if (onoff != 0) {
-    DCCWaveform::mainTrack.schedulePacket(b, 2, 3);      // Repeat on packet three times
+    DCCWaveform::scheduleMain(b, 2, 3, PRIORITY_ACCESSORY);      // Repeat on packet three times
 #if defined(EXRAIL_ACTIVE)
     RMFT2::activateEvent(address<<2|port,gate);
 #endif
   }
   if (onoff != 1) {
     b[1] &= ~0x08; // set C to 0
-    DCCWaveform::mainTrack.schedulePacket(b, 2, 3);      // Repeat off packet three times
+    DCCWaveform::scheduleMain(b, 2, 3, PRIORITY_ACCESSORY);      // Repeat off packet three times
+  }
+#endif
+}
+
+#ifdef ACCESSORY_GANG
+// Add an accessory packet to the gang.  If the gang is full, wait for 
+// the earlier ones to make room (dropped if the track has no output).
+void DCC::gangAccessory(const byte packet[], byte length, byte onSends, byte offSends) {
+  // without a channel nothing would ever make room in the gang
+  if (!DCCWaveform::mainTrack.hasOutput()) return;
+  if (mergeAccessory(packet, length, onSends, offSends)) {
+    issueAccessories();
+    return;
   }
+  while (gangCount >= ACCESSORY_GANG) {
+    issueAccessories();
+    if (DCCWaveform::canScheduleMain()) issueAccessoryRepeat();
+  }
+  GANG_ENTRY & e=accessoryGang[gangCount++];
+  memcpy(e.packet, packet, length);
+  e.length=length;
+  e.onSends=onSends;
+  e.offSends=offSends;
+  e.started=false;
+  issueAccessories();
 }
 
+// A command for an address and port that is already waiting, the
+// latest one if there are several. The same command tops up the copies
+// still to send. Another aspect of an extended accessory, or the other
+// gate of a basic one not yet sent, is replaced. A basic one already
+// started is left to send its off packets and the new one queued after.
+bool DCC::mergeAccessory(const byte packet[], byte length, byte onSends, byte offSends) {
+  // basic packets: 10AAAAAA 1AAACPPG, C and G left out of the match
+  byte keyMask = (length==2) ? 0xF6 : 0xFF;
+  for (byte i=gangCount; i-- > 0;) {
+    GANG_ENTRY & e=accessoryGang[i];
+    if (e.length!=length || e.packet[0]!=packet[0]
+        || ((e.packet[1]^packet[1]) & keyMask)) continue;
+    if (memcmp(e.packet, packet, length)==0) {
+      if (e.onSends<onSends) e.onSends=onSends;
+      if (e.offSends<offSends) e.offSends=offSends;
+      return true;
+    }
+    if (length==2 && e.started) {
+      e.onSends=0;
+      if (e.offSends==0) e.offSends=1;
+      return false;
+    }
+    memcpy(e.packet, packet, length);
+    e.onSends=onSends;
+    e.offSends=offSends;
+    e.started=false;
+    return true;
+  }
+  return false;
+}
+
+void DCC::sendGangCopy(GANG_ENTRY & e) {
+  if (e.onSends) {
+    DCCWaveform::scheduleMain(e.packet, e.length, 0, PRIORITY_ACCESSORY);
+    e.onSends--;
+  } else {
+    byte b[2]={e.packet[0], (byte)(e.packet[1] & ~0x08)};
+    DCCWaveform::scheduleMain(b, 2, 0, PRIORITY_ACCESSORY);
+    e.offSends--;
+  }
+  e.started=true;
+}
+
+// Send the first copy of each new accessory packet, for as long as the
+// waveform has room without waiting.
+void DCC::issueAccessories() {
+  byte i=0;
+  while (i<gangCount) {
+    GANG_ENTRY & e=accessoryGang[i];
+    if (e.started) { i++; continue; }
+    if (!DCCWaveform::canScheduleMain()) return;
+    sendGangCopy(e);
+    if (e.onSends==0 && e.offSends==0) {
+      gangCount--;
+      memmove(&accessoryGang[i], &accessoryGang[i+1], (gangCount-i)*sizeof(GANG_ENTRY));
+      if (gangNext>i) gangNext--;
+    }
+    else i++;
+  }
+}
+
+// Send the next repeat, taking each started packet in turn.  Called in
+// a reminder window so that repeats share the track with the locos.
+bool DCC::issueAccessoryRepeat() {
+  for (byte n=gangCount; n>0; n--) {
+    if (gangNext >= gangCount) gangNext=0;
+    GANG_ENTRY & e=accessoryGang[gangNext];
+    if (!e.started) {
+      gangNext++;
+      continue;
+    }
+    sendGangCopy(e);
+    if (e.onSends==0 && e.offSends==0) {
+      // Finished, close up the table.  gangNext now refers to the one after.
+      gangCount--;
+      memmove(&accessoryGang[gangNext], &accessoryGang[gangNext+1], (gangCount-gangNext)*sizeof(GANG_ENTRY));
+    }
+    else gangNext++;
+    return true;
+  }
+  return false;
+}
+
+DCC::GANG_ENTRY DCC::accessoryGang[ACCESSORY_GANG];
+byte DCC::gangCount=0;
+byte DCC::gangNext=0;
+bool DCC::lastWasAccessory=false;
+#endif
+
 bool DCC::setExtendedAccessory(int16_t address, int16_t value, byte repeats) {
 
 /* From https://www.nmra.org/sites/default/files/s-9.2.1_2012_07.pdf
@@ -362,7 +678,11 @@ whole range of the 11 bits sent to track.
     | (((~(address>>8)) & 0x07)<<4)  // shift out 8, invert, mask 3 bits, shift up 4
     | ((address & 0x03)<<1);         // mask 2 bits, shift up 1
   b[2]=value;
-  DCCWaveform::mainTrack.schedulePacket(b, sizeof(b), repeats);
+#ifdef ACCESSORY_GANG
+  gangAccessory(b, sizeof(b), repeats+1, 0);
+#else
+  DCCWaveform::scheduleMain(b, sizeof(b), repeats, PRIORITY_ACCESSORY);
+#endif
   return true;
 }
 
@@ -381,7 +701,28 @@ void DCC::writeCVByteMain(int cab, int cv, byte bValue)  {
   b[nB++] = cv2(cv);
   b[nB++] = bValue;
 
-  DCCWaveform::mainTrack.schedulePacket(b, nB, 4);
+  scheduleLoco(cab, b, nB, 4, PRIORITY_CVMAIN);
+#ifdef CV_CACHE
+  CVCache::store(cab, cv, bValue);
+#endif
+}
+
+//
+// readCVByteMain: PoM verify byte on main. The decoder answers with
+// the CV value in Railcom channel 2, see Railcom.cpp
+//
+void DCC::readCVByteMain(int cab, int cv)  {
+  byte b[5];
+  byte nB = 0;
+  if (cab > HIGHEST_SHORT_ADDR)
+    b[nB++] = highByte(cab) | 0xC0;    // convert train number into a two-byte address
+
+  b[nB++] = lowByte(cab);
+  b[nB++] = cv1(VERIFY_BYTE_MAIN, cv);
+  b[nB++] = cv2(cv);
+  b[nB++] = 0;  // ignored by the decoder for a read
+
+  scheduleLoco(cab, b, nB, 4, PRIORITY_CVMAIN);
 }
 
 //
@@ -402,7 +743,10 @@ void DCC::writeCVBitMain(int cab, int cv, byte bNum, bool bValue)  {
   b[nB++] = cv2(cv);
   b[nB++] = WRITE_BIT | (bValue ? BIT_ON : BIT_OFF) | bNum;
 
-  DCCWaveform::mainTrack.schedulePacket(b, nB, 4);
+  scheduleLoco(cab, b, nB, 4, PRIORITY_CVMAIN);
+#ifdef CV_CACHE
+  CVCache::storeBit(cab, cv, bNum, bValue);
+#endif
 }
 
 FSH* DCC::getMotorShieldName() {
@@ -672,15 +1016,29 @@ const ackOp FLASH LONG_LOCO_ID_PROG[] = {
 };
 
 void  DCC::writeCVByte(int16_t cv, byte byteValue, ACK_CALLBACK callback)  {
+#ifdef CV_CACHE
+  callback=CVCache::wrap(CVCache::PENDING_WRITE, cv, byteValue, callback);
+#endif
   DCCACK::Setup(cv, byteValue,  WRITE_BYTE_PROG, callback);
 }
 
 void DCC::writeCVBit(int16_t cv, byte bitNum, bool bitValue, ACK_CALLBACK callback)  {
-  if (bitNum >= 8) callback(-1);
-  else DCCACK::Setup(cv, bitNum, bitValue?WRITE_BIT1_PROG:WRITE_BIT0_PROG, callback);
+  if (bitNum >= 8) {
+    callback(-1);
+    return;
+  }
+#ifdef CV_CACHE
+  callback=CVCache::wrap(CVCache::PENDING_BIT, cv, bitNum<<1 | bitValue, callback);
+#endif
+  DCCACK::Setup(cv, bitNum, bitValue?WRITE_BIT1_PROG:WRITE_BIT0_PROG, callback);
 }
 
+// Verify answers with the value read, so the cache can answer it too
 void  DCC::verifyCVByte(int16_t cv, byte byteValue, ACK_CALLBACK callback)  {
+#ifdef CV_CACHE
+  if (CVCache::answer(cv, callback)) return;
+  callback=CVCache::wrap(CVCache::PENDING_READ, cv, 0, callback);
+#endif
   DCCACK::Setup(cv, byteValue,  VERIFY_BYTE_PROG, callback);
 }
 
@@ -696,10 +1054,17 @@ void DCC::readCVBit(int16_t cv, byte bitNum, ACK_CALLBACK callback)  {
 }
 
 void DCC::readCV(int16_t cv, ACK_CALLBACK callback)  {
+#ifdef CV_CACHE
+  if (CVCache::answer(cv, callback)) return;
+  callback=CVCache::wrap(CVCache::PENDING_READ, cv, 0, callback);
+#endif
   DCCACK::Setup(cv, 0,READ_CV_PROG, callback);
 }
 
 void DCC::getLocoId(ACK_CALLBACK callback) {
+#ifdef CV_CACHE
+  callback=CVCache::wrap(CVCache::PENDING_LOCOID, 0, 0, callback);
+#endif
   DCCACK::Setup(0,0, LOCO_ID_PROG, callback);
 }
 
@@ -708,6 +1073,9 @@ void DCC::setLocoId(int id,ACK_CALLBACK callback) {
     callback(-1);
     return;
   }
+#ifdef CV_CACHE
+  callback=CVCache::wrap(CVCache::PENDING_SETID, 0, id, callback);
+#endif
   if (id<=HIGHEST_SHORT_ADDR)
       DCCACK::Setup(id, SHORT_LOCO_ID_PROG, callback);
   else
@@ -731,93 +1099,251 @@ void DCC::setConsistId(int id,bool reverse,ACK_CALLBACK callback) {
     cv19=id%100;
   }
   if (reverse) cv19|=0x80;
+#ifdef CV_CACHE
+  // an address CV, so the cache forgets the loco
+  callback=CVCache::wrap(CVCache::PENDING_WRITE, 19, cv19, callback);
+#endif
   DCCACK::Setup((cv20<<8)|cv19, CONSIST_ID_PROG, callback);
 }
 
 void DCC::forgetLoco(int cab) {  // removes any speed reminders for this loco
-  setThrottle2(cab,1); // ESTOP this loco if still on track
+  setThrottle2(cab,1,PRIORITY_ESTOP); // ESTOP this loco if still on track
   int reg=lookupSpeedTable(cab, false);
   if (reg>=0) {
-    speedTable[reg].loco=0;
-    setThrottle2(cab,1); // ESTOP if this loco still on track
+#ifdef LOCO_INDEX
+    locoIndex.remove(cab);
+#endif
+    speedTable.loco[reg]=0;
+    // a broadcast still due would go to the next loco in the slot
+    bitClear(speedTable.dirty[reg>>3], reg & 7);
+    setThrottle2(cab,1,PRIORITY_ESTOP); // ESTOP if this loco still on track
     CommandDistributor::broadcastForgetLoco(cab);
   }
 }
 void DCC::forgetAllLocos() {  // removes all speed reminders
-  setThrottle2(0,1); // ESTOP all locos still on track
-  for (int i=0;i<MAX_LOCOS;i++) {
-    if (speedTable[i].loco) CommandDistributor::broadcastForgetLoco(speedTable[i].loco);
-    speedTable[i].loco=0;
+  setThrottle2(0,1,PRIORITY_ESTOP); // ESTOP all locos still on track
+  for (int i=0;i<tableSlots;i++) {
+    if (speedTable.loco[i]) CommandDistributor::broadcastForgetLoco(speedTable.loco[i]);
+    speedTable.loco[i]=0;
   }
+  memset(speedTable.dirty, 0, sizeof(speedTable.dirty));
+#ifdef LOCO_INDEX
+  locoIndex.clear();
+#endif
 }
 
-byte DCC::loopStatus=0;
-
 void DCC::loop()  {
   TrackManager::loop(); // power overload checks
+#ifdef ACCESSORY_GANG
+  issueAccessories();
+#endif
+#ifdef LOCO_MOMENTUM
+  issueMomentum();
+#endif
   issueReminders();
+  flushBroadcasts();
+#ifdef RAILCOM_SERIAL
+  Railcom::loop();
+#endif
+}
+
+void DCC::markForBroadcast(int reg) {
+  bitSet(speedTable.dirty[reg>>3], reg & 7);
+}
+
+// Broadcast each changed loco once, however many times it changed since
+// the last flush (e.g. a throttle knob being spun or a global estop).
+// A change after a quiet spell goes out at once, later ones wait for
+// the interval to expire.
+void DCC::flushBroadcasts() {
+  unsigned long now=millis();
+  if (now - lastBroadcastFlush < LOCO_BROADCAST_INTERVAL) return;
+  bool sent=false;
+  for (byte i=0; i<sizeof(speedTable.dirty); i++) {
+    byte bits=speedTable.dirty[i];
+    if (!bits) continue;
+    speedTable.dirty[i]=0;
+    for (byte b=0; b<8; b++) {
+      int reg=(i<<3)+b;
+      if (bitRead(bits,b) && speedTable.loco[reg]) {
+        CommandDistributor::broadcastLoco(reg);
+        sent=true;
+      }
+    }
+  }
+  if (sent) lastBroadcastFlush=now;
 }
 
 void DCC::issueReminders() {
+#ifdef DCC_DISTRICTS
+  // each district stream reminds its own locos
+  for (byte stream=1; stream<MAIN_STREAMS; stream++)
+    if (DCCWaveform::mainStream(stream).isReminderWindowOpen()) issueReminder(stream);
+#endif
   // if the main track transmitter still has a pending packet, skip this time around.
   if (!DCCWaveform::mainTrack.isReminderWindowOpen()) return;
+
+#ifdef ACCESSORY_GANG
+  // Accessory repeats take every other window at most
+  if (gangCount && !lastWasAccessory && issueAccessoryRepeat()) {
+    lastWasAccessory=true;
+    return;
+  }
+  lastWasAccessory=false;
+#endif
+
+  // Recently changed locos get extra speed reminders, alternating
+  // with the round robin so that neither can starve the other.
+  if (boostPending && !lastWasBoost && issueBoostReminder()) {
+    lastWasBoost=true;
+    return;
+  }
+  lastWasBoost=false;
+  issueReminder(0);
+}
+
+// One step of the round robin over the locos on this MAIN stream
+void DCC::issueReminder(byte stream) {
+  REMINDER_STATE & state=reminders[stream];
   // Move to next loco slot.  If occupied, send a reminder.
-  int reg = lastLocoReminder+1;
+  int reg = state.lastLocoReminder+1;
   if (reg > highestUsedReg) {
-    if (loopStatus == 0 /*only needed if numLocos == 1 but we do not have a counter*/) {
-      // insert idle packet in the speed packet loop to fullfill the *censored*
-      // >5ms between packets to same decoder rule
-      const byte idlepacket[] = {0xFF, 0x00};
-      DCCWaveform::mainTrack.schedulePacket(idlepacket, 2, 0);
+    state.reminderCycle++;
+#ifdef DCC_PACKET_STATS
+    if (stream==0) {
+      unsigned long now=millis();
+      reminderCycleTime.add(now-lastCycleStart);
+      lastCycleStart=now;
     }
+#endif
     reg = 0;  // Go to start of table
+    // Insert an idle packet to fulfill the >5ms between packets to the
+    // same decoder rule, but only when the cycle would come straight
+    // back to the decoder it has just finished with. Any other loco
+    // on the way gives it the time it needs.
+    if (state.loopStatus == 0 && state.lastRemindedLoco > 0) {
+      int next=reg;
+      while (next <= highestUsedReg && (speedTable.loco[next] <= 0 || !inStream(next, stream))) next++;
+      if (next <= highestUsedReg && speedTable.loco[next] == state.lastRemindedLoco) {
+        const byte idlepacket[] = {0xFF, 0x00};
+        DCCWaveform::mainStream(stream).schedulePacket(idlepacket, 2, 0, PRIORITY_REMINDER);
+        state.lastRemindedLoco = 0;
+      }
+    }
   }
-  if (speedTable[reg].loco > 0) {
+  if (speedTable.loco[reg] > 0 && inStream(reg, stream)) {
     // have found loco to remind
-    if (issueReminder(reg))
-      lastLocoReminder = reg;
+    state.lastRemindedLoco = speedTable.loco[reg];
+#ifdef DCC_DISTRICTS
+    reminderStream=stream;
+#endif
+    bool done=issueReminder(stream, reg);
+#ifdef DCC_DISTRICTS
+    reminderStream=ALL_STREAMS;
+#endif
+    if (done) state.lastLocoReminder = reg;
   } else
-    lastLocoReminder = reg;
+    state.lastLocoReminder = reg;
 }
 
-bool DCC::issueReminder(int reg) {
-  unsigned long functions=speedTable[reg].functions;
-  int loco=speedTable[reg].loco;
-  byte flags=speedTable[reg].groupFlags;
+bool DCC::issueBoostReminder() {
+  for (int i=0; i<=highestUsedReg; i++) {
+    boostCursor++;
+    if (boostCursor > highestUsedReg) boostCursor=0;
+    if (speedTable.loco[boostCursor]<=0 || speedTable.speedBoost[boostCursor]==0) continue;
+    speedTable.speedBoost[boostCursor]--;
+    remindSpeed(boostCursor);
+    reminders[0].lastRemindedLoco = speedTable.loco[boostCursor];
+    return true;
+  }
+  boostPending=false; // nothing left to boost
+  return false;
+}
+
+bool DCC::issueReminder(byte stream, int reg) {
+  REMINDER_STATE & state=reminders[stream];
+  unsigned long functions=speedTable.functions[reg];
+  int loco=speedTable.loco[reg];
+  byte flags=speedTable.groupFlags[reg];
+  // Function groups that have not changed for a while are
+  // only reminded on some cycles, staggered by slot.
+  bool functionsDue= speedTable.functionAge[reg] < FN_REMINDER_FRESH
+    || ((state.reminderCycle ^ reg) & FN_REMINDER_SLOW_MASK)==0;
+  if (!functionsDue) flags=0;
+#ifdef LOCO_EXT_FUNCTIONS
+  byte extFlags=speedTable.extGroupFlags[reg];
+  if (speedTable.functionAge[reg] >= FN_REMINDER_FRESH
+      && ((state.reminderCycle ^ reg) & FN_REMINDER_EXT_SLOW_MASK)!=0) extFlags=0;
+#endif
 
-  switch (loopStatus) {
+  // Step through the phases until a packet is sent or the loco is done.
+  // Phases with nothing to send do not use up a reminder window.
+  bool sent=false;
+  while (!sent) {
+    switch (state.loopStatus) {
         case 0:
-      //   DIAG(F("Reminder %d speed %d"),loco,speedTable[reg].speedCode);
-         setThrottle2(loco, speedTable[reg].speedCode);
+      //   DIAG(F("Reminder %d speed %d"),loco,speedTable.speedCode[reg]);
+         remindSpeed(reg);
+         sent=true;
          break;
        case 1: // remind function group 1 (F0-F4)
-          if (flags & FN_GROUP_1)
-	    setFunctionInternal(loco,0, 128 | ((functions>>1)& 0x0F) | ((functions & 0x01)<<4),0); // 100D DDDD
+          if (flags & FN_GROUP_1) {
+	    setFunctionInternal(loco,0, 128 | ((functions>>1)& 0x0F) | ((functions & 0x01)<<4),0,PRIORITY_REMINDER); // 100D DDDD
+            sent=true;
+          }
           break;
        case 2: // remind function group 2 F5-F8
-          if (flags & FN_GROUP_2)
-  	    setFunctionInternal(loco,0, 176 | ((functions>>5)& 0x0F),0);                           // 1011 DDDD
+          if (flags & FN_GROUP_2) {
+  	    setFunctionInternal(loco,0, 176 | ((functions>>5)& 0x0F),0,PRIORITY_REMINDER);                           // 1011 DDDD
+            sent=true;
+          }
           break;
        case 3: // remind function group 3 F9-F12
-          if (flags & FN_GROUP_3)
-	    setFunctionInternal(loco,0, 160 | ((functions>>9)& 0x0F),0);                           // 1010 DDDD
+          if (flags & FN_GROUP_3) {
+	    setFunctionInternal(loco,0, 160 | ((functions>>9)& 0x0F),0,PRIORITY_REMINDER);                           // 1010 DDDD
+            sent=true;
+          }
           break;
        case 4: // remind function group 4 F13-F20
-          if (flags & FN_GROUP_4)
-	    setFunctionInternal(loco,222, ((functions>>13)& 0xFF),0);
+          if (flags & FN_GROUP_4) {
+	    setFunctionInternal(loco,222, ((functions>>13)& 0xFF),0,PRIORITY_REMINDER);
+            sent=true;
+          }
           break;
        case 5: // remind function group 5 F21-F28
-          if (flags & FN_GROUP_5)
-	    setFunctionInternal(loco,223, ((functions>>21)& 0xFF),0);
+          if (flags & FN_GROUP_5) {
+	    setFunctionInternal(loco,223, ((functions>>21)& 0xFF),0,PRIORITY_REMINDER);
+            sent=true;
+          }
+          break;
+#ifdef LOCO_EXT_FUNCTIONS
+       default: // remind extended groups F29-F36 ... F61-F68
+          {
+            byte group=state.loopStatus-6;
+            if (extFlags & (1<<group)) {
+              setFunctionInternal(loco,FN_GROUP_EXT+group, speedTable.extFunctions[reg][group],0,PRIORITY_REMINDER);
+              sent=true;
+            }
+          }
           break;
+#endif
       }
-      loopStatus++;
-      // if we reach status 6 then this loco is done so
+      state.loopStatus++;
+      // if we reach REMINDER_PHASES then this loco is done so
       // reset status to 0 for next loco and return true so caller
       // moves on to next loco.
-      if (loopStatus>5) loopStatus=0;
-      return loopStatus==0;
+      if (state.loopStatus>=REMINDER_PHASES) {
+        state.loopStatus=0;
+#ifdef DCC_DISTRICTS
+        // a loco on every stream ages with the first one only
+        if (speedTable.district[reg]==0 && stream!=0) return true;
+#endif
+        if (speedTable.functionAge[reg] < 255) speedTable.functionAge[reg]++;
+        return true;
+      }
     }
+    return false;
+}
 
 
 
@@ -835,40 +1361,179 @@ byte DCC::cv2(int cv)  {
 
 int DCC::lookupSpeedTable(int locoId, bool autoCreate) {
   // determine speed reg for this loco
-  int firstEmpty = MAX_LOCOS;
+  if (locoId<=0) return -1;
   int reg;
-  for (reg = 0; reg < MAX_LOCOS; reg++) {
-    if (speedTable[reg].loco == locoId) break;
-    if (speedTable[reg].loco == 0 && firstEmpty == MAX_LOCOS) firstEmpty = reg;
+#ifdef LOCO_INDEX
+  // index lookup, only scan when looking for an empty slot to create
+  reg=locoIndex.find(locoId);
+  if (reg<0) reg=tableSlots;
+  int firstEmpty = tableSlots;
+  if (autoCreate && reg==tableSlots) {
+    for (firstEmpty = 0; firstEmpty < tableSlots; firstEmpty++) {
+      if (speedTable.loco[firstEmpty] == 0) break;
+    }
+  }
+#else
+  int firstEmpty = tableSlots;
+  for (reg = 0; reg < tableSlots; reg++) {
+    if (speedTable.loco[reg] == locoId) break;
+    if (speedTable.loco[reg] == 0 && firstEmpty == tableSlots) firstEmpty = reg;
   }
+#endif
 
   // return -1 if not found and not auto creating
-  if (reg == MAX_LOCOS) {
+  if (reg == tableSlots) {
     if (!autoCreate) return -1;    // nothing found and not auto creating
-    if (firstEmpty == MAX_LOCOS) { // through and no empty slot
+#ifdef LOCO_TABLE_GROWS
+    if (firstEmpty == tableSlots) {
+      byte oldSlots=tableSlots;
+      if (growTable()) firstEmpty=oldSlots;
+#if LOCO_EVICT_SECONDS > 0
+      else {
+        int idle=evictIdleLoco();
+        if (idle>=0) firstEmpty=idle;
+      }
+#endif
+    }
+#endif
+    if (firstEmpty == tableSlots) { // through and no empty slot
       DIAG(F("Too many locos"));
       return -1;
     }
     reg = firstEmpty;
-    speedTable[reg].loco = locoId;
-    speedTable[reg].speedCode=128;  // default direction forward
-    speedTable[reg].groupFlags=0;
-    speedTable[reg].functions=0;
+    speedTable.loco[reg] = locoId;
+    speedTable.speedCode[reg]=128;  // default direction forward
+    invalidateSpeedPacket(reg);
+    speedTable.groupFlags[reg]=0;
+    speedTable.functions[reg]=0;
+    speedTable.functionAge[reg]=0;
+    speedTable.speedBoost[reg]=0;
+#ifdef DCC_PACKET_STATS
+    lastRefresh[reg]=millis();
+#endif
+#ifdef LOCO_EXT_FUNCTIONS
+    memset(speedTable.extFunctions[reg], 0, EXT_FN_GROUPS);
+    speedTable.extGroupFlags[reg]=0;
+#endif
+#ifdef LOCO_MOMENTUM
+    speedTable.targetSpeedCode[reg]=128;
+    speedTable.accelRate[reg]=defaultAccel;
+    speedTable.decelRate[reg]=defaultDecel;
+    speedTable.momentumCredit[reg]=0;
+#endif
+#ifdef DC_KICKSTART
+    speedTable.dcKick[reg]=0;
+#endif
+#ifdef DCC_DISTRICTS
+    speedTable.district[reg]=0;
+#endif
+#ifdef LOCO_INDEX
+    locoIndex.insert(locoId, reg);
+#endif
   }
   if (reg > highestUsedReg) highestUsedReg = reg;
+#ifdef LOCO_TABLE_GROWS
+  if (autoCreate) speedTable.lastUsed[reg]=millis()/1000;
+#endif
   return reg;
 }
 
+#ifdef LOCO_TABLE_GROWS
+byte DCC::tableSlots=0;
+
+// Resizes one field array, new slots are zeroed. A field that has
+// already grown keeps its larger block if a later one fails.
+template <typename T> static bool growField(T * & field, byte oldSlots, byte newSlots) {
+  T * grown=(T *)realloc((void *)field, sizeof(T)*newSlots);
+  if (!grown) return false;
+  memset((void *)(grown+oldSlots), 0, sizeof(T)*(newSlots-oldSlots));
+  field=grown;
+  return true;
+}
+
+// Adds LOCO_TABLE_CHUNK slots (LOCO_TABLE_MIN the first time), false
+// if the table is at MAX_LOCOS or there is not the memory
+bool DCC::growTable() {
+  if (tableSlots>=MAX_LOCOS) return false;
+  int wanted=tableSlots ? tableSlots+LOCO_TABLE_CHUNK : LOCO_TABLE_MIN;
+  byte newSlots=wanted>MAX_LOCOS ? MAX_LOCOS : wanted;
+  bool grown=growField(speedTable.loco, tableSlots, newSlots)
+    && growField(speedTable.speedCode, tableSlots, newSlots)
+    && growField(speedTable.groupFlags, tableSlots, newSlots)
+    && growField(speedTable.functions, tableSlots, newSlots)
+    && growField(speedTable.functionAge, tableSlots, newSlots)
+#ifdef LOCO_EXT_FUNCTIONS
+    && growField(speedTable.extFunctions, tableSlots, newSlots)
+    && growField(speedTable.extGroupFlags, tableSlots, newSlots)
+#endif
+    && growField(speedTable.speedBoost, tableSlots, newSlots)
+#ifdef LOCO_PACKET_CACHE
+    && growField(speedTable.speedPacket, tableSlots, newSlots)
+    && growField(speedTable.speedPacketLength, tableSlots, newSlots)
+#endif
+#ifdef LOCO_MOMENTUM
+    && growField(speedTable.targetSpeedCode, tableSlots, newSlots)
+    && growField(speedTable.accelRate, tableSlots, newSlots)
+    && growField(speedTable.decelRate, tableSlots, newSlots)
+    && growField(speedTable.momentumCredit, tableSlots, newSlots)
+#endif
+#ifdef DC_KICKSTART
+    && growField(speedTable.dcKick, tableSlots, newSlots)
+#endif
+#ifdef DCC_DISTRICTS
+    && growField(speedTable.district, tableSlots, newSlots)
+#endif
+    && growField(speedTable.lastUsed, tableSlots, newSlots);
+#ifdef LOCO_INDEX
+  locoIndex.setLocos(speedTable.loco);
+#endif
+  if (!grown) {
+    DIAG(F("Loco table can not grow beyond %d"), tableSlots);
+    return false;
+  }
+  tableSlots=newSlots;
+  return true;
+}
+
+#if LOCO_EVICT_SECONDS > 0
+// Forgets the loco stopped and untouched longest to free its slot,
+// -1 if none has been idle for LOCO_EVICT_SECONDS
+int DCC::evictIdleLoco() {
+  uint16_t now=millis()/1000;
+  int oldest=-1;
+  uint16_t oldestIdle=0;
+  for (int reg=0; reg<=highestUsedReg; reg++) {
+    if (speedTable.loco[reg]<=0 || (speedTable.speedCode[reg] & 0x7F) > 1) continue;
+#ifdef LOCO_MOMENTUM
+    if ((speedTable.targetSpeedCode[reg] & 0x7F) > 1) continue;
+#endif
+    uint16_t idle=now-speedTable.lastUsed[reg];
+    if (idle>=LOCO_EVICT_SECONDS && idle>=oldestIdle) {
+      oldest=reg;
+      oldestIdle=idle;
+    }
+  }
+  if (oldest<0) return -1;
+  DIAG(F("Loco %d idle %us, slot reused"), speedTable.loco[oldest], oldestIdle);
+  forgetLoco(speedTable.loco[oldest]);
+  return oldest;
+}
+#endif
+#endif
+
 void  DCC::updateLocoReminder(int loco, byte speedCode) {
 
   if (loco==0) {
      // broadcast stop/estop but dont change direction
      for (int reg = 0; reg <= highestUsedReg; reg++) {
-       if (speedTable[reg].loco==0) continue;
-       byte newspeed=(speedTable[reg].speedCode & 0x80) |  (speedCode & 0x7f);
-       if (speedTable[reg].speedCode != newspeed) {
-         speedTable[reg].speedCode = newspeed;
-         CommandDistributor::broadcastLoco(reg);
+       if (speedTable.loco[reg]==0) continue;
+       byte newspeed=(speedTable.speedCode[reg] & 0x80) |  (speedCode & 0x7f);
+       if (speedTable.speedCode[reg] != newspeed) {
+         speedTable.speedCode[reg] = newspeed;
+         invalidateSpeedPacket(reg);
+         speedTable.speedBoost[reg] = REMINDER_BOOST;
+         boostPending=true;
+         markForBroadcast(reg);
        }
      }
      return;
@@ -876,27 +1541,183 @@ void  DCC::updateLocoReminder(int loco, byte speedCode) {
 
   // determine speed reg for this loco
   int reg=lookupSpeedTable(loco, true);
-  if (reg>=0 && speedTable[reg].speedCode!=speedCode) {
-    speedTable[reg].speedCode = speedCode;
-    CommandDistributor::broadcastLoco(reg);
+  if (reg>=0 && speedTable.speedCode[reg]!=speedCode) {
+    speedTable.speedCode[reg] = speedCode;
+    invalidateSpeedPacket(reg);
+    speedTable.speedBoost[reg] = REMINDER_BOOST;
+    boostPending=true;
+    markForBroadcast(reg);
   }
 }
 
-DCC::LOCO DCC::speedTable[MAX_LOCOS];
-int DCC::lastLocoReminder = 0;
+#ifdef DCC_DISTRICTS
+// A loco moving to another district gets its speed and functions there
+// from the boost and the next reminder pass on that stream.
+bool DCC::setLocoDistrict(int cab, int16_t district) {
+  if (district<0 || district>DCC_DISTRICTS) return false;
+  int reg=lookupSpeedTable(cab, true);
+  if (reg<0) return false;
+  if (speedTable.district[reg]!=district) {
+    speedTable.district[reg]=district;
+    speedTable.functionAge[reg]=0;
+    speedTable.speedBoost[reg]=REMINDER_BOOST;
+    boostPending=true;
+  }
+  return true;
+}
+#endif
+
+#ifdef LOCO_MOMENTUM
+bool DCC::setMomentum(int cab, byte accel, byte decel) {
+  if (cab==0) {
+    defaultAccel=accel;
+    defaultDecel=decel;
+    return true;
+  }
+  int reg=lookupSpeedTable(cab, true);
+  if (reg<0) return false;
+  speedTable.accelRate[reg]=accel;
+  speedTable.decelRate[reg]=decel;
+  return true;
+}
+
+// One updater steps every ramping loco towards its target, sending a 
+// speed packet only when its speed step changes.
+void DCC::issueMomentum() {
+  if (!momentumPending) return;
+  unsigned long now=millis();
+  unsigned long elapsed=now - lastMomentumTick;
+  if (elapsed < MOMENTUM_TICK) return;
+  lastMomentumTick=now;
+  if (elapsed > 1000) elapsed=1000;  // after a long stall of the loop
+  momentumPending=false;
+  for (int reg = 0; reg <= highestUsedReg; reg++) {
+    if (speedTable.loco[reg]<=0) continue;
+    if (speedTable.speedCode[reg]==speedTable.targetSpeedCode[reg]) continue;
+    momentumPending=true;
+    byte speed=speedTable.speedCode[reg] & 0x7F;
+    if (speed==1) speed=0;  // ramp up from an emergency stop
+    bool faster=((speedTable.speedCode[reg] ^ speedTable.targetSpeedCode[reg]) & 0x80)==0
+                 && (speedTable.targetSpeedCode[reg] & 0x7F) > speed;
+    byte rate=faster ? speedTable.accelRate[reg] : speedTable.decelRate[reg];
+    byte steps=127;
+    if (rate) {
+      uint16_t credit=speedTable.momentumCredit[reg] + elapsed;
+      steps=credit/rate > 127 ? 127 : credit/rate;
+      speedTable.momentumCredit[reg]=credit % rate;
+      if (steps==0) continue;
+    }
+    byte speedCode=momentumStep(reg, steps);
+    applyThrottle(speedTable.loco[reg], speedCode);
+  }
+}
+
+// The speedCode steps nearer the target. A change of direction slows to a
+// stop first and the direction changes once stopped.
+byte DCC::momentumStep(int reg, byte steps) {
+  byte current=speedTable.speedCode[reg];
+  byte target=speedTable.targetSpeedCode[reg];
+  byte speed=current & 0x7F;
+  byte goal=target & 0x7F;
+  if (speed==1) speed=0;
+  if ((current ^ target) & 0x80) {
+    if (speed==0) return target & 0x80;
+    goal=0;
+  }
+  // speed steps run 0, 2, 3 .. 127
+  if (goal > speed) {
+    if (speed==0) speed=1;
+    speed = (goal - speed <= steps) ? goal : speed + steps;
+  }
+  else {
+    speed = (speed - goal <= steps) ? goal : speed - steps;
+    if (speed==1) speed=0;
+  }
+  return (current & 0x80) | speed;
+}
+
+bool DCC::momentumPending = false;
+unsigned long DCC::lastMomentumTick = 0;
+byte DCC::defaultAccel = 0;
+byte DCC::defaultDecel = 0;
+#endif
+
+DCC::LOCO_STORE DCC::speedTable;
+#ifdef LOCO_INDEX
+LocoIndex<MAX_LOCOS> DCC::locoIndex(DCC::speedTable.loco);
+#endif
+DCC::REMINDER_STATE DCC::reminders[MAIN_STREAMS];
+#ifdef DCC_DISTRICTS
+byte DCC::reminderStream = DCC::ALL_STREAMS;
+#endif
 int DCC::highestUsedReg = 0;
+int DCC::boostCursor = 0;
+bool DCC::boostPending = false;
+bool DCC::lastWasBoost = false;
+#ifdef DCC_PACKET_STATS
+StatsHistogram<5> DCC::reminderCycleTime;
+unsigned long DCC::lastCycleStart = 0;
+
+StatsHistogram<4> DCC::refreshInterval;
+uint16_t DCC::lastRefresh[MAX_LOCOS];
+uint16_t DCC::worstRefresh = 0;
+int DCC::worstRefreshLoco = 0;
+uint32_t DCC::refreshAlarms = 0;
+unsigned long DCC::nextRefreshAlarm = 0;
+
+// A decoder that goes too long without a speed packet may stop
+// (RailCom or packet timeout) or lose its speed after a glitch.
+// Reported at most every 10s, the count is in <D LATENCY>.
+void DCC::noteRefresh(int reg) {
+  uint16_t now=millis();
+  uint16_t interval=now-lastRefresh[reg];
+  lastRefresh[reg]=now;
+  refreshInterval.add(interval);
+  if (interval>worstRefresh) {
+    worstRefresh=interval;
+    worstRefreshLoco=speedTable.loco[reg];
+  }
+  if (interval>LOCO_REFRESH_ALARM) {
+    refreshAlarms++;
+    if ((long)(millis()-nextRefreshAlarm) >= 0) {
+      nextRefreshAlarm=millis()+10000;
+      DIAG(F("Loco %d not refreshed for %ums"), speedTable.loco[reg], interval);
+    }
+  }
+}
+
+void DCC::showReminderStats(bool reset) {
+  reminderCycleTime.show(F("Reminder cycle"), F("ms"));
+  refreshInterval.show(F("Loco refresh"), F("ms"));
+  uint32_t p95=refreshInterval.percentile(95);
+  if (p95==refreshInterval.OPEN_ENDED)  // beyond the last bucket
+    DIAG(F("Loco refresh p95 - worst %ums (loco %d) over %dms %L times"),
+         worstRefresh, worstRefreshLoco, LOCO_REFRESH_ALARM, refreshAlarms);
+  else
+    DIAG(F("Loco refresh p95 <%Lms worst %ums (loco %d) over %dms %L times"),
+         p95, worstRefresh, worstRefreshLoco, LOCO_REFRESH_ALARM, refreshAlarms);
+  if (reset) {
+    reminderCycleTime.reset();
+    refreshInterval.reset();
+    worstRefresh=0;
+    worstRefreshLoco=0;
+    refreshAlarms=0;
+  }
+}
+#endif
+unsigned long DCC::lastBroadcastFlush = 0;
 
 
 void DCC::displayCabList(Print * stream) {
 
     int used=0;
     for (int reg = 0; reg <= highestUsedReg; reg++) {
-       if (speedTable[reg].loco>0) {
+       if (speedTable.loco[reg]>0) {
         used ++;
         StringFormatter::send(stream,F("cab=%d, speed=%d, dir=%c \n"),
-           speedTable[reg].loco,  speedTable[reg].speedCode & 0x7f,(speedTable[reg].speedCode & 0x80) ? 'F':'R');
+           speedTable.loco[reg],  speedTable.speedCode[reg] & 0x7f,(speedTable.speedCode[reg] & 0x80) ? 'F':'R');
        }
      }
-     StringFormatter::send(stream,F("Used=%d, max=%d\n"),used,MAX_LOCOS);
+     StringFormatter::send(stream,F("Used=%d, slots=%d, max=%d\n"),used,tableSlots,MAX_LOCOS);
 
 }
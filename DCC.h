@@ -37,16 +37,93 @@
 #endif
 #endif
 #include "DCCACK.h"
+#include "DCCWaveform.h"
+#include "LocoIndex.h"
 const uint16_t LONG_ADDR_MARKER = 0x4000;
 
 
 // Allocations with memory implications..!
-// Base system takes approx 900 bytes + 8 per loco. Turnouts, Sensors etc are dynamically created
-#if defined(HAS_ENOUGH_MEMORY)
+// Base system takes approx 900 bytes + 10 per loco (18 with HAS_ENOUGH_MEMORY). Turnouts, Sensors etc are dynamically created
+// Processors with plenty of heap start the loco table at LOCO_TABLE_MIN
+// slots and add LOCO_TABLE_CHUNK at a time as locos turn up, up to
+// LOCO_TABLE_MAX. Once it can grow no more, a new loco may take the slot
+// of the loco stopped and untouched longest, if that is at least
+// LOCO_EVICT_SECONDS (0 for never). All may be set in config.h, or
+// DISABLE_LOCO_TABLE_GROWTH for the fixed table.
+#if (defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_STM32) || defined(ARDUINO_TEENSY35) \
+     || defined(ARDUINO_TEENSY36) || defined(ARDUINO_TEENSY40) || defined(ARDUINO_TEENSY41)) \
+    && !defined(DISABLE_LOCO_TABLE_GROWTH)
+#define LOCO_TABLE_GROWS
+#ifndef LOCO_TABLE_MAX
+#define LOCO_TABLE_MAX 100
+#endif
+#ifndef LOCO_TABLE_MIN
+#define LOCO_TABLE_MIN 16
+#endif
+#ifndef LOCO_TABLE_CHUNK
+#define LOCO_TABLE_CHUNK 16
+#endif
+#ifndef LOCO_EVICT_SECONDS
+#define LOCO_EVICT_SECONDS 600
+#endif
+// (the loco index has at most 256 buckets, two per slot)
+#if LOCO_TABLE_MAX > 127 || LOCO_TABLE_MIN < 1 || LOCO_TABLE_CHUNK < 1
+#error LOCO_TABLE_MAX must be at most 127, LOCO_TABLE_MIN and LOCO_TABLE_CHUNK at least 1
+#endif
+const byte MAX_LOCOS = LOCO_TABLE_MAX;
+#elif defined(HAS_ENOUGH_MEMORY)
 const byte MAX_LOCOS = 50;
 #else
 const byte MAX_LOCOS = 30;
 #endif
+// Hashed cab to slot index for the speed table, costs 2 bytes per loco
+// (rounded up to a power of two) so only used where memory allows.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_LOCO_INDEX)
+#define LOCO_INDEX
+#endif
+// Ready built speed reminder packets, 5 bytes per loco
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_PACKET_CACHE)
+#define LOCO_PACKET_CACHE
+#endif
+// Speed changes ramped by the command station at per loco rates, 5 bytes per loco
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_MOMENTUM)
+#define LOCO_MOMENTUM
+#ifndef MOMENTUM_TICK
+#define MOMENTUM_TICK 20 // ms between momentum updates
+#endif
+#endif
+// F29-F68 kept per loco, sent in feature expansion groups of 8 when they
+// change and then reminded, 6 bytes per loco. Without it F29 and up are sent once as binary states.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_EXT_FUNCTIONS)
+#define LOCO_EXT_FUNCTIONS
+const int16_t MAX_EXT_FUNCTION = 68;
+const byte EXT_FN_GROUPS = (MAX_EXT_FUNCTION-28)/8;
+#endif
+// Decoder CV values remembered per loco, see CVCache.h
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_CV_CACHE)
+#define CV_CACHE
+#endif
+// Consist table, see DCCConsist.h
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_CONSISTS)
+#define LOCO_CONSISTS
+#endif
+// Accessory packets wait in a small table and their repeats are sent in 
+// turn, one copy of each per pass, so every turnout of a route gets its
+// first packet before any gets its repeats. A new command for an address
+// and port already waiting merges with or replaces it. Repeats take
+// turns with the loco reminders.  7 bytes per entry.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_ACCESSORY_GANG)
+#define ACCESSORY_GANG 16
+#endif
+// With DCC_PACKET_STATS the time between speed packets to each loco is
+// measured, and a longer gap than this is reported
+#ifndef LOCO_REFRESH_ALARM
+#define LOCO_REFRESH_ALARM 1000 // ms
+#endif
+// Loco state changes are broadcast at most once per slot per interval
+#ifndef LOCO_BROADCAST_INTERVAL
+#define LOCO_BROADCAST_INTERVAL 100 // ms, 0 to flush on every loop
+#endif
 
 class DCC
 {
@@ -65,12 +142,21 @@ public:
   static bool getThrottleDirection(int cab);
   static void writeCVByteMain(int cab, int cv, byte bValue);
   static void writeCVBitMain(int cab, int cv, byte bNum, bool bValue);
+  static void readCVByteMain(int cab, int cv); // answer comes by Railcom
   static void setFunction(int cab, byte fByte, byte eByte);
   static bool setFn(int cab, int16_t functionNumber, bool on);
   static void changeFn(int cab, int16_t functionNumber);
   static int8_t getFn(int cab, int16_t functionNumber);
+#ifdef HOT_RESTART
+  // Puts a loco back as it was before a reset, the reminders send it
+  static void restoreLoco(int cab, byte speedCode, uint32_t functions);
+#endif
   static uint32_t getFunctionMap(int cab);
   static void setDCFreq(int cab,byte freq);
+#ifdef DC_KICKSTART
+  static void setDCKick(int cab, byte ms);
+  static byte getThrottleKick(int cab);
+#endif
   static void updateGroupflags(byte &flags, int16_t functionNumber);
   static void setAccessory(int address, byte port, bool gate, byte onoff = 2);
   static bool setExtendedAccessory(int16_t address, int16_t value, byte repeats=3);
@@ -92,41 +178,178 @@ public:
   static void forgetAllLocos();    // removes all speed reminders
   static void displayCabList(Print *stream);
   static FSH *getMotorShieldName();
-  static inline void setGlobalSpeedsteps(byte s) {
-    globalSpeedsteps = s;
-  };
+  static void setGlobalSpeedsteps(byte s);
+#ifdef LOCO_MOMENTUM
+  // ms per speed step (of 126) when speeding up and slowing down, 0 for 
+  // none. cab 0 sets the rates given to locos when they are first seen.
+  static bool setMomentum(int cab, byte accel, byte decel);
+#endif
+#ifdef DCC_PACKET_STATS
+  static void showReminderStats(bool reset);
+#endif
+#ifdef DCC_DISTRICTS
+  // district 1 to DCC_DISTRICTS the loco is now in, 0 for all of them
+  static bool setLocoDistrict(int cab, int16_t district);
+#endif
   
-  struct LOCO
+  // Loco state is held as parallel arrays indexed by slot so that a pass
+  // over one field (address scans, reminders) touches only that array.
+  // This is shared by the sniffer (LocoTable) and all throttle interfaces.
+  // A growing table holds pointers to heap arrays of tableSlots entries,
+  // which are indexed just the same.
+#ifdef LOCO_TABLE_GROWS
+#define LOCO_FIELD(type, name) type * name
+#define LOCO_FIELD2(type, name, n) type (* name)[n]
+#else
+#define LOCO_FIELD(type, name) type name[MAX_LOCOS]
+#define LOCO_FIELD2(type, name, n) type name[MAX_LOCOS][n]
+#endif
+  struct LOCO_STORE
   {
-    int loco;
-    byte speedCode;
-    byte groupFlags;
-    uint32_t functions;
+    LOCO_FIELD(int, loco);
+    LOCO_FIELD(byte, speedCode);
+    LOCO_FIELD(byte, groupFlags);
+    LOCO_FIELD(uint32_t, functions);
+    LOCO_FIELD(byte, functionAge); // reminder cycles since a function last changed
+#ifdef LOCO_EXT_FUNCTIONS
+    LOCO_FIELD2(byte, extFunctions, EXT_FN_GROUPS); // F29-F36 in [0] bit 0 up
+    LOCO_FIELD(byte, extGroupFlags);                // bit per group touched
+#endif
+    LOCO_FIELD(byte, speedBoost);   // extra speed reminders still due after a speed change
+    byte dirty[(MAX_LOCOS+7)/8];    // one bit per slot awaiting broadcastLoco
+#ifdef LOCO_PACKET_CACHE
+    LOCO_FIELD2(byte, speedPacket, 4);    // address and speed bytes, no checksum
+    LOCO_FIELD(byte, speedPacketLength);  // 0 when speedPacket must be rebuilt
+#endif
+#ifdef LOCO_MOMENTUM
+    LOCO_FIELD(byte, targetSpeedCode);    // speedCode is ramped towards this
+    LOCO_FIELD(byte, accelRate);          // ms per step
+    LOCO_FIELD(byte, decelRate);
+    LOCO_FIELD(uint16_t, momentumCredit); // ms not yet used for a step
+#endif
+#ifdef LOCO_TABLE_GROWS
+    LOCO_FIELD(uint16_t, lastUsed);       // millis()/1000 of the last throttle lookup
+#endif
+#ifdef DC_KICKSTART
+    LOCO_FIELD(byte, dcKick);             // ms of full power when starting on DC
+#endif
+#ifdef DCC_DISTRICTS
+    LOCO_FIELD(byte, district);           // 0 for every MAIN stream
+#endif
   };
- static LOCO speedTable[MAX_LOCOS];
+ static LOCO_STORE speedTable;
+#ifdef LOCO_TABLE_GROWS
+ static byte tableSlots;  // slots allocated so far
+#else
+ static const byte tableSlots=MAX_LOCOS;
+#endif
+#ifdef LOCO_INDEX
+ static LocoIndex<MAX_LOCOS> locoIndex;
+#endif
  static int lookupSpeedTable(int locoId, bool autoCreate);
  static byte cv1(byte opcode, int cv);
  static byte cv2(int cv);
  
 private:
-  static byte loopStatus;
-  static void setThrottle2(uint16_t cab, uint8_t speedCode);
+  // round robin position of the reminders on each MAIN packet stream
+  struct REMINDER_STATE {
+    int lastLocoReminder;
+    int lastRemindedLoco;  // address of the last reminder packet
+    byte loopStatus;
+    byte reminderCycle;
+  };
+  static REMINDER_STATE reminders[MAIN_STREAMS];
+#ifdef DCC_DISTRICTS
+  static const byte ALL_STREAMS = 255;
+  static byte reminderStream;  // stream being reminded, or ALL_STREAMS
+#endif
+  static inline bool inStream(int reg, byte stream) {
+#ifdef DCC_DISTRICTS
+    return speedTable.district[reg]==0 || speedTable.district[reg]==stream+1;
+#else
+    (void)reg; (void)stream;
+    return true;
+#endif
+  }
+  static void scheduleLoco(int cab, const byte b[], byte nB, byte repeats, PACKET_PRIORITY priority);
+  static void setThrottle2(uint16_t cab, uint8_t speedCode, PACKET_PRIORITY priority);
+  static void applyThrottle(uint16_t cab, byte speedCode);
+  static byte buildSpeedPacket(byte b[], uint16_t cab, byte speedCode);
+  static void remindSpeed(int reg);
+  static inline void invalidateSpeedPacket(int reg) {
+#ifdef LOCO_PACKET_CACHE
+    speedTable.speedPacketLength[reg]=0;
+#else
+    (void)reg;
+#endif
+  }
+#ifdef LOCO_TABLE_GROWS
+  static bool growTable();
+#if LOCO_EVICT_SECONDS > 0
+  static int evictIdleLoco();
+#endif
+#endif
   static void updateLocoReminder(int loco, byte speedCode);
-  static void setFunctionInternal(int cab, byte fByte, byte eByte, byte count);
-  static bool issueReminder(int reg);
-  static int lastLocoReminder;
+  static void setFunctionInternal(int cab, byte fByte, byte eByte, byte count, PACKET_PRIORITY priority);
+  static void issueReminder(byte stream);
+  static bool issueReminder(byte stream, int reg);
+  static bool issueBoostReminder();
+  static void markForBroadcast(int reg);
+  static void flushBroadcasts();
+  static unsigned long lastBroadcastFlush;
+  static int boostCursor;
+  static bool boostPending;
+  static bool lastWasBoost;
+#ifdef DCC_PACKET_STATS
+  static StatsHistogram<5> reminderCycleTime; // ms per pass over the loco table
+  static unsigned long lastCycleStart;
+  static StatsHistogram<4> refreshInterval;   // ms between speed packets to a loco
+  static uint16_t lastRefresh[MAX_LOCOS];     // millis() of each slot's last
+  static uint16_t worstRefresh;
+  static int worstRefreshLoco;
+  static uint32_t refreshAlarms;
+  static unsigned long nextRefreshAlarm;
+  static void noteRefresh(int reg);
+#endif
   static int highestUsedReg;
   static FSH *shieldName;
   static byte globalSpeedsteps;
 
   static void issueReminders();
   static void callback(int value);
+#ifdef LOCO_MOMENTUM
+  static void issueMomentum();
+  static byte momentumStep(int reg, byte steps);
+  static bool momentumPending;
+  static unsigned long lastMomentumTick;
+  static byte defaultAccel;
+  static byte defaultDecel;
+#endif
+#ifdef ACCESSORY_GANG
+  struct GANG_ENTRY {
+    byte packet[3];
+    byte length;
+    byte onSends;    // copies still to send as given
+    byte offSends;   // then copies with the C bit cleared (basic packets only)
+    bool started;    // first copy sent, the rest are repeats
+  };
+  static GANG_ENTRY accessoryGang[ACCESSORY_GANG];
+  static byte gangCount;
+  static byte gangNext;
+  static bool lastWasAccessory;
+  static void gangAccessory(const byte packet[], byte length, byte onSends, byte offSends);
+  static bool mergeAccessory(const byte packet[], byte length, byte onSends, byte offSends);
+  static void issueAccessories();
+  static bool issueAccessoryRepeat();
+  static void sendGangCopy(GANG_ENTRY & e);
+#endif
 
   
   // NMRA codes #
   static const byte SET_SPEED = 0x3f;
   static const byte WRITE_BYTE_MAIN = 0xEC;
   static const byte WRITE_BIT_MAIN = 0xE8;
+  static const byte VERIFY_BYTE_MAIN = 0xE4;
   static const byte WRITE_BYTE = 0x7C;
   static const byte VERIFY_BYTE = 0x74;
   static const byte BIT_MANIPULATE = 0x78;
@@ -56,7 +56,20 @@ unsigned long DCCACK::ackPulseStart; // micros
  unsigned long DCCACK::ackCheckStart; // millis
  volatile bool DCCACK::ackPending;
   bool   DCCACK::autoPowerOff;
+  bool   DCCACK::holdSession=false;
+  bool   DCCACK::sessionBaseline=false;
+  bool   DCCACK::sessionPowerOff=false;
+  bool   DCCACK::sessionRejoin=false;
+  bool   DCCACK::sessionLearned=false;
+  byte   DCCACK::sessionDepth=0;
+  byte   DCCACK::verifyRepeats=PROG_REPEATS;
+  int    DCCACK::defaultRise;
+  unsigned long DCCACK::defaultMinPulse;
+  unsigned long DCCACK::defaultMaxPulse;
+  unsigned long DCCACK::ackSendStart;
    int  DCCACK::ackThreshold; 
+   int  DCCACK::ackRise;
+   uint16_t DCCACK::ackBaseline;
    int  DCCACK::ackLimitmA = 50;
      int DCCACK::ackMaxCurrent;
       unsigned int DCCACK::ackCheckDuration; // millis       
@@ -108,6 +121,14 @@ void  DCCACK::Setup(int cv, byte byteValueOrBitnum, ackOp const program[], ACK_C
       }
 
 
+  if (holdSession) {
+    // only the first operation of a session finds JOIN set or power off
+    sessionRejoin |= ackManagerRejoin;
+    sessionPowerOff |= autoPowerOff;
+    ackManagerRejoin = false;
+    autoPowerOff = false;
+  }
+
   ackManagerCv = cv;
   ackManagerProg = program;
   ackManagerProgStart = program;
@@ -132,9 +153,20 @@ bool DCCACK::checkResets(uint8_t numResets) {
 // Operations applicable to PROG track ONLY.
 // (yes I know I could have subclassed the main track but...) 
 
+// Where ADCee::read converts on each call the baseline is the mean of
+// ACK_BASELINE_READS readings, on platforms that scan the ADC from the
+// interrupt they are all the same latest sample. checkAck then keeps
+// the baseline up to date while waiting for an ack.
 void DCCACK::setAckBaseline() {
-      int baseline=progDriver->getCurrentRaw();
-      ackThreshold= baseline + progDriver->mA2raw(ackLimitmA);
+      long sum=0;
+      for (byte n=0; n<ACK_BASELINE_READS; n++) {
+        int raw=progDriver->getCurrentRaw();
+        sum+= raw<0 ? -raw : raw;
+      }
+      int baseline=sum/ACK_BASELINE_READS;
+      ackBaseline=baseline<<ACK_BASELINE_SHIFT;
+      if (!(holdSession && sessionLearned)) ackRise=progDriver->mA2raw(ackLimitmA);
+      ackThreshold= baseline + ackRise;
       if (Diag::ACK) DIAG(F("ACK baseline=%d/%dmA Threshold=%d/%dmA Duration between %lus and %lus"),
 			  baseline,progDriver->raw2mA(baseline),
 			  ackThreshold,progDriver->raw2mA(ackThreshold),
@@ -147,6 +179,7 @@ void DCCACK::setAckPending() {
       ackPulseDuration=0;
       ackDetected=false;
       ackCheckStart=millis();
+      ackSendStart=micros();
       numAckSamples=0;
       numAckGaps=0;
       ackPending=true;  // interrupt routines will now take note
@@ -154,9 +187,13 @@ void DCCACK::setAckPending() {
 
 byte DCCACK::getAck() {
       if (ackPending) return (2);  // still waiting
-      if (Diag::ACK) DIAG(F("%S after %dmS max=%d/%dmA pulse=%luS samples=%d gaps=%d"),ackDetected?F("ACK"):F("NO-ACK"), ackCheckDuration,
-			  ackMaxCurrent,progDriver->raw2mA(ackMaxCurrent), ackPulseDuration, numAckSamples, numAckGaps);
-      if (ackDetected) return (1); // Yes we had an ack
+      if (Diag::ACK) DIAG(F("%S after %dmS max=%d/%dmA pulse=%luS samples=%d gaps=%d baseline=%d"),ackDetected?F("ACK"):F("NO-ACK"), ackCheckDuration,
+			  ackMaxCurrent,progDriver->raw2mA(ackMaxCurrent), ackPulseDuration, numAckSamples, numAckGaps,
+			  ackThreshold-ackRise);
+      if (ackDetected) {
+        if (holdSession && !sessionLearned) learnAck();
+        return (1); // Yes we had an ack
+      }
       return(0);  // pending set off but not detected means no ACK.   
 }
 
@@ -171,8 +208,13 @@ void DCCACK::loop() {
     switch (opcode) {
       case BASELINE:
           if (progDriver->getPower()==POWERMODE::OVERLOAD) return;
-      	  if (checkResets(autoPowerOff || ackManagerRejoin  ? 20 : 3)) return;
+          if (holdSession && sessionBaseline) {
+            callbackState=AFTER_READ;
+            break;
+          }
+      	  if (checkResets(autoPowerOff || ackManagerRejoin || sessionPowerOff || sessionRejoin ? 20 : 3)) return;
           setAckBaseline();
+          sessionBaseline=holdSession;
           callbackState=AFTER_READ;
           break;
       case W0:    // write 0 bit
@@ -204,7 +246,7 @@ void DCCACK::loop() {
 	  if (checkResets( RESET_MIN)) return;
           if (Diag::ACK) DIAG(F("VB cv=%d value=%d"),ackManagerCv,ackManagerByte);
           byte message[] = { DCC::cv1(VERIFY_BYTE, ackManagerCv), DCC::cv2(ackManagerCv), ackManagerByte};
-          DCCWaveform::progTrack.schedulePacket(message, sizeof(message), PROG_REPEATS);
+          DCCWaveform::progTrack.schedulePacket(message, sizeof(message), verifyRepeats);
           setAckPending();
         }
         break;
@@ -216,7 +258,7 @@ void DCCACK::loop() {
           if (Diag::ACK) DIAG(F("V%d cv=%d bit=%d"),opcode==V1, ackManagerCv,ackManagerBitNum);
           byte instruction = VERIFY_BIT | (opcode==V0?BIT_OFF:BIT_ON) | ackManagerBitNum;
           byte message[] = {DCC::cv1(BIT_MANIPULATE, ackManagerCv), DCC::cv2(ackManagerCv), instruction };
-          DCCWaveform::progTrack.schedulePacket(message, sizeof(message), PROG_REPEATS);
+          DCCWaveform::progTrack.schedulePacket(message, sizeof(message), verifyRepeats);
           setAckPending();
         }
         break;
@@ -374,6 +416,8 @@ void DCCACK::loop() {
 }
 
 void DCCACK::callback(int value) {
+    // a tuned session must not be the reason for a failure
+    if (value == -1 && sessionLearned) forgetAck();
     // check for automatic retry
     if (value == -1 && ackManagerRetry > 0) {
       ackRetrySum ++;
@@ -456,6 +500,64 @@ void DCCACK::callback(int value) {
 }
 #endif
 
+// Sessions nest, only the outermost begin and end take effect.
+void DCCACK::beginSession() {
+  if (sessionDepth++) return;
+  forgetAck();
+  holdSession=true;
+  sessionBaseline=false;
+  sessionPowerOff=false;
+  sessionRejoin=false;
+}
+
+// Called on the first ack of a session with ackPulseDuration and
+// ackMaxCurrent of that ack.
+void DCCACK::learnAck() {
+  sessionLearned=true;
+  defaultRise=ackRise;
+  defaultMinPulse=minAckPulseDuration;
+  defaultMaxPulse=maxAckPulseDuration;
+  // the decoder's own pulse, with room either side, inside the defaults
+  if (ackPulseDuration/2 > minAckPulseDuration) minAckPulseDuration=ackPulseDuration/2;
+  if (ackPulseDuration*2 < maxAckPulseDuration) maxAckPulseDuration=ackPulseDuration*2;
+  // half way to the measured peak, but never below the configured limit
+  int rise=ackRise + (ackMaxCurrent-ackThreshold)/2;
+  if (rise > ackRise) {
+    ackThreshold+=rise-ackRise;
+    ackRise=rise;
+  }
+  if (ackPulseStart-ackSendStart < ACK_LEARN_LEAD) verifyRepeats=PROG_REPEATS_LEARNED;
+  if (Diag::ACK) DIAG(F("ACK learned pulse %lus-%lus threshold=%d repeats=%d"),
+                      minAckPulseDuration, maxAckPulseDuration, ackThreshold, verifyRepeats);
+}
+
+void DCCACK::forgetAck() {
+  if (!sessionLearned) return;
+  sessionLearned=false;
+  ackThreshold+=defaultRise-ackRise;
+  ackRise=defaultRise;
+  minAckPulseDuration=defaultMinPulse;
+  maxAckPulseDuration=defaultMaxPulse;
+  verifyRepeats=PROG_REPEATS;
+}
+
+void DCCACK::endSession() {
+  if (sessionDepth==0 || --sessionDepth) return;
+  forgetAck();
+  holdSession=false;
+  sessionBaseline=false;
+  if (sessionPowerOff && progDriver) {
+    if (Diag::ACK) DIAG(F("Auto Prog power off"));
+    progDriver->setPower(POWERMODE::OFF);
+  }
+  if (sessionRejoin) {
+    TrackManager::setJoin(true);
+    if (Diag::ACK) DIAG(F("Auto JOIN"));
+  }
+  sessionPowerOff=false;
+  sessionRejoin=false;
+}
+
 void DCCACK::checkAck(byte sentResetsSincePacket) {
     if (!ackPending) return; 
     // This function operates in interrupt() time so must be fast and can't DIAG 
@@ -469,8 +571,11 @@ void DCCACK::checkAck(byte sentResetsSincePacket) {
     numAckSamples++;
     if (current > ackMaxCurrent) ackMaxCurrent=current;
     // An ACK is a pulse lasting between minAckPulseDuration and maxAckPulseDuration uSecs (refer @haba)
+    // that rises ackRise above the baseline. Once in a pulse the current
+    // only has to stay above half that, so noise on the top of the pulse
+    // is not taken for its trailing edge.
         
-    if (current>ackThreshold) {
+    if (current > (ackPulseStart ? ackThreshold-ackRise/2 : ackThreshold)) {
        if (trailingEdgeCounter > 0) {
 	 numAckGaps++;
 	 trailingEdgeCounter = 0;
@@ -479,6 +584,13 @@ void DCCACK::checkAck(byte sentResetsSincePacket) {
        return;
     }
     
+    // Outside a pulse the baseline follows slow drift, like a sound
+    // decoder's capacitors charging, but not the start of a rising edge
+    if (ackPulseStart==0 && current>=0 && current < ackThreshold-ackRise/2) {
+      ackBaseline = ackBaseline - (ackBaseline>>ACK_BASELINE_SHIFT) + current;
+      ackThreshold = (ackBaseline>>ACK_BASELINE_SHIFT) + ackRise;
+    }
+
     // not in pulse
     if (ackPulseStart==0) return; // keep waiting for leading edge 
     
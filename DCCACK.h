@@ -92,6 +92,12 @@ class DCCACK {
     static void  Setup(int wordval, ackOp const program[], ACK_CALLBACK callback);
     static void loop();
     static bool isActive() { return ackManagerProg!=NULL;}
+    // Between beginSession and endSession prog track power and JOIN are
+    // left alone after each operation and the ack baseline is measured only
+    // once, so a list of CVs can be read back to back. endSession restores
+    // power and JOIN as they were before the first operation.
+    static void beginSession();
+    static void endSession();
   static inline int16_t setAckRetry(byte retry) {
     ackRetry = retry;
     ackRetryPSum = ackRetrySum;
@@ -115,6 +121,14 @@ class DCCACK {
     static void callback(int value);
     
     static const int PROG_REPEATS = 8; // repeats of programming commands (some decoders need at least 8 to be reliable)
+    // Within a session, once a decoder has acked within ACK_LEARN_LEAD of
+    // the verify packet starting, verifies use PROG_REPEATS_LEARNED (the
+    // NMRA minimum of 5) and the pulse window and threshold are narrowed
+    // around what was measured. Any failure goes back to the defaults.
+    static const int PROG_REPEATS_LEARNED = 5;
+    static const unsigned long ACK_LEARN_LEAD = 30000; // micros
+    static void learnAck();
+    static void forgetAck();
     
     // ACK management (Prog track only)  
     static void checkAck();
@@ -122,7 +136,12 @@ class DCCACK {
 
     static volatile bool ackPending;
     static volatile bool ackDetected;
-    static int  ackThreshold; 
+    static int  ackThreshold;  // baseline + ackRise
+    static int  ackRise;       // raw current rise of an ack
+    // running baseline << ACK_BASELINE_SHIFT, about 16 samples
+    static uint16_t ackBaseline;
+    static const byte ACK_BASELINE_SHIFT = 4;  // 16*4095 fits
+    static const byte ACK_BASELINE_READS = 8;
     static int  ackLimitmA;
     static int ackMaxCurrent;
     static unsigned long ackCheckStart; // millis
@@ -152,6 +171,16 @@ static byte   ackManagerBitNum;
 static bool   ackReceived;
 static bool   ackManagerRejoin;
 static bool   autoPowerOff;
+static bool   holdSession;
+static bool   sessionBaseline;     // ackThreshold is valid for this session
+static bool   sessionPowerOff;     // power off at endSession
+static bool   sessionRejoin;       // JOIN at endSession
+static bool   sessionLearned;      // window and repeats below are tuned
+static byte   sessionDepth;
+static byte   verifyRepeats;
+static int    defaultRise;
+static unsigned long defaultMinPulse, defaultMaxPulse;
+static unsigned long ackSendStart;  // micros
 static CALLBACK_STATE callbackState;
 static ACK_CALLBACK ackManagerCallback;
 
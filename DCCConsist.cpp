@@ -0,0 +1,96 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "DCCConsist.h"
+#ifdef LOCO_CONSISTS
+#include "StringFormatter.h"
+
+DCCConsist::CONSIST DCCConsist::consists[MAX_CONSISTS];
+byte DCCConsist::legacyCount=0;
+
+DCCConsist::CONSIST * DCCConsist::find(int16_t id) {
+  if (id<=0) return NULL;
+  for (byte i=0; i<MAX_CONSISTS; i++)
+    if (consists[i].id==id) return &consists[i];
+  return NULL;
+}
+
+bool DCCConsist::create(int16_t id, bool advanced, const int16_t members[], byte count) {
+  if (id<=0 || id>10239 || count==0 || count>CONSIST_MEMBERS) return false;
+  for (byte i=0; i<count; i++) {
+    int16_t loco=abs(members[i]);
+    if (loco==0 || loco>10239 || loco==id) return false;
+  }
+  remove(id);
+  CONSIST * c=NULL;
+  for (byte i=0; i<MAX_CONSISTS && !c; i++)
+    if (consists[i].id==0) c=&consists[i];
+  if (!c) return false;  // table full
+  c->id=id;
+  c->advanced=advanced;
+  memset(c->member, 0, sizeof(c->member));
+  for (byte i=0; i<count; i++) {
+    c->member[i]=members[i];
+    DCC::forgetLoco(abs(members[i]));
+  }
+  if (advanced) writeConsistCVs(c, true);
+  else legacyCount++;
+  return true;
+}
+
+bool DCCConsist::remove(int16_t id) {
+  CONSIST * c=find(id);
+  if (!c) return false;
+  DCC::forgetLoco(id);   // stops the members while they are still listed
+  if (c->advanced) writeConsistCVs(c, false);
+  else legacyCount--;
+  c->id=0;
+  return true;
+}
+
+// CV19 holds the consist address (or its last two digits with the rest in
+// CV20) with bit 7 set for a reversed member, see DCC::setConsistId.
+void DCCConsist::writeConsistCVs(const CONSIST * c, bool join) {
+  byte cv19=0, cv20=0;
+  if (join) {
+    if (c->id<=HIGHEST_SHORT_ADDR) cv19=c->id;
+    else {
+      cv20=c->id/100;
+      cv19=c->id%100;
+    }
+  }
+  for (byte i=0; i<CONSIST_MEMBERS && c->member[i]; i++) {
+    int16_t loco=abs(c->member[i]);
+    DCC::writeCVByteMain(loco, 20, cv20);
+    DCC::writeCVByteMain(loco, 19, cv19 | ((join && c->member[i]<0) ? 0x80 : 0));
+  }
+}
+
+void DCCConsist::list(Print * stream) {
+  for (byte i=0; i<MAX_CONSISTS; i++) {
+    const CONSIST * c=&consists[i];
+    if (c->id==0) continue;
+    StringFormatter::send(stream, F("<G %d%S"), c->id, c->advanced ? F(" ADVANCED") : F(""));
+    for (byte m=0; m<CONSIST_MEMBERS && c->member[m]; m++)
+      StringFormatter::send(stream, F(" %d"), c->member[m]);
+    StringFormatter::send(stream, F(">\n"));
+  }
+}
+#endif
@@ -0,0 +1,71 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DCCConsist_h
+#define DCCConsist_h
+#include <Arduino.h>
+#include "DCC.h"
+
+// Command station consists, only compiled in when LOCO_CONSISTS is set in
+// DCC.h.  A consist address stands for up to CONSIST_MEMBERS locos, each 
+// with a direction flag, and has one slot in the loco table like any 
+// other loco so that momentum and reminders happen once per consist.
+// - ADVANCED consists have CV19 (and CV20) of every member written on the
+//   main track, so each speed packet goes out once on the consist address.
+// - Other consists fan each speed packet out to every member in one go,
+//   reversed where flagged, and send function packets to the lead (first)
+//   member only.
+// Members are forgotten (stopped and dropped from reminders) when they 
+// join a consist.
+//   <G>                           list consists as <G id [ADVANCED] [-]loco ...>
+//   <G id [ADVANCED] [-]loco ...> create or replace, - runs the loco reversed
+//   <G id>                        stop and delete (advanced members' CV19 cleared)
+#ifdef LOCO_CONSISTS
+#ifndef MAX_CONSISTS
+#define MAX_CONSISTS 8
+#endif
+const byte CONSIST_MEMBERS = 6;
+
+class DCCConsist {
+public:
+  struct CONSIST {
+    int16_t id;                       // 0 for a free entry
+    int16_t member[CONSIST_MEMBERS];  // negative if reversed, 0 after the last
+    bool advanced;
+  };
+
+  static bool create(int16_t id, bool advanced, const int16_t members[], byte count);
+  static bool remove(int16_t id);
+  static void list(Print * stream);
+
+  // The consist whose packets DCC must fan out to the members, if cab is one
+  static inline CONSIST * findLegacy(uint16_t cab) {
+    if (legacyCount==0) return NULL;
+    CONSIST * c=find(cab);
+    return (c && !c->advanced) ? c : NULL;
+  }
+
+private:
+  static CONSIST * find(int16_t id);
+  static void writeConsistCVs(const CONSIST * c, bool join);
+  static CONSIST consists[MAX_CONSISTS];
+  static byte legacyCount;
+};
+#endif
+#endif
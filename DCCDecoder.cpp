@@ -23,6 +23,32 @@
 #include "DIAG.h"
 #include "DCC.h"
 
+DCCDecoder::CACHE DCCDecoder::cache[DCCDecoder::CACHE_SIZE];
+byte DCCDecoder::cacheNext = 0;
+
+// The part of the first instruction byte that says what is being
+// set, with the values masked out. 0 for packets that are never
+// cached (decoder control, consists, CV access) as those must not
+// be skipped.
+byte DCCDecoder::cacheKind(byte instr) {
+  switch (instr & 0xE0) {
+  case 0x20: return instr;          // extended (128 speed steps)
+  case 0x40:
+  case 0x60: return 0x40;           // 28 step speed and direction
+  case 0x80: return 0x80;           // F0-F4
+  case 0xA0: return instr & 0xF0;   // F5-F8 or F9-F12
+  case 0xC0: return instr;          // F13 and up
+  }
+  return 0;
+}
+
+DCCDecoder::CACHE *DCCDecoder::cacheFind(uint16_t addr, byte kind) {
+  for (byte n = 0; n < CACHE_SIZE; n++)
+    if (cache[n].kind == kind && cache[n].addr == addr)
+      return &cache[n];
+  return NULL;
+}
+
 bool DCCDecoder::parse(DCCPacket &p) {
   if (!active)
     return false;
@@ -37,18 +63,6 @@ bool DCCDecoder::parse(DCCPacket &p) {
   if (d[0] ==  0B11111111) {  // Idle packet
     return false;
   }
-  // CRC verification here
-  byte checksum = 0;
-  for (byte n = 0; n < p.len(); n++)
-    checksum ^= d[n];
-  if (checksum) {  // Result should be zero, if not it's an error!
-    if (Diag::SNIFFER) {
-      DIAG(F("Checksum error"));
-      p.print();
-    }
-    return false;
-  }
-
 /*
   Serial.print("< ");
   for(int n=0; n<8; n++) {
@@ -71,6 +85,39 @@ bool DCCDecoder::parse(DCCPacket &p) {
       addr = d[0] &  0B00111111;
     }
   }
+  byte kind = 0;
+  CACHE *slot = NULL;
+  if (decoderType == DECODER_MOBILE && addr != 0 && p.len() <= CACHE_PACKETLEN) { // not broadcasts
+    kind = cacheKind(instr[0]);
+    if (kind) {
+      slot = cacheFind(addr, kind);
+      if (slot && slot->len == p.len() && memcmp(slot->data, d, p.len()) == 0)
+	return false; // nothing new since the last one
+    }
+  }
+
+  // CRC verification here
+  byte checksum = 0;
+  for (byte n = 0; n < p.len(); n++)
+    checksum ^= d[n];
+  if (checksum) {  // Result should be zero, if not it's an error!
+    if (Diag::SNIFFER) {
+      DIAG(F("Checksum error"));
+      p.print();
+    }
+    return false;
+  }
+
+  if (kind) {
+    if (slot == NULL) {
+      slot = &cache[cacheNext];
+      cacheNext = (cacheNext + 1) % CACHE_SIZE;
+      slot->addr = addr;
+      slot->kind = kind;
+    }
+    slot->len = p.len();
+    memcpy(slot->data, d, p.len());
+  }
   if (decoderType == DECODER_MOBILE) {
     switch (instr[0] & 0xE0) {
     case 0x20: // 001x-xxxx Extended commands
@@ -86,16 +133,19 @@ bool DCCDecoder::parse(DCCPacket &p) {
       break;
     case 0x40: // 010x-xxxx 28 (or 14 step) speed we assume 28
     case 0x60: // 011x-xxxx
-      if ((locoInfoChanged = LocoTable::updateLoco(addr, instr[0] & 0B00111111)) == true) {
-	byte speed = instr[0] & 0B00001111; // first only look at 4 bits
-	if (speed > 1) {               // neither stop nor emergency stop, recalculate speed
-	  speed = ((instr[0] & 0B00001111) << 1) + bitRead(instr[0], 4); // reshuffle bits
-	  speed = (speed - 3) * 9/2;
-	}
-	byte direction = instr[0] & 0B00100000;
+    {
+      byte speed = instr[0] & 0B00001111; // first only look at 4 bits
+      if (speed > 1) {               // neither stop nor emergency stop, recalculate speed
+	speed = ((instr[0] & 0B00001111) << 1) + bitRead(instr[0], 4); // reshuffle bits
+	speed = (speed - 3) * 9/2;
+      }
+      byte direction = instr[0] & 0B00100000;
+      // compare in speedTable format, as that is what is stored
+      if ((locoInfoChanged = LocoTable::updateLoco(addr, (speed & 0x7F) | (direction ? 0x80 : 0))) == true) {
 	DCC::setThrottle(addr, speed, direction);
       }
-      break;
+    }
+    break;
     case 0x80: // 100x-xxxx Function group 1
       if ((locoInfoChanged = LocoTable::updateFunc(addr, instr[0], 1)) == true) {
 	byte normalized = (instr[0] << 1 & 0x1e) | (instr[0] >> 4 & 0x01);
@@ -120,10 +170,10 @@ bool DCCDecoder::parse(DCCPacket &p) {
     case 0xC0: // 110x-xxxx Extended (here are functions F13 and up
       switch (instr[0] & 0B00011111) {
       case 0B00011110:  // F13-F20 Function Control
-	if ((locoInfoChanged = LocoTable::updateFunc(addr, instr[0], 13)) == true) {
+	if ((locoInfoChanged = LocoTable::updateFunc(addr, instr[1], 13)) == true) {
 	  DCCEXParser::funcmap(addr, instr[1], 13, 20);
 	}
-	if ((locoInfoChanged = LocoTable::updateFunc(addr, instr[0], 17)) == true) {
+	if ((locoInfoChanged = LocoTable::updateFunc(addr, instr[1]>>4, 17)) == true) {
 	  DCCEXParser::funcmap(addr, instr[1], 13, 20);
 	}
       break;
@@ -23,8 +23,25 @@
 class DCCDecoder {
 public:
   static bool parse(DCCPacket &p);
-  static inline void onoff(bool on) {active = on;};
+  static inline void onoff(bool on) {active = on; cacheClear();};
 private:
   static bool active;
+  // Upstream repeats every loco's speed and function groups over and
+  // over. The last packet seen for each (address, instruction kind)
+  // is remembered so an identical repeat is thrown away before it is
+  // checksummed and decoded.
+  static const byte CACHE_SIZE = 32;
+  static const byte CACHE_PACKETLEN = 6;
+  struct CACHE {
+    uint16_t addr;
+    byte kind;     // 0 means free slot
+    byte len;
+    byte data[CACHE_PACKETLEN];
+  };
+  static CACHE cache[CACHE_SIZE];
+  static byte cacheNext;
+  static byte cacheKind(byte instr);
+  static CACHE *cacheFind(uint16_t addr, byte kind);
+  static inline void cacheClear() {memset(cache, 0, sizeof(cache));};
 };
 #endif // ARDUINO_ARCH_ESP32
@@ -42,10 +42,12 @@
 #endif
 #include "Display_Implementation.h"
 #include "LCN.h"
+#include "CommandTrace.h"
 #include "IODevice.h"
 #include "Turnouts.h"
 #include "Sensors.h"
 #include "Outputs.h"
+#include "EEStore.h"
 #include "CommandDistributor.h"
 #include "TrackManager.h"
 #include "DCCTimer.h"    
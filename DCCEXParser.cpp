@@ -57,18 +57,18 @@ Once a new OPCODE is decided upon, update this list.
   f, Loco decoder function control (deprecated)
   F, Loco decoder function control
   g,
-  G,
+  G, Command station consists
   h,
   H, Turnout state broadcast
   i, Server details string
   I, Turntable object command, control, and broadcast
   j, Throttle responses
   J, Throttle queries
-  k, Reserved for future use - Potentially Railcom
-  K, Reserved for future use - Potentially Railcom
+  k, Railcom POM read response
+  K, Railcom POM read on main
   l, Loco speedbyte/function map broadcast
   L, Reserved for LCC interface (implemented in EXRAIL)
-  m, message to throttles broadcast 
+  m, message to throttles broadcast, loco momentum <m cab accel [decel]>
   M, Write DCC packet
   n, Reserved for SensorCam
   N, Reserved for Sensorcam 
@@ -100,6 +100,7 @@ Once a new OPCODE is decided upon, update this list.
 
 #include "StringFormatter.h"
 #include "DCCEXParser.h"
+#include "CommandTokenizer.h"
 #include "DCC.h"
 #include "DCCWaveform.h"
 #include "Turnouts.h"
@@ -118,25 +119,191 @@ Once a new OPCODE is decided upon, update this list.
 #include "version.h"
 #include "KeywordHasher.h"
 #include "CamParser.h"
+#include "Railcom.h"
+#include "LoopProfile.h"
+#include "CommandTrace.h"
+#include "DCCConsist.h"
+#include "CVCache.h"
+#include "HotRestart.h"
 #ifdef ARDUINO_ARCH_ESP32
 #include "WifiESP32.h"
 #include "DCCDecoder.h"
 #endif
 
-// This macro can't be created easily as a portable function because the
-// flashlist requires a far pointer for high flash access. 
-#define SENDFLASHLIST(stream,flashList)                 \
-    for (int16_t i=0;;i+=sizeof(flashList[0])) {                            \
-        int16_t value=GETHIGHFLASHW(flashList,i);       \
-        if (value==INT16_MAX) break;                            \
-        StringFormatter::send(stream,F(" %d"),value);	\
-    }                                   
+// LIST_WRITERs for the <J> id lists, see CommandDistributor::sendList.
+// position counts entries including hidden ones.
+#ifdef EXRAIL_ACTIVE
+static bool writeRosterIds(Print * stream, uint16_t & position, int16_t room) {
+  for (;;position++) {
+    // The flashlist needs a far pointer for high flash access 
+    int16_t value=GETHIGHFLASHW(RMFT2::rosterIdList,position*sizeof(int16_t));
+    if (value==INT16_MAX) return true;
+    if (room<CommandDistributor::LIST_ENTRY_SIZE) return false;
+    StringFormatter::send(stream,F(" %d"),value);
+    room-=CommandDistributor::LIST_ENTRY_SIZE;
+  }
+}
+#endif
+
+static bool writeSensorIds(Print * stream, uint16_t & position, int16_t room) {
+  Sensor * s=Sensor::firstSensor;
+  for (uint16_t i=0; s && i<position; i++) s=s->nextSensor;
+  for (; s; s=s->nextSensor, position++) {
+    if (room<CommandDistributor::LIST_ENTRY_SIZE) return false;
+    StringFormatter::send(stream, F(" %d"),s->data.snum);
+    room-=CommandDistributor::LIST_ENTRY_SIZE;
+  }
+  return true;
+}
+
+// REPLY_WRITER for the turnout part of <s>
+static void writeTurnoutStates(Print * stream) {
+  Turnout::printAll(stream);
+}
+
+static bool writeTurnoutIds(Print * stream, uint16_t & position, int16_t room) {
+  Turnout * t=Turnout::first();
+  for (uint16_t i=0; t && i<position; i++) t=t->next();
+  for (; t; t=t->next(), position++) {
+    if (t->isHidden()) continue;
+    if (room<CommandDistributor::LIST_ENTRY_SIZE) return false;
+    StringFormatter::send(stream, F(" %d"),t->getId());
+    room-=CommandDistributor::LIST_ENTRY_SIZE;
+  }
+  return true;
+}
+
+#ifndef IO_NO_HAL
+static bool writeTurntableIds(Print * stream, uint16_t & position, int16_t room) {
+  Turntable * tto=Turntable::first();
+  for (uint16_t i=0; tto && i<position; i++) tto=tto->next();
+  for (; tto; tto=tto->next(), position++) {
+    if (tto->isHidden()) continue;
+    if (room<CommandDistributor::LIST_ENTRY_SIZE) return false;
+    StringFormatter::send(stream, F(" %d"),tto->getId());
+    room-=CommandDistributor::LIST_ENTRY_SIZE;
+  }
+  return true;
+}
+#endif
+
+#ifdef HAS_ENOUGH_MEMORY
+// <JZ> snapshot, the replies to <s>, <=>, <t cab> for every loco slot and
+// the route states in one go, ending with <jZ>. Each part is written like
+// a LIST_WRITER, taking what room is left, position is its own count.
+// The snapshot position holds the part in the top bits.
+static const byte SNAPSHOT_PART_SHIFT=12;
+static const uint16_t SNAPSHOT_COUNT_MASK=(1<<SNAPSHOT_PART_SHIFT)-1;
+typedef bool (*SNAPSHOT_PART)(Print * stream, uint16_t & position, int16_t & room);
+
+static bool snapshotHasRoom(int16_t & room) {
+  if (room<CommandDistributor::SNAPSHOT_ENTRY_SIZE) return false;
+  room-=CommandDistributor::SNAPSHOT_ENTRY_SIZE;
+  return true;
+}
+
+static bool writePowerStates(Print * stream, uint16_t & position, int16_t & room) {
+  char pstr[] = "? x";
+  for (; position<(uint16_t)TrackManager::numTracks(); position++) {
+    if (!TrackManager::getPower(position, pstr)) continue;
+    if (!snapshotHasRoom(room)) return false;
+    StringFormatter::send(stream, F("<p%s>\n"), pstr);
+  }
+  // the summary lines of broadcastPower, at most 25 bytes
+  if (!snapshotHasRoom(room)) return false;
+  char state=CommandDistributor::powerState();
+  if (state!='2') StringFormatter::send(stream, F("<p%c>\n"), state);
+  if (TrackManager::isJoined()) StringFormatter::send(stream, F("<p1 JOIN>\n"));
+  else {
+    if (TrackManager::getMainPower()==POWERMODE::ON) StringFormatter::send(stream, F("<p1 MAIN>\n"));
+    if (TrackManager::getProgPower()==POWERMODE::ON) StringFormatter::send(stream, F("<p1 PROG>\n"));
+  }
+  return true;
+}
+
+static bool writeTrackStates(Print * stream, uint16_t & position, int16_t & room) {
+  for (; position<(uint16_t)TrackManager::numTracks(); position++) {
+    if (!snapshotHasRoom(room)) return false;
+    TrackManager::streamTrackState(stream, position);
+  }
+  return true;
+}
+
+static bool writeLocoStates(Print * stream, uint16_t & position, int16_t & room) {
+  for (; position<DCC::tableSlots; position++) {
+    int loco=DCC::speedTable.loco[position];
+    if (loco<=0) continue;
+    if (!snapshotHasRoom(room)) return false;
+    StringFormatter::emit(stream, F("<l "), loco, ' ', (int)position, ' ',
+                          DCC::speedTable.speedCode[position], ' ',
+                          (long)DCC::speedTable.functions[position], F(">\n"));
+  }
+  return true;
+}
+
+static bool writeTurnoutStates(Print * stream, uint16_t & position, int16_t & room) {
+  Turnout * t=Turnout::first();
+  for (uint16_t i=0; t && i<position; i++) t=t->next();
+  for (; t; t=t->next(), position++) {
+    if (t->isHidden()) continue;
+    if (!snapshotHasRoom(room)) return false;
+    StringFormatter::send(stream, F("<H %d %d>\n"), t->getId(), t->isThrown());
+  }
+  return true;
+}
+
+static bool writeSensorStates(Print * stream, uint16_t & position, int16_t & room) {
+  Sensor * tt=Sensor::firstSensor;
+  for (uint16_t i=0; tt && i<position; i++) tt=tt->nextSensor;
+  for (; tt; tt=tt->nextSensor, position++) {
+    if (!snapshotHasRoom(room)) return false;
+    StringFormatter::send(stream, F("<%c %d>\n"), tt->active ? 'Q' : 'q', tt->data.snum);
+  }
+  return true;
+}
+
+static bool writeSnapshotEnd(Print * stream, uint16_t & position, int16_t & room) {
+  (void)position;
+  if (!snapshotHasRoom(room)) return false;
+  StringFormatter::send(stream, F("<jZ")); // sendList adds the >
+  return true;
+}
+
+static const SNAPSHOT_PART snapshotParts[] = {
+  writePowerStates, writeTrackStates, writeLocoStates,
+  writeTurnoutStates, writeSensorStates,
+#ifdef EXRAIL_ACTIVE
+  RMFT2::writeRouteStates,
+#endif
+  writeSnapshotEnd
+};
+
+static bool writeSnapshot(Print * stream, uint16_t & position, int16_t room) {
+  for (;;) {
+    byte part=position>>SNAPSHOT_PART_SHIFT;
+    uint16_t count=position & SNAPSHOT_COUNT_MASK;
+    bool done=snapshotParts[part](stream, count, room);
+    if (!done) {
+      position=(part<<SNAPSHOT_PART_SHIFT) | count;
+      return false;
+    }
+    if (++part==sizeof(snapshotParts)/sizeof(snapshotParts[0])) return true;
+    position=part<<SNAPSHOT_PART_SHIFT;
+  }
+}
+#endif
 
 int16_t DCCEXParser::stashP[MAX_COMMAND_PARAMS];
 bool DCCEXParser::stashBusy;
+#ifdef HAS_ENOUGH_MEMORY
+bool DCCEXParser::inBatch=false;
+byte DCCEXParser::batchFailures;
+#endif
 Print *DCCEXParser::stashStream = NULL;
 RingStream *DCCEXParser::stashRingStream = NULL;
 byte DCCEXParser::stashTarget=0;
+byte DCCEXParser::stashIndex=0;
+byte DCCEXParser::stashCount=0;
 
 // This is a JMRI command parser.
 // It doesnt know how the string got here, nor how it gets back.
@@ -147,94 +314,13 @@ byte DCCEXParser::stashTarget=0;
 
 int16_t DCCEXParser::splitValues(int16_t result[MAX_COMMAND_PARAMS], byte *cmd, bool usehex)
 {
-    byte state = 1;
-    byte parameterCount = 0;
-    int16_t runningValue = 0;
-    byte *remainingCmd = cmd + 1; // skips the opcode
-    bool signNegative = false;
-
-    // clear all parameters in case not enough found
-    for (int16_t i = 0; i < MAX_COMMAND_PARAMS; i++)
-        result[i] = 0;
-
-    while (parameterCount < MAX_COMMAND_PARAMS)
-    {
-        byte hot = *remainingCmd;
-        switch (state)
-        {
-
-        case 1: // skipping spaces before a param
-            if (hot == ' ')
-                break;
-            if (hot == '\0')
-	      return -1;
-	    if (hot == '>') {
-	      *remainingCmd = '\0';  // terminate the cmd string with 0 instead of '>'
-	      return parameterCount;
-	    }
-            state = 2;
-            continue;
-
-        case 2: // checking sign or quoted string
-#ifdef HAS_ENOUGH_MEMORY
-	    if (hot == '"') {
-	      // this inserts an extra parameter 0x7777 in front
-	      // of each string parameter as a marker that can
-	      // be checked that a string parameter follows
-	      // This clashes of course with the real value
-	      // 0x7777 which we hope is used seldom
-	      result[parameterCount] = (int16_t)0x7777;
-	      parameterCount++;
-	      result[parameterCount] = (int16_t)(remainingCmd - cmd + 1);
-	      parameterCount++;
-	      state = 4;
-	      break;
-	    }
-#endif
-            signNegative = false;
-            runningValue = 0;
-            state = 3;
-            if (hot != '-')
-                continue;
-            signNegative = true;
-            break;
-        case 3: // building a parameter
-            if (hot >= '0' && hot <= '9')
-            {
-                runningValue = (usehex?16:10) * runningValue + (hot - '0');
-                break;
-            }
-            if (hot >= 'a' && hot <= 'z') hot=hot-'a'+'A'; // uppercase a..z
-            if (usehex && hot>='A' && hot<='F') {
-                // treat A..F as hex not keyword
-                runningValue = 16 * runningValue + (hot - 'A' + 10);
-                break;
-            }
-            if (hot=='_' || (hot >= 'A' && hot <= 'Z'))
-            {
-                // Since JMRI got modified to send keywords in some rare cases, we need this
-                // Super Kluge to turn keywords into a hash value that can be recognised later
-                runningValue = ((runningValue << 5) + runningValue) ^ hot;
-                break;
-            }
-            result[parameterCount] = runningValue * (signNegative ? -1 : 1);
-            parameterCount++;
-            state = 1;
-            continue;
-#ifdef HAS_ENOUGH_MEMORY
-	case 4: // skipover text
-	  if (hot == '\0')        // We did run to end of buffer without finding the "
-	    return -1;
-	  if (hot == '"') {
-	    *remainingCmd = '\0'; // overwrite " in command buffer with the end-of-string
-	    state = 1;
-	  }
-	  break;
-#endif
-        }
-        remainingCmd++;
+    CommandTokenizer tokenizer;
+    tokenizer.begin(result, usehex);
+    for (byte *remainingCmd = cmd + 1; ; remainingCmd++) { // skips the opcode
+        auto r = tokenizer.feed(*remainingCmd, remainingCmd - cmd);
+        if (r == CommandTokenizer::TOKEN_DONE) return tokenizer.count();
+        if (r == CommandTokenizer::TOKEN_ERROR) return -1;
     }
-    return parameterCount;
 }
 
 extern __attribute__((weak))  void myFilter(Print * stream, byte & opcode, byte & paramCount, int16_t p[]);
@@ -267,6 +353,49 @@ void DCCEXParser::parse(const FSH * cmd) {
 
 // See documentation on DCC class for info on this section
 
+// Values of a <t CAB SPEED DIR> or <t REGISTER CAB SPEED DIR> command,
+// c just after the '<'. Returns their count, or 0 for anything else
+// including a speed command the 't' case would reject.
+static byte throttleValues(const byte * c, int16_t values[4]) {
+  if (*c++ != 't') return 0;
+  byte count=0;
+  for (;;) {
+    while (*c==' ') c++;
+    if (*c=='>') break;
+    if (count==4) return 0;
+    bool negative = (*c=='-');
+    if (negative) c++;
+    if (!isdigit(*c)) return 0;
+    int32_t value=0;
+    while (isdigit(*c)) {
+      value = value*10 + (*c++ - '0');
+      if (value > 32767) return 0;
+    }
+    values[count++] = negative ? -value : value;
+  }
+  if (count<3) return 0;
+  int16_t * v = values+count-3; // CAB SPEED DIR
+  if (v[0] < 0 || v[0] > 10239) return 0;
+  if (v[1] < -1 || v[1] > 126 || (v[0] == 0 && v[1] > 0)) return 0;
+  if (v[2] < 0 || v[2] > 1) return 0;
+  return count;
+}
+
+// Cab of a valid throttle command, -1 for anything else
+static int16_t throttleCab(const byte * c) {
+  int16_t values[4];
+  byte count=throttleValues(c, values);
+  return count ? values[count-3] : -1;
+}
+
+// true if a later throttle command in rest sets the speed of cab,
+// making the one in hand pointless
+static bool throttleSuperseded(int16_t cab, const byte * rest) {
+  for (; *rest; rest++)
+    if (*rest=='<' && throttleCab(rest+1)==cab) return true;
+  return false;
+}
+
 void DCCEXParser::parse(Print *stream,  byte *com,  RingStream *ringStream) {
   // This function can get stings of the form "<C OMM AND>" or "C OMM AND>"
   // found is true first after the leading "<" has been passed which results
@@ -279,29 +408,105 @@ void DCCEXParser::parse(Print *stream,  byte *com,  RingStream *ringStream) {
       found=false;
     }
     if (c[0] == '<') {
-      if (cForLater) parseOne(stream, cForLater, ringStream);
+      if (cForLater) {
+        // a throttle flooding speed changes only gets the latest one
+        // done for each loco in the buffer
+        int16_t values[4];
+        byte count=throttleValues(cForLater, values);
+        if (count && throttleSuperseded(values[count-3], c)) {
+          // its <l> broadcast comes from the later one, but the obsolete
+          // format still gets its own reply
+          if (count==4)
+            StringFormatter::send(stream, F("<T %d %d %d>\n"), values[0], values[2], values[3]);
+          cForLater=NULL;
+          found=true;
+          continue;
+        }
+        parseOne(stream, cForLater, ringStream);
+        // a list still being sent must finish before the next reply
+        if (CommandDistributor::holdCommands(stream, c)) return;
+      }
       found = true;
     }
   }
   if (cForLater) parseOne(stream, cForLater, ringStream);
 }
 
+// Opcode rules, checked before the big switch in parseOne.
+// Commands with a fixed set of parameter counts list them here so that
+// malformed commands are rejected without reaching their handler.
+// Opcodes not in the table accept any count and leave checking to the
+// switch (or to a sub parser like parseT).
+struct OPCODE_RULE {
+  byte opcode;
+  byte flags;
+  byte paramsAllowed; // bit n set if n parameters are valid (n<8)
+};
+static const byte OPCODE_HEX=0x01;  // parameters are parsed as hex
+#define ALLOW(n) (1<<(n))
+static const OPCODE_RULE opcodeRules[] PROGMEM = {
+  {'t', 0, ALLOW(1) | ALLOW(3) | ALLOW(4)},
+  {'f', 0, ALLOW(2) | ALLOW(3)},
+  {'F', 0, ALLOW(3)},
+  {'a', 0, ALLOW(2) | ALLOW(3) | ALLOW(4)},
+  {'A', 0, ALLOW(2)},
+  {'w', 0, ALLOW(3)},
+  {'b', 0, ALLOW(4)},
+  {'W', 0, ALLOW(1) | ALLOW(2) | ALLOW(3) | ALLOW(4)},
+  {'V', 0, ALLOW(2) | ALLOW(3)},
+  {'B', 0, ALLOW(3) | ALLOW(5)},
+  {'1', 0, ALLOW(0) | ALLOW(1)},
+  {'0', 0, ALLOW(0) | ALLOW(1)},
+  {'-', 0, ALLOW(0) | ALLOW(1)},
+  {'c', 0, ALLOW(0)},
+  {'J', 0, ALLOW(1) | ALLOW(2) | ALLOW(3) | ALLOW(4)}, // 4 only for <JS>
+  {'M', OPCODE_HEX, 0xFF},
+  {'P', OPCODE_HEX, 0xFF},
+};
+#undef ALLOW
+
+// returns the rule for opcode or NULL if it has none
+static const OPCODE_RULE * findOpcodeRule(byte opcode) {
+  for (byte i=0; i<sizeof(opcodeRules)/sizeof(opcodeRules[0]); i++)
+    if (GETFLASH(&opcodeRules[i].opcode)==opcode) return &opcodeRules[i];
+  return NULL;
+}
+
 void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
 {
-#ifdef DISABLE_PROG
-    (void)ringStream;
-#endif
 #ifndef DISABLE_EEPROM
     (void)EEPROM; // tell compiler not to warn this is unused
 #endif
-    byte params = 0;
-    if (Diag::CMD)
-        DIAG(F("PARSING:%s"), com);
+    DIAGLOG(Diag::CMD, F("PARSING:%s"), com);
     int16_t p[MAX_COMMAND_PARAMS];
     while (com[0] == '<' || com[0] == ' ')
         com++; // strip off any number of < or spaces
+#ifdef HAS_ENOUGH_MEMORY
+    if (com[0] == '(') {
+        parseBatch(stream, com, ringStream);
+        return;
+    }
+#endif
+    int16_t splitnum = splitValues(p, com, isHexOpcode(com[0]));
+    parseSplit(stream, com, p, splitnum, ringStream);
+}
+
+bool DCCEXParser::isHexOpcode(byte opcode) {
+    const OPCODE_RULE * rule = findOpcodeRule(opcode);
+    return rule && (GETFLASH(&rule->flags) & OPCODE_HEX);
+}
+
+// Executes a command whose parameters have already been split, either
+// by parseOne or by a CommandTokenizer fed as the command arrived.
+// com points at the opcode and has been terminated by the split.
+void DCCEXParser::parseSplit(Print *stream, byte *com, int16_t p[MAX_COMMAND_PARAMS], int16_t splitnum, RingStream * ringStream)
+{
+#ifdef DISABLE_PROG
+    (void)ringStream;
+#endif
+    byte params = 0;
     byte opcode = com[0];
-    int16_t splitnum = splitValues(p, com, opcode=='M' || opcode=='P');
+    const OPCODE_RULE * rule = NULL;
     if (splitnum < 0 || splitnum >= MAX_COMMAND_PARAMS) // if arguments are broken, leave but via printing <X>
       goto out;
     // Because of check above we are now inside byte size
@@ -312,6 +517,12 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
     if (filterRMFTCallback && opcode!='\0')
         filterRMFTCallback(stream, opcode, params, p);
 
+    // Filters may have consumed or rewritten the command, so the
+    // parameter count is checked against the opcode we now have.
+    rule = findOpcodeRule(opcode);
+    if (rule && params<8 && !(GETFLASH(&rule->paramsAllowed) & (1<<params)))
+      goto out;
+
     // Functions return from this switch if complete, break from switch implies error <X> to send
     switch (opcode)
     {
@@ -371,6 +582,32 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
         // speed change will be broadcast anyway in new <l > format
         return;
     }
+#ifdef LOCO_CONSISTS
+    case 'G': // CONSIST <G> list, <G CONSIST> delete, <G CONSIST [ADVANCED] [-]LOCO ...> create
+        if (params == 0) {
+            DCCConsist::list(stream);
+            return;
+        }
+        if (params == 1) {
+            if (!DCCConsist::remove(p[0])) break;
+            return;
+        }
+        {
+            bool advanced = p[1] == "ADVANCED"_hk;
+            byte first = advanced ? 2 : 1;
+            if (!DCCConsist::create(p[0], advanced, p + first, params - first)) break;
+        }
+        return;
+#endif
+
+#ifdef LOCO_MOMENTUM
+    case 'm': // MOMENTUM <m CAB ACCEL [DECEL]> ms per speed step, CAB 0 for new locos
+        if (params < 2 || params > 3 || p[0] < 0 || p[0] > 10239) break;
+        if (p[1] < 0 || p[1] > 255 || (params == 3 && (p[2] < 0 || p[2] > 255))) break;
+        if (!DCC::setMomentum(p[0], p[1], params == 3 ? p[2] : p[1])) break;
+        return;
+#endif
+
     case 'f': // FUNCTION <f CAB BYTE1 [BYTE2]>
         if (parsef(stream, params, p))
             return;
@@ -510,77 +747,34 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
           byte packet[params];
           for (int i=0;i<params;i++) {
             packet[i]=(byte)p[i+1];
-            if (Diag::CMD) DIAG(F("packet[%d]=%d (0x%x)"), i, packet[i], packet[i]);
+            DIAGLOG(Diag::CMD, F("packet[%d]=%d (0x%x)"), i, packet[i], packet[i]);
           }
-          (opcode=='M'?DCCWaveform::mainTrack:DCCWaveform::progTrack).schedulePacket(packet,params,3);  
+          if (opcode=='M') DCCWaveform::scheduleMain(packet,params,3,PRIORITY_ACCESSORY);
+          else DCCWaveform::progTrack.schedulePacket(packet,params,3,PRIORITY_ACCESSORY);
         }
         return;
         
 #ifndef DISABLE_PROG
-    case 'W': // WRITE CV ON PROG <W CV VALUE CALLBACKNUM CALLBACKSUB>
-        if (!stashCallback(stream, p, ringStream))
-	    break;
-        if (params == 1) // <W id> Write new loco id (clearing consist and managing short/long)
-            DCC::setLocoId(p[0],callback_Wloco);
-        else if (params == 4)  // WRITE CV ON PROG <W CV VALUE [CALLBACKNUM] [CALLBACKSUB]>
-            DCC::writeCVByte(p[0], p[1], callback_W4);
-        else if ((params==2 || params==3 ) && p[0]=="CONSIST"_hk ) {
-            DCC::setConsistId(p[1],p[2]=="REVERSE"_hk,callback_Wconsist);
-        }    
-        else if (params == 2)  // WRITE CV ON PROG <W CV VALUE>
-            DCC::writeCVByte(p[0], p[1], callback_W);
-	else
-            break;
-        return;
-
-    case 'V': // VERIFY CV ON PROG <V CV VALUE> <V CV BIT 0|1>
-        if (params == 2)
-        { // <V CV VALUE>
-            if (!stashCallback(stream, p, ringStream))
-                break;
-            DCC::verifyCVByte(p[0], p[1], callback_Vbyte);
-            return;
-        }
-        if (params == 3)
-        {
-            if (!stashCallback(stream, p, ringStream))
-                break;
-            DCC::verifyCVBit(p[0], p[1], p[2], callback_Vbit);
+    case 'W': // WRITE CV ON PROG
+    case 'V': // VERIFY CV ON PROG
+    case 'B': // WRITE CV BIT ON PROG
+    case 'R': // READ CV ON PROG
+        if (parseProg(stream, opcode, params, p, ringStream))
             return;
-        }
         break;
+#endif
 
-    case 'B': // WRITE CV BIT ON PROG  <B CV BIT VALUE CALLBACKNUM CALLBACKSUB> or <B CV BIT VALUE>
-        if (params != 3 && params != 5)
-	  break;
+#ifdef RAILCOM_SERIAL
+    case 'K': // <K cab cv> read CV on main via Railcom, replies <k cab cv value>
+        if (params != 2)
+            break;
         if (!stashCallback(stream, p, ringStream))
-	  break;
-        DCC::writeCVBit(p[0], p[1], p[2], callback_B);
-        return;
-
-    case 'R': // READ CV ON PROG
-        if (params == 1)
-        { // <R CV> -- uses verify callback
-            if (!stashCallback(stream, p, ringStream))
-                break;
-            DCC::verifyCVByte(p[0], 0, callback_Vbyte);
-            return;
-        }
-        if (params == 3)
-        { // <R CV CALLBACKNUM CALLBACKSUB>
-            if (!stashCallback(stream, p, ringStream))
-                break;
-            DCC::readCV(p[0], callback_R);
-            return;
-        }
-        if (params == 0)
-        { // <R> New read loco id
-            if (!stashCallback(stream, p, ringStream))
-                break;
-            DCC::getLocoId(callback_Rloco);
-            return;
+            break;
+        if (!Railcom::readCVMain(p[0], p[1], callback_K)) {
+            stashBusy = false;
+            break;
         }
-        break;
+        return;
 #endif
 
     case '1': // POWERON <1   [MAIN|PROG|JOIN]>
@@ -663,7 +857,8 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
     case 's': // STATUS <s>
         StringFormatter::send(stream, F("<iDCC-EX V-%S / %S / %S G-%S>\n"), F(VERSION), F(ARDUINO_TYPE), DCC::getMotorShieldName(), F(GITHUB_SHA));
         CommandDistributor::broadcastPower(); // <s> is the only "get power status" command we have
-        Turnout::printAll(stream); //send all Turnout states
+        ReplyCache::reply(stream, REPLY_TURNOUT_STATES, Turnout::turnoutlistHash+Turnout::stateGeneration,
+                          writeTurnoutStates); //send all Turnout states
         Sensor::printAll(stream);  //send all Sensor  states
         return;       
 
@@ -735,9 +930,15 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
           DCC::setDCFreq(p[0],p[2]);
           return;    
         }
+#ifdef DC_KICKSTART
+        if (p[1]=="DCKICK"_hk) { // <F cab DCKICK 0..255> ms of full power when starting
+          if (p[2]<0 || p[2]>255) break;
+          DCC::setDCKick(p[0],p[2]);
+          return;
+        }
+#endif
 
-        if (Diag::CMD)
-            DIAG(F("Setting loco %d F%d %S"), p[0], p[1], p[2] ? F("ON") : F("OFF"));
+        DIAGLOG(Diag::CMD, F("Setting loco %d F%d %S"), p[0], p[1], p[2] ? F("ON") : F("OFF"));
         if (DCC::setFn(p[0], p[1], p[2] == 1)) return;
 	break;
 
@@ -753,7 +954,7 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
 
     case 'J' : // throttle info access
         {
-            if ((params<1) | (params>3)) break; // <J>
+            if ((params<1) | (params>(p[0]=="S"_hk ? 4 : 3))) break; // <J>
             //if ((params<1) | (params>2)) break; // <J>
             int16_t id=(params==2)?p[1]:0;
             switch(p[0]) {
@@ -766,14 +967,47 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
                     CommandDistributor::setClockTime(p[1], p[2], 1);
                     return;
                 
+                case "S"_hk: // <JS ALL|NONE|LOCO|SENSOR|TURNOUT|POWER [from to]> subscribe to broadcasts
+                {
+                    if (params==1 || params==3) break;
+                    byte category;
+                    switch (p[1]) {
+                        case "ALL"_hk:     category=CommandDistributor::SUB_ALL; break;
+                        case "NONE"_hk:    category=0; break;
+                        case "LOCO"_hk:    category=CommandDistributor::SUB_LOCO; break;
+                        case "SENSOR"_hk:  category=CommandDistributor::SUB_SENSOR; break;
+                        case "TURNOUT"_hk: category=CommandDistributor::SUB_TURNOUT; break;
+                        case "POWER"_hk:   category=CommandDistributor::SUB_POWER; break;
+                        default: category=0xF0; // unknown keyword
+                    }
+                    if (category==0xF0) break;
+                    if (!CommandDistributor::subscribe(category, params==4 ? p[2] : INT16_MIN, params==4 ? p[3] : INT16_MAX)) break;
+                    StringFormatter::send(stream, F("<O>\n"));
+                    return;
+                }
+
                 case "G"_hk: // <JG> current gauge limits
                     if (params>1) break;
-                    TrackManager::reportGauges(stream);   // <g limit...limit>     
+                    ReplyCache::reply(stream, REPLY_GAUGES, TrackManager::stateGeneration,
+                                      TrackManager::reportGauges);   // <g limit...limit>     
                     return;
                 
                 case "I"_hk: // <JI> current values
-                    if (params>1) break;
-                    TrackManager::reportCurrent(stream);   // <g limit...limit>     
+                    if (params==1) {
+                        TrackManager::reportCurrent(stream);   // <g limit...limit>     
+                        return;
+                    }
+#ifdef HAS_ENOUGH_MEMORY
+                    if (p[1]=="HISTORY"_hk) { // <JI HISTORY [ms]> per track min/max/avg
+                        if (params==3 && p[2]<=0) break;
+                        TrackManager::reportCurrentHistory(stream, params==3 ? p[2] : 0);
+                        return;
+                    }
+#endif
+                    // <JI ms> stream current values every ms, <JI 0> stop
+                    if (params>2 || p[1]<0) break;
+                    if (!CommandDistributor::subscribeCurrent(p[1])) break;
+                    StringFormatter::send(stream, F("<O>\n"));
                     return;
 
                 case "A"_hk: // <JA> intercepted by EXRAIL// <JA> returns automations/routes
@@ -788,12 +1022,13 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
                     return;
  
             case "R"_hk: // <JR> returns rosters 
-                StringFormatter::send(stream, F("<jR"));
 #ifdef EXRAIL_ACTIVE
                 if (params==1) {
-                    SENDFLASHLIST(stream,RMFT2::rosterIdList)
+                    CommandDistributor::sendList(stream, F("<jR"), writeRosterIds, REPLY_ROSTER_LIST, 0);
+                    return;
                 }
-                else {
+                StringFormatter::send(stream, F("<jR"));
+                {
                     auto rosterName= RMFT2::getRosterName(id);
                     if (!rosterName) rosterName=F("");
 
@@ -803,18 +1038,19 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
                     StringFormatter::send(stream,F(" %d \"%S\" \"%S\""), 
 					                            id, rosterName, functionNames);
                 }
+#else
+                StringFormatter::send(stream, F("<jR"));
 #endif          
                 StringFormatter::send(stream, F(">\n"));      
                 return; 
             case "T"_hk: // <JT> returns turnout list 
-                StringFormatter::send(stream, F("<jT"));
                 if (params==1) { // <JT>
-                    for ( Turnout * t=Turnout::first(); t; t=t->next()) { 
-                        if (t->isHidden()) continue;          
-                        StringFormatter::send(stream, F(" %d"),t->getId());
-                    }
+                    CommandDistributor::sendList(stream, F("<jT"), writeTurnoutIds,
+                                                 REPLY_TURNOUT_LIST, Turnout::turnoutlistHash);
+                    return;
                 }
-                else { // <JT id>
+                StringFormatter::send(stream, F("<jT"));
+                { // <JT id>
                     Turnout * t=Turnout::get(id);
                     if (!t || t->isHidden()) StringFormatter::send(stream, F(" %d X"),id);
                     else {
@@ -831,17 +1067,33 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
                 }
                 StringFormatter::send(stream, F(">\n"));
                 return;
+#ifdef HAS_ENOUGH_MEMORY
+            case "Z"_hk: // <JZ> state snapshot for a new client, ends with <jZ>
+                if (params!=1) break;
+                CommandDistributor::sendList(stream, F(""), writeSnapshot);
+                return;
+#endif
+            case "Q"_hk: // <JQ> returns sensor list, in <JQS> order
+                if (params!=1) break;
+                CommandDistributor::sendList(stream, F("<jQ"), writeSensorIds);
+                return;
+            case "QS"_hk: // <JQS [list sequence]> returns packed sensor states or the changes since
+                if (params==2) break;
+                if (params>3) break;
+                Sensor::printStates(stream, params==3 && p[1]==Sensor::sensorlistHash, (uint16_t)p[2]);
+                return;
+            case "TS"_hk: // <JTS [list generation]> returns packed turnout states
+                if (params>3) break;
+                Turnout::printStates(stream, 
+                    params<3 || p[1]!=Turnout::turnoutlistHash || (uint16_t)p[2]!=Turnout::stateGeneration);
+                return;
 // No turntables without HAL support
 #ifndef IO_NO_HAL
             case "O"_hk: // <JO returns turntable list
-                StringFormatter::send(stream, F("<jO"));
                 if (params==1) { // <JO>
-                    for (Turntable * tto=Turntable::first(); tto; tto=tto->next()) { 
-                        if (tto->isHidden()) continue;          
-                        StringFormatter::send(stream, F(" %d"),tto->getId());
-                    }
-                    StringFormatter::send(stream, F(">\n"));
+                    CommandDistributor::sendList(stream, F("<jO"), writeTurntableIds);
                 } else {    // <JO id>
+                    StringFormatter::send(stream, F("<jO"));
                     Turntable *tto=Turntable::get(id);
                     if (!tto || tto->isHidden()) {
                         StringFormatter::send(stream, F(" %d X>\n"), id);
@@ -924,9 +1176,55 @@ void DCCEXParser::parseOne(Print *stream, byte *com, RingStream * ringStream)
     } // end of opcode switch
 
 out:// Any fallout here sends an <X>
+#ifdef HAS_ENOUGH_MEMORY
+    if (inBatch) {  // counted in the batch reply instead
+        batchFailures++;
+        return;
+    }
+#endif
     StringFormatter::send(stream, F("<X>\n"));
 }
 
+#ifdef HAS_ENOUGH_MEMORY
+// BATCH <( cmd | cmd | ... )>
+// Each cmd is a command without its < and >, executed in order.
+// Failures do not send <X>, instead one <) count failed> reply is
+// sent at the end. Turnout and sensor broadcasts caused by the batch
+// are held back and sent once each when it completes.
+void DCCEXParser::parseBatch(Print *stream, byte *com, RingStream * ringStream)
+{
+    if (inBatch) { // no nesting
+        StringFormatter::send(stream, F("<X>\n"));
+        return;
+    }
+    inBatch=true;
+    batchFailures=0;
+    byte count=0;
+    CommandDistributor::beginBatch();
+    byte *cmd = com + 1; // skip (
+    bool inString=false;
+    for (byte *c = cmd; ; c++) {
+        byte hot = *c;
+        if (hot == '"') inString = !inString;
+        if (inString && hot != '\0') continue;
+        if (hot != '|' && hot != ')' && hot != '>' && hot != '\0') continue;
+        // Terminate the sub command in place so splitValues finds its end
+        *c = '>';
+        while (*cmd == ' ') cmd++;
+        if (cmd != c) {
+            parseOne(stream, cmd, ringStream);
+            count++;
+        }
+        *c = hot; // put back the separator, or the string's terminator
+        if (hot != '|') break;
+        cmd = c + 1;
+    }
+    CommandDistributor::endBatch();
+    inBatch=false;
+    StringFormatter::send(stream, F("<) %d %d>\n"), count, batchFailures);
+}
+#endif
+
 bool DCCEXParser::parseZ(Print *stream, int16_t params, int16_t p[])
 {
 
@@ -1094,7 +1392,9 @@ bool DCCEXParser::parseS(Print *stream, int16_t params, int16_t p[])
     switch (params)
     {
     case 3: // <S id pin pullup>  create sensor. pullUp indicator (0=LOW/1=HIGH)
-        if (!Sensor::create(p[0], p[1], p[2]))
+    case 4: // <S id pin pullup debounce>  debounce is the number of extra read cycles (0-63) before acting on change
+        if (params==4 && (p[3] < 0 || p[3] > (int16_t)Sensor::maxReadCount)) return false;
+        if (!Sensor::create(p[0], p[1], p[2], params==4 ? p[3] : Sensor::minReadCount))
           return false;
         StringFormatter::send(stream, F("<O>\n"));
         return true;
@@ -1132,6 +1432,9 @@ bool DCCEXParser::parseC(Print *stream, int16_t params, int16_t p[]) {
 	    return true;
 #endif
     case "RESET"_hk:
+#ifdef HOT_RESTART
+        HotRestart::clear(); // a requested reset starts with the locos stopped
+#endif
         DCCTimer::reset();
         break; // and <X> if we didnt restart
     case "SPEED28"_hk:
@@ -1213,6 +1516,8 @@ bool DCCEXParser::parseD(Print *stream, int16_t params, int16_t p[])
     if (params == 0)
         return false;
     bool onOff = (params > 0) && (p[1] == 1 || p[1] == "ON"_hk); // dont care if other stuff or missing... just means off
+    // category diags may also be SYNC, written at once rather than queued
+    byte level = onOff ? Diag::ON : (params > 1 && p[1] == "SYNC"_hk) ? Diag::SYNC : Diag::OFF;
     switch (p[0])
     {
     case "CABS"_hk: // <D CABS>
@@ -1223,25 +1528,80 @@ bool DCCEXParser::parseD(Print *stream, int16_t params, int16_t p[])
         DIAG(F("Free memory=%d"), DCCTimer::getMinimumFreeMemory());
         return true;
 
-    case "CMD"_hk: // <D CMD ON/OFF>
-        Diag::CMD = onOff;
+    case "ARENA"_hk: // <D ARENA>
+        Arena::show();
+        return true;
+
+    case "QUEUE"_hk: // <D QUEUE>
+        for (byte stream=0; stream<MAIN_STREAMS; stream++)
+          DCCWaveform::mainStream(stream).showQueueStats();
+        return true;
+
+    case "OVERLOAD"_hk: // <D OVERLOAD [RESET]>
+        TrackManager::showCheckStats((params > 1) && p[1] == "RESET"_hk);
+        return true;
+
+#ifdef FAST_REVERSER
+    case "REVERSER"_hk: // <D REVERSER [RESET]>
+        TrackManager::showReverserStats((params > 1) && p[1] == "RESET"_hk);
+        return true;
+#endif
+
+#ifdef DCC_PACKET_STATS
+    case "LATENCY"_hk: // <D LATENCY [RESET]>
+        {
+          bool reset = (params > 1) && p[1] == "RESET"_hk;
+          for (byte stream=0; stream<MAIN_STREAMS; stream++)
+            DCCWaveform::mainStream(stream).showLatencyStats(reset);
+          DCC::showReminderStats(reset);
+        }
+        return true;
+#endif
+
+#ifdef ISR_LOAD_WINDOW
+    case "ISR"_hk: // <D ISR [RESET]>
+        DCCWaveform::showIsrLoad((params > 1) && p[1] == "RESET"_hk);
+        return true;
+#endif
+
+#ifdef CV_CACHE
+    case "CVCACHE"_hk: // <D CVCACHE [CLEAR]>
+        if (params > 1 && p[1] == "CLEAR"_hk) CVCache::clear();
+        CVCache::show();
+        return true;
+#endif
+
+#ifdef TRACE_SERIAL
+    case "TRACE"_hk: // <D TRACE ON/OFF>
+        CommandTrace::setActive(onOff);
+        return true;
+#endif
+
+#ifdef LOOP_PROFILE
+    case "LOOP"_hk: // <D LOOP [RESET]>
+        LoopProfile::show((params > 1) && p[1] == "RESET"_hk);
+        return true;
+#endif
+
+    case "CMD"_hk: // <D CMD ON/SYNC/OFF>
+        Diag::CMD = level;
         return true;
 
 #ifdef HAS_ENOUGH_MEMORY
-    case "WIFI"_hk: // <D WIFI ON/OFF>
-        Diag::WIFI = onOff;
+    case "WIFI"_hk: // <D WIFI ON/SYNC/OFF>
+        Diag::WIFI = level;
         return true;
 
-    case "ETHERNET"_hk: // <D ETHERNET ON/OFF>
-        Diag::ETHERNET = onOff;
+    case "ETHERNET"_hk: // <D ETHERNET ON/SYNC/OFF>
+        Diag::ETHERNET = level;
         return true;
 
-    case "WIT"_hk: // <D WIT ON/OFF>
-        Diag::WITHROTTLE = onOff;
+    case "WIT"_hk: // <D WIT ON/SYNC/OFF>
+        Diag::WITHROTTLE = level;
         return true;
 
-    case "LCN"_hk: // <D LCN ON/OFF>
-        Diag::LCN = onOff;
+    case "LCN"_hk: // <D LCN ON/SYNC/OFF>
+        Diag::LCN = level;
         return true;
     case "SNIFFER"_hk: // <D SNIFFER ON/OFF>
         Diag::SNIFFER = onOff;
@@ -1263,12 +1623,27 @@ bool DCCEXParser::parseD(Print *stream, int16_t params, int16_t p[])
         DIAG(F("VPIN=%u value=%d"), p[1], IODevice::readAnalogue(p[1]));
         return true;
 
+#if defined(I2C_STATS)
+    case "I2C"_hk:    // <D I2C [RESET]>
+        I2CManager.showStats(params > 1 && p[1] == "RESET"_hk);
+        return true;
+#endif
+
 #if !defined(IO_NO_HAL)
     case "HAL"_hk: 
         if (p[1] == "SHOW"_hk) 
           IODevice::DumpAll();
         else if (p[1] == "RESET"_hk)
           IODevice::reset();
+#if defined(HAL_BENCHMARK)
+        else if (p[1] == "STATS"_hk)  // <D HAL STATS [RESET]>
+          IODevice::showBenchmark(params > 2 && p[2] == "RESET"_hk);
+        else if (p[1] == "BENCH"_hk) {  // <D HAL BENCH>
+          for (Sensor *sensor = Sensor::firstSensor; sensor; sensor = sensor->nextSensor)
+            IODevice::read(sensor->data.pin);
+          IODevice::showBenchmark(false);
+        }
+#endif
         return true;
 #endif
 
@@ -1376,6 +1751,155 @@ bool DCCEXParser::parseI(Print *stream, int16_t params, int16_t p[])
 #endif
 
 // CALLBACKS must be static
+#ifndef DISABLE_PROG
+// Programming track commands. While one is running further ones are
+// queued (HAS_ENOUGH_MEMORY) and run back to back in one DCCACK session.
+bool DCCEXParser::parseProg(Print *stream, byte opcode, int16_t params, int16_t p[], RingStream * ringStream)
+{
+#ifdef HAS_ENOUGH_MEMORY
+    if (stashBusy)
+        return queueProg(stream, opcode, params, p, ringStream);
+#endif
+    switch (opcode) {
+    case 'W': // WRITE CV ON PROG <W CV VALUE CALLBACKNUM CALLBACKSUB>
+        if (!stashCallback(stream, p, ringStream))
+	    break;
+        if (params == 1) // <W id> Write new loco id (clearing consist and managing short/long)
+            DCC::setLocoId(p[0],callback_Wloco);
+        else if (params == 4)  // WRITE CV ON PROG <W CV VALUE [CALLBACKNUM] [CALLBACKSUB]>
+            DCC::writeCVByte(p[0], p[1], callback_W4);
+        else if ((params==2 || params==3 ) && p[0]=="CONSIST"_hk ) {
+            DCC::setConsistId(p[1],p[2]=="REVERSE"_hk,callback_Wconsist);
+        }    
+        else if (params == 2)  // WRITE CV ON PROG <W CV VALUE>
+            DCC::writeCVByte(p[0], p[1], callback_W);
+	else {
+            stashBusy = false; // nothing was started
+            break;
+        }
+        return true;
+
+    case 'V': // VERIFY CV ON PROG <V CV VALUE> <V CV BIT 0|1>
+        if (params == 2)
+        { // <V CV VALUE>
+            if (!stashCallback(stream, p, ringStream))
+                break;
+            DCC::verifyCVByte(p[0], p[1], callback_Vbyte);
+            return true;
+        }
+        if (params == 3)
+        {
+            if (!stashCallback(stream, p, ringStream))
+                break;
+            DCC::verifyCVBit(p[0], p[1], p[2], callback_Vbit);
+            return true;
+        }
+        break;
+
+    case 'B': // WRITE CV BIT ON PROG  <B CV BIT VALUE CALLBACKNUM CALLBACKSUB> or <B CV BIT VALUE>
+        if (params != 3 && params != 5)
+	  break;
+        if (!stashCallback(stream, p, ringStream))
+	  break;
+        DCC::writeCVBit(p[0], p[1], p[2], callback_B);
+        return true;
+
+    case 'R': // READ CV ON PROG
+        if (params >= 2 && p[0] == "LIST"_hk)
+        { // <R LIST CV CV ...> -- read CVs back to back, <v CV value> for each
+            if (!stashCallback(stream, p, ringStream))
+                break;
+            stashIndex = 1;
+            stashCount = params;
+            DCCACK::beginSession();
+            DCC::verifyCVByte(p[1], 0, callback_Rlist);
+            return true;
+        }
+        if (params == 1)
+        { // <R CV> -- uses verify callback
+            if (!stashCallback(stream, p, ringStream))
+                break;
+            DCC::verifyCVByte(p[0], 0, callback_Vbyte);
+            return true;
+        }
+        if (params == 3)
+        { // <R CV CALLBACKNUM CALLBACKSUB>
+            if (!stashCallback(stream, p, ringStream))
+                break;
+            DCC::readCV(p[0], callback_R);
+            return true;
+        }
+        if (params == 0)
+        { // <R> New read loco id
+            if (!stashCallback(stream, p, ringStream))
+                break;
+            DCC::getLocoId(callback_Rloco);
+            return true;
+        }
+        break;
+    default:
+        break;
+    }
+    return false;
+}
+#endif
+
+#if !defined(DISABLE_PROG) && defined(HAS_ENOUGH_MEMORY)
+DCCEXParser::PROG_JOB DCCEXParser::progQueue[PROG_QUEUE];
+byte DCCEXParser::progQueueStart=0;
+byte DCCEXParser::progQueueCount=0;
+bool DCCEXParser::progQueueSession=false;
+bool DCCEXParser::progReplay=false;
+
+bool DCCEXParser::queueProg(Print *stream, byte opcode, int16_t params, int16_t p[], RingStream * ringStream)
+{
+    if (progQueueCount >= PROG_QUEUE)
+        return false; // <X>, client has to try again
+    PROG_JOB & job = progQueue[(progQueueStart + progQueueCount) % PROG_QUEUE];
+    job.opcode = opcode;
+    job.params = params;
+    job.stream = stream;
+    job.ring = ringStream;
+    job.target = ringStream ? ringStream->peekTargetMark() : 0;
+    memcpy(job.p, p, sizeof(job.p));
+    progQueueCount++;
+    return true;
+}
+
+// Called when the running job has replied. Starts the next queued one,
+// if any, in the same DCCACK session so that the prog track is not
+// powered down and up again in between.
+void DCCEXParser::runProgQueue()
+{
+    while (progQueueCount && !stashBusy) {
+        PROG_JOB job = progQueue[progQueueStart];
+        progQueueStart = (progQueueStart + 1) % PROG_QUEUE;
+        progQueueCount--;
+        if (!progQueueSession) {
+            progQueueSession = true;
+            DCCACK::beginSession();
+        }
+        progReplay = true;
+        stashTarget = job.target;
+        bool ok = parseProg(job.stream, job.opcode, job.params, job.p, job.ring);
+        progReplay = false;
+        if (!ok) {
+            Print * out = job.stream;
+            if (job.ring) {
+                job.ring->mark(job.target);
+                out = job.ring;
+            }
+            StringFormatter::send(out, F("<X>\n"));
+            if (job.ring) job.ring->commit();
+        }
+    }
+    if (progQueueCount == 0 && !stashBusy && progQueueSession) {
+        progQueueSession = false;
+        DCCACK::endSession();
+    }
+}
+#endif
+
 bool DCCEXParser::stashCallback(Print *stream, int16_t p[MAX_COMMAND_PARAMS], RingStream * ringStream)
 {
     if (stashBusy )
@@ -1383,7 +1907,11 @@ bool DCCEXParser::stashCallback(Print *stream, int16_t p[MAX_COMMAND_PARAMS], Ri
     stashBusy = true;
     stashStream = stream;
     stashRingStream=ringStream;
+#if !defined(DISABLE_PROG) && defined(HAS_ENOUGH_MEMORY)
+    if (ringStream && !progReplay) stashTarget= ringStream->peekTargetMark();
+#else
     if (ringStream) stashTarget= ringStream->peekTargetMark();
+#endif
     memcpy(stashP, p, MAX_COMMAND_PARAMS * sizeof(p[0]));
     return true;
 }
@@ -1399,6 +1927,9 @@ Print * DCCEXParser::getAsyncReplyStream() {
 void DCCEXParser::commitAsyncReplyStream() {
      if (stashRingStream) stashRingStream->commit();
      stashBusy = false;
+#if !defined(DISABLE_PROG) && defined(HAS_ENOUGH_MEMORY)
+     runProgQueue();
+#endif
 }
 
 void DCCEXParser::callback_W(int16_t result)
@@ -1432,6 +1963,29 @@ void DCCEXParser::callback_Vbyte(int16_t result)
     commitAsyncReplyStream();
 }
 
+// Each result is sent as soon as it is known. A missing or unusable prog
+// track (-2, -3) ends the list early.
+void DCCEXParser::callback_Rlist(int16_t result)
+{
+    StringFormatter::send(getAsyncReplyStream(), F("<v %d %d>\n"), stashP[stashIndex], result);
+    stashIndex++;
+    if (stashIndex < stashCount && result >= -1) {
+        if (stashRingStream) stashRingStream->commit();
+        DCC::verifyCVByte(stashP[stashIndex], 0, callback_Rlist);
+        return;
+    }
+    DCCACK::endSession();
+    commitAsyncReplyStream();
+}
+
+#ifdef RAILCOM_SERIAL
+void DCCEXParser::callback_K(int16_t result)
+{
+    StringFormatter::send(getAsyncReplyStream(), F("<k %d %d %d>\n"), stashP[0], stashP[1], result);
+    commitAsyncReplyStream();
+}
+#endif
+
 void DCCEXParser::callback_R(int16_t result)
 {
     StringFormatter::send(getAsyncReplyStream(), F("<r%d|%d|%d %d>\n"), stashP[1], stashP[2], stashP[0], result);
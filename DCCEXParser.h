@@ -35,6 +35,8 @@ struct DCCEXParser
    static void parse(Print * stream,  byte * command,  RingStream * ringStream);
    static void parse(const FSH * cmd);
    static void parseOne(Print * stream,  byte * command,  RingStream * ringStream);
+   static void parseSplit(Print * stream, byte * command, int16_t p[], int16_t splitnum, RingStream * ringStream);
+   static bool isHexOpcode(byte opcode);
    static void setFilter(FILTER_CALLBACK filter);
    static void setRMFTFilter(FILTER_CALLBACK filter);
    static void setAtCommandCallback(AT_COMMAND_CALLBACK filter);
@@ -55,6 +57,34 @@ struct DCCEXParser
 #ifndef IO_NO_HAL
     static bool parseI(Print * stream, int16_t params, int16_t p[]);
 #endif
+#ifndef DISABLE_PROG
+    static bool parseProg(Print * stream, byte opcode, int16_t params, int16_t p[], RingStream * ringStream);
+#endif
+#if !defined(DISABLE_PROG) && defined(HAS_ENOUGH_MEMORY)
+    // prog track commands waiting for the running one to finish
+    struct PROG_JOB {
+      byte opcode;
+      byte params;
+      byte target;           // ring client, if ring is set
+      Print * stream;
+      RingStream * ring;
+      int16_t p[MAX_COMMAND_PARAMS];
+    };
+    static const byte PROG_QUEUE=4;
+    static PROG_JOB progQueue[PROG_QUEUE];
+    static byte progQueueStart;
+    static byte progQueueCount;
+    static bool progQueueSession;  // DCCACK session held for the queue
+    static bool progReplay;        // stashTarget was set by runProgQueue
+    static bool queueProg(Print * stream, byte opcode, int16_t params, int16_t p[], RingStream * ringStream);
+    static void runProgQueue();
+#endif
+
+#ifdef HAS_ENOUGH_MEMORY
+    static void parseBatch(Print * stream, byte * com, RingStream * ringStream);
+    static bool inBatch;
+    static byte batchFailures;
+#endif
 
     static Print * getAsyncReplyStream();
     static void commitAsyncReplyStream();
@@ -75,6 +105,12 @@ struct DCCEXParser
     static void callback_Wconsist(int16_t result);
     static void callback_Vbit(int16_t result);
     static void callback_Vbyte(int16_t result);
+    static void callback_Rlist(int16_t result);
+#ifdef RAILCOM_SERIAL
+    static void callback_K(int16_t result);
+#endif
+    static byte stashIndex;   // next stashP entry of <R LIST ...>
+    static byte stashCount;
     static FILTER_CALLBACK  filterCallback;
     static FILTER_CALLBACK  filterRMFTCallback;
     static AT_COMMAND_CALLBACK  atCommandCallback;
@@ -19,65 +19,46 @@
 #include <Arduino.h>
 #ifndef DCCPacket_h
 #define DCCPacket_h
-#include <strings.h>
 #include "defines.h"
 
+// The longest packet the sniffer assembles, which is longer than any
+// DCC packet so that damaged ones can still be recognised.
+#ifndef MAXDCCPACKETLEN
+#define MAXDCCPACKETLEN 8
+#endif
+
+// The bytes are kept inline, so packets are copied and returned by
+// value without touching the heap.
 class DCCPacket {
 public:
   DCCPacket() {
     _len = 0;
-    _data = NULL;
   };
-  DCCPacket(byte *d, byte l) {
+  DCCPacket(const byte *d, byte l) {
+    if (l > MAXDCCPACKETLEN) l = MAXDCCPACKETLEN;
     _len = l;
-    _data = new byte[_len];
-    for (byte n = 0; n<_len; n++)
-      _data[n] = d[n];
-  };
-  DCCPacket(const DCCPacket &old) {
-    _len = old._len;
-    _data = new byte[_len];
-    for (byte n = 0; n<_len; n++)
-      _data[n] = old._data[n];
-  };
-  DCCPacket &operator=(const DCCPacket &rhs) {
-    if (this == &rhs)
-      return *this;
-    delete[]_data;
-    _len = rhs._len;
-    _data = new byte[_len];
-    for (byte n = 0; n<_len; n++)
-      _data[n] = rhs._data[n];
-    return *this;
-  };
-  ~DCCPacket() {
-    if (_len) {
-      delete[]_data;
-      _len = 0;
-      _data = NULL;
-    }
+    memcpy(_data, d, l);
   };
-  inline bool operator==(const DCCPacket &right) {
+  inline bool operator==(const DCCPacket &right) const {
     if (_len != right._len)
       return false;
-    if (_len == 0)
-      return true;
-    return (bcmp(_data, right._data, _len) == 0);
+    return (memcmp(_data, right._data, _len) == 0);
   };
-  void print() {
+  void print(Print *stream = &USB_SERIAL) const {
     static const char hexchars[]="0123456789ABCDEF";
-    USB_SERIAL.print(F("<* DCCPACKET "));
+    stream->print(F("<* DCCPACKET "));
     for (byte n = 0; n< _len; n++) {
-      USB_SERIAL.print(hexchars[_data[n]>>4]);
-      USB_SERIAL.print(hexchars[_data[n] & 0x0f]);
-      USB_SERIAL.print(' ');
+      stream->print(hexchars[_data[n]>>4]);
+      stream->print(hexchars[_data[n] & 0x0f]);
+      stream->print(' ');
     }
-    USB_SERIAL.print(F("*>\n"));
+    stream->print(F("*>\n"));
   };
-  inline byte len() {return _len;};
+  inline byte len() const {return _len;};
   inline byte *data() {return _data;};
+  inline const byte *data() const {return _data;};
 private:
-  byte _len = 0;
-  byte *_data = NULL;
+  byte _len;
+  byte _data[MAXDCCPACKETLEN];
 };
 #endif
@@ -163,7 +163,8 @@ RMTChannel::RMTChannel(pinpair pins, bool isMain) {
 
   // data: max packet size today is 5 + checksum
   maxDataLen = DATA_LEN(MAX_PACKET_SIZE+1);  // plus checksum
-  data = (rmt_item32_t*)malloc(maxDataLen*sizeof(rmt_item32_t));
+  for (byte q=0; q<RMT_QUEUE_LEN; q++)
+    data[q] = (rmt_item32_t*)malloc(maxDataLen*sizeof(rmt_item32_t));
 
   rmt_config_t config;
   // Configure the RMT channel for TX
@@ -193,7 +194,6 @@ RMTChannel::RMTChannel(pinpair pins, bool isMain) {
   // packet queue. We intentionally do not wait for the RMT TX complete here.
   //rmt_write_items(channel, preamble, preambleLen, false);
   RMTprefill();
-  dataReady = false;
 }
 
 void RMTChannel::RMTprefill() {
@@ -203,19 +203,13 @@ void RMTChannel::RMTprefill() {
 
 const byte transmitMask[] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
 
-int RMTChannel::RMTfillData(const byte buffer[], byte byteCount, byte repeatCount=0) {
+int RMTChannel::RMTfillData(const byte buffer[], byte byteCount, byte repeatCount, uint32_t &ahead) {
   //int RMTChannel::RMTfillData(dccPacket packet) {
-  // dataReady: Signals to then interrupt routine. It is set when
-  // we have data in the channel buffer which can be copied out
-  // to the HW. dataRepeat on the other hand signals back to
-  // the caller of this function if the data has been sent enough
-  // times (0 to 3 means 1 to 4 times in total).
-  {
-    volatile byte dr = dataRepeat; // copy to test variable, not to be optimezed away
-    if (dr > 0) // we have still old work to do
-      return dr;
-  }
-  if (dataReady == true) // the packet is not copied out yet
+  // The packet is encoded into the next free queue slot, the interrupt
+  // routine copies it out to the HW when the packets before it are done.
+  // ahead returns the number of transmissions before this packet starts,
+  // repeatCount of 0 to 3 means 1 to 4 times in total.
+  if (queued() >= RMT_QUEUE_LEN-1) // queue full, caller has to try again
     return 1000;
   if (DATA_LEN(byteCount) > maxDataLen) {  // this would overun our allocated memory for data
     DIAG(F("Can not convert DCC bytes # %d to DCC bits %d, buffer too small"), byteCount, maxDataLen);
@@ -223,23 +217,33 @@ int RMTChannel::RMTfillData(const byte buffer[], byte byteCount, byte repeatCoun
   }
 
   // convert bytes to RMT stream of "bits"
+  byte tail = queueTail;
+  rmt_item32_t *d = data[tail];
   byte bitcounter = 0;
   for(byte n=0; n<byteCount; n++) {
     for(byte bit=0; bit<8; bit++) {
       if (buffer[n] & transmitMask[bit])
-	setDCCBit1(data + bitcounter++);
+	setDCCBit1(d + bitcounter++);
       else
-	setDCCBit0(data + bitcounter++);
+	setDCCBit0(d + bitcounter++);
     }
-    setDCCBit0(data + bitcounter++); // zero at end of each byte
+    setDCCBit0(d + bitcounter++); // zero at end of each byte
   }
-  setDCCBit1(data + bitcounter-1);     // overwrite previous zero bit with one bit
-  setEOT(data + bitcounter++);         // EOT marker
-  dataLen = bitcounter;
-  noInterrupts();                      // keep dataReady and dataRepeat consistnet to each other
-  dataReady = true;
-  dataRepeat = repeatCount+1;         // repeatCount of 0 means send once
+  setDCCBit1(d + bitcounter-1);     // overwrite previous zero bit with one bit
+  setEOT(d + bitcounter++);         // EOT marker
+  dataLen[tail] = bitcounter;
+  dataRepeat[tail] = repeatCount;
+#ifdef DCC_PACKET_STATS
+  queuedAt[tail] = micros();
+#endif
+  noInterrupts();                   // keep ahead consistent with the queue
+  ahead = currentRepeat;
+  for (byte q=queueHead; q!=tail; q=(q+1)%RMT_QUEUE_LEN)
+    ahead += dataRepeat[q]+1;
+  queueTail = (tail+1)%RMT_QUEUE_LEN;
   interrupts();
+  byte fill = queued();
+  if (fill > maxQueueFill) maxQueueFill = fill;
   return 0;
 }
 
@@ -247,20 +251,27 @@ void IRAM_ATTR RMTChannel::RMTinterrupt() {
   //no rmt_tx_start(channel,true) as we run in loop mode
   //preamble is always loaded at beginning of buffer
   packetCounter++;
-  if (!dataReady && dataRepeat == 0) { // we did run empty
+  if (currentRepeat > 0) {    // loop mode sends the loaded packet again
+    currentRepeat--;
+    return;
+  }
+  byte head = queueHead;
+  if (head == queueTail) {    // we did run empty
+    if (!idleLoaded) underrunCounter++;
+    idleCounter++;
     rmt_fill_tx_items(channel, idle, idleLen, preambleLen-1);
+    idleLoaded = true;
     return; // nothing to do about that
   }
 
-  // take care of incoming data
-  if (dataReady) {            // if we have new data, fill while preamble is running
-    rmt_fill_tx_items(channel, data, dataLen, preambleLen-1);
-    dataReady = false;
-    if (dataRepeat == 0)       // all data should go out at least once
-      DIAG(F("Channel %d DCC signal lost data"), channel);
-  }
-  if (dataRepeat > 0)         // if a repeat count was specified, work on that
-    dataRepeat--;
+  // take care of incoming data, fill while preamble is running
+  rmt_fill_tx_items(channel, data[head], dataLen[head], preambleLen-1);
+  currentRepeat = dataRepeat[head];
+#ifdef DCC_PACKET_STATS
+  queueWait.add(micros() - queuedAt[head]);
+#endif
+  idleLoaded = false;
+  queueHead = (head+1)%RMT_QUEUE_LEN;
 }
 
 bool RMTChannel::addPin(byte pin, bool inverted) {
@@ -24,12 +24,19 @@
 #include "soc/rmt_reg.h"
 #include "soc/rmt_struct.h"
 #include "MotorDriver.h" // for class pinpair
+#include "PacketStats.h"
 
 // make calculations easy and set up for microseconds
 #define RMT_CLOCK_DIVIDER 80
 #define DCC_1_HALFPERIOD 58  //4640 // 1 / 80000000 * 4640 = 58us
 #define DCC_0_HALFPERIOD 100 //8000
 
+// Pre-encoded packets waiting for the RMT hardware. One slot is always
+// kept free to tell a full queue from an empty one.
+#ifndef RMT_QUEUE_LEN
+#define RMT_QUEUE_LEN 4
+#endif
+
 class RMTChannel {
  public:
   RMTChannel(pinpair pins, bool isMain);
@@ -38,19 +45,28 @@ class RMTChannel {
   void IRAM_ATTR RMTinterrupt();
   void RMTprefill();
   //int RMTfillData(dccPacket packet);
-  int RMTfillData(const byte buffer[], byte byteCount, byte repeatCount);
+  int RMTfillData(const byte buffer[], byte byteCount, byte repeatCount, uint32_t &ahead);
+  // A reminder may be queued when nothing is waiting behind the packet
+  // on the wire, so there is always a packet ready to follow it.
   inline bool busy() {
-    if (dataRepeat > 0) // we have still old work to do
-      return true;
-    return dataReady;
+    return queued() > 0;
   };
   inline void waitForDataCopy() {
-    while(1) { // do nothing and wait for interrupt clearing dataReady to happen
-      if (dataReady == false)
+    while(1) { // do nothing and wait for interrupt to free a queue slot
+      if (queued() < RMT_QUEUE_LEN-1)
 	break;
     }
   };
+  inline byte queued() {
+    return (queueTail + RMT_QUEUE_LEN - queueHead) % RMT_QUEUE_LEN;
+  };
   inline uint32_t packetCount() { return packetCounter; };
+  inline uint32_t idleCount() { return idleCounter; };
+  inline uint32_t underrunCount() { return underrunCounter; };
+  inline byte maxQueued() { return maxQueueFill; };
+#ifdef DCC_PACKET_STATS
+  StatsHistogram<10> queueWait;   // us from RMTfillData to transmission
+#endif
   
  private:
     
@@ -61,12 +77,22 @@ class RMTChannel {
   byte idleLen;
   rmt_item32_t *preamble;
   byte preambleLen;
-  rmt_item32_t *data;
-  byte dataLen;
+  // ring of encoded packets, the ISR moves queueHead and
+  // RMTfillData moves queueTail
+  rmt_item32_t *data[RMT_QUEUE_LEN];
+  byte dataLen[RMT_QUEUE_LEN];
+  byte dataRepeat[RMT_QUEUE_LEN];
+#ifdef DCC_PACKET_STATS
+  uint32_t queuedAt[RMT_QUEUE_LEN];
+#endif
   byte maxDataLen;
+  volatile byte queueHead = 0;
+  volatile byte queueTail = 0;
+  volatile byte currentRepeat = 0;  // repeats left of the packet in RMT memory
+  bool idleLoaded = true;           // RMT memory holds idle (or reset) packet
   uint32_t packetCounter = 0;
-  // flags 
-  volatile bool dataReady = false;    // do we have real data available or send idle
-  volatile byte dataRepeat = 0;
+  uint32_t idleCounter = 0;         // idle packets sent because queue was empty
+  uint32_t underrunCounter = 0;     // times the queue ran dry after data
+  byte maxQueueFill = 0;
 };
 #endif //ESP32
@@ -62,6 +62,26 @@ class DCCTimer {
   static bool isPWMPin(byte pin);
   static void setPWM(byte pin, bool high);
   static void clearPWM();
+#if defined(ARDUINO_ARCH_AVR)
+  static const uint16_t PWM_HIGH=1024; // compare value above TOP, pin stays high
+  // compare register of a PWM pin, NULL if none
+  static volatile uint16_t * pwmRegister(byte pin);
+  // connects the pin to its compare output, which then follows
+  // whatever is in the register; returns pwmRegister(pin)
+  static volatile uint16_t * enablePWM(byte pin);
+#endif
+#if defined(ARDUINO_ARCH_STM32) && defined(STM32_SIGNAL_DMA)
+  // The MAIN signal words go to the BSRR of one GPIO port by DMA, one
+  // per tick, round a buffer of two halves (see DCCWaveform::fillSignalDMA)
+  static const byte SIGNAL_DMA_HALF=8;  // ticks, 464us
+  static volatile uint32_t signalDMAWords[2*SIGNAL_DMA_HALF];
+  // restarts the DMA on the BSRR of another port, interrupts off
+  static void setSignalDMAPort(volatile uint32_t * bsrr);
+  // from the ISR: the half just sent, now free to refill, or -1
+  static int8_t signalDMARefill();
+  // from the ISR: the index of the word sent on this tick
+  static byte signalDMAIndex();
+#endif
   static void startRailcomTimer(byte brakePin);
   static void ackRailcomTimer();
   static void DCCEXanalogWriteFrequency(uint8_t pin, uint32_t frequency);
@@ -70,6 +90,7 @@ class DCCTimer {
   static void DCCEXanalogCopyChannel(int8_t frompin, int8_t topin);
   static void DCCEXInrushControlOn(uint8_t pin, int duty, bool invert);
   static void DCCEXledcAttachPin(uint8_t pin, int8_t channel, bool inverted);
+  static int8_t DCCEXledcReserveChannel();
 
 // Update low ram level.  Allow for extra bytes to be specified
 // by estimation or inspection, that may be used by other 
@@ -89,6 +110,16 @@ class DCCTimer {
 
   static int  getMinimumFreeMemory();
   static void reset();
+
+#ifdef ISR_LOAD
+  // CPU cycles for the waveform ISR load figures (see DCCWaveform.h).
+  // isrCycles(start) is the count since isrCycleStart() was called at the
+  // start of the ISR, or since the timer tick itself on ports that read
+  // the waveform timer, which includes the interrupt entry.
+  static uint32_t isrCycleStart();
+  static uint32_t isrCycles(uint32_t start);
+  static uint32_t cyclesPerMicro();
+#endif
   
 private:
   static void DCCEXanalogWriteFrequencyInternal(uint8_t pin, uint32_t frequency);
@@ -140,20 +140,44 @@ void DCCTimer::ackRailcomTimer() {
  void DCCTimer::setPWM(byte pin, bool high) {
     if (pin==TIMER1_A_PIN) {
       TCCR1A |= _BV(COM1A1);
-      OCR1A= high?1024:0;
+      OCR1A= high?PWM_HIGH:0;
     }
     else if (pin==TIMER1_B_PIN) { 
       TCCR1A |= _BV(COM1B1);
-      OCR1B= high?1024:0;
+      OCR1B= high?PWM_HIGH:0;
     }
  #ifdef TIMER1_C_PIN 
     else if (pin==TIMER1_C_PIN) { 
       TCCR1A |= _BV(COM1C1);
-      OCR1C= high?1024:0;
+      OCR1C= high?PWM_HIGH:0;
     }
  #endif       
  }
 
+ volatile uint16_t * DCCTimer::pwmRegister(byte pin) {
+    if (pin==TIMER1_A_PIN) return &OCR1A;
+    if (pin==TIMER1_B_PIN) return &OCR1B;
+ #ifdef TIMER1_C_PIN 
+    if (pin==TIMER1_C_PIN) return &OCR1C;
+ #endif       
+    return NULL;
+ }
+
+ // The compare registers are double buffered and only take a new
+ // value at BOTTOM, so the pin changes exactly at the period boundary.
+ volatile uint16_t * DCCTimer::enablePWM(byte pin) {
+    byte com=0;
+    if (pin==TIMER1_A_PIN) com=_BV(COM1A1);
+    else if (pin==TIMER1_B_PIN) com=_BV(COM1B1);
+ #ifdef TIMER1_C_PIN 
+    else if (pin==TIMER1_C_PIN) com=_BV(COM1C1);
+ #endif       
+    noInterrupts();
+    TCCR1A |= com;
+    interrupts();
+    return pwmRegister(pin);
+ }
+
 void DCCTimer::clearPWM() {
   TCCR1A= 0;
 }
@@ -196,6 +220,28 @@ void DCCTimer::reset() {
 
 }
 
+#ifdef ISR_LOAD
+// Timer1 counts up from 0 to ICR1 and back down again at one count per
+// cycle and interrupts at 0, so its position gives the cycles since the
+// tick. Two reads tell us which way it is counting. An ISR longer than
+// the 58us period would wrap, but then the waveform is broken anyway.
+uint32_t DCCTimer::isrCycleStart() {
+  return 0;
+}
+
+uint32_t DCCTimer::isrCycles(uint32_t start) {
+  (void) start;
+  uint16_t a=TCNT1;
+  uint16_t b=TCNT1;
+  if (b>=a) return b;
+  return 2*CLOCK_CYCLES-b;
+}
+
+uint32_t DCCTimer::cyclesPerMicro() {
+  return F_CPU/1000000UL;
+}
+#endif
+
 void DCCTimer::DCCEXanalogWriteFrequency(uint8_t pin, uint32_t f) {
   DCCTimer::DCCEXanalogWriteFrequencyInternal(pin, f);
 }
@@ -73,6 +73,20 @@ int DCCTimer::getMinimumFreeMemory() {
 int DCCTimer::freeMemory() {
   return ESP.getFreeHeap();
 }
+
+#ifdef ISR_LOAD
+uint32_t IRAM_ATTR DCCTimer::isrCycleStart() {
+  return ESP.getCycleCount();
+}
+
+uint32_t IRAM_ATTR DCCTimer::isrCycles(uint32_t start) {
+  return ESP.getCycleCount()-start;
+}
+
+uint32_t DCCTimer::cyclesPerMicro() {
+  return ESP.getCpuFreqMHz();
+}
+#endif
 #endif
 
 ////////////////////////////////////////////////////////////////////////
@@ -192,7 +206,22 @@ void DCCTimer::DCCEXanalogWriteFrequency(uint8_t pin, uint32_t f) {
 #endif
 
 static int8_t pin_to_channel[SOC_GPIO_PIN_COUNT] = { 0 };
-static int cnt_channel = LEDC_CHANNELS;
+// Track pins on each channel, a channel is free again when its last
+// pin is detached
+static byte channel_pins[LEDC_CHANNELS] = { 0 };
+// Next channel for IO_TimerPWM servos, which count up from 2 as
+// channels 0 and 1 share the inrush timer. 0 until one is taken.
+static int servo_channel = 0;
+
+// Neighbouring channels share a timer, so a servo channel may only be
+// taken from a pair with no track pins, and a track channel only from
+// a pair above the servo channels.
+int8_t DCCTimer::DCCEXledcReserveChannel() {
+  if (servo_channel == 0) servo_channel = 2;
+  if (servo_channel >= LEDC_CHANNELS) return -1;
+  if (channel_pins[servo_channel & ~1] || channel_pins[servo_channel | 1]) return -1;
+  return servo_channel++;
+}
 
 void DCCTimer::DCCEXanalogWriteFrequencyInternal(uint8_t pin, uint32_t frequency) {
   if (pin < SOC_GPIO_PIN_COUNT) {
@@ -206,6 +235,7 @@ void DCCTimer::DCCEXledcDetachPin(uint8_t pin) {
 #ifdef DIAG_IO
   DIAG(F("Clear pin %d from ledc channel"), pin);
 #endif
+  if (pin_to_channel[pin] != 0) channel_pins[pin_to_channel[pin]]--;
   pin_to_channel[pin] = 0;
   pinMatrixOutDetach(pin, false, false);
 }
@@ -247,7 +277,9 @@ void DCCTimer::DCCEXanalogCopyChannel(int8_t frompin, int8_t topin) {
     topin = -topin;
   }
   int channel = pin_to_channel[frompin]; // after abs(frompin)
+  if (pin_to_channel[topin] != 0) channel_pins[pin_to_channel[topin]]--;
   pin_to_channel[topin] = channel;
+  if (channel != 0) channel_pins[channel]++;
   DCCTimer::DCCEXledcAttachPin(topin, channel, inverted);
 }
 
@@ -256,34 +288,17 @@ void DCCTimer::DCCEXanalogWrite(uint8_t pin, int value, bool invert) {
   // so each channel gets its own timer.
   if (pin < SOC_GPIO_PIN_COUNT) {
     if (pin_to_channel[pin] == 0) {
-      int search_channel;
-      int n;
-      if (!cnt_channel) {
+      // search for a free pair top down, above the servo channels
+      int channel;
+      for (channel=LEDC_CHANNELS-1; channel-1 >= servo_channel; channel -= 2)
+	if (channel_pins[channel] == 0 && channel_pins[channel-1] == 0) break;
+      if (channel-1 < servo_channel) {
           log_e("No more PWM channels available! All %u already used", LEDC_CHANNELS);
           return;
       }
-      // search for free channels top down
-      for (search_channel=LEDC_CHANNELS-1; search_channel >=cnt_channel; search_channel -= 2) {
-	bool chanused = false;
-	for (n=0; n < SOC_GPIO_PIN_COUNT; n++) {
-	  if (pin_to_channel[n] == search_channel) { // current search_channel used
-	    chanused = true;
-	    break;
-	  }
-	}
-	if (chanused)
-	  continue;
-	if (n == SOC_GPIO_PIN_COUNT) // current search_channel unused
-	  break;
-      }
-      if (search_channel >= cnt_channel) {
-	pin_to_channel[pin] = search_channel;
-	DIAG(F("Pin %d assigned to search channel %d"), pin, search_channel);
-      } else {
-	pin_to_channel[pin] = --cnt_channel; // This sets 15, 13, ...
-	DIAG(F("Pin %d assigned to new channel %d"), pin, cnt_channel);
-	--cnt_channel;                       // Now we are at 14, 12, ...
-      }
+      pin_to_channel[pin] = channel;
+      channel_pins[channel]++;
+      DIAG(F("Pin %d assigned to channel %d"), pin, channel);
       ledcSetup(pin_to_channel[pin], 1000, 8);
       DCCEXledcAttachPin(pin, pin_to_channel[pin], invert);
     } else {
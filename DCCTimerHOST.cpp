@@ -0,0 +1,130 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// ATTENTION: this file only compiles for the host simulation build
+// Please refer to DCCTimer.h for general comments about how this class works
+// This is to avoid repetition and duplication.
+#ifdef ARDUINO_ARCH_HOST
+
+#include <chrono>
+#include "DCCTimer.h"
+
+INTERRUPT_CALLBACK interruptHandler=0;
+
+void DCCTimer::begin(INTERRUPT_CALLBACK callback) {
+  interruptHandler=callback;
+  hostTimerBegin(interruptHandler, DCC_SIGNAL_TIME);
+}
+
+void DCCTimer::startRailcomTimer(byte brakePin) {
+  (void) brakePin;
+}
+
+void DCCTimer::ackRailcomTimer() {
+}
+
+// No hardware PWM, so the waveform is always driven from the interrupt
+bool DCCTimer::isPWMPin(byte pin) {
+  (void) pin;
+  return false;
+}
+
+void DCCTimer::setPWM(byte pin, bool high) {
+  (void) pin;
+  (void) high;
+}
+
+void DCCTimer::clearPWM() {
+}
+
+void DCCTimer::getSimulatedMacAddress(byte mac[6]) {
+  static const byte hostMac[6] = {0xBE, 0xEF, 0xDC, 0xCE, 0x00, 0x01};
+  memcpy(mac, hostMac, 6);
+}
+
+volatile int DCCTimer::minimum_free_memory=__INT_MAX__;
+
+// Return low memory value... 
+int DCCTimer::getMinimumFreeMemory() {
+  noInterrupts(); // Disable interrupts to get volatile value 
+  int retval = freeMemory();
+  interrupts();
+  return retval;
+}
+
+// Report the free memory of a Mega, the smallest board with the full
+// feature set, so that memory checks behave as they would there.
+int DCCTimer::freeMemory() {
+  return 8192;
+}
+
+void DCCTimer::reset() {
+  exit(0);
+}
+
+#ifdef ISR_LOAD
+// The host ISR takes well under a microsecond, so count nanoseconds and
+// report them as the cycles of a 1GHz CPU.
+uint32_t DCCTimer::isrCycleStart() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t DCCTimer::isrCycles(uint32_t start) {
+  return isrCycleStart()-start;
+}
+
+uint32_t DCCTimer::cyclesPerMicro() {
+  return 1000;
+}
+#endif
+
+void DCCTimer::DCCEXanalogWriteFrequency(uint8_t pin, uint32_t f) {
+  (void) pin;
+  (void) f;
+}
+void DCCTimer::DCCEXanalogWriteFrequencyInternal(uint8_t pin, uint32_t fbits) {
+  (void) pin;
+  (void) fbits;
+}
+
+int16_t ADCee::ADCmax() {
+  return 1023;
+}
+
+int ADCee::init(uint8_t pin) {
+  return analogRead(pin);
+}
+/*
+ * Read function ADCee::read(pin) to get value instead of analogRead(pin)
+ */
+int ADCee::read(uint8_t pin, bool fromISR) {
+  (void) fromISR;
+  return analogRead(pin);
+}
+/*
+ * Scan function that is called from interrupt
+ */
+void ADCee::scan() {
+}
+
+void ADCee::begin() {
+}
+#endif
@@ -134,6 +134,22 @@ void DCCTimer::reset() {
   while(true){}
 }
 
+#ifdef ISR_LOAD
+// TCB0 restarts from 0 at each tick and counts every 2 cycles
+uint32_t DCCTimer::isrCycleStart() {
+  return 0;
+}
+
+uint32_t DCCTimer::isrCycles(uint32_t start) {
+  (void) start;
+  return (uint32_t)TCB0.CNT*2;
+}
+
+uint32_t DCCTimer::cyclesPerMicro() {
+  return F_CPU/1000000UL;
+}
+#endif
+
 void DCCTimer::DCCEXanalogWriteFrequency(uint8_t pin, uint32_t f) {
 }
 void DCCTimer::DCCEXanalogWriteFrequencyInternal(uint8_t pin, uint32_t fbits) {
@@ -165,6 +165,22 @@ void DCCTimer::reset() {
     while(true) {};
 }
 
+#ifdef ISR_LOAD
+// The Cortex-M0+ has no DWT cycle counter, so this is micros() scaled
+// to cycles and only good to the nearest microsecond.
+uint32_t DCCTimer::isrCycleStart() {
+  return micros();
+}
+
+uint32_t DCCTimer::isrCycles(uint32_t start) {
+  return (micros()-start)*(F_CPU/1000000UL);
+}
+
+uint32_t DCCTimer::cyclesPerMicro() {
+  return F_CPU/1000000UL;
+}
+#endif
+
 void DCCTimer::DCCEXanalogWriteFrequency(uint8_t pin, uint32_t f) {
 }
 void DCCTimer::DCCEXanalogWriteFrequencyInternal(uint8_t pin, uint32_t fbits) {
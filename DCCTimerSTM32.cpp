@@ -29,6 +29,7 @@
 // This is to avoid repetition and duplication.
 #ifdef ARDUINO_ARCH_STM32
 
+#include "defines.h"  // before DCCTimer.h, which depends on config.h
 #include "DCCTimer.h"
 #ifdef DEBUG_ADC
 #include "TrackManager.h"
@@ -178,7 +179,14 @@ INTERRUPT_CALLBACK interruptHandler=0;
 // so are good choices for general timer duties - they are used for tone and servo
 // in stm32duino so we shall usurp those as DCC-EX doesn't use tone or servo libs.
 // NB: the F401, F410 and F411 do **not** have Timer 6 or 7, so we use Timer 11
-#ifndef DCC_EX_TIMER
+#if defined(STM32_SIGNAL_DMA)
+// Only DMA2 can write to the GPIO ports, and the TIM1 update event is its
+// stream 5 channel 6 request on every STM32F4. TIM1 then raises the
+// waveform interrupt too, right after the DMA has sent the tick's word.
+// Its PWM pins (PA8-PA11 on most boards) cannot be brake pins.
+#undef DCC_EX_TIMER
+#define DCC_EX_TIMER TIM1
+#elif !defined(DCC_EX_TIMER)
 #if defined(TIM6)
 #define DCC_EX_TIMER TIM6
 #elif defined(TIM7)
@@ -210,11 +218,69 @@ void DCCTimer::begin(INTERRUPT_CALLBACK callback) {
   dcctimer.attachInterrupt(DCCTimer_Handler);
   dcctimer.setInterruptPriority(0, 0); // Set highest preemptive priority!
   dcctimer.refresh();
+#ifdef STM32_SIGNAL_DMA
+  // a DMA request on each update. The words are all 0 until there is a
+  // MAIN port, which leaves GPIOA alone.
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  DCC_EX_TIMER->DIER |= TIM_DIER_UDE;
+  setSignalDMAPort(&GPIOA->BSRR);
+#endif
   dcctimer.resume();
 
+#ifdef ISR_LOAD
+  // enable the DWT cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
   interrupts();
 }
 
+#ifdef STM32_SIGNAL_DMA
+volatile uint32_t DCCTimer::signalDMAWords[2*SIGNAL_DMA_HALF]={0};
+
+// DMA2 stream 5 sends signalDMAWords round and round, a word per update.
+// A restart goes back to the start of the buffer, which cuts the packet
+// being sent, so it is only done when the port changes.
+void DCCTimer::setSignalDMAPort(volatile uint32_t * bsrr) {
+  DMA_Stream_TypeDef * stream=DMA2_Stream5;
+  if ((stream->CR & DMA_SxCR_EN) && stream->PAR==(uint32_t)bsrr) return;
+  stream->CR &= ~DMA_SxCR_EN;
+  while (stream->CR & DMA_SxCR_EN) {}
+  DMA2->HIFCR = DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5
+              | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5;
+  stream->PAR = (uint32_t)bsrr;
+  stream->M0AR = (uint32_t)signalDMAWords;
+  stream->NDTR = 2*SIGNAL_DMA_HALF;
+  stream->FCR = 0;  // direct mode, a word at a time
+  stream->CR = (6U << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_PL | DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1
+             | DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_DIR_0;
+  stream->CR |= DMA_SxCR_EN;
+}
+
+// The half and full transfer flags are polled from the waveform
+// interrupt, which runs on every tick anyway, so the stream has no
+// interrupt of its own.
+int8_t DCCTimer::signalDMARefill() {
+  uint32_t flags=DMA2->HISR;
+  if (flags & DMA_HISR_TCIF5) {
+    DMA2->HIFCR=DMA_HIFCR_CTCIF5;
+    return 1;
+  }
+  if (flags & DMA_HISR_HTIF5) {
+    DMA2->HIFCR=DMA_HIFCR_CHTIF5;
+    return 0;
+  }
+  return -1;
+}
+
+byte DCCTimer::signalDMAIndex() {
+  // NDTR counts down from the buffer size and already includes this tick
+  byte sent=2*SIGNAL_DMA_HALF-DMA2_Stream5->NDTR;
+  return (sent+2*SIGNAL_DMA_HALF-1) % (2*SIGNAL_DMA_HALF);
+}
+#endif
+
 void DCCTimer::startRailcomTimer(byte brakePin) {
   // TODO: for intended operation see DCCTimerAVR.cpp
   (void) brakePin; 
@@ -280,6 +346,20 @@ void DCCTimer::reset() {
     while(true) {};
 }
 
+#ifdef ISR_LOAD
+uint32_t DCCTimer::isrCycleStart() {
+  return DWT->CYCCNT;
+}
+
+uint32_t DCCTimer::isrCycles(uint32_t start) {
+  return DWT->CYCCNT-start;
+}
+
+uint32_t DCCTimer::cyclesPerMicro() {
+  return SystemCoreClock/1000000UL;
+}
+#endif
+
 void DCCTimer::DCCEXanalogWriteFrequency(uint8_t pin, uint32_t f) {
   if (f >= 16)
     DCCTimer::DCCEXanalogWriteFrequencyInternal(pin, f);
@@ -318,6 +398,13 @@ void DCCTimer::DCCEXanalogWriteFrequencyInternal(uint8_t pin, uint32_t frequency
       DIAG(F("DCCEXanalogWriteFrequency::Pin %d has no PWM function!"), pin);
       return;
     }
+#ifdef STM32_SIGNAL_DMA
+    if (Instance == DCC_EX_TIMER) {
+      // its frequency is the DCC tick
+      DIAG(F("DCCEXanalogWriteFrequency::Pin %d is on the DCC signal timer!"), pin);
+      return;
+    }
+#endif
     pin_channel[pin] = STM_PIN_CHANNEL(pinmap_function(digitalPinToPinName(pin), PinMap_PWM));
 
     // Instantiate HardwareTimer object. Thanks to 'new' instantiation,
@@ -381,6 +468,69 @@ uint32_t * ADCee::analogchans = NULL;        // Array of channel numbers to be s
 // bool adc1configured = false;
 ADC_TypeDef * * ADCee::adcchans = NULL;      // Array to capture which ADC is each input channel on
 
+// Add following line to config.h to let ADC1 convert all current sense
+// inputs continuously in scan mode, with the DMA controller (DMA2 stream 0)
+// writing the results into a ring of ADC_DMA_SAMPLES conversions per input.
+// read() then returns the average of that ring instead of one conversion,
+// and the waveform ISR no longer has to step through the inputs. Only used
+// if every scanned input is on ADC1, otherwise scan() is used as before.
+//#define ADC_USE_DMA
+#if defined(ADC_USE_DMA) && defined(DMA2_Stream0)
+#define ADC_DMA_SAMPLES 8
+enum : uint8_t { ADCDMA_UNTRIED, ADCDMA_RUNNING, ADCDMA_UNUSED };
+static volatile uint8_t dmaState = ADCDMA_UNTRIED;
+static uint16_t *dmaBuffer = NULL;   // ADC_DMA_SAMPLES rows of one conversion per used pin
+static uint8_t dmaChannels = 0;      // conversions in each row
+
+// Called from scan() with no conversion outstanding. Returns false if the
+// used pins can not all be converted by ADC1 in a single sequence.
+static bool startADCDMA(uint32_t usedpins, uint8_t highestPin, uint32_t *analogchans, ADC_TypeDef **adcchans) {
+  uint8_t n = 0;
+  for (uint8_t id = 0; id <= highestPin; id++) {
+    if (!(usedpins & (1UL << id))) continue;
+    if (adcchans[id] != ADC1 || n == 16) return false;
+    uint32_t chan = analogchans[id];
+    if (n < 6) ADC1->SQR3 = (ADC1->SQR3 & ~(0x1FUL << (n*5))) | (chan << (n*5));
+    else if (n < 12) ADC1->SQR2 = (ADC1->SQR2 & ~(0x1FUL << ((n-6)*5))) | (chan << ((n-6)*5));
+    else ADC1->SQR1 = (ADC1->SQR1 & ~(0x1FUL << ((n-12)*5))) | (chan << ((n-12)*5));
+    n++;
+  }
+  if (n == 0 || n != dmaChannels || dmaBuffer == NULL) return false;
+  ADC1->SQR1 = (ADC1->SQR1 & ~(0xFUL << 20)) | ((uint32_t)(n-1) << 20); // L = conversions-1
+
+  RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+  DMA2_Stream0->CR &= ~DMA_SxCR_EN;
+  while (DMA2_Stream0->CR & DMA_SxCR_EN) {}
+  DMA2->LIFCR = 0x3D;  // clear all stream 0 flags
+  DMA2_Stream0->PAR = (uint32_t)&ADC1->DR;
+  DMA2_Stream0->M0AR = (uint32_t)dmaBuffer;
+  DMA2_Stream0->NDTR = n * ADC_DMA_SAMPLES;
+  // channel 0, high priority, 16 bit both sides, memory increment, circular
+  DMA2_Stream0->CR = DMA_SxCR_PL_1 | DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0
+                   | DMA_SxCR_MINC | DMA_SxCR_CIRC;
+  DMA2_Stream0->FCR = 0;   // direct mode
+  DMA2_Stream0->CR |= DMA_SxCR_EN;
+
+  ADC1->SR = 0;
+  ADC1->CR1 |= ADC_CR1_SCAN;
+  ADC1->CR2 |= ADC_CR2_CONT | ADC_CR2_DMA | ADC_CR2_DDS;
+  ADC1->CR2 |= ADC_CR2_SWSTART;
+  return true;
+}
+
+// Return ADC1 to single conversions so that init() can sample a new pin.
+static void stopADCDMA() {
+  ADC1->CR2 &= ~(ADC_CR2_CONT | ADC_CR2_DMA | ADC_CR2_DDS);
+  ADC1->CR1 &= ~ADC_CR1_SCAN;
+  DMA2_Stream0->CR &= ~DMA_SxCR_EN;
+  while (DMA2_Stream0->CR & DMA_SxCR_EN) {}
+  delayMicroseconds(20);   // let the last conversion of the sequence finish
+  (void)ADC1->DR;
+  ADC1->SR = 0;
+  ADC1->SQR1 &= ~(0xFUL << 20);
+}
+#endif
+
 int16_t ADCee::ADCmax()
 {
     return 4095;
@@ -479,6 +629,15 @@ int ADCee::init(uint8_t pin) {
   else
     adc->SMPR1 |= (0b111 << ((adcchan - 10) * 3)); // Channel sampling rate 480 cycles
 
+#if defined(ADC_USE_DMA) && defined(DMA2_Stream0)
+  // A pin added after the scan started: go back to single conversions.
+  // scan() starts a new sequence including this pin once the buffer
+  // has been reallocated below, not before.
+  noInterrupts();
+  if (dmaState == ADCDMA_RUNNING) stopADCDMA();
+  dmaState = ADCDMA_UNUSED;
+  interrupts();
+#endif
   // Read the inital ADC value for this analog input
   adc->SQR3 = adcchan;           // 1st conversion in regular sequence
   adc->CR2 |= ADC_CR2_SWSTART;   //(1 << 30);                     // Start 1st conversion SWSTART
@@ -500,6 +659,16 @@ int ADCee::init(uint8_t pin) {
   adcchans[id] = adc;         // Keep track of which ADC this channel is on
   usedpins |= (1 << id);                // This pin is now ready
   if (id > highestPin) highestPin = id; // Store our highest pin in use
+#if defined(ADC_USE_DMA) && defined(DMA2_Stream0)
+  dmaChannels = __builtin_popcount(usedpins);
+  uint16_t *buffer = (uint16_t *)realloc(dmaBuffer, dmaChannels * ADC_DMA_SAMPLES * sizeof(uint16_t));
+  if (buffer) {
+    dmaBuffer = buffer;
+    for (uint16_t i = 0; i < dmaChannels * ADC_DMA_SAMPLES; i++) dmaBuffer[i] = value;
+    dmaState = ADCDMA_UNTRIED; // scan() may start the DMA again
+  }
+  // else stays ADCDMA_UNUSED, scanning one pin at a time
+#endif
 
   DIAG(F("ADCee::init(): value=%d, ADC%d: channel=%d, id=%d"), value, adcnum, adcchan, id);
 
@@ -514,6 +683,16 @@ int ADCee::read(uint8_t pin, bool fromISR) {
   // Was this pin initialised yet?
   if ((usedpins & (1<<id) ) == 0)
     return -1023;
+#if defined(ADC_USE_DMA) && defined(DMA2_Stream0)
+  if (dmaState == ADCDMA_RUNNING) {
+    // position of this pin in the conversion sequence
+    uint8_t slot = __builtin_popcount(usedpins & ((1UL << id) - 1));
+    uint32_t sum = 0;
+    for (uint8_t s = 0; s < ADC_DMA_SAMPLES; s++)
+      sum += dmaBuffer[s * dmaChannels + slot];
+    return sum / ADC_DMA_SAMPLES;
+  }
+#endif
   // We do not need to check (analogvals == NULL)
   // because usedpins would still be 0 in that case
   return analogvals[id];
@@ -530,6 +709,17 @@ void ADCee::scan() {
   static bool waiting = false;
   static ADC_TypeDef *adc;
 
+#if defined(ADC_USE_DMA) && defined(DMA2_Stream0)
+  if (dmaState == ADCDMA_RUNNING)
+    return; // conversions and transfers run without the CPU
+  if (dmaState == ADCDMA_UNTRIED && !waiting && usedpins) {
+    if (startADCDMA(usedpins, highestPin, analogchans, adcchans)) {
+      dmaState = ADCDMA_RUNNING;
+      return;
+    }
+    dmaState = ADCDMA_UNUSED;
+  }
+#endif
   adc = adcchans[id];
   if (waiting)
   {
@@ -36,6 +36,11 @@ IntervalTimer myDCCTimer;
 
 void DCCTimer::begin(INTERRUPT_CALLBACK callback) {
   interruptHandler=callback;
+#ifdef ISR_LOAD
+  // enable the DWT cycle counter
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
   myDCCTimer.begin(interruptHandler, DCC_SIGNAL_TIME);
   }
 
@@ -150,6 +155,24 @@ void DCCTimer::reset() {
   SCB_AIRCR = 0x05FA0004;
 }
 
+#ifdef ISR_LOAD
+uint32_t DCCTimer::isrCycleStart() {
+  return ARM_DWT_CYCCNT;
+}
+
+uint32_t DCCTimer::isrCycles(uint32_t start) {
+  return ARM_DWT_CYCCNT-start;
+}
+
+uint32_t DCCTimer::cyclesPerMicro() {
+#if defined(__IMXRT1062__)
+  return F_CPU_ACTUAL/1000000UL;
+#else
+  return F_CPU/1000000UL;
+#endif
+}
+#endif
+
 void DCCTimer::DCCEXanalogWriteFrequency(uint8_t pin, uint32_t f) {
 }
 void DCCTimer::DCCEXanalogWriteFrequencyInternal(uint8_t pin, uint32_t fbits) {
@@ -30,10 +30,17 @@
 #include "DCCTimer.h"
 #include "DCCACK.h"
 #include "DIAG.h"
+#include "CommandTrace.h"
 
 
 DCCWaveform  DCCWaveform::mainTrack(PREAMBLE_BITS_MAIN, true);
 DCCWaveform  DCCWaveform::progTrack(PREAMBLE_BITS_PROG, false);
+#ifdef DCC_DISTRICTS
+DCCWaveform  DCCWaveform::districtTrack[DCC_DISTRICTS-1];
+#endif
+#ifdef SIGNAL_DMA
+bool DCCWaveform::signalDMALevel[2*DCCTimer::SIGNAL_DMA_HALF];
+#endif
 
 
 // This bitmask has 9 entries as each byte is trasmitted as a zero + 8 bits.
@@ -72,27 +79,59 @@ void DCCWaveform::loop() {
 #pragma GCC push_options
 #pragma GCC optimize ("-O3")
 void DCCWaveform::interruptHandler() {
+#ifdef ISR_LOAD_WINDOW
+  uint32_t isrStart=DCCTimer::isrCycleStart();
+#endif
   // call the timer edge sensitive actions for progtrack and maintrack
   // member functions would be cleaner but have more overhead
+#ifdef SIGNAL_DMA
+  // the DMA has already sent the MAIN level of this tick
+  byte sigMain=signalDMALevel[DCCTimer::signalDMAIndex()];
+#else
   byte sigMain=signalTransform[mainTrack.state];
+#endif
   byte sigProg=TrackManager::progTrackSyncMain? sigMain : signalTransform[progTrack.state];
   
   // Set the signal state for both tracks
   TrackManager::setDCCSignal(sigMain);
   TrackManager::setPROGSignal(sigProg);
+#ifdef DCC_DISTRICTS
+  for (byte d=0; d<DCC_DISTRICTS-1; d++)
+    TrackManager::setDistrictSignal(d+1, signalTransform[districtTrack[d].state]);
+#endif
 
   // Refresh the values in the ADCee object buffering the values of the ADC HW
   ADCee::scan();
+#ifdef FAST_REVERSER
+  TrackManager::checkReversers();
+#endif
 
   // Move on in the state engine
+#ifdef SIGNAL_DMA
+  int8_t half=DCCTimer::signalDMARefill();
+  if (half>=0) fillSignalDMA(half);
+#else
   mainTrack.state=stateTransform[mainTrack.state];    
+#endif
   progTrack.state=stateTransform[progTrack.state];    
 
   // WAVE_PENDING means we dont yet know what the next bit is
+#ifndef SIGNAL_DMA
   if (mainTrack.state==WAVE_PENDING) mainTrack.interrupt2();  
+#endif
   if (progTrack.state==WAVE_PENDING) progTrack.interrupt2();
   else DCCACK::checkAck(progTrack.getResets());
+#ifdef DCC_DISTRICTS
+  for (byte d=0; d<DCC_DISTRICTS-1; d++) {
+    DCCWaveform & district=districtTrack[d];
+    district.state=stateTransform[district.state];
+    if (district.state==WAVE_PENDING) district.interrupt2();
+  }
+#endif
 
+#ifdef ISR_LOAD_WINDOW
+  recordIsrLoad(DCCTimer::isrCycles(isrStart));
+#endif
 }
 #pragma GCC pop_options
 
@@ -105,7 +144,14 @@ void DCCWaveform::interruptHandler() {
 
 DCCWaveform::DCCWaveform( byte preambleBits, bool isMain) {
   isMainTrack = isMain;
-  packetPending = false;
+  for (byte slot=0; slot<PACKET_QUEUE_SIZE; slot++) packetQueue[slot].inUse=false;
+  nextSequence=0;
+  suspendedLength=0;
+  transmitPriority=PRIORITY_REMINDER;
+  for (byte p=0; p<PRIORITY_CLASSES; p++) {
+    maxQueueDepth[p]=0;
+    scheduledCount[p]=0;
+  }
   reminderWindowOpen = false;
   memcpy(transmitPacket, idlePacket, sizeof(idlePacket));
   state = WAVE_START;
@@ -121,9 +167,16 @@ volatile bool DCCWaveform::railcomDebug=false;     // switched on by user
 
 bool DCCWaveform::setRailcom(bool on, bool debug) {
   if (on) {
-    // TODO check possible
+#if (defined(ARDUINO_AVR_MEGA) || defined(ARDUINO_AVR_MEGA2560)) && !defined(DCC_DISTRICTS)
     railcomActive=true;
     railcomDebug=debug;
+#else
+    // no cutout timer on this platform, see DCCTimer::startRailcomTimer,
+    // or districts whose packets end at different times
+    (void)debug;
+    railcomActive=false;
+    railcomDebug=false;
+#endif
   }
   else {
     railcomActive=false;
@@ -180,48 +233,193 @@ void DCCWaveform::interrupt2() {
       }
   }  
 }
+
+#ifdef SIGNAL_DMA
+// Step the MAIN waveform through the half of the DMA buffer just sent.
+// It goes out while the DMA sends the other half, so the MAIN edges
+// come from the timer however late the interrupt runs.
+void DCCWaveform::fillSignalDMA(byte half) {
+  byte i=half*DCCTimer::SIGNAL_DMA_HALF;
+  for (byte n=0; n<DCCTimer::SIGNAL_DMA_HALF; n++, i++) {
+    bool level=signalTransform[mainTrack.state];
+    signalDMALevel[i]=level;
+    DCCTimer::signalDMAWords[i]=TrackManager::signalDMAWord(level);
+    mainTrack.state=stateTransform[mainTrack.state];
+    if (mainTrack.state==WAVE_PENDING) mainTrack.interrupt2();
+  }
+}
+#endif
 #pragma GCC pop_options
 
-// Wait until there is no packet pending, then make this pending
-void DCCWaveform::schedulePacket(const byte buffer[], byte byteCount, byte repeats) {
-  if (byteCount > MAX_PACKET_SIZE) return; // allow for chksum
-  while (packetPending);
+#ifdef SIGNAL_DMA
+// The words already in the buffer are rebuilt from their levels, so
+// a new port or phase does not wait for the next refill
+void DCCWaveform::refreshSignalDMA() {
+  for (byte i=0; i<2*DCCTimer::SIGNAL_DMA_HALF; i++)
+    DCCTimer::signalDMAWords[i]=TrackManager::signalDMAWord(signalDMALevel[i]);
+}
+#endif
+
+// Find the queued packet to send next: most urgent class first,
+// then the oldest (by sequence) within the class.
+byte DCCWaveform::findQueuedSlot() {
+  byte best=NO_SLOT;
+  for (byte slot=0; slot<PACKET_QUEUE_SIZE; slot++) {
+    if (!packetQueue[slot].inUse) continue;
+    if (best==NO_SLOT
+        || packetQueue[slot].priority < packetQueue[best].priority
+        || (packetQueue[slot].priority == packetQueue[best].priority
+            && (int8_t)(packetQueue[slot].sequence - packetQueue[best].sequence) < 0))
+      best=slot;
+  }
+  return best;
+}
 
+byte DCCWaveform::findFreeSlot() {
+  for (byte slot=0; slot<PACKET_QUEUE_SIZE; slot++)
+    if (!packetQueue[slot].inUse) return slot;
+  return NO_SLOT;
+}
+
+byte DCCWaveform::queueDepth(PACKET_PRIORITY priority) {
+  byte depth=0;
+  for (byte slot=0; slot<PACKET_QUEUE_SIZE; slot++)
+    if (packetQueue[slot].inUse && packetQueue[slot].priority==priority) depth++;
+  return depth;
+}
+
+// Loco address length of a packet, 0 if it is not a loco speed packet
+static byte speedPacketAddress(const byte data[]) {
+  byte length;
+  if (data[0]<0x80) length=1;                        // broadcast or short
+  else if ((data[0] & 0xC0)==0xC0 && data[0]<0xE8) length=2;  // long
+  else return 0;
+  byte instruction=data[length];
+  return (instruction==0x3F || (instruction & 0xC0)==0x40) ? length : 0;
+}
+
+// A new speed packet makes the speed packets still queued for the same
+// loco (every loco for the broadcast address) stale, so those of the
+// same or a lower priority are dropped rather than sent after it. A more
+// urgent one still queued, such as an emergency stop, is left to go first.
+void DCCWaveform::cancelSpeedPackets(const byte speed[], PACKET_PRIORITY priority) {
+  byte length=speedPacketAddress(speed);
+  if (length==0) return;
+  noInterrupts();  // the ISR takes slots as it promotes them
+  for (byte slot=0; slot<PACKET_QUEUE_SIZE; slot++) {
+    QUEUED_PACKET * q=&packetQueue[slot];
+    if (!q->inUse || q->priority<priority) continue;
+    byte qlength=speedPacketAddress(q->data);
+    if (qlength==0) continue;
+    if (speed[0]==0 || (qlength==length && memcmp(q->data, speed, length)==0))
+      q->inUse=false;
+  }
+  interrupts();
+}
+
+// Wait until there is a free queue slot, then queue this packet
+void DCCWaveform::schedulePacket(const byte buffer[], byte byteCount, byte repeats, PACKET_PRIORITY priority) {
+  if (byteCount > MAX_PACKET_SIZE) return; // allow for chksum
+  if (priority >= PRIORITY_CLASSES) priority=PRIORITY_REMINDER;
+  TRACE_PACKET(isMainTrack, priority, repeats, buffer, byteCount);
+  cancelSpeedPackets(buffer, priority);
+  byte slot;
+  while ((slot=findFreeSlot())==NO_SLOT);
+
+  // The ISR does not look at this slot until inUse is set
+  QUEUED_PACKET * q=&packetQueue[slot];
   byte checksum = 0;
   for (byte b = 0; b < byteCount; b++) {
     checksum ^= buffer[b];
-    pendingPacket[b] = buffer[b];
+    q->data[b] = buffer[b];
   }
-  // buffer is MAX_PACKET_SIZE but pendingPacket is one bigger
-  pendingPacket[byteCount] = checksum;
-  pendingLength = byteCount + 1;
-  pendingRepeats = repeats;
-  packetPending = true;
+  // buffer is MAX_PACKET_SIZE but data is one bigger
+  q->data[byteCount] = checksum;
+  q->length = byteCount + 1;
+  q->repeats = repeats;
+  q->priority = priority;
+  q->sequence = nextSequence++;
+#ifdef DCC_PACKET_STATS
+  q->queuedAt = micros();
+#endif
+  q->inUse = true;
   clearResets();
+
+  scheduledCount[priority]++;
+  byte depth=queueDepth(priority);
+  if (depth > maxQueueDepth[priority]) maxQueueDepth[priority]=depth;
+}
+
+#ifdef DCC_DISTRICTS
+void DCCWaveform::scheduleMain(const byte buffer[], byte byteCount, byte repeats, PACKET_PRIORITY priority) {
+  for (byte stream=0; stream<MAIN_STREAMS; stream++)
+    mainStream(stream).schedulePacket(buffer, byteCount, repeats, priority);
 }
 
+bool DCCWaveform::canScheduleMain() {
+  for (byte stream=0; stream<MAIN_STREAMS; stream++)
+    if (!mainStream(stream).canSchedule()) return false;
+  return true;
+}
+#endif
+
 bool DCCWaveform::isReminderWindowOpen() {
-  return reminderWindowOpen && ! packetPending;
+  return reminderWindowOpen && findQueuedSlot()==NO_SLOT;
+}
+
+// True if schedulePacket would not have to wait, with a slot to spare 
+// for a more urgent packet.
+bool DCCWaveform::canSchedule() {
+  byte freeSlots=0;
+  for (byte slot=0; slot<PACKET_QUEUE_SIZE; slot++)
+    if (!packetQueue[slot].inUse) freeSlots++;
+  return freeSlots >= 2;
 }
 
 void DCCWaveform::promotePendingPacket() {
-    // fill the transmission packet from the pending packet
-    
-    // Just keep going if repeating  
+    // fill the transmission packet from the queue
+    byte slot=findQueuedSlot();
+#ifdef DCC_PACKET_STATS
+    packetsSent++;
+#endif
+
     if (transmitRepeats > 0) {
+      // Just keep going if repeating, unless a more urgent packet is
+      // waiting and we have room to park the remaining repeats.
+      if (slot==NO_SLOT || suspendedLength
+          || packetQueue[slot].priority >= transmitPriority) {
         transmitRepeats--;
         return;
       }
+      memcpy(suspendedPacket, transmitPacket, sizeof(transmitPacket));
+      suspendedLength = transmitLength;
+      suspendedRepeats = transmitRepeats-1;
+      suspendedPriority = transmitPriority;
+    }
+
+    // Resume a suspended packet unless something more urgent is waiting
+    if (suspendedLength
+        && (slot==NO_SLOT || packetQueue[slot].priority >= suspendedPriority)) {
+      memcpy(transmitPacket, suspendedPacket, sizeof(suspendedPacket));
+      transmitLength = suspendedLength;
+      transmitRepeats = suspendedRepeats;
+      transmitPriority = suspendedPriority;
+      suspendedLength = 0;
+      return;
+    }
 
-    if (packetPending) {
-        // Copy pending packet to transmit packet
+    if (slot!=NO_SLOT) {
+        // Copy queued packet to transmit packet
         // a fixed length memcpy is faster than a variable length loop for these small lengths
-        // for (int b = 0; b < pendingLength; b++) transmitPacket[b] = pendingPacket[b];
-        memcpy( transmitPacket, pendingPacket, sizeof(pendingPacket));
-        
-        transmitLength = pendingLength;
-        transmitRepeats = pendingRepeats;
-        packetPending = false;
+        QUEUED_PACKET * q=&packetQueue[slot];
+        memcpy( transmitPacket, q->data, sizeof(q->data));
+        transmitLength = q->length;
+        transmitRepeats = q->repeats;
+        transmitPriority = q->priority;
+#ifdef DCC_PACKET_STATS
+        queueWait.add(micros() - q->queuedAt);
+#endif
+        q->inUse = false;
         clearResets();
         return;
       }
@@ -235,13 +433,73 @@ void DCCWaveform::promotePendingPacket() {
       memcpy( transmitPacket, (isMainTrack && (!railcomDebug)) ? idlePacket : resetPacket, sizeof(idlePacket));
       transmitLength = sizeof(idlePacket);
       transmitRepeats = 0;
+      transmitPriority = PRIORITY_REMINDER;
+#ifdef DCC_PACKET_STATS
+      idlesSent++;
+#endif
       if (getResets() < 250) sentResetsSincePacket++; // only place to increment (private!)
 }
+
+void DCCWaveform::showQueueStats() {
+#ifdef DCC_DISTRICTS
+  if (isMainTrack && this!=&mainTrack)
+    DIAG(F("MAIN %d packet queue size %d"), (int)(this-districtTrack)+2, PACKET_QUEUE_SIZE);
+  else
+#endif
+  DIAG(F("%S packet queue size %d"), isMainTrack ? F("MAIN") : F("PROG"), PACKET_QUEUE_SIZE);
+  for (byte p=0; p<PRIORITY_CLASSES; p++)
+    DIAG(F("  class %d depth=%d max=%d scheduled=%l"),
+         p, queueDepth((PACKET_PRIORITY)p), maxQueueDepth[p], scheduledCount[p]);
+}
+
+#ifdef DCC_PACKET_STATS
+void DCCWaveform::showLatencyStats(bool reset) {
+  noInterrupts();
+  uint32_t sent=packetsSent;
+  uint32_t idles=idlesSent;
+  if (reset) packetsSent=idlesSent=0;
+  interrupts();
+#ifdef DCC_DISTRICTS
+  if (isMainTrack && this!=&mainTrack)
+    DIAG(F("MAIN %d packets sent=%L idle=%L"), (int)(this-districtTrack)+2, sent, idles);
+  else
+#endif
+  DIAG(F("%S packets sent=%L idle=%L"), isMainTrack ? F("MAIN") : F("PROG"), sent, idles);
+  queueWait.show(F("Queue wait"), F("us"));
+  if (reset) queueWait.reset();
+}
+#endif
+
+#ifdef ISR_LOAD_WINDOW
+uint32_t DCCWaveform::isrWindowCycles=0;
+uint32_t DCCWaveform::isrWindowMax=0;
+uint16_t DCCWaveform::isrWindowCount=0;
+volatile uint32_t DCCWaveform::isrMeanCycles=0;
+volatile uint32_t DCCWaveform::isrPeakCycles=0;
+volatile uint32_t DCCWaveform::isrMaxCycles=0;
+
+void DCCWaveform::showIsrLoad(bool reset) {
+  noInterrupts();
+  uint32_t mean=isrMeanCycles;
+  uint32_t peak=isrPeakCycles;
+  uint32_t max=isrMaxCycles;
+  if (reset) isrMaxCycles=0;
+  interrupts();
+  uint32_t perMicro=DCCTimer::cyclesPerMicro();
+  // tenths of a percent of the 58us between interrupts
+  uint32_t load=mean*1000/(perMicro*58);
+  uint32_t meanTenths=mean*10/perMicro;
+  DIAG(F("ISR mean %L.%Lus, cycles mean %L max %L, %L since reset, CPU %L.%L%%"),
+       meanTenths/10, meanTenths%10, mean, peak, max, load/10, load%10);
+}
+#endif
 #endif
 
 #ifdef ARDUINO_ARCH_ESP32
 #include "DCCWaveform.h"
 #include "DCCACK.h"
+#include "DIAG.h"
+#include "CommandTrace.h"
 
 DCCWaveform  DCCWaveform::mainTrack(PREAMBLE_BITS_MAIN, true);
 DCCWaveform  DCCWaveform::progTrack(PREAMBLE_BITS_PROG, false);
@@ -251,6 +509,7 @@ RMTChannel *DCCWaveform::rmtProgChannel = NULL;
 DCCWaveform::DCCWaveform(byte preambleBits, bool isMain) {
   isMainTrack = isMain;
   requiredPreambles = preambleBits;
+  for (byte p=0; p<PRIORITY_CLASSES; p++) scheduledCount[p]=0;
 }
 void DCCWaveform::begin() {
   for(const auto& md: TrackManager::getMainDrivers()) {
@@ -276,8 +535,11 @@ void DCCWaveform::begin() {
   }
 }
 
-void DCCWaveform::schedulePacket(const byte buffer[], byte byteCount, byte repeats) {
+void DCCWaveform::schedulePacket(const byte buffer[], byte byteCount, byte repeats, PACKET_PRIORITY priority) {
   if (byteCount > MAX_PACKET_SIZE) return; // allow for chksum
+  if (priority >= PRIORITY_CLASSES) priority=PRIORITY_REMINDER;
+  TRACE_PACKET(isMainTrack, priority, repeats, buffer, byteCount);
+  scheduledCount[priority]++;
   RMTChannel *rmtchannel = (isMainTrack ? rmtMainChannel : rmtProgChannel);
   if (rmtchannel == NULL)
     return; // no idea to prepare packet if we can not send it anyway
@@ -295,16 +557,23 @@ void DCCWaveform::schedulePacket(const byte buffer[], byte byteCount, byte repea
 // DIAG repeated commands (accesories)
 //  if (pendingRepeats > 0)
 //    DIAG(F("Repeats=%d on %s track"), pendingRepeats, isMainTrack ? "MAIN" : "PROG");
-  // The resets will be zero not only now but as well repeats packets into the future
-  clearResets(repeats+1);
   {
     int ret = 0;
+    uint32_t ahead = 0;
     do {
-      ret = rmtchannel->RMTfillData(pendingPacket, pendingLength, pendingRepeats);
+      ret = rmtchannel->RMTfillData(pendingPacket, pendingLength, pendingRepeats, ahead);
     } while(ret > 0);
+    // The resets will be zero not only now but as well for the packets
+    // queued before this one and its repeats into the future
+    if (ret == 0) clearResets(ahead+repeats+1);
   }
 }
 
+bool DCCWaveform::canSchedule() {
+  RMTChannel *rmtchannel = (isMainTrack ? rmtMainChannel : rmtProgChannel);
+  return rmtchannel && rmtchannel->queued() < RMT_QUEUE_LEN-2;
+}
+
 bool DCCWaveform::isReminderWindowOpen() {
   if(isMainTrack) {
     if (rmtMainChannel == NULL)
@@ -325,4 +594,28 @@ bool DCCWaveform::setRailcom(bool on, bool debug) {
   return false;
 }
 
+void DCCWaveform::showQueueStats() {
+  // The RMT channel keeps its own queue of encoded packets without
+  // priorities, so report that and what has been scheduled per class.
+  RMTChannel *rmtchannel = (isMainTrack ? rmtMainChannel : rmtProgChannel);
+  DIAG(F("%S packets scheduled"), isMainTrack ? F("MAIN") : F("PROG"));
+  for (byte p=0; p<PRIORITY_CLASSES; p++)
+    DIAG(F("  class %d scheduled=%l"), p, scheduledCount[p]);
+  if (rmtchannel == NULL) return;
+  DIAG(F("  RMT sent=%L idle=%L underruns=%L queued=%d max=%d"),
+       rmtchannel->packetCount(), rmtchannel->idleCount(), rmtchannel->underrunCount(),
+       rmtchannel->queued(), rmtchannel->maxQueued());
+}
+
+#ifdef DCC_PACKET_STATS
+void DCCWaveform::showLatencyStats(bool reset) {
+  RMTChannel *rmtchannel = (isMainTrack ? rmtMainChannel : rmtProgChannel);
+  if (rmtchannel == NULL) return;
+  DIAG(F("%S packets sent=%L idle=%L"), isMainTrack ? F("MAIN") : F("PROG"),
+       rmtchannel->packetCount(), rmtchannel->idleCount());
+  rmtchannel->queueWait.show(F("Queue wait"), F("us"));
+  if (reset) rmtchannel->queueWait.reset();
+}
+#endif
+
 #endif
@@ -24,7 +24,9 @@
 #ifndef DCCWaveform_h
 #define DCCWaveform_h
 
+#include "defines.h"
 #include "MotorDriver.h"
+#include "PacketStats.h"
 #ifdef ARDUINO_ARCH_ESP32
 #include "DCCRMT.h"
 #include "TrackManager.h"
@@ -37,6 +39,59 @@ const byte PREAMBLE_BITS_MAIN = 16;
 const byte PREAMBLE_BITS_PROG = 22;
 const byte MAX_PACKET_SIZE = 5;     // NMRA standard extended packets, payload size WITHOUT checksum.
 
+// Packets waiting for transmission are queued by priority class.
+// When a transmission ends, the waveform picks the most urgent queued
+// packet (lowest number) and the oldest packet within that class.
+// A packet of a more urgent class may also break into the repeats
+// of a less urgent one, which is resumed afterwards.
+enum PACKET_PRIORITY : byte {
+  PRIORITY_ESTOP=0,     // emergency stops
+  PRIORITY_THROTTLE=1,  // speed and function changes from throttles
+  PRIORITY_ACCESSORY=2, // accessory and raw packets
+  PRIORITY_CVMAIN=3,    // programming on main
+  PRIORITY_REMINDER=4,  // reminders and idles
+  PRIORITY_CLASSES=5    // number of classes, not a priority
+};
+
+// Waveform interrupt load, only compiled in when ISR_LOAD is defined in
+// config.h. The time spent in each 58us waveform interrupt is measured
+// in CPU cycles (see DCCTimer::isrCycles) and shown by <D ISR [RESET]> as
+// the mean and maximum of the last ISR_LOAD_WINDOW interrupts (about a
+// second), the maximum since reset and the CPU percentage taken.
+// Not available on ESP32 where the waveform is generated by RMT.
+#if defined(ISR_LOAD) && !defined(ARDUINO_ARCH_ESP32)
+#define ISR_LOAD_SHIFT 14
+#define ISR_LOAD_WINDOW (1U<<ISR_LOAD_SHIFT)
+#endif
+
+// MAIN tracks can be split into power districts with a packet stream of
+// their own by defining DCC_DISTRICTS (2 to 4) in config.h. A MAIN track
+// joins a district with <= A DISTRICT n> and a loco is put in one with
+// <= LOCO cab n>, for example by EXRAIL when the train passes the sensor
+// at the district boundary. A loco in a district gets its packets and
+// reminders on that stream alone, so with the locos spread out each
+// district sees them more often. Locos in no district (0, as at first),
+// accessories and broadcasts go to every stream. Each stream adds its 
+// state machine to the waveform interrupt and there is no railcom cutout
+// with districts. Not available on ESP32, where each stream would need
+// an RMT channel of its own.
+#ifdef DCC_DISTRICTS
+#if defined(ARDUINO_ARCH_ESP32)
+#error DCC_DISTRICTS is not available on ESP32
+#elif DCC_DISTRICTS < 2 || DCC_DISTRICTS > 4
+#error DCC_DISTRICTS must be 2 to 4
+#endif
+const byte MAIN_STREAMS = DCC_DISTRICTS;
+#else
+const byte MAIN_STREAMS = 1;
+#endif
+
+#if defined(HAS_ENOUGH_MEMORY)
+const byte PACKET_QUEUE_SIZE = 8;
+#else
+const byte PACKET_QUEUE_SIZE = 2;
+#endif
+
 
 // The WAVE_STATE enum is deliberately numbered because a change of order would be catastrophic
 // to the transform array.
@@ -54,18 +109,36 @@ enum  WAVE_STATE : byte {
 
 class DCCWaveform {
   public:
-    DCCWaveform( byte preambleBits, bool isMain);
+    DCCWaveform( byte preambleBits=PREAMBLE_BITS_MAIN, bool isMain=true);
     static void begin();
     static void loop();
     static DCCWaveform  mainTrack;
     static DCCWaveform  progTrack;
+#ifdef DCC_DISTRICTS
+    static DCCWaveform  districtTrack[DCC_DISTRICTS-1]; // districts 2 and up
+    // stream 0 is mainTrack, which drives district 1
+    static inline DCCWaveform & mainStream(byte stream) {
+      return stream ? districtTrack[stream-1] : mainTrack;
+    }
+    // packets for every MAIN stream
+    static void scheduleMain(const byte buffer[], byte byteCount, byte repeats,
+                             PACKET_PRIORITY priority=PRIORITY_REMINDER);
+    static bool canScheduleMain();
+#else
+    static inline DCCWaveform & mainStream(byte stream) { (void)stream; return mainTrack; }
+    static inline void scheduleMain(const byte buffer[], byte byteCount, byte repeats,
+                                    PACKET_PRIORITY priority=PRIORITY_REMINDER) {
+      mainTrack.schedulePacket(buffer, byteCount, repeats, priority);
+    }
+    static inline bool canScheduleMain() { return mainTrack.canSchedule(); }
+#endif
     inline void clearRepeats() { transmitRepeats=0; }
 #ifndef ARDUINO_ARCH_ESP32
     inline void clearResets() { sentResetsSincePacket=0; }
     inline byte getResets() { return sentResetsSincePacket; }
 #else
   // extrafudge is added when we know that the resets will first come extrafudge  packets in the future
-    inline void clearResets(byte extrafudge=0) {
+    inline void clearResets(uint32_t extrafudge=0) {
       if ((isMainTrack ? rmtMainChannel : rmtProgChannel) == NULL) return;
       resetPacketBase = isMainTrack ? rmtMainChannel->packetCount() : rmtProgChannel->packetCount();
       resetPacketBase += extrafudge;
@@ -82,22 +155,97 @@ class DCCWaveform {
       return count;                                   // all special cases handled above
     };
 #endif
-    void schedulePacket(const byte buffer[], byte byteCount, byte repeats);
+    void schedulePacket(const byte buffer[], byte byteCount, byte repeats,
+                        PACKET_PRIORITY priority=PRIORITY_REMINDER);
     bool isReminderWindowOpen();
+    bool canSchedule();
+#ifdef ARDUINO_ARCH_ESP32
+    // false while the track has no RMT channel, packets are then dropped
+    inline bool hasOutput() { return (isMainTrack ? rmtMainChannel : rmtProgChannel) != NULL; }
+#else
+    inline bool hasOutput() { return true; }
+#endif
     void promotePendingPacket();
+    void showQueueStats();
+#ifdef DCC_PACKET_STATS
+    void showLatencyStats(bool reset);
+#endif
+#ifdef ISR_LOAD_WINDOW
+    static void showIsrLoad(bool reset);
+#endif
     static bool setRailcom(bool on, bool debug);
     static bool isRailcom() {return railcomActive;}
+#ifdef SIGNAL_DMA
+    // MAIN ports or phases changed, interrupts off
+    static void refreshSignalDMA();
+#endif
     
   private:
 #ifndef ARDUINO_ARCH_ESP32
-    volatile bool packetPending;
+    struct QUEUED_PACKET {
+      byte data[MAX_PACKET_SIZE+1]; // +1 for checksum
+      byte length;
+      byte repeats;
+      PACKET_PRIORITY priority;
+      byte sequence;          // FIFO order within a priority class
+      volatile bool inUse;    // set by schedulePacket, cleared by the ISR
+#ifdef DCC_PACKET_STATS
+      uint32_t queuedAt;      // micros() at schedulePacket
+#endif
+    };
+    static const byte NO_SLOT=255;
+    byte findQueuedSlot();
+    byte findFreeSlot();
+    byte queueDepth(PACKET_PRIORITY priority);
+    void cancelSpeedPackets(const byte speed[], PACKET_PRIORITY priority);
+    QUEUED_PACKET packetQueue[PACKET_QUEUE_SIZE];
+    byte nextSequence;
     volatile bool reminderWindowOpen;
     volatile byte sentResetsSincePacket;
+    // A less urgent packet whose repeats were interrupted
+    byte suspendedPacket[MAX_PACKET_SIZE+1];
+    byte suspendedLength;     // 0 if nothing suspended
+    byte suspendedRepeats;
+    PACKET_PRIORITY suspendedPriority;
+    PACKET_PRIORITY transmitPriority;
+    byte maxQueueDepth[PRIORITY_CLASSES];
+#ifdef DCC_PACKET_STATS
+    StatsHistogram<10> queueWait;   // us from schedulePacket to transmission
+    volatile uint32_t packetsSent;  // including repeats
+    volatile uint32_t idlesSent;    // idle or reset packets for want of data
+#endif
 #else
     volatile uint32_t resetPacketBase;
+    byte pendingPacket[MAX_PACKET_SIZE+1]; // +1 for checksum
+    byte pendingLength;
+    byte pendingRepeats;
+#endif
+    uint32_t scheduledCount[PRIORITY_CLASSES];
+#ifdef ISR_LOAD_WINDOW
+    static inline void recordIsrLoad(uint32_t cycles) {
+      isrWindowCycles+=cycles;
+      if (cycles>isrWindowMax) isrWindowMax=cycles;
+      if (++isrWindowCount==ISR_LOAD_WINDOW) {
+        isrMeanCycles=isrWindowCycles>>ISR_LOAD_SHIFT;
+        isrPeakCycles=isrWindowMax;
+        if (isrWindowMax>isrMaxCycles) isrMaxCycles=isrWindowMax;
+        isrWindowCycles=isrWindowMax=0;
+        isrWindowCount=0;
+      }
+    }
+    static uint32_t isrWindowCycles;  // accessed by ISR only
+    static uint32_t isrWindowMax;
+    static uint16_t isrWindowCount;
+    static volatile uint32_t isrMeanCycles; // of the last complete window
+    static volatile uint32_t isrPeakCycles;
+    static volatile uint32_t isrMaxCycles;  // since reset
 #endif
     static void interruptHandler();
     void interrupt2();
+#ifdef SIGNAL_DMA
+    static void fillSignalDMA(byte half);
+    static bool signalDMALevel[2*DCCTimer::SIGNAL_DMA_HALF]; // MAIN level of each DMA word
+#endif
     
     bool isMainTrack;
     // Transmission controller
@@ -109,9 +257,6 @@ class DCCWaveform {
     byte bits_sent;           // 0-8 (yes 9 bits) sent for current byte
     byte bytes_sent;          // number of bytes sent from transmitPacket
     WAVE_STATE state;         // wave generator state machine
-    byte pendingPacket[MAX_PACKET_SIZE+1]; // +1 for checksum
-    byte pendingLength;
-    byte pendingRepeats;
     static volatile bool railcomActive;     // switched on by user
     static volatile bool railcomDebug;     // switched on by user
     
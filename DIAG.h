@@ -23,6 +23,9 @@
 
 #include "StringFormatter.h"
 #define DIAG  StringFormatter::diag
+// Category diag, e.g. DIAGLOG(Diag::CMD, F("..."), ...), written when
+// the category is on and queued unless it is at Diag::SYNC (see DiagLog.h)
+#define DIAGLOG(level, ...) do { if (level) StringFormatter::diagLevel(level, __VA_ARGS__); } while (0)
 #define LCD   StringFormatter::lcd
 #define SCREEN  StringFormatter::lcd2
 #endif
@@ -0,0 +1,155 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "DiagLog.h"
+#ifdef DIAG_LOG
+#include "DIAG.h"
+
+byte * DiagLog::ring=NULL;
+uint16_t DiagLog::head=0;
+uint16_t DiagLog::tail=0;
+uint16_t DiagLog::used=0;
+uint16_t DiagLog::dropped=0;
+
+// The wifi task on ESP32 may queue diags from the other core
+#if defined(ARDUINO_ARCH_ESP32)
+static portMUX_TYPE diagLogMux = portMUX_INITIALIZER_UNLOCKED;
+#define DIAG_LOG_LOCK() portENTER_CRITICAL(&diagLogMux)
+#define DIAG_LOG_UNLOCK() portEXIT_CRITICAL(&diagLogMux)
+#else
+#define DIAG_LOG_LOCK() noInterrupts()
+#define DIAG_LOG_UNLOCK() interrupts()
+#endif
+
+bool DiagLog::add(const FSH * format, va_list args) {
+  if (!ring) {
+    ring=(byte *)malloc(DIAG_LOG_SIZE);
+    if (!ring) return false;
+  }
+  byte entry[ENTRY_MAX];
+  byte length=encode(entry,format,args);
+  if (length==0) return false;
+
+  DIAG_LOG_LOCK();
+  if (used+length+1 > DIAG_LOG_SIZE) {
+    if (dropped<0xFFFF) dropped++;
+  }
+  else {
+    put(&length,1);
+    put(entry,length);
+  }
+  DIAG_LOG_UNLOCK();
+  return true;
+}
+
+// Walks the format as StringFormatter::send2 does and copies each
+// argument it takes. Returns the entry length, 0 if it does not fit.
+byte DiagLog::encode(byte * entry, const FSH * format, va_list args) {
+  memcpy(entry,&format,sizeof(format));
+  byte n=sizeof(format);
+  char * flash=(char *)format;
+  for (int i=0; ; i++) {
+    char c=GETFLASH(flash+i);
+    if (c=='\0') return n;
+    if (c!='%') continue;
+    do {
+      i++;
+      c=GETFLASH(flash+i);
+    } while (c=='-' || (c>='0' && c<='9'));
+
+    union { int i; long l; void * p; } value;
+    byte size;
+    switch (c) {
+      case '\0': return n;
+      case 'c': case 'd': case 'u': case 'b': case 'o': case 'x': case 'h':
+        value.i=va_arg(args, int);
+        size=sizeof(int);
+        break;
+      case 'l': case 'L': case 'X': case 'M': case 'F':
+        value.l=va_arg(args, long);
+        size=sizeof(long);
+        break;
+      case 'S': case 'E': case 'P':
+        value.p=va_arg(args, void*);
+        size=sizeof(void*);
+        break;
+      case 's': case 'e':
+      {
+        // copied as the caller's buffer is gone by the time it is written
+        const char * s=va_arg(args, char*);
+        if (!s) s="";  // written as nothing, as print() does
+        if (n>=ENTRY_MAX) return 0;
+        byte room=ENTRY_MAX-n-1;
+        byte len=0;
+        while (len<room && s[len]) len++;
+        memcpy(entry+n,s,len);
+        n+=len;
+        entry[n++]='\0';
+        continue;
+      }
+      default: continue; // %% takes no argument
+    }
+    if (n+size > ENTRY_MAX) return 0;
+    memcpy(entry+n,&value,size);
+    n+=size;
+  }
+}
+
+void DiagLog::put(const byte * data, byte length) {
+  for (byte b=0; b<length; b++) {
+    ring[head]=data[b];
+    head = head+1==DIAG_LOG_SIZE ? 0 : head+1;
+  }
+  used+=length;
+}
+
+void DiagLog::get(byte * data, byte length) {
+  for (byte b=0; b<length; b++) {
+    data[b]=ring[tail];
+    tail = tail+1==DIAG_LOG_SIZE ? 0 : tail+1;
+  }
+  used-=length;
+}
+
+// One line per call so that a burst is spread over several loops
+void DiagLog::loop() {
+  if (!ring) return;
+  byte entry[ENTRY_MAX];
+  byte length=0;
+  uint16_t lost=0;
+  DIAG_LOG_LOCK();
+  if (used) {
+    get(&length,1);
+    get(entry,length);
+  }
+  else {
+    // reported once the ring has caught up
+    lost=dropped;
+    dropped=0;
+  }
+  DIAG_LOG_UNLOCK();
+
+  if (length) {
+    const FSH * format;
+    memcpy(&format,entry,sizeof(format));
+    StringFormatter::diagLogged(format,entry+sizeof(format));
+  }
+  if (lost) DIAG(F("Diag log dropped %d lines"),lost);
+}
+#endif
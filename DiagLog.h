@@ -0,0 +1,88 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DiagLog_h
+#define DiagLog_h
+#include <Arduino.h>
+#include <stdarg.h>
+#include "defines.h"
+#include "FSH.h"
+
+// Queue for the category diags (<D CMD ON> etc, written with DIAGLOG)
+// so that a burst of them costs the caller a copy of the arguments
+// rather than the formatting and the wait for the serial port.
+// The format pointer and arguments are saved in a ring and the lines
+// are written from loop(). Lines that do not fit while the ring is
+// full are counted, and the count is reported once the ring is empty.
+// <D CMD SYNC> etc writes that category at once instead.
+// The ring is only allocated when the first diag is queued.
+// Leave it out with DISABLE_DIAG_LOG in config.h.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_DIAG_LOG)
+#define DIAG_LOG
+#ifndef DIAG_LOG_SIZE
+  #if defined(ARDUINO_ARCH_AVR)
+    #define DIAG_LOG_SIZE 256
+  #else
+    #define DIAG_LOG_SIZE 2048
+  #endif
+#endif
+#endif
+
+#ifdef DIAG_LOG
+class DiagLog {
+public:
+  // Longest entry (format pointer and arguments), %s strings are cut
+  // short to fit and a line with more arguments is written at once.
+  static const byte ENTRY_MAX=96;
+
+  // true if the line was queued (or dropped as the ring is full),
+  // false if the caller has to write it.
+  static bool add(const FSH * format, va_list args);
+  // Writes a few queued lines
+  static void loop();
+
+private:
+  static byte * ring;
+  static uint16_t head;
+  static uint16_t tail;
+  static uint16_t used;
+  static uint16_t dropped;
+  static byte encode(byte * entry, const FSH * format, va_list args);
+  static void put(const byte * data, byte length);
+  static void get(byte * data, byte length);
+};
+
+// Reads the arguments of a queued line back for StringFormatter.
+// Each is stored in the type send2 takes it as, strings are
+// copied in with their terminator.
+class DiagLogArgs {
+public:
+  DiagLogArgs(const byte * args) : next(args) {}
+  int i() { int v; take(&v,sizeof(v)); return v; }
+  unsigned int u() { return (unsigned int)i(); }
+  long l() { long v; take(&v,sizeof(v)); return v; }
+  unsigned long ul() { return (unsigned long)l(); }
+  char * str() { char * s=(char *)next; next+=strlen(s)+1; return s; }
+  void * ptr() { void * v; take(&v,sizeof(v)); return v; }
+private:
+  void take(void * v, byte size) { memcpy(v,next,size); next+=size; }
+  const byte * next;
+};
+#endif
+#endif
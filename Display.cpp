@@ -37,6 +37,9 @@
  *     the loop2() function is called with force=true, where 
  *     a screen update is executed to completion.  This is normally
  *     only done during start-up.
+ *  6) The characters last sent to each screen line are remembered and
+ *     only the span between the first and last changed character is
+ *     sent again; a line that has not changed is skipped entirely.
  *  The scroll mode is selected by defining SCROLLMODE as 0, 1 or 2
  *  in the config.h.
  *  #define SCROLLMODE 0 is scroll continuous (fill screen if poss),
@@ -55,6 +58,8 @@ Display::Display(DisplayDevice *deviceDriver) {
   numScreenRows = _deviceDriver->getNumRows();
   for (uint8_t row = 0; row < MAX_CHARACTER_ROWS; row++) 
     rowBuffer[row][0] = '\0';
+  if (numScreenColumns > MAX_CHARACTER_COLS) numScreenColumns = MAX_CHARACTER_COLS;
+  setScreenBuffer('\0');
   
   addDisplay(0);  // Add this display as display number 0
 };
@@ -62,10 +67,12 @@ Display::Display(DisplayDevice *deviceDriver) {
 void Display::begin() {
   _deviceDriver->begin();
   _deviceDriver->clearNative();
+  setScreenBuffer(' ');
 }
 
 void Display::_clear() {
   _deviceDriver->clearNative();
+  setScreenBuffer(' ');
   for (uint8_t row = 0; row < MAX_CHARACTER_ROWS; row++) 
     rowBuffer[row][0] = '\0';
 }
@@ -88,6 +95,8 @@ size_t Display::_write(uint8_t b) {
 // during start-up.
 void Display::_refresh() {
   loop2(true);
+  // Wait for drivers that buffer the screen to send it all
+  while (_deviceDriver->isBusy()) {}
 }
 
 // On normal loop entries, loop will only make one output request on each
@@ -112,9 +121,12 @@ Display *Display::loop2(bool force) {
     bufferPointer = 0;
     noMoreRowsToDisplay = false;
     slot = 0;
+    setScreenBuffer('\0');
   }
 
+  bool skipped;
   do {
+    skipped = false;
     if (bufferPointer == 0) {
       // Search for non-blank row
       while (!noMoreRowsToDisplay) {
@@ -123,80 +135,103 @@ Display *Display::loop2(bool force) {
         if (rowCurrent == rowFirst) noMoreRowsToDisplay = true;  
       }
 
-      if (noMoreRowsToDisplay) {
-        // No non-blank lines left, so draw blank line
-        buffer[0] = '\0';
-      } else {
-        // Non-blank line found, so copy it (including terminator)
-        for (uint8_t i = 0; i <= MAX_CHARACTER_COLS; i++)
+      // Copy the line to be shown, padded with spaces to erase the
+      // rest of the screen line.
+      uint8_t i = 0;
+      if (!noMoreRowsToDisplay) {
+        for (; i < numScreenColumns && rowBuffer[rowCurrent][i]; i++)
           buffer[i] = rowBuffer[rowCurrent][i];
       }
-      _deviceDriver->setRowNative(slot);  // Set position for display
-      charIndex = 0;
-      bufferPointer = &buffer[0];
-    } else {
-      // Write next character, or a space to erase current position.
-      char ch = *bufferPointer;
-      if (ch) {
-        _deviceDriver->writeNative(ch);
-        bufferPointer++;
+      for (; i < numScreenColumns; i++)
+        buffer[i] = ' ';
+
+      // Find the span that differs from what is on the screen.
+      uint8_t first = 0;
+      uint8_t last = numScreenColumns;
+      if (slot < MAX_CHARACTER_ROWS) {
+        while (first < last && buffer[first] == screenBuffer[slot][first]) first++;
+        while (last > first && buffer[last-1] == screenBuffer[slot][last-1]) last--;
+      }
+      if (first == last) {
+        // Nothing changed on this line, go straight to the next one.
+        if (nextSlot(currentMillis)) return NULL;
+        skipped = true;
       } else {
-        _deviceDriver->writeNative(' ');
+        if (!_deviceDriver->setRowColNative(slot, first))  // Set position for display
+          first = 0;
+        charIndex = first;
+        charEnd = last;
+        bufferPointer = &buffer[first];
+      }
+    } else {
+      // Write next changed character
+      char ch = *bufferPointer++;
+      _deviceDriver->writeNative(ch);
+      if (slot < MAX_CHARACTER_ROWS) screenBuffer[slot][charIndex] = ch;
+
+      if (++charIndex >= charEnd) {
+        if (nextSlot(currentMillis)) return NULL;
       }
+    }
+  } while (force || skipped);
+
+  return NULL;
+}
 
-      if (++charIndex >= MAX_CHARACTER_COLS) {
-        // Screen slot completed, move to next nonblank row
-        bufferPointer = 0;
-        for (;;) {
-          moveToNextRow();
-          if (rowCurrent == rowFirst) {
-            noMoreRowsToDisplay = true;
-            break;
-          }  
-          if (!isCurrentRowBlank()) break;
-        }
-        // Move to next screen slot, if available
-        slot++;
-        if (slot >= numScreenRows) {
-          // Last slot on screen written, so get ready for next screen update.
+// Screen slot completed, move to next nonblank row and screen slot.
+// Returns true when the last slot on the screen has been done.
+bool Display::nextSlot(unsigned long currentMillis) {
+  bufferPointer = 0;
+  for (;;) {
+    moveToNextRow();
+    if (rowCurrent == rowFirst) {
+      noMoreRowsToDisplay = true;
+      break;
+    }  
+    if (!isCurrentRowBlank()) break;
+  }
+  // Move to next screen slot, if available
+  slot++;
+  if (slot < numScreenRows) return false;
+
+  // Last slot on screen written, so get ready for next screen update.
 #if SCROLLMODE==0
-          // Scrollmode 0 scrolls continuously.  If the rows fit on the screen,
-          // then restart at row 0, but otherwise continue with the row
-          // after the last one displayed.
-          if (countNonBlankRows() <= numScreenRows)
-            rowCurrent = 0;
-          rowFirst = rowCurrent;
+  // Scrollmode 0 scrolls continuously.  If the rows fit on the screen,
+  // then restart at row 0, but otherwise continue with the row
+  // after the last one displayed.
+  if (countNonBlankRows() <= numScreenRows)
+    rowCurrent = 0;
+  rowFirst = rowCurrent;
 #elif SCROLLMODE==1
-          // Scrollmode 1 scrolls by page, so if the last page has just completed then
-          // next time restart with row 0.
-          if (noMoreRowsToDisplay) 
-            rowFirst = rowCurrent = 0;
+  // Scrollmode 1 scrolls by page, so if the last page has just completed then
+  // next time restart with row 0.
+  if (noMoreRowsToDisplay) 
+    rowFirst = rowCurrent = 0;
 #else
-          // Scrollmode 2 scrolls by row.  If the rows don't fit on the screen,
-          // then start one row further on next time.  If they do fit, then 
-          // show them in order and start next page at row 0.
-          if (countNonBlankRows() <= numScreenRows) {
-            rowFirst = rowCurrent = 0;
-          } else {
-            // Find first non-blank row after the previous first row
-            rowCurrent = rowFirst;
-            do {
-              moveToNextRow();
-            } while (isCurrentRowBlank());
-            rowFirst = rowCurrent;
-          }
+  // Scrollmode 2 scrolls by row.  If the rows don't fit on the screen,
+  // then start one row further on next time.  If they do fit, then 
+  // show them in order and start next page at row 0.
+  if (countNonBlankRows() <= numScreenRows) {
+    rowFirst = rowCurrent = 0;
+  } else {
+    // Find first non-blank row after the previous first row
+    rowCurrent = rowFirst;
+    do {
+      moveToNextRow();
+    } while (isCurrentRowBlank());
+    rowFirst = rowCurrent;
+  }
 #endif
-          noMoreRowsToDisplay = false;
-          slot = 0;
-          _deviceDriver->setRowNative(slot);  // Set position for display
-          lastScrollTime = currentMillis;
-          return NULL;
-        }
-      }
-    }
-  } while (force);
+  noMoreRowsToDisplay = false;
+  slot = 0;
+  lastScrollTime = currentMillis;
+  return true;
+}
 
-  return NULL;
+void Display::setScreenBuffer(char c) {
+  for (uint8_t row = 0; row < MAX_CHARACTER_ROWS; row++)
+    for (uint8_t col = 0; col < MAX_CHARACTER_COLS; col++)
+      screenBuffer[row][col] = c;
 }
 
 bool Display::isCurrentRowBlank() {
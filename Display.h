@@ -59,7 +59,13 @@ private:
   uint16_t numScreenRows;
   uint16_t numScreenColumns = MAX_CHARACTER_COLS;
 
+  uint8_t charEnd = 0;
+
   char rowBuffer[MAX_CHARACTER_ROWS][MAX_CHARACTER_COLS+1];
+  // What is currently on each screen line, so that only the span of
+  // characters that changed is sent. 0 is never written so marks a
+  // cell as unknown.
+  char screenBuffer[MAX_CHARACTER_ROWS][MAX_CHARACTER_COLS];
 
 public:
   void begin() override;  
@@ -73,6 +79,8 @@ public:
   bool isCurrentRowBlank();
   void moveToNextRow();
   uint8_t countNonBlankRows();
+  bool nextSlot(unsigned long currentMillis);
+  void setScreenBuffer(char c);
 
 };
 
@@ -91,6 +91,13 @@ public:
   virtual bool begin() { return true; }
   virtual void clearNative() = 0;
   virtual void setRowNative(uint8_t line) = 0;
+  // Position at a character column within a line. Devices that can't do
+  // this go to the start of the line and return false.
+  virtual bool setRowColNative(uint8_t line, uint8_t col) {
+    (void)col;
+    setRowNative(line);
+    return false;
+  }
   virtual size_t writeNative(uint8_t c) = 0;
   virtual bool isBusy() = 0;
   virtual uint16_t getNumRows() = 0;
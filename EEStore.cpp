@@ -57,14 +57,20 @@ void EEStore::init() {
   }
 
   reset();          // set memory pointer to first free EEPROM space
+  IODevice::beginWriteBatch();  // one write per GPIO port for all the pins
   Turnout::load();  // load turnout definitions
   Sensor::load();   // load sensor definitions
+  IODevice::endWriteBatch();
   Output::load();   // load output definitions
+  // Output pins are written from the first loop(), once DCC and the 
+  // network are running.
+  restorePending = (eeStore->data.nOutputs > 0);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 void EEStore::clear() {
+  flush();
   sprintf(eeStore->data.id,
           EESTORE_ID);  // create blank eeStore structure (no turnouts, no
                         // sensors) and save it back to EEPROM
@@ -77,6 +83,7 @@ void EEStore::clear() {
 ///////////////////////////////////////////////////////////////////////////////
 
 void EEStore::store() {
+  flush();  // queued writes use the addresses of the old layout
   reset();
   Turnout::store();
   Sensor::store();
@@ -98,6 +105,7 @@ int EEStore::pointer() { return (eeAddress); }
 ///////////////////////////////////////////////////////////////////////////////
 
 void EEStore::dump(int num) {
+  flush();
   byte b = 0;
   DIAG(F("Addr  0x  char"));
   for (int n = 0; n < num; n++) {
@@ -107,6 +115,57 @@ void EEStore::dump(int num) {
 }
 ///////////////////////////////////////////////////////////////////////////////
 
+// Queue a byte to be written by loop().  The EEPROM isn't read here to
+// see if it has changed, as on AVR a read waits for a write in progress.
+void EEStore::update(int address, byte value) {
+  for (byte i = 0; i < pendingCount; i++) {
+    if (pending[i].address == address) {
+      pending[i].value = value;
+      return;
+    }
+  }
+  if (pendingCount >= EESTORE_PENDING) writeNext();  // waits if necessary
+  pending[pendingCount].address = address;
+  pending[pendingCount].value = value;
+  pendingCount++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void EEStore::loop() {
+  if (restorePending) {
+    restorePending = false;
+    Output::restoreAll();
+  }
+  if (pendingCount == 0) return;
+#if defined(__AVR__)
+  if (!eeprom_is_ready()) return;  // previous byte still being written
+#endif
+  writeNext();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void EEStore::flush() {
+  while (pendingCount > 0) writeNext();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write the oldest queued byte, if it differs from what's there.
+
+void EEStore::writeNext() {
+  int address = pending[0].address;
+  byte value = pending[0].value;
+  pendingCount--;
+  memmove(&pending[0], &pending[1], pendingCount * sizeof(PendingWrite));
+  if (EEPROM.read(address) != value) EEPROM.write(address, value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 EEStore *EEStore::eeStore = NULL;
 int EEStore::eeAddress = 0;
+EEStore::PendingWrite EEStore::pending[EESTORE_PENDING];
+byte EEStore::pendingCount = 0;
+bool EEStore::restorePending = false;
 #endif
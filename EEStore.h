@@ -35,6 +35,14 @@ extern ExternalEEPROM EEPROM;
 
 #define EESTORE_ID "DCC++1"
 
+// Single byte state updates (turnout and output states) are queued and 
+// written one per loop when the EEPROM is free, rather than waiting for
+// each byte write (~3.3ms on AVR) to finish.  A further update to a
+// queued address replaces the queued value.
+#ifndef EESTORE_PENDING
+#define EESTORE_PENDING 8
+#endif
+
 struct EEStoreData{
   char id[sizeof(EESTORE_ID)];
   uint16_t nTurnouts;
@@ -53,6 +61,19 @@ struct EEStore{
   static void store();
   static void clear();
   static void dump(int);
+  static void update(int address, byte value);
+  static void loop();
+  static void flush();
+  static bool writesPending() { return pendingCount > 0; }
+private:
+  struct PendingWrite {
+    int address;
+    byte value;
+  };
+  static PendingWrite pending[EESTORE_PENDING];
+  static byte pendingCount;
+  static bool restorePending;  // output states not yet written to the pins
+  static void writeNext();
 };
 
 #endif
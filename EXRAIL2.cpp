@@ -58,10 +58,46 @@
 #include "IODevice.h"
 #include "EXRAILSensor.h"
 
+// A task keeps running opcodes until it blocks, or has run this many
+// opcodes or this many microseconds, before the next task gets a turn.
+#ifndef EXRAIL_SLICE_OPCODES
+#define EXRAIL_SLICE_OPCODES 20
+#endif
+#ifndef EXRAIL_SLICE_MICROS
+#define EXRAIL_SLICE_MICROS 1000
+#endif
+
+// Tasks are allocated from a fixed pool of this many, so that short lived
+// ONxxx handler tasks do not fragment the heap. If the pool runs out
+// further tasks come from the heap.
+#ifndef EXRAIL_TASK_POOL
+  #if !defined(EXRAIL_ACTIVE)
+    #define EXRAIL_TASK_POOL 0
+  #elif defined(ARDUINO_ARCH_AVR)
+    #define EXRAIL_TASK_POOL 8
+  #else
+    #define EXRAIL_TASK_POOL 32
+  #endif
+#endif
+
+// Boards with RAM to spare keep a table of if block ends, see skipIfBlock().
+// This costs 4 bytes for each IF and ELSE in the script.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(EXRAIL_NO_SKIP_TABLE)
+#define EXRAIL_SKIP_TABLE
+#endif
+
+// and a RAM copy of the signal definitions, see getSignalSlot().
+// This costs 9 bytes for each signal, twice that for a NEOPIXEL_SIGNAL.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(EXRAIL_NO_SIGNAL_TABLE)
+#define EXRAIL_SIGNAL_TABLE
+#endif
+
 
 // One instance of RMFT clas is used for each "thread" in the automation.
 // Each thread manages a loco on a journey through the layout, and/or may manage a scenery automation.
 // The threads exist in a ring, each time through loop() the next thread in the ring is serviced.
+// Threads waiting in delayMe are moved out of the run ring into a timer queue
+// kept in wake order, so only threads that can make progress are serviced.
 
 // Statics 
 const int16_t LOCO_ID_WAITING=-99; // waiting for loco id from prog track
@@ -69,12 +105,20 @@ int16_t RMFT2::progtrackLocoId;  // used for callback when detecting a loco on p
 bool RMFT2::diag=false;      // <D EXRAIL ON>  
 RMFT2 * RMFT2::loopTask=NULL; // loopTask contains the address of ONE of the tasks in a ring.
 RMFT2 * RMFT2::pausingTask=NULL; // Task causing a PAUSE.
+RMFT2 * RMFT2::runTask=NULL;    // ONE of the runnable tasks in the run ring
+RMFT2 * RMFT2::timerQueue=NULL; // sleeping tasks, earliest wake first
+RMFT2 * RMFT2::blockQueue=NULL; // tasks in ATBLOCK, WAITFREE or RESERVE
  // when pausingTask is set, that is the ONLY task that gets any service,
  // and all others will have their locos stopped, then resumed after the pausing task resumes.
-byte RMFT2::flags[MAX_FLAGS];
+// plane order, see getFlags() and the status display
+const byte RMFT2::flagPlaneMask[FLAG_PLANES]={SECTION_FLAG,LATCH_FLAG,TASK_FLAG,SIGNAL_RED,SIGNAL_GREEN,OCCUPIED_FLAG};
+byte RMFT2::flagPlanes[FLAG_PLANES][FLAG_BYTES];
 Print * RMFT2::LCCSerial=0;
 LookList *  RMFT2::routeLookup=NULL;
 LookList *  RMFT2::signalLookup=NULL;
+#ifdef EXRAIL_SIGNAL_TABLE
+SIGNAL_DEFINITION * RMFT2::signalTable=NULL;
+#endif
 LookList *  RMFT2::onThrowLookup=NULL;
 LookList *  RMFT2::onCloseLookup=NULL;
 LookList *  RMFT2::onActivateLookup=NULL;
@@ -84,6 +128,16 @@ LookList *  RMFT2::onAmberLookup=NULL;
 LookList *  RMFT2::onGreenLookup=NULL;
 LookList *  RMFT2::onChangeLookup=NULL;
 LookList *  RMFT2::onClockLookup=NULL;
+int16_t RMFT2::clockCursor=0;
+#ifdef EXRAIL_EVENT_QUEUE
+RMFT2::QUEUED_EVENT RMFT2::eventQueue[EXRAIL_EVENT_QUEUE_SIZE];
+byte RMFT2::eventCount=0;
+bool RMFT2::eventOverflow=false;
+#endif
+int16_t RMFT2::lastClockTime=-1;
+#ifdef EXRAIL_SKIP_TABLE
+LookList *  RMFT2::skipLookup=NULL;
+#endif
 #ifndef IO_NO_HAL
 LookList *  RMFT2::onRotateLookup=NULL;
 #endif
@@ -95,6 +149,7 @@ LookList *  RMFT2::onRailSyncOffLookup=NULL;
 byte * RMFT2::routeStateArray=nullptr; 
 const FSH  * * RMFT2::routeCaptionArray=nullptr; 
 int16_t * RMFT2::stashArray=nullptr;
+LookList * RMFT2::stashLookup=nullptr;
 int16_t RMFT2::maxStashId=0;
 
 // getOperand instance version, uses progCounter from instance.
@@ -114,23 +169,51 @@ LookList::LookList(int16_t size) {
   m_size=size;
   m_loaded=0;
   m_chain=nullptr;
+#ifdef EXRAIL_EVENT_QUEUE
+  m_pending=nullptr;
+#endif
   if (size) {
-    m_lookupArray=new int16_t[size];
-    m_resultArray=new int16_t[size];
+    m_lookupArray=(int16_t *)Arena::alloc(size*sizeof(int16_t), Arena::ARENA_EXRAIL);
+    m_resultArray=(int16_t *)Arena::alloc(size*sizeof(int16_t), Arena::ARENA_EXRAIL);
   }
 }
 
+// Lists are kept sorted by lookup value so they can be binary searched.
+// Entries with the same value stay in the order they were added so that
+// multiple ONxxx handlers for one id still run in program order.
 void LookList::add(int16_t lookup, int16_t result) {
   if (m_loaded==m_size) return; // and forget
-  m_lookupArray[m_loaded]=lookup;
-  m_resultArray[m_loaded]=result;
+  int16_t i=m_loaded;
+  while (i>0 && m_lookupArray[i-1]>lookup) {
+    m_lookupArray[i]=m_lookupArray[i-1];
+    m_resultArray[i]=m_resultArray[i-1];
+    i--;
+  }
+  m_lookupArray[i]=lookup;
+  m_resultArray[i]=result;
   m_loaded++;
 }
 
-int16_t LookList::find(int16_t value) {
-  for (int16_t i=0;i<m_size;i++) {
-    if (m_lookupArray[i]==value) return m_resultArray[i];
+// returns position of first entry with this value or -1
+int16_t LookList::lowerBound(int16_t value) {
+  int16_t low=0;
+  int16_t high=m_loaded;
+  while (low<high) {
+    int16_t mid=low+(high-low)/2;
+    if (m_lookupArray[mid]<value) low=mid+1;
+    else high=mid;
   }
+  return low;
+}
+
+int16_t LookList::findPosition(int16_t value) {
+  int16_t low=lowerBound(value);
+  return (low<m_loaded && m_lookupArray[low]==value) ? low : -1;
+}
+
+int16_t LookList::find(int16_t value) {
+  int16_t i=findPosition(value);
+  if (i>=0) return m_resultArray[i];
   return m_chain ?  m_chain->find(value)  :-1;
 }
 void LookList::chain(LookList * chain) {
@@ -138,48 +221,153 @@ void LookList::chain(LookList * chain) {
 }
 void LookList::handleEvent(const FSH* reason,int16_t id) {
   // New feature... create multiple ONhandlers
-  for (int i=0;i<m_size;i++) 
-    if (m_lookupArray[i]==id)
+  int16_t i=findPosition(id);
+  if (i<0) return;
+  for (;i<m_loaded && m_lookupArray[i]==id;i++)
        RMFT2::startNonRecursiveTask(reason,id,m_resultArray[i]);
 }
 
+#ifdef EXRAIL_EVENT_QUEUE
+void LookList::trackPending() {
+  if (m_pending || m_size==0) return;
+  m_pending=(byte *)Arena::alloc((m_size+7)/8, Arena::ARENA_EXRAIL);
+  memset(m_pending,0,(m_size+7)/8);
+}
 
-void LookList::stream(Print * _stream) {
-  for (int16_t i=0;i<m_size;i++) {
-    _stream->print(" ");
-    _stream->print(m_lookupArray[i]);
+// Marks (or unmarks) each handler for this id
+void LookList::setPending(int16_t id, bool pending) {
+  if (!m_pending) return;
+  int16_t i=findPosition(id);
+  if (i<0) return;
+  for (;i<m_loaded && m_lookupArray[i]==id;i++) {
+    if (pending) m_pending[i/8] |= 1<<(i%8);
+    else m_pending[i/8] &= ~(1<<(i%8));
   }
 }
 
-int16_t LookList::findPosition(int16_t value) {
-  for (int16_t i=0;i<m_size;i++) {
-    if (m_lookupArray[i]==value) return i;
+// Starts up to budget pending handlers, in id order
+byte LookList::runPending(const FSH* reason, byte budget) {
+  if (!m_pending) return budget;
+  for (int16_t i=0;i<m_loaded && budget;i++) {
+    if (!(m_pending[i/8] & (1<<(i%8)))) continue;
+    m_pending[i/8] &= ~(1<<(i%8));
+    RMFT2::startNonRecursiveTask(reason,m_lookupArray[i],m_resultArray[i]);
+    budget--;
   }
-  return -1;
+  return budget;
 }
+#endif
+
+
+void LookList::stream(Print * _stream) {
+  uint16_t position=0;
+  stream(_stream,position,INT16_MAX);
+}
+
+bool LookList::stream(Print * _stream, uint16_t & position, int16_t room) {
+  // Stream in the order added (results are ascending program counters
+  // for lists from loadLookLists) rather than sorted order, so that
+  // throttles show routes as written. Rarely called so no index kept.
+  for (;;) {
+    int16_t next=-1;
+    for (int16_t i=0;i<m_loaded;i++) {
+      if (m_resultArray[i]>=(int16_t)position && (next<0 || m_resultArray[i]<m_resultArray[next])) next=i;
+    }
+    if (next<0) return true;
+    if (room<7) return false; // " -32768"
+    _stream->print(" ");
+    _stream->print(m_lookupArray[next]);
+    room-=7;
+    position=m_resultArray[next]+1;
+  }
+}
+
 int16_t LookList::size() {
-   return m_size;
+   return m_loaded;
+}
+
+// The lists built by loadLookLists, in the order of lookListIndex
+enum : int8_t { LL_ROUTE, LL_SEQUENCE, LL_THROW, LL_CLOSE, LL_ACTIVATE, 
+  LL_DEACTIVATE, LL_CHANGE, LL_CLOCK, LL_OVERLOAD, LL_ROTATE, 
+  LL_RAILSYNCON, LL_RAILSYNCOFF, LL_RED, LL_AMBER, LL_GREEN, LL_COUNT };
+
+// Which list an opcode is loaded into, -1 for none
+int8_t RMFT2::lookListIndex(byte opcode) {
+  switch (opcode) {
+    case OPCODE_ROUTE:
+    case OPCODE_AUTOMATION:   return LL_ROUTE;
+    case OPCODE_SEQUENCE:     return LL_SEQUENCE;
+    case OPCODE_ONTHROW:      return LL_THROW;
+    case OPCODE_ONCLOSE:      return LL_CLOSE;
+    case OPCODE_ONACTIVATE:   return LL_ACTIVATE;
+    case OPCODE_ONDEACTIVATE: return LL_DEACTIVATE;
+    case OPCODE_ONCHANGE:     return LL_CHANGE;
+    case OPCODE_ONTIME:       return LL_CLOCK;
+    case OPCODE_ONOVERLOAD:   return LL_OVERLOAD;
+#ifndef IO_NO_HAL
+    case OPCODE_ONROTATE:     return LL_ROTATE;
+#endif
+#ifdef BOOSTER_INPUT
+    case OPCODE_ONRAILSYNCON:  return LL_RAILSYNCON;
+    case OPCODE_ONRAILSYNCOFF: return LL_RAILSYNCOFF;
+#endif
+    case OPCODE_ONRED:   return (compileFeatures & FEATURE_SIGNAL) ? LL_RED : -1;
+    case OPCODE_ONAMBER: return (compileFeatures & FEATURE_SIGNAL) ? LL_AMBER : -1;
+    case OPCODE_ONGREEN: return (compileFeatures & FEATURE_SIGNAL) ? LL_GREEN : -1;
+    default: return -1;
+  }
 }
 
-LookList* RMFT2::LookListLoader(OPCODE op1, OPCODE op2, OPCODE op3) {
+// Build every opcode lookup in one pass to size the lists and one to fill
+// them, rather than two passes over the script for each list.
+void RMFT2::loadLookLists() {
+  LookList * sequenceLookup=NULL;
+  LookList ** lists[LL_COUNT] = {
+    &routeLookup, &sequenceLookup, &onThrowLookup, &onCloseLookup, 
+    &onActivateLookup, &onDeactivateLookup, &onChangeLookup, &onClockLookup,
+    &onOverloadLookup, 
+#ifndef IO_NO_HAL
+    &onRotateLookup, 
+#else
+    NULL,
+#endif
+#ifdef BOOSTER_INPUT
+    &onRailSyncOnLookup, &onRailSyncOffLookup, 
+#else
+    NULL, NULL,
+#endif
+    &onRedLookup, &onAmberLookup, &onGreenLookup
+  };
+  int16_t count[LL_COUNT] = {0};
   int progCounter;
-  int16_t count=0;
-  // find size for list
   for (progCounter=0;; SKIPOP) {
     byte opcode=GET_OPCODE;
     if (opcode==OPCODE_ENDEXRAIL) break;
-    if (opcode==op1 || opcode==op2 || opcode==op3) count++;
+    int8_t index=lookListIndex(opcode);
+    if (index>=0) count[index]++;
+  }
+  for (byte index=0; index<LL_COUNT; index++) {
+    if (!lists[index]) continue;
+    if (index>=LL_RED && !(compileFeatures & FEATURE_SIGNAL)) continue;
+    *lists[index]=new LookList(count[index]);
   }
-  // create list 
-  LookList* list=new LookList(count);
-  if (count==0) return list;
-
   for (progCounter=0;; SKIPOP) {
     byte opcode=GET_OPCODE;
     if (opcode==OPCODE_ENDEXRAIL) break;
-    if (opcode==op1 || opcode==op2 || opcode==op3)  list->add(getOperand(progCounter,0),progCounter);   
+    int8_t index=lookListIndex(opcode);
+    if (index>=0) (*lists[index])->add(getOperand(progCounter,0),progCounter);
   }
-  return list;
+  routeLookup->chain(sequenceLookup);
+#ifdef EXRAIL_EVENT_QUEUE
+  onThrowLookup->trackPending();
+  onCloseLookup->trackPending();
+  onActivateLookup->trackPending();
+  onDeactivateLookup->trackPending();
+  onChangeLookup->trackPending();
+#ifndef IO_NO_HAL
+  onRotateLookup->trackPending();
+#endif
+#endif
 }
 
 /* static */ void RMFT2::begin() {
@@ -189,51 +377,44 @@ LookList* RMFT2::LookListLoader(OPCODE op1, OPCODE op2, OPCODE op3) {
   bool saved_diag=diag;
   diag=true;
   DCCEXParser::setRMFTFilter(RMFT2::ComandFilter);
-  for (int f=0;f<MAX_FLAGS;f++) flags[f]=0;
+  memset(flagPlanes,0,sizeof(flagPlanes));
   
   // create lookups
-  routeLookup=LookListLoader(OPCODE_ROUTE, OPCODE_AUTOMATION);
-  routeLookup->chain(LookListLoader(OPCODE_SEQUENCE));
+  loadLookLists();
   if (compileFeatures && FEATURE_ROUTESTATE) {
     routeStateArray=(byte *)calloc(routeLookup->size(),sizeof(byte));
     routeCaptionArray=(const FSH * *)calloc(routeLookup->size(),sizeof(const FSH *));
   }
-  onThrowLookup=LookListLoader(OPCODE_ONTHROW);
-  onCloseLookup=LookListLoader(OPCODE_ONCLOSE);
-  onActivateLookup=LookListLoader(OPCODE_ONACTIVATE);
-  onDeactivateLookup=LookListLoader(OPCODE_ONDEACTIVATE);
-  onChangeLookup=LookListLoader(OPCODE_ONCHANGE);
-  onClockLookup=LookListLoader(OPCODE_ONTIME);
-#ifndef IO_NO_HAL
-  onRotateLookup=LookListLoader(OPCODE_ONROTATE);
-#endif
-  onOverloadLookup=LookListLoader(OPCODE_ONOVERLOAD);
-#ifdef BOOSTER_INPUT
-  onRailSyncOnLookup=LookListLoader(OPCODE_ONRAILSYNCON);
-  onRailSyncOffLookup=LookListLoader(OPCODE_ONRAILSYNCOFF);
-#endif
   // onLCCLookup is not the same so not loaded here. 
+#ifdef EXRAIL_SKIP_TABLE
+  loadSkipLookup();
+#endif
 
   // Second pass startup, define any turnouts or servos, set signals red
   // add sequences onRoutines to the lookups
   if (compileFeatures & FEATURE_SIGNAL) {
     
-    onRedLookup=LookListLoader(OPCODE_ONRED);
-    onAmberLookup=LookListLoader(OPCODE_ONAMBER);
-    onGreenLookup=LookListLoader(OPCODE_ONGREEN);
     // Load the signal lookup with slot numbers in the signal table
     int signalCount=0; 
-    for (int16_t slot=0;;slot++) {
-        SIGNAL_DEFINITION signal=getSignalSlot(slot);
-        DIAG(F("Signal s=%d id=%d t=%d"),slot,signal.id,signal.type);
+    int16_t slots;
+    for (slots=0;;slots++) {
+        SIGNAL_DEFINITION signal=getSignalSlot(slots);
+        DIAG(F("Signal s=%d id=%d t=%d"),slots,signal.id,signal.type);
         if (signal.type==sigtypeNoMoreSignals) break;
         if (signal.type==sigtypeContinuation) continue;
         signalCount++;
     }    
+#ifdef EXRAIL_SIGNAL_TABLE
+    if (slots) {
+      // including the sigtypeNoMoreSignals end marker
+      auto table=(SIGNAL_DEFINITION *)Arena::alloc((slots+1)*sizeof(SIGNAL_DEFINITION), Arena::ARENA_EXRAIL);
+      for (int16_t slot=0;slot<=slots;slot++) table[slot]=getSignalSlot(slot);
+      signalTable=table; // from now on getSignalSlot reads RAM
+    }
+#endif
     signalLookup=new LookList(signalCount);
-    for (int16_t slot=0;;slot++) {
+    for (int16_t slot=0;slot<slots;slot++) {
         SIGNAL_DEFINITION signal=getSignalSlot(slot);
-        if (signal.type==sigtypeNoMoreSignals) break;
         if (signal.type==sigtypeContinuation) continue;
         signalLookup->add(signal.id,slot);
         doSignal(signal.id, SIGNAL_RED);
@@ -283,6 +464,13 @@ LookList* RMFT2::LookListLoader(OPCODE op1, OPCODE op2, OPCODE op3) {
       if (compileFeatures & FEATURE_SENSOR) 
         new EXRAILSensor(operand,progCounter+3,false );
       break;
+    case OPCODE_BLOCK: {
+      VPIN pin=getOperand(progCounter,1);
+      DIAG(F("EXRAIL block %d sensor VPIN %u"),operand,pin);
+      new EXRAILSensor(pin,0,true,operand);
+      blockEvent(operand);
+      break;
+    }
     case OPCODE_TURNOUT: {
       VPIN id=operand;
       int addr=getOperand(progCounter,1);
@@ -362,8 +550,26 @@ LookList* RMFT2::LookListLoader(OPCODE op1, OPCODE op2, OPCODE op3) {
   SKIPOP; // include ENDROUTES opcode
   
   if (compileFeatures & FEATURE_STASH) {
-    // create the stash array from the highest id found
-    if (maxStashId>0) stashArray=(int16_t*)calloc(maxStashId+1, sizeof(int16_t));
+    // create the stash array with one entry for each different id used,
+    // so that sparse ids cost no more than dense ones
+    int16_t stashOps=0;
+    for (progCounter=0;; SKIPOP) {
+      byte opcode=GET_OPCODE;
+      if (opcode==OPCODE_ENDEXRAIL) break;
+      if (opcode==OPCODE_STASH || opcode==OPCODE_CLEAR_STASH || opcode==OPCODE_PICKUP_STASH) stashOps++;
+    }
+    stashLookup=new LookList(stashOps);
+    int16_t stashCount=0;
+    for (progCounter=0;; SKIPOP) {
+      byte opcode=GET_OPCODE;
+      if (opcode!=OPCODE_STASH && opcode!=OPCODE_CLEAR_STASH && opcode!=OPCODE_PICKUP_STASH) {
+        if (opcode==OPCODE_ENDEXRAIL) break;
+        continue;
+      }
+      int16_t id=getOperand(progCounter,0);
+      if (stashLookup->find(id)<0) stashLookup->add(id,stashCount++);
+    }
+    if (stashCount>0) stashArray=(int16_t*)calloc(stashCount, sizeof(int16_t));
      //TODO check EEPROM and fetch stashArray
   }
   
@@ -397,17 +603,67 @@ char RMFT2::getRouteType(int16_t id) {
 }
 
 
+byte RMFT2::tasksInUse=0;
+byte RMFT2::tasksHighWater=0;
+uint16_t RMFT2::tasksOnHeap=0;
+
+#if EXRAIL_TASK_POOL>0
+// Unused pool entries are chained through their first bytes.
+// Entries never used yet are taken from the end of taskPoolUsed.
+union TaskPoolEntry {
+  TaskPoolEntry * nextFree;
+  alignas(RMFT2) byte task[sizeof(RMFT2)];
+};
+static TaskPoolEntry taskPool[EXRAIL_TASK_POOL];
+static TaskPoolEntry * taskPoolFree=NULL;
+static byte taskPoolUsed=0;
+#endif
+
+void * RMFT2::operator new(size_t size) {
+  void * task=NULL;
+#if EXRAIL_TASK_POOL>0
+  if (taskPoolFree) {
+    task=taskPoolFree;
+    taskPoolFree=taskPoolFree->nextFree;
+  }
+  else if (taskPoolUsed<EXRAIL_TASK_POOL) task=&taskPool[taskPoolUsed++];
+#endif
+  if (!task) {
+    task=malloc(size);
+    if (!task) return NULL;
+    tasksOnHeap++;
+  }
+  if (++tasksInUse>tasksHighWater) tasksHighWater=tasksInUse;
+  return task;
+}
+
+void RMFT2::operator delete(void * task) {
+  if (!task) return;
+  tasksInUse--;
+#if EXRAIL_TASK_POOL>0
+  if (task>=(void *)&taskPool[0] && task<(void *)&taskPool[EXRAIL_TASK_POOL]) {
+    TaskPoolEntry * entry=(TaskPoolEntry *)task;
+    entry->nextFree=taskPoolFree;
+    taskPoolFree=entry;
+    return;
+  }
+#endif
+  free(task);
+}
+
 RMFT2::RMFT2(int progCtr) {
   progCounter=progCtr;
 
   // get an unused  task id from the flags table
   taskId=255; // in case of overflow
-  for (int f=0;f<MAX_FLAGS;f++) {
-    if (!getFlag(f,TASK_FLAG)) {
-      taskId=f;
-      setFlag(f, TASK_FLAG);
-      break;
-    }
+  byte * taskPlane=flagPlanes[TASK_PLANE];
+  for (byte b=0;b<FLAG_BYTES;b++) {
+    if (taskPlane[b]==0xFF) continue; // 8 ids in use
+    byte bit=0;
+    while (taskPlane[b] & (1<<bit)) bit++;
+    taskId=b*8+bit;
+    setFlag(taskId, TASK_FLAG);
+    break;
   }
   delayTime=0;
   loco=0;
@@ -417,6 +673,10 @@ RMFT2::RMFT2(int progCtr) {
   blinkState=not_blink_task;
   stackDepth=0;
   onEventStartPosition=-1; // Not handling an ONxxx 
+#ifdef EXRAIL_PROFILE
+  profileSlot=profileSlotFor(progCtr);
+  profileSlots[profileSlot].runs++;
+#endif
 
   // chain into ring of RMFTs
   if (loopTask==NULL) {
@@ -426,12 +686,16 @@ RMFT2::RMFT2(int progCtr) {
     next=loopTask->next;
     loopTask->next=this;
   }
+  sleeping=false;
+  blockWait=-1;
+  makeRunnable();
 }
 
 
 RMFT2::~RMFT2() {
   driveLoco(1); // ESTOP my loco if any
   setFlag(taskId,0,TASK_FLAG); // we are no longer using this id
+  unschedule();
   if (next==this)
     loopTask=NULL;
   else
@@ -469,7 +733,7 @@ bool RMFT2::readSensor(uint16_t sensorId) {
   int16_t sId=(int16_t) sensorId;
 
   VPIN vpin=abs(sId);
-  if (getFlag(vpin,LATCH_FLAG)) return true; // latched on
+  if (vpin<MAX_FLAGS && (flagPlanes[LATCH_PLANE][vpin>>3] & (1<<(vpin&7)))) return true; // latched on
   
   // negative sensorIds invert the logic (e.g. for a break-beam sensor which goes OFF when detecting)
   bool s= IODevice::read(vpin) ^ (sId<0);
@@ -477,9 +741,9 @@ bool RMFT2::readSensor(uint16_t sensorId) {
   return s;
 }
 
-// This skips to the end of an if block, or to the ELSE within it.
-bool RMFT2::skipIfBlock() {
-  // returns false if killed
+// Finds the ELSE or ENDIF that ends the if block starting at progCounter,
+// or -1 if the code ends first.
+int RMFT2::findIfBlockEnd(int progCounter) {
   short nest = 1;
   while (nest > 0) {
     SKIPOP;
@@ -488,8 +752,7 @@ bool RMFT2::skipIfBlock() {
     if (opcode>IF_TYPE_OPCODES) nest++;
     else switch(opcode) {
       case OPCODE_ENDEXRAIL:
-        kill(F("missing ENDIF"), nest);
-        return false;
+        return -1;
     
       case OPCODE_ENDIF:
         nest--;
@@ -503,10 +766,45 @@ bool RMFT2::skipIfBlock() {
       break;
     }
   }
-  return true;
+  return progCounter;
 }
 
+// This skips to the end of an if block, or to the ELSE within it.
+bool RMFT2::skipIfBlock() {
+  // returns false if killed
+#ifdef EXRAIL_SKIP_TABLE
+  int target=skipLookup->find(progCounter);
+#else
+  int target=findIfBlockEnd(progCounter);
+#endif
+  if (target<0) {
+    kill(F("missing ENDIF"), progCounter);
+    return false;
+  }
+  progCounter=target;
+  return true;
+}
 
+#ifdef EXRAIL_SKIP_TABLE
+// Resolve the end of every if block once at begin(), so that a failing
+// IF or an ELSE jumps straight there instead of scanning the code.
+void RMFT2::loadSkipLookup() {
+  int progCounter;
+  int16_t count=0;
+  for (progCounter=0;; SKIPOP) {
+    byte opcode=GET_OPCODE;
+    if (opcode==OPCODE_ENDEXRAIL) break;
+    if (opcode>IF_TYPE_OPCODES || opcode==OPCODE_ELSE) count++;
+  }
+  skipLookup=new LookList(count);
+  for (progCounter=0;; SKIPOP) {
+    byte opcode=GET_OPCODE;
+    if (opcode==OPCODE_ENDEXRAIL) break;
+    if (opcode>IF_TYPE_OPCODES || opcode==OPCODE_ELSE)
+      skipLookup->add(progCounter,findIfBlockEnd(progCounter));
+  }
+}
+#endif
 
 /* static */ void RMFT2::readLocoCallback(int16_t cv) {
   if (cv <= 0) {
@@ -529,10 +827,168 @@ void RMFT2::loop() {
   if (compileFeatures & FEATURE_SENSOR) 
       EXRAILSensor::checkAll();
 
-  // Round Robin call to a RMFT task each time
-  if (loopTask==NULL) return;
-  loopTask=loopTask->next;
-  if (pausingTask==NULL || pausingTask==loopTask) loopTask->loop2();
+#ifdef EXRAIL_EVENT_QUEUE
+  // Handlers for the oldest few queued events. They are taken off the
+  // queue first as the handlers may post more.
+  byte events=eventCount<EXRAIL_EVENT_BUDGET ? eventCount : EXRAIL_EVENT_BUDGET;
+  if (events) {
+    QUEUED_EVENT run[EXRAIL_EVENT_BUDGET];
+    memcpy(run, eventQueue, events*sizeof(QUEUED_EVENT));
+    eventCount-=events;
+    memmove(eventQueue, eventQueue+events, eventCount*sizeof(QUEUED_EVENT));
+    for (byte i=0; i<events; i++) runEvent(run[i].type, run[i].id, run[i].value);
+  }
+  // Then those that overflowed it, which all came later
+  if (eventOverflow && eventCount==0 && events<EXRAIL_EVENT_BUDGET) {
+    if (runOverflow(EXRAIL_EVENT_BUDGET-events)) eventOverflow=false;
+  }
+#endif
+
+  wakeTasks();
+
+  // Round Robin call to a runnable RMFT task each time
+  if (runTask==NULL) return;
+  RMFT2 * task=runTask->schedNext;
+  runTask=task;
+  if (pausingTask!=NULL && pausingTask!=task) return;
+
+  // Opcodes that complete move progCounter on. One that has to wait
+  // leaves it alone, delays (leaving the run ring) or kills the task.
+  unsigned long sliceStart=micros();
+  for (byte slice=0;;) {
+    int pc=task->progCounter;
+#ifdef EXRAIL_PROFILE
+    // task may be gone after loop2 so take what we need first
+    byte opcode=GETHIGHFLASH(RouteCode,pc);
+    PROFILE_SLOT & slot=profileSlots[task->profileSlot];
+    unsigned long opStart=micros();
+    task->loop2();
+    unsigned long opMicros=micros()-opStart;
+    slot.opcodes++;
+    slot.busyMicros+=opMicros;
+    opcodeCount[opcode]++;
+    opcodeMicros[opcode]+=opMicros;
+    if (opMicros>longestMicros) {
+      longestMicros=opMicros;
+      longestPc=pc;
+    }
+#else
+    task->loop2();
+#endif
+    if (runTask!=task || task->sleeping || task->progCounter==pc) return;
+    if (++slice>=EXRAIL_SLICE_OPCODES) return;
+    if (micros()-sliceStart>=EXRAIL_SLICE_MICROS) return;
+    if (pausingTask!=NULL && pausingTask!=task) return;
+  }
+}
+
+// Move tasks whose delay has expired from the timer queue to the run ring.
+void RMFT2::wakeTasks() {
+  unsigned long now=millis();
+  while (timerQueue && timerQueue->remainingDelay(now)==0) {
+    RMFT2 * task=timerQueue;
+    timerQueue=task->schedNext;
+    if (timerQueue) timerQueue->schedPrev=NULL;
+#ifdef EXRAIL_PROFILE
+    profileSlots[task->profileSlot].waitMillis+=now-task->delayStart;
+#endif
+    task->makeRunnable();
+  }
+}
+
+#ifdef EXRAIL_PROFILE
+RMFT2::PROFILE_SLOT RMFT2::profileSlots[RMFT2::PROFILE_SLOTS];
+byte RMFT2::profileSlotsUsed=0;
+uint32_t RMFT2::opcodeCount[256];
+uint32_t RMFT2::opcodeMicros[256];
+unsigned long RMFT2::longestMicros=0;
+int RMFT2::longestPc=0;
+
+// Tasks are profiled by where they started, i.e. their route,
+// automation, sequence or ONxxx handler.
+byte RMFT2::profileSlotFor(int startPc) {
+  for (byte slot=0;slot<profileSlotsUsed;slot++)
+    if (profileSlots[slot].startPc==startPc) return slot;
+  if (profileSlotsUsed==PROFILE_SLOTS) return PROFILE_SLOTS-1;
+  PROFILE_SLOT & slot=profileSlots[profileSlotsUsed];
+  memset(&slot,0,sizeof(slot));
+  slot.startPc=startPc;
+  return profileSlotsUsed++;
+}
+
+void RMFT2::profileReset() {
+  for (byte slot=0;slot<profileSlotsUsed;slot++) {
+    int startPc=profileSlots[slot].startPc;
+    memset(&profileSlots[slot],0,sizeof(PROFILE_SLOT));
+    profileSlots[slot].startPc=startPc;
+  }
+  memset(opcodeCount,0,sizeof(opcodeCount));
+  memset(opcodeMicros,0,sizeof(opcodeMicros));
+  longestMicros=0;
+  longestPc=0;
+}
+
+void RMFT2::profileShow(Print * stream) {
+  StringFormatter::send(stream, F("<* EXRAIL PROFILE"));
+  for (byte s=0;s<profileSlotsUsed;s++) {
+    PROFILE_SLOT & slot=profileSlots[s];
+    // ID is the operand of the ROUTE/AUTOMATION/ONxxx where the task started
+    StringFormatter::send(stream,F("\nPC=%d,ID=%d,RUNS=%L,OPS=%L,BUSY=%Lus,WAIT=%Lms"),
+        slot.startPc, (int16_t)getOperand(slot.startPc,0),
+        slot.runs, slot.opcodes, slot.busyMicros, slot.waitMillis);
+  }
+  RMFT2 * task=loopTask;
+  while(task) {
+    StringFormatter::send(stream,F("\nID=%d,STARTPC=%d"),
+        (int)(task->taskId), profileSlots[task->profileSlot].startPc);
+    task=task->next;
+    if (task==loopTask) break;
+  }
+  for (int opcode=0;opcode<256;opcode++) {
+    if (opcodeCount[opcode]==0) continue;
+    StringFormatter::send(stream,F("\nOPCODE=%d,COUNT=%L,BUSY=%Lus"),
+        opcode, opcodeCount[opcode], opcodeMicros[opcode]);
+  }
+  StringFormatter::send(stream,F("\nLONGEST=%Lus,PC=%d *>\n"), longestMicros, longestPc);
+}
+#endif
+
+unsigned long RMFT2::remainingDelay(unsigned long now) {
+  unsigned long elapsed=now-delayStart;
+  return elapsed>=delayTime ? 0 : delayTime-elapsed;
+}
+
+// Add to the run ring so this task is serviced next
+void RMFT2::makeRunnable() {
+  sleeping=false;
+  if (runTask==NULL) {
+    runTask=this;
+    schedNext=this;
+    schedPrev=this;
+    return;
+  }
+  schedPrev=runTask;
+  schedNext=runTask->schedNext;
+  runTask->schedNext->schedPrev=this;
+  runTask->schedNext=this;
+}
+
+// Take out of the run ring or timer queue, whichever we are in.
+void RMFT2::unschedule() {
+  if (sleeping) {
+    if (schedPrev) schedPrev->schedNext=schedNext;
+    else if (blockWait>=0) blockQueue=schedNext;
+    else timerQueue=schedNext;
+    if (schedNext) schedNext->schedPrev=schedPrev;
+    return;
+  }
+  if (schedNext==this) {
+    runTask=NULL;
+    return;
+  }
+  schedPrev->schedNext=schedNext;
+  schedNext->schedPrev=schedPrev;
+  if (runTask==this) runTask=schedPrev; // so loop() moves on to schedNext
 }
 
 
@@ -618,7 +1074,7 @@ void RMFT2::loop2() {
   case OPCODE_RESERVE:
     if (getFlag(operand,SECTION_FLAG)) {
       driveLoco(0);
-      delayMe(500);
+      waitForBlock(operand); // until a FREE
       return;
     }
     setFlag(operand,SECTION_FLAG);
@@ -626,8 +1082,20 @@ void RMFT2::loop2() {
     
   case OPCODE_FREE:
     setFlag(operand,0,SECTION_FLAG);
+    blockEvent(operand);
     break;
     
+  case OPCODE_ATBLOCK: // wait for a BLOCK sensor to be active
+    blinkState=not_blink_task;
+    if (getFlag(operand,OCCUPIED_FLAG)) break;
+    waitForBlock(operand);
+    return;
+    
+  case OPCODE_WAITFREE: // wait for a block neither occupied nor reserved
+    if (!getFlag(operand,OCCUPIED_FLAG | SECTION_FLAG)) break;
+    waitForBlock(operand);
+    return;
+    
   case OPCODE_AT:
     blinkState=not_blink_task;
     if (readSensor(operand)) break;
@@ -1080,22 +1548,22 @@ void RMFT2::loop2() {
 
   case OPCODE_STASH:
     if (compileFeatures & FEATURE_STASH) 
-      stashArray[operand] = invert? -loco : loco;
+      *stashSlot(operand) = invert? -loco : loco;
     break; 
 
   case OPCODE_CLEAR_STASH:
     if (compileFeatures & FEATURE_STASH) 
-      stashArray[operand] = 0;
+      *stashSlot(operand) = 0;
     break; 
        
   case OPCODE_CLEAR_ALL_STASH:
     if (compileFeatures & FEATURE_STASH) 
-      for (int i=0;i<=maxStashId;i++) stashArray[operand]=0;
+      for (int i=0;i<stashLookup->size();i++) stashArray[i]=0;
     break;
 
   case OPCODE_PICKUP_STASH:
     if (compileFeatures & FEATURE_STASH) {
-      int16_t x=stashArray[operand];
+      int16_t x=*stashSlot(operand);
       if (x>=0) {
         loco=x;
         invert=false;
@@ -1131,6 +1599,7 @@ void RMFT2::loop2() {
   case OPCODE_ONTIME:
   case OPCODE_ONBUTTON:
   case OPCODE_ONSENSOR:
+  case OPCODE_BLOCK: // Block sensor definition ignored at runtime
 #ifndef IO_NO_HAL
   case OPCODE_DCCTURNTABLE: // Turntable definition ignored at runtime
   case OPCODE_EXTTTURNTABLE:  // Turntable definition ignored at runtime
@@ -1157,20 +1626,87 @@ void RMFT2::loop2() {
 void RMFT2::delayMe(long delay) {
   delayTime=delay;
   delayStart=millis();
+  if (delayTime==0) return;
+
+  // park in the timer queue behind any task due to wake no later
+  unschedule();
+  sleeping=true;
+  RMFT2 * before=NULL;
+  RMFT2 * after=timerQueue;
+  while (after && after->remainingDelay(delayStart)<=delayTime) {
+    before=after;
+    after=after->schedNext;
+  }
+  schedPrev=before;
+  schedNext=after;
+  if (before) before->schedNext=this;
+  else timerQueue=this;
+  if (after) after->schedPrev=this;
+}
+
+// Park in the block queue until blockEvent for this id, without 
+// a place in the run ring the task costs nothing while it waits.
+void RMFT2::waitForBlock(int16_t blockId) {
+  delayTime=0;
+  unschedule();
+  sleeping=true;
+  blockWait=blockId;
+  schedPrev=NULL;
+  schedNext=blockQueue;
+  if (blockQueue) blockQueue->schedPrev=this;
+  blockQueue=this;
+}
+
+// A block's occupancy or reservation may have changed, so update its 
+// OCCUPIED flag and let the tasks waiting on it look again.
+void RMFT2::blockEvent(int16_t blockId) {
+  if (EXRAILSensor::blockOccupied(blockId)) setFlag(blockId,OCCUPIED_FLAG);
+  else setFlag(blockId,0,OCCUPIED_FLAG);
+  RMFT2 * task=blockQueue;
+  while (task) {
+    RMFT2 * nextTask=task->schedNext;
+    if (task->blockWait==blockId) {
+      task->unschedule();
+      task->blockWait=-1;
+      task->makeRunnable();
+    }
+    task=nextTask;
+  }
+}
+
+// The stash entry for an id, or NULL if the script never uses that id.
+// Opcodes can always use the result as begin() collected their ids.
+int16_t * RMFT2::stashSlot(int16_t id) {
+  if (!stashLookup) return nullptr;
+  int16_t slot=stashLookup->find(id);
+  return slot<0 ? nullptr : &stashArray[slot];
 }
 
 bool RMFT2::setFlag(VPIN id,byte onMask, byte offMask) {
    if (FLAGOVERFLOW(id)) return false; // Outside range limit
-   byte f=flags[id];
-   f &= ~offMask;
-   f |= onMask;
-   flags[id]=f;
+   byte bit=1<<(id & 7);
+   byte b=id>>3;
+   for (byte p=0;p<FLAG_PLANES;p++) {
+     byte mask=flagPlaneMask[p];
+     if (offMask & mask) flagPlanes[p][b] &= ~bit;
+     if (onMask & mask) flagPlanes[p][b] |= bit;
+   }
    return true;
 }
 
 bool RMFT2::getFlag(VPIN id,byte mask) {
+  return getFlags(id)&mask;
+}
+
+// all the flags for an id, in the bit positions of the *_FLAG masks
+byte RMFT2::getFlags(VPIN id) {
   if (FLAGOVERFLOW(id)) return 0; // Outside range limit
-  return flags[id]&mask;
+  byte bit=1<<(id & 7);
+  byte b=id>>3;
+  byte f=0;
+  for (byte p=0;p<FLAG_PLANES;p++)
+    if (flagPlanes[p][b] & bit) f |= flagPlaneMask[p];
+  return f;
 }
 
 void RMFT2::kill(const FSH * reason, int operand) {
@@ -1181,6 +1717,9 @@ void RMFT2::kill(const FSH * reason, int operand) {
 
 
 SIGNAL_DEFINITION RMFT2::getSignalSlot(int16_t slot) {
+#ifdef EXRAIL_SIGNAL_TABLE
+  if (signalTable) return signalTable[slot];
+#endif
   SIGNAL_DEFINITION signal;
   COPYHIGHFLASH(&signal,SignalDefinitions,slot*sizeof(SIGNAL_DEFINITION),sizeof(SIGNAL_DEFINITION));
   return signal;
@@ -1199,12 +1738,21 @@ SIGNAL_DEFINITION RMFT2::getSignalSlot(int16_t slot) {
   auto sigslot=signalLookup->find(id);
   if (sigslot<0) return; 
   
-  // keep track of signal state 
-  setFlag(sigslot,rag,SIGNAL_MASK);
- 
   // Correct signal definition found, get the rag values
   auto signal=getSignalSlot(sigslot);
   
+  // An unchanged aspect needs no HAL or DCC traffic. Signals start with
+  // no aspect so the first RED is always sent. A BLINK may have taken
+  // over an LED signal's pin, setting the aspect again stops it.
+  if ((getFlags(sigslot) & SIGNAL_MASK)==rag
+      && !((compileFeatures & FEATURE_BLINK)
+           && (signal.type==sigtypeSIGNAL || signal.type==sigtypeSIGNALH)))
+    return;
+  
+  // keep track of signal state 
+  setFlag(sigslot,rag,SIGNAL_MASK);
+ 
+
   switch (signal.type) {
   case sigtypeSERVO: 
     { 
@@ -1258,7 +1806,8 @@ case sigtypeNEOPIXEL:
   // Manage invert (HIGH on) pins
   bool aHigh=signal.type==sigtypeSIGNALH;
       
-  // set the three pins 
+  // set the three pins, in one write to each device
+  IODevice::beginWriteBatch();
   if (signal.redpin) {
     bool redval=(rag==SIGNAL_RED || rag==SIMAMBER);
     if (!aHigh) redval=!redval;
@@ -1277,6 +1826,7 @@ case sigtypeNEOPIXEL:
     killBlinkOnVpin(signal.greenpin);
     IODevice::write(signal.greenpin,greenval);
   }
+  IODevice::endWriteBatch();
 }
   case sigtypeVIRTUAL: break;
   case sigtypeContinuation: break;
@@ -1288,7 +1838,7 @@ case sigtypeNEOPIXEL:
   if (!(compileFeatures & FEATURE_SIGNAL)) return false; 
   int16_t sigslot=signalLookup->find(id);
   if (sigslot<0) return false; 
-  return (flags[sigslot] & SIGNAL_MASK) == rag;
+  return (getFlags(sigslot) & SIGNAL_MASK) == rag;
 }
 
 
@@ -1322,52 +1872,150 @@ bool RMFT2::signalAspectEvent(int16_t address, byte aspect ) {
 }
 
 void RMFT2::turnoutEvent(int16_t turnoutId, bool closed) {
-  // Hunt for an ONTHROW/ONCLOSE for this turnout
-  if (closed)  onCloseLookup->handleEvent(F("CLOSE"),turnoutId);
-  else onThrowLookup->handleEvent(F("THROW"),turnoutId);
+  postEvent(EVENT_TURNOUT, turnoutId, closed);
 }
 
-
 void RMFT2::activateEvent(int16_t addr, bool activate) {
-  // Hunt for an ONACTIVATE/ONDEACTIVATE for this accessory
-  if (activate)  onActivateLookup->handleEvent(F("ACTIVATE"),addr);
-  else onDeactivateLookup->handleEvent(F("DEACTIVATE"),addr);
+  postEvent(EVENT_ACTIVATE, addr, activate);
 }
 
 void RMFT2::changeEvent(int16_t vpin, bool change) {
-  // Hunt for an ONCHANGE for this sensor
-  if (change)  onChangeLookup->handleEvent(F("CHANGE"),vpin);
+  if (change) postEvent(EVENT_CHANGE, vpin, true);
 }
 
 #ifndef IO_NO_HAL
 void RMFT2::rotateEvent(int16_t turntableId, bool change) {
-  // Hunt or an ONROTATE for this turntable
-  if (change) onRotateLookup->handleEvent(F("ROTATE"),turntableId);
+  if (change) postEvent(EVENT_ROTATE, turntableId, true);
 }
 #endif
 
+// Queue the event for loop(), replacing one still waiting for the same item
+void RMFT2::postEvent(EVENT_TYPE type, int16_t id, bool value) {
+#ifdef EXRAIL_EVENT_QUEUE
+  for (byte i=0; i<eventCount; i++) {
+    if (eventQueue[i].type==type && eventQueue[i].id==id) {
+      eventQueue[i].value=value;
+      return;
+    }
+  }
+  // Once overflowed, queue no more until the pending handlers have
+  // started so that they are not overtaken.
+  if (!eventOverflow && eventCount<EXRAIL_EVENT_QUEUE_SIZE) {
+    eventQueue[eventCount++]={id, type, value};
+    return;
+  }
+  overflowEvent(type, id, value);
+#else
+  runEvent(type, id, value);
+#endif
+}
+
+#ifdef EXRAIL_EVENT_QUEUE
+// Marks the handlers for the event pending, replacing the opposite ones
+// if still waiting
+void RMFT2::overflowEvent(EVENT_TYPE type, int16_t id, bool value) {
+  eventOverflow=true;
+  switch (type) {
+    case EVENT_TURNOUT:
+      onCloseLookup->setPending(id, value);
+      onThrowLookup->setPending(id, !value);
+      break;
+    case EVENT_ACTIVATE:
+      onActivateLookup->setPending(id, value);
+      onDeactivateLookup->setPending(id, !value);
+      break;
+    case EVENT_CHANGE:
+      onChangeLookup->setPending(id, true);
+      break;
+#ifndef IO_NO_HAL
+    case EVENT_ROTATE:
+      onRotateLookup->setPending(id, true);
+      break;
+#endif
+    default: break;
+  }
+}
+
+// Starts up to budget pending handlers, any budget left means none remain
+byte RMFT2::runOverflow(byte budget) {
+  budget=onCloseLookup->runPending(F("CLOSE"), budget);
+  budget=onThrowLookup->runPending(F("THROW"), budget);
+  budget=onActivateLookup->runPending(F("ACTIVATE"), budget);
+  budget=onDeactivateLookup->runPending(F("DEACTIVATE"), budget);
+  budget=onChangeLookup->runPending(F("CHANGE"), budget);
+#ifndef IO_NO_HAL
+  budget=onRotateLookup->runPending(F("ROTATE"), budget);
+#endif
+  return budget;
+}
+#endif
+
+void RMFT2::runEvent(EVENT_TYPE type, int16_t id, bool value) {
+  switch (type) {
+    case EVENT_TURNOUT:
+      // Hunt for an ONTHROW/ONCLOSE for this turnout
+      if (value)  onCloseLookup->handleEvent(F("CLOSE"),id);
+      else onThrowLookup->handleEvent(F("THROW"),id);
+      break;
+    case EVENT_ACTIVATE:
+      // Hunt for an ONACTIVATE/ONDEACTIVATE for this accessory
+      if (value)  onActivateLookup->handleEvent(F("ACTIVATE"),id);
+      else onDeactivateLookup->handleEvent(F("DEACTIVATE"),id);
+      break;
+    case EVENT_CHANGE:
+      // Hunt for an ONCHANGE for this sensor
+      onChangeLookup->handleEvent(F("CHANGE"),id);
+      break;
+#ifndef IO_NO_HAL
+    case EVENT_ROTATE:
+      // Hunt for an ONROTATE for this turntable
+      onRotateLookup->handleEvent(F("ROTATE"),id);
+      break;
+#endif
+    default: break;
+  }
+}
+
 void RMFT2::clockEvent(int16_t clocktime, bool change) {
   // Hunt for an ONTIME for this time
-  if (Diag::CMD)
-   DIAG(F("clockEvent at : %d"), clocktime);
-  if (change) {
-    onClockLookup->handleEvent(F("CLOCK"),clocktime);
-    onClockLookup->handleEvent(F("CLOCK"),25*60+clocktime%60);
+  DIAGLOG(Diag::CMD, F("clockEvent at : %d"), clocktime);
+  if (!change) return;
+  const int16_t day=24*60;
+  int16_t skipped=(clocktime-lastClockTime+day)%day;
+  if (lastClockTime<0 || skipped==0 || skipped>CLOCK_CATCHUP) {
+    // first time or the clock was set, only this minute counts
+    clockCursor=onClockLookup->lowerBound(clocktime);
+    clockMinute(clocktime);
+  }
+  else {
+    // on from the last minute seen, making up any the clock polling missed
+    for (int16_t s=1; s<=skipped; s++) clockMinute((lastClockTime+s)%day);
   }
+  lastClockTime=clocktime;
 } 
 
+// ONTIMEs in order from the cursor, then any ONCLOCKMINS(mm) as 25:mm
+void RMFT2::clockMinute(int16_t clocktime) {
+  if (clocktime==0) clockCursor=0; // midnight
+  int16_t size=onClockLookup->size();
+  while (clockCursor<size && onClockLookup->keyAt(clockCursor)<=clocktime) {
+    if (onClockLookup->keyAt(clockCursor)==clocktime)
+      startNonRecursiveTask(F("CLOCK"),clocktime,onClockLookup->resultAt(clockCursor));
+    clockCursor++;
+  }
+  onClockLookup->handleEvent(F("CLOCK"),25*60+clocktime%60);
+}
+
 void RMFT2::powerEvent(int16_t track, bool overload) {
   // Hunt for an ONOVERLOAD for this item
-  if (Diag::CMD)
-   DIAG(F("powerEvent : %c"), track + 'A');
+  DIAGLOG(Diag::CMD, F("powerEvent : %c"), track + 'A');
   if (overload) {
     onOverloadLookup->handleEvent(F("POWER"),track);
   }
 }
 #ifdef BOOSTER_INPUT
 void RMFT2::railsyncEvent(bool on) {
-  if (Diag::CMD)
-   DIAG(F("railsyncEvent : %d"), on);
+  DIAGLOG(Diag::CMD, F("railsyncEvent : %d"), on);
   if (on) {
     if (onRailSyncOnLookup)
       onRailSyncOnLookup->handleEvent(F("RAILSYNCON"), 0);
@@ -1422,16 +2070,17 @@ void RMFT2::printMessage2(const FSH * msg) {
 }
 static StringBuffer * buffer=NULL;
 /* thrungeString is used to stream a HIGHFLASH string to a suitable Serial
-and handle the oddities like LCD, BROADCAST and PARSE */    
+and handle the oddities like LCD, BROADCAST and PARSE. The text is copied
+from flash into each destination by %F, only PARSE needs it in RAM. */    
 void RMFT2::thrungeString(uint32_t strfar, thrunger mode, byte id) {
    //DIAG(F("thrunge addr=%l mode=%d id=%d"), strfar,mode,id);
+   unsigned long text=strfar; // %F takes an unsigned long
    Print * stream=NULL;
    // Find out where the string is going 
    switch (mode) {
     case thrunge_print:
-         StringFormatter::send(&USB_SERIAL,F("<* EXRAIL(%d) "),loco);
-         stream=&USB_SERIAL;
-         break;
+         StringFormatter::send(&USB_SERIAL,F("<* EXRAIL(%d) %F *>\n"),loco,text);
+         return;
 
     case thrunge_serial: stream=&USB_SERIAL; break;  
     case thrunge_serial1: 
@@ -1470,56 +2119,30 @@ void RMFT2::thrungeString(uint32_t strfar, thrunger mode, byte id) {
       #endif
        break;  
     case thrunge_parse:
-    case thrunge_broadcast:
-    case thrunge_message: 
-    case thrunge_lcd:
-    default:    // thrunge_lcd+1, ...
-         if (!buffer) buffer=new StringBuffer();
+         // room for the <m "..."> around a broadcast message
+         if (!buffer) buffer=new StringBuffer(BROADCAST_MAX-8);
          buffer->flush();
-         stream=buffer;
-         break; 
-    }
-    if (!stream) return; 
-    
-     #if defined(ARDUINO_AVR_MEGA) || defined(ARDUINO_AVR_MEGA2560)
-    // if mega stream it out 
-    for (;;strfar++) {
-      char c=pgm_read_byte_far(strfar);
-      if (c=='\0') break;
-      stream->write(c);
-    }
-    #else
-    // UNO/NANO CPUs dont have high memory
-    // 32 bit cpus dont care anyway
-    stream->print((FSH *)strfar);
-    #endif
-
-  // and decide what to do next
-   switch (mode) {
-    case thrunge_print:
-         StringFormatter::send(&USB_SERIAL,F(" *>\n"));
-         break;
-    // TODO  more serials for SAMx case thrunge_serial4: stream=&Serial4; break;
-    case thrunge_parse: 
-      DCCEXParser::parseOne(&USB_SERIAL,(byte*)buffer->getString(),NULL);
-      break;
+         StringFormatter::printFar(buffer,strfar);
+         DCCEXParser::parseOne(&USB_SERIAL,(byte*)buffer->getString(),NULL);
+         return;
     case thrunge_broadcast:
-      CommandDistributor::broadcastRaw(CommandDistributor::COMMAND_TYPE,buffer->getString());
-      break;
+      CommandDistributor::broadcastFar(CommandDistributor::COMMAND_TYPE,strfar);
+      return;
     case thrunge_withrottle:
-      CommandDistributor::broadcastRaw(CommandDistributor::WITHROTTLE_TYPE,buffer->getString());
-      break;
+      CommandDistributor::broadcastFar(CommandDistributor::WITHROTTLE_TYPE,strfar);
+      return;
     case thrunge_message:
-      CommandDistributor::broadcastMessage(buffer->getString());
-      break;
+      CommandDistributor::broadcastFarMessage(strfar);
+      return;
     case thrunge_lcd:
-         LCD(id,F("%s"),buffer->getString());
-         break;
+         LCD(id,F("%F"),text);
+         return;
     default:  // thrunge_lcd+1, ...
       if (mode > thrunge_lcd) 
-        SCREEN(mode-thrunge_lcd, id, F("%s"),buffer->getString());  // print to other display
-      break;       
+        SCREEN(mode-thrunge_lcd, id, F("%F"),text);  // print to other display
+      return;       
     }
+    if (stream) StringFormatter::printFar(stream,strfar);
 }
 
 void RMFT2::manageRouteState(int16_t id, byte state) {
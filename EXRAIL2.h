@@ -27,6 +27,28 @@
 #include "IODevice.h"
 #include "Turnouts.h"
 #include "Turntables.h"
+#include "defines.h"
+
+// ONTHROW/ONCLOSE, ONACTIVATE/ONDEACTIVATE, ONCHANGE and ONROTATE events
+// are queued and their handlers started from loop(), at most
+// EXRAIL_EVENT_BUDGET events a loop. A later event for the same item
+// replaces one still waiting, so only its latest state is handled.
+// Once a burst fills the queue, later events mark their handlers pending
+// in the lookup lists and these are started when the queue has drained.
+// Leave it out with DISABLE_EXRAIL_EVENT_QUEUE in config.h.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_EXRAIL_EVENT_QUEUE)
+#define EXRAIL_EVENT_QUEUE
+#ifndef EXRAIL_EVENT_QUEUE_SIZE
+  #if defined(ARDUINO_ARCH_AVR)
+    #define EXRAIL_EVENT_QUEUE_SIZE 8
+  #else
+    #define EXRAIL_EVENT_QUEUE_SIZE 32
+  #endif
+#endif
+#ifndef EXRAIL_EVENT_BUDGET
+  #define EXRAIL_EVENT_BUDGET 4
+#endif
+#endif
    
 // The following are the operation codes (or instructions) for a kind of virtual machine.
 // Each instruction is normally 3 bytes long with an operation code followed by a parameter.
@@ -78,6 +100,7 @@ enum OPCODE : byte {OPCODE_THROW,OPCODE_CLOSE,OPCODE_TOGGLE_TURNOUT,
              OPCODE_ROUTE_DISABLED,
              OPCODE_STASH,OPCODE_CLEAR_STASH,OPCODE_CLEAR_ALL_STASH,OPCODE_PICKUP_STASH,
              OPCODE_ONBUTTON,OPCODE_ONSENSOR,             
+             OPCODE_BLOCK,OPCODE_ATBLOCK,OPCODE_WAITFREE,
              OPCODE_NEOPIXEL,
              // OPcodes below this point are skip-nesting IF operations
              // placed here so that they may be skipped as a group
@@ -144,7 +167,7 @@ enum SignalType {
   static const byte SECTION_FLAG = 0x80;
   static const byte LATCH_FLAG   = 0x40;
   static const byte TASK_FLAG    = 0x20;
-  static const byte SPARE_FLAG   = 0x10;
+  static const byte OCCUPIED_FLAG= 0x10; // a BLOCK sensor is active
   static const byte SIGNAL_MASK  = 0x0C;
   static const byte SIGNAL_RED   = 0x08;
   static const byte SIGNAL_AMBER = 0x0C;
@@ -157,14 +180,26 @@ enum SignalType {
 
 class LookList {
   public: 
+    ARENA_NEW(ARENA_EXRAIL)
     LookList(int16_t size);
     void chain(LookList* chainTo);
     void add(int16_t lookup, int16_t result);
     int16_t find(int16_t value); // finds result value
     int16_t findPosition(int16_t value); // finds index 
+    int16_t lowerBound(int16_t value); // index of first lookup >= value
     int16_t size();
+    int16_t keyAt(int16_t position) { return m_lookupArray[position]; }
+    int16_t resultAt(int16_t position) { return m_resultArray[position]; }
     void stream(Print * _stream); 
+    // resumable: position is the lowest result not yet sent
+    bool stream(Print * _stream, uint16_t & position, int16_t room);
     void handleEvent(const FSH* reason,int16_t id);
+#ifdef EXRAIL_EVENT_QUEUE
+    // handlers for an event that did not fit in the event queue
+    void trackPending();
+    void setPending(int16_t id, bool pending);
+    byte runPending(const FSH* reason, byte budget); // returns budget left
+#endif
 
   private:
      int16_t m_size;
@@ -172,6 +207,9 @@ class LookList {
      int16_t * m_lookupArray;
      int16_t * m_resultArray;
      LookList* m_chain;     
+#ifdef EXRAIL_EVENT_QUEUE
+     byte * m_pending;  // one bit per entry, NULL when not tracked
+#endif
 };
 
  class RMFT2 {
@@ -181,12 +219,15 @@ class LookList {
     RMFT2(int progCounter);
     RMFT2(int route, uint16_t cab);
     ~RMFT2();
+    static void * operator new(size_t size);
+    static void operator delete(void * task);
     static void readLocoCallback(int16_t cv);
     static void createNewTask(int route, uint16_t cab);
     static void turnoutEvent(int16_t id, bool closed);  
     static void activateEvent(int16_t addr, bool active);
     static void changeEvent(int16_t id, bool change);
     static void clockEvent(int16_t clocktime, bool change);
+    static void blockEvent(int16_t blockId);
     static void rotateEvent(int16_t id, bool change);
     static void powerEvent(int16_t track, bool overload);
 #ifdef BOOSTER_INPUT
@@ -214,6 +255,11 @@ private:
     static void ComandFilter(Print * stream, byte & opcode, byte & paramCount, int16_t p[]);
     static bool parseSlash(Print * stream, byte & paramCount, int16_t p[]) ;
     static void streamFlags(Print* stream);
+    static bool writeRouteIds(Print * stream, uint16_t & position, int16_t room);
+public:
+    // <jB> for each route not in its default state, for the <JZ> snapshot
+    static bool writeRouteStates(Print * stream, uint16_t & position, int16_t & room);
+private:
     static bool setFlag(VPIN id,byte onMask, byte OffMask=0);
     static bool getFlag(VPIN id,byte mask); 
     static int16_t progtrackLocoId;
@@ -222,15 +268,28 @@ private:
     #ifndef IO_NO_HAL
     static void setTurntableHiddenState(Turntable * tto);
     #endif
-    static LookList* LookListLoader(OPCODE op1,
-                      OPCODE op2=OPCODE_ENDEXRAIL,OPCODE op3=OPCODE_ENDEXRAIL);
+    static void loadLookLists();
+    static int8_t lookListIndex(byte opcode);
     static uint16_t getOperand(int progCounter,byte n);
     static void killBlinkOnVpin(VPIN pin,uint16_t count=1);
     static RMFT2 * loopTask;
     static RMFT2 * pausingTask;
+    static RMFT2 * runTask;
+    static byte tasksInUse;     // task pool usage, shown by </>
+    static byte tasksHighWater;
+    static uint16_t tasksOnHeap; // times the pool was full
+    static RMFT2 * timerQueue;
+    static RMFT2 * blockQueue;  // tasks parked until a block changes
+    static void wakeTasks();
     void delayMe(long millisecs);
+    void waitForBlock(int16_t blockId);
+    unsigned long remainingDelay(unsigned long now);
+    void makeRunnable();
+    void unschedule();
     void driveLoco(byte speedo);
     bool skipIfBlock();
+    static int findIfBlockEnd(int progCounter);
+    static void loadSkipLookup();
     bool readLoco();
     void loop2();
     void kill(const FSH * reason=NULL,int operand=0);          
@@ -242,10 +301,18 @@ private:
    static bool diag;
    static const  HIGHFLASH3  byte RouteCode[];
    static const  HIGHFLASH  SIGNAL_DEFINITION SignalDefinitions[];
-   static byte flags[MAX_FLAGS];
+   // Each flag bit is kept in its own plane of MAX_FLAGS bits, so that
+   // a flag costs a bit per id and whole bytes can be tested at once.
+   static const byte FLAG_PLANES=6;
+   static const byte FLAG_BYTES=MAX_FLAGS/8;
+   static const byte SECTION_PLANE=0, LATCH_PLANE=1, TASK_PLANE=2, OCCUPIED_PLANE=5; // see flagPlaneMask
+   static const byte flagPlaneMask[FLAG_PLANES];
+   static byte flagPlanes[FLAG_PLANES][FLAG_BYTES];
+   static byte getFlags(VPIN id);
    static Print * LCCSerial;
    static LookList * routeLookup;
    static LookList * signalLookup;
+   static SIGNAL_DEFINITION * signalTable; // RAM copy of SignalDefinitions
    static LookList * onThrowLookup;
    static LookList * onCloseLookup;
    static LookList * onActivateLookup;
@@ -255,6 +322,27 @@ private:
    static LookList * onGreenLookup;
    static LookList * onChangeLookup;
    static LookList * onClockLookup;
+   // ONTIME entries below the cursor are for times up to lastClockTime
+   static int16_t clockCursor;
+   static int16_t lastClockTime;
+   static const int16_t CLOCK_CATCHUP=15; // minutes made up after a skip
+   static void clockMinute(int16_t clocktime);
+   enum EVENT_TYPE : byte { EVENT_TURNOUT, EVENT_ACTIVATE, EVENT_CHANGE, EVENT_ROTATE };
+   static void postEvent(EVENT_TYPE type, int16_t id, bool value);
+   static void runEvent(EVENT_TYPE type, int16_t id, bool value);
+#ifdef EXRAIL_EVENT_QUEUE
+   struct QUEUED_EVENT {
+     int16_t id;
+     EVENT_TYPE type;
+     bool value;
+   };
+   static QUEUED_EVENT eventQueue[EXRAIL_EVENT_QUEUE_SIZE];
+   static byte eventCount;
+   static bool eventOverflow; // handlers pending in the lookup lists
+   static void overflowEvent(EVENT_TYPE type, int16_t id, bool value);
+   static byte runOverflow(byte budget);
+#endif
+   static LookList * skipLookup;
 #ifndef IO_NO_HAL
    static LookList * onRotateLookup;
 #endif
@@ -270,11 +358,40 @@ private:
    static void manageRouteCaption(int16_t id, const FSH* caption);
    static byte * routeStateArray;
    static const FSH ** routeCaptionArray;
-   static int16_t * stashArray;
+   static int16_t * stashArray;  // one entry per stash id used
+   static LookList * stashLookup; // stash id to stashArray index
    static int16_t maxStashId;
+   static int16_t * stashSlot(int16_t id);
     
+#ifdef EXRAIL_PROFILE
+   // </ PROFILE> statistics, per task start point and per opcode.
+   // Only compiled in when EXRAIL_PROFILE is defined in config.h
+   struct PROFILE_SLOT {
+     int startPc;
+     uint32_t runs;
+     uint32_t opcodes;
+     uint32_t busyMicros;
+     uint32_t waitMillis;
+   };
+   static const byte PROFILE_SLOTS=32; // last one collects any overflow
+   static PROFILE_SLOT profileSlots[PROFILE_SLOTS];
+   static byte profileSlotsUsed;
+   static uint32_t opcodeCount[256];
+   static uint32_t opcodeMicros[256];
+   static unsigned long longestMicros;
+   static int longestPc;
+   static byte profileSlotFor(int startPc);
+   static void profileShow(Print * stream);
+   static void profileReset();
+   byte profileSlot;
+#endif
+
   // Local variables - exist for each instance/task 
     RMFT2 *next;   // loop chain 
+    RMFT2 *schedNext; // run ring, or timer queue when sleeping
+    RMFT2 *schedPrev;
+    bool sleeping;      // in the timer queue, or the block queue if blockWait>=0
+    int16_t blockWait;  
     int progCounter;    // Byte offset of next route opcode in ROUTES table
     unsigned long delayStart; // Used by opcodes that must be recalled before completing
     unsigned long  delayTime;
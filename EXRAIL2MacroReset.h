@@ -34,12 +34,14 @@
 #undef ANOUT
 #undef ASPECT
 #undef AT
+#undef ATBLOCK
 #undef ATGTE
 #undef ATLT
 #undef ATTIMEOUT
 #undef AUTOMATION 
 #undef AUTOSTART
 #undef BLINK
+#undef BLOCK
 #undef BROADCAST
 #undef CALL 
 #undef CLEAR_STASH
@@ -190,6 +192,7 @@
 #undef VIRTUAL_SIGNAL
 #undef VIRTUAL_TURNOUT
 #undef WAITFOR
+#undef WAITFREE
 #ifndef IO_NO_HAL
 #undef WAITFORTT
 #endif
@@ -209,6 +212,7 @@
 #define AMBER(signal_id)
 #define ANOUT(vpin,value,param1,param2)
 #define AT(sensor_id)
+#define ATBLOCK(blockid)
 #define ASPECT(address,value)
 #define ATGTE(sensor_id,value) 
 #define ATLT(sensor_id,value) 
@@ -216,6 +220,7 @@
 #define AUTOMATION(id,description) 
 #define AUTOSTART
 #define BLINK(vpin,onDuty,offDuty)
+#define BLOCK(blockid,sensor_id)
 #define BROADCAST(msg)
 #define CALL(route)
 #define CLEAR_STASH(id)
@@ -365,6 +370,7 @@
 #define VIRTUAL_SIGNAL(id) 
 #define VIRTUAL_TURNOUT(id,description...) 
 #define WAITFOR(pin)
+#define WAITFREE(blockid)
 #ifndef IO_NO_HAL
 #define WAITFORTT(turntable_id)
 #endif
@@ -29,11 +29,29 @@
 #include "EXRAIL2.h"
 #include "DCC.h"
 #include "KeywordHasher.h"
+#include "CommandDistributor.h"
 
 // This filter intercepts <> commands to do the following:
 // - Implement RMFT specific commands/diagnostics
 // - Reject/modify JMRI commands that would interfere with RMFT processing
 
+// LIST_WRITER for <JA>, see CommandDistributor::sendList
+bool RMFT2::writeRouteIds(Print * stream, uint16_t & position, int16_t room) {
+  return routeLookup->stream(stream, position, room);
+}
+
+bool RMFT2::writeRouteStates(Print * stream, uint16_t & position, int16_t & room) {
+  if (!(compileFeatures & FEATURE_ROUTESTATE)) return true;
+  for (; position<(uint16_t)routeLookup->size(); position++) {
+    byte state=routeStateArray[position];
+    if (!state) continue;
+    if (room<CommandDistributor::SNAPSHOT_ENTRY_SIZE) return false;
+    StringFormatter::send(stream,F("<jB %d %d>\n"), routeLookup->keyAt(position), state);
+    room-=CommandDistributor::SNAPSHOT_ENTRY_SIZE;
+  }
+  return true;
+}
+
 void RMFT2::ComandFilter(Print * stream, byte & opcode, byte & paramCount, int16_t p[]) {
   (void)stream; // avoid compiler warning if we don't access this parameter
   
@@ -156,9 +174,7 @@ void RMFT2::ComandFilter(Print * stream, byte & opcode, byte & paramCount, int16
         switch(p[0]) {
           case "A"_hk: // <JA> returns automations/routes
             if (paramCount==1) {// <JA>
-              StringFormatter::send(stream, F("<jA"));
-              routeLookup->stream(stream);
-              StringFormatter::send(stream, F(">\n"));
+              CommandDistributor::sendList(stream, F("<jA"), writeRouteIds, REPLY_ROUTE_LIST, 0);
               opcode=0;
               return; 
             }
@@ -194,14 +210,16 @@ void RMFT2::ComandFilter(Print * stream, byte & opcode, byte & paramCount, int16
             } 
           if (paramCount==2) {  // <JM id>
               if (p[1]<=0 || p[1]>maxStashId) break;
+              int16_t * stash=stashSlot(p[1]);
               StringFormatter::send(stream,F("<jM %d %d>\n"),
-                    p[1],stashArray[p[1]]);
+                    p[1],stash ? *stash : 0);
                opcode=0;     
                break;    
           } 
           if (paramCount==3) {  // <JM id cab>
-              if (p[1]<=0 || p[1]>maxStashId) break;
-              stashArray[p[1]]=p[2];
+              int16_t * stash=stashSlot(p[1]);
+              if (p[1]<=0 || !stash) break;
+              *stash=p[2];
               opcode=0;
               break;      
           }
@@ -239,12 +257,18 @@ bool RMFT2::parseSlash(Print * stream, byte & paramCount, int16_t p[]) {
       if (task==loopTask) break;
     }
     // Now stream the flags
-    for (int id=0;id<MAX_FLAGS; id++) {
-      byte flag=flags[id];
-      if (flag & ~TASK_FLAG & ~SIGNAL_MASK) { // not interested in TASK_FLAG only. Already shown above
+    // not interested in TASK_FLAG or signals, already shown,
+    // so skip 8 ids at a time where nothing is reserved, latched or occupied
+    for (int b=0;b<FLAG_BYTES; b++) {
+      if ((flagPlanes[SECTION_PLANE][b] | flagPlanes[LATCH_PLANE][b] | flagPlanes[OCCUPIED_PLANE][b])==0) continue;
+      for (int id=b*8;id<b*8+8;id++) {
+        byte flag=getFlags(id);
+        if (flag & (SECTION_FLAG | LATCH_FLAG | OCCUPIED_FLAG)) {
 	      StringFormatter::send(stream,F("\nflags[%d] "),id);
 	      if (flag & SECTION_FLAG) StringFormatter::send(stream,F(" RESERVED"));
+	      if (flag & OCCUPIED_FLAG) StringFormatter::send(stream,F(" OCCUPIED"));
 	      if (flag & LATCH_FLAG) StringFormatter::send(stream,F(" LATCHED"));
+        }
       }
     }
 
@@ -255,7 +279,7 @@ bool RMFT2::parseSlash(Print * stream, byte & paramCount, int16_t p[]) {
         SIGNAL_DEFINITION slot=getSignalSlot(sigslot);
         if (slot.type==sigtypeNoMoreSignals) break; // end of signal list
 	      if (slot.type==sigtypeContinuation) continue; // continueation of previous line
-	      byte flag=flags[sigslot] & SIGNAL_MASK; // obtain signal flags for this ids
+	      byte flag=getFlags(sigslot) & SIGNAL_MASK; // obtain signal flags for this ids
         StringFormatter::send(stream,F("\n%S[%d]"), 
 			      (flag == SIGNAL_RED)? F("RED") : (flag==SIGNAL_GREEN) ? F("GREEN") : F("AMBER"),
 			      slot.id);
@@ -263,13 +287,16 @@ bool RMFT2::parseSlash(Print * stream, byte & paramCount, int16_t p[]) {
     }
 
     if (compileFeatures & FEATURE_STASH) {
-      for (int i=1;i<=maxStashId;i++) {
-        if (stashArray[i])
+      for (int i=0;i<stashLookup->size();i++) {
+        int16_t x=stashArray[stashLookup->resultAt(i)];
+        if (x)
           StringFormatter::send(stream,F("\nSTASH[%d] Loco=%d"),
-              i, stashArray[i]); 
+              stashLookup->keyAt(i), x); 
       } 
     }
     
+    StringFormatter::send(stream,F("\nTASKS=%d,MAX=%d,HEAP=%d"),
+        tasksInUse, tasksHighWater, tasksOnHeap);
     StringFormatter::send(stream,F(" *>\n"));
     return true;
   }
@@ -294,6 +321,14 @@ bool RMFT2::parseSlash(Print * stream, byte & paramCount, int16_t p[]) {
     return true;
     
     
+#ifdef EXRAIL_PROFILE
+  case "PROFILE"_hk: // </ PROFILE [RESET]>
+    if (paramCount==2 && p[1]=="RESET"_hk) profileReset();
+    else if (paramCount==1) profileShow(stream);
+    else return false;
+    return true;
+#endif
+
   case "START"_hk: // </ START [cab] route >
     if (paramCount<2 || paramCount>3) return false;
     {
@@ -339,7 +374,9 @@ bool RMFT2::parseSlash(Print * stream, byte & paramCount, int16_t p[]) {
     return setFlag(p[1],SECTION_FLAG);
     
   case "FREE"_hk:  // force free a section
-    return setFlag(p[1],0,SECTION_FLAG);
+    if (!setFlag(p[1],0,SECTION_FLAG)) return false;
+    blockEvent(p[1]);
+    return true;
     
   case "LATCH"_hk:
     return setFlag(p[1], LATCH_FLAG);
@@ -143,6 +143,12 @@ static_assert(!hasdup(compileTimeSequenceList[0],1),"Duplicate SEQUENCE/ROUTE/AU
 #define RESERVE(id) static_assert(id>=0 && id<MAX_FLAGS,"Id out of valid range 0-255" );
 #undef FREE
 #define FREE(id) static_assert(id>=0 && id<MAX_FLAGS,"Id out of valid range 0-255" );
+#undef BLOCK
+#define BLOCK(id,sensor_id) static_assert(id>=0 && id<MAX_FLAGS,"Id out of valid range 0-255" );
+#undef ATBLOCK
+#define ATBLOCK(id) static_assert(id>=0 && id<MAX_FLAGS,"Id out of valid range 0-255" );
+#undef WAITFREE
+#define WAITFREE(id) static_assert(id>=0 && id<MAX_FLAGS,"Id out of valid range 0-255" );
 #undef SPEED
 #define SPEED(speed) static_assert(speed>=0 && speed<128,"Speed out of valid range 0-127");
 #undef FWD
@@ -231,6 +237,8 @@ bool exrailHalSetup() {
 #define ONBUTTON(vpin) | FEATURE_SENSOR
 #undef ONSENSOR
 #define ONSENSOR(vpin) | FEATURE_SENSOR
+#undef BLOCK
+#define BLOCK(blockid,vpin) | FEATURE_SENSOR
 
 const byte RMFT2::compileFeatures = 0
    #include "myAutomation.h"
@@ -484,12 +492,14 @@ int RMFT2::onLCCLookup[RMFT2::countLCCLookup];
 #define ANOUT(vpin,value,param1,param2) OPCODE_SERVO,V(vpin),OPCODE_PAD,V(value),OPCODE_PAD,V(param1),OPCODE_PAD,V(param2),
 #define ASPECT(address,value) OPCODE_ASPECT,V((address<<5) | (value & 0x1F)),
 #define AT(sensor_id) OPCODE_AT,V(sensor_id),
+#define ATBLOCK(blockid) OPCODE_ATBLOCK,V(blockid),
 #define ATGTE(sensor_id,value) OPCODE_ATGTE,V(sensor_id),OPCODE_PAD,V(value),  
 #define ATLT(sensor_id,value) OPCODE_ATLT,V(sensor_id),OPCODE_PAD,V(value),  
 #define ATTIMEOUT(sensor_id,timeout) OPCODE_ATTIMEOUT1,0,0,OPCODE_ATTIMEOUT2,V(sensor_id),OPCODE_PAD,V(timeout/100L),
 #define AUTOMATION(id, description)  OPCODE_AUTOMATION, V(id), 
 #define AUTOSTART OPCODE_AUTOSTART,0,0,
 #define BLINK(vpin,onDuty,offDuty) OPCODE_BLINK,V(vpin),OPCODE_PAD,V(onDuty),OPCODE_PAD,V(offDuty),
+#define BLOCK(blockid,sensor_id) OPCODE_BLOCK,V(blockid),OPCODE_PAD,V(sensor_id),
 #define BROADCAST(msg) PRINT(msg)
 #define CALL(route) OPCODE_CALL,V(route),
 #define CLEAR_STASH(id) OPCODE_CLEAR_STASH,V(id),
@@ -662,6 +672,7 @@ int RMFT2::onLCCLookup[RMFT2::countLCCLookup];
 #define VIRTUAL_TURNOUT(id,description...) OPCODE_PINTURNOUT,V(id),OPCODE_PAD,V(0), 
 #define WITHROTTLE(msg) PRINT(msg)
 #define WAITFOR(pin) OPCODE_WAITFOR,V(pin),
+#define WAITFREE(blockid) OPCODE_WAITFREE,V(blockid),
 #ifndef IO_NO_HAL
 #define WAITFORTT(turntable_id) OPCODE_WAITFORTT,V(turntable_id),
 #endif
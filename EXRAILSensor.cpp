@@ -24,7 +24,10 @@ to call an exrail ONBUTTON or ONCHANGE handler.
 These are created at EXRAIL startup and thus need no delete or listing
 capability.
 The basic logic is similar to that found in the Sensor class
-except that on the relevant change an EXRAIL thread is started.    
+except that on the relevant change an EXRAIL thread is started,
+or for a BLOCK sensor the block occupancy is updated.    
+As in the Sensor class, pins on devices that notify changes are only
+read after a change has been notified, until the debounce completes.
 **********************************************************************/
 
 #include "EXRAILSensor.h"
@@ -58,6 +61,10 @@ void EXRAILSensor::checkAll() {
 } 
 
 bool EXRAILSensor::check() {
+  // nothing to do for an unchanged notifying pin
+  if (!pollingRequired && !changePending && latchDelay==minReadCount) return false;
+  changePending=false;
+
   // check for debounced change in this sensor 
   inputState = RMFT2::readSensor(pin);
 
@@ -76,6 +83,10 @@ bool EXRAILSensor::check() {
     // change validated, act on it.
     active = inputState;
     latchDelay = minReadCount;  // Reset debounce counter
+    if (blockId>=0) {
+      RMFT2::blockEvent(blockId);
+      return false;
+    }
     if (onChange || active) {
       new RMFT2(progCounter);
       return true;  // Don't check any more sensors on this entry
@@ -83,7 +94,7 @@ bool EXRAILSensor::check() {
     return false; 
 }
 
-EXRAILSensor::EXRAILSensor(VPIN _pin, int _progCounter, bool _onChange) {
+EXRAILSensor::EXRAILSensor(VPIN _pin, int _progCounter, bool _onChange, int16_t _blockId) {
   // Add to the start of the list
   //DIAG(F("ONthing vpin=%d at %d"), _pin, _progCounter);
   nextSensor = firstSensor;
@@ -92,13 +103,40 @@ EXRAILSensor::EXRAILSensor(VPIN _pin, int _progCounter, bool _onChange) {
   pin=_pin;
   progCounter=_progCounter;
   onChange=_onChange;
+  blockId=_blockId;
 
   IODevice::configureInput(pin, true);   
   active = IODevice::read(pin);
   inputState = active;
   latchDelay = minReadCount;
+
+  changePending=false;
+  pollingRequired=!IODevice::hasCallback(pin);
+  if (!pollingRequired && !inputChangeCallbackRegistered) {
+    IONotifyCallback::add(inputChangeCallback);
+    inputChangeCallbackRegistered=true;
+  }
+}
+
+// Callback from HAL when a digital input changes on a device
+// that supports notification. The state is read again in check()
+// so that latching and inverted pins are handled as when polling.
+void EXRAILSensor::inputChangeCallback(VPIN vpin, int state) {
+  (void)state;
+  for (EXRAILSensor * s=firstSensor; s!=NULL; s=s->nextSensor) {
+    if (s->pin==vpin) s->changePending=true;
+  }
+}
+
+// A block is occupied while any of its sensors is active.
+bool EXRAILSensor::blockOccupied(int16_t blockId) {
+  for (EXRAILSensor * s=firstSensor; s!=NULL; s=s->nextSensor) {
+    if (s->blockId==blockId && s->active) return true;
+  }
+  return false;
 }
 
 EXRAILSensor *EXRAILSensor::firstSensor=NULL;
 EXRAILSensor *EXRAILSensor::readingSensor=NULL;
 unsigned long EXRAILSensor::lastReadCycle=0;
+bool EXRAILSensor::inputChangeCallbackRegistered=false;
@@ -27,14 +27,20 @@ class EXRAILSensor {
  static unsigned long lastReadCycle;
  
   public:
+  ARENA_NEW(ARENA_EXRAIL)
   static void checkAll();
+  static void inputChangeCallback(VPIN vpin, int state);
+  static bool blockOccupied(int16_t blockId);
   
-  EXRAILSensor(VPIN _pin, int _progCounter, bool _onChange);
+  // A BLOCK sensor has a blockId and tells RMFT2::blockEvent of changes
+  // instead of starting a handler at _progCounter.
+  EXRAILSensor(VPIN _pin, int _progCounter, bool _onChange, int16_t _blockId=-1);
   bool check();
   
   private:
   static const unsigned int cycleInterval = 10000; // min time between consecutive reads of each sensor in microsecs.
                                                    // should not be less than device scan cycle time.
+  static bool inputChangeCallbackRegistered;
   static const byte minReadCount = 4; // number of additional scans before acting on change
                                         // E.g. 1 means that a change is ignored for one scan and actioned on the next.
                                         // Max value is 63
@@ -42,9 +48,12 @@ class EXRAILSensor {
   EXRAILSensor* nextSensor;
   VPIN pin; 
   int progCounter; 
+  int16_t blockId;
   bool active; 
   bool inputState;
   bool onChange;
+  bool pollingRequired; // false when the device notifies changes
+  bool changePending;   // notified, read on next check
   byte latchDelay;
 };
 #endif
@@ -31,6 +31,7 @@
 #include "CommandDistributor.h"
 #include "WiThrottle.h"
 #include "DCCTimer.h"
+#include "UdpThrottle.h"
 #if __has_include ( "MDNS_Generic.h")
   #include "MDNS_Generic.h"
   #define DO_MDNS 
@@ -47,6 +48,8 @@ EthernetServer * EthernetInterface::server= nullptr;
 EthernetClient EthernetInterface::clients[MAX_SOCK_NUM];                // accept up to MAX_SOCK_NUM client connections at the same time; This depends on the chipset used on the Shield
 bool EthernetInterface::inUse[MAX_SOCK_NUM];                // accept up to MAX_SOCK_NUM client connections at the same time; This depends on the chipset used on the Shield
 uint8_t EthernetInterface::buffer[MAX_ETH_BUFFER+1];                    // buffer used by TCP for the recv
+uint8_t EthernetInterface::carry[MAX_SOCK_NUM][MAX_ETH_CARRY];
+uint8_t EthernetInterface::carryLength[MAX_SOCK_NUM];
 RingStream * EthernetInterface::outboundRing = nullptr;
 
 /**
@@ -97,6 +100,9 @@ void EthernetInterface::setup()
   }
   server = new EthernetServer(IP_PORT); // Ethernet Server listening on default port IP_PORT
   server->begin();
+#ifdef UDP_THROTTLE_ON
+  UdpThrottle::setup();
+#endif
 
   // Arrange display of IP address and port
   #ifdef LCD_DRIVER
@@ -139,8 +145,8 @@ void EthernetInterface::acceptClient() { // STM32 version
     {
       clients[socket] = client;
       inUse[socket]=true;
-      if (Diag::ETHERNET)
-        DIAG(F("Ethernet: New client socket %d"), socket);
+      carryLength[socket]=0;
+      DIAGLOG(Diag::ETHERNET, F("Ethernet: New client socket %d"), socket);
       return;
     }
   }
@@ -153,8 +159,8 @@ void EthernetInterface::acceptClient() { // non-STM32 version
   auto socket=client.getSocketNumber();
   clients[socket]=client;
   inUse[socket]=true;
-  if (Diag::ETHERNET)
-    DIAG(F("Ethernet: New client socket %d"), socket);
+  carryLength[socket]=0;
+  DIAGLOG(Diag::ETHERNET, F("Ethernet: New client socket %d"), socket);
 }
 #endif
 
@@ -162,8 +168,9 @@ void EthernetInterface::dropClient(byte socket)
 { 
   clients[socket].stop();
   inUse[socket]=false;
+  carryLength[socket]=0;
   CommandDistributor::forget(socket);
-	if (Diag::ETHERNET)  DIAG(F("Ethernet: Disconnect %d "), socket);  
+	DIAGLOG(Diag::ETHERNET, F("Ethernet: Disconnect %d "), socket);  
 }
 
 /**
@@ -215,7 +222,11 @@ void EthernetInterface::loop()
         break;
     }
     looptimer(5000, F("E.maintain"));
-	  
+
+#ifdef UDP_THROTTLE_ON
+    UdpThrottle::loop();
+#endif
+
     // get client from the server
     acceptClient();
     
@@ -226,55 +237,93 @@ void EthernetInterface::loop()
       if (inUse[socket] && !clients[socket].connected()) dropClient(socket);
     }  
 
-    // check for incoming data from all possible clients
+    // check for incoming data from all possible clients,
+    // one read each so that a busy client does not hold up the others,
+    // none for a client over its share of commands
     for (byte socket = 0; socket < MAX_SOCK_NUM; socket++)
     {
-      if (!inUse[socket]) continue; // socket is not in use
-	
-	    // read any bytes from this client
-	    auto count = clients[socket].read(buffer, MAX_ETH_BUFFER);
-      
-      if (count<0) continue;  // -1 indicates nothing to read
-	    
-      if (count > 0) {  // we have incoming data 
-	      buffer[count] = '\0'; // terminate the string properly
-	      if (Diag::ETHERNET) DIAG(F("Ethernet s=%d, c=%d b=:%e"), socket, count, buffer);
-	      // execute with data going directly back
-	      CommandDistributor::parse(socket,buffer,outboundRing);
-	      //looptimer(5000, F("Ethloop2 parse"));
-	      return; // limit the amount of processing that takes place within 1 loop() cycle. 
-	    }
-	    
-      // count=0 The client has disconnected
-	    dropClient(socket);
+      if (inUse[socket] && CommandDistributor::mayParse(socket)) receive(socket);
     }
 	
     WiThrottle::loop(outboundRing);
 
-    // handle at most 1 outbound transmission 
-    auto socketOut=outboundRing->read();
-    if (socketOut<0) return;  // no outbound pending
+    // drop clients that have stopped reading their broadcasts
+    byte evictions=outboundRing->takeEvictions();
+    for (byte socket=0; evictions && socket<MAX_SOCK_NUM; socket++, evictions>>=1) {
+      if ((evictions & 1) && inUse[socket]) dropClient(socket);
+    }
 
-    if (socketOut >= MAX_SOCK_NUM) {
-      // This is a catastrophic code failure and unrecoverable.  
-      DIAG(F("Ethernet outboundRing s=%d error"), socketOut);
-      connected=false;
-      return;
-    } 
+    // Send all outbound replies. Replies that follow each other to the
+    // same socket are joined in buffer (free again now) into one write.
+    int batchSocket=-1;
+    int batchLength=0;
+    for (;;) {
+      auto socketOut=outboundRing->read();
+      if (socketOut >= MAX_SOCK_NUM) {
+        // This is a catastrophic code failure and unrecoverable.  
+        DIAG(F("Ethernet outboundRing s=%d error"), socketOut);
+        connected=false;
+        return;
+      } 
+      int count = (socketOut<0) ? 0 : outboundRing->count();
+      if (batchLength && (socketOut!=batchSocket || batchLength+count>MAX_ETH_BUFFER)) {
+        sendReply(batchSocket,buffer,batchLength);
+        batchLength=0;
+      }
+      if (socketOut<0) return;  // no more outbound pending
 
-    auto count=outboundRing->count();
-    {
-	    char tmpbuf[count+1]; // one extra for '\0'
-	    for(int i=0;i<count;i++) {
-	      tmpbuf[i] = outboundRing->read();
-	    }
-	    tmpbuf[count]=0;
-      if (inUse[socketOut]) {
-  	    if (Diag::ETHERNET) DIAG(F("Ethernet reply s=%d, c=%d, b:%e"),
-                              socketOut,count,tmpbuf);
-	      clients[socketOut].write(tmpbuf,count);
+      if (count>MAX_ETH_BUFFER) { // too big to join
+        uint8_t tmpbuf[count+1]; // one extra for '\0'
+        outboundRing->read(tmpbuf,count);
+        sendReply(socketOut,tmpbuf,count);
+        continue;
       }
+      batchSocket=socketOut;
+      batchLength+=outboundRing->read(buffer+batchLength,count);
     }
-    
+}
+
+// Read what one client has sent and parse the complete commands. A
+// command cut short by the end of a TCP segment is carried over to the
+// next read instead of being parsed in two halves.
+void EthernetInterface::receive(byte socket) {
+  byte held=carryLength[socket];
+  memcpy(buffer, carry[socket], held);
+
+  // read any bytes from this client
+  auto count = clients[socket].read(buffer+held, MAX_ETH_BUFFER-held);
+  if (count<0) return;  // -1 indicates nothing to read
+  if (count==0) {
+    // The client has disconnected
+    dropClient(socket);
+    return;
+  }
+
+  // Complete commands end with > (or newline for WiThrottle)
+  int length=held+count;
+  int end=length;
+  while (end>0 && buffer[end-1]!='>' && buffer[end-1]!='\n') end--;
+  int tail=length-end;
+  if (tail>MAX_ETH_CARRY) {
+    // too long to be a split command, pass it on as it is
+    end=length;
+    tail=0;
+  }
+  memcpy(carry[socket], buffer+end, tail);
+  carryLength[socket]=tail;
+  if (end==0) return;
+
+  buffer[end] = '\0'; // terminate the string properly
+  DIAGLOG(Diag::ETHERNET, F("Ethernet s=%d, c=%d b=:%e"), socket, end, buffer);
+  // execute with data going directly back
+  CommandDistributor::parse(socket,buffer,outboundRing);
+}
+
+void EthernetInterface::sendReply(byte socket, uint8_t * reply, int count) {
+  if (!inUse[socket]) return;
+  reply[count]=0;
+  DIAGLOG(Diag::ETHERNET, F("Ethernet reply s=%d, c=%d, b:%e"),
+          socket,count,reply);
+  clients[socket].write(reply,count);
 }
 #endif
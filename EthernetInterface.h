@@ -56,7 +56,13 @@
  * 
  */
 
+#ifdef STM32_ETHERNET
+// plenty of RAM, read and write in fewer, larger TCP segments
+#define MAX_ETH_BUFFER 512
+#else
 #define MAX_ETH_BUFFER 128
+#endif
+#define MAX_ETH_CARRY 32   // unterminated command tail kept per socket
 #define OUTBOUND_RING_SIZE 2048
 
 class EthernetInterface {
@@ -72,9 +78,13 @@ class EthernetInterface {
     static EthernetClient clients[MAX_SOCK_NUM];                // accept up to MAX_SOCK_NUM client connections at the same time; This depends on the chipset used on the Shield
     static bool inUse[MAX_SOCK_NUM];                // accept up to MAX_SOCK_NUM client connections at the same time; This depends on the chipset used on the Shield
     static uint8_t buffer[MAX_ETH_BUFFER+1];                    // buffer used by TCP for the recv
+    static uint8_t carry[MAX_SOCK_NUM][MAX_ETH_CARRY];  // start of a command split over TCP segments
+    static uint8_t carryLength[MAX_SOCK_NUM];
     static RingStream * outboundRing;
     static void acceptClient();
     static void dropClient(byte socketnum);
+    static void receive(byte socket);
+    static void sendReply(byte socket, uint8_t * reply, int count);
     
 };
 
@@ -88,7 +88,7 @@ typedef char FSH;
 #define FLASH
 #define HIGHFLASH
 #define HIGHFLASH3
-#define GETFARPTR(data) ((uint32_t)(data))
+#define GETFARPTR(data) ((uintptr_t)(data))
 #define GETFLASH(addr) (*(const byte *)(addr))
 #define GETHIGHFLASH(data,offset)  (*(const byte *)(GETFARPTR(data)+offset))
 #define GETHIGHFLASHW(data,offset) (*(const uint16_t *)(GETFARPTR(data)+offset))
@@ -0,0 +1,203 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "HotRestart.h"
+#ifdef HOT_RESTART
+#include "DIAG.h"
+#include "DCC.h"
+#include "EEStore.h"
+#include "TrackManager.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <avr/io.h>
+#endif
+
+// Each bank holds the VALID byte, its sequence byte, a record per track,
+// then a record per loco slot. A slot with no loco has address 0.
+static const byte VALID=0xA5;
+static const byte TRACKS=TrackManager::MAX_TRACKS;
+static const byte RECORDS=TRACKS+HOT_RESTART_LOCOS;
+static const int BANK_SIZE=2+TRACKS*4+HOT_RESTART_LOCOS*7;
+
+#if defined(ARDUINO_ARCH_AVR) && defined(HOT_RESTART_BOOTLOADER_FLAGS)
+// Optiboot clears MCUSR and hands its value to the sketch in r2, which
+// must be saved before the C startup uses the register.
+static byte bootFlags __attribute__((section(".noinit")));
+void hotRestartBootFlags() __attribute__((naked, used, section(".init0")));
+void hotRestartBootFlags() {
+  __asm__ __volatile__ ("mov %0, r2\n" : "=r" (bootFlags) :);
+}
+#endif
+
+int HotRestart::base=0;
+byte HotRestart::banks=0;
+byte HotRestart::bank=0;
+byte HotRestart::sequence=0;
+byte HotRestart::nextRecord=0;
+unsigned long HotRestart::passStart=0;
+
+bool HotRestart::warmReset() {
+#if defined(HOT_RESTART_ALWAYS)
+  return true;
+#elif defined(ARDUINO_ARCH_AVR)
+  byte flags=MCUSR;
+  MCUSR=0;  // or the next reset would look like this one
+#if defined(HOT_RESTART_BOOTLOADER_FLAGS)
+  if (flags==0) flags=bootFlags;
+#endif
+#if defined(HOT_RESTART_NO_BROWNOUT)
+  const byte warmFlags=_BV(WDRF);
+#else
+  const byte warmFlags=_BV(WDRF) | _BV(BORF);
+#endif
+  // a power on or the reset pin set as well means the supply or the user
+  // restarted it, not a lockup or a dip
+  return (flags & warmFlags) && !(flags & (_BV(PORF) | _BV(EXTRF)));
+#else
+  return false;
+#endif
+}
+
+void HotRestart::begin() {
+  bool warm=warmReset();
+  int room=EEPROM.length()-EEStore::pointer();
+  banks=room/BANK_SIZE;
+  if (banks>HOT_RESTART_BANKS) banks=HOT_RESTART_BANKS;
+  if (banks==0) {
+    DIAG(F("HotRestart no room in EEPROM"));
+    return;
+  }
+  base=EEPROM.length()-banks*BANK_SIZE;
+
+  // the newest valid bank, by sequence number modulo 256
+  int newest=-1;
+  for (byte b=0; b<banks; b++) {
+    if (EEPROM.read(bankAddress(b))!=VALID) continue;
+    byte seq=EEPROM.read(bankAddress(b)+1);
+    if (newest<0 || (int8_t)(seq-sequence)>0) {
+      newest=b;
+      sequence=seq;
+    }
+  }
+  if (newest>=0) bank=(newest+1)%banks;
+  if (warm && newest>=0) restore(newest);
+  else {
+    // not resumed, so it is rewritten from scratch before it counts
+    for (byte b=0; b<banks; b++)
+      if (EEPROM.read(bankAddress(b))==VALID) EEStore::update(bankAddress(b), 0);
+  }
+  passStart=millis();
+}
+
+void HotRestart::clear() {
+  if (base==0) return;
+  EEStore::flush();
+  for (byte b=0; b<banks; b++)
+    if (EEPROM.read(bankAddress(b))==VALID) EEPROM.write(bankAddress(b), 0);
+}
+
+int HotRestart::bankAddress(byte b) {
+  return base+b*BANK_SIZE;
+}
+
+int HotRestart::address(byte b, byte record) {
+  int a=bankAddress(b)+2;
+  if (record<TRACKS) return a+record*TRACK_RECORD;
+  return a+TRACKS*TRACK_RECORD+(record-TRACKS)*LOCO_RECORD;
+}
+
+// The live state of a record as it is stored, returns its length
+byte HotRestart::encode(byte record, byte * data) {
+  if (record<TRACKS) {
+    byte t=record;
+    bool exists=(t<TrackManager::numTracks());
+    data[0]=exists ? TrackManager::getMode(t) : 0;
+    data[1]=exists && TrackManager::isPowerOn(t);
+    int16_t dcAddr=exists ? TrackManager::returnDCAddr(t) : 0;
+    memcpy(data+2, &dcAddr, 2);
+    return TRACK_RECORD;
+  }
+  byte slot=record-TRACKS;
+  int16_t cab=0;
+  byte speedCode=0;
+  uint32_t functions=0;
+  if (slot<DCC::tableSlots && DCC::speedTable.loco[slot]>0) {
+    cab=DCC::speedTable.loco[slot];
+    speedCode=DCC::speedTable.speedCode[slot];
+    functions=DCC::speedTable.functions[slot];
+  }
+  memcpy(data, &cab, 2);
+  data[2]=speedCode;
+  memcpy(data+3, &functions, 4);
+  return LOCO_RECORD;
+}
+
+void HotRestart::loop() {
+  if (base==0 || EEStore::writesPending()) return;
+#if defined(__AVR__)
+  if (!eeprom_is_ready()) return;  // reads would wait for the write
+#endif
+  int header=bankAddress(bank);
+  if (nextRecord==0) {
+    if (millis()-passStart < HOT_RESTART_INTERVAL) return;
+    passStart=millis();
+    // the bank is not valid while it is part written
+    if (EEPROM.read(header)==VALID) EEStore::update(header, 0);
+  }
+
+  byte data[LOCO_RECORD];
+  byte length=encode(nextRecord, data);
+  int a=address(bank, nextRecord);
+  for (byte i=0; i<length; i++)
+    if (EEPROM.read(a+i)!=data[i]) EEStore::update(a+i, data[i]);
+
+  if (++nextRecord<RECORDS) return;
+  nextRecord=0;
+  // every record of the bank is now up to date, so it is the newest
+  sequence++;
+  EEStore::update(header+1, sequence);
+  EEStore::update(header, VALID);
+  bank=(bank+1)%banks;
+}
+
+void HotRestart::restore(byte b) {
+  byte locos=0;
+  for (byte slot=0; slot<HOT_RESTART_LOCOS; slot++) {
+    int a=address(b, TRACKS+slot);
+    int16_t cab;
+    uint32_t functions;
+    EEPROM.get(a, cab);
+    EEPROM.get(a+3, functions);
+    if (cab<=0) continue;
+    DCC::restoreLoco(cab, EEPROM.read(a+2), functions);
+    locos++;
+  }
+  // power last, so the first packets already carry the speeds
+  for (byte t=0; t<TRACKS && t<TrackManager::numTracks(); t++) {
+    int a=address(b, t);
+    TRACK_MODE mode=(TRACK_MODE)EEPROM.read(a);
+    int16_t dcAddr;
+    EEPROM.get(a+2, dcAddr);
+    if (mode!=0 && mode!=TrackManager::getMode(t))
+      TrackManager::setTrackMode(t, mode, dcAddr);
+    if (EEPROM.read(a+1)) TrackManager::setTrackPower(POWERMODE::ON, t);
+  }
+  DIAG(F("HotRestart resumed %d locos"), locos);
+}
+#endif
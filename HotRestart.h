@@ -0,0 +1,86 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HotRestart_h
+#define HotRestart_h
+#include <Arduino.h>
+#include "defines.h"
+
+// HOT_RESTART, defined in config.h, keeps a snapshot of the first
+// HOT_RESTART_LOCOS loco slots (address, speed and direction, F0-F28 and
+// the DC frequency bits) and of each track's mode, DC address and power
+// in the last bytes of the EEPROM. F29 and above (LOCO_EXT_FUNCTIONS) are
+// not saved. After a watchdog reset or a brownout the locos and tracks
+// are put back from it before the network starts, so trains carry on
+// within a second rather than waiting for every throttle to reconnect.
+//
+// The snapshot is compared with the live state one record at a time and
+// only changed bytes are queued to EEStore, with a pass starting at most
+// every HOT_RESTART_INTERVAL ms. Successive passes go to the next of up to
+// HOT_RESTART_BANKS copies (as many as fit), each with a sequence number,
+// so a byte that changes on every pass is written every
+// HOT_RESTART_INTERVAL*HOT_RESTART_BANKS ms: 7.5 times an hour by default,
+// over 13000 hours of driving for a 100k cycle EEPROM.
+//
+// Only a watchdog reset or a brownout resumes, as told by MCUSR on AVR.
+// A power on, the reset button and the USB auto reset (DTR) all start
+// with everything stopped as before. Define HOT_RESTART_NO_BROWNOUT when
+// the processor shares its supply with the track, so a short that drags
+// the supply down is not powered up again. The stock Mega bootloader
+// clears MCUSR, so define HOT_RESTART_BOOTLOADER_FLAGS when the bootloader
+// passes it on in r2 (Optiboot and its derivatives). Other processors
+// never resume unless HOT_RESTART_ALWAYS is defined, which resumes after
+// any reset, including the reset button. <C RESET> does not resume.
+#ifdef HOT_RESTART
+#ifndef HOT_RESTART_LOCOS
+#define HOT_RESTART_LOCOS 16
+#endif
+#ifndef HOT_RESTART_INTERVAL
+#define HOT_RESTART_INTERVAL 60000
+#endif
+#ifndef HOT_RESTART_BANKS
+#define HOT_RESTART_BANKS 8
+#endif
+
+class HotRestart {
+public:
+  // after DCC::begin(), resumes from the snapshot if the reset allows
+  static void begin();
+  // compares (and queues) one record of the snapshot
+  static void loop();
+  // the next restart is from scratch
+  static void clear();
+
+private:
+  static const byte TRACK_RECORD=4;  // mode, power, DC address
+  static const byte LOCO_RECORD=7;   // address, speedCode, functions
+  static int base;          // EEPROM address of the first bank, 0 when off
+  static byte banks;        // banks that fit in the EEPROM
+  static byte bank;         // bank being written
+  static byte sequence;     // of the last completed bank
+  static byte nextRecord;
+  static unsigned long passStart;
+  static bool warmReset();
+  static byte encode(byte record, byte * data);
+  static int bankAddress(byte b);
+  static int address(byte b, byte record);
+  static void restore(byte b);
+};
+#endif
+#endif
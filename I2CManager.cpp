@@ -284,6 +284,113 @@ const FSH *I2CManagerClass::getErrorMessage(uint8_t status) {
   }
 }
 
+#if defined(I2C_STATS)
+/***************************************************************************
+ *  Add a finished request to the statistics for its device.  On the native
+ *  drivers this is called from the interrupt handler.
+ ***************************************************************************/
+void I2CManagerClass::recordStats(I2CAddress address, uint8_t bytes, uint8_t status, 
+    uint8_t retries, uint32_t waitTime, uint32_t busyTime) {
+  DeviceStats *d = _deviceStats;
+  uint8_t i;
+  for (i=0; i<_deviceStatsCount; i++, d++) {
+#if defined(I2C_EXTENDED_ADDRESS)
+    if (d->address.muxNumber() != address.muxNumber() || d->address.subBus() != address.subBus())
+      continue;
+#endif
+    if ((uint8_t)d->address == (uint8_t)address) break;
+  }
+  if (i == _deviceStatsCount) {
+    // New device
+    if (i >= I2C_STATS_DEVICES) {
+      _statsDropped++;
+      return;
+    }
+    memset((void *)d, 0, sizeof(DeviceStats));
+    d->address = address;
+    _deviceStatsCount++;
+  }
+  d->transactions++;
+  d->bytes += bytes;
+  if (status == I2C_STATUS_NEGATIVE_ACKNOWLEDGE || status == I2C_STATUS_TRANSMIT_ERROR)
+    d->naks++;
+  else if (status == I2C_STATUS_TIMEOUT)
+    d->timeouts++;
+  else if (status != I2C_STATUS_OK)
+    d->errors++;
+  d->retries += retries;
+  d->waitMicros += waitTime;
+  d->busyMicros += busyTime;
+  if (busyTime > d->maxBusyMicros) d->maxBusyMicros = busyTime;
+}
+
+/***************************************************************************
+ *  Print the statistics.  Busy time is shown as a percentage of the time
+ *  since the statistics were last reset.  Times are accumulated in 
+ *  microseconds, so reset at least hourly for a busy bus.
+ ***************************************************************************/
+void I2CManagerClass::showStats(bool reset) {
+  // Entries are copied one at a time with interrupts off, as the interrupt
+  // handler may be updating them.
+  DeviceStats d, other;
+  uint8_t count = _deviceStatsCount;
+  unsigned long now = millis();
+  unsigned long elapsed = now - _statsStartMillis;
+  if (elapsed == 0) elapsed = 1;
+
+  // Microseconds busy per millisecond is busy time in tenths of one percent.
+  uint32_t busy = 0;
+  for (uint8_t i=0; i<count; i++) {
+    noInterrupts();
+    busy += _deviceStats[i].busyMicros;
+    interrupts();
+  }
+  busy /= elapsed;
+  DIAG(F("I2CBus_0 busy %L.%d%% over %Lms, %u requests not recorded"), 
+    busy/10, (int)(busy%10), elapsed, _statsDropped);
+
+#if defined(I2C_EXTENDED_ADDRESS)
+  // Sum the devices on each subbus, listing each subbus once.
+  for (uint8_t i=0; i<count; i++) {
+    I2CMux mux = _deviceStats[i].address.muxNumber();
+    I2CSubBus subBus = _deviceStats[i].address.subBus();
+    if (mux == I2CMux_None) continue;
+    uint8_t j;
+    for (j=0; j<i; j++)
+      if (_deviceStats[j].address.muxNumber() == mux && _deviceStats[j].address.subBus() == subBus) break;
+    if (j < i) continue;  // Already listed
+    busy = 0;
+    for (j=i; j<count; j++) {
+      noInterrupts();
+      other = _deviceStats[j];
+      interrupts();
+      if (other.address.muxNumber() == mux && other.address.subBus() == subBus)
+        busy += other.busyMicros;
+    }
+    busy /= elapsed;
+    DIAG(F("  {I2CMux_%d,SubBus_%d} busy %L.%d%%"), mux, subBus, busy/10, (int)(busy%10));
+  }
+#endif
+
+  for (uint8_t i=0; i<count; i++) {
+    noInterrupts();
+    d = _deviceStats[i];
+    interrupts();
+    DIAG(F("%s n=%L bytes=%L nak=%u timeout=%u error=%u retry=%u wait=%Lus xfer=%Lus max=%Lus"),
+      d.address.toString(), d.transactions, d.bytes, d.naks, d.timeouts, d.errors,
+      d.retries, d.waitMicros/d.transactions, d.busyMicros/d.transactions, d.maxBusyMicros);
+  }
+
+  if (reset) {
+    noInterrupts();
+    _deviceStatsCount = 0;
+    _statsDropped = 0;
+    interrupts();
+    _statsStartMillis = now;
+  }
+}
+#endif
+
 /***************************************************************************
  *  Declare singleton class instance.
  ***************************************************************************/
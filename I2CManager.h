@@ -115,6 +115,13 @@
 // configured applies to each try separately.
 #define MAX_I2C_RETRIES 2
 
+// Maximum number of times a queued request may be overtaken by later
+// requests that are grouped with others on the same mux subbus.
+// Define as 0 in config.h to keep the queue strictly in order.
+#ifndef I2C_MAX_BYPASS
+#define I2C_MAX_BYPASS 4
+#endif
+
 // Add following line to config.h to enable Wire library instead of native I2C drivers
 //#define I2C_USE_WIRE
 
@@ -126,6 +133,39 @@
 #define I2C_USE_INTERRUPTS
 #endif
 
+// Add following line to config.h to let the native STM32F4 driver use the DMA
+// controller for the data phase of longer transfers, so that the CPU is only
+// interrupted at the start and end of the transfer rather than for each byte.
+// DMA1 streams 0 (receive) and 6 (transmit) are used for I2C1.
+//#define I2C_USE_DMA
+
+// Transfers shorter than this are still handled byte by byte, as setting up
+// the DMA stream costs more than a couple of interrupts.
+#ifndef I2C_DMA_MIN_BYTES
+#define I2C_DMA_MIN_BYTES 4
+#endif
+
+// Add following line to config.h to keep per-device I2C statistics
+// (transactions, bytes, NAKs, timeouts, retries, queue wait and transfer
+// time) for up to I2C_STATS_DEVICES addresses.  Shown by <D I2C [RESET]>.
+//#define I2C_STATS
+#ifndef I2C_STATS_DEVICES
+#define I2C_STATS_DEVICES 16
+#endif
+
+// Devices declare the fastest clock they support with 
+// I2CManager.setClock(address, speed), and the bus is switched to that
+// speed for each of their requests, so one slow device no longer slows
+// the rest.  Other devices run at the lowest speed given to setClock(speed).
+// Device speeds are limited to I2C_MAX_FREQ, by default the same as 
+// I2C_FREQ; define it as 1000000 in config.h to let Fast-mode Plus 
+// devices run at 1MHz on processors and wiring that allow it.  Up to
+// I2C_CLOCK_DEVICES addresses are remembered.  The Wire library keeps
+// one speed for the whole bus.
+#ifndef I2C_CLOCK_DEVICES
+#define I2C_CLOCK_DEVICES 8
+#endif
+
 // I2C Extended Address support I2C Multiplexers and allows various properties to be 
 // associated with an I2C address such as the MUX and SubBus.  In the future, this
 // may be extended to include multiple buses, and other features. 
@@ -393,6 +433,9 @@ typedef enum : uint8_t
 #ifndef I2C_FREQ
 #define I2C_FREQ    400000L
 #endif
+#ifndef I2C_MAX_FREQ
+#define I2C_MAX_FREQ I2C_FREQ
+#endif
 
 // Class defining a request context for an I2C operation.
 class I2CRB {
@@ -417,6 +460,14 @@ public:
   const uint8_t *writeBuffer;
 #if !defined(I2C_USE_WIRE)
   I2CRB *nextRequest;  // Used by non-blocking devices for I2CRB queue management.
+  uint16_t clockKHz;   // Bus speed for the request, 0 for the default speed
+#if defined(I2C_EXTENDED_ADDRESS)
+  uint8_t bypassCount;  // Number of later requests moved ahead of this one
+#endif
+#if defined(I2C_STATS)
+  uint32_t queuedAt;   // micros() when queued
+  uint32_t startedAt;  // micros() when first try started
+#endif
 #endif
 };
 
@@ -428,6 +479,8 @@ public:
   void begin(void);
   // Set clock speed to the lowest requested one.
   void setClock(uint32_t speed);
+  // Set the fastest clock speed a device supports.
+  void setClock(I2CAddress address, uint32_t speed);
   // Force clock speed 
   void forceClock(uint32_t speed);
   // setTimeout sets the timout value for I2C transactions (milliseconds).
@@ -470,6 +523,36 @@ public:
   // need to be printed using FSH.
   static const FSH *getErrorMessage(uint8_t status);
 
+#if defined(HAL_BENCHMARK)
+  // Bytes requested so far (writes plus reads), sampled by the HAL 
+  // benchmark either side of each device call.
+  uint32_t bytesRequested = 0;
+#endif
+
+#if defined(I2C_STATS)
+  // List statistics per bus, mux subbus and device, optionally clearing them.
+  void showStats(bool reset);
+private:
+  struct DeviceStats {
+    I2CAddress address;
+    uint16_t naks;
+    uint16_t timeouts;
+    uint16_t errors;     // Other failures
+    uint16_t retries;
+    uint32_t transactions;
+    uint32_t bytes;
+    uint32_t waitMicros;   // Total time queued behind other requests
+    uint32_t busyMicros;   // Total time from first start to completion
+    uint32_t maxBusyMicros;
+  };
+  DeviceStats _deviceStats[I2C_STATS_DEVICES];
+  volatile uint8_t _deviceStatsCount = 0;
+  volatile uint16_t _statsDropped = 0;   // Requests for devices beyond the table
+  unsigned long _statsStartMillis = 0;
+  void recordStats(I2CAddress address, uint8_t bytes, uint8_t status, uint8_t retries,
+    uint32_t waitTime, uint32_t busyTime);
+#endif
+
 private:
   bool _beginCompleted = false;
   bool _clockSpeedFixed = false;
@@ -502,6 +585,12 @@ private:
   uint8_t _muxCount = 0;
 public:
   uint8_t getMuxCount() { return _muxCount; }
+#if !defined(I2C_USE_WIRE)
+  // Number of mux subbus selections avoided by grouping queued requests.
+  uint32_t getMuxSwitchesSaved() { return _muxSwitchesSaved; }
+private:
+  uint32_t _muxSwitchesSaved = 0;
+#endif
 #endif
 
 #if !defined(I2C_USE_WIRE)
@@ -535,15 +624,32 @@ private:
     uint32_t startTime = 0;
     uint8_t muxPhase = 0;
     uint8_t muxAddress = 0;
+    uint8_t selectedMux = I2CMux_None;  // mux with a subbus enabled
+    uint8_t selectedSubBus = SubBus_None;
     uint8_t muxData[1];
     uint8_t deviceAddress;
     const uint8_t *sendBuffer;
     uint8_t *receiveBuffer;
     uint8_t transactionState = 0;
   
-    volatile uint32_t pendingClockSpeed = 0;
+    // Speed for requests without their own, and the speed the bus is set to
+    // (0 when it must be set again before the next transaction).
+    volatile uint32_t defaultClockSpeed = I2C_FREQ;
+    uint32_t busClockSpeed = 0;
+
+    struct DeviceClock {
+      I2CAddress address;
+      uint16_t kHz;
+    };
+    DeviceClock _deviceClocks[I2C_CLOCK_DEVICES];
+    uint8_t _deviceClockCount = 0;
+    uint16_t deviceClockKHz(I2CAddress address);
 
     void startTransaction();
+    void startRequestPhase();
+#if defined(I2C_EXTENDED_ADDRESS)
+    bool queueBySubBus(I2CRB *req);
+#endif
     
     // Low-level hardware manipulation functions.
     void I2C_init();
@@ -77,8 +77,12 @@ enum MuxPhase: uint8_t {
   MuxPhase_PROLOG,
   MuxPhase_PAYLOAD,
   MuxPhase_EPILOG,
+  MuxPhase_DESELECT,
 } ;
 
+// selectedSubBus value when a mux may have any subbus enabled.
+#define SUBBUS_UNKNOWN 253
+
 
 /***************************************************************************
  * Initialise the I2CManagerAsync class.
@@ -94,12 +98,48 @@ void I2CManagerClass::_initialise()
 /***************************************************************************
  *  Set I2C clock speed.  Normally 100000 (Standard) or 400000 (Fast)
  *   on Arduino.  Mega4809 supports 1000000 (Fast+) too.
- *   This function saves the desired clock speed and the startTransaction
- *   function acts on it before a new transaction, to avoid speed changes
- *   during an I2C transaction.
+ *   This function saves the desired clock speed for devices that have
+ *   not set their own, and the startTransaction function acts on it 
+ *   before a new transaction, to avoid speed changes during an I2C 
+ *   transaction.
  ***************************************************************************/
 void I2CManagerClass::_setClock(unsigned long i2cClockSpeed) {
-  pendingClockSpeed = i2cClockSpeed;
+  defaultClockSpeed = i2cClockSpeed;
+  busClockSpeed = 0;
+}
+
+/***************************************************************************
+ *  Record the fastest speed a device supports.  If the table is full the
+ *   device falls back to lowering the default speed for everyone.
+ ***************************************************************************/
+void I2CManagerClass::setClock(I2CAddress address, uint32_t speed) {
+  if (speed > I2C_MAX_FREQ) speed = I2C_MAX_FREQ;
+  uint8_t i = 0;
+  while (i < _deviceClockCount && !(_deviceClocks[i].address == address)) i++;
+  if (i == I2C_CLOCK_DEVICES) {
+    setClock(speed);
+    return;
+  }
+  _deviceClocks[i].address = address;
+  _deviceClocks[i].kHz = speed / 1000;
+  if (i == _deviceClockCount) _deviceClockCount++;
+  DIAG(F("I2C:%s clock speed %l Hz"), address.toString(), speed);
+}
+
+// Speed for a request, looked up when it is queued, 0 for the default.
+uint16_t I2CManagerClass::deviceClockKHz(I2CAddress address) {
+  if (_clockSpeedFixed) return 0;
+  for (uint8_t i = 0; i < _deviceClockCount; i++) {
+    if (_deviceClocks[i].address == address) {
+      uint16_t kHz = _deviceClocks[i].kHz;
+#if defined(I2C_EXTENDED_ADDRESS)
+      // The mux is in the path too, and most are only rated to 400kHz.
+      if (address.muxNumber() != I2CMux_None && kHz > 400) kHz = 400;
+#endif
+      return kHz;
+    }
+  }
+  return 0;
 }
 
 /***************************************************************************
@@ -113,22 +153,49 @@ void I2CManagerClass::startTransaction() {
     if ((state == I2C_STATE_FREE) && (queueHead != NULL)) {
       state = I2C_STATE_ACTIVE;
       completionStatus = I2C_STATUS_OK;
-      // Check for pending clock speed change
-      if (pendingClockSpeed) {
-        // We're about to start a new I2C transaction, so set clock now.
-        I2C_setClock(pendingClockSpeed);
-        pendingClockSpeed = 0;
+      // Switch the clock if this request is for a device of another speed.
+      // We're about to start a new I2C transaction, so set clock now.
+      uint32_t speed = queueHead->clockKHz ? queueHead->clockKHz * 1000UL : defaultClockSpeed;
+      if (speed != busClockSpeed) {
+        I2C_setClock(speed);
+        busClockSpeed = speed;
       }
       startTime = micros();
       currentRequest = queueHead;
       rxCount = txCount = 0;
+#if defined(I2C_STATS)
+      if (retryCounter == 0) currentRequest->startedAt = startTime;
+#endif
 
       // Start the I2C process going.
+      startRequestPhase();
+    }
+  }
+}
+
+/***************************************************************************
+ * Start the next phase of the current request.  The subbus selected on a
+ * mux is remembered and left enabled after the request, so a run of
+ * requests to devices on the same subbus needs only one mux write.  When
+ * there are several muxes, the enabled one is turned off before another
+ * mux or a device on the main bus is accessed.
+ ***************************************************************************/
+void I2CManagerClass::startRequestPhase() {
 #if defined(I2C_EXTENDED_ADDRESS)
       I2CMux muxNumber = currentRequest->i2cAddress.muxNumber();
-      if (muxNumber != I2CMux_None) {
+      uint8_t subBus = currentRequest->i2cAddress.subBus();
+      if (_muxCount > 1 && selectedMux != I2CMux_None && selectedMux != muxNumber) {
+        // Another mux has a subbus enabled, so deselect it first
+        muxPhase = MuxPhase_DESELECT;
+        muxData[0] = 0x00;
+        deviceAddress = I2C_MUX_BASE_ADDRESS + selectedMux;
+        sendBuffer = &muxData[0];
+        bytesToSend = 1;
+        bytesToReceive = 0;
+        operation = OPERATION_SEND;
+      } else if (muxNumber != I2CMux_None && (selectedMux != muxNumber || selectedSubBus != subBus
+          || currentRequest->i2cAddress.deviceAddress() == 0)) {
         muxPhase = MuxPhase_PROLOG;
-        uint8_t subBus = currentRequest->i2cAddress.subBus();
         muxData[0] = (subBus == SubBus_All) ? 0xff :
                      (subBus == SubBus_None) ? 0x00 :
 #if defined(I2CMUX_PCA9547)
@@ -146,8 +213,8 @@ void I2CManagerClass::startTransaction() {
         bytesToReceive = 0;
         operation = OPERATION_SEND;
       } else {
-        // Send/receive payload for device only.
-        muxPhase = MuxPhase_OFF;
+        // Send/receive payload for device only, any mux is already set up.
+        muxPhase = (muxNumber == I2CMux_None) ? MuxPhase_OFF : MuxPhase_PAYLOAD;
         deviceAddress = currentRequest->i2cAddress;
         sendBuffer = currentRequest->writeBuffer;
         bytesToSend = currentRequest->writeLen;
@@ -164,8 +231,6 @@ void I2CManagerClass::startTransaction() {
       operation = currentRequest->operation & OPERATION_MASK;
 #endif
       I2C_sendStart();
-    }
-  }
 }
 
 /***************************************************************************
@@ -178,10 +243,28 @@ void I2CManagerClass::queueRequest(I2CRB *req) {
 
   req->status = I2C_STATUS_PENDING;
   req->nextRequest = NULL;
+  req->clockKHz = deviceClockKHz(req->i2cAddress);
+#if defined(I2C_EXTENDED_ADDRESS)
+  req->bypassCount = 0;
+#endif
+#if defined(I2C_STATS)
+  req->queuedAt = micros();
+#endif
+#if defined(HAL_BENCHMARK)
+  switch (req->operation & OPERATION_MASK) {
+    case OPERATION_READ: bytesRequested += req->readLen; break;
+    case OPERATION_REQUEST: bytesRequested += req->readLen;  // fall through
+    default: bytesRequested += req->writeLen; break;
+  }
+#endif
   ATOMIC_BLOCK() {
     if (!queueTail) 
       queueHead = queueTail = req;  // Only item on queue
+#if defined(I2C_EXTENDED_ADDRESS)
+    else if (!queueBySubBus(req))
+#else
     else
+#endif
       queueTail = queueTail->nextRequest = req; // Add to end
     startTransaction();
   }
@@ -189,6 +272,47 @@ void I2CManagerClass::queueRequest(I2CRB *req) {
 }
 
 
+#if defined(I2C_EXTENDED_ADDRESS)
+/***************************************************************************
+ *  When devices are spread over several mux subbuses, place a new request
+ *  directly after the last queued request for the same subbus, so that
+ *  the mux is switched once for the group rather than for every request.
+ *  Requests to a device stay in order as they share a subbus.  Requests
+ *  may only be overtaken I2C_MAX_BYPASS times, and never overtake a
+ *  mux-only request or the request at the head of the queue (which may
+ *  be in progress).  Returns false if the request is to go on the end.
+ *  Called with interrupts disabled.
+ ***************************************************************************/
+bool I2CManagerClass::queueBySubBus(I2CRB *req) {
+  I2CMux muxNumber = req->i2cAddress.muxNumber();
+  I2CSubBus subBus = req->i2cAddress.subBus();
+  if (_muxCount == 0 || muxNumber == I2CMux_None || req->i2cAddress.deviceAddress() == 0)
+    return false;
+  if (queueTail->i2cAddress.muxNumber() == muxNumber && queueTail->i2cAddress.subBus() == subBus)
+    return false;  // Already grouped
+
+  // Find the last request on the same subbus that can be overtaken to.
+  I2CRB *insertAfter = NULL;
+  for (I2CRB *r = queueHead; r != NULL; r = r->nextRequest) {
+    if (r->i2cAddress.muxNumber() == muxNumber && r->i2cAddress.subBus() == subBus
+        && r->i2cAddress.deviceAddress() != 0)
+      insertAfter = r;
+    else if (r == queueHead)
+      continue;
+    else if (r->bypassCount >= I2C_MAX_BYPASS || r->i2cAddress.deviceAddress() == 0)
+      insertAfter = NULL;   // Can't overtake this one
+  }
+  if (!insertAfter) return false;
+
+  for (I2CRB *r = insertAfter->nextRequest; r != NULL; r = r->nextRequest)
+    r->bypassCount++;
+  req->nextRequest = insertAfter->nextRequest;
+  insertAfter->nextRequest = req;
+  _muxSwitchesSaved++;
+  return true;
+}
+#endif
+
 /***************************************************************************
  *  Initiate a write to an I2C device (non-blocking operation)
  ***************************************************************************/
@@ -255,8 +379,15 @@ void I2CManagerClass::checkForTimeout() {
         if (!queueHead) queueTail = NULL;
         currentRequest = NULL;
         bytesToReceive = bytesToSend = 0;
+#if defined(I2C_EXTENDED_ADDRESS)
+        if (selectedMux != I2CMux_None) selectedSubBus = SUBBUS_UNKNOWN;  // set it again next time
+#endif
         // Post request as timed out.
         t->status = I2C_STATUS_TIMEOUT;
+#if defined(I2C_STATS)
+        recordStats(t->i2cAddress, t->writeLen, I2C_STATUS_TIMEOUT, retryCounter,
+          t->startedAt - t->queuedAt, micros() - t->startedAt);
+#endif
         // Reset TWI interface so it is able to continue
         // Try close and init, not entirely satisfactory but sort of works...
         I2C_close();  // Shutdown and restart twi interface
@@ -312,8 +443,26 @@ void I2CManagerClass::handleInterrupt() {
     {
       // Status is OK, or has failed and retry count exceeded, or failed and retries disabled.
 #if defined(I2C_EXTENDED_ADDRESS)
+      if (muxPhase == MuxPhase_DESELECT) {
+        // Other mux now off (or not answering), carry on with the request
+        selectedMux = I2CMux_None;
+        retryCounter = 0;
+        state = I2C_STATE_ACTIVE;
+        startRequestPhase();
+        return;
+      }
       if (muxPhase == MuxPhase_PROLOG ) {
         overallStatus = completionStatus;
+        uint8_t subBus = currentRequest->i2cAddress.subBus();
+        if (completionStatus != I2C_STATUS_OK) {
+          selectedMux = currentRequest->i2cAddress.muxNumber();
+          selectedSubBus = SUBBUS_UNKNOWN;
+        } else if (subBus == SubBus_None) {
+          selectedMux = I2CMux_None;
+        } else {
+          selectedMux = currentRequest->i2cAddress.muxNumber();
+          selectedSubBus = subBus;
+        }
         uint8_t rbAddress = currentRequest->i2cAddress.deviceAddress();
         if (completionStatus == I2C_STATUS_OK && rbAddress != 0) {
           // Mux request OK, start handling application request.
@@ -329,29 +478,15 @@ void I2CManagerClass::handleInterrupt() {
           return;
         } 
       } else if (muxPhase == MuxPhase_PAYLOAD) {
-        // Application request completed, now send epilogue to mux
+        // Application request completed.  The subbus is left selected
+        // for the next request, see startRequestPhase().
         overallStatus = completionStatus;
         currentRequest->nBytes = rxCount;  // Save number of bytes read into rb
-        if (_muxCount == 1) {
-          // Only one MUX, don't need to deselect subbus
-          muxPhase = MuxPhase_OFF;
-        } else {
-          muxPhase = MuxPhase_EPILOG;
-          deviceAddress = I2C_MUX_BASE_ADDRESS + currentRequest->i2cAddress.muxNumber();
-          muxData[0] = 0x00;
-          sendBuffer = &muxData[0];
-          bytesToSend = 1;
-          bytesToReceive = 0;
-          operation = OPERATION_SEND;
-          state = I2C_STATE_ACTIVE;
-          I2C_sendStart();
-          return;
-        }
-      } else if (muxPhase == MuxPhase_EPILOG) {
-        // Epilog finished, ignore completionStatus
         muxPhase = MuxPhase_OFF;
-      } else
+      } else {
         overallStatus = completionStatus;
+        currentRequest->nBytes = rxCount;
+      }
 #else
       overallStatus = completionStatus;
       currentRequest->nBytes = rxCount;
@@ -363,6 +498,12 @@ void I2CManagerClass::handleInterrupt() {
         queueHead = t->nextRequest;
         if (!queueHead) queueTail = queueHead;
         t->status = overallStatus;
+#if defined(I2C_STATS)
+        // A failed request has had its retry counter stepped past the last retry.
+        recordStats(t->i2cAddress, t->writeLen + t->nBytes, overallStatus, 
+          retryCounter - (overallStatus != I2C_STATUS_OK), 
+          t->startedAt - t->queuedAt, micros() - t->startedAt);
+#endif
         
         // I2C state machine is now free for next request
         currentRequest = NULL;
@@ -371,7 +512,10 @@ void I2CManagerClass::handleInterrupt() {
       retryCounter = 0;
     } else {
       // Status is failed and retry permitted.
-      // Retry previous request.
+      // Retry previous request, selecting the subbus again.
+#if defined(I2C_EXTENDED_ADDRESS)
+      if (selectedMux != I2CMux_None) selectedSubBus = SUBBUS_UNKNOWN;
+#endif
       state = I2C_STATE_FREE;  
     }
   }
@@ -56,6 +56,13 @@ extern "C" void I2C1_EV_IRQHandler(void) {
 extern "C" void I2C1_ER_IRQHandler(void) {
   I2CManager.handleInterrupt();
 }
+#if defined(I2C_USE_DMA)
+// Receive DMA completion is signalled from the DMA stream, not the I2C1
+// peripheral, so it also runs the state machine.
+extern "C" void DMA1_Stream0_IRQHandler(void) {
+  I2CManager.handleInterrupt();
+}
+#endif
 #else
 #warning STM32 board selected is not yet supported - so I2C1 peripheral is not defined
 #endif
@@ -99,7 +106,43 @@ extern "C" void I2C1_ER_IRQHandler(void) {
 // #define I2C_CR1_PE        (1<<0)    // I2C Peripheral enable
 
 // States of the STM32 I2C driver state machine
-enum {TS_IDLE,TS_START,TS_W_ADDR,TS_W_DATA,TS_W_STOP,TS_R_ADDR,TS_R_DATA,TS_R_STOP};
+enum {TS_IDLE,TS_START,TS_W_ADDR,TS_W_DATA,TS_W_STOP,TS_R_ADDR,TS_R_DATA,TS_R_STOP,TS_R_DMA};
+
+#if defined(I2C_USE_DMA)
+// I2C1 requests are on DMA1 channel 1: RX on stream 0, TX on stream 6.
+DMA_Stream_TypeDef *dmaRx = DMA1_Stream0;
+DMA_Stream_TypeDef *dmaTx = DMA1_Stream6;
+#define DMA_RX_FLAGS (DMA_LIFCR_CTCIF0 | DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTEIF0 | DMA_LIFCR_CDMEIF0 | DMA_LIFCR_CFEIF0)
+#define DMA_TX_FLAGS (DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6 | DMA_HIFCR_CDMEIF6 | DMA_HIFCR_CFEIF6)
+
+/***************************************************************************
+ *  Start a DMA stream moving 'count' bytes between buffer and the I2C data 
+ *  register.  'dir' is DMA_SxCR_DIR_0 for transmit or 0 for receive.
+ ***************************************************************************/
+static void I2C_startDMA(DMA_Stream_TypeDef *stream, const uint8_t *buffer, uint8_t count, uint32_t dir) {
+  stream->CR &= ~DMA_SxCR_EN;
+  while (stream->CR & DMA_SxCR_EN) {}  // Stream must be off before reprogramming
+  DMA1->LIFCR = DMA_RX_FLAGS;
+  DMA1->HIFCR = DMA_TX_FLAGS;
+  stream->PAR = (uint32_t)&s->DR;
+  stream->M0AR = (uint32_t)buffer;
+  stream->NDTR = count;
+  stream->FCR = 0;   // Direct mode, no FIFO
+  stream->CR = (1 << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MINC | dir
+    | (dir ? 0 : DMA_SxCR_TCIE) | DMA_SxCR_EN;
+}
+
+/***************************************************************************
+ *  Stop any DMA transfer and return the I2C peripheral to byte mode.
+ ***************************************************************************/
+static void I2C_stopDMA() {
+  s->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+  dmaRx->CR &= ~DMA_SxCR_EN;
+  dmaTx->CR &= ~DMA_SxCR_EN;
+  DMA1->LIFCR = DMA_RX_FLAGS;
+  DMA1->HIFCR = DMA_TX_FLAGS;
+}
+#endif
 
 
 /***************************************************************************
@@ -228,6 +271,15 @@ void I2CManagerClass::I2C_init()
   s->CR2 |= (I2C_CR2_ITBUFEN | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);   // Enable Buffer, Event and Error interrupts
 #endif
 
+#if defined(I2C_USE_DMA)
+  RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;  // Enable DMA1 CLOCK
+  I2C_stopDMA();
+#if defined(I2C_USE_INTERRUPTS)
+  NVIC_SetPriority(DMA1_Stream0_IRQn, 1);  // Same priority as I2C1 events
+  NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+#endif
+#endif
+
   // DIAG(F("I2C_init() setting initial I2C clock to 100KHz"));
   // Calculate baudrate and set default rate for now
   // Configure the Clock Control Register for 100KHz SCL frequency
@@ -296,6 +348,10 @@ void I2CManagerClass::I2C_close() {
   }
   NVIC_DisableIRQ(I2C1_EV_IRQn);
   NVIC_DisableIRQ(I2C1_ER_IRQn);
+#if defined(I2C_USE_DMA)
+  I2C_stopDMA();
+  NVIC_DisableIRQ(DMA1_Stream0_IRQn);
+#endif
 }
 
 /***************************************************************************
@@ -308,8 +364,26 @@ void I2CManagerClass::I2C_handleInterrupt() {
 
   temp_sr1 = s->SR1;
 
+#if defined(I2C_USE_DMA)
+  if (transactionState == TS_R_DMA && (DMA1->LISR & DMA_LISR_TCIF0)) {
+    // DMA has stored the last byte, the I2C has already NAK'd it
+    // because of the LAST flag.  Just send the stop.
+    I2C_sendStop();
+    I2C_stopDMA();
+    rxCount += bytesToReceive;
+    bytesToReceive = 0;
+    transactionState = TS_IDLE;
+    completionStatus = I2C_STATUS_OK;
+    state = I2C_STATE_COMPLETED;
+    return;
+  }
+#endif
+
   // Check for errors first
   if (temp_sr1 & (I2C_SR1_AF | I2C_SR1_ARLO | I2C_SR1_BERR)) {
+#if defined(I2C_USE_DMA)
+    I2C_stopDMA();
+#endif
     // Check which error flag is set
     if (temp_sr1 & I2C_SR1_AF)
     {
@@ -367,6 +441,17 @@ void I2CManagerClass::I2C_handleInterrupt() {
             transactionState = TS_IDLE;
             completionStatus = I2C_STATUS_OK;
             state = I2C_STATE_COMPLETED;
+#if defined(I2C_USE_DMA)
+          } else if (bytesToSend >= I2C_DMA_MIN_BYTES) {
+            // DMA loads DR on each TXE; the next interrupt is the BTF
+            // after the last byte has gone.
+            s->CR2 &= ~I2C_CR2_ITBUFEN;
+            I2C_startDMA(dmaTx, sendBuffer+txCount, bytesToSend, DMA_SxCR_DIR_0);
+            s->CR2 |= I2C_CR2_DMAEN;
+            txCount += bytesToSend;
+            bytesToSend = 0;
+            transactionState = TS_W_STOP;
+#endif
           } else {
             // Put one byte into DR to load shift register.
             s->DR = sendBuffer[txCount++];
@@ -409,6 +494,10 @@ void I2CManagerClass::I2C_handleInterrupt() {
 
       case TS_W_STOP:
         if (temp_sr1 & I2C_SR1_BTF) {
+#if defined(I2C_USE_DMA)
+          if (dmaTx->NDTR) break;  // BTF during DMA transmit, not finished yet
+          I2C_stopDMA();
+#endif
           // Event EV8_2
           // Done, last character sent. Anything to receive?
           if (bytesToReceive) {
@@ -437,6 +526,17 @@ void I2CManagerClass::I2C_handleInterrupt() {
           // The next bit is different depending on whether there are 
           // 1 byte, 2 bytes or >2 bytes to be received, in accordance with the
           // Programmers Reference RM0390.
+#if defined(I2C_USE_DMA)
+          if (bytesToReceive >= 2 && bytesToReceive >= I2C_DMA_MIN_BYTES) {
+            // DMA stores each byte, LAST makes the I2C NAK the final one.
+            // Both must be set up before ADDR is cleared.
+            s->CR2 &= ~I2C_CR2_ITBUFEN;
+            I2C_startDMA(dmaRx, receiveBuffer+rxCount, bytesToReceive, 0);
+            s->CR2 |= (I2C_CR2_DMAEN | I2C_CR2_LAST);
+            temp_sr2 = s->SR2; // read SR2 to complete clearing the ADDR bit
+            transactionState = TS_R_DMA;
+          } else
+#endif
           if (bytesToReceive == 1) {
             // Receive 1 byte
             s->CR1 &= ~I2C_CR1_ACK;  // Disable ack
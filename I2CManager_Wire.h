@@ -53,6 +53,13 @@ void I2CManagerClass::_setClock(unsigned long i2cClockSpeed) {
   Wire.setClock(i2cClockSpeed);
 }
 
+// Wire runs the whole bus at one speed, so a device speed is just 
+//  another request for the lowest one.
+void I2CManagerClass::setClock(I2CAddress address, uint32_t speed) {
+  (void)address;
+  setClock(speed);
+}
+
 /***************************************************************************
  *  Set I2C timeout value in microseconds.  The timeout applies to each
  *   Wire call separately, i.e. in a write+read, the timer is reset before the
@@ -100,6 +107,9 @@ static uint8_t muxSelect(I2CAddress address) {
 uint8_t I2CManagerClass::write(I2CAddress address, const uint8_t buffer[], uint8_t size, I2CRB *rb) {
   uint8_t status, muxStatus;
   uint8_t retryCount = 0;
+#if defined(I2C_STATS)
+  uint32_t startTime = micros();
+#endif
   // If request fails, retry up to the defined limit, unless the NORETRY flag is set
   // in the request block.
   do {
@@ -125,6 +135,12 @@ uint8_t I2CManagerClass::write(I2CAddress address, const uint8_t buffer[], uint8
   } while (!(status == I2C_STATUS_OK
     || ++retryCount > MAX_I2C_RETRIES || rb->operation & OPERATION_NORETRY));
   rb->status = status;
+#if defined(HAL_BENCHMARK)
+  bytesRequested += size;
+#endif
+#if defined(I2C_STATS)
+  recordStats(address, size, status, retryCount - (status != I2C_STATUS_OK), 0, micros() - startTime);
+#endif
   return I2C_STATUS_OK;
 }
 
@@ -149,6 +165,9 @@ uint8_t I2CManagerClass::read(I2CAddress address, uint8_t readBuffer[], uint8_t
   uint8_t status, muxStatus;
   uint8_t nBytes = 0;
   uint8_t retryCount = 0;
+#if defined(I2C_STATS)
+  uint32_t startTime = micros();
+#endif
   // If request fails, retry up to the defined limit, unless the NORETRY flag is set
   // in the request block.
   do {
@@ -197,6 +216,13 @@ uint8_t I2CManagerClass::read(I2CAddress address, uint8_t readBuffer[], uint8_t
 
   rb->nBytes = nBytes;
   rb->status = status;
+#if defined(HAL_BENCHMARK)
+  bytesRequested += writeSize + readSize;
+#endif
+#if defined(I2C_STATS)
+  recordStats(address, writeSize + nBytes, status, retryCount - (status != I2C_STATUS_OK), 
+    0, micros() - startTime);
+#endif
   return I2C_STATUS_OK;
 }
 
@@ -35,6 +35,18 @@
 extern __attribute__((weak)) void halSetup();
 extern __attribute__((weak)) bool exrailHalSetup();
 
+// With HAL_BENCHMARK, BENCH_START() and BENCH_END() bracket a call into a
+// device, charging its duration and I2C bytes to the device's statistics.
+#if defined(HAL_BENCHMARK)
+#define BENCH_START() unsigned long benchStart = micros(); \
+  uint32_t benchBytes = I2CManager.bytesRequested
+#define BENCH_END(dev, op) dev->benchRecord(IODevice::op, micros() - benchStart, \
+  I2CManager.bytesRequested - benchBytes)
+#else
+#define BENCH_START()
+#define BENCH_END(dev, op)
+#endif
+
 //==================================================================================================================
 // Static methods
 //------------------------------------------------------------------------------------------------------------------
@@ -99,8 +111,12 @@ void IODevice::reset() {
   }
 }
 
-// Overarching static loop() method for the IODevice subsystem.  Works through the
-// list of installed devices and calls their individual _loop() method.
+// Overarching static loop() method for the IODevice subsystem.  Calls the
+// _loop() method of the device that has been waiting longest since its 
+// _nextEntryTime, using a heap ordered by _nextEntryTime so that 
+// devices with long intervals cost nothing until they are due.
+// With IO_LOOP_MICROS defined, all due devices are serviced until that many
+// microseconds have been used, otherwise one device is serviced per call.
 // Devices may or may not implement this, but if they do it is useful for things like animations 
 // or flashing LEDs.
 // The current value of micros() is passed as a parameter, so the called loop function
@@ -108,23 +124,32 @@ void IODevice::reset() {
 void IODevice::loop() {
   unsigned long currentMicros = micros();
   
-  IODevice *lastLoopDevice = _nextLoopDevice;  // So we know when to stop...
-  // Loop through devices until we find one ready to be serviced.
-  do {
-    if (!_nextLoopDevice) _nextLoopDevice = _firstDevice;
-    if (_nextLoopDevice) {
-      if (_nextLoopDevice->_deviceState != DEVSTATE_FAILED 
-            && ((long)(currentMicros - _nextLoopDevice->_nextEntryTime)) >= 0) {
-        // Found one ready to run, so invoke its _loop method.
-        _nextLoopDevice->_nextEntryTime = currentMicros;
-        _nextLoopDevice->_loop(currentMicros);
-        _nextLoopDevice = _nextLoopDevice->_nextDevice;
-        break;
-      }
-      // Not this one, move to next one
-      _nextLoopDevice = _nextLoopDevice->_nextDevice;
+  if (!_loopHeapValid) buildLoopHeap();
+  if (!_loopHeap) loopChain(currentMicros);  // no memory for the heap
+  else for (uint16_t serviced = 0; _loopHeapSize > 0 && serviced < _loopHeapSize; ) {
+    IODevice *dev = _loopHeap[0];
+    if ((long)(currentMicros - dev->_nextEntryTime) < 0) break;  // nothing due yet
+    if (dev->_deviceState == DEVSTATE_FAILED) {
+      // Not serviced, but look again later in case it is reset
+      dev->_nextEntryTime = currentMicros + 100000UL;
+    } else {
+      // Found one ready to run, so invoke its _loop method.
+      dev->_nextEntryTime = currentMicros;
+      _loopingDevice = dev;
+      BENCH_START();
+      dev->_loop(currentMicros);
+      BENCH_END(dev, BENCH_LOOP);
+      _loopingDevice = NULL;
+      serviced++;
     }
-  } while (_nextLoopDevice != lastLoopDevice); // Stop looking when we've done all.
+    if (_loopHeapValid) siftDown(0);
+    else buildLoopHeap();  // devices added or rescheduled by someone else
+#if defined(IO_LOOP_MICROS)
+    if (serviced > 0 && micros() - currentMicros >= IO_LOOP_MICROS) break;
+#else
+    if (serviced > 0) break;
+#endif
+  }
   
   // Report loop time if diags enabled
 #if defined(DIAG_LOOPTIMES)
@@ -166,7 +191,31 @@ void IODevice::DumpAll() {
   for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
     dev->_display();
   }
+#if defined(I2C_EXTENDED_ADDRESS) && !defined(I2C_USE_WIRE)
+  if (I2CManager.getMuxCount() > 0)
+    DIAG(F("I2C Mux switches saved:%L"), I2CManager.getMuxSwitchesSaved());
+#endif
+}
+
+#if defined(HAL_BENCHMARK)
+// List each device followed by the mean and worst case time of each kind of 
+// call made to it, and the mean number of I2C bytes that call requested.
+void IODevice::showBenchmark(bool reset) {
+  static const char names[] PROGMEM = "loop\0read\0write\0analogue\0";
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
+    dev->_display();
+    const char *name = names;
+    for (uint8_t op = 0; op < BENCH_OPS; op++) {
+      BenchStats &b = dev->_bench[op];
+      if (b.count)
+        DIAG(F("  %S calls %L mean %lus max %lus I2C bytes/call %L"), (const FSH *)name, 
+          b.count, b.totalMicros / b.count, b.maxMicros, b.i2cBytes / b.count);
+      name += strlen_P(name) + 1;
+    }
+    if (reset) memset(dev->_bench, 0, sizeof(dev->_bench));
+  }
 }
+#endif
 
 // Determine if the specified vpin is allocated to a device.
 bool IODevice::exists(VPIN vpin) {
@@ -206,9 +255,12 @@ bool IODevice::configure(VPIN vpin, ConfigTypeEnum configType, int paramCount, i
 
 // Read value from virtual pin.
 int IODevice::read(VPIN vpin) {
-  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
-    if (dev->owns(vpin)) 
-      return dev->_read(vpin);
+  IODevice *dev = findDevice(vpin);
+  if (dev) {
+    BENCH_START();
+    int value = dev->_read(vpin);
+    BENCH_END(dev, BENCH_READ);
+    return value;
   }
 #ifdef DIAG_IO
   DIAG(F("IODevice::read(): VPIN %u not found!"), (int)vpin);
@@ -216,11 +268,41 @@ int IODevice::read(VPIN vpin) {
   return false;
 }
 
+// Read digital values from a range of virtual pins, which may be spread
+// over several devices, as a bit mask.
+uint32_t IODevice::readRange(VPIN vpin, uint8_t count) {
+  if (count > 32) count = 32;
+  uint32_t result = 0;
+  uint8_t bit = 0;
+  while (bit < count) {
+    auto dev = findDevice(vpin);
+    if (dev) {
+      uint32_t bits = 0;
+      // read from driver, driver will return next vpin it cant handle
+      BENCH_START();
+      VPIN next = dev->_readRange(vpin, count - bit, bits);
+      BENCH_END(dev, BENCH_READ);
+      result |= bits << bit;
+      bit += next - vpin;
+      vpin = next;
+    }
+    else {
+      // skip a vpin if no device handler
+      vpin++;
+      bit++;
+    }
+  }
+  return result;
+}
+
 // Read analogue value from virtual pin.
 int IODevice::readAnalogue(VPIN vpin) {
-  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
-    if (dev->owns(vpin)) 
-      return dev->_readAnalogue(vpin);
+  IODevice *dev = findDevice(vpin);
+  if (dev) {
+    BENCH_START();
+    int value = dev->_readAnalogue(vpin);
+    BENCH_END(dev, BENCH_READ);
+    return value;
   }
 #ifdef DIAG_IO
   DIAG(F("IODevice::readAnalogue(): VPIN %u not found!"), (int)vpin);
@@ -228,10 +310,8 @@ int IODevice::readAnalogue(VPIN vpin) {
   return -1023;
 }
 int IODevice::configureAnalogIn(VPIN vpin) {
-  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
-    if (dev->owns(vpin)) 
-      return dev->_configureAnalogIn(vpin);
-  }
+  IODevice *dev = findDevice(vpin);
+  if (dev) return dev->_configureAnalogIn(vpin);
 #ifdef DIAG_IO
   DIAG(F("IODevice::configureAnalogIn(): VPIN %u not found!"), (int)vpin);
 #endif
@@ -243,7 +323,9 @@ int IODevice::configureAnalogIn(VPIN vpin) {
 void IODevice::write(VPIN vpin, int value) {
   IODevice *dev = findDevice(vpin);
   if (dev) {
+    BENCH_START();
     dev->_write(vpin, value);
+    BENCH_END(dev, BENCH_WRITE);
     return;
   }
 #ifdef DIAG_IO
@@ -251,6 +333,17 @@ void IODevice::write(VPIN vpin, int value) {
 #endif
 }
 
+void IODevice::beginWriteBatch() {
+  if (_writeBatching < 255) _writeBatching++;
+}
+
+void IODevice::endWriteBatch() {
+  if (_writeBatching == 0) return;  // no batch open
+  if (--_writeBatching) return;     // an outer batch is still open
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice)
+    dev->_flushWrites();
+}
+
 // Write value to count virtual pin(s).
 // these may be within one driver or separated over several drivers 
 void IODevice::writeRange(VPIN vpin, int value, int count) {  
@@ -260,7 +353,9 @@ void IODevice::writeRange(VPIN vpin, int value, int count) {
     if (dev) {
       auto vpinBefore=vpin; 
       // write to driver, driver will return next vpin it cant handle
+      BENCH_START();
       vpin=dev->_writeRange(vpin, value,count);
+      BENCH_END(dev, BENCH_WRITE);
       count-= vpin-vpinBefore;  // decrement by number of vpins changed
     }
     else {
@@ -282,7 +377,9 @@ void IODevice::writeRange(VPIN vpin, int value, int count) {
 void IODevice::writeAnalogue(VPIN vpin, int value, uint8_t param1, uint16_t param2) {
   IODevice *dev = findDevice(vpin);
   if (dev) {
+    BENCH_START();
     dev->_writeAnalogue(vpin, value, param1, param2);
+    BENCH_END(dev, BENCH_ANALOGUE);
     return;
   }
 #ifdef DIAG_IO
@@ -297,7 +394,9 @@ void IODevice::writeAnalogueRange(VPIN vpin, int value, uint8_t param1, uint16_t
     if (dev) {
       auto vpinBefore=vpin; 
       // write to driver, driver will return next vpin it cant handle
+      BENCH_START();
       vpin=dev->_writeAnalogueRange(vpin, value, param1, param2,count);
+      BENCH_END(dev, BENCH_ANALOGUE);
       count-= vpin-vpinBefore;  // decrement by number of vpins changed
     }
     else {
@@ -325,6 +424,22 @@ void IODevice::setGPIOInterruptPin(int16_t pinNumber) {
   _gpioInterruptPin = pinNumber;
 }
 
+bool IODevice::gpioScanDue(unsigned long currentMicros, unsigned long lastScanMicros) {
+  if (_gpioInterruptPin < 0) return true;
+  bool active = !digitalRead(_gpioInterruptPin);
+  if (active && !_gpioInterruptActive) {
+    // First to see the interrupt, so wake the rest of the group.
+    for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
+      if (dev != this && dev->_gpioInterruptPin == _gpioInterruptPin) {
+        dev->_gpioInterruptActive = true;
+        dev->delayUntil(currentMicros);
+      }
+    }
+  }
+  _gpioInterruptActive = active;
+  return active || (currentMicros - lastScanMicros >= GPIO_INTERRUPT_REFRESH);
+}
+
 // Helper function to add a new device to the device chain.  If 
 // slaveDevice is NULL then the device is added to the end of the chain.
 // Otherwise, the chain is searched for slaveDevice and the new device linked
@@ -345,12 +460,83 @@ void IODevice::addDevice(IODevice *newDevice, IODevice *slaveDevice /* = NULL */
       }
     }
   }
+  _vpinIndexValid = false;
+  _loopHeapValid = false;
   newDevice->_begin();
 }
 
+// Service the next due device round the chain, as loop() did before the
+// heap, for when the heap could not be allocated.
+void IODevice::loopChain(unsigned long currentMicros) {
+  IODevice *lastLoopDevice = _nextLoopDevice;  // So we know when to stop...
+  // Loop through devices until we find one ready to be serviced.
+  do {
+    if (!_nextLoopDevice) _nextLoopDevice = _firstDevice;
+    if (!_nextLoopDevice) return;
+    IODevice *dev = _nextLoopDevice;
+    _nextLoopDevice = dev->_nextDevice;
+    if (dev->_deviceState != DEVSTATE_FAILED 
+          && ((long)(currentMicros - dev->_nextEntryTime)) >= 0) {
+      // Found one ready to run, so invoke its _loop method.
+      dev->_nextEntryTime = currentMicros;
+      BENCH_START();
+      dev->_loop(currentMicros);
+      BENCH_END(dev, BENCH_LOOP);
+      return;
+    }
+  } while (_nextLoopDevice != lastLoopDevice); // Stop looking when we've done all.
+}
+
+// Build the loop heap from the device chain.  If there is no memory for
+// it, it is left invalid to be tried again and loop() walks the chain.
+void IODevice::buildLoopHeap() {
+  uint16_t count = 0;
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) count++;
+  if (count != _loopHeapSize || !_loopHeap) {
+    free(_loopHeap);
+    _loopHeap = (IODevice **)malloc((count ? count : 1) * sizeof(IODevice *));
+    _loopHeapSize = _loopHeap ? count : 0;
+  }
+  if (!_loopHeap) return;
+  _loopHeapValid = true;
+  count = 0;
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) 
+    _loopHeap[count++] = dev;
+  for (uint16_t i = count / 2; i-- > 0; ) siftDown(i);
+}
+
+// Move the device at position down the heap until neither child is due
+// before it.  Times are compared by difference to allow for micros() wrap.
+void IODevice::siftDown(uint16_t position) {
+  IODevice *dev = _loopHeap[position];
+  for (;;) {
+    uint16_t child = 2 * position + 1;
+    if (child >= _loopHeapSize) break;
+    if (child + 1 < _loopHeapSize && 
+        (long)(_loopHeap[child+1]->_nextEntryTime - _loopHeap[child]->_nextEntryTime) < 0) 
+      child++;
+    if ((long)(_loopHeap[child]->_nextEntryTime - dev->_nextEntryTime) >= 0) break;
+    _loopHeap[position] = _loopHeap[child];
+    position = child;
+  }
+  _loopHeap[position] = dev;
+}
+
 // Private helper function to locate a device by VPIN.  Returns NULL if not found.
-//  This is performance-critical, so minimises the calculation and function calls necessary.
+//  This is performance-critical, so uses a binary search of the vpin index.
 IODevice *IODevice::findDevice(VPIN vpin) { 
+  if (!_vpinIndexValid) buildVpinIndex();
+  if (_vpinIndex) {
+    if (_vpinIndexSize == 0 || vpin < _vpinIndex[0].firstVpin) return NULL;
+    uint16_t low = 0, high = _vpinIndexSize;  // find last range starting at or before vpin
+    while (high - low > 1) {
+      uint16_t mid = (low + high) / 2;
+      if (_vpinIndex[mid].firstVpin <= vpin) low = mid;
+      else high = mid;
+    }
+    return _vpinIndex[low].dev;
+  }
+  // No memory for the index so search the chain.
   for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
     VPIN firstVpin = dev->_firstVpin;
     if (vpin >= firstVpin && vpin < firstVpin+dev->_nPins)
@@ -359,6 +545,88 @@ IODevice *IODevice::findDevice(VPIN vpin) {
   return NULL;
 }
 
+// Build the vpin index from the device chain.  Each device range contributes
+// its start and end as boundaries, and the vpins between consecutive boundaries
+// belong to the first device in the chain that owns the lower one, so filter
+// devices still take precedence over the devices they are layered on.
+void IODevice::buildVpinIndex() {
+  _vpinIndexValid = true;
+  free(_vpinIndex);
+  _vpinIndex = NULL;
+  _vpinIndexSize = 0;
+
+  uint16_t maxRanges = 0;
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice)
+    if (dev->_nPins > 0) maxRanges += 2;
+  if (maxRanges == 0) {
+    _vpinIndex = (VpinRange *)malloc(sizeof(VpinRange));  // empty but valid
+    return;
+  }
+  VpinRange *index = (VpinRange *)malloc(maxRanges * sizeof(VpinRange));
+  if (!index) return;
+
+  // Collect boundaries in ascending order without duplicates
+  uint16_t count = 0;
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
+    if (dev->_nPins <= 0) continue;
+    uint32_t bounds[2] = {dev->_firstVpin, (uint32_t)dev->_firstVpin + dev->_nPins};
+    for (uint8_t b = 0; b < 2; b++) {
+      if (bounds[b] > 0xFFFF) continue;  // range runs to the last vpin
+      VPIN bound = bounds[b];
+      uint16_t i = count;
+      while (i > 0 && index[i-1].firstVpin > bound) {
+        index[i] = index[i-1];
+        i--;
+      }
+      if (i > 0 && index[i-1].firstVpin == bound) {  // already there, undo the shift
+        for (; i < count; i++) index[i] = index[i+1];
+        continue;
+      }
+      index[i].firstVpin = bound;
+      count++;
+    }
+  }
+
+  // Give each range its device, and merge neighbours with the same device
+  uint16_t ranges = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    VPIN vpin = index[i].firstVpin;
+    IODevice *owner = NULL;
+    for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
+      if (vpin >= dev->_firstVpin && (uint32_t)vpin < (uint32_t)dev->_firstVpin + dev->_nPins) {
+        owner = dev;
+        break;
+      }
+    }
+    if (ranges > 0 && index[ranges-1].dev == owner) continue;
+    index[ranges].firstVpin = vpin;
+    index[ranges].dev = owner;
+    ranges++;
+  }
+  _vpinIndex = index;
+  _vpinIndexSize = ranges;
+
+#ifdef DIAG_IO
+  // Check the index against the chain walk either side of the ends of
+  // every device range.  Ownership only changes at those vpins, so this
+  // covers every vpin, including overlapping filter devices and a range
+  // ending at the last vpin.
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
+    if (dev->_nPins <= 0) continue;
+    uint32_t end = (uint32_t)dev->_firstVpin + dev->_nPins;
+    uint32_t checks[4] = {(uint32_t)dev->_firstVpin - 1, dev->_firstVpin, end - 1, end};
+    for (uint8_t c = 0; c < 4; c++) {
+      if (checks[c] > 0xFFFF) continue;
+      VPIN vpin = checks[c];
+      IODevice *owner = NULL;
+      for (IODevice *d = _firstDevice; d != 0 && !owner; d = d->_nextDevice)
+        if (vpin >= d->_firstVpin && (uint32_t)vpin < (uint32_t)d->_firstVpin + d->_nPins) owner = d;
+      if (findDevice(vpin) != owner) DIAG(F("IODevice: vpin index wrong for vpin %u"), vpin);
+    }
+  }
+#endif
+}
+
 // Instance helper function for filter devices (layered over others).  Looks for 
 //  a device that is further down the chain than the current device.
 IODevice *IODevice::findDeviceFollowing(VPIN vpin) {
@@ -415,8 +683,19 @@ IONotifyCallback *IONotifyCallback::first = 0;
 // Start and end of chain of devices.
 IODevice *IODevice::_firstDevice = 0;
 
-// Reference to next device to be called on _loop() method.
-IODevice *IODevice::_nextLoopDevice = 0;
+// Index for findDevice(), built from the chain of devices.
+IODevice::VpinRange *IODevice::_vpinIndex = NULL;
+uint16_t IODevice::_vpinIndexSize = 0;
+bool IODevice::_vpinIndexValid = false;
+
+// Heap of devices for the _loop() method.
+IODevice **IODevice::_loopHeap = NULL;
+uint16_t IODevice::_loopHeapSize = 0;
+bool IODevice::_loopHeapValid = false;
+IODevice *IODevice::_loopingDevice = NULL;
+IODevice *IODevice::_nextLoopDevice = NULL;
+
+uint8_t IODevice::_writeBatching = 0;
 
 
 //==================================================================================================================
@@ -447,6 +726,8 @@ void IODevice::write(VPIN vpin, int value) {
   digitalWrite(vpin, value);
   pinMode(vpin, OUTPUT);
 }
+void IODevice::beginWriteBatch() {}
+void IODevice::endWriteBatch() {}
 void IODevice::writeAnalogue(VPIN, int, uint8_t, uint16_t) {}
 bool IODevice::isBusy(VPIN) { return false; }
 bool IODevice::hasCallback(VPIN) { return false; }
@@ -454,6 +735,13 @@ int IODevice::read(VPIN vpin) {
   if (vpin >= NUM_DIGITAL_PINS) return 0;
   return !digitalRead(vpin);  // Return inverted state (5v=0, 0v=1)
 }
+uint32_t IODevice::readRange(VPIN vpin, uint8_t count) {
+  if (count > 32) count = 32;
+  uint32_t result = 0;
+  for (uint8_t bit = 0; bit < count; bit++)
+    if (read(vpin + bit)) result |= (uint32_t)1 << bit;
+  return result;
+}
 int IODevice::readAnalogue(VPIN vpin) {
   return ADCee::read(vpin);
 }
@@ -558,6 +846,17 @@ int ArduinoPins::_read(VPIN vpin) {
   return value;
 }
 
+// Device-specific read function for several digital inputs.  Saves
+// looking up the device for each pin.
+VPIN ArduinoPins::_readRange(VPIN vpin, int count, uint32_t &bits) {
+  int pins = _firstVpin + _nPins - vpin;
+  if (count > pins) count = pins;
+  bits = 0;
+  for (int i = 0; i < count; i++)
+    if (_read(vpin + i)) bits |= (uint32_t)1 << i;
+  return vpin + count;
+}
+
 // Device-specific readAnalogue function (analogue input)
 int ArduinoPins::_readAnalogue(VPIN vpin) {
   if (vpin > 255) return -1023;
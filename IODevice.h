@@ -27,6 +27,14 @@
 // Define symbol DIAG_LOOPTIMES to enable CS loop execution time to be reported
 //#define DIAG_LOOPTIMES
 
+// Define symbol HAL_BENCHMARK to time every call into each device's _loop, 
+// _read/_readAnalogue, _write and _writeAnalogue methods, with the I2C bytes 
+// each call requests.  Shown by <D HAL STATS [RESET]>; <D HAL BENCH> reads 
+// every sensor's vpin once first, so that input timings are available for 
+// devices whose inputs are otherwise only notified.  Outputs are never 
+// exercised, as that would move points and servos on the layout.
+//#define HAL_BENCHMARK
+
 // Define symbol IO_SWITCH_OFF_SERVO to set the PCA9685 output to 0 when an 
 // animation has completed.  This switches off the servo motor, preventing 
 // the continuous buzz sometimes found on servos, and reducing the 
@@ -39,6 +47,7 @@
 #include "I2CManager.h"
 #include "inttypes.h"
 #include "TemplateForEnums.h"
+#include "Arena.h"
 
 typedef uint16_t VPIN;
 // Limit VPIN number to max 32767.  Above this number, printing often gives negative values.
@@ -83,6 +92,8 @@ private:
 
 class IODevice {
 public:
+  // HAL devices are never deleted
+  ARENA_NEW(ARENA_HAL)
 
   // Parameter values to identify type of call to IODevice::configure.
   typedef enum : uint8_t {
@@ -131,6 +142,12 @@ public:
   static void write(VPIN vpin, int value);
   static void writeRange(VPIN vpin, int value,int count);
 
+  // Between beginWriteBatch() and endWriteBatch(), devices that support it (GPIO extenders)
+  // hold back digital writes and pin configuration, and send each port once at the end.
+  // Batches nest, the ports are sent when the outermost one ends.
+  static void beginWriteBatch();
+  static void endWriteBatch();
+
   // write invokes the IODevice instance's _writeAnalogue method (not applicable for digital outputs)
   static void writeAnalogue(VPIN vpin, int value, uint8_t profile=0, uint16_t duration=0);
   static void writeAnalogueRange(VPIN vpin, int value, uint8_t profile, uint16_t duration, int count);
@@ -144,6 +161,9 @@ public:
 
   // read invokes the IODevice instance's _read method.
   static int read(VPIN vpin);
+  // readRange returns the digital states of up to 32 vpins, bit 0 for vpin,
+  // bit 1 for vpin+1 and so on.  Vpins with no device read as 0.
+  static uint32_t readRange(VPIN vpin, uint8_t count);
 
   // read invokes the IODevice instance's _readAnalogue method.
   static int readAnalogue(VPIN vpin);
@@ -154,6 +174,21 @@ public:
 
   static void DumpAll();
 
+#if defined(HAL_BENCHMARK)
+  // List per-device call timings, optionally clearing them.
+  static void showBenchmark(bool reset);
+
+  enum BenchOp : uint8_t { BENCH_LOOP, BENCH_READ, BENCH_WRITE, BENCH_ANALOGUE, BENCH_OPS };
+  // Add a call taking 'micros' and requesting 'bytes' over I2C to the statistics.
+  void benchRecord(BenchOp op, uint32_t micros, uint32_t bytes) {
+    BenchStats &b = _bench[op];
+    b.count++;
+    b.totalMicros += micros;
+    if (micros > b.maxMicros) b.maxMicros = micros;
+    b.i2cBytes += bytes;
+  }
+#endif
+
   // exists checks whether there is a device owning the specified vpin
   static bool exists(VPIN vpin);
 
@@ -164,10 +199,16 @@ public:
   // should pull down this pin when requesting a scan.  The pin may be shared by multiple modules.
   // Without the shared interrupt, input states are scanned periodically to detect changes on 
   // GPIO extender pins.  If a shared interrupt pin is configured, then input states are scanned
-  // only when the shared interrupt pin is pulled low.  The external GPIO module releases the pin
-  // once the GPIO port concerned has been read.
+  // only when the shared interrupt pin is pulled low, plus a slow safety refresh.  The external 
+  // GPIO module releases the pin once the GPIO port concerned has been read.
   void setGPIOInterruptPin(int16_t pinNumber);
 
+  // With an interrupt pin, inputs are still read at this interval in case 
+  // an interrupt is missed.
+  #ifndef GPIO_INTERRUPT_REFRESH
+  #define GPIO_INTERRUPT_REFRESH 1000000UL  // 1 second
+  #endif
+
   // Method to check if pins will overlap before creating new device. 
   static bool checkNoOverlap(VPIN firstPin, uint8_t nPins=1, 
                   I2CAddress i2cAddress=0, bool silent=false);
@@ -210,6 +251,15 @@ public:
     return 0;
   };
 
+  // Method to read up to 32 digital pin states into bits, bit 0 for vpin.
+  // This will, by default just read one vpin and return the next one to try,
+  // drivers that hold their input states as a port can do many at once.
+  virtual VPIN _readRange(VPIN vpin, int count, uint32_t &bits) {
+    (void)count;
+    bits = _read(vpin) ? 1 : 0;
+    return vpin+1;
+  };
+
   // Method to read analogue pin state (optionally implemented within device class)
   virtual int _readAnalogue(VPIN vpin) { 
     (void)vpin; 
@@ -251,12 +301,17 @@ protected:
   // Method for displaying info on DIAG output (optionally implemented within device class)
   virtual void _display();
 
+  // Method to send writes held back during a write batch (optionally implemented within device class)
+  virtual void _flushWrites() {};
+
   // Destructor
   virtual ~IODevice() {};
 
   // Non-virtual function
   void delayUntil(unsigned long futureMicrosCount) {
     _nextEntryTime = futureMicrosCount;
+    // A change made outside this device's own _loop() reorders the loop heap
+    if (this != _loopingDevice) _loopHeapValid = false;
   }
   
   // Common object fields.
@@ -269,6 +324,15 @@ protected:
   // Pin number of interrupt pin for GPIO extender devices.  The extender module will pull this
   //  pin low if an input changes state.
   int16_t _gpioInterruptPin = -1;
+  // Interrupt pin state last seen by this device.
+  bool _gpioInterruptActive = false;
+
+  // For GPIO extenders, returns true if the inputs should be read now: always if
+  // there's no interrupt pin, otherwise if the pin is active or the inputs haven't
+  // been read for GPIO_INTERRUPT_REFRESH.  The first device of a group sharing an
+  // interrupt pin to see it go active schedules the others to run straight away, 
+  // so the whole group is read together.
+  bool gpioScanDue(unsigned long currentMicros, unsigned long lastScanMicros);
     
   // Static support function for subclass creation
   static void addDevice(IODevice *newDevice, IODevice *slaveDevice = NULL);
@@ -276,15 +340,48 @@ protected:
   // Method to find device handling Vpin
   static IODevice *findDevice(VPIN vpin);
 
+  // Index of vpin ranges in ascending order, each giving the first
+  // device in the chain that handles it (NULL for unallocated vpins).
+  // Rebuilt on the first lookup after a device is added.
+  struct VpinRange {
+    VPIN firstVpin;
+    IODevice *dev;
+  };
+  static VpinRange *_vpinIndex;
+  static uint16_t _vpinIndexSize;
+  static bool _vpinIndexValid;
+  static void buildVpinIndex();
+
   // Current state of device
   DeviceStateEnum _deviceState = DEVSTATE_DORMANT;
 
+  // Open beginWriteBatch() calls, not yet ended
+  static uint8_t _writeBatching;
+
 private:
   IODevice *_nextDevice = 0;
   unsigned long _nextEntryTime;
   static IODevice *_firstDevice;
 
-  static IODevice *_nextLoopDevice;
+  // Devices in order of _nextEntryTime, as a binary min-heap, for loop().
+  static IODevice **_loopHeap;
+  static uint16_t _loopHeapSize;
+  static bool _loopHeapValid;
+  static IODevice *_loopingDevice;  // device whose _loop() is running
+  static IODevice *_nextLoopDevice; // for loopChain()
+  static void buildLoopHeap();
+  static void loopChain(unsigned long currentMicros);
+  static void siftDown(uint16_t position);
+
+#if defined(HAL_BENCHMARK)
+  struct BenchStats {
+    uint32_t count;
+    uint32_t totalMicros;
+    uint32_t maxMicros;
+    uint32_t i2cBytes;
+  };
+  BenchStats _bench[BENCH_OPS] = {};
+#endif
 };
 
 
@@ -317,8 +414,8 @@ private:
   void _writeAnalogue(VPIN vpin, int value, uint8_t profile, uint16_t duration) override;
   int _read(VPIN vpin) override; // returns the digital state or busy status of the device
   void _loop(unsigned long currentMicros) override;
-  void updatePosition(uint8_t pin);
-  void writeDevice(uint8_t pin, int value);
+  int updatePosition(uint8_t pin);
+  void writeDevice(uint8_t firstPin, uint8_t count, const int values[]);
   void _display() override;
   
 
@@ -342,9 +439,12 @@ private:
 
   const unsigned int refreshInterval = 50; // refresh every 50ms
 
-  // structures for setting up non-blocking writes to servo controller
+  // structures for setting up non-blocking writes to servo controller.
+  // Up to 7 adjacent channels are written at once, keeping within the
+  // 32-byte buffer of the Wire library.
+  static const uint8_t _burstChannels = 7;
   I2CRB requestBlock;
-  uint8_t outputBuffer[5];
+  uint8_t outputBuffer[1 + 4 * _burstChannels];
   uint8_t prescaler; // clock prescaler for setting PWM frequency
 };
 
@@ -392,6 +492,7 @@ private:
   void _write(VPIN vpin, int value) override;
   // Device-specific read functions.
   int _read(VPIN vpin) override;
+  VPIN _readRange(VPIN vpin, int count, uint32_t &bits) override;
   int _readAnalogue(VPIN vpin) override;
   int _configureAnalogIn(VPIN vpin) override;
   void _display() override;
@@ -408,6 +509,12 @@ private:
  * IODevice subclass for EX-Turntable.
  */
  
+// Interval between status reads while the turntable is idle, in case it 
+// has been moved other than by a command from here (e.g. homing at power on).
+#ifndef EXTT_IDLE_REFRESH
+#define EXTT_IDLE_REFRESH 2000000UL  // 2 seconds
+#endif
+
 class EXTurntable : public IODevice {
 public:
   static void create(VPIN firstVpin, int nPins, I2CAddress I2CAddress);
@@ -437,6 +544,10 @@ private:
   uint8_t _stepperStatus;
   uint8_t _previousStatus;
   uint8_t _currentActivity;
+  uint8_t _readBuffer[1];
+  bool _readPending;
+  unsigned long _lastPollMicros;
+  I2CRB _i2crb;
 };
 #endif
 
@@ -451,9 +562,9 @@ private:
 // 
 // void updateLocoScreen() {
 //   for (int i=0; i<8; i++) {
-//     if (DCC::speedTable[i].loco > 0) {
-//       int speed = DCC::speedTable[i].speedCode;
-//       SCREEN(3, i, F("Loco:%4d %3d %c"), DCC::speedTable[i].loco,
+//     if (DCC::speedTable.loco[i] > 0) {
+//       int speed = DCC::speedTable.speedCode[i];
+//       SCREEN(3, i, F("Loco:%4d %3d %c"), DCC::speedTable.loco[i],
 //         speed & 0x7f, speed & 0x80 ? 'R' : 'F');
 //     }
 //   }
@@ -543,6 +654,15 @@ protected:
     return (_states[pin>>3] & mask) ? 1 : 0;
   }
 
+  VPIN _readRange(VPIN vpin, int count, uint32_t &bits) override {
+    int pin = vpin - _firstVpin;
+    if (count > _nPins - pin) count = _nPins - pin;
+    bits = 0;
+    for (int i = 0; i < count; i++, pin++)
+      if (_states[pin>>3] & (1 << (pin & 7))) bits |= (uint32_t)1 << i;
+    return vpin + count;
+  }
+
   void _write(VPIN vpin, int value) override {
     int pin = vpin - _firstVpin;
     if (pin >= _nPins || pin < 0) return;
@@ -35,41 +35,62 @@
  * ADS1113 and ADS1114 are restricted to 1 input.  ADS1115 has a multiplexer which allows 
  * any of four input pins to be read by its ADC.
  * 
- * The driver polls the device in accordance with the constant 'scanInterval' below.  On first loop
- * entry, the multiplexer is set to pin A0 and the ADC is triggered.  On second and subsequent
- * entries, the analogue value is read from the conversion register and then the multiplexer and
- * ADC are set up to read the next pin.
+ * Each channel is sampled at its own interval (10ms unless configured).  With one input the
+ * ADC runs in continuous mode, and a sample is just a read of the conversion register.  With
+ * more, a single-shot conversion is started on whichever channel is most overdue, and the
+ * result is read as soon as the conversion is complete.  Completion is seen on the ALERT/RDY
+ * pin if it is wired to an Arduino pin, otherwise by reading the config register, and only
+ * once the conversion should have finished.  Nothing is done on the bus between samples.
  * 
  * The ADS111x is set up as follows:
- *    Single-shot scan
- *    Data rate 128 samples/sec (7.8ms/sample, but scanned every 10ms)
- *    Comparator off
+ *    Data rate 250 samples/sec (4ms/sample)
+ *    Comparator used only as conversion ready signal
  *    Gain FSR=6.144V
  * The gain means that the maximum input voltage of 5V (when Vss=5V) gives a reading 
  * of 32767*(5.0/6.144) = 26666.
  * 
  * A device is configured by the following:
- *   ADS111x::create(firstVpin, nPins, i2cAddress);
+ *   ADS111x::create(firstVpin, nPins, i2cAddress [, readyPin]);
  * for example
- *   ADS111x::create(300, 1, 0x48);  // single-input ADS1113
- *   ADS111x::create(300, 4, 0x48);  // four-input ADS1115
+ *   ADS111x::create(300, 1, 0x48);      // single-input ADS1113
+ *   ADS111x::create(300, 4, 0x48, 2);   // four-input ADS1115, ALERT/RDY on pin 2
  * 
- * Note: The device is simple and does not need initial configuration, so it should recover from
- * temporary loss of communications or power.
+ * A channel may be given its own sample interval, and a threshold.  When the value rises to
+ * the threshold, or falls below threshold-hysteresis, IONotifyCallback subscribers (e.g. 
+ * Sensor objects on the vpin) are told, and the digital read of the vpin is 1 above it.
+ *   ADS111x::configureChannel(vpin, intervalMs [, threshold, hysteresis]);
+ * for example
+ *   ADS111x::configureChannel(301, 5, 2000, 200);  // occupancy detector on A1
+ * 
+ * Note: The device is simple and only needs ALERT/RDY set up, which is done again if it stops
+ * signalling, so it should recover from temporary loss of communications or power.
  **********************************************************************************************/
 class ADS111x: public IODevice { 
 public:
-  static void create(VPIN firstVpin, int nPins, I2CAddress i2cAddress) {
-    if (checkNoOverlap(firstVpin,nPins,i2cAddress)) new ADS111x(firstVpin, nPins, i2cAddress);
+  static void create(VPIN firstVpin, int nPins, I2CAddress i2cAddress, int16_t readyPin=-1) {
+    if (checkNoOverlap(firstVpin,nPins,i2cAddress)) new ADS111x(firstVpin, nPins, i2cAddress, readyPin);
+  }
+  // Threshold -1 turns notification off for the channel.
+  inline static bool configureChannel(VPIN vpin, uint16_t intervalMs, int16_t threshold=-1, uint16_t hysteresis=0) {
+    int params[] = {(int)intervalMs, threshold, (int)hysteresis};
+    return IODevice::configure(vpin, CONFIGURE_ANALOGINPUT, 3, params);
   }
 private:
-  ADS111x(VPIN firstVpin, int nPins, I2CAddress i2cAddress) {
+  ADS111x(VPIN firstVpin, int nPins, I2CAddress i2cAddress, int16_t readyPin) {
     _firstVpin = firstVpin;
     _nPins = (nPins > 4) ? 4 : nPins;
     _I2CAddress = i2cAddress;
+    _readyPin = readyPin;
     _currentPin = 0;
-    for (int8_t i=0; i<_nPins; i++)
+    _above = 0;
+    for (int8_t i=0; i<_nPins; i++) {
       _value[i] = -1;
+      _interval[i] = defaultInterval;
+      _threshold[i] = -1;
+      _hysteresis[i] = 0;
+      _lastSample[i] = 0;
+    }
+    _hasCallback = true;  // threshold crossings are notified from _loop
     addDevice(this);
   }
   void _begin() {
@@ -77,10 +98,11 @@ private:
     I2CManager.begin();
     // ADS111x support high-speed I2C (4.3MHz) but that requires special
     // processing.  So stick to fast mode (400kHz maximum).
-    I2CManager.setClock(400000);
+    I2CManager.setClock(_I2CAddress, 400000);
+    if (_readyPin >= 0) pinMode(_readyPin, INPUT_PULLUP);  // ALERT/RDY is open drain
     // Initialise ADS device
     if (I2CManager.exists(_I2CAddress)) {
-      _nextState = STATE_STARTSCAN;
+      _nextState = STATE_SETLOW;
 #ifdef DIAG_IO
       _display();
 #endif
@@ -89,6 +111,16 @@ private:
       _deviceState = DEVSTATE_FAILED;
     }
   }
+
+  bool _configure(VPIN vpin, ConfigTypeEnum configType, int paramCount, int params[]) override {
+    if (configType != CONFIGURE_ANALOGINPUT || paramCount < 1) return false;
+    int pin = vpin - _firstVpin;
+    _interval[pin] = params[0] > 0 ? params[0] : 1;
+    _threshold[pin] = paramCount > 1 ? params[1] : -1;
+    _hysteresis[pin] = paramCount > 2 ? params[2] : 0;
+    return true;
+  }
+
   void _loop(unsigned long currentMicros) override {
 
     // Check that previous non-blocking write has completed, if not then wait
@@ -96,19 +128,42 @@ private:
     if (status == I2C_STATUS_PENDING) return;  // Busy, so don't do anything.
     if (status == I2C_STATUS_OK) {
       switch (_nextState) {
-        case STATE_STARTSCAN:
-          // Configure ADC and multiplexer for next scan.  See ADS111x datasheet for details
-          // of configuration register settings.
-          _outBuffer[0] = 0x01; // Config register address
-          _outBuffer[1] = 0xC0 + (_currentPin << 4); // Trigger single-shot, channel n
-          _outBuffer[2] = 0xA3;           // 250 samples/sec, comparator off
-          // Write command, without waiting for completion.
+        case STATE_SETLOW:
+        case STATE_SETHIGH:
+          // Lo_thresh MSB 0 and Hi_thresh MSB 1 make ALERT/RDY a conversion-ready signal.
+          _outBuffer[0] = _nextState == STATE_SETLOW ? 0x02 : 0x03;
+          _outBuffer[1] = _nextState == STATE_SETLOW ? 0x00 : 0x80;
+          _outBuffer[2] = 0x00;
           I2CManager.write(_I2CAddress, _outBuffer, 3, &_i2crb);
+          _nextState = _nextState == STATE_SETLOW ? STATE_SETHIGH : STATE_STARTSCAN;
+          break;
 
-          delayUntil(currentMicros + scanInterval);
-          _nextState = STATE_STARTREAD;
+        case STATE_STARTSCAN:
+          if (_nPins == 1) {
+            // Configure continuous conversion on A0.  See ADS111x datasheet for details
+            // of configuration register settings.
+            _outBuffer[0] = 0x01; // Config register address
+            _outBuffer[1] = 0x40; // Continuous, channel 0
+            _outBuffer[2] = 0xA3; // 250 samples/sec, comparator off
+            I2CManager.write(_I2CAddress, _outBuffer, 3, &_i2crb);
+            // First result is there after one conversion
+            delayUntil(currentMicros + conversionTime);
+            _lastSample[0] = currentMicros - _interval[0] * 1000UL;
+            _nextState = STATE_CONTINUOUS;
+          } else {
+            startNextScan(currentMicros);
+          }
           break;
 
+        case STATE_CONTINUOUS:
+          if (!sampleDue(0, currentMicros)) {
+            delayUntil(_lastSample[0] + _interval[0] * 1000UL);
+            break;
+          }
+          _lastSample[0] = currentMicros;
+          _nextState = STATE_STARTREAD;
+          // fall through
+
         case STATE_STARTREAD:
           // Reading the pin value
           _outBuffer[0] = 0x00;  // Conversion register address
@@ -116,15 +171,36 @@ private:
           _nextState = STATE_GETVALUE;
           break;
 
+        case STATE_WAITREADY:
+          if (_readyPin >= 0) {
+            // ALERT/RDY goes low at the end of the conversion, polled without using the bus.
+            if (digitalRead(_readyPin) == LOW) 
+              _nextState = STATE_STARTREAD;
+            else if (currentMicros - _lastSample[_currentPin] > readyTimeout)
+              _nextState = STATE_SETLOW;  // Device reset? Set up ALERT/RDY again.
+          } else {
+            _outBuffer[0] = 0x01;  // Config register, OS bit is set when conversion done
+            I2CManager.read(_I2CAddress, _inBuffer, 2, _outBuffer, 1, &_i2crb);
+            _nextState = STATE_CHECKREADY;
+          }
+          break;
+
+        case STATE_CHECKREADY:
+          if (_inBuffer[0] & 0x80) {
+            _nextState = STATE_STARTREAD;
+          } else {
+            delayUntil(currentMicros + readyPollInterval);
+            _nextState = STATE_WAITREADY;
+          }
+          break;
+
         case STATE_GETVALUE:
           _value[_currentPin] = ((uint16_t)_inBuffer[0] << 8) + (uint16_t)_inBuffer[1];
           #ifdef IO_ANALOGUE_SLOW
           DIAG(F("ADS111x VPIN:%u value:%d"), _currentPin, _value[_currentPin]);
           #endif
-
-          // Move to next pin
-          if (++_currentPin >= _nPins) _currentPin = 0;
-          _nextState = STATE_STARTSCAN;
+          checkThreshold(_currentPin);
+          _nextState = _nPins == 1 ? STATE_CONTINUOUS : STATE_STARTSCAN;
           break;
         
         default:
@@ -136,6 +212,52 @@ private:
     }
   }
 
+  bool sampleDue(uint8_t pin, unsigned long currentMicros) {
+    return currentMicros - _lastSample[pin] >= _interval[pin] * 1000UL;
+  }
+
+  // Start a single-shot conversion on the channel that is most overdue, or
+  // sleep until the next one is due.
+  void startNextScan(unsigned long currentMicros) {
+    uint8_t next = 0;
+    long mostLate = 0;
+    for (uint8_t pin=0; pin<_nPins; pin++) {
+      long late = (long)(currentMicros - _lastSample[pin]) - (long)(_interval[pin] * 1000UL);
+      if (pin == 0 || late > mostLate) {
+        mostLate = late;
+        next = pin;
+      }
+    }
+    if (mostLate < 0) {
+      delayUntil(currentMicros - mostLate);
+      return;
+    }
+    _currentPin = next;
+    _lastSample[next] = currentMicros;
+    _outBuffer[0] = 0x01; // Config register address
+    _outBuffer[1] = 0xC0 + (next << 4); // Trigger single-shot, channel n
+    _outBuffer[2] = 0xA0;  // 250 samples/sec, ALERT/RDY after each conversion
+    // Write command, without waiting for completion.
+    I2CManager.write(_I2CAddress, _outBuffer, 3, &_i2crb);
+    delayUntil(currentMicros + conversionTime);
+    _nextState = STATE_WAITREADY;
+  }
+
+  void checkThreshold(uint8_t pin) {
+    if (_threshold[pin] < 0) return;
+    int16_t value = (int16_t)_value[pin];
+    bool above = bitRead(_above, pin);
+    if (!above && value >= _threshold[pin]) above = true;
+    else if (above && value < _threshold[pin] - (int16_t)_hysteresis[pin]) above = false;
+    else return;
+    bitWrite(_above, pin, above);
+    IONotifyCallback::invokeAll(_firstVpin + pin, above);
+  }
+
+  int _read(VPIN vpin) override {
+    return bitRead(_above, vpin - _firstVpin);
+  }
+
   int _readAnalogue(VPIN vpin) override {
     int pin = vpin - _firstVpin;
     return _value[pin];
@@ -146,22 +268,36 @@ private:
       _deviceState == DEVSTATE_FAILED ? F("OFFLINE") : F(""));
   }
 
-  // ADC conversion rate is 250SPS, or 4ms per conversion.  Set the period between updates to 10ms. 
-  // This is enough to allow the conversion to reliably complete in time.
+  // ADC conversion rate is 250SPS, or 4ms per conversion, and the internal oscillator
+  // may be up to 10% slow.  The first check for the result is made after conversionTime.
+  const unsigned long conversionTime = 4000UL;
+  const unsigned long readyPollInterval = 200UL;
+  const unsigned long readyTimeout = 20000UL;
   #ifndef IO_ANALOGUE_SLOW
-  const unsigned long scanInterval = 10000UL;  // Period between successive ADC scans in microseconds.
+  static const uint16_t defaultInterval = 10;  // Default ms between samples of a channel.
   #else
-  const unsigned long scanInterval = 1000000UL;  // Period between successive ADC scans in microseconds.
+  static const uint16_t defaultInterval = 1000;  // Default ms between samples of a channel.
   #endif
   enum : uint8_t {
+    STATE_SETLOW,
+    STATE_SETHIGH,
     STATE_STARTSCAN,
+    STATE_CONTINUOUS,
+    STATE_WAITREADY,
+    STATE_CHECKREADY,
     STATE_STARTREAD, 
     STATE_GETVALUE,
   };
   uint16_t _value[4];
+  uint16_t _interval[4];      // ms between samples
+  int16_t _threshold[4];      // -1 if not notifying
+  uint16_t _hysteresis[4];
+  unsigned long _lastSample[4];  // micros when last sampled
+  uint8_t _above;             // bit per channel, set when above threshold
   uint8_t _outBuffer[3];
   uint8_t _inBuffer[2];
   uint8_t _currentPin;  // ADC pin currently being scanned
+  int16_t _readyPin;    // Arduino pin wired to ALERT/RDY, or -1
   I2CRB _i2crb;
   uint8_t _nextState;
 };
@@ -104,12 +104,14 @@ void _loop(unsigned long currentMicros) override{
         //_clocktime = (a << 8) + b;
         //_clockrate = readBuffer[2];
 
-        CommandDistributor::setClockTime(((a << 8) + b), readBuffer[2], 1);
+        byte rate = readBuffer[2];
+        CommandDistributor::setClockTime(((a << 8) + b), rate, 1);
         //setClockTime(int16_t clocktime, int8_t clockrate, byte opt);
         
-        // As the minimum clock increment is 2 seconds delay a bit - say 1 sec.
-        // Clock interval is 60/ clockspeed i.e 60/b seconds
-        delayUntil(currentMicros + ((60/b) * 1000000));  
+        // A clock minute is 60/rate seconds. Reading twice a minute sees
+        // every minute once, so ONTIMEs fire one by one even at x60.
+        // A stopped clock is still read every second to see it restart.
+        delayUntil(currentMicros + (rate ? 30000000UL/rate : 1000000UL));
      
       #endif
     
@@ -36,6 +36,16 @@
 * The total number of pins cannot exceed 256 because of the communications packet format.
 * The number of analogue inputs cannot exceed 16 because of a limit on the maximum
 * I2C packet size of 32 bytes (in the Wire library).
+*
+* Expanders that answer the EXIORDCHG command are polled for changes only.  The
+* request is {EXIORDCHG, hysteresis} and the reply is {EXIOCHG, count, entries...}
+* with up to EXIO_CHANGE_ENTRIES entries of three bytes each:
+*   {byte index, value, 0}   for a changed digital input byte, or
+*   {0x80|analogue pin, value LSB, value MSB}   for an analogue input that has 
+*                            moved by more than the hysteresis since last reported.
+* A count of 0xFF means there were too many changes to fit, in which case the 
+* full digital and analogue states are read instead.  The expander treats 
+* everything as changed after EXIOINIT.  Other expanders are read in full as before.
 */
 
 #ifndef IO_EX_IOEXPANDER_H
@@ -46,6 +56,15 @@
 #include "DIAG.h"
 #include "FSH.h"
 
+// Number of changes returned by one EXIORDCHG poll.
+#ifndef EXIO_CHANGE_ENTRIES
+#define EXIO_CHANGE_ENTRIES 4
+#endif
+// Analogue change below which the expander doesn't report a new value.
+#ifndef EXIO_ANALOGUE_HYSTERESIS
+#define EXIO_ANALOGUE_HYSTERESIS 4
+#endif
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 /*
  * IODevice subclass for EX-IOExpander.
@@ -63,23 +82,28 @@ public:
     NoPowerOff = 0x80, // Flag to be ORed in to suppress power off after move.
   };
 
-  static void create(VPIN vpin, int nPins, I2CAddress i2cAddress) {
-    if (checkNoOverlap(vpin, nPins, i2cAddress)) new EXIOExpander(vpin, nPins, i2cAddress);
+  // If the expander drives an interrupt line when a digital input changes,
+  // give the pin it is connected to as interruptPin.
+  static void create(VPIN vpin, int nPins, I2CAddress i2cAddress, int interruptPin=-1) {
+    if (checkNoOverlap(vpin, nPins, i2cAddress)) new EXIOExpander(vpin, nPins, i2cAddress, interruptPin);
   }
 
 private:
   // Constructor
-  EXIOExpander(VPIN firstVpin, int nPins, I2CAddress i2cAddress) {
+  EXIOExpander(VPIN firstVpin, int nPins, I2CAddress i2cAddress, int interruptPin) {
     _firstVpin = firstVpin;
     // Number of pins cannot exceed 256 (1 byte) because of I2C message structure.
     if (nPins > 256) nPins = 256;
     _nPins = nPins;
     _I2CAddress = i2cAddress;
+    _gpioInterruptPin = interruptPin;
     addDevice(this);
   }
 
   void _begin() {
     uint8_t status;
+    if (_gpioInterruptPin >= 0) 
+      pinMode(_gpioInterruptPin, INPUT_PULLUP);
     // Initialise EX-IOExander device
     I2CManager.begin();
     if (I2CManager.exists(_I2CAddress)) {
@@ -159,6 +183,22 @@ private:
         DIAG(F("EX-IOExpander device found, I2C:%s, Version v%d.%d.%d"),
             _I2CAddress.toString(), _majorVer, _minorVer, _patchVer);
 
+        // Check whether the expander can report changes only.  Older
+        // firmware won't reply with EXIOCHG.
+        if (!_changeBuffer) _changeBuffer = (uint8_t *)calloc(CHANGE_BUFFER_SIZE, 1);
+        if (_changeBuffer) {
+          commandBuffer[0] = EXIORDCHG;
+          commandBuffer[1] = EXIO_ANALOGUE_HYSTERESIS;
+          _changeBuffer[0] = 0;
+          if (I2CManager.read(_I2CAddress, _changeBuffer, CHANGE_BUFFER_SIZE, commandBuffer, 2) == I2C_STATUS_OK
+              && _changeBuffer[0] == EXIOCHG) {
+            _fullReadsNeeded = FULL_DIGITAL | FULL_ANALOGUE;   // Start from full states
+          } else {
+            free(_changeBuffer);
+            _changeBuffer = NULL;
+          }
+        }
+
 #ifdef DIAG_IO
         _display();
 #endif
@@ -248,6 +288,8 @@ private:
           // The received digital states are placed directly into the digital buffer on receipt, 
           // so don't need any further processing at this point (unless we want to check for
           // changes and notify them to subscribers, to avoid the need for polling - see IO_GPIOBase.h).
+        } else if (_readState == RDS_CHANGES) {
+          applyChanges();
         }
       } else
         reportError(status, false);   // report eror but don't go offline.
@@ -255,9 +297,37 @@ private:
       _readState = RDS_IDLE;
     }
 
+    // Expanders that report changes are polled for them at the digital refresh rate,
+    // unless full reads have been asked for.
+    if (_readState == RDS_IDLE && _changeBuffer && _fullReadsNeeded) {
+      if (_numDigitalPins > 0 && (_fullReadsNeeded & FULL_DIGITAL)) {
+        _readCommandBuffer[0] = EXIORDD;
+        I2CManager.read(_I2CAddress, _digitalInputStates, (_numDigitalPins+7)/8, _readCommandBuffer, 1, &_i2crb);
+        _readState = RDS_DIGITAL;
+      } else if (_numAnaloguePins > 0 && (_fullReadsNeeded & FULL_ANALOGUE)) {
+        _readCommandBuffer[0] = EXIORDAN;
+        I2CManager.read(_I2CAddress, _analogueInputBuffer, _numAnaloguePins * 2, _readCommandBuffer, 1, &_i2crb);
+        _readState = RDS_ANALOGUE;
+      }
+      _fullReadsNeeded = (_readState == RDS_DIGITAL) ? (_fullReadsNeeded & ~FULL_DIGITAL) : 0;
+      return;
+    }
+    if (_readState == RDS_IDLE && _changeBuffer) {
+      if (currentMicros - _lastDigitalRead > _digitalRefresh
+          && (_numAnaloguePins > 0 || gpioScanDue(currentMicros, _lastDigitalRead))) {
+        _readCommandBuffer[0] = EXIORDCHG;
+        _readCommandBuffer[1] = EXIO_ANALOGUE_HYSTERESIS;
+        I2CManager.read(_I2CAddress, _changeBuffer, CHANGE_BUFFER_SIZE, _readCommandBuffer, 2, &_i2crb);
+        _lastDigitalRead = currentMicros;
+        _readState = RDS_CHANGES;
+      }
+      return;
+    }
+
     // If we're not doing anything now, check to see if a new input transfer is due.
     if (_readState == RDS_IDLE) {
-      if (_numDigitalPins>0 && currentMicros - _lastDigitalRead > _digitalRefresh) { // Delay for digital read refresh
+      if (_numDigitalPins>0 && currentMicros - _lastDigitalRead > _digitalRefresh  // Delay for digital read refresh
+          && gpioScanDue(currentMicros, _lastDigitalRead)) {                    // and for interrupt, if used
         // Issue new read request for digital states.  As the request is non-blocking, the buffer has to
         // be allocated from heap (object state).
         _readCommandBuffer[0] = EXIORDD;
@@ -276,6 +346,29 @@ private:
     }
   }
 
+  // Apply the changes reported by an EXIORDCHG poll.
+  void applyChanges() {
+    if (_changeBuffer[0] != EXIOCHG) return;  // Not a valid reply, poll again next time
+    uint8_t count = _changeBuffer[1];
+    if (count > EXIO_CHANGE_ENTRIES) {
+      // Overflow, get everything.
+      _fullReadsNeeded = FULL_DIGITAL | FULL_ANALOGUE;
+      return;
+    }
+    uint8_t *entry = &_changeBuffer[2];
+    for (uint8_t i=0; i<count; i++, entry+=3) {
+      uint8_t index = entry[0];
+      if (index & 0x80) {
+        index &= 0x7f;
+        if (index < _numAnaloguePins) {
+          _analogueInputStates[index*2] = entry[1];
+          _analogueInputStates[index*2+1] = entry[2];
+        }
+      } else if (index < (_numDigitalPins+7)/8) 
+        _digitalInputStates[index] = entry[1];
+    }
+  }
+
   // Obtain the correct analogue input value, with reference to the analogue
   // pin map.  
   // Obtain the correct analogue input value
@@ -301,6 +394,18 @@ private:
     return value;
   }
 
+  // Obtain several digital input values from the last read of the node
+  VPIN _readRange(VPIN vpin, int count, uint32_t &bits) override {
+    int pin = vpin - _firstVpin;
+    if (count > _nPins - pin) count = _nPins - pin;
+    bits = 0;
+    if (_deviceState != DEVSTATE_FAILED) {
+      for (int i = 0; i < count; i++, pin++)
+        if (bitRead(_digitalInputStates[pin / 8], pin % 8)) bits |= (uint32_t)1 << i;
+    }
+    return vpin + count;
+  }
+
   // Write digital value.  We could have an output buffer of states, that is periodically
   // written to the device if there are any changes; this would reduce the I2C overhead
   // if lots of output requests are being made.  We could also cache the last value 
@@ -383,14 +488,19 @@ private:
   uint8_t* _digitalInputStates  = NULL;
   uint8_t* _analogueInputStates = NULL;
   uint8_t* _analogueInputBuffer = NULL;  // buffer for I2C input transfers
-  uint8_t _readCommandBuffer[1];
+  uint8_t _readCommandBuffer[2];
+  // Reply buffer for EXIORDCHG, only allocated if the expander supports it.
+  static const uint8_t CHANGE_BUFFER_SIZE = 2 + 3 * EXIO_CHANGE_ENTRIES;
+  uint8_t* _changeBuffer = NULL;
+  enum {FULL_DIGITAL = 1, FULL_ANALOGUE = 2};
+  uint8_t _fullReadsNeeded = 0;  // Full reads to do before polling for changes
 
   uint8_t _digitalPinBytes = 0;   // Size of allocated memory buffer (may be longer than needed)
   uint8_t _analoguePinBytes = 0;  // Size of allocated memory buffer (may be longer than needed)
   uint8_t* _analoguePinMap = NULL;
   I2CRB _i2crb;
 
-  enum {RDS_IDLE, RDS_DIGITAL, RDS_ANALOGUE};  // Read operation states
+  enum {RDS_IDLE, RDS_DIGITAL, RDS_ANALOGUE, RDS_CHANGES};  // Read operation states
   uint8_t _readState = RDS_IDLE;
   
   unsigned long _lastDigitalRead = 0;
@@ -411,6 +521,8 @@ private:
     EXIOINITA = 0xE8,   // Flag we're receiving analogue pin mappings
     EXIOPINS = 0xE9,    // Flag we're receiving pin counts for buffers
     EXIOWRAN = 0xEA,   // Flag we're sending an analogue write (PWM)
+    EXIORDCHG = 0xEB,   // Flag to read changed digital bytes and analogue inputs
+    EXIOCHG = 0xEC,     // Flag we're receiving changed inputs
     EXIOERR = 0xEF,     // Flag we've received an error
   };
 };
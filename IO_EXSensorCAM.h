@@ -50,6 +50,12 @@
  * I2C packet size of 32 bytes (in the Wire library).
 */
 #define DIGITALREFRESH 20000UL      // min uSec delay between digital reads of digitalInputStates
+// Delta mode: with a CAM at or above CAMDELTAVERSION (major*10+minor) the driver sends
+// '[' with the last sequence number received, and the CAM answers '{' seq count, then 
+// count pairs of bank number and bank byte for the banks changed since that sequence.
+// A CAM that has lost track sends all banks. The short packet allows a faster refresh.
+#define CAMDELTAVERSION 33
+#define DELTAREFRESH 5000UL         // min uSec delay between delta reads
 #ifndef IO_EX_EXSENSORCAM_H
 #define IO_EX_EXSENSORCAM_H
 #define SEND StringFormatter::send
@@ -80,13 +86,14 @@ class EXSensorCAM : public IODevice {
       if (nPins > 80) nPins = 80;
       _nPins = nPins;
       _I2CAddress = i2cAddress;
+      _hasCallback = true;   // sensor changes are notified from _loop
       addDevice(this);
     }
 //*************************
 void _begin() {
     uint8_t status;
     // Initialise EX-SensorCAM device
-    I2CManager.setClock(100000);  // Set speed for I2C operations
+    I2CManager.setClock(_I2CAddress, 100000);  // Set speed for I2C operations
     I2CManager.begin();
     if (!I2CManager.exists(_I2CAddress)) {
       DIAG(F("EX-SensorCAM I2C:%s device not found"), _I2CAddress.toString());
@@ -109,6 +116,10 @@ void _begin() {
           _majorVer= _inputBuf[1]/10;	
           _minorVer= _inputBuf[1]%10;
           _patchVer= _inputBuf[2];				
+          if (_inputBuf[1] >= CAMDELTAVERSION) {
+            _deltaMode = true;
+            _digitalRefresh = DELTAREFRESH;
+          }
           DIAG(F("EX-SensorCAM device found, I2C:%s, Version v%d.%d.%d"),
                        _I2CAddress.toString(),_majorVer, _minorVer,_patchVer);
         }  	
@@ -162,8 +173,14 @@ void _loop(unsigned long currentMicros) override {
       if ( currentMicros - _lastDigitalRead > _digitalRefresh) { 
         // Issue new read request for digital states.  
              
+        if (_deltaMode) {             //ask only for banks changed since last sequence
+          _readCommandBuffer[0] = '[';
+          _readCommandBuffer[1] = _deltaSeq;
+          I2CManager.read(_I2CAddress,_inputBuf, sizeof(_inputBuf),_readCommandBuffer, 2, &_i2crb);     
+        } else {
         _readCommandBuffer[0] = '@';  //start new read of digitalInputStates Table     // non-blocking read 
         I2CManager.read(_I2CAddress,_inputBuf, sizeof(_inputBuf),_readCommandBuffer, 1, &_i2crb);     
+        }
         _lastDigitalRead = currentMicros;
         _readState = RDS_DIGITAL;
         
@@ -240,15 +257,27 @@ int processIncomingPkt(uint8_t *rBuf,uint8_t sensorCmd) {
 
   switch (sensorCmd){
     case '`':      //response to request for digitalInputStates[] table  '@'=>'`'  
-      memcpy(_digitalInputStates, rBuf+1, digitalBytesNeeded);
+      for (k=0; k<(int)digitalBytesNeeded; k++) updateBank(k, rBuf[k+1]);
       break;                                                 
 
+    case '{':      //response to delta request '['=>'{' seq, count, (bank,byte) pairs
+      b=rBuf[2];
+      if (b > 14) return 1;  // more pairs than a packet holds
+      for (k=0; k<b; k++) 
+        if (rBuf[3+2*k] < digitalBytesNeeded) updateBank(rBuf[3+2*k], rBuf[4+2*k]);
+      _deltaSeq=rBuf[1];
+      break;
+
     case EXIORDY:  //some commands give back acknowledgement only
       SEND(&USB_SERIAL,F("<n ACK OK n>\n"));
       break;
 
     case CAMERR:   //cmd format error code from CAM
       DIAG(F("CAM cmd error 0xFE 0x%x"),rBuf[1]); 
+      if (_readState == RDS_DIGITAL && _deltaMode) {   //'[' not understood, back to full reads
+        _deltaMode = false;
+        _digitalRefresh = DIGITALREFRESH;
+      }
       break;
 
     case 'v':
@@ -390,6 +419,19 @@ void _writeAnalogue(VPIN vpin, int param1, uint8_t camop, uint16_t param3) overr
               _deviceState == DEVSTATE_FAILED ? F("OFFLINE") : F(""));
   }
 //*************************
+// Store a bank of 8 sensor states, notifying only the vpins that changed.
+void updateBank(uint8_t bank, uint8_t value) {
+  uint8_t changes = _digitalInputStates[bank] ^ value;
+  if (!changes) return;
+  _digitalInputStates[bank] = value;
+  if (!IONotifyCallback::hasCallback()) return;
+  for (int bit=0; bit<8; bit++) {
+    int pin = bank*8 + bit;
+    if (pin >= _nPins) break;
+    if (bitRead(changes, bit)) IONotifyCallback::invokeAll(_firstVpin+pin, bitRead(value, bit));
+  }
+}
+//*************************
 // Helper function for error handling
 void reportError(uint8_t status, bool fail=true) {
   DIAG(F("EX-SensorCAM I2C:%s Error:%d (%S)"), _I2CAddress.toString(), 
@@ -405,7 +447,9 @@ void reportError(uint8_t status, bool fail=true) {
   uint8_t _minorVer = 0;
   uint8_t _patchVer = 0;
 
-  uint8_t _digitalInputStates[10];
+  uint8_t _digitalInputStates[10] = {0};
+  bool    _deltaMode = false;     //CAM supports '[' delta reads
+  uint8_t _deltaSeq = 0;          //sequence number of last delta received (0 = none, CAM sends all)
   I2CRB _i2crb;
  
   byte _outputBuffer[8];
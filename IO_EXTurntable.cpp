@@ -47,6 +47,8 @@ EXTurntable::EXTurntable(VPIN firstVpin, int nPins, I2CAddress I2CAddress) {
   _I2CAddress = I2CAddress;
   _stepperStatus = 0;
   _previousStatus = 0;
+  _readPending = false;
+  _lastPollMicros = 0;
   addDevice(this);
 }
 
@@ -67,17 +69,34 @@ void EXTurntable::_begin() {
 // Processing loop to obtain status of stepper
 // 0 = finished moving and in correct position
 // 1 = still moving
+// The status is read (without waiting for the I2C bus) every 100ms while
+// the turntable is moving, and every EXTT_IDLE_REFRESH when it's idle.
 void EXTurntable::_loop(unsigned long currentMicros) {
-  uint8_t readBuffer[1];
-  I2CManager.read(_I2CAddress, readBuffer, 1);
-  _stepperStatus = readBuffer[0];
-  if (_stepperStatus != _previousStatus && _stepperStatus == 0) { // Broadcast when a rotation finishes
-    if ( _currentActivity < 4) {
-      _broadcastStatus(_firstVpin, _stepperStatus, _currentActivity);
+  if (_i2crb.isBusy()) {
+    delayUntil(currentMicros + 1000);  // Check for completion in 1ms
+    return;
+  }
+  if (_readPending) {
+    _readPending = false;
+    if (_i2crb.status == I2C_STATUS_OK) {
+      _stepperStatus = _readBuffer[0];
+      if (_stepperStatus != _previousStatus && _stepperStatus == 0) { // Broadcast when a rotation finishes
+        if ( _currentActivity < 4) {
+          _broadcastStatus(_firstVpin, _stepperStatus, _currentActivity);
+        }
+        _previousStatus = _stepperStatus;
+      }
     }
-    _previousStatus = _stepperStatus;
   }
-  delayUntil(currentMicros + 100000);  // Wait 100ms before checking again
+  unsigned long interval = (_stepperStatus == 0) ? EXTT_IDLE_REFRESH : 100000UL;
+  if (currentMicros - _lastPollMicros >= interval) {
+    I2CManager.read(_I2CAddress, _readBuffer, 1, NULL, 0, &_i2crb);
+    _readPending = true;
+    _lastPollMicros = currentMicros;
+    delayUntil(currentMicros + 1000);
+  } else {
+    delayUntil(_lastPollMicros + interval);
+  }
 }
 
 // Read returns status as obtained in our loop.
@@ -136,6 +155,13 @@ void EXTurntable::_writeAnalogue(VPIN vpin, int value, uint8_t activity, uint16_
   _currentActivity = activity;
   _broadcastStatus(vpin, _stepperStatus, activity); // Broadcast when the rotation starts
   I2CManager.write(_I2CAddress, 3, stepsMSB, stepsLSB, activity);
+  if (activity < 4) {
+    // Moving, so start polling at the faster rate. A poll already
+    // issued was for before the move, so its status is ignored.
+    _readPending = false;
+    _lastPollMicros = micros();
+    delayUntil(_lastPollMicros + 100000UL);
+  }
 }
 
 // Display Turnetable-EX device driver info.
@@ -26,6 +26,13 @@
 #include "IODevice.h"
 #include "DIAG.h"
 #include "DCC.h"
+#include "IO_EncoderThrottle.h"
+#ifdef ENCODER_HARDWARE_COUNT
+#include "driver/pcnt.h"
+#include "driver/gpio.h"
+
+int8_t EncoderThrottle::_nextPcntUnit=0;
+#endif
 
 const byte _DIR_CW = 0x10;  // Clockwise step
 const byte _DIR_CCW = 0x20;  // Counter-clockwise step
@@ -64,12 +71,46 @@ const byte _DIR_MASK = 0x30;
     IODevice::configureInput(dtPin,true);
     IODevice::configureInput(clkPin,true);
     IODevice::configureInput(clickPin,true);
+#ifdef ENCODER_HARDWARE_COUNT
+    _pcntUnit=-1;
+    _lastCount=0;
+    if (!startCounter()) _pcntUnit=-1;
+#endif
     addDevice(this);
     _display();
   }
 
   
 
+#ifdef ENCODER_HARDWARE_COUNT
+  // Count clk edges with a PCNT unit, dt giving the direction.
+  bool EncoderThrottle::startCounter() {
+    if (_dtPin<0 || _dtPin>=NUM_DIGITAL_PINS || _clkPin<0 || _clkPin>=NUM_DIGITAL_PINS) return false;
+    if (_nextPcntUnit>=PCNT_UNIT_MAX) return false;
+    pcnt_config_t config = {};
+    config.pulse_gpio_num=_clkPin;
+    config.ctrl_gpio_num=_dtPin;
+    config.channel=PCNT_CHANNEL_0;
+    config.unit=(pcnt_unit_t)_nextPcntUnit;
+    config.pos_mode=PCNT_COUNT_DEC;
+    config.neg_mode=PCNT_COUNT_INC;
+    config.lctrl_mode=PCNT_MODE_REVERSE;
+    config.hctrl_mode=PCNT_MODE_KEEP;
+    config.counter_h_lim=ENCODER_COUNT_LIMIT;
+    config.counter_l_lim=-ENCODER_COUNT_LIMIT;
+    if (pcnt_unit_config(&config)!=ESP_OK) return false;
+    _pcntUnit=_nextPcntUnit++;
+    gpio_pullup_en((gpio_num_t)_clkPin);
+    gpio_pullup_en((gpio_num_t)_dtPin);
+    pcnt_set_filter_value((pcnt_unit_t)_pcntUnit, 1023);  // ignore contact bounce
+    pcnt_filter_enable((pcnt_unit_t)_pcntUnit);
+    pcnt_counter_pause((pcnt_unit_t)_pcntUnit);
+    pcnt_counter_clear((pcnt_unit_t)_pcntUnit);
+    pcnt_counter_resume((pcnt_unit_t)_pcntUnit);
+    return true;
+  }
+#endif
+
   void EncoderThrottle::_loop(unsigned long currentMicros)  {
     if (_locoid==0) return;  // not in use
     
@@ -82,6 +123,28 @@ const byte _DIR_MASK = 0x30;
     return; 
   }
 
+#ifdef ENCODER_HARDWARE_COUNT
+  if (_pcntUnit>=0) {
+    delayUntil(currentMicros+ENCODER_READ_MICROS);
+    int16_t count;
+    if (pcnt_get_counter_value((pcnt_unit_t)_pcntUnit,&count)!=ESP_OK) return;
+    // Reaching either limit puts the counter back to 0, so it counts
+    // modulo ENCODER_COUNT_LIMIT. The turn since the last read is far
+    // less than half of that.
+    int change=(count-_lastCount) % ENCODER_COUNT_LIMIT;
+    if (change > ENCODER_COUNT_LIMIT/2) change-=ENCODER_COUNT_LIMIT;
+    else if (change < -ENCODER_COUNT_LIMIT/2) change+=ENCODER_COUNT_LIMIT;
+    int steps=change/ENCODER_COUNTS_PER_STEP;
+    if (steps==0) return;
+    // keep any odd count for next time
+    _lastCount=(_lastCount+steps*ENCODER_COUNTS_PER_STEP) % ENCODER_COUNT_LIMIT;
+    step(steps*abs(steps));
+    return;
+  }
+#else
+  (void)currentMicros;
+#endif
+
   // read roco pins and detect state change 
   byte pinstate = (IODevice::read(_dtPin) << 1) | IODevice::read(_clkPin);
   if (pinstate==_prevpinstate) return;
@@ -90,9 +153,11 @@ const byte _DIR_MASK = 0x30;
   _rocoState = transition_table[_rocoState & _STATE_MASK][pinstate];
   if ((_rocoState & _DIR_MASK) == 0) return; // no value change 
 
-  int change=(_rocoState & _DIR_CW)?+1:-1;
   // handle roco change -1 or +1 (clockwise)
-  
+  step((_rocoState & _DIR_CW)?+1:-1);
+}
+
+  void EncoderThrottle::step(int change) {
   if (_stopState==xrSTOP) {
       // first move after button press sets the direction. (clockwise=fwd)
       _stopState=change>0?xrFWD:xrREV;
@@ -107,11 +172,13 @@ const byte _DIR_MASK = 0x30;
     //  manage limits
     int oldspeed=DCC::getThrottleSpeed(_locoid);
     if (oldspeed==1)oldspeed=0; // break out of estop
-    int  newspeed=change>0 ?  (min((oldspeed+_notch),126)) : (max(0,(oldspeed-_notch)));
+    int  newspeed=oldspeed+change*_notch;
+    if (newspeed>126) newspeed=126;
+    if (newspeed<0) newspeed=0;
     if (newspeed==1) newspeed=0; // normal decelereated stop. 
     if (oldspeed!=newspeed) {
         DIAG(F("DRIVE %d notch %S %d %S"),_locoid,
-             change>0?F("UP"):F("DOWN"),_notch,
+             change>0?F("UP"):F("DOWN"),abs(change)*_notch,
              _stopState==xrFWD?F("FWD"):F("REV"));
         DCC::setThrottle(_locoid,newspeed,_stopState==xrFWD);
         }
@@ -124,6 +191,10 @@ const byte _DIR_MASK = 0x30;
     _locoid=value;
     if (param1>0) _notch=param1;
     _rocoState=0;
+#ifdef ENCODER_HARDWARE_COUNT
+    // ignore any turning done before this loco was selected
+    if (_pcntUnit>=0) pcnt_get_counter_value((pcnt_unit_t)_pcntUnit,&_lastCount);
+#endif
     
     // If loco is moving, we inherit direction from it.
     _stopState=xrSTOP;
@@ -139,5 +210,9 @@ const byte _DIR_MASK = 0x30;
 
   
   void EncoderThrottle::_display() {
-    DIAG(F("DRIVE vpin %d loco %d notch %d"),_firstVpin,_locoid,_notch);
+    DIAG(F("DRIVE vpin %d loco %d notch %d%S"),_firstVpin,_locoid,_notch,
+#ifdef ENCODER_HARDWARE_COUNT
+      _pcntUnit>=0 ? F(" PCNT") : 
+#endif
+      F(""));
   }
@@ -21,12 +21,25 @@
 * The IO_EncoderThrottle device driver uses a rotary encoder connected to vpins
 * to drive a loco.
 *  Loco id is selected by writeAnalog.
+*
+* On ESP32, when dt and clk are Arduino pins, a PCNT unit counts the
+* quadrature edges in hardware and the count is read every
+* ENCODER_READ_MICROS. N steps within one read move the speed by N*N
+* notches, so a fast spin covers the range quickly while single steps
+* still move one notch. Otherwise the pins are polled every loop as before.
 */
 
 #ifndef IO_EncoderThrottle_H
 #define IO_EncoderThrottle_H
 #include "IODevice.h"
 
+#if defined(ARDUINO_ARCH_ESP32)
+#define ENCODER_HARDWARE_COUNT
+#define ENCODER_READ_MICROS 20000UL
+#define ENCODER_COUNTS_PER_STEP 2   // PCNT counts both clk edges
+#define ENCODER_COUNT_LIMIT 32767   // the counter goes back to 0 at +/- this
+#endif
+
 class EncoderThrottle : public IODevice {
 public:
   
@@ -36,11 +49,19 @@ private:
   int _dtPin,_clkPin,_clickPin, _locoid, _notch,_prevpinstate; 
   enum {xrSTOP,xrFWD,xrREV} _stopState;
   byte _rocoState;  
+#ifdef ENCODER_HARDWARE_COUNT
+  int8_t _pcntUnit;    // -1 when polling the pins
+  int16_t _lastCount;
+  bool startCounter();
+  static int8_t _nextPcntUnit;
+#endif
 
   // Constructor
   EncoderThrottle(VPIN firstVpin, int dtPin, int clkPin, int clickPin, byte notch);
   
   void _loop(unsigned long currentMicros) override ;
+  // change speed by change notches, +ve is clockwise
+  void step(int change);
 
   // Selocoid as analog value to start drive
   // use <z vpin locoid [notch]>
@@ -41,10 +41,15 @@ protected:
   bool _configure(VPIN vpin, ConfigTypeEnum configType, int paramCount, int params[]) override;
   // Pin write function.
   void _write(VPIN vpin, int value) override;
+  VPIN _writeRange(VPIN vpin, int value, int count) override;
   // Pin read function.
   int _read(VPIN vpin) override;
+  VPIN _readRange(VPIN vpin, int count, uint32_t &bits) override;
   void _display() override;
   void _loop(unsigned long currentMicros) override;
+  void _flushWrites() override;
+  // Several pins of the port in one device write, for _writeRange
+  void _writeMasked(VPIN vpin, uint32_t mask, uint32_t values);
 
   // Data fields
  
@@ -54,6 +59,13 @@ protected:
   T _portMode;  // 0=input, 1=output
   T _portPullup; // 0=nopullup, 1=pullup
   T _portInUse;  // 0=not in use, 1=in use
+  unsigned long _lastScanMicros = 0;
+  // Device writes held back during a write batch
+  struct {
+    uint8_t _outputsPending:1;
+    uint8_t _modesPending:1;
+    uint8_t _pullupsPending:1;
+  };
   // Target interval between refreshes of each input port
   static const int _portTickTime = 4000; // 4ms
 
@@ -91,6 +103,7 @@ GPIOBase<T>::GPIOBase(FSH *deviceName, VPIN firstVpin, uint8_t nPins, I2CAddress
   _portPullup = -1; // default to pullup enabled
   _portInputState = -1;  // default to all inputs high (inactive)
   _portInUse = 0;  // No ports in use initially.
+  _outputsPending = _modesPending = _pullupsPending = 0;
 }
 
 template <class T>
@@ -100,7 +113,7 @@ void GPIOBase<T>::_begin() {
     pinMode(_gpioInterruptPin, INPUT_PULLUP);
 
   I2CManager.begin();
-  I2CManager.setClock(400000);
+  I2CManager.setClock(_I2CAddress, 400000);
   if (I2CManager.exists(_I2CAddress)) {
 #if defined(DIAG_IO)
     _display();
@@ -135,13 +148,26 @@ bool GPIOBase<T>::_configure(VPIN vpin, ConfigTypeEnum configType, int paramCoun
   _portMode &= ~mask;
 
   // Call subclass's virtual function to write to device
-  _writePortModes();
-  _writePullups();
+  if (_writeBatching) 
+    _modesPending = _pullupsPending = 1;
+  else {
+    _writePortModes();
+    _writePullups();
+  }
   // Port change will be notified on next loop entry.
 
   return true;
 }
 
+// Send the writes held back during a write batch.
+template <class T>
+void GPIOBase<T>::_flushWrites() {
+  if (_modesPending) _writePortModes();
+  if (_pullupsPending) _writePullups();
+  if (_outputsPending) _writeGpioPort();
+  _modesPending = _pullupsPending = _outputsPending = 0;
+}
+
 // Periodically read the input port
 template <class T>
 void GPIOBase<T>::_loop(unsigned long currentMicros) {
@@ -179,16 +205,15 @@ void GPIOBase<T>::_loop(unsigned long currentMicros) {
     #endif
   }
 
-  // Check if interrupt configured.  If not, or if it is active (pulled down), then
-  //  initiate a scan.
-  if (_gpioInterruptPin < 0 || !digitalRead(_gpioInterruptPin)) {
+  // Check if interrupt configured.  If not, or if it is active (pulled down), 
+  //  or the safety refresh is due, then initiate a scan.
+  if (_deviceState == DEVSTATE_NORMAL && gpioScanDue(currentMicros, _lastScanMicros)) {
     // TODO: Could suppress reads if there are no pins configured as inputs!
 
     // Read input
-    if (_deviceState == DEVSTATE_NORMAL) {
-      _readGpioPort(false);  // Initiate non-blocking read
-      _deviceState= DEVSTATE_SCANNING;
-    }
+    _readGpioPort(false);  // Initiate non-blocking read
+    _deviceState= DEVSTATE_SCANNING;
+    _lastScanMicros = currentMicros;
   }
   // Delay next entry until tick elapsed.
   delayUntil(currentMicros + _portTickTime);
@@ -212,7 +237,10 @@ void GPIOBase<T>::_write(VPIN vpin, int value) {
   if (!(_portMode & mask)) {
     _portInUse |= mask;
     _portMode |= mask;
-    _writePortModes();
+    if (_writeBatching) 
+      _modesPending = 1;
+    else
+      _writePortModes();
   }
 
   // Update port output state
@@ -222,9 +250,51 @@ void GPIOBase<T>::_write(VPIN vpin, int value) {
     _portOutputState &= ~mask;
 
   // Call subclass's virtual function to write to device.
+  if (_writeBatching) {
+    _outputsPending = 1;
+    return;
+  }
   return _writeGpioPort();
 }
 
+// Write pins vpin+n, for bit n set in mask, to bit n of values with one
+// device write.  Pins past the end of this device are left out.
+template <class T>
+void GPIOBase<T>::_writeMasked(VPIN vpin, uint32_t mask, uint32_t values) {
+  int pin = vpin - _firstVpin;
+  int count = _nPins - pin;
+  if (count < 32) mask &= ((uint32_t)1 << count) - 1;
+  T portMask = (T)(mask << pin);
+  T portValues = (T)((values & mask) << pin);
+  #ifdef DIAG_IO
+  DIAG(F("%S I2C:%s Write Mask:%x Val:%x"), _deviceName, _I2CAddress.toString(), portMask, portValues);
+  #endif
+
+  // Set port mode output for any pins not already output
+  if ((_portMode & portMask) != portMask) {
+    _portInUse |= portMask;
+    _portMode |= portMask;
+    if (_writeBatching) 
+      _modesPending = 1;
+    else
+      _writePortModes();
+  }
+  _portOutputState = (_portOutputState & ~portMask) | portValues;
+  if (_writeBatching) 
+    _outputsPending = 1;
+  else
+    _writeGpioPort();
+}
+
+template <class T>
+VPIN GPIOBase<T>::_writeRange(VPIN vpin, int value, int count) {
+  int pin = vpin - _firstVpin;
+  if (count > _nPins - pin) count = _nPins - pin;
+  uint32_t mask = (count >= 32) ? 0xFFFFFFFFUL : ((uint32_t)1 << count) - 1;
+  _writeMasked(vpin, mask, value ? mask : 0);
+  return vpin + count;
+}
+
 template <class T>
 int GPIOBase<T>::_read(VPIN vpin) {
   int pin = vpin - _firstVpin;
@@ -247,4 +317,19 @@ int GPIOBase<T>::_read(VPIN vpin) {
   return (_portInputState & mask) ? 0 : 1;  // Invert state (5v=0, 0v=1)
 }
 
+// Read several pins from the port state in one go.  Pins not yet
+// in use as inputs are set up by _read() first.
+template <class T>
+VPIN GPIOBase<T>::_readRange(VPIN vpin, int count, uint32_t &bits) {
+  int pin = vpin - _firstVpin;
+  if (count > _nPins - pin) count = _nPins - pin;
+  T mask = (T)((((uint32_t)1 << count) - 1) << pin);
+  if ((_portMode | ~_portInUse) & mask) {
+    for (int i = 0; i < count; i++) 
+      if (((_portMode | ~_portInUse) >> (pin + i)) & 1) _read(vpin + i);
+  }
+  bits = ((uint32_t)(T)~_portInputState & mask) >> pin;  // Invert state (5v=0, 0v=1)
+  return vpin + count;
+}
+
 #endif
@@ -45,6 +45,12 @@
  * And 58us corresponds to 1cm in the calculation, so the effect of
  * interrupts is negligible.
  *
+ * Where the echo pin can take an interrupt (attachInterrupt), up to
+ * HCSR04_IRQ_SLOTS sensors have the echo edges timestamped by an interrupt
+ * instead, so _loop only sends the trigger pulse and later picks up the
+ * result, without waiting for the echo. Other sensors, and all sensors on
+ * ESP32 (whose handlers would have to be in IRAM), use the polling below.
+ *
  * Note: The timing accuracy required for measuring the pulse length means that
  * the pins have to be direct Arduino pins; GPIO pins on an IO Extender cannot
  * provide the required accuracy.
@@ -69,6 +75,12 @@
 
 #include "IODevice.h"
 
+#if !defined(ARDUINO_ARCH_ESP32)
+#define HCSR04_IRQ_SLOTS 4
+#else
+#define HCSR04_IRQ_SLOTS 0
+#endif
+
 class HCSR04 : public IODevice {
 
 private:
@@ -90,10 +102,48 @@ private:
   const uint16_t maxPermittedLoopTime = 10 * factor; // max in us
   unsigned long _startTime = 0;
   unsigned long _maxTime = 0;
-  enum {DORMANT, MEASURING}; // _state values
+  enum {DORMANT, MEASURING, IRQ_WAIT}; // _state values
   uint8_t _state = DORMANT;
   uint8_t _counter = 0;
   uint16_t _options = 0;
+#if HCSR04_IRQ_SLOTS > 0
+  // Echo times taken by echoEdge(), rising edge then falling edge.
+  volatile unsigned long _edgeTime[2];
+  volatile uint8_t _edges = 0;
+  bool _useIrq = false;
+
+  static HCSR04 **irqDevices() {
+    static HCSR04 *devices[HCSR04_IRQ_SLOTS] = {};
+    return devices;
+  }
+  template <uint8_t SLOT> static void echoInterrupt() {
+    HCSR04 *dev = irqDevices()[SLOT];
+    if (dev) dev->echoEdge();
+  }
+  void echoEdge() {
+    if (_edges < 2) _edgeTime[_edges++] = micros();
+  }
+  // Take an interrupt slot for the echo pin if it has an interrupt.
+  bool attachEcho() {
+    int interrupt = digitalPinToInterrupt(_echoPin);
+    if (interrupt < 0) return false;  // NOT_AN_INTERRUPT
+    HCSR04 **devices = irqDevices();
+    for (uint8_t slot = 0; slot < HCSR04_IRQ_SLOTS; slot++) {
+      if (devices[slot] && devices[slot] != this) continue;
+      devices[slot] = this;
+      void (*handler)() = NULL;
+      switch (slot) {
+        case 0: handler = echoInterrupt<0>; break;
+        case 1: handler = echoInterrupt<1>; break;
+        case 2: handler = echoInterrupt<2>; break;
+        default: handler = echoInterrupt<3>; break;
+      }
+      attachInterrupt(interrupt, handler, CHANGE);
+      return true;
+    }
+    return false;
+  }
+#endif
 
 public:
   enum Options {
@@ -124,6 +174,9 @@ protected:
     pinMode(_trigPin, OUTPUT);
     pinMode(_echoPin, INPUT);
     ArduinoPins::fastWriteDigital(_trigPin, 0);
+#if HCSR04_IRQ_SLOTS > 0
+    if (!(_options & LOOP)) _useIrq = attachEcho();
+#endif
 #if defined(DIAG_IO)
     _display();
 #endif
@@ -140,6 +193,36 @@ protected:
     return _distance;
   }
 
+  // Echo pulse completed; check if pulse length is below threshold and if so set value.
+  void echoEnded(unsigned long waitTime) {
+    if (waitTime <= factor * _onThreshold) {
+      // Measured time is within the onThreshold, so value is one.
+      _value = 1;
+      // If the new distance value is less than the current, use it immediately.
+      // But if the new distance value is longer, then it may be erroneously long
+      // (because of extended loop times delays), so apply a delay to distance increases.
+      uint16_t estimatedDistance = waitTime / factor;
+      if (estimatedDistance < _distance) 
+        _distance = estimatedDistance;
+      else
+        _distance += 1;  // Just increase distance slowly.
+      _counter = 0;
+      //DIAG(F("HCSR04: Pulse Len=%l Distance=%d"), waitTime, _distance);
+    }
+  }
+
+  // Pulse length longer than maxTime, value is provisionally zero.
+  // But don't change _value unless provisional value is zero for 10 consecutive measurements
+  void echoTooLong() {
+    if (_value == 1) {
+      if (++_counter >= 10) {
+        _value = 0;
+        _distance = 32767;
+        _counter = 0;
+      }
+    }
+  }
+
   // _loop function - read HC-SR04 once every 100 milliseconds.
   void _loop(unsigned long currentMicros) override {
     unsigned long waitTime;
@@ -149,9 +232,22 @@ protected:
         if (ArduinoPins::fastReadDigital(_echoPin)) return;
 
         // Send 10us pulse to trigger transmitter
+#if HCSR04_IRQ_SLOTS > 0
+        _edges = 0;
+#endif
         ArduinoPins::fastWriteDigital(_trigPin, 1);
         delayMicroseconds(10);
         ArduinoPins::fastWriteDigital(_trigPin, 0);
+#if HCSR04_IRQ_SLOTS > 0
+        if (_useIrq) {
+          // The interrupt times the echo, come back when it should be over.
+          _startTime = micros();
+          _maxTime = 1000 + factor * _offThreshold;
+          _state = IRQ_WAIT;
+          delayUntil(currentMicros + 1000);
+          return;
+        }
+#endif
 
         // Wait, with timeout, for echo pin to become set.
         // Measured time delay is just under 500us, so 
@@ -186,36 +282,14 @@ protected:
         do {
           waitTime = micros() - _startTime;
           if (!ArduinoPins::fastReadDigital(_echoPin)) {
-            // Echo pulse completed; check if pulse length is below threshold and if so set value.
-            if (waitTime <= factor * _onThreshold) {
-              // Measured time is within the onThreshold, so value is one.
-              _value = 1;
-              // If the new distance value is less than the current, use it immediately.
-              // But if the new distance value is longer, then it may be erroneously long
-              // (because of extended loop times delays), so apply a delay to distance increases.
-              uint16_t estimatedDistance = waitTime / factor;
-              if (estimatedDistance < _distance) 
-                _distance = estimatedDistance;
-              else
-                _distance += 1;  // Just increase distance slowly.
-              _counter = 0;
-              //DIAG(F("HCSR04: Pulse Len=%l Distance=%d"), waitTime, _distance);
-            }
+            echoEnded(waitTime);
             _state = DORMANT;
           } else {
             // Echo pulse hasn't finished, so check if maximum time has elapsed
             // If pulse is too long then set return value to zero,
             //  and finish without waiting for end of pulse.
             if (waitTime > _maxTime) {
-              // Pulse length longer than maxTime, value is provisionally zero.
-              // But don't change _value unless provisional value is zero for 10 consecutive measurements
-              if (_value == 1) {
-                if (++_counter >= 10) {
-                  _value = 0;
-                  _distance = 32767;
-                  _counter = 0;
-                }
-              }
+              echoTooLong();
               _state = DORMANT; // start again
             }
           }
@@ -226,6 +300,22 @@ protected:
           if (!(_options & LOOP) && remainingTime < maxPermittedLoopTime) return;
         } while (_state == MEASURING) ;
         break;
+
+#if HCSR04_IRQ_SLOTS > 0
+      case IRQ_WAIT: // Pick up the pulse timed by echoInterrupt
+        if (_edges == 2) {
+          echoEnded(_edgeTime[1] - _edgeTime[0]);
+          _state = DORMANT;
+        } else if (micros() - _startTime > _maxTime) {
+          // no echo, or one longer than the off threshold
+          if (_edges == 1) echoTooLong();
+          _state = DORMANT;
+        } else {
+          delayUntil(currentMicros + 1000);
+          return;
+        }
+        break;
+#endif
     }
     // Datasheet recommends a wait of at least 60ms between measurement cycles
     if (_state == DORMANT)
@@ -234,8 +324,13 @@ protected:
   }
 
   void _display() override {
-    DIAG(F("HCSR04 Configured on VPIN:%u TrigPin:%d EchoPin:%d On:%dcm Off:%dcm"),
-      _firstVpin, _trigPin, _echoPin, _onThreshold, _offThreshold);
+    DIAG(F("HCSR04 Configured on VPIN:%u TrigPin:%d EchoPin:%d On:%dcm Off:%dcm%S"),
+      _firstVpin, _trigPin, _echoPin, _onThreshold, _offThreshold,
+#if HCSR04_IRQ_SLOTS > 0
+      _useIrq ? F(" (interrupt)") : F(""));
+#else
+      F(""));
+#endif
   }
 
 };
@@ -35,7 +35,7 @@
  * 
  * myHall.cpp configuration syntax:
  * 
- * I2CDFPlayer::create(1st vPin, vPins, I2C address, xtal);
+ * I2CDFPlayer::create(1st vPin, vPins, I2C address, xtal [, irq pin]);
  * 
  * Parameters:
  * 1st vPin     : First virtual pin that EX-Rail can control to play a sound, use PLAYSOUND command (alias of ANOUT)
@@ -43,9 +43,15 @@
  *                1st vPin for UART 0, 2nd for UART 1
  * I2C Address  : I2C address of the serial controller, in 0x format
  * xtal         : 0 for 1,8432Mhz, 1 for 14,7456Mhz
+ * irq pin      : optional Arduino pin wired to the SC16IS752 IRQ output. The RX FIFO is then
+ *                only read when the UART signals data, instead of every 10ms
  * 
  * The vPin is also a pin that can be read, it indicate if the DFPlayer has finished playing a track
  *
+ * After _begin, all I2C traffic from _loop goes through a single queued I2CRB with one
+ * request in flight, so the driver never waits on the bus. The bus clock is left to
+ * the other devices and I2CManager.
+ *
  */
 
 #ifndef IO_I2CDFPlayer_h
@@ -106,8 +112,15 @@ private:
   bool _daconCmd = false;
   uint8_t _audioMixer = 0x01; // Default to output amplifier 1
   bool _setamCmd = false; // Set the Audio mixer channel
-  uint8_t _outbuffer [11]; // DFPlayer command is 10 bytes + 1 byte register address & UART channel
+  uint8_t _outbuffer [11]; // Register access during initialisation
+  uint8_t _txbuffer [11]; // DFPlayer command is 10 bytes + 1 byte register address & UART channel
+  uint8_t _regbuffer [2]; // Register address and value for queued register access
   uint8_t _inbuffer[10]; // expected DFPlayer return 10 bytes
+  uint8_t _gpioState = 0; // Last value written to IOSTATE
+  int _irqPin;
+  // Queued request on _rb whose result _loop handles next
+  enum : uint8_t {IO_IDLE, IO_RXLEVEL, IO_RXDATA, IO_TXLEVEL};
+  uint8_t _ioState = IO_IDLE;
    
   unsigned long _sc16is752_xtal_freq;
   unsigned long SC16IS752_XTAL_FREQ_LOW = 1843200; // To support cheap eBay/AliExpress SC16IS752 boards
@@ -115,10 +128,11 @@ private:
    
 public:
   // Constructor
-   I2CDFPlayer(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint8_t xtal){
+   I2CDFPlayer(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint8_t xtal, int irqPin){
     _firstVpin = firstVpin;
     _nPins = nPins;
     _I2CAddress = i2cAddress;
+    _irqPin = irqPin;
     if (xtal == 0){
       _sc16is752_xtal_freq = SC16IS752_XTAL_FREQ_LOW;
     } else { // should be 1
@@ -128,14 +142,15 @@ public:
    } 
   
 public:
-  static void create(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint8_t xtal) {
-    if (checkNoOverlap(firstVpin, nPins, i2cAddress)) new I2CDFPlayer(firstVpin, nPins, i2cAddress, xtal); 
+  static void create(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint8_t xtal, int irqPin=-1) {
+    if (checkNoOverlap(firstVpin, nPins, i2cAddress)) new I2CDFPlayer(firstVpin, nPins, i2cAddress, xtal, irqPin); 
     }
 
   void _begin() override {
     // check if SC16IS752 exist first, initialize and then resume DFPlayer init via SC16IS752
+    if (_irqPin >= 0)
+      pinMode(_irqPin, INPUT_PULLUP);  // IRQ output is open drain, active low
     I2CManager.begin();
-    I2CManager.setClock(1000000);
     if (I2CManager.exists(_I2CAddress)){
       DIAG(F("SC16IS752 I2C:%s UART detected"), _I2CAddress.toString());
       Init_SC16IS752(); // Initialize UART
@@ -158,66 +173,104 @@ public:
   
   
   void _loop(unsigned long currentMicros) override {
-    // Read responses from device
+    if (_rb.isBusy()) return;  // Busy, so don't do anything
     uint8_t status = _rb.status;
-    if (status == I2C_STATUS_PENDING) return;  // Busy, so don't do anything
-    if (status == I2C_STATUS_OK) { 
-      processIncoming(currentMicros);
-          // Check if a command sent to device has timed out.  Allow 0.5 second for response
-          // added retry counter, sometimes we do not sent keep alive due to other commands sent to DFPlayer
-      if (_awaitingResponse && (int32_t)(currentMicros - _timeoutTime) > 0) { // timeout triggered
-        if(_retryCounter == 0){ // retry counter out of luck, must take the device to failed state     
-          DIAG(F("I2CDFPlayer:%s, DFPlayer not responding on UART channel: 0x%x"), _I2CAddress.toString(), _UART_CH);
-          _deviceState = DEVSTATE_FAILED;
-          _awaitingResponse = false;
-          _playing = false;
-          _retryCounter = RETRYCOUNT;
-        } else { // timeout and retry protection and recovery of corrupt data frames from DFPlayer
-            #ifdef DIAG_I2CDFplayer_playing
-              DIAG(F("I2CDFPlayer: %s, DFPlayer timout, retry counter: %d on UART channel: 0x%x"), _I2CAddress.toString(), _retryCounter, _UART_CH);
-            #endif
-            _timeoutTime = currentMicros + 5000000UL;  // Timeout if no response within 5 seconds// reset timeout
-            _awaitingResponse = false; // trigger sending a keep alive 0x42 in processOutgoing()
-            _retryCounter --; // decrement retry counter                        
-            resetRX_fifo(); // reset the RX fifo as it has corrupt data            
-          }
-      }      
+    if (status != I2C_STATUS_OK) {
+      DIAG(F("SC16IS752: I2C: %s failed %S"), _I2CAddress.toString(), I2CManager.getErrorMessage(status));
+      _deviceState = DEVSTATE_FAILED;
+      _ioState = IO_IDLE;
+      return;
     }
 
-    status = _rb.status;
-    if (status == I2C_STATUS_PENDING) return;  // Busy, try next time
-    if (status == I2C_STATUS_OK) {
-     // Send any commands that need to go.
-      processOutgoing(currentMicros);
-     }
+    // Handle the result of the request that has just completed
+    bool rxPolled = false;
+    switch (_ioState) {
+      case IO_RXLEVEL:
+        FIFO_RX_LEVEL = _inbuffer[0];
+        if (FIFO_RX_LEVEL >= 10) {
+          #ifdef DIAG_I2CDFplayer
+            DIAG(F("I2CDFPlayer: %s Retrieving data from RX Fifo on UART_CH: 0x%x FIFO_RX_LEVEL: %d"),_I2CAddress.toString(), _UART_CH, FIFO_RX_LEVEL); 
+          #endif
+          // Only copy 10 bytes from RX FIFO, there maybe additional partial return data after a track is finished playing in the RX FIFO
+          _regbuffer[0] = REG_RHR << 3 | _UART_CH << 1;
+          I2CManager.read(_I2CAddress, _inbuffer, 10, _regbuffer, 1, &_rb);
+          _ioState = IO_RXDATA;
+          return;
+        }
+        FIFO_RX_LEVEL = 0; //set to 0, we'll read a fresh FIFO_RX_LEVEL next time
+        _ioState = IO_IDLE;
+        rxPolled = true;
+        break;
+      case IO_RXDATA:
+        RX_BUFFER = 10; // We have copied 10 bytes from RX FIFO to _inbuffer
+        processIncoming(currentMicros);
+        _ioState = IO_IDLE;
+        rxPolled = true;
+        break;
+      case IO_TXLEVEL:
+        FIFO_TX_LEVEL = _inbuffer[0];
+        _ioState = IO_IDLE;
+        if (FIFO_TX_LEVEL >= sizeof(_txbuffer)-1) { // room for the whole command
+          I2CManager.write(_I2CAddress, _txbuffer, sizeof(_txbuffer), &_rb);
+          #ifdef DIAG_I2CDFplayer
+           DIAG(F("SC16IS752: I2C: %s data transmit queued on UART: 0x%x"), _I2CAddress.toString(), _UART_CH);
+          #endif
+        } else {
+          DIAG(F("I2CDFPlayer at: %s, TX FIFO not empty on UART: 0x%x"), _I2CAddress.toString(), _UART_CH);
+          _deviceState = DEVSTATE_FAILED; // This should not happen      
+        }
+        return;
+      default:
+        break;
+    }
+
+    // Check if a command sent to device has timed out.
+    // added retry counter, sometimes we do not sent keep alive due to other commands sent to DFPlayer
+    if (_awaitingResponse && (int32_t)(currentMicros - _timeoutTime) > 0) { // timeout triggered
+      if(_retryCounter == 0){ // retry counter out of luck, must take the device to failed state     
+        DIAG(F("I2CDFPlayer:%s, DFPlayer not responding on UART channel: 0x%x"), _I2CAddress.toString(), _UART_CH);
+        _deviceState = DEVSTATE_FAILED;
+        _awaitingResponse = false;
+        _playing = false;
+        _retryCounter = RETRYCOUNT;
+      } else { // timeout and retry protection and recovery of corrupt data frames from DFPlayer
+          #ifdef DIAG_I2CDFplayer_playing
+            DIAG(F("I2CDFPlayer: %s, DFPlayer timout, retry counter: %d on UART channel: 0x%x"), _I2CAddress.toString(), _retryCounter, _UART_CH);
+          #endif
+          _timeoutTime = currentMicros + 5000000UL;  // Timeout if no response within 5 seconds// reset timeout
+          _awaitingResponse = false; // trigger sending a keep alive 0x42 in processOutgoing()
+          _retryCounter --; // decrement retry counter                        
+          resetRX_fifo(); // reset the RX fifo as it has corrupt data            
+          return;
+        }
+    }
+
+    // Read responses from device, once per entry. With an IRQ pin, only when
+    // the UART says there is data.
+    if (!rxPolled && (_irqPin < 0 || digitalRead(_irqPin) == LOW)) {
+      queueReadRegister(REG_RXLV);
+      _ioState = IO_RXLEVEL;
+      return;
+    }
+
+    // Send any commands that need to go.
+    processOutgoing(currentMicros);
     delayUntil(currentMicros + 10000); // Only enter every 10ms    
   }
 
  
   // Check for incoming data, and update busy flag and other state accordingly
  
+  // Called when 10 bytes have been read from the RX FIFO into _inbuffer
   void processIncoming(unsigned long currentMicros) {
+    (void)currentMicros;
     // Expected message is in the form "7E FF 06 3D xx xx xx xx xx EF"
-    RX_fifo_lvl();
-    if (FIFO_RX_LEVEL >= 10) {      
-      #ifdef DIAG_I2CDFplayer
-        DIAG(F("I2CDFPlayer: %s Retrieving data from RX Fifo on UART_CH: 0x%x FIFO_RX_LEVEL: %d"),_I2CAddress.toString(), _UART_CH, FIFO_RX_LEVEL); 
-      #endif
-      _outbuffer[0] = REG_RHR << 3 | _UART_CH << 1;
-      // Only copy 10 bytes from RX FIFO, there maybe additional partial return data after a track is finished playing in the RX FIFO
-      I2CManager.read(_I2CAddress, _inbuffer, 10, _outbuffer, 1); // inbuffer[] has the data now
-      //delayUntil(currentMicros + 10000); // Allow time to get the data
-      RX_BUFFER = 10; // We have copied 10 bytes from RX FIFO to _inbuffer
-        #ifdef DIAG_I2CDFplayer_data
-          DIAG(F("SC16IS752: At I2C: %s, UART channel: 0x%x, RX FIFO Data"), _I2CAddress.toString(), _UART_CH);
-          for (int i = 0; i < sizeof _inbuffer; i++){
-            DIAG(F("SC16IS752: Data _inbuffer[0x%x]: 0x%x"), i, _inbuffer[i]);  
-          }
-        #endif       
-    } else {
-        FIFO_RX_LEVEL = 0; //set to 0, we'll read a fresh FIFO_RX_LEVEL next time
-        return; // No data or not enough data in rx fifo, check again next time around
+    #ifdef DIAG_I2CDFplayer_data
+      DIAG(F("SC16IS752: At I2C: %s, UART channel: 0x%x, RX FIFO Data"), _I2CAddress.toString(), _UART_CH);
+      for (int i = 0; i < sizeof _inbuffer; i++){
+        DIAG(F("SC16IS752: Data _inbuffer[0x%x]: 0x%x"), i, _inbuffer[i]);  
       }
+    #endif       
 
     
     bool ok = false;
@@ -367,6 +420,7 @@ public:
         _eqCmd = false;
       } else if (_setamCmd == true){ // Set Audio mixer channel
          setGPIO(); // Set the audio mixer channel
+         queueWriteRegister(REG_IOSTATE, _gpioState);
          /*        
           if (_audioMixer == 1){ // set to audio mixer 1       
             if (_UART_CH == 0){ 
@@ -548,30 +602,22 @@ private:
 
     setChecksum(out);
 
-      // Prepend the DFPlayer command with REG address and UART Channel in _outbuffer
-      _outbuffer[0] = REG_THR << 3 | _UART_CH << 1; //TX FIFO and UART Channel      
+      // Prepend the DFPlayer command with REG address and UART Channel in _txbuffer
+      _txbuffer[0] = REG_THR << 3 | _UART_CH << 1; //TX FIFO and UART Channel      
       for ( int i = 1; i < sizeof(out)+1 ; i++){
-        _outbuffer[i] = out[i-1];
+        _txbuffer[i] = out[i-1];
       }
 
       #ifdef DIAG_I2CDFplayer_data
        DIAG(F("SC16IS752: I2C: %s Sent packet function"), _I2CAddress.toString());
-       for (int i = 0; i < sizeof _outbuffer; i++){
-        DIAG(F("SC16IS752: Data _outbuffer[0x%x]: 0x%x"), i, _outbuffer[i]);  
+       for (int i = 0; i < sizeof _txbuffer; i++){
+        DIAG(F("SC16IS752: Data _txbuffer[0x%x]: 0x%x"), i, _txbuffer[i]);  
        }
       #endif
       
-    TX_fifo_lvl();
-    if(FIFO_TX_LEVEL > 0){ //FIFO is empty
-      I2CManager.write(_I2CAddress, _outbuffer, sizeof(_outbuffer), &_rb);
-      //I2CManager.write(_I2CAddress, _outbuffer, sizeof(_outbuffer));
-      #ifdef DIAG_I2CDFplayer
-       DIAG(F("SC16IS752: I2C: %s data transmit complete on UART: 0x%x"), _I2CAddress.toString(), _UART_CH);
-      #endif
-    } else {
-      DIAG(F("I2CDFPlayer at: %s, TX FIFO not empty on UART: 0x%x"), _I2CAddress.toString(), _UART_CH);
-      _deviceState = DEVSTATE_FAILED; // This should not happen      
-    }
+    // Check the TX FIFO has room, _loop then queues the packet write
+    queueReadRegister(REG_TXLV);
+    _ioState = IO_TXLEVEL;
     _commandSendTime = micros();
   }
 
@@ -621,8 +667,9 @@ private:
     TEMP_REG_VAL = 0xFF; //Set all pins as output
     UART_WriteRegister(REG_IODIR, TEMP_REG_VAL);
     UART_ReadRegister(REG_IOSTATE); // Read current state as not to overwrite the other GPIO pins
-    TEMP_REG_VAL = _inbuffer[0];
+    _gpioState = _inbuffer[0];
     setGPIO(); // Set the audio mixer channel
+    UART_WriteRegister(REG_IOSTATE, _gpioState);
     /*
     if (_UART_CH == 0){ // Set Audio mixer channel
       TEMP_REG_VAL |= (0x01 << _UART_CH); //Set GPIO pin 0 to high
@@ -631,8 +678,9 @@ private:
     }
     UART_WriteRegister(REG_IOSTATE, TEMP_REG_VAL);
     */
-    TEMP_REG_VAL = 0x07; // Reset FIFO, clear RX & TX FIFO
+    TEMP_REG_VAL = 0x07; // Reset FIFO, clear RX & TX FIFO, RX trigger level 8 characters
     UART_WriteRegister(REG_FCR, TEMP_REG_VAL);
+    if (_irqPin >= 0) UART_WriteRegister(REG_IER, 0x01); // IRQ on RX data or RX timeout
     TEMP_REG_VAL = 0x00; // Set MCR to all 0, includes Clock divisor
     UART_WriteRegister(REG_MCR, TEMP_REG_VAL);
     TEMP_REG_VAL = 0x80 | WORD_LEN | STOP_BIT | PARITY_ENA | PARITY_TYPE;
@@ -656,21 +704,6 @@ private:
   }
 
   
-  // Read the Receive FIFO Level register (RXLVL), return a single unsigned integer
-  // of nr of characters in the RX FIFO, bit 6:0, 7 not used, set to zero
-  // value from 0 (0x00) to 64 (0x40) Only display if RX FIFO has data
-  // The RX fifo level is used to check if there are enough bytes to process a frame
-  void RX_fifo_lvl(){
-    UART_ReadRegister(REG_RXLV);
-    FIFO_RX_LEVEL = _inbuffer[0];
-    #ifdef DIAG_I2CDFplayer
-     if (FIFO_RX_LEVEL > 0){
-     //if (FIFO_RX_LEVEL > 0 && FIFO_RX_LEVEL < 10){
-      DIAG(F("SC16IS752: At I2C: %s, UART channel: 0x%x, FIFO_RX_LEVEL: 0d%d"), _I2CAddress.toString(), _UART_CH, _inbuffer[0]);
-    }
-    #endif   
-  }
-
   // When a frame is transmitted from the DFPlayer to the serial port, and at the same time the CS is sending a 42 query
   // the following two frames from the DFPlayer are corrupt. This result in the receive buffer being out of sync and the 
   // CS will complain and generate a timeout.
@@ -681,15 +714,16 @@ private:
       DIAG(F("SC16IS752: At I2C: %s, UART channel: 0x%x, RX fifo reset"), _I2CAddress.toString(), _UART_CH);
     #endif    
     TEMP_REG_VAL = 0x03; // Reset RX fifo
-    UART_WriteRegister(REG_FCR, TEMP_REG_VAL);
+    queueWriteRegister(REG_FCR, TEMP_REG_VAL);
   }
 
   // Set or reset GPIO pin 0 and 1 depending on the UART ch
   // This function may be modified in a future release to enable all 8 pins to be set or reset with EX-Rail
   // for various auxilary functions
+  // The IOSTATE value is kept in _gpioState rather than read back each time; the
+  // caller writes it (queued from _loop).
   void setGPIO(){
-    UART_ReadRegister(REG_IOSTATE); // Get the current GPIO pins state from the IOSTATE register
-    TEMP_REG_VAL = _inbuffer[0];
+    TEMP_REG_VAL = _gpioState;
     if (_audioMixer == 1){ // set to audio mixer 1
       if (_UART_CH == 0){ 
         TEMP_REG_VAL |= (0x01 << _UART_CH); //Set GPIO pin 0 to high
@@ -703,24 +737,11 @@ private:
            TEMP_REG_VAL &= ~(0x01 << _UART_CH); //Set GPIO pin 1 to Low
           }
       }    
-    UART_WriteRegister(REG_IOSTATE, TEMP_REG_VAL);
+    _gpioState = TEMP_REG_VAL;
     _setamCmd = false;  
   }
   
 
-  // Read the Tranmit FIFO Level register (TXLVL), return a single unsigned integer
-  // of nr characters free in the TX FIFO, bit 6:0, 7 not used, set to zero
-  // value from 0 (0x00) to 64 (0x40)
-  //
-  void TX_fifo_lvl(){
-    UART_ReadRegister(REG_TXLV);
-    FIFO_TX_LEVEL = _inbuffer[0];
-    #ifdef DIAG_I2CDFplayer
-    //  DIAG(F("SC16IS752: At I2C: %s, UART channel: 0x%x, FIFO_TX_LEVEL: 0d%d"), _I2CAddress.toString(), _UART_CH, FIFO_TX_LEVEL);
-    #endif 
-  }
-
-
   //void UART_WriteRegister(I2CAddress _I2CAddress, uint8_t _UART_CH, uint8_t UART_REG, uint8_t Val, I2CRB &_rb){
   void UART_WriteRegister(uint8_t UART_REG, uint8_t Val){
     _outbuffer[0] = UART_REG << 3 | _UART_CH << 1;
@@ -732,6 +753,20 @@ private:
   }
 
  
+  // Non-blocking versions for _loop, using _regbuffer and _rb. A read
+  // leaves the value in _inbuffer[0] once _rb completes.
+  void queueWriteRegister(uint8_t UART_REG, uint8_t Val){
+    _regbuffer[0] = UART_REG << 3 | _UART_CH << 1;
+    _regbuffer[1] = Val;
+    I2CManager.write(_I2CAddress, _regbuffer, 2, &_rb);
+  }
+
+  void queueReadRegister(uint8_t UART_REG){
+    _regbuffer[0] = UART_REG << 3 | _UART_CH << 1;
+    I2CManager.read(_I2CAddress, _inbuffer, 1, _regbuffer, 1, &_rb);
+  }
+
+  // Blocking register access, used during initialisation only
   void UART_ReadRegister(uint8_t UART_REG){
      _outbuffer[0] = UART_REG << 3 | _UART_CH << 1; // _outbuffer[0] has now UART_REG and UART_CH
      I2CManager.read(_I2CAddress, _inbuffer, 1, _outbuffer, 1);    
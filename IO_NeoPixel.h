@@ -34,6 +34,10 @@
 * This can be written/read with an analog write/read call. 
 * The ON bit can be set on and off with a digital write. This allows for 
 * a pixel to be preset a colour and then turned on and off like any other light. 
+*
+* Writes only mark pixels as changed. The HAL loop sends runs of changed
+* pixels as multi-pixel buffer writes, one non-blocking I2C request per
+* entry, and a single SHOW once they have all gone.
 */
 
 #ifndef IO_EX_NeoPixel_H
@@ -145,6 +149,10 @@ private:
   // all adafruit examples say this pin. Presumably its hard wired 
   // in the adapter anyway. 
   static const byte SEESAW_PIN15 = 15;
+
+  // Pixel data bytes per buffer write, so that the 4 byte header plus
+  // data fits the 32 byte Wire and seesaw buffers.
+  static const byte MAX_RUN_BYTES = 28;
   
   // Constructor
   NeoPixel(VPIN firstVpin, int nPins, uint16_t mode, I2CAddress i2cAddress) {
@@ -155,21 +163,23 @@ private:
     // calculate the offsets into the seesaw buffer for each colour depending
     // on the pixel strip type passed in mode.
 
-    _redOffset=4+(mode >> 4 & 0x03);
-    _greenOffset=4+(mode >> 2 & 0x03); 
-    _blueOffset=4+(mode & 0x03); 
-    if (4+(mode >>6 & 0x03) == _redOffset) _bytesPerPixel=3; 
+    _redOffset=(mode >> 4 & 0x03);
+    _greenOffset=(mode >> 2 & 0x03); 
+    _blueOffset=(mode & 0x03); 
+    if ((mode >>6 & 0x03) == _redOffset) _bytesPerPixel=3; 
     else _bytesPerPixel=4; // string has a white byte.
     
     _kHz800=(mode & NEO_KHZ400)==0;
     _showPendimg=false;
+    _nextDirty=_nPins;
     
     // Each pixel requires 3 bytes RGB memory.
     // Although the driver device can remember this, it cant do off/on without
     // forgetting what the on colour was!
     pixelBuffer=(RGB *) malloc(_nPins*sizeof(RGB)); 
     stateBuffer=(byte *) calloc((_nPins+7)/8,sizeof(byte)); // all pixels off  
-    if (pixelBuffer==nullptr || stateBuffer==nullptr) {
+    dirtyBuffer=(byte *) calloc((_nPins+7)/8,sizeof(byte));
+    if (pixelBuffer==nullptr || stateBuffer==nullptr || dirtyBuffer==nullptr) {
       DIAG(F("NeoPixel I2C:%s not enough RAM"), _I2CAddress.toString());
       return;
     }
@@ -200,16 +210,26 @@ private:
     const byte pinbuffer[] = {SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_PIN,SEESAW_PIN15};
     I2CManager.write(_I2CAddress, pinbuffer, sizeof(pinbuffer));
     
-    for (auto pin=0;pin<_nPins;pin++) transmit(pin);
+    // send the whole string from _loop
+    memset(dirtyBuffer,0xFF,(_nPins+7)/8);
+    _nextDirty=0;
      _display();
   }
   
  // loop called by HAL supervisor 
   void _loop(unsigned long currentMicros) override {
     (void)currentMicros;
+    if (_deviceState == DEVSTATE_FAILED) return;
+    if (_requestBlock.isBusy()) return;  // previous write still going
+    if (_requestBlock.status != I2C_STATUS_OK) {
+      reportError(_requestBlock.status);
+      return;
+    }
+    if (transmitRun()) return;
     if (!_showPendimg) return;
-    byte showBuffer[]={SEESAW_NEOPIXEL_BASE,SEESAW_NEOPIXEL_SHOW};
-    I2CManager.write(_I2CAddress,showBuffer,sizeof(showBuffer));
+    _i2cBuffer[0]=SEESAW_NEOPIXEL_BASE;
+    _i2cBuffer[1]=SEESAW_NEOPIXEL_SHOW;
+    I2CManager.write(_I2CAddress,_i2cBuffer,2,&_requestBlock);
     _showPendimg=false;
   }  
   
@@ -232,12 +252,13 @@ private:
       if (!isPixelOn(pixel)) return;
       setPixelOff(pixel);
      }
-     transmit(pixel);
+     setDirty(pixel);
   }
    
   VPIN _writeRange(VPIN vpin,int value, int count) {
     // using write range cuts out the constant vpin to driver lookup so
-    // we can update multiple pixels much faster.
+    // we can update multiple pixels much faster. The pixels are only
+    // marked here, _loop sends them in runs.
     VPIN nextVpin=vpin +  (count>_nPins ? _nPins : count);
     if (_deviceState != DEVSTATE_FAILED) while(vpin<nextVpin) {
       _write(vpin,value);
@@ -257,7 +278,7 @@ private:
       
     if (onoff) setPixelOn(pixel); else setPixelOff(pixel);
     pixelBuffer[pixel]=newColour;
-    transmit(pixel);
+    setDirty(pixel);
   }
  VPIN _writeAnalogueRange(VPIN vpin, int colour_RG, uint8_t onoff, uint16_t colour_B, int count) override {
     // using write range cuts out the constant vpin to driver lookup so
@@ -282,6 +303,12 @@ private:
   bool isPixelOn(int16_t pixel) {return stateBuffer[pixel/8] & (0x80>>(pixel%8));}
   void setPixelOn(int16_t pixel) {stateBuffer[pixel/8] |= (0x80>>(pixel%8));}
   void setPixelOff(int16_t pixel) {stateBuffer[pixel/8] &= ~(0x80>>(pixel%8));}
+  bool isDirty(int16_t pixel) {return dirtyBuffer[pixel/8] & (0x80>>(pixel%8));}
+  void setDirty(int16_t pixel) {
+    dirtyBuffer[pixel/8] |= (0x80>>(pixel%8));
+    if (pixel<_nextDirty) _nextDirty=pixel;
+  }
+  void clearDirty(int16_t pixel) {dirtyBuffer[pixel/8] &= ~(0x80>>(pixel%8));}
   
   // Helper function for error handling
   void reportError(uint8_t status, bool fail=true) {
@@ -292,24 +319,44 @@ private:
   }
 
   
-  void transmit(uint16_t pixel) { 
-    byte buffer[]={SEESAW_NEOPIXEL_BASE,SEESAW_NEOPIXEL_BUF,0x00,0x00,0x00,0x00,0x00};
+  // Send the next run of changed pixels as one buffer write starting at
+  // the first changed pixel. Unchanged pixels within the run are resent
+  // rather than splitting it. Returns false if nothing was left to send.
+  bool transmitRun() {
+    int16_t pixel=_nextDirty;
+    while (pixel<_nPins && !isDirty(pixel)) pixel++;
+    if (pixel>=_nPins) {
+      _nextDirty=_nPins;
+      return false;
+    }
+    int16_t end=pixel + MAX_RUN_BYTES/_bytesPerPixel;
+    if (end>_nPins) end=_nPins;
+    while (!isDirty(end-1)) end--;  // trim unchanged pixels off the end
+
     uint16_t offset= pixel * _bytesPerPixel;
-    buffer[2]=(byte)(offset>>8);
-    buffer[3]=(byte)(offset & 0xFF);
-    
-    if (isPixelOn(pixel)) {
-      auto colour=pixelBuffer[pixel];    
-      buffer[_redOffset]=colour.red;
-      buffer[_greenOffset]=colour.green;
-      buffer[_blueOffset]=colour.blue;
-    } // else leave buffer black (in buffer preset to zeros above)
+    _i2cBuffer[0]=SEESAW_NEOPIXEL_BASE;
+    _i2cBuffer[1]=SEESAW_NEOPIXEL_BUF;
+    _i2cBuffer[2]=(byte)(offset>>8);
+    _i2cBuffer[3]=(byte)(offset & 0xFF);
+    byte * data=_i2cBuffer+4;
+    memset(data,0,(end-pixel)*_bytesPerPixel);
+    for (int16_t p=pixel; p<end; p++, data+=_bytesPerPixel) {
+      clearDirty(p);
+      if (isPixelOn(p)) {
+        auto colour=pixelBuffer[p];    
+        data[_redOffset]=colour.red;
+        data[_greenOffset]=colour.green;
+        data[_blueOffset]=colour.blue;
+      } // else leave pixel black
+    }
+    _nextDirty=end;
     
-    // Transmit pixel to driver
-    I2CManager.write(_I2CAddress,buffer,4 +_bytesPerPixel);
+    // Transmit run to driver
+    I2CManager.write(_I2CAddress,_i2cBuffer,4+(end-pixel)*_bytesPerPixel,&_requestBlock);
     _showPendimg=true;
-  
+    return true;
   }
+
   struct RGB { 
       byte red; 
       byte green; 
@@ -321,7 +368,11 @@ private:
 
   RGB*   pixelBuffer = nullptr;
   byte*  stateBuffer = nullptr;  // 1 bit per pixel
+  byte*  dirtyBuffer = nullptr;  // 1 bit per pixel, changed since sent
+  int16_t _nextDirty;            // no dirty pixels below this one
   bool _showPendimg;
+  I2CRB _requestBlock;
+  byte _i2cBuffer[4+MAX_RUN_BYTES];
   
   // mapping of RGB onto pixel buffer for seesaw.
   byte _bytesPerPixel;
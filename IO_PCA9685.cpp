@@ -94,7 +94,7 @@ PCA9685::PCA9685(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint16_t freq
 // Device-specific initialisation
 void PCA9685::_begin() {
   I2CManager.begin();
-  I2CManager.setClock(1000000); // Nominally able to run up to 1MHz on I2C
+  I2CManager.setClock(_I2CAddress, 1000000); // Nominally able to run up to 1MHz on I2C
           // In reality, other devices including the Arduino will limit 
           // the clock speed to a lower rate.
 
@@ -189,21 +189,39 @@ int PCA9685::_read(VPIN vpin) {
     return (s->stepNumber < s->numSteps);
 }
 
+// All servos on the board are stepped together, then each run of adjacent
+// channels that have changed is sent as one auto-increment write.
 void PCA9685::_loop(unsigned long currentMicros) {
+  int values[16];
+  uint8_t runStart = 0, runLength = 0;
   for (int pin=0; pin<_nPins; pin++) {
-    updatePosition(pin);
+    values[pin] = updatePosition(pin);
   }
+  for (int pin=0; pin<_nPins; pin++) {
+    if (values[pin] >= 0) {
+      if (runLength == 0) runStart = pin;
+      if (++runLength == _burstChannels) {
+        writeDevice(runStart, runLength, &values[runStart]);
+        runLength = 0;
+      }
+    } else if (runLength > 0) {
+      writeDevice(runStart, runLength, &values[runStart]);
+      runLength = 0;
+    }
+  }
+  if (runLength > 0) writeDevice(runStart, runLength, &values[runStart]);
   delayUntil(currentMicros + refreshInterval * 1000UL);
 }
 
-// Private function to reposition servo
+// Private function to reposition servo.  Returns the new PWM value to be 
+// sent to the pin, or -1 if nothing is to be sent.
 // TODO: Could calculate step number from elapsed time, to allow for erratic loop timing.
-void PCA9685::updatePosition(uint8_t pin) {
+int PCA9685::updatePosition(uint8_t pin) {
   struct ServoData *s = _servoData[pin];
   
-  if (s == NULL) return; // No pin configuration/state data
+  if (s == NULL) return -1; // No pin configuration/state data
 
-  if (s->numSteps == 0) return; // No animation in progress
+  if (s->numSteps == 0) return -1; // No animation in progress
 
   if (s->stepNumber == 0 && s->fromPosition == s->toPosition) {
     // Go straight to end of sequence, output final position.
@@ -222,7 +240,7 @@ void PCA9685::updatePosition(uint8_t pin) {
       s->currentPosition = map(s->stepNumber, 0, s->numSteps, s->fromPosition, s->toPosition);
     }
     // Send servo command
-    writeDevice(pin, s->currentPosition);
+    return s->currentPosition;
   } else if (s->stepNumber < s->numSteps + _catchupSteps) {
     // We've finished animation, wait a little to allow servo to catch up
     s->stepNumber++;
@@ -231,18 +249,22 @@ void PCA9685::updatePosition(uint8_t pin) {
 #ifdef IO_SWITCH_OFF_SERVO
     if ((s->currentProfile & NoPowerOff) == 0) {
       // Wait has finished, so switch off PWM to prevent annoying servo buzz
-      writeDevice(pin, 0);
+      s->numSteps = 0;  // Done now.
+      return 0;
     }
 #endif
     s->numSteps = 0;  // Done now.
   }
+  return -1;
 }
 
-// writeDevice takes a pin in range 0 to _nPins-1 within the device, and a value
-// between 0 and 4095 for the PWM mark-to-period ratio, with 4095 being 100%.
-void PCA9685::writeDevice(uint8_t pin, int value) {
+// writeDevice takes the first of 'count' adjacent pins (0 to _nPins-1 within 
+// the device), and for each a value between 0 and 4095 for the PWM 
+// mark-to-period ratio, with 4095 being 100%.  The PCA9685 auto-increments 
+// the register address, so all pins are written in one request.
+void PCA9685::writeDevice(uint8_t firstPin, uint8_t count, const int values[]) {
   #ifdef DIAG_IO
-  DIAG(F("PCA9685 I2C:%s WriteDevice Pin:%d Value:%d"), _I2CAddress.toString(), pin, value);
+  DIAG(F("PCA9685 I2C:%s WriteDevice Pin:%d Count:%d Value:%d"), _I2CAddress.toString(), firstPin, count, values[0]);
   #endif
   // Wait for previous request to complete
   uint8_t status = requestBlock.wait();
@@ -251,11 +273,16 @@ void PCA9685::writeDevice(uint8_t pin, int value) {
     DIAG(F("PCA9685 I2C:%s failed %S"), _I2CAddress.toString(), I2CManager.getErrorMessage(status));
   } else {
     // Set up new request.
-    outputBuffer[0] = PCA9685_FIRST_SERVO + 4 * pin;
-    outputBuffer[1] = 0;
-    outputBuffer[2] = (value == 4095 ? 0x10 : 0);  // 4095=full on
-    outputBuffer[3] = value & 0xff;
-    outputBuffer[4] = value >> 8;
+    uint8_t *ptr = outputBuffer;
+    *ptr++ = PCA9685_FIRST_SERVO + 4 * firstPin;
+    for (uint8_t i=0; i<count; i++) {
+      int value = values[i];
+      *ptr++ = 0;
+      *ptr++ = (value == 4095 ? 0x10 : 0);  // 4095=full on
+      *ptr++ = value & 0xff;
+      *ptr++ = value >> 8;
+    }
+    requestBlock.setWriteParams(_I2CAddress, outputBuffer, ptr - outputBuffer);
     I2CManager.queueRequest(&requestBlock);
   }
 }
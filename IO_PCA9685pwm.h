@@ -96,7 +96,7 @@ private:
   // Device-specific initialisation
   void _begin() override {
     I2CManager.begin();
-    I2CManager.setClock(1000000); // Nominally able to run up to 1MHz on I2C
+    I2CManager.setClock(_I2CAddress, 1000000); // Nominally able to run up to 1MHz on I2C
             // In reality, other devices including the Arduino will limit 
             // the clock speed to a lower rate.
 
@@ -70,7 +70,9 @@
  * HAL(TCA8418, 300, 80, 0x34, D21)
  * 
  * Note that using an interrupt pin speeds up button press acquisition considerably (less than a millisecond vs 10-100),
- * but even with interrupts enabled the code presently checks every 100ms in case the interrupt pin becomes disconnected.
+ * and the device is then only read while INT is asserted, so an untouched keypad uses no bus time at all.
+ * Without one, the event counter is polled every 10ms. Either way all waiting key events are taken from
+ * the FIFO in one burst read.
  * Use any available Arduino pin for interrupt monitoring.
  */
  
@@ -91,14 +93,14 @@ private:
 
   unsigned long _lastEventRead = 0;
   unsigned long _eventRefresh = 10000UL;    // Delay refreshing events for 10ms
-  const unsigned long _eventRefreshSlow = 100000UL;   // Delay refreshing events for 100ms
   bool _gpioInterruptsEnabled = false;
 
-  uint8_t _inputBuffer[1];
-  uint8_t _commandBuffer[1];
+  static const uint8_t FIFO_SIZE = 10;       // Key event FIFO depth
+  uint8_t _inputBuffer[FIFO_SIZE];
+  uint8_t _commandBuffer[2];
   I2CRB _i2crb;
 
-  enum {RDS_IDLE, RDS_EVENT, RDS_KEYCODE};  // Read operation states
+  enum {RDS_IDLE, RDS_EVENT, RDS_KEYCODE, RDS_CLEAR};  // Read operation states
   uint8_t _readState = RDS_IDLE;
 
   // Constructor
@@ -109,6 +111,7 @@ private:
       _nPins = nPins;
       _I2CAddress = i2cAddress;
       _gpioInterruptPin = interruptPin;
+      _hasCallback = true;  // key changes are notified from _loop
       addDevice(this);
     }
   }
@@ -164,7 +167,6 @@ private:
     if (_gpioInterruptPin >= 0) {
       DIAG(F("TCA8418 I2C: interrupt pin configured on %d"), _gpioInterruptPin);
       _gpioInterruptsEnabled = true;
-      _eventRefresh = _eventRefreshSlow; // Switch to slower manual refreshes in case the INT pin isn't connected!
       pinMode(_gpioInterruptPin, INPUT_PULLUP);
       I2CManager.write(_I2CAddress, 2, REG_CFG, REG_CFG_KE_IEN);
       // Clear any pending interrupts
@@ -202,56 +204,55 @@ private:
         // First check if we have any key events waiting
         if (_readState == RDS_EVENT) {
           if ((_numKeyEvents = (_inputBuffer[0] & 0x0F)) != 0) {
-            // We could read each key event waiting in a synchronous loop, which may prove preferable
-            // but for now, schedule an async read of the first key event in the queue
+            if (_numKeyEvents > FIFO_SIZE) _numKeyEvents = FIFO_SIZE;
+            // Read all waiting events in one go. With auto-increment off (REG_CFG AI=0)
+            // each byte read from KEY_EVENT_A takes the next event off the FIFO.
             _commandBuffer[0] = REG_KEY_EVENT_A;
-            I2CManager.read(_I2CAddress, _inputBuffer, 1, _commandBuffer, 1, &_i2crb);  // non-blocking read
+            I2CManager.read(_I2CAddress, _inputBuffer, _numKeyEvents, _commandBuffer, 1, &_i2crb);  // non-blocking read
             _readState = RDS_KEYCODE; // Shift to reading key events!
           }
           else // We found no key events waiting, return to IDLE
             _readState = RDS_IDLE;
         }
-         else {
-          // RDS_KEYCODE
-          uint8_t key = _inputBuffer[0] & 0x7F;
-          bool keyDown = _inputBuffer[0] & 0x80;
-          // Check for just keypad events
-          key--; // R0/C0 is key #1, so subtract 1 to create an array offset
-          // We only want to record key events we're configured for, as we have calloc'd an
-          // appropriately sized _digitalInputStates array!
-          if (key < _nPins) {
-            if (keyDown)
-              _digitalInputStates[key / 8] |= (1 << (key % 8));
+        else if (_readState == RDS_KEYCODE) {
+          for (uint8_t event = 0; event < _numKeyEvents; event++) {
+            uint8_t key = _inputBuffer[event] & 0x7F;
+            bool keyDown = _inputBuffer[event] & 0x80;
+            // Check for just keypad events
+            key--; // R0/C0 is key #1, so subtract 1 to create an array offset
+            // We only want to record key events we're configured for, as we have calloc'd an
+            // appropriately sized _digitalInputStates array!
+            if (key < _nPins) {
+              if (keyDown)
+                _digitalInputStates[key / 8] |= (1 << (key % 8));
+              else
+                _digitalInputStates[key / 8] &= ~(1 << (key % 8));
+              if (IONotifyCallback::hasCallback())
+                IONotifyCallback::invokeAll(_firstVpin + key, keyDown);
+            }
             else
-              _digitalInputStates[key / 8] &= ~(1 << (key % 8));
+              DIAG(F("TCA8418 I2C: key event %d discarded, outside Vpin range"), key);
           }
-          else
-            DIAG(F("TCA8418 I2C: key event %d discarded, outside Vpin range"), key);
-          _numKeyEvents--; // One less key event to get
-          if (_numKeyEvents != 0)
-          {
-            // DIAG(F("TCA8418 I2C: more keys in read event queue, # waiting is: %x"), _numKeyEvents);
-            // We could read each key event waiting in a synchronous loop, which may prove preferable
-            // but for now, schedule an async read of the first key event in the queue
-            _commandBuffer[0] = REG_KEY_EVENT_A;
-            I2CManager.read(_I2CAddress, _inputBuffer, 1, _commandBuffer, 1, &_i2crb); // non-blocking read
-          }
-          else {
-            // DIAG(F("TCA8418 I2C: no more keys in read event queue"));
-            // Clear any pending interrupts
-            I2CManager.write(_I2CAddress, 2, REG_INT_STAT, REG_STAT_K_INT);
-            _readState = RDS_IDLE; // Shift to IDLE
-            return;
-          }
-         }
+          _numKeyEvents = 0;
+          // Clear any pending interrupts
+          _commandBuffer[0] = REG_INT_STAT;
+          _commandBuffer[1] = REG_STAT_K_INT;
+          I2CManager.write(_I2CAddress, _commandBuffer, 2, &_i2crb);
+          _readState = RDS_CLEAR;
+          return;
+        }
+        else {
+          // RDS_CLEAR, interrupt cleared
+          _readState = RDS_IDLE;
+        }
       } else
         reportError(status, false);   // report eror but don't go offline.
     }
 
     // If we're not doing anything now, check to see if we have an interrupt pin configured and it is low,
-    // or if our timer has elapsed and we should check anyway in case the interrupt pin is disconnected.
+    // or, without an interrupt pin, if our timer has elapsed.
     if (_readState == RDS_IDLE) {
-      if ((_gpioInterruptsEnabled && !digitalRead(_gpioInterruptPin)) ||
+      if (_gpioInterruptsEnabled ? !digitalRead(_gpioInterruptPin) :
         ((currentMicros - _lastEventRead) > _eventRefresh))
       {
         _commandBuffer[0] = REG_KEY_LCK_EC;
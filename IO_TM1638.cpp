@@ -47,6 +47,7 @@ const uint8_t HIGHFLASH _digits[16]={
     _buttons=0;
     _leds=0;
     _lastLoop=micros();
+    _hasCallback=true;  // button changes are notified from _loop
     addDevice(this);
    } 
 
@@ -65,8 +66,14 @@ const uint8_t HIGHFLASH _digits[16]={
  
   void TM1638::_loop(unsigned long currentMicros)  {
      if (currentMicros - _lastLoop > (1000000UL/LoopHz)) {
-         _buttons=getButtons();// Read the buttons
+         uint8_t buttons=getButtons();// Read the buttons
+         uint8_t changes=buttons ^ _buttons;
+         _buttons=buttons;
          _lastLoop=currentMicros;   
+         // notify only the buttons that changed
+         if (changes && IONotifyCallback::hasCallback()) 
+           for (byte pin=0; pin<_nPins; pin++) 
+             if (bitRead(changes,pin)) IONotifyCallback::invokeAll(_firstVpin+pin, bitRead(buttons,pin));
      } 
   }
            
@@ -0,0 +1,97 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "IODevice.h"
+#include "DIAG.h"
+#include "DCCTimer.h"
+#include "IO_TimerPWM.h"
+
+void TimerPWM::create(VPIN firstVpin, int nPins, const uint8_t pins[], uint16_t frequency) {
+#ifdef TIMER_PWM_SUPPORTED
+  if (nPins > MAX_PINS) nPins = MAX_PINS;
+  if (checkNoOverlap(firstVpin, nPins)) new TimerPWM(firstVpin, nPins, pins, frequency);
+#else
+  (void)nPins; (void)pins; (void)frequency;
+  DIAG(F("TimerPWM on Vpin %u not supported on this processor"), firstVpin);
+#endif
+}
+
+TimerPWM::TimerPWM(VPIN firstVpin, int nPins, const uint8_t pins[], uint16_t frequency) {
+  _firstVpin = firstVpin;
+  _nPins = nPins;
+  _I2CAddress = 0;
+  _frequency = frequency;
+  memcpy(_pins, pins, nPins);
+  addDevice(this);
+}
+
+void TimerPWM::_begin() {
+  for (int i = 0; i < _nPins; i++) {
+#if defined(ARDUINO_ARCH_ESP32)
+    _channels[i] = DCCTimer::DCCEXledcReserveChannel();
+    if (_channels[i] < 0) {
+      DIAG(F("TimerPWM no ledc channel left for pin %d"), _pins[i]);
+      continue;
+    }
+    ledcSetup(_channels[i], _frequency, 12);  // 12 bits, as PCA9685
+    ledcAttachPin(_pins[i], _channels[i]);
+    ledcWrite(_channels[i], 0);
+#elif defined(ARDUINO_ARCH_STM32)
+    _timers[i] = NULL;
+    PinName name = digitalPinToPinName(_pins[i]);
+    TIM_TypeDef *instance = (TIM_TypeDef *)pinmap_peripheral(name, PinMap_PWM);
+    if (!instance) {
+      DIAG(F("TimerPWM pin %d has no PWM function"), _pins[i]);
+      continue;
+    }
+    _channels[i] = STM_PIN_CHANNEL(pinmap_function(name, PinMap_PWM));
+    // Pins on the same timer share one HardwareTimer object.
+    for (int j = 0; j < i; j++)
+      if (_timers[j] && _timers[j]->getHandle()->Instance == instance) _timers[i] = _timers[j];
+    if (!_timers[i]) _timers[i] = new HardwareTimer(instance);
+    _timers[i]->setPWM(_channels[i], _pins[i], _frequency, 0);
+#endif
+  }
+#if defined(DIAG_IO)
+  _display();
+#endif
+}
+
+// Value 0-4095 is the mark-to-period ratio, 0 switching the servo off.
+void TimerPWM::_writeAnalogue(VPIN vpin, int value, uint8_t param1, uint16_t param2) {
+  (void)param1; (void)param2;
+  int pin = vpin - _firstVpin;
+  if (value > 4095) value = 4095;
+  else if (value < 0) value = 0;
+#if defined(ARDUINO_ARCH_ESP32)
+  if (_channels[pin] < 0) return;
+  ledcWrite(_channels[pin], value == 4095 ? 4096 : value);  // 4096 is full on
+#elif defined(ARDUINO_ARCH_STM32)
+  if (!_timers[pin]) return;
+  _timers[pin]->setCaptureCompare(_channels[pin], value, RESOLUTION_12B_COMPARE_FORMAT);
+#else
+  (void)pin;
+#endif
+}
+
+void TimerPWM::_display() {
+  DIAG(F("TimerPWM Configured on Vpins:%u-%u %dHz"), (int)_firstVpin,
+    (int)_firstVpin+_nPins-1, _frequency);
+}
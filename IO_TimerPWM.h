@@ -0,0 +1,74 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The TimerPWM device driver drives servo pulses straight from the
+ * processor's own PWM timers, ledc channels on ESP32 and timer compare
+ * units on STM32, instead of over I2C to a PCA9685. Values are on the
+ * same 0-4095 scale as PCA9685pwm, so a Servo device laid over it keeps
+ * its positions and profiles, and each animation step becomes a
+ * register write instead of an I2C transaction.
+ *
+ * Example of use in myHal.cpp:
+ *
+ * #include "IO_TimerPWM.h"
+ * #include "IO_Servo.h"
+ * ...
+ * static const uint8_t servoPins[] = {16, 17, 18};
+ * TimerPWM::create(100, 3, servoPins);  // vpins 100-102 on GPIO 16-18
+ * Servo::create(300, 3, 100);           // animated servos on vpins 300-302
+ *
+ * On ESP32 servo channels are taken from ledc channel 2 upwards, clear
+ * of the inrush channel 0 and of the track PWM channels that DCCTimer
+ * takes from the top. On STM32 pins that share a timer must all be in
+ * the same TimerPWM device, and the timer must not be one used by the
+ * DCC signal or a track brake pin. Other processors are not supported.
+ */
+
+#ifndef IO_TimerPWM_h
+#define IO_TimerPWM_h
+#include "IODevice.h"
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_STM32)
+#define TIMER_PWM_SUPPORTED
+#endif
+
+class TimerPWM : public IODevice {
+public:
+  static void create(VPIN firstVpin, int nPins, const uint8_t pins[], uint16_t frequency=50);
+
+private:
+  static const uint8_t MAX_PINS = 8;
+  uint8_t _pins[MAX_PINS];
+  uint16_t _frequency;
+#if defined(ARDUINO_ARCH_ESP32)
+  int8_t _channels[MAX_PINS];      // ledc channel, -1 if none left
+#elif defined(ARDUINO_ARCH_STM32)
+  HardwareTimer *_timers[MAX_PINS];  // NULL if the pin has no timer
+  uint8_t _channels[MAX_PINS];
+#endif
+
+  TimerPWM(VPIN firstVpin, int nPins, const uint8_t pins[], uint16_t frequency);
+  void _begin() override;
+  void _writeAnalogue(VPIN vpin, int value, uint8_t param1, uint16_t param2) override;
+  void _display() override;
+};
+
+#endif
@@ -34,6 +34,12 @@
  * labelled 3 (connected to pin TP2 on the chip).  When this link is connected,
  * the pins OUT1 to OUT8 are not used but all sixteen touch pads are operational.
  * 
+ * The TTP229 pulls its data line low while a pad is touched, so while all pads
+ * are released the driver just checks the data pin every 10ms and only clocks 
+ * the pad states out when it goes low, with a full read once a second in case 
+ * a touch was missed.  While pads are held they are read every 20ms so that 
+ * releases are seen promptly.
+ * 
  * TODO: Allow a list of datapins to be provided so that multiple keypads can
  * be read simultaneously by the one device driver and the one shared clock signal.
  * As it stands, we can configure multiple driver instances, one for each keypad, 
@@ -50,6 +56,7 @@ class TouchKeypad : public IODevice {
 private:
   // Here we define the device-specific variables.  
   uint16_t _inputStates = 0;
+  unsigned long _lastScan = 0;
   VPIN _clockPin;
   VPIN _dataPin;
 
@@ -66,6 +73,7 @@ protected:
     _nPins = (nPins > 16) ? 16 : nPins;  // Maximum of 16 pads per device
     _clockPin = clockPin;
     _dataPin = dataPin;
+    _hasCallback = true;  // pad changes are notified from _loop
 
     addDevice(this);
   }
@@ -96,12 +104,18 @@ protected:
   // and the data bits can be read on the rising edge of the clock.
   // By default the clock and data are inverted (active-low).
   // A gap of more  than 2ms is advised between successive read
-  // cycles, we wait for 100ms between reads of the keyboard as this
-  // provide a good enough response time.
+  // cycles.
   // Maximum clock frequency is 512kHz, so put a 1us delay
   // between clock transitions.
   //
   void _loop(unsigned long currentMicros) {
+    if (_inputStates == 0 && ArduinoPins::fastReadDigital(_dataPin)
+        && currentMicros - _lastScan < 1000000UL) {
+      // Nothing touched
+      delayUntil(currentMicros + 10000);
+      return;
+    }
+    _lastScan = currentMicros;
 
     // Clock 16 bits from the device
     uint16_t data = 0, maskBit = 0x01;
@@ -113,13 +127,16 @@ protected:
       maskBit <<= 1;
       delayMicroseconds(1);
     }
+    uint16_t changes = data ^ _inputStates;
     _inputStates = data;
 #ifdef DIAG_IO
-    static uint16_t lastData = 0;
-    if (data != lastData) DIAG(F("KeyPad: %x"), data);
-    lastData = data;
+    if (changes) DIAG(F("KeyPad: %x"), data);
 #endif
-    delayUntil(currentMicros + 100000); // read every 100ms
+    if (changes && IONotifyCallback::hasCallback()) {
+      for (uint8_t pad=0; pad<_nPins; pad++)
+        if (changes & (1<<pad)) IONotifyCallback::invokeAll(_firstVpin+pad, (data & (1<<pad)) ? 1 : 0);
+    }
+    delayUntil(currentMicros + 20000); // read again in 20ms
   }
 
   // Display information about the device, and perhaps its current condition (e.g. active, disabled etc).
@@ -32,8 +32,11 @@
  * will return a value that indicates whether the object is within the threshold range (1)
  * or not (0).  An analogue read on the first pin returns the last measured distance (in mm), 
  * the second pin returns the signal strength, and the third pin returns detected 
- * ambient light level.  By default the device takes around 60ms to complete a ranging 
- * operation, so we do a 100ms cycle (10 samples per second).
+ * ambient light level.  The device is put into continuous back-to-back ranging, and the
+ * driver checks every 10ms whether a new result is ready, reads it and clears the 
+ * device's interrupt so that the next one follows.  All I2C traffic after start-up
+ * is queued through the device's own request block, so several sensors just 
+ * queue their requests one after another on the bus and none of them blocks the loop.
  * 
  * The VL53L0X is initially set to respond to I2C address 0x29.  If you only have one module,
  * you can use this address.  However, the address can be modified by software.  If
@@ -76,6 +79,11 @@
  *       XSHUT terminal on the module.  The digital output may be an Arduino pin or an
  *       I/O extender pin.
  * 
+ * Optionally a further VPIN may be given as gpio1Pin, connected to the module's GPIO1 
+ *       output, which goes low when a result is ready.  The interrupt status register
+ *       is then only read when that pin is low:
+ *       VL53L0X::create(firstVpin, nPins, i2cAddress, lowThreshold, highThreshold, xshutPin, gpio1Pin);
+ * 
  * Example:
  *   In mySetup function within mySetup.cpp:
  *      VL53L0X::create(4000, 3, 0x29, 200, 250);
@@ -103,6 +111,7 @@ private:
   uint16_t _onThreshold;
   uint16_t _offThreshold;
   VPIN _xshutPin;
+  VPIN _gpio1Pin;
   bool _value;
   uint8_t _nextState = STATE_INIT;
   I2CRB _rb;
@@ -116,9 +125,11 @@ private:
     STATE_RESTARTMODULE,
     STATE_CONFIGUREADDRESS,
     STATE_CONFIGUREDEVICE,
-    STATE_INITIATESCAN,
+    STATE_SETPADVOLTAGE,
+    STATE_SETINTERRUPT,
+    STATE_STARTCONTINUOUS,
     STATE_CHECKSTATUS,
-    STATE_GETRESULTS,
+    STATE_CHECKREADY,
     STATE_DECODERESULTS,
     STATE_FAILED,
   };
@@ -126,6 +137,8 @@ private:
   // Register addresses
   enum : uint8_t {
     VL53L0X_REG_SYSRANGE_START=0x00,
+    VL53L0X_REG_SYSTEM_INTERRUPT_CONFIG_GPIO=0x0A,
+    VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR=0x0B,
     VL53L0X_REG_RESULT_INTERRUPT_STATUS=0x13,
     VL53L0X_REG_RESULT_RANGE_STATUS=0x14,
     VL53L0X_CONFIG_PAD_SCL_SDA__EXTSUP_HV=0x89,
@@ -135,18 +148,19 @@ private:
 
 
   public:
-  static void create(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint16_t onThreshold, uint16_t offThreshold, VPIN xshutPin = VPIN_NONE) {
-     if (checkNoOverlap(firstVpin, nPins,i2cAddress)) new VL53L0X(firstVpin, nPins, i2cAddress, onThreshold, offThreshold, xshutPin);
+  static void create(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint16_t onThreshold, uint16_t offThreshold, VPIN xshutPin = VPIN_NONE, VPIN gpio1Pin = VPIN_NONE) {
+     if (checkNoOverlap(firstVpin, nPins,i2cAddress)) new VL53L0X(firstVpin, nPins, i2cAddress, onThreshold, offThreshold, xshutPin, gpio1Pin);
   }
 
 protected:
-  VL53L0X(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint16_t onThreshold, uint16_t offThreshold, VPIN xshutPin = VPIN_NONE) {
+  VL53L0X(VPIN firstVpin, int nPins, I2CAddress i2cAddress, uint16_t onThreshold, uint16_t offThreshold, VPIN xshutPin = VPIN_NONE, VPIN gpio1Pin = VPIN_NONE) {
     _firstVpin = firstVpin;
     _nPins = (nPins > 3) ? 3 : nPins;
     _I2CAddress = i2cAddress;
     _onThreshold = onThreshold;
     _offThreshold = offThreshold;
     _xshutPin = xshutPin;
+    _gpio1Pin = gpio1Pin;
     _value = 0;
     addDevice(this);
   }
@@ -157,10 +171,11 @@ protected:
     //  desired address is already responding on the I2C bus.
     _nextState = STATE_INIT;
     _addressConfigInProgress = false;
+    // GPIO1 is open drain, active low
+    if (_gpio1Pin != VPIN_NONE) IODevice::configureInput(_gpio1Pin, true);
   }
 
   void _loop(unsigned long currentMicros) override {
-    uint8_t status;
     switch (_nextState) {
       case STATE_INIT:
         if (I2CManager.exists(_I2CAddress)) {
@@ -198,21 +213,23 @@ protected:
         // Then write the desired I2C address to the device, while this is the only
         //  module responding to the default address.
         {
+          _outBuffer[0] = VL53L0X_REG_I2C_SLAVE_DEVICE_ADDRESS;
           #if defined(I2C_EXTENDED_ADDRESS)
           // Add subbus reference for desired address to the device default address.
           I2CAddress defaultAddress = {_I2CAddress, VL53L0X_I2C_DEFAULT_ADDRESS};
-          status = I2CManager.write(defaultAddress, 2, VL53L0X_REG_I2C_SLAVE_DEVICE_ADDRESS, _I2CAddress.deviceAddress());
+          _outBuffer[1] = _I2CAddress.deviceAddress();
+          I2CManager.write(defaultAddress, _outBuffer, 2, &_rb);
           #else
-          status = I2CManager.write(VL53L0X_I2C_DEFAULT_ADDRESS, 2, VL53L0X_REG_I2C_SLAVE_DEVICE_ADDRESS, _I2CAddress);
+          _outBuffer[1] = _I2CAddress;
+          I2CManager.write(VL53L0X_I2C_DEFAULT_ADDRESS, _outBuffer, 2, &_rb);
           #endif
-          if (status != I2C_STATUS_OK) {
-            reportError(status);
-          }
         }
         delayUntil(currentMicros+10000);
         _nextState = STATE_CONFIGUREDEVICE;
         break;
       case STATE_CONFIGUREDEVICE:
+        if (_rb.isBusy()) return;  // address write still going
+        if (_rb.status != I2C_STATUS_OK) reportError(_rb.status);
         // Allow next VL53L0X device to be configured
         _addressConfigInProgress = false;
         // Now check if device address has been set.
@@ -220,48 +237,60 @@ protected:
           #ifdef DIAG_IO
           _display();
           #endif
-          // Set 2.8V mode
-          status = write_reg(VL53L0X_CONFIG_PAD_SCL_SDA__EXTSUP_HV, 
-            read_reg(VL53L0X_CONFIG_PAD_SCL_SDA__EXTSUP_HV) | 0x01);
-          if (status != I2C_STATUS_OK) {
-            reportError(status);
-          } else
-            _nextState = STATE_INITIATESCAN;
+          // Read pad configuration, to set 2.8V mode
+          readRegister(VL53L0X_CONFIG_PAD_SCL_SDA__EXTSUP_HV);
+          _nextState = STATE_SETPADVOLTAGE;
         } else {
           DIAG(F("VL53L0X I2C:%s device not responding"), _I2CAddress.toString());
           _deviceState = DEVSTATE_FAILED;
           _nextState = STATE_FAILED;
         }
         break;
-      case STATE_INITIATESCAN:
-        // Not scanning, so initiate a scan
-        _outBuffer[0] = VL53L0X_REG_SYSRANGE_START;
-        _outBuffer[1] = 0x01;
-        I2CManager.write(_I2CAddress, _outBuffer, 2, &_rb);
+      case STATE_SETPADVOLTAGE:
+        if (!requestComplete()) return;
+        // Set 2.8V mode
+        writeRegister(VL53L0X_CONFIG_PAD_SCL_SDA__EXTSUP_HV, _inBuffer[0] | 0x01);
+        _nextState = STATE_SETINTERRUPT;
+        break;
+      case STATE_SETINTERRUPT:
+        if (!requestComplete()) return;
+        // Interrupt (and GPIO1) on new sample ready
+        writeRegister(VL53L0X_REG_SYSTEM_INTERRUPT_CONFIG_GPIO, 0x04);
+        _nextState = STATE_STARTCONTINUOUS;
+        break;
+      case STATE_STARTCONTINUOUS:
+        if (!requestComplete()) return;
+        // Back-to-back ranging, the device starts the next measurement itself
+        writeRegister(VL53L0X_REG_SYSRANGE_START, 0x02);
         _nextState = STATE_CHECKSTATUS;
         break;
       case STATE_CHECKSTATUS:
-        status = _rb.status;
-        if (status == I2C_STATUS_PENDING) return; // try next time
-        if (status != I2C_STATUS_OK) {
-          reportError(status);
-        } else
-          _nextState = STATE_GETRESULTS;
-        delayUntil(currentMicros + 95000); // wait for 95 ms before checking.
+        // Wait for the previous request (interrupt clear) to finish.
+        if (!requestComplete()) return;
+        if (_gpio1Pin != VPIN_NONE && IODevice::read(_gpio1Pin)) {
+          // GPIO1 still high, no result yet
+          delayUntil(currentMicros + 10000);
+          return;
+        }
+        readRegister(VL53L0X_REG_RESULT_INTERRUPT_STATUS);
+        _nextState = STATE_CHECKREADY;
         break;
-      case STATE_GETRESULTS:
+      case STATE_CHECKREADY:
+        if (!requestComplete()) return;
+        if ((_inBuffer[0] & 0x07) == 0) {
+          // No new result, check again in 10ms
+          _nextState = STATE_CHECKSTATUS;
+          delayUntil(currentMicros + 10000);
+          return;
+        }
         // Ranging completed.  Request results
         _outBuffer[0] = VL53L0X_REG_RESULT_RANGE_STATUS;
         I2CManager.read(_I2CAddress, _inBuffer, 12, _outBuffer, 1, &_rb);
-        delayUntil(currentMicros + 5000); // Allow 5ms to get data
         _nextState = STATE_DECODERESULTS;
         break;
       case STATE_DECODERESULTS:
-        // If I2C write still busy, return.
-        status = _rb.status;
-        if (status == I2C_STATUS_PENDING) return; // try again next time
-        if (status == I2C_STATUS_OK) {
-          if (!(_inBuffer[0] & 1)) return; // device still busy
+        if (!requestComplete()) return;
+        if (_inBuffer[0] & 1) {
           uint8_t deviceRangeStatus = ((_inBuffer[0] & 0x78) >> 3);
           if (deviceRangeStatus == 0x0b) {
             // Range status OK, so use data
@@ -273,11 +302,11 @@ protected:
             else if (_distance > _offThreshold) 
               _value = false;
           }
-          // Completed. Restart scan on next loop entry.
-          _nextState = STATE_INITIATESCAN;
-        } else {
-          reportError(status);
         }
+        // Clear the interrupt to release the next result.
+        writeRegister(VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR, 0x01);
+        _nextState = STATE_CHECKSTATUS;
+        delayUntil(currentMicros + 10000);
         break;
       case STATE_FAILED:
         // Do nothing.
@@ -329,17 +358,25 @@ private:
   inline uint16_t makeuint16(byte lsb, byte msb) {
     return (((uint16_t)msb) << 8) | lsb;
   }
-  uint8_t write_reg(uint8_t reg, uint8_t data) {
-    // write byte to register
-    uint8_t outBuffer[2];
-    outBuffer[0] = reg;
-    outBuffer[1] = data;
-    return I2CManager.write(_I2CAddress, outBuffer, 2);
+  // Non-blocking register access through _rb.  A read leaves the
+  // value in _inBuffer[0] once the request has completed.
+  void writeRegister(uint8_t reg, uint8_t data) {
+    _outBuffer[0] = reg;
+    _outBuffer[1] = data;
+    I2CManager.write(_I2CAddress, _outBuffer, 2, &_rb);
+  }
+  void readRegister(uint8_t reg) {
+    _outBuffer[0] = reg;
+    I2CManager.read(_I2CAddress, _inBuffer, 1, _outBuffer, 1, &_rb);
   }
-  uint8_t read_reg(uint8_t reg) {
-    // read byte from register and return value
-    I2CManager.read(_I2CAddress, _inBuffer, 1, &reg, 1);
-    return _inBuffer[0];
+  // True once the last request has finished. A failure is reported and the
+  // device shown as offline, the failed request is not retried and the
+  // state machine goes on to its next step.
+  bool requestComplete() {
+    if (_rb.isBusy()) return false;
+    uint8_t status = _rb.status;
+    if (status != I2C_STATUS_OK) reportError(status);
+    return true;
   }
 };
 
@@ -23,6 +23,18 @@
 #include "defines.h"
 #include "IODevice.h"
 
+// With DUINONODES_SPI defined in config.h, a chain whose clock pin is the
+// hardware SCK pin and whose data pin is MISO (inputs) or MOSI (outputs) is
+// shifted by the SPI peripheral instead of bit banging. The latch pin stays
+// an ordinary pin. An input chain drives MISO all the time, so it can not
+// share MISO with other SPI devices.
+#if defined(DUINONODES_SPI)
+#include <SPI.h>
+#ifndef DUINONODES_SPI_CLOCK
+#define DUINONODES_SPI_CLOCK 1000000
+#endif
+#endif
+
 #define DN_PIN_MASK(bit) (0x80>>(bit%8))
 #define DN_GET_BIT(x) (_pinValues[(x)/8] & DN_PIN_MASK((x)) )
 #define DN_SET_BIT(x) _pinValues[(x)/8] |= DN_PIN_MASK((x))
@@ -44,6 +56,8 @@ public:
     _pinMap=pinmap;
     _nShiftBytes=(nPins+7)/8; // rounded up to multiples of 8 bits
     _pinValues=(byte*) calloc(_nShiftBytes,1);  
+    // Inputs notify changes, so sensors need not poll them.
+    _hasCallback = (_pinMap != NULL);
     // Connect to HAL so my _write, _read and _loop will be called as required.
     IODevice::addDevice(this);  
   }
@@ -54,6 +68,10 @@ public:
     pinMode(_latchPin,OUTPUT);
     pinMode(_clockPin,OUTPUT);
     pinMode(_dataPin,_pinMap?INPUT_PULLUP:OUTPUT);
+#if defined(DUINONODES_SPI)
+    _useSPI= _clockPin==SCK && _dataPin==(_pinMap ? MISO : MOSI);
+    if (_useSPI) SPI.begin();
+#endif
     _display();
     if (!_pinMap) _loopOutput();
   }
@@ -75,6 +93,21 @@ void _loopInput(unsigned long currentMicros)  {
    //set latch to LOW to enable the data to be transmitted serially
    ArduinoPins::fastWriteDigital(_latchPin, LOW);
 
+#if defined(DUINONODES_SPI)
+  if (_useSPI) {
+    // first bit out of the chain arrives in the top bit of each byte
+    SPI.beginTransaction(SPISettings(DUINONODES_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+    for (int xmitByte=0;xmitByte<_nShiftBytes; xmitByte++) {
+      byte data=SPI.transfer(0);
+      byte newByte=0;
+      for (int xmitBit=0;xmitBit<8; xmitBit++) 
+        if (data & (0x80>>xmitBit)) newByte |= _pinMap[xmitBit];
+      updateInputs(xmitByte,newByte);
+    }
+    SPI.endTransaction();
+    return;
+  }
+#endif
   // stream in the bitmap using mapping order provided at constructor   
   for (int xmitByte=0;xmitByte<_nShiftBytes; xmitByte++) {
       byte newByte=0;
@@ -88,15 +121,41 @@ void _loopInput(unsigned long currentMicros)  {
         ArduinoPins::fastWriteDigital(_clockPin, HIGH); 
         delayMicroseconds(1);   
       }
-      _pinValues[xmitByte]=newByte;
+      updateInputs(xmitByte,newByte);
       // DIAG(F("DIN %x=%x"),xmitByte, newByte);
     }
   }
 
+// Store a scanned input byte, notifying only the pins that changed.
+void updateInputs(int xmitByte, byte newByte) {
+    byte changes=_pinValues[xmitByte] ^ newByte;
+    if (!changes) return;
+    _pinValues[xmitByte]=newByte;
+    if (!IONotifyCallback::hasCallback()) return;
+    for (int bit=0; bit<8; bit++) {
+      int pin=xmitByte*8+bit;
+      if (pin>=_nPins) break;
+      if (changes & DN_PIN_MASK(bit)) 
+        IONotifyCallback::invokeAll(_firstVpin+pin, (newByte & DN_PIN_MASK(bit)) ? 1 : 0);
+    }
+}
+
 void _loopOutput()  {
     // stream out the bitmap (highest pin first)
     _xmitPending=false; 
     ArduinoPins::fastWriteDigital(_latchPin, LOW);
+#if defined(DUINONODES_SPI)
+    if (_useSPI) {
+      // highest pin first: last byte first, and bit 0 of each byte
+      // holds its highest pin (see DN_PIN_MASK)
+      SPI.beginTransaction(SPISettings(DUINONODES_SPI_CLOCK, LSBFIRST, SPI_MODE0));
+      for (int xmitByte=_nShiftBytes-1; xmitByte>=0; xmitByte--) 
+        SPI.transfer(_pinValues[xmitByte]);
+      SPI.endTransaction();
+      ArduinoPins::fastWriteDigital(_latchPin, HIGH);
+      return;
+    }
+#endif
     for (int xmitBit=_nShiftBytes*8 -1; xmitBit>=0; xmitBit--) {
         ArduinoPins::fastWriteDigital(_dataPin,DN_GET_BIT(xmitBit));
         ArduinoPins::fastWriteDigital(_clockPin,HIGH);
@@ -122,10 +181,15 @@ void _loopOutput()  {
   }
 
   void _display() override {
-      DIAG(F("IO_duinoNodes %SPUT Configured on Vpins:%u-%u shift=%d"), 
+      DIAG(F("IO_duinoNodes %SPUT Configured on Vpins:%u-%u shift=%d%S"), 
       _pinMap?F("IN"):F("OUT"),
       (int)_firstVpin, 
-      (int)_firstVpin+_nPins-1, _nShiftBytes*8);
+      (int)_firstVpin+_nPins-1, _nShiftBytes*8,
+#if defined(DUINONODES_SPI)
+      _useSPI ? F(" SPI") : F(""));
+#else
+      F(""));
+#endif
   }
 
 private:
@@ -135,6 +199,9 @@ private:
   VPIN _latchPin,_clockPin,_dataPin;
   byte* _pinValues;
   bool _xmitPending; // Only relevant in output mode
+#if defined(DUINONODES_SPI)
+  bool _useSPI=false;
+#endif
   const byte* _pinMap;  // NULL in output mode 
 };
 
@@ -25,6 +25,12 @@
  keywords. 
  Thus  "MAIN"_hk  generates exactly the same run time vakue 
  as   const int16_t HASH_KEYWORD_MAIN=11339  
+
+ Keywords are best dispatched with switch (p[n]) { case "MAIN"_hk: ... }
+ The compiler turns the sparse case values into a balanced compare tree
+ (a few compares for any number of keywords) and two keywords in the same
+ switch that hash alike are a "duplicate case value" compile error, 
+ which a chain of if (p[n]=="...") tests would silently hide.
 */
 #ifndef KeywordHasher_h
 #define KeywordHasher_h
@@ -22,9 +22,13 @@
 #include "Turnouts.h"
 #include "Sensors.h"
 
+#include "CommandDistributor.h"
+
 int  LCN::id = 0;
 Stream * LCN::stream=NULL;
 bool LCN::firstLoop=true;
+char LCN::outBuffer[LCN_OUT_SIZE];
+byte LCN::outLength=0;
 
 void LCN::init(Stream & lcnstream) {
   stream=&lcnstream; 
@@ -33,6 +37,8 @@ void LCN::init(Stream & lcnstream) {
 
 
 // Inbound LCN traffic is postfix notation...   nnnX  where nnn is an id, X is the opcode
+// A burst of reports (e.g. after LCN reconnects) is taken in one pass,
+// with the turnout broadcasts held back and sent once at the end.
 void LCN::loop() {
   if (!stream) return;
   if (firstLoop) {
@@ -40,37 +46,68 @@ void LCN::loop() {
     stream->println('X');
     return; 
   }
+  flush();
   
-  while (stream->available()) {
-    int ch = stream->read();
+  int available = stream->available();
+  if (available <= 0) return;
+#ifdef HAS_ENOUGH_MEMORY
+  CommandDistributor::beginBatch();
+#endif
+  unsigned long start = micros();
+  char chunk[LCN_READ_CHUNK];
+  do {
+    if (available > LCN_READ_CHUNK) available = LCN_READ_CHUNK;
+    // no more than available, so readBytes never waits for its timeout
+    size_t count = stream->readBytes(chunk, available);
+    for (size_t i = 0; i < count; i++) receive(chunk[i]);
+    available = stream->available();
+  } while (available > 0 && micros() - start < LCN_LOOP_BUDGET);
+#ifdef HAS_ENOUGH_MEMORY
+  CommandDistributor::endBatch();
+#endif
+}
+
+void LCN::receive(char ch) {
     if (ch >= '0' && ch <= '9') {  // accumulate id value
       id = 10 * id + ch - '0';
     }
     else if (ch == 't' || ch == 'T') { // Turnout opcodes
-      if (Diag::LCN) DIAG(F("LCN IN %d%c"),id,(char)ch);
+      DIAGLOG(Diag::LCN, F("LCN IN %d%c"),id,(char)ch);
       if (!Turnout::exists(id)) LCNTurnout::create(id);
       Turnout::setClosedStateOnly(id,ch=='t');
       id = 0;
     }
     else if (ch == 'y' || ch == 'Y') { // Turnout opcodes
-      if (Diag::LCN) DIAG(F("LCN IN %d%c"),id,(char)ch);
+      DIAGLOG(Diag::LCN, F("LCN IN %d%c"),id,(char)ch);
       Turnout::setClosed(id,ch=='y');
       id = 0;
     }
     else if (ch == 'S' || ch == 's') {
-      if (Diag::LCN) DIAG(F("LCN IN %d%c"),id,(char)ch);
+      DIAGLOG(Diag::LCN, F("LCN IN %d%c"),id,(char)ch);
       Sensor * ss = Sensor::get(id);
       if (!ss) ss = Sensor::create(id, VPIN_NONE, 0); // impossible pin
       ss->setState(ch == 'S');
       id = 0;
     }
     else  id = 0; // ignore any other garbage from LCN
-  }
 }
 
+// Commands are collected and written to LCN in one go by the next loop,
+// or sooner if the buffer fills.
 void LCN::send(char opcode, int id, bool state) {
    if (stream) {
-      StringFormatter::send(stream,F("%c/%d/%d"), opcode, id , state);
-      if (Diag::LCN) DIAG(F("LCN OUT %c/%d/%d"), opcode, id , state);
+      char command[16];
+      int length=snprintf(command, sizeof(command), "%c/%d/%d", opcode, id, state);
+      if (length<0 || length>=(int)sizeof(command)) return;
+      if (outLength+length > LCN_OUT_SIZE) flush();
+      memcpy(outBuffer+outLength, command, length);
+      outLength+=length;
+      DIAGLOG(Diag::LCN, F("LCN OUT %c/%d/%d"), opcode, id , state);
    }
 }
+
+void LCN::flush() {
+  if (outLength==0) return;
+  stream->write((const uint8_t *)outBuffer, outLength);
+  outLength=0;
+}
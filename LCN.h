@@ -22,15 +22,26 @@
 #define LCN_h
 #include <Arduino.h>
 
+// Inbound bytes are read in chunks of LCN_READ_CHUNK for up to
+// LCN_LOOP_BUDGET microseconds per loop. Outbound commands are
+// collected in LCN_OUT_SIZE bytes and written once per loop.
+#define LCN_READ_CHUNK 32
+#define LCN_LOOP_BUDGET 2000
+#define LCN_OUT_SIZE 64
+
 class LCN {
   public: 
     static void init(Stream & lcnstream);
     static void loop();
     static void send(char opcode, int id, bool state);
   private :
+    static void receive(char ch);
+    static void flush();
     static bool firstLoop; 
     static Stream * stream; 
     static int id;
+    static char outBuffer[LCN_OUT_SIZE];
+    static byte outLength;
 };
 
 #endif
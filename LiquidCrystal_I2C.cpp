@@ -52,7 +52,7 @@ LiquidCrystal_I2C::LiquidCrystal_I2C(I2CAddress lcd_Addr, uint8_t lcd_cols,
 bool LiquidCrystal_I2C::begin() {
 
   I2CManager.begin();
-  I2CManager.setClock(100000L);    // PCF8574 is spec'd to 100kHz.
+  I2CManager.setClock(_Addr, 100000L);    // PCF8574 is spec'd to 100kHz.
 
   if (I2CManager.exists(_Addr)) {
     DIAG(F("%dx%d LCD configured on I2C:%s"), (int)lcdCols, (int)lcdRows, _Addr.toString());
@@ -72,55 +72,67 @@ bool LiquidCrystal_I2C::begin() {
   // 100 milliseconds after pulling both RS and R/W and backlight pin low
   expanderWrite(
       _backlightval);  // reset expander and turn backlight off (Bit 8 =1)
-  delay(100);
-
-  // put the LCD into 4 bit mode
-  // this is according to the hitachi HD44780 datasheet
-  // figure 24, pg 46
-
-  // we start in 8bit mode, try to set 4 bit mode
-  write4bits(0x03);
-  delayMicroseconds(5000);  // wait min 4.1ms
-
-  // second try
-  write4bits(0x03);
-  delayMicroseconds(5000);  // wait min 4.1ms
-
-  // third go!
-  write4bits(0x03);
-  delayMicroseconds(5000);
-
-  // finally, set to 4-bit interface
-  write4bits(0x02);
-
-  // set # lines, font size, etc.
-  command(LCD_FUNCTIONSET | _displayfunction);
-
-  // turn the display on with no cursor or blinking default
-  _displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
-  display();
-
-  // Initialize to default text direction (for roman languages)
-  _displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
-
-  // set the entry mode
-  command(LCD_ENTRYMODESET | _displaymode);
+  startWait(100000UL);
 
+  // The rest of the start-up is sent a step at a time from isBusy(), so
+  // that the delays it needs don't hold up the rest of the system.
+  _initStep = 1;
   return true;
 }
 
+// One step of putting the LCD into 4 bit mode, according to the
+// hitachi HD44780 datasheet figure 24, pg 46.
+void LiquidCrystal_I2C::initStep() {
+  switch (_initStep++) {
+  case 1:
+  case 2:
+  case 3:
+    // we start in 8bit mode, try to set 4 bit mode three times
+    write4bits(0x03);
+    startWait(5000);  // wait min 4.1ms
+    break;
+  case 4:
+    // finally, set to 4-bit interface
+    write4bits(0x02);
+    break;
+  case 5:
+    // set # lines, font size, etc.
+    command(LCD_FUNCTIONSET | _displayfunction);
+    break;
+  case 6:
+    // turn the display on with no cursor or blinking default
+    _displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+    display();
+    break;
+  default:
+    // Initialize to default text direction (for roman languages)
+    _displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+    // set the entry mode
+    command(LCD_ENTRYMODESET | _displaymode);
+    _initStep = 0;  // Done
+    break;
+  }
+}
+
 /********** high level commands, for the user! */
 void LiquidCrystal_I2C::clearNative() {
+  waitReady();
   command(LCD_CLEARDISPLAY);  // clear display, set cursor position to zero
-  delayMicroseconds(2000);    // this command takes 1.52ms but allow plenty
+  startWait(2000);            // this command takes 1.52ms but allow plenty
 }
 
 void LiquidCrystal_I2C::setRowNative(byte row) {
+  setRowColNative(row, 0);
+}
+
+bool LiquidCrystal_I2C::setRowColNative(byte row, byte col) {
   uint8_t row_offsets[] = {0x00, 0x40, 0x14, 0x54};
   if (row >= lcdRows) {
     row = lcdRows - 1;  // we count rows starting w/0
   }
-  command(LCD_SETDDRAMADDR | (row_offsets[row]));
+  waitReady();
+  command(LCD_SETDDRAMADDR | (row_offsets[row] + col));
+  return true;
 }
 
 void LiquidCrystal_I2C::display() {
@@ -140,12 +152,38 @@ void LiquidCrystal_I2C::backlight(void) {
 }
 
 size_t LiquidCrystal_I2C::writeNative(uint8_t value) {
+  waitReady();
   send(value, Rs);
   return 1;
 }
 
 bool LiquidCrystal_I2C::isBusy() { 
-  return rb.isBusy();
+  if (transferBusy()) return true;
+  if (_initStep == 0) return false;
+  initStep();
+  return true;
+}
+
+// Callers are expected to check isBusy() first; this only blocks for
+// those that don't, e.g. a forced refresh during start-up.
+void LiquidCrystal_I2C::waitReady() {
+  while (isBusy()) {}
+}
+
+// The I2C transfer time covers the HD44780's ordinary 37us command time.
+// Slower commands (clear, start-up) set a wait that isBusy() honours.
+void LiquidCrystal_I2C::startWait(unsigned long us) {
+  _waitStart = micros();
+  _waitTime = us;
+}
+
+bool LiquidCrystal_I2C::transferBusy() {
+  if (rb.isBusy()) return true;
+  if (_waitTime) {
+    if (micros() - _waitStart < _waitTime) return true;
+    _waitTime = 0;
+  }
+  return false;
 }
 
 /*********** mid level commands, for sending data/cmds */
@@ -194,7 +232,7 @@ void LiquidCrystal_I2C::send(uint8_t value, uint8_t mode) {
   uint8_t lownib = ((value & 0x0f) << BACKPACK_DATA_BITS) | mode;
   // Send both nibbles
   uint8_t len = 0;
-  rb.wait();
+  while (transferBusy()) {}
   outputBuffer[len++] = highnib|En;
   outputBuffer[len++] = highnib;
   outputBuffer[len++] = lownib|En;
@@ -209,7 +247,7 @@ void LiquidCrystal_I2C::write4bits(uint8_t value) {
   // I2C clock cycle time of 2.5us at 400kHz. Data is clocked in to the
   // HD44780 on the trailing edge of the Enable pin.
   uint8_t len = 0;
-  rb.wait();
+  while (transferBusy()) {}
   outputBuffer[len++] = _data|En;
   outputBuffer[len++] = _data;
   I2CManager.write(_Addr, outputBuffer, len, &rb);  // Write command asynchronously
@@ -218,7 +256,7 @@ void LiquidCrystal_I2C::write4bits(uint8_t value) {
 // write a byte to the PCF8574 I2C interface.  We don't need to set
 // the enable pin for this.
 void LiquidCrystal_I2C::expanderWrite(uint8_t value) {
-  rb.wait();
+  while (transferBusy()) {}
   outputBuffer[0] = value | _backlightval;
   I2CManager.write(_Addr, outputBuffer, 1, &rb);  // Write command asynchronously
 }
@@ -68,8 +68,10 @@ public:
   bool begin() override;
   void clearNative() override;
   void setRowNative(byte line) override;
+  bool setRowColNative(byte line, byte col) override;
   size_t writeNative(uint8_t c) override;
-  // I/O is synchronous, so if this is called we're not busy!
+  // True while an I2C transfer, a controller wait or the start-up
+  // sequence is in progress. Each call moves start-up on a step.
   bool isBusy() override; 
   
   void display();
@@ -85,6 +87,10 @@ private:
   void send(uint8_t, uint8_t);
   void write4bits(uint8_t);
   void expanderWrite(uint8_t);
+  bool transferBusy();
+  void waitReady();
+  void startWait(unsigned long us);
+  void initStep();
   uint8_t lcdCols=0, lcdRows=0;
   I2CAddress _Addr;
   uint8_t _displayfunction;
@@ -94,6 +100,10 @@ private:
 
   uint8_t outputBuffer[4];
   I2CRB rb;
+  // Controller execution time still to run after the last transfer
+  unsigned long _waitStart = 0;
+  unsigned long _waitTime = 0;
+  uint8_t _initStep = 0;  // 0 when start-up is complete
 };
 
 #endif
@@ -0,0 +1,99 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LocoIndex_h
+#define LocoIndex_h
+#include <Arduino.h>
+
+// LocoIndex maps a cab address to its slot in a loco table so that
+// lookups do not have to scan the whole table.
+//
+// It is an open addressed hash with linear probing. Each bucket is one
+// byte holding slot+1 (0 means empty), so the cost is 1<<BITS bytes.
+// The key is not stored in the bucket, it is read back from the array of
+// addresses the index was built over. Removal uses backward shift so no
+// tombstones are left behind.
+
+// Smallest number of bits that gives at least twice as many buckets
+// as slots, so the table never fills and probe chains stay short.
+constexpr byte locoIndexBits(int slots, byte bits=1) {
+  return ((1<<bits) >= 2*slots) ? bits : locoIndexBits(slots, bits+1);
+}
+
+template <int SLOTS, byte BITS=locoIndexBits(SLOTS)>
+class LocoIndex {
+  static_assert((1<<BITS) > SLOTS, "LocoIndex needs more buckets than slots");
+  static_assert(SLOTS < 255, "LocoIndex supports at most 254 slots");
+public:
+  LocoIndex(const int * locos) : _locos(locos) { clear(); }
+
+  // after the array of addresses has been moved (a growing loco table)
+  void setLocos(const int * locos) { _locos=locos; }
+
+  // returns slot number or -1 if not indexed
+  int find(int loco) {
+    for (byte b=home(loco); _bucket[b]; b=(b+1) & MASK) {
+      byte slot=_bucket[b]-1;
+      if (_locos[slot]==loco) return slot;
+    }
+    return -1;
+  }
+
+  void insert(int loco, byte slot) {
+    byte b=home(loco);
+    while (_bucket[b]) b=(b+1) & MASK;
+    _bucket[b]=slot+1;
+  }
+
+  void remove(int loco) {
+    byte b=home(loco);
+    for (;;b=(b+1) & MASK) {
+      if (!_bucket[b]) return;  // not indexed
+      if (_locos[_bucket[b]-1]==loco) break;
+    }
+    // Pull later entries of the probe chain back into the hole
+    byte hole=b;
+    _bucket[hole]=0;
+    for (byte next=(hole+1) & MASK; _bucket[next]; next=(next+1) & MASK) {
+      byte h=home(_locos[_bucket[next]-1]);
+      // can this entry move back to the hole without passing its home?
+      bool movable = (hole<=next) ? (h<=hole || h>next) : (h<=hole && h>next);
+      if (movable) {
+        _bucket[hole]=_bucket[next];
+        _bucket[next]=0;
+        hole=next;
+      }
+    }
+  }
+
+  void clear() {
+    memset(_bucket, 0, sizeof(_bucket));
+  }
+
+private:
+  static const byte MASK=(1<<BITS)-1;
+  // Fibonacci hashing spreads consecutive and round-number addresses
+  static byte home(int loco) {
+    return ((uint16_t)((uint16_t)loco * 40503u)) >> (16-BITS);
+  }
+  const int * _locos;
+  byte _bucket[1<<BITS];
+};
+
+#endif
@@ -16,48 +16,34 @@
  */
 #include "LocoTable.h"
 
-LocoTable::LOCO LocoTable::speedTable[MAX_LOCOS] = { {0,0,0,0,0,0} };
-int LocoTable::highestUsedReg = 0;
+unsigned int LocoTable::funccounter[MAX_LOCOS] = {0};
+unsigned int LocoTable::speedcounter[MAX_LOCOS] = {0};
 
 int LocoTable::lookupSpeedTable(int locoId, bool autoCreate) {
-  // determine speed reg for this loco
-  const int UNUSED = -1;
-  int firstEmpty = UNUSED;
-  int reg;
-  for (reg = 0; reg < MAX_LOCOS; reg++) {
-    if (speedTable[reg].loco == locoId) break;
-    if (speedTable[reg].loco == 0 && firstEmpty == UNUSED) firstEmpty = reg;
-  }
-
-  if (reg == MAX_LOCOS && !autoCreate)            // not found and not auto creating
+  // slots are shared with DCC, new ones start with fresh counters
+  int reg=DCC::lookupSpeedTable(locoId, false);
+  if (reg>=0 || !autoCreate) return reg;
+  reg=DCC::lookupSpeedTable(locoId, true);
+  if (reg<0) {
+    DIAG(F("Can not add id %d to full sniffer table (total > %d)"), locoId, MAX_LOCOS);
     return -1;
-  if (reg == MAX_LOCOS) {
-    if (firstEmpty == UNUSED) {                   // did not find empty slot
-      DIAG(F("Can not add id %d to full sniffer table (total > %d)"), locoId, MAX_LOCOS);
-      return -1;
-    } else {                                      // populate empty slot
-      reg = firstEmpty;
-      //DIAG(F("LocoTable SNIFFER: Create loco %d in slot %d"), locoId, reg);
-      speedTable[reg].loco = locoId;
-      speedTable[reg].speedCode=128;              // default direction forward
-      speedTable[reg].groupFlags=0;
-      speedTable[reg].functions=0;
-    }
   }
-  if (reg > highestUsedReg) highestUsedReg = reg;
+  funccounter[reg]=0;
+  speedcounter[reg]=0;
   return reg;
 }
 
+// speedCode is in speedTable format (see DCC::setThrottle)
 // returns false only if loco existed but nothing was changed
 bool LocoTable::updateLoco(int loco, byte speedCode) {
   if (loco==0) {
     /*
      // broadcast stop/estop but dont change direction
      for (int reg = 0; reg < highestUsedReg; reg++) {
-       if (speedTable[reg].loco==0) continue;
-       byte newspeed=(speedTable[reg].speedCode & 0x80) |  (speedCode & 0x7f);
-       if (speedTable[reg].speedCode != newspeed) {
-         speedTable[reg].speedCode = newspeed;
+       if (DCC::speedTable.loco[reg]==0) continue;
+       byte newspeed=(DCC::speedTable.speedCode[reg] & 0x80) |  (speedCode & 0x7f);
+       if (DCC::speedTable.speedCode[reg] != newspeed) {
+         DCC::speedTable.speedCode[reg] = newspeed;
          CommandDistributor::broadcastLoco(reg);
        }
      }
@@ -69,71 +55,56 @@ bool LocoTable::updateLoco(int loco, byte speedCode) {
   int reg=lookupSpeedTable(loco, false);
 
   if (reg>=0) {
-    speedTable[reg].speedcounter++;
-    if (speedTable[reg].speedCode!=speedCode) {
-      speedTable[reg].speedCode = speedCode;
-      return true;
-    } else {
-      return false;
-    }
-  } else {
-    // need to make new entry
-    reg=lookupSpeedTable(loco, true);
-    if(reg >=0) {
-      speedTable[reg].speedCode = speedCode;
-      return true;
-    } else { // as no loco was added, nothing changed
-      return false;
-    }
+    speedcounter[reg]++;
+    // the caller stores the new speed via DCC::setThrottle
+    return DCC::speedTable.speedCode[reg]!=speedCode;
   }
+  // need to make new entry, if none could be added nothing changed
+  return lookupSpeedTable(loco, true) >= 0;
 }
 
+// returns true if the 4 functions from shift upwards differ from the
+// speedTable, the caller stores them via DCC::setFn
 bool LocoTable::updateFunc(int loco, byte func, int shift) {
   unsigned long previous;
   unsigned long newfunc;
-  bool retval = false; // nothing was touched
   int reg = lookupSpeedTable(loco, false);
   if (reg < 0) { // not found
-    retval = true;
     reg = lookupSpeedTable(loco, true);
     if (reg < 0) // could not create new entry, nothing changed
       return false;
-    newfunc = previous = 0;
-  } else {
-    newfunc = previous = speedTable[reg].functions;
+    funccounter[reg]++;
+    return true;
   }
+  newfunc = previous = DCC::speedTable.functions[reg];
 
-  speedTable[reg].funccounter++;    
+  funccounter[reg]++;
 
   if(shift == 1) { // special case for light
     newfunc &= ~1UL;
     newfunc |= ((func & 0B10000) >> 4);
   }
   newfunc &= ~(0B1111UL << shift);
-  newfunc |=  ((func & 0B1111) << shift);
+  newfunc |=  ((unsigned long)(func & 0B1111) << shift);
 
-  if (newfunc != previous) {
-    speedTable[reg].functions = newfunc;
-    retval = true;
-  }
-  return retval;
+  return newfunc != previous;
 }
 
 void LocoTable::dumpTable(Stream *output) {
   output->print("\n-----------Table---------\n");
-  for (byte reg = 0; reg <= highestUsedReg; reg++) {
-    if (speedTable[reg].loco != 0) {
-      output->print(speedTable[reg].loco);
+  for (byte reg = 0; reg < DCC::tableSlots; reg++) {
+    if (DCC::speedTable.loco[reg] != 0) {
+      output->print(DCC::speedTable.loco[reg]);
       output->print(' ');
-      output->print(speedTable[reg].speedCode);
+      output->print(DCC::speedTable.speedCode[reg]);
       output->print(' ');
-      output->print(speedTable[reg].functions);
+      output->print(DCC::speedTable.functions[reg]);
       output->print(" #funcpacks:");
-      output->print(speedTable[reg].funccounter);
+      output->print(funccounter[reg]);
       output->print(" #speedpacks:");
-      output->print(speedTable[reg].speedcounter);
-      speedTable[reg].funccounter = 0;
-      speedTable[reg].speedcounter = 0;
+      output->print(speedcounter[reg]);
+      funccounter[reg] = 0;
+      speedcounter[reg] = 0;
       output->print('\n');
     }
   }
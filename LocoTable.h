@@ -18,27 +18,17 @@
 
 #include "DCC.h" // fetch MAX_LOCOS from there
 
+// The sniffer keeps no loco state of its own, it compares what it sees
+// on the track against the shared DCC::speedTable. Only the packet
+// counters for dumpTable are held here, indexed by the same slot.
 class LocoTable {
 public:
-  void forgetLoco(int cab) {
-    int reg=lookupSpeedTable(cab, false);
-    if (reg>=0) speedTable[reg].loco=0;
-  }
   static int lookupSpeedTable(int locoId, bool autoCreate);
   static bool updateLoco(int loco, byte speedCode);
   static bool updateFunc(int loco, byte func, int shift);
   static void dumpTable(Stream *output);
 
 private:
-  struct LOCO
-  {
-    int loco;
-    byte speedCode;
-    byte groupFlags;
-    unsigned long functions;
-    unsigned int funccounter;
-    unsigned int speedcounter;
-  };
-  static LOCO speedTable[MAX_LOCOS];
-  static int highestUsedReg;
+  static unsigned int funccounter[MAX_LOCOS];
+  static unsigned int speedcounter[MAX_LOCOS];
 };
@@ -0,0 +1,70 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "LoopProfile.h"
+#ifdef LOOP_PROFILE
+#include "DIAG.h"
+
+LoopProfile::Stats LoopProfile::stats[LoopProfile::SECTIONS];
+unsigned long LoopProfile::lastMark = 0;
+unsigned long LoopProfile::periodStart = 0;
+uint32_t LoopProfile::loops = 0;
+
+void LoopProfile::begin() {
+  lastMark = micros();
+  if (loops++ == 0) periodStart = millis();
+}
+
+void LoopProfile::mark(Section section) {
+  unsigned long now = micros();
+  uint32_t elapsed = now - lastMark;
+  lastMark = now;
+  Stats & s = stats[section];
+  s.total += elapsed;
+  s.count++;
+  if (elapsed > s.max) s.max = elapsed;
+  s.histogram.add(elapsed);
+}
+
+void LoopProfile::show(bool reset) {
+  static const char names[] PROGMEM  = 
+    "SNIFFER\0DCC\0SERIAL\0WIFI\0ETHERNET\0RMFT\0LCN\0"
+    "DISPLAY\0IO\0SENSORS\0EEPROM\0DIAGLOG\0MEMORY\0";
+  uint32_t elapsed = millis() - periodStart;
+  if (loops > 1 && elapsed > 0)
+    DIAG(F("Loop %l/s over %lms"), (uint32_t)(loops * 1000.0 / elapsed), elapsed);
+  const char * name = names;
+  for (byte n = 0; n < SECTIONS; n++) {
+    Stats & s = stats[n];
+    if (s.count) {
+      uint32_t p99 = s.histogram.percentile(99);
+      if (p99 == s.histogram.OPEN_ENDED) p99 = s.max;
+      DIAG(F("%S mean %lus p99 <%lus max %lus"), (const FSH *)name, s.total / s.count, p99, s.max);
+    }
+    name += strlen_P(name) + 1;
+  }
+  if (reset) {
+    for (byte n = 0; n < SECTIONS; n++) {
+      stats[n].total = stats[n].count = stats[n].max = 0;
+      stats[n].histogram.reset();
+    }
+    loops = 0;
+  }
+}
+#endif
@@ -0,0 +1,66 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LoopProfile_h
+#define LoopProfile_h
+#include <Arduino.h>
+#include "defines.h"
+
+// Main loop profiling, only compiled in when LOOP_PROFILE is defined
+// in config.h. Each responsibility in loop() is followed by a
+// LOOP_PROFILE_MARK naming it, which charges the time since the
+// previous mark to that section. Shown by <D LOOP [RESET]>.
+//#define LOOP_PROFILE
+
+#ifdef LOOP_PROFILE
+#include "PacketStats.h"
+
+class LoopProfile {
+public:
+  // prefixed, as SERIAL and DISPLAY are macros on some cores
+  enum Section : byte {
+    PROFILE_SNIFFER, PROFILE_DCC, PROFILE_SERIAL, PROFILE_WIFI,
+    PROFILE_ETHERNET, PROFILE_RMFT, PROFILE_LCN, PROFILE_DISPLAY,
+    PROFILE_IO, PROFILE_SENSORS, PROFILE_EEPROM, PROFILE_DIAGLOG,
+    PROFILE_MEMORY,
+    SECTIONS
+  };
+  static void begin();
+  static void mark(Section section);
+  static void show(bool reset);
+private:
+  struct Stats {
+    uint32_t total;
+    uint32_t count;
+    uint32_t max;
+    StatsHistogram<4> histogram;  // from 16us to 2ms
+  };
+  static Stats stats[SECTIONS];
+  static unsigned long lastMark;
+  static unsigned long periodStart;  // millis
+  static uint32_t loops;
+};
+
+#define LOOP_PROFILE_BEGIN() LoopProfile::begin()
+#define LOOP_PROFILE_MARK(section) LoopProfile::mark(LoopProfile::PROFILE_##section)
+#else
+#define LOOP_PROFILE_BEGIN()
+#define LOOP_PROFILE_MARK(section)
+#endif
+#endif
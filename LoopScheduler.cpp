@@ -0,0 +1,33 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "LoopScheduler.h"
+
+unsigned long LoopScheduler::loopStart = 0;
+
+bool LoopScheduler::due(unsigned long & last, uint16_t interval) {
+  unsigned long now = millis();
+  unsigned long waited = now - last;
+  if (waited < interval) return false;
+  if (micros() - loopStart >= LOOP_BACKGROUND_BUDGET
+      && waited < (unsigned long)interval + LOOP_BACKGROUND_MAXWAIT)
+    return false;
+  last = now;
+  return true;
+}
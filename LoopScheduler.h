@@ -0,0 +1,48 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LoopScheduler_h
+#define LoopScheduler_h
+#include <Arduino.h>
+#include "defines.h"
+
+// loop() runs the latency critical responsibilities (DCC, command
+// input, WiFi/Ethernet, EX-RAIL, IO devices and sensors) on every pass.
+// Background work (display refresh, EEPROM writes, the free memory
+// report) only runs in the time left over: while the pass so far has
+// taken less than LOOP_BACKGROUND_BUDGET microseconds. A background
+// task that has been put off for LOOP_BACKGROUND_MAXWAIT milliseconds
+// runs anyway so that it is never starved.
+#ifndef LOOP_BACKGROUND_BUDGET
+#define LOOP_BACKGROUND_BUDGET 2000
+#endif
+#ifndef LOOP_BACKGROUND_MAXWAIT
+#define LOOP_BACKGROUND_MAXWAIT 100
+#endif
+
+class LoopScheduler {
+public:
+  static inline void begin() { loopStart = micros(); }
+  // True when a background task, last run at 'last' (millis), should
+  // run now. At most every 'interval' ms. Updates 'last' when true.
+  static bool due(unsigned long & last, uint16_t interval = 0);
+private:
+  static unsigned long loopStart;
+};
+#endif
@@ -28,6 +28,7 @@
 #include "DCCWaveform.h"
 #include "DCCTimer.h"
 #include "DIAG.h"
+#include "StringFormatter.h"
 #include "EXRAIL2.h"
 
 unsigned long MotorDriver::globalOverloadStart = 0;
@@ -194,6 +195,9 @@ MotorDriver::MotorDriver(int16_t power_pin, byte signal_pin, byte signal_pin2, i
   // This conversion performed at compile time so the remainder of the code never needs
   // float calculations or libraray code. 
   senseFactorInternal=sense_factor * senseScale; 
+  // and the inverse for mA2raw, so that neither needs a division at run time
+  mA2rawFactor = senseFactorInternal>0 ? ((uint32_t)senseScale<<16)/senseFactorInternal : 0;
+  mA2rawLimit = mA2rawFactor ? 0xFFFFFFFFUL/mA2rawFactor : 0;
   tripMilliamps=trip_milliamps;
 #ifdef MAX_CURRENT
   if (MAX_CURRENT > 0 && MAX_CURRENT < tripMilliamps)
@@ -348,9 +352,9 @@ uint16_t taurustones[28] = { 165, 175, 196, 220,
 			     220, 196, 175, 165 };
 #endif
 #endif
-void MotorDriver::setDCSignal(byte speedcode, uint8_t frequency /*default =0*/) {
+bool MotorDriver::setDCSignal(byte speedcode, uint8_t frequency /*default =0*/, byte kick /*default =0*/) {
   if (brakePin == UNUSED_PIN)
-    return;
+    return false;
   // spedcoode is a dcc speed & direction
   byte tSpeed=speedcode & 0x7F; // DCC Speed with 0,1 stop and speed steps 2 to 127
   byte tDir=speedcode & 0x80;
@@ -360,24 +364,34 @@ void MotorDriver::setDCSignal(byte speedcode, uint8_t frequency /*default =0*/)
   else if (tSpeed >= 127) brake = 0;
   else  brake = 2 * (128-tSpeed);
 
-  { // new block because of variable f
+  uint16_t f = frequency;
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_STM32)
-    int f = frequency;
 #ifdef VARIABLE_TONES
-    if (tSpeed > 2) {
-      if (tSpeed <= 58) {
-	f = taurustones[ (tSpeed-2)/2 ] ;
-      }
+  if (tSpeed > 2) {
+    if (tSpeed <= 58) {
+      f = taurustones[ (tSpeed-2)/2 ] ;
     }
+  }
 #endif
-    //DIAG(F("Brake pin %d value %d freqency %d"), brakePin, brake, f);
-    DCCTimer::DCCEXanalogWrite(brakePin, brake, invertBrake);
-    DCCTimer::DCCEXanalogWriteFrequency(brakePin, f); // set DC PWM frequency
-#else // all AVR here
-    DCCTimer::DCCEXanalogWriteFrequency(brakePin, frequency); // frequency steps
-    analogWrite(brakePin, invertBrake ? 255-brake : brake);
 #endif
+
+#ifdef DC_KICKSTART
+  if (dcKickEnd) {           // already kicking, the new speed follows it
+    if (brake == 255) dcKickEnd = 0;
+    else {
+      dcKickBrake = brake;
+      brake = 0;
+    }
+  } else if (kick && brake < 255 && dcBrake >= 255) { // starting from standstill
+    dcKickBrake = brake;
+    brake = 0;
+    dcKickEnd = millis() + kick;
+    if (dcKickEnd == 0) dcKickEnd = 1;
   }
+#else
+  (void) kick;
+#endif
+  writeDCBrake(brake, f);
 
   //DIAG(F("DCSignal %d"), speedcode);
   if (HAVE_PORTA(fastSignalPin.shadowinout == &PORTA)) {
@@ -433,10 +447,47 @@ void MotorDriver::setDCSignal(byte speedcode, uint8_t frequency /*default =0*/)
     setSignal(tDir);
     interrupts();
   }
+#ifdef DC_KICKSTART
+  return dcKickEnd != 0;
+#else
+  return false;
+#endif
 }
+
+// The brake pin PWM is only changed when the duty or frequency differ
+// from what was last written, as reprogramming the timer can glitch
+// the output and on some ports also DIAGs.
+void MotorDriver::writeDCBrake(byte brake, uint16_t frequency) {
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_STM32)
+  //DIAG(F("Brake pin %d value %d freqency %d"), brakePin, brake, frequency);
+  if (brake != dcBrake)
+    DCCTimer::DCCEXanalogWrite(brakePin, brake, invertBrake);
+  if (frequency != dcFrequency)
+    DCCTimer::DCCEXanalogWriteFrequency(brakePin, frequency); // set DC PWM frequency
+#else // all AVR here
+  if (frequency != dcFrequency)
+    DCCTimer::DCCEXanalogWriteFrequency(brakePin, frequency); // frequency steps
+  if (brake != dcBrake)
+    analogWrite(brakePin, invertBrake ? 255-brake : brake);
+#endif
+  dcBrake = brake;
+  dcFrequency = frequency;
+}
+
+#ifdef DC_KICKSTART
+bool MotorDriver::endDCKick(unsigned long now) {
+  if (dcKickEnd == 0) return false;
+  if ((long)(now - dcKickEnd) < 0) return true;
+  dcKickEnd = 0;
+  writeDCBrake(dcKickBrake, dcFrequency);
+  return false;
+}
+#endif
+
 void MotorDriver::throttleInrush(bool on) {
   if (brakePin == UNUSED_PIN)
     return;
+  forgetDCSignal(); // the brake pin PWM is not ours any more
   if ( !(trackMode & (TRACK_MODE_MAIN | TRACK_MODE_PROG | TRACK_MODE_EXT | TRACK_MODE_BOOST)))
     return;
   byte duty = on ? 207 : 0; // duty of 81% at 62500Hz this gives pauses of 3usec
@@ -463,15 +514,154 @@ void MotorDriver::throttleInrush(bool on) {
   analogWrite(brakePin,duty);
 #endif
 }
-unsigned int MotorDriver::raw2mA( int raw) {
-  //DIAG(F("%d = %d * %d / %d"), (int32_t)raw * senseFactorInternal / senseScale, raw, senseFactorInternal, senseScale);
-  return (int32_t)raw * senseFactorInternal / senseScale;
+#ifdef HAS_ENOUGH_MEMORY
+uint16_t MotorDriver::historyInterval=1000;
+
+void MotorDriver::recordCurrent(unsigned long now) {
+  int raw=getCurrentRaw(false);
+  if (raw<0) raw=-raw;
+  if ((uint16_t)raw<periodMin) periodMin=raw;
+  if ((uint16_t)raw>periodMax) periodMax=raw;
+  periodSum+=raw;
+  periodSamples++;
+  if (now-periodStart < historyInterval && periodSamples!=0xFFFF) return;
+  CURRENT_SUMMARY & h=history[historyNext];
+  h.min=periodMin;
+  h.max=periodMax;
+  h.avg=periodSum/periodSamples;
+  historyNext = (historyNext+1) % CURRENT_HISTORY;
+  if (historyCount<CURRENT_HISTORY) historyCount++;
+  periodMin=0xFFFF;
+  periodMax=0;
+  periodSum=0;
+  periodSamples=0;
+  periodStart=now;
+}
+
+// min max avg in mA for each summary, oldest first
+void MotorDriver::reportHistory(Print *stream) {
+  byte slot=(historyNext+CURRENT_HISTORY-historyCount) % CURRENT_HISTORY;
+  for (byte n=0; n<historyCount; n++) {
+    CURRENT_SUMMARY & h=history[slot];
+    StringFormatter::send(stream, F(" %d %d %d"), raw2mA(h.min), raw2mA(h.max), raw2mA(h.avg));
+    slot=(slot+1) % CURRENT_HISTORY;
+  }
+}
+#endif
+
+#if defined(ARDUINO_ARCH_STM32) && defined(STM32_SIGNAL_BSRR)
+// Merge one signal pin into the per port BSRR words: the pin is set
+// for one signal level and reset (upper half of BSRR) for the other.
+static void addPinBSRR(SIGNAL_PORT ports[], byte & count, byte pin, bool inverted) {
+  volatile uint32_t *bsrr = &(digitalPinToPort(pin)->BSRR);
+  uint32_t mask = digitalPinToBitMask(pin);
+  byte p;
+  for (p=0; p<count; p++)
+    if (ports[p].bsrr == bsrr) break;
+  if (p == count) {
+    ports[p].bsrr = bsrr;
+    ports[p].word[0] = ports[p].word[1] = 0;
+    count++;
+  }
+  ports[p].word[inverted ? 0 : 1] |= mask;
+  ports[p].word[inverted ? 1 : 0] |= mask << 16;
+}
+
+void MotorDriver::addSignalPorts(SIGNAL_PORT ports[], byte & count) {
+  signalMapDirty=false;
+  addPinBSRR(ports, count, signalPin, invertPhase);
+  if (dualSignal) addPinBSRR(ports, count, signalPin2, !invertPhase);
 }
-unsigned int MotorDriver::mA2raw( unsigned int mA) {
-  //DIAG(F("%d = %d * %d / %d"), (int32_t)mA * senseScale / senseFactorInternal, mA, senseScale, senseFactorInternal);
-  return (int32_t)mA * senseScale / senseFactorInternal;
+
+#ifdef FAST_REVERSER
+// Swap set and reset of one pin in place, from interrupt
+static void flipPinBSRR(SIGNAL_PORT ports[], byte count, byte pin) {
+  volatile uint32_t *bsrr = &(digitalPinToPort(pin)->BSRR);
+  uint32_t mask = digitalPinToBitMask(pin);
+  mask |= mask << 16;
+  for (byte p=0; p<count; p++)
+    if (ports[p].bsrr == bsrr) {
+      ports[p].word[0] ^= mask;
+      ports[p].word[1] ^= mask;
+    }
 }
 
+void MotorDriver::flipSignalPorts(SIGNAL_PORT ports[], byte count) {
+  flipPinBSRR(ports, count, signalPin);
+  if (dualSignal) flipPinBSRR(ports, count, signalPin2);
+}
+#endif
+#elif defined(SIGNAL_PORT_MASKS)
+// Merge one signal pin into the per port masks: the pin is set for
+// one signal level and cleared for the other. The real port register
+// is used, not the shadow in fastSignalPin.
+static void addPinMask(SIGNAL_PORT ports[], byte & count, byte pin, bool inverted) {
+  volatile portreg_t *out = portOutputRegister(digitalPinToPort(pin));
+  portreg_t mask = digitalPinToBitMask(pin);
+  byte p;
+  for (p=0; p<count; p++)
+    if (ports[p].out == out) break;
+  if (p == count) {
+    ports[p].out = out;
+    ports[p].keep = (portreg_t)~0;
+    ports[p].set[0] = ports[p].set[1] = 0;
+    count++;
+  }
+  ports[p].keep &= ~mask;
+  ports[p].set[inverted ? 0 : 1] |= mask;
+}
+
+void MotorDriver::addSignalPorts(SIGNAL_PORT ports[], byte & count) {
+  signalMapDirty=false;
+  addPinMask(ports, count, signalPin, invertPhase);
+  if (dualSignal) addPinMask(ports, count, signalPin2, !invertPhase);
+}
+
+#ifdef FAST_REVERSER
+// Swap the levels of one pin in place, from interrupt
+static void flipPinMask(SIGNAL_PORT ports[], byte count, byte pin) {
+  volatile portreg_t *out = portOutputRegister(digitalPinToPort(pin));
+  portreg_t mask = digitalPinToBitMask(pin);
+  for (byte p=0; p<count; p++)
+    if (ports[p].out == out) {
+      ports[p].set[0] ^= mask;
+      ports[p].set[1] ^= mask;
+    }
+}
+
+void MotorDriver::flipSignalPorts(SIGNAL_PORT ports[], byte count) {
+  flipPinMask(ports, count, signalPin);
+  if (dualSignal) flipPinMask(ports, count, signalPin2);
+}
+#endif
+#endif
+
+#ifdef SIGNAL_COMPARE
+// HA mode drives only signalPin from the timer (see setSignal()),
+// so there is one compare register per track.
+void MotorDriver::addSignalCompare(SIGNAL_OCR list[], byte & count) {
+  volatile uint16_t *ocr = DCCTimer::enablePWM(signalPin);
+  if (ocr == NULL) return;
+  list[count].ocr = ocr;
+  list[count].value[invertPhase ? 1 : 0] = 0;
+  list[count].value[invertPhase ? 0 : 1] = DCCTimer::PWM_HIGH;
+  count++;
+}
+
+#ifdef FAST_REVERSER
+// Swap the levels of this track's compare register in place, from interrupt
+void MotorDriver::flipSignalCompare(SIGNAL_OCR list[], byte count) {
+  volatile uint16_t *ocr = DCCTimer::pwmRegister(signalPin);
+  for (byte p=0; p<count; p++)
+    if (list[p].ocr == ocr) {
+      uint16_t v = list[p].value[0];
+      list[p].value[0] = list[p].value[1];
+      list[p].value[1] = v;
+    }
+}
+#endif
+#endif
+
 void  MotorDriver::getFastPin(const FSH* type,int pin, bool input, FASTPIN & result) {
     // DIAG(F("MotorDriver %S Pin=%d,"),type,pin);
     (void) type; // avoid compiler warning if diag not used above.
@@ -576,7 +766,11 @@ void MotorDriver::checkPowerOverload(bool useProgLimit, byte trackno) {
 	DIAG(F("TRACK %c ALERT FAULT"), trackno + 'A');
       }
       setPower(POWERMODE::ALERT);
-      if ((trackMode & TRACK_MODIFIER_AUTO) && (trackMode & (TRACK_MODE_MAIN|TRACK_MODE_EXT|TRACK_MODE_BOOST))){
+#ifdef FAST_REVERSER
+      if (isReverser() && !fastReverser()) { // else checkReverser flips
+#else
+      if (isReverser()) {
+#endif
 	DIAG(F("TRACK %c INVERT"), trackno + 'A');
 	invertOutput();
       }
@@ -670,3 +864,50 @@ void MotorDriver::checkPowerOverload(bool useProgLimit, byte trackno) {
     break;
   }
 }
+
+#ifdef FAST_REVERSER
+// Called from the DCC interrupt (from loop on ESP32) for reverse loop
+// tracks. A sample over the trip value or an active fault pin flips the
+// phase at once if the track has been good since the last flip and
+// REVERSER_HOLDOFF has passed. The reaction time is counted from the
+// last good sample of this track, so it includes the interval between
+// checks but not the age of the ADC reading.
+#pragma GCC push_options
+#pragma GCC optimize ("-O3")
+bool MotorDriver::checkReverser(uint16_t tick) {
+  if (powerMode!=POWERMODE::ON && powerMode!=POWERMODE::ALERT) {
+    reverserGoodTick=tick;
+    return false;
+  }
+  int current=getCurrentRaw(true);
+  if (current>=0 && current<rawCurrentTripValue) {
+    reverserGoodTick=tick;
+    if ((uint16_t)(tick-reverserFlipTick) >= REVERSER_HOLDOFF)
+      reverserArmed=true;
+    return false;
+  }
+  if (!reverserArmed) return false;
+  invertOutput();
+  reverserArmed=false;
+  reverserFlipTick=tick;
+  reverserFlips++;
+  uint16_t reaction=tick-reverserGoodTick;
+  if (reaction>reverserMaxTicks) reverserMaxTicks=reaction;
+  reverserReaction.add((uint32_t)reaction*REVERSER_TICK_US);
+  return true;
+}
+#pragma GCC pop_options
+
+void MotorDriver::showReverser(bool reset) {
+  noInterrupts();
+  uint16_t flips=reverserFlips;
+  uint32_t maxUs=(uint32_t)reverserMaxTicks*REVERSER_TICK_US;
+  if (reset) reverserFlips=reverserMaxTicks=0;
+  interrupts();
+  uint32_t p95=reverserReaction.percentile(95);
+  if (p95==reverserReaction.OPEN_ENDED) p95=maxUs;
+  DIAG(F("TRACK %c REVERSER %d flips p95 <%lus max %lus"), trackLetter, flips, p95, maxUs);
+  if (flips) reverserReaction.show(F("Reaction"), F("us"));
+  if (reset) reverserReaction.reset();
+}
+#endif
@@ -29,6 +29,15 @@
 #include <wiring_private.h>
 
 #include "TemplateForEnums.h"
+#include "PacketStats.h"
+
+// DC kick-start: a short burst of full power when a DC loco starts from
+// standstill so that stiff motors get moving at low speed steps. The
+// length is stored per loco and set with <F CAB DCKICK ms>.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_DC_KICKSTART)
+#define DC_KICKSTART
+#endif
+
 // use powers of two so we can do logical and/or on the track modes in if clauses.
 // For example TRACK_MODE_DC_INV is (TRACK_MODE_DC|TRACK_MODIFIER_INV)
 enum TRACK_MODE : byte {
@@ -154,6 +163,56 @@ typedef uint32_t portreg_t;
 typedef uint8_t portreg_t;
 #endif
 
+// The DCC signal pins of all tracks on the same waveform are written
+// with one precomputed access per GPIO port, built by TrackManager from
+// the track modes and phase inversions. Define DISABLE_SIGNAL_MASKS in
+// config.h to go back to setting each track's pins in turn.
+#if defined(ARDUINO_ARCH_STM32) && defined(STM32_SIGNAL_DMA) && !defined(STM32_SIGNAL_BSRR)
+#define STM32_SIGNAL_BSRR  // the DMA sends these words
+#endif
+#if defined(ARDUINO_ARCH_STM32) && defined(STM32_SIGNAL_BSRR)
+#define SIGNAL_PORT_MASKS
+// One atomic BSRR write per GPIO port and signal level
+struct SIGNAL_PORT {
+  volatile uint32_t *bsrr;
+  uint32_t word[2]; // [0] for signal LOW, [1] for signal HIGH
+};
+__attribute__((always_inline)) inline void setSignalPort(SIGNAL_PORT & p, bool high) {
+  *p.bsrr = p.word[high];
+}
+#elif !defined(ARDUINO_ARCH_ESP32) && !defined(DISABLE_SIGNAL_MASKS)
+#define SIGNAL_PORT_MASKS
+// One read-modify-write per port register and signal level
+struct SIGNAL_PORT {
+  volatile portreg_t *out;
+  portreg_t keep;   // bits of other pins on this port
+  portreg_t set[2]; // [0] for signal LOW, [1] for signal HIGH
+};
+__attribute__((always_inline)) inline void setSignalPort(SIGNAL_PORT & p, bool high) {
+  *p.out = (*p.out & p.keep) | p.set[high];
+}
+#endif
+// In HA mode on AVR the signal pins are Timer1 compare outputs. The
+// interrupt then only loads each compare register with the value for
+// the next half bit, and the timer switches the pin at the period
+// boundary without any jitter from the ISR. Define
+// DISABLE_SIGNAL_COMPARE in config.h to set the tracks one by one.
+#if defined(ARDUINO_ARCH_AVR) && defined(SIGNAL_PORT_MASKS) && !defined(DISABLE_SIGNAL_COMPARE)
+#define SIGNAL_COMPARE
+struct SIGNAL_OCR {
+  volatile uint16_t *ocr;
+  uint16_t value[2]; // [0] for signal LOW, [1] for signal HIGH
+};
+#endif
+// On STM32 with STM32_SIGNAL_DMA in config.h, the word for the first
+// MAIN port is written to its BSRR by DMA on every tick of the waveform
+// timer, so the MAIN edges do not wait for the interrupt. The interrupt
+// only refills the DMA buffer, half of it at a time (see
+// DCCWaveform::fillSignalDMA). Any further MAIN ports follow from the
+// interrupt as before.
+#if defined(ARDUINO_ARCH_STM32) && defined(SIGNAL_PORT_MASKS) && defined(STM32_SIGNAL_DMA)
+#define SIGNAL_DMA
+#endif
 struct FASTPIN {
   volatile portreg_t *inout;
   portreg_t maskHIGH;
@@ -220,20 +279,34 @@ class MotorDriver {
     };
     inline pinpair getSignalPin() { return pinpair(signalPin,signalPin2); };
     inline int8_t getBrakePinSigned() { return invertBrake ? -brakePin : brakePin; };
-    void setDCSignal(byte speedByte, uint8_t frequency=0);
+    // returns true while a kick-start is running, see endDCKick
+    bool setDCSignal(byte speedByte, uint8_t frequency=0, byte kick=0);
+#ifdef DC_KICKSTART
+    bool endDCKick(unsigned long now); // true while still kicking
+#endif
     void throttleInrush(bool on);
     inline void detachDCSignal() {
 #if defined(__arm__)
       pinMode(brakePin, OUTPUT);
+      forgetDCSignal();
 #elif defined(ARDUINO_ARCH_ESP32)
       DCCTimer::DCCEXledcDetachPin(brakePin);
+      forgetDCSignal();
 #else
       setDCSignal(128);
 #endif
     };
     int  getCurrentRaw(bool fromISR=false);
-    unsigned int raw2mA( int raw);
-    unsigned int mA2raw( unsigned int mA);
+    // Negative raw values (fault pin flag) give negative mA
+    inline unsigned int raw2mA( int raw) {
+      if (raw<0) return -(int)(((uint32_t)(-raw) * senseFactorInternal) >> senseShift);
+      return ((uint32_t)raw * senseFactorInternal) >> senseShift;
+    }
+    inline unsigned int mA2raw( unsigned int mA) {
+      if (mA > mA2rawLimit) // product would overflow
+        return (int32_t)mA * senseScale / senseFactorInternal;
+      return ((uint32_t)mA * mA2rawFactor) >> 16;
+    }
     inline bool brakeCanPWM() {
 #if defined(ARDUINO_ARCH_ESP32)
       return (brakePin != UNUSED_PIN); // This was just (true) but we probably do need to check for UNUSED_PIN!
@@ -251,6 +324,15 @@ class MotorDriver {
     }
     bool isPWMCapable();
     bool canMeasureCurrent();
+#ifdef HAS_ENOUGH_MEMORY
+    // Rolling current history: each entry summarises historyInterval ms
+    // of samples taken by TrackManager::loop. Shown by <JI HISTORY [ms]>.
+    static const byte CURRENT_HISTORY=8;
+    static uint16_t historyInterval;
+    void recordCurrent(unsigned long now);
+    void reportHistory(Print *stream);
+    inline void clearHistory() { historyCount=0; historyNext=0; }
+#endif
     bool trackPWM = false; // this track uses PWM timer to generate the DCC waveform
     bool commonFaultPin = false; // This is a stupid motor shield which has only a common fault pin for both outputs
     inline byte setCommonFaultPin() {
@@ -263,6 +345,26 @@ class MotorDriver {
       isProgTrack = on;
     }
     void checkPowerOverload(bool useProgLimit, byte trackno);
+    inline bool isReverser() {
+      return (trackMode & TRACK_MODIFIER_AUTO) && (trackMode & (TRACK_MODE_MAIN|TRACK_MODE_EXT|TRACK_MODE_BOOST));
+    }
+#ifdef FAST_REVERSER
+    inline bool fastReverser() { return isReverser() && currentPin!=UNUSED_PIN; }
+    // tick counts REVERSER_TICK_US, true if the phase was just flipped
+    bool checkReverser(uint16_t tick);
+    void showReverser(bool reset);
+#ifdef SIGNAL_PORT_MASKS
+    void flipSignalPorts(SIGNAL_PORT ports[], byte count);
+#endif
+#ifdef SIGNAL_COMPARE
+    void flipSignalCompare(SIGNAL_OCR list[], byte count);
+#endif
+#ifdef ARDUINO_ARCH_ESP32
+    static const uint16_t REVERSER_TICK_US=1;  // micros() from loop
+#else
+    static const uint16_t REVERSER_TICK_US=58;  // one DCC interrupt, DCC_SIGNAL_TIME
+#endif
+#endif
     inline void setTrackLetter(char c) {
       trackLetter = c;
     };
@@ -282,6 +384,7 @@ class MotorDriver {
 #endif
   inline void setMode(TRACK_MODE m) {
     trackMode = m;
+    forgetDCSignal();
     invertOutput(trackMode & TRACK_MODIFIER_INV);
   };
   inline void invertOutput() {               // toggles output inversion
@@ -307,8 +410,18 @@ class MotorDriver {
       else
 	*outreg |=  ((uint32_t)0x1 << GPIO_FUNC0_OUT_INV_SEL_S);
     }
+#endif
+#ifdef SIGNAL_PORT_MASKS
+    signalMapDirty=true; // TrackManager must rebuild its port masks
 #endif
   };
+#ifdef SIGNAL_PORT_MASKS
+  void addSignalPorts(SIGNAL_PORT ports[], byte & count);
+  bool signalMapDirty=true;
+#endif
+#ifdef SIGNAL_COMPARE
+  void addSignalCompare(SIGNAL_OCR list[], byte & count);
+#endif
   inline TRACK_MODE getMode() {
     return trackMode;
   };
@@ -340,6 +453,33 @@ class MotorDriver {
     bool invertPower;       // power pin passed as negative means pin is inverted
     bool invertFault;       // fault pin passed as negative means pin is inverted
     bool invertPhase = 0;   // phase of out pin is inverted
+    // Last PWM settings of the brake pin in DC mode so that unchanged
+    // ones are not written to the timer again, 0xFFFF when unknown
+    uint16_t dcBrake = 0xFFFF;
+    uint16_t dcFrequency = 0xFFFF;
+    void writeDCBrake(byte brake, uint16_t frequency);
+    inline void forgetDCSignal() {
+      dcBrake = dcFrequency = 0xFFFF;
+#ifdef DC_KICKSTART
+      dcKickEnd = 0;
+#endif
+    };
+#ifdef FAST_REVERSER
+    // Minimum time between two flips so that the inrush after a flip
+    // does not flip back. A short that is still there after a flip is
+    // left to the overload handling.
+    static const uint16_t REVERSER_HOLDOFF=2000/REVERSER_TICK_US;
+    bool reverserArmed = false;     // a sample below the trip value was seen
+    uint16_t reverserGoodTick = 0;  // last sample below the trip value
+    uint16_t reverserFlipTick = 0;
+    volatile uint16_t reverserFlips = 0;
+    volatile uint16_t reverserMaxTicks = 0;
+    StatsHistogram<6> reverserReaction; // us from last good sample to flip
+#endif
+#ifdef DC_KICKSTART
+    unsigned long dcKickEnd = 0; // millis() when the kick ends, 0 if none
+    byte dcKickBrake;            // the brake duty after the kick
+#endif
     // Raw to milliamp conversion factors avoiding float data types.
     // Milliamps=rawADCreading * sensefactorInternal / senseScale
     //
@@ -347,6 +487,9 @@ class MotorDriver {
     // raw->mA conversion with an ultra fast optimised integer multiplication  
     int senseFactorInternal;  // set to senseFactor * senseScale
     static const int senseScale=256;
+    static const byte senseShift=8;  // log2(senseScale)
+    uint32_t mA2rawFactor;  // (senseScale<<16) / senseFactorInternal
+    uint32_t mA2rawLimit;   // largest mA that mA2rawFactor can multiply
     int senseOffset;
     unsigned int tripMilliamps;
     int rawCurrentTripValue;
@@ -389,6 +532,17 @@ class MotorDriver {
     unsigned long power_sample_overload_wait = POWER_SAMPLE_OVERLOAD_WAIT;
     unsigned int power_good_counter = 0;
     TRACK_MODE trackMode = TRACK_MODE_NONE; // we assume track not assigned at startup
+#ifdef HAS_ENOUGH_MEMORY
+    struct CURRENT_SUMMARY { uint16_t min, max, avg; }; // raw ADC units
+    CURRENT_SUMMARY history[CURRENT_HISTORY];
+    byte historyNext = 0;     // slot the next summary goes into
+    byte historyCount = 0;    // valid summaries
+    uint16_t periodMin = 0xFFFF;
+    uint16_t periodMax = 0;
+    uint32_t periodSum = 0;
+    uint16_t periodSamples = 0;
+    unsigned long periodStart = 0; // millis
+#endif
 
 };
 #endif
@@ -111,7 +111,7 @@ void  Output::activate(uint16_t s){
 #ifndef DISABLE_EEPROM
   // Update EEPROM if output has been stored.    
   if(EEStore::eeStore->data.nOutputs > 0 && num > 0)
-    EEPROM.put(num, data.oStatus);
+    EEStore::update(num, data.oStatus);
 #endif
 }
 
@@ -157,14 +157,26 @@ void Output::load(){
     EEPROM.get(EEStore::pointer(),data);
     // Create new object, set current state to default or to saved state from eeprom.
     tt=create(data.id, data.pin, data.flags);
-    uint8_t state = data.setDefault ? data.defaultValue : data.active;
-    tt->activate(state);
+    // The pin is written later by restoreAll()
+    if (tt) tt->data.active = data.setDefault ? data.defaultValue : data.active;
 
     if (tt) tt->num=EEStore::pointer() + offsetof(OutputData, oStatus); // Save pointer to flags within EEPROM
     EEStore::advance(sizeof(tt->data));
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Static function to write the states loaded from EEPROM to the output pins.  
+// This is done in one write batch, so that outputs on the same GPIO extender 
+// are sent to it together.
+
+void Output::restoreAll(){
+  IODevice::beginWriteBatch();
+  for (Output *tt=firstOutput; tt!=NULL; tt=tt->nextOutput)
+    IODevice::write(tt->data.pin, tt->data.active ^ tt->data.invert);
+  IODevice::endWriteBatch();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Static function to store configuration and state of all Outputs to EEPROM
 
@@ -188,7 +200,8 @@ void Output::store(){
 ///////////////////////////////////////////////////////////////////////////////
 // Static function to create an Output object
 //   The obscurely named parameter 'v' is 0 if called from the load() function
-//   and 1 if called from the <Z> command processing.
+//   and 1 if called from the <Z> command processing.  The pin is only written
+//   here for <Z>; loaded outputs are written by restoreAll().
 
 Output *Output::create(uint16_t id, VPIN pin, int iFlag, int v){
   Output *tt;
@@ -218,8 +231,8 @@ Output *Output::create(uint16_t id, VPIN pin, int iFlag, int v){
       tt->data.active = tt->data.defaultValue;
     else
       tt->data.active = 0;
+    IODevice::write(tt->data.pin, tt->data.active ^ tt->data.invert);
   }
-  IODevice::write(tt->data.pin, tt->data.active ^ tt->data.invert);
 
   return(tt);
 }
@@ -54,6 +54,7 @@ public:
 #ifndef DISABLE_EEPROM
   static void load();
   static void store();
+  static void restoreAll();
 #endif
   static Output *create(uint16_t, VPIN, int, int=0);
   static Output *firstOutput;
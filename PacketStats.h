@@ -0,0 +1,91 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PacketStats_h
+#define PacketStats_h
+#include <Arduino.h>
+#include "defines.h"
+#include "DIAG.h"
+
+// Packet latency instrumentation, only compiled in when
+// DCC_PACKET_STATS is defined in config.h. Shown by <D LATENCY>.
+// The histogram is also used by LOOP_PROFILE (see LoopProfile.h)
+// and FAST_REVERSER (see MotorDriver.h).
+#if defined(DCC_PACKET_STATS) || defined(LOOP_PROFILE) || defined(FAST_REVERSER)
+
+// Histogram with power of two buckets so that adding a sample from
+// an ISR is a few shifts. Bucket 0 counts values below 1<<SHIFT,
+// bucket n values below 1<<(SHIFT+n), the last bucket everything else.
+template <byte SHIFT>
+class StatsHistogram {
+public:
+  static const byte BUCKETS=8;
+
+  void add(uint32_t value) {
+    value >>= SHIFT;
+    byte b=0;
+    while (value && b<BUCKETS-1) {
+      value >>= 1;
+      b++;
+    }
+    count[b]++;
+  }
+
+  // may be called with interrupts on while the ISR adds samples
+  void show(const FSH * name, const FSH * unit) {
+    uint32_t snapshot[BUCKETS];
+    noInterrupts();
+    memcpy(snapshot, (const void *)count, sizeof(snapshot));
+    interrupts();
+    DIAG(F("%S"), name);
+    for (byte b=0; b<BUCKETS-1; b++)
+      DIAG(F("  <%L%S %L"), 1UL<<(SHIFT+b), unit, snapshot[b]);
+    DIAG(F("  more %L"), snapshot[BUCKETS-1]);
+  }
+
+  // percentile() of a sample in the open ended last bucket
+  static const uint32_t OPEN_ENDED=UINT32_MAX;
+
+  // Upper bound of the bucket holding the pct percentile sample,
+  // 0 if no samples and OPEN_ENDED if it is in the last bucket.
+  uint32_t percentile(byte pct) {
+    uint32_t total=0;
+    for (byte b=0; b<BUCKETS; b++) total+=count[b];
+    if (total==0) return 0;
+    uint32_t below=total-(total*(100-pct))/100;
+    uint32_t seen=0;
+    for (byte b=0; b<BUCKETS-1; b++) {
+      seen+=count[b];
+      if (seen>=below) return 1UL<<(SHIFT+b);
+    }
+    return OPEN_ENDED;
+  }
+
+  void reset() {
+    noInterrupts();
+    memset((void *)count, 0, sizeof(count));
+    interrupts();
+  }
+
+private:
+  volatile uint32_t count[BUCKETS] = {0};
+};
+
+#endif
+#endif
@@ -0,0 +1,115 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "Railcom.h"
+#ifdef RAILCOM_SERIAL
+#include "DCC.h"
+#include "DCCWaveform.h"
+#include "DIAG.h"
+#include "LocoTable.h"
+
+// 4/8 code of RCN-217: the received byte for each 6 bit value.
+// All other bytes with four bits set are ACK, NACK or BUSY.
+static const byte FLASH railcomCode[64] = {
+  0xAC, 0xAA, 0xA9, 0xA5, 0xA3, 0xA6, 0x9C, 0x9A,
+  0x99, 0x95, 0x93, 0x96, 0x8E, 0x8D, 0x8B, 0xB1,
+  0xB2, 0xB4, 0xB8, 0x74, 0x72, 0x6C, 0x6A, 0x69,
+  0x65, 0x63, 0x66, 0x5C, 0x5A, 0x59, 0x55, 0x53,
+  0x56, 0x4E, 0x4D, 0x4B, 0x47, 0x71, 0xE8, 0xE4,
+  0xE2, 0xD1, 0xC9, 0xC5, 0xD8, 0xD4, 0xD2, 0xCA,
+  0xC6, 0xCC, 0x78, 0x17, 0x1B, 0x1D, 0x1E, 0x2E,
+  0x36, 0x3A, 0x27, 0x2B, 0x2D, 0x35, 0x39, 0x33
+};
+
+ACK_CALLBACK Railcom::pomCallback=NULL;
+unsigned long Railcom::pomStart=0;
+byte Railcom::addressHigh=0;
+int Railcom::lastAddress=0;
+
+void Railcom::begin() {
+  RAILCOM_SERIAL.begin(BAUD);
+}
+
+// 6 bit value, or -1 for ACK/NACK/BUSY and transmission errors
+int8_t Railcom::decode(byte b) {
+  for (byte v=0; v<64; v++)
+    if (GETFLASH(railcomCode+v)==b) return v;
+  return -1;
+}
+
+// The loop runs far more often than the 6ms or more between two
+// cutouts, so whatever has arrived since the last call is taken to be
+// one cutout: channel 1 first, then channel 2.
+void Railcom::loop() {
+  if (pomCallback && millis()-pomStart > POM_TIMEOUT) {
+    ACK_CALLBACK cb=pomCallback;
+    pomCallback=NULL;
+    cb(-1);
+  }
+  byte length=0;
+  byte frame[FRAME_MAX];
+  while (RAILCOM_SERIAL.available() && length<FRAME_MAX) {
+    int8_t v=decode(RAILCOM_SERIAL.read());
+    if (v<0) continue;
+    frame[length++]=v;
+  }
+  while (RAILCOM_SERIAL.available()) RAILCOM_SERIAL.read(); // more than one cutout behind
+  if (length>=2 && DCCWaveform::isRailcom()) processFrame(frame, length);
+}
+
+// 12 bit datagrams: 4 bit id, 8 bit data spread over two 6 bit values
+void Railcom::processFrame(byte frame[], byte length) {
+  for (byte i=0; i+1<length; i+=2)
+    datagram(frame[i]>>2, ((frame[i]&0x03)<<6) | frame[i+1]);
+}
+
+void Railcom::datagram(byte id, byte data) {
+  switch (id) {
+  case ID_POM:
+    if (pomCallback) {
+      ACK_CALLBACK cb=pomCallback;
+      pomCallback=NULL;
+      cb(data);
+    }
+    break;
+  case ID_ADR_HIGH:
+    addressHigh=data;
+    break;
+  case ID_ADR_LOW: {
+    // high byte 0 with a low byte is a short address, else a long one
+    int address = addressHigh ? ((addressHigh & 0x3F)<<8) | data : data;
+    // accept an address once it has been seen twice in a row
+    if (address && address==lastAddress) LocoTable::lookupSpeedTable(address, true);
+    lastAddress=address;
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+bool Railcom::readCVMain(int cab, int cv, ACK_CALLBACK callback) {
+  if (pomCallback) return false;
+  pomCallback=callback;
+  pomStart=millis();
+  DCC::readCVByteMain(cab, cv);
+  return true;
+}
+
+#endif
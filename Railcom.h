@@ -0,0 +1,60 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef Railcom_h
+#define Railcom_h
+#include <Arduino.h>
+#include "defines.h"
+#include "DCCACK.h"
+
+// Railcom receiver for a detector whose UART output is wired to a spare
+// serial port. Add for example
+//   #define RAILCOM_SERIAL Serial3
+// to config.h and switch the cutout on with <C RAILCOM ON>. The cutout
+// itself is only generated on the Mega (see DCCTimerAVR.cpp).
+//
+// Channel 1 address broadcasts (ID1/ID2) are passed to the loco table,
+// channel 2 POM datagrams (ID0) answer <K cab cv> reads on the main track.
+#ifdef RAILCOM_SERIAL
+
+class Railcom {
+public:
+  static void begin();
+  static void loop();
+  // Read a CV on the main track. callback(value), or callback(-1) if
+  // no answer arrives within POM_TIMEOUT ms. Returns false if a read
+  // is already in progress.
+  static bool readCVMain(int cab, int cv, ACK_CALLBACK callback);
+
+private:
+  static const unsigned long BAUD=250000;
+  static const unsigned long POM_TIMEOUT=200;  // ms
+  static const byte FRAME_MAX=8;  // 2 bytes channel 1, 6 bytes channel 2
+  static const byte ID_POM=0, ID_ADR_HIGH=1, ID_ADR_LOW=2;
+  static int8_t decode(byte b);
+  static void processFrame(byte frame[], byte length);
+  static void datagram(byte id, byte data);
+  static ACK_CALLBACK pomCallback;
+  static unsigned long pomStart;
+  static byte addressHigh;
+  static int lastAddress;
+};
+
+#endif
+#endif
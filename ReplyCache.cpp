@@ -0,0 +1,80 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ReplyCache.h"
+#ifdef REPLY_CACHE
+#include "StringBuffer.h"
+
+ReplyCache::ENTRY ReplyCache::entries[REPLY_QUERIES];
+
+// one capture buffer for all queries, as replies are not nested
+static StringBuffer * capture=NULL;
+
+void ReplyCache::reply(Print * stream, REPLY_QUERY query, uint16_t generation, REPLY_WRITER writer) {
+  uint16_t length;
+  const char * text=get(query, generation, length);
+  if (!text) {
+    writer(begin());
+    text=end(query, generation, length);
+    if (!text) { // too long to keep, so it goes out as before
+      writer(stream);
+      return;
+    }
+  }
+  stream->write((const uint8_t *)text, length);
+}
+
+const char * ReplyCache::get(REPLY_QUERY query, uint16_t generation, uint16_t & length) {
+  ENTRY & e=entries[query];
+  if (!e.text || e.generation!=generation) return NULL;
+  length=e.length;
+  return e.text;
+}
+
+Print * ReplyCache::begin() {
+  if (!capture) capture=new StringBuffer(REPLY_CACHE_MAX+1);
+  capture->flush();
+  return capture;
+}
+
+const char * ReplyCache::end(REPLY_QUERY query, uint16_t generation, uint16_t & length) {
+  ENTRY & e=entries[query];
+  length=capture->length();
+  if (length>REPLY_CACHE_MAX) {
+    free(e.text);
+    e.text=NULL;
+    return NULL;
+  }
+  // a reply no longer than the last one reuses its buffer
+  if (!e.text || length>e.length) {
+    char * larger=(char *)realloc(e.text, length ? length : 1);
+    if (!larger) {
+      free(e.text);
+      e.text=NULL;
+      return NULL;
+    }
+    e.text=larger;
+  }
+  memcpy(e.text, capture->getString(), length);
+  e.length=length;
+  e.generation=generation;
+  return e.text;
+}
+#endif
@@ -0,0 +1,83 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ReplyCache_h
+#define ReplyCache_h
+#include <Arduino.h>
+#include "defines.h"
+
+// Replies to the queries that throttles repeat (<s> turnouts, <=>, <JG>,
+// <JT>, <JR>, <JA>) are formatted once and then copied from the cache
+// while the generation of whatever they describe stays the same. The
+// caller passes that generation, such as Turnout::stateGeneration or
+// TrackManager::stateGeneration, or 0 for lists fixed at compile time.
+// Replies longer than REPLY_CACHE_MAX are not kept.
+// Leave it out with DISABLE_REPLY_CACHE in config.h.
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_REPLY_CACHE)
+#define REPLY_CACHE
+#ifndef REPLY_CACHE_MAX
+  #if defined(ARDUINO_ARCH_AVR)
+    #define REPLY_CACHE_MAX 128
+  #else
+    #define REPLY_CACHE_MAX 1024
+  #endif
+#endif
+#endif
+
+enum REPLY_QUERY : byte {
+  REPLY_TURNOUT_STATES, // <s>
+  REPLY_TRACK_STATES,   // <=>
+  REPLY_GAUGES,         // <JG>
+  REPLY_TURNOUT_LIST,   // <JT>
+  REPLY_ROUTE_LIST,     // <JA>
+  REPLY_ROSTER_LIST,    // <JR>
+  REPLY_QUERIES,
+  REPLY_NONE=0xFF
+};
+
+typedef void (*REPLY_WRITER)(Print * stream);
+
+#ifdef REPLY_CACHE
+class ReplyCache {
+public:
+  // Sends the cached reply, or has writer format it and keeps that
+  static void reply(Print * stream, REPLY_QUERY query, uint16_t generation, REPLY_WRITER writer);
+  // The cached reply if it is for this generation, else NULL
+  static const char * get(REPLY_QUERY query, uint16_t generation, uint16_t & length);
+  // A reply written to begin() is kept by end(), which returns
+  // it or NULL if it was too long
+  static Print * begin();
+  static const char * end(REPLY_QUERY query, uint16_t generation, uint16_t & length);
+private:
+  struct ENTRY {
+    char * text;  // NULL until the query is first answered
+    uint16_t length;
+    uint16_t generation;
+  };
+  static ENTRY entries[REPLY_QUERIES];
+};
+#else
+class ReplyCache {
+public:
+  static inline void reply(Print * stream, REPLY_QUERY, uint16_t, REPLY_WRITER writer) {
+    writer(stream);
+  }
+};
+#endif
+#endif
@@ -32,14 +32,45 @@ const byte FLASH_INSERT_MARKER=0xff;
 RingStream::RingStream( const uint16_t len)
 {
   _len=len;
-  _buffer=new byte[len];
+  _buffer=(byte *)Arena::alloc(len, Arena::ARENA_RING);
   _pos_write=0;
+  _pos_commit=0;
   _pos_read=0;
   _buffer[0]=0;
   _overflow=false;
   _mark=0;
   _count=0; 
   _flashInsert=0;
+  _countPos=0;
+#ifdef RING_PRODUCER_LOCK
+  _producerLock=xSemaphoreCreateMutex();
+#endif
+}
+
+// Producer view of where the consumer has released space up to.
+// _pos_read is loaded first, the consumer stores _replayRelease
+// before moving _pos_read past the start of a multicast message.
+int RingStream::releasePos() {
+  int readPos=RING_LOAD(_pos_read);
+  int replay=RING_LOAD(_replayRelease);
+  return replay<0 ? readPos : replay;
+}
+
+void RingStream::takeProducer() {
+#ifdef RING_PRODUCER_LOCK
+  TaskHandle_t me=xTaskGetCurrentTaskHandle();
+  if (RING_LOAD(_producerTask)==me) return; // re-mark without commit
+  xSemaphoreTake(_producerLock, portMAX_DELAY);
+  RING_STORE(_producerTask, me);
+#endif
+}
+
+void RingStream::giveProducer() {
+#ifdef RING_PRODUCER_LOCK
+  if (RING_LOAD(_producerTask)!=xTaskGetCurrentTaskHandle()) return;
+  RING_STORE(_producerTask, (TaskHandle_t)NULL);
+  xSemaphoreGive(_producerLock);
+#endif
 }
 
 size_t RingStream::write(uint8_t b) {
@@ -47,7 +78,7 @@ size_t RingStream::write(uint8_t b) {
   _buffer[_pos_write] = b;
   ++_pos_write;
   if (_pos_write==_len) _pos_write=0;
-  if (_pos_write==_pos_read) {
+  if (_pos_write==releasePos()) {
     _overflow=true; 
     return 0;
   }
@@ -55,6 +86,28 @@ size_t RingStream::write(uint8_t b) {
   return 1;
 }
 
+// Strings, and flash strings on 32 bit processors, arrive here from
+// Print in one piece. Copied in at most two parts when they fit.
+size_t RingStream::write(const uint8_t * buffer, size_t size) {
+  if (_overflow) return 0;
+  int release=releasePos();
+  int room = (release>_pos_write) ? release-_pos_write-1 : _len-_pos_write+release-1;
+  if ((int)size>room) {
+    // fill up and overflow as the byte at a time write does
+    size_t n=0;
+    while (n<size && write(buffer[n])) n++;
+    return n;
+  }
+  int first=_len-_pos_write;
+  if (first>(int)size) first=size;
+  memcpy(_buffer+_pos_write, buffer, first);
+  memcpy(_buffer, buffer+first, size-first);
+  _pos_write+=size;
+  if (_pos_write>=_len) _pos_write-=_len;
+  _count+=size;
+  return size;
+}
+
 // Ideally, I would prefer to override the Print:print(_FlashStringHelper) function
 // but the library authors omitted to make this virtual.
 // Therefore we obveride the only other simple function that has no side effects
@@ -102,7 +155,85 @@ _count=prevCount+plength;
 return plength;
 }
 
+// Reads follow the message layout: client id, count, then count bytes.
+// A multicast message is written once with a client mask and is
+// read out as a separate message for each client in the mask.
+// The space is only released after the last client has read it.
 int RingStream::read() {
+  if (_replayNext) {
+    _replayNext=false;
+    return nextReplayClient();
+  }
+  if (_recordRemaining==0) { // expecting a client id
+    if (_pos_read==RING_LOAD(_pos_commit)) return -1;  // empty
+    if (_buffer[_pos_read]==MULTICAST_CLIENT) {
+      // hold the space before moving past the start of the message
+      RING_STORE(_replayRelease, _pos_read);
+      readRawByte();
+      _replayMask=readRawByte();
+      _replayStart=_pos_read;
+      return nextReplayClient();
+    }
+  }
+  int b=readLogical();
+  if (b<0) return b;
+  if (_recordRemaining==0) {
+    _readClient=b;
+    return b;
+  }
+  if (--_recordRemaining==0) endRecord();
+  return b;
+}
+
+// Reads up to length bytes of the message being read, after count(),
+// as that many read() calls would, and returns how many. 32 bit builds
+// never write flash inserts so the bytes are copied straight out.
+int RingStream::read(byte * buffer, int length) {
+  if (length>_recordRemaining) length=_recordRemaining;
+  if (length<=0) return 0;
+  if (sizeof(void*)<=2) {
+    for (int i=0; i<length; i++) buffer[i]=read();
+    return length;
+  }
+  int pos=_pos_read;
+  int first=_len-pos;
+  if (first>length) first=length;
+  memcpy(buffer, _buffer+pos, first);
+  memcpy(buffer+first, _buffer, length-first);
+  pos+=length;
+  if (pos>=_len) pos-=_len;
+  RING_STORE(_pos_read, pos);
+  _recordRemaining-=length;
+  if (_recordRemaining==0) endRecord();
+  return length;
+}
+
+void RingStream::endRecord() {
+  _flashInsert=NULL;
+  if (_readClient<MAX_TRACKED_CLIENTS)
+    RING_STORE(_sent[_readClient], (uint16_t)(_sent[_readClient]+_recordCount));
+  if (_replayMask) {
+    // rewind to the count for the next client
+    RING_STORE(_pos_read, _replayStart);
+    _replayNext=true;
+  }
+  else if (_replayRelease>=0) {
+    RING_STORE(_replayRelease, -1);  // last copy read, space is free again
+  }
+}
+
+int RingStream::nextReplayClient() {
+  for (byte c=0; c<8; c++) {
+    if (_replayMask & (1<<c)) {
+      _replayMask &= ~(1<<c);
+      _readClient=c;
+      return c;
+    }
+  }
+  return -1; // empty mask, cannot be written by markMulticast
+}
+
+int RingStream::readLogical() {
   if (_flashInsert) {
     // we are reading out of a flash string 
     byte fb=GETFLASH(_flashInsert);
@@ -111,7 +242,7 @@ int RingStream::read() {
     // flash insert complete, clear and drop through to next buffer byte
     _flashInsert=NULL; 
   }
-  if ((_pos_read==_pos_write) && !_overflow) return -1;  // empty  
+  if (_pos_read==RING_LOAD(_pos_commit)) return -1;  // empty
   byte b=readRawByte();
   if (b!=FLASH_INSERT_MARKER) return b; 
   // Detected a flash insert 
@@ -129,34 +260,84 @@ int RingStream::read() {
   }
   _flashInsert=reinterpret_cast<char * >( iFlash);
   // and try again... so will read the first byte of the insert. 
-  return read();
+  return readLogical();
 }
 
 byte RingStream::readRawByte() {
-  byte b=_buffer[_pos_read];
-  _pos_read++;
-  if (_pos_read==_len) _pos_read=0;
-  _overflow=false;
+  int pos=_pos_read;
+  byte b=_buffer[pos];
+  pos++;
+  if (pos==_len) pos=0;
+  RING_STORE(_pos_read, pos);
   return b;
 }
 
 int RingStream::count() {
-  return (readRawByte()<<8) | readRawByte(); 
+  int high=readRawByte();
+  _recordRemaining=(high<<8) | readRawByte();
+  _recordCount=_recordRemaining;
+  return _recordRemaining;
   }
 
 int RingStream::freeSpace() {
   // allow space for client flag and length bytes
-  if (_pos_read>_pos_write) return _pos_read-_pos_write-3;
-  else return _len - _pos_write + _pos_read-3;  
+  int release=releasePos();
+  if (release>_pos_write) return release-_pos_write-3;
+  else return _len - _pos_write + release-3;  
 }
 
 
 // mark start of message with client id (0...9)
 void RingStream::mark(uint8_t b) {
     //DIAG(F("RS mark client %d at %d core %d"), b, _pos_write, xPortGetCoreID());
+    takeProducer();
     _ringClient = b;
+    _pos_write=_pos_commit; // drop anything written without a mark
+    _overflow=false;
     _mark=_pos_write;
     write(b); // client id
+    _countPos=_pos_write;
+    write((uint8_t)0);  // count MSB placemarker
+    write((uint8_t)0);  // count LSB placemarker
+    _count=0;
+}
+
+uint16_t RingStream::pending(byte client) {
+  if (client>=MAX_TRACKED_CLIENTS) return 0;
+  return RING_LOAD(_queued[client]) - RING_LOAD(_sent[client]);
+}
+
+// A quarter of the ring, or half of what the other clients are not
+// using if that is more, so that a client doing a bulk transfer while
+// the others are quiet gets it done in fewer, larger pieces. Whatever
+// it takes, the others still have at least half the ring between them.
+int RingStream::quota(byte client) {
+  int others=0;
+  for (byte c=0; c<MAX_TRACKED_CLIENTS; c++)
+    if (c!=client) others+=pending(c);
+  int share=(_len-others)/2;
+  return share > _len/4 ? share : _len/4;
+}
+
+void RingStream::evict(byte client) {
+  if (client<MAX_TRACKED_CLIENTS) RING_OR(_evictMask, (byte)(1<<client));
+}
+
+byte RingStream::takeEvictions() {
+  return RING_TAKE(_evictMask);
+}
+
+// mark start of a message that is sent to every client in clientMask
+void RingStream::markMulticast(uint8_t clientMask) {
+    takeProducer();
+    _ringClient = MULTICAST_CLIENT;
+    _pos_write=_pos_commit; // drop anything written without a mark
+    _overflow=false;
+    _mark=_pos_write;
+    write(MULTICAST_CLIENT);
+    write(clientMask);
+    _markMask=clientMask;
+    _countPos=_pos_write;
     write((uint8_t)0);  // count MSB placemarker
     write((uint8_t)0);  // count LSB placemarker
     _count=0;
@@ -165,6 +346,11 @@ void RingStream::mark(uint8_t b) {
 // peekTargetMark is used by the parser stash routines to know which client
 // to send a callback response to some time later. 
 uint8_t RingStream::peekTargetMark() {
+#ifdef RING_PRODUCER_LOCK
+  // a message being written by another task is not ours to commit
+  TaskHandle_t owner=RING_LOAD(_producerTask);
+  if (owner && owner!=xTaskGetCurrentTaskHandle()) return NO_CLIENT;
+#endif
   return _ringClient;
 }
 
@@ -173,12 +359,12 @@ void RingStream::info() {
 }
 
 bool RingStream::commit() {
-  _flashInsert=NULL; // prepared for first read
   if (_overflow) {
         //DIAG(F("RingStream(%d) commit(%d) OVERFLOW"),_len, _count);
         // just throw it away 
         _pos_write=_mark;
         _overflow=false;
+        giveProducer();
         return false; // commit failed
   }
   if (_count==0) {
@@ -186,23 +372,34 @@ bool RingStream::commit() {
     // ignore empty response
     _pos_write=_mark;
     _ringClient = NO_CLIENT;         //XXX make else clause later
+    giveProducer();
     return true; // true=commit ok
   }
-  // Go back to the _mark and inject the count 1 byte later
-  _mark++;
-  if (_mark==_len) _mark=0;
-  _buffer[_mark]=highByte(_count);
-  _mark++;
-  if (_mark==_len) _mark=0;
-  _buffer[_mark]=lowByte(_count);
+  // Go back and inject the count after the client id (and mask)
+  _buffer[_countPos]=highByte(_count);
+  _countPos++;
+  if (_countPos==_len) _countPos=0;
+  _buffer[_countPos]=lowByte(_count);
+  // account the message to its clients before publishing it
+  for (byte c=0; c<MAX_TRACKED_CLIENTS; c++) {
+    if (_ringClient==c || (_ringClient==MULTICAST_CLIENT && (_markMask & (1<<c))))
+      RING_STORE(_queued[c], (uint16_t)(_queued[c]+_count));
+  }
   _ringClient = NO_CLIENT;
+  RING_STORE(_pos_commit, _pos_write); // publish the message
+  giveProducer();
   return true; // commit worked
 }
 void RingStream::flush() {
   _pos_write=0;
+  _pos_commit=0;
   _pos_read=0;
   _buffer[0]=0;
   _flashInsert=NULL; // prepared for first read
   _ringClient = NO_CLIENT;
+  _recordRemaining=0;
+  _replayRelease=-1;
+  _replayMask=0;
+  _replayNext=false;
 }
   
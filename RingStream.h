@@ -22,13 +22,38 @@
 
 #include <Arduino.h>
 #include "FSH.h"
+#include "Arena.h"
+
+// RingStream is written by one producer and read by one consumer which
+// may run on different cores (ESP32 with WIFI_TASK_ON_CORE0). The read
+// and committed write positions are published with acquire/release
+// ordering so the consumer only ever sees whole committed messages.
+// On ESP32 producers on different tasks are serialised from mark()
+// to commit() with a mutex, so broadcasts and replies do not interleave.
+#if defined(ARDUINO_ARCH_ESP32)
+  #define RING_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+  #define RING_STORE(x,v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+  #define RING_OR(x,v) __atomic_fetch_or(&(x), (v), __ATOMIC_ACQ_REL)
+  #define RING_TAKE(x) __atomic_exchange_n(&(x), 0, __ATOMIC_ACQ_REL)
+  #define RING_PRODUCER_LOCK
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/semphr.h>
+#else
+  #define RING_LOAD(x) (x)
+  #define RING_STORE(x,v) ((x)=(v))
+  #define RING_OR(x,v) ((x)|=(v))
+  #define RING_TAKE(x) ringTake(x)
+  static inline byte ringTake(byte & x) { byte v=x; x=0; return v; }
+#endif
   
 class RingStream : public Print {
 
   public:
+    ARENA_NEW(ARENA_RING)
     RingStream( const uint16_t len);
     static const int THIS_IS_A_RINGSTREAM=777;
     virtual size_t write(uint8_t b);
+    virtual size_t write(const uint8_t * buffer, size_t size) override;
 
     // This availableForWrite function is subverted from its original intention so that a caller 
     // can destinguish between a normal stream and a RingStream. 
@@ -40,29 +65,62 @@ class RingStream : public Print {
     using Print::write;
     size_t printFlash(const FSH * flashBuffer);
     int read();
+    int read(byte * buffer, int length); // bytes of the message being read
     int count();
     int freeSpace();
     void mark(uint8_t b);
+    void markMulticast(uint8_t clientMask);
     bool commit();
     uint8_t peekTargetMark();
     void flush();
     void info();
     byte readRawByte();
     inline int peek() {
-      if ((_pos_read==_pos_write) && !_overflow) return -1;  // empty
+      if (_pos_read==RING_LOAD(_pos_commit)) return -1;  // empty
       return _buffer[_pos_read];
     };
+    // Per client backpressure, for client ids below MAX_TRACKED_CLIENTS
+    static const byte MAX_TRACKED_CLIENTS=8;
+    uint16_t pending(byte client);  // committed bytes the consumer has not read
+    int quota(byte client);         // share of the ring client may fill
+    void evict(byte client);        // ask the consumer to disconnect client
+    byte takeEvictions();           // consumer: mask of clients to disconnect
     static const byte NO_CLIENT=255;
+    static const byte MULTICAST_CLIENT=254;
  private:
+   int readLogical();
+   void endRecord();
+   int nextReplayClient();
+   int releasePos();
+   void takeProducer();
+   void giveProducer();
    int _len;
-   int _pos_write;
-   int _pos_read;
-   bool _overflow;
+   int _pos_write;   // producer only
+   int _pos_commit;  // end of committed messages, written by producer
+   int _pos_read;    // written by consumer
+   bool _overflow;   // producer only
    int _mark;
    int _count;
    byte * _buffer;
    char * _flashInsert;
    byte _ringClient = NO_CLIENT;
+   int _countPos;
+   // A multicast message is stored once and read out once per client
+   int _recordRemaining=0;  // bytes left to read in the current message
+   int _replayStart;        // position of the count of a multicast message
+   int _replayRelease=-1;   // start of the multicast message being read, or -1
+   byte _replayMask=0;      // clients still to be given the multicast message
+   bool _replayNext=false;  // rewound, next read() returns the next client
+   byte _markMask;          // clients of the multicast message being written
+   byte _readClient;        // client of the message being read
+   int _recordCount;        // count of the message being read
+   uint16_t _queued[MAX_TRACKED_CLIENTS]={0};  // written by producer
+   uint16_t _sent[MAX_TRACKED_CLIENTS]={0};    // written by consumer
+   byte _evictMask=0;
+#ifdef RING_PRODUCER_LOCK
+   SemaphoreHandle_t _producerLock;
+   TaskHandle_t _producerTask=NULL;  // task between mark() and commit()
+#endif
 };
 
 #endif
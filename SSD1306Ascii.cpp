@@ -155,6 +155,14 @@ SSD1306AsciiWire::SSD1306AsciiWire(I2CAddress address, int width, int height) {
   // Set size in characters
   m_charsPerColumn = m_displayHeight / fontHeight;
   m_charsPerRow = (m_displayWidth+fontWidth-1) / fontWidth; // Round up
+#if defined(SSD1306_FRAMEBUFFER)
+  if (m_displayHeight <= 64) 
+    m_frame = (uint8_t *)calloc(m_displayWidth, m_displayHeight/8);
+  for (uint8_t page = 0; page < 8; page++) {
+    m_dirtyFirst[page] = 0;
+    m_dirtyEnd[page] = 0;
+  }
+#endif
 }
 
 bool SSD1306AsciiWire::begin() {
@@ -199,6 +207,19 @@ bool SSD1306AsciiWire::begin() {
 
 /* Clear screen by writing blank pixels. */
 void SSD1306AsciiWire::clearNative() {
+#if defined(SSD1306_FRAMEBUFFER)
+  if (m_frame) {
+    // Blank the framebuffer and send all of it on the next flush.
+    memset(m_frame, 0, m_displayWidth * (m_displayHeight/8));
+    for (uint8_t page = 0; page < m_displayHeight/8; page++) {
+      m_dirtyFirst[page] = 0;
+      m_dirtyEnd[page] = m_displayWidth;
+    }
+    m_row = 0;
+    m_col = m_colOffset;
+    return;
+  }
+#endif
   const int maxBytes = sizeof(blankPixels) - 1;  // max number of pixel columns (bytes) per transmission
   for (uint8_t r = 0; r <= m_displayHeight/8 - 1; r++) {
     setRowNative(r);   // Position at start of row to be erased
@@ -214,11 +235,19 @@ void SSD1306AsciiWire::clearNative() {
 
 // Set cursor position (by text line)
 void SSD1306AsciiWire::setRowNative(uint8_t line) {
+  setRowColNative(line, 0);
+}
+
+// Set cursor position (by text line and character column)
+bool SSD1306AsciiWire::setRowColNative(uint8_t line, uint8_t col) {
   // Calculate pixel position from line number
   uint8_t row = line*8;
   if (row < m_displayHeight) {
     m_row = row;
-    m_col = m_colOffset;
+    m_col = m_colOffset + col*fontWidth;
+#if defined(SSD1306_FRAMEBUFFER)
+    if (m_frame) return true;  // Nothing to send until flush
+#endif
     // Before using buffer, wait for last request to complete
     requestBlock.wait();
     // Build output buffer for I2C
@@ -229,6 +258,7 @@ void SSD1306AsciiWire::setRowNative(uint8_t line) {
     outputBuffer[len++] = SSD1306_SETSTARTPAGE | (m_row/8);
     I2CManager.write(m_i2cAddr, outputBuffer, len, &requestBlock);
   }
+  return true;
 }
 //------------------------------------------------------------------------------
 
@@ -253,6 +283,28 @@ size_t SSD1306AsciiWire::writeNative(uint8_t ch) {
 
   ch -= m_fontFirstChar;
   base += fontWidth * ch;
+#if defined(SSD1306_FRAMEBUFFER)
+  if (m_frame) {
+    // Draw into the framebuffer, noting any columns that changed
+    uint8_t page = m_row/8;
+    uint8_t *frame = m_frame + page*m_displayWidth;
+    for (uint8_t i = 0; i < fontWidth; i++, m_col++) {
+      uint8_t pixels = GETFLASH(base++);
+      if (frame[m_col] != pixels) {
+        frame[m_col] = pixels;
+        if (m_dirtyFirst[page] >= m_dirtyEnd[page]) {
+          m_dirtyFirst[page] = m_col;
+          m_dirtyEnd[page] = m_col+1;
+        } else if (m_col < m_dirtyFirst[page]) 
+          m_dirtyFirst[page] = m_col;
+        else if (m_col >= m_dirtyEnd[page])
+          m_dirtyEnd[page] = m_col+1;
+      }
+    }
+    m_drawing = true;
+    return 1;
+  }
+#endif
   // Before using buffer, wait for last request to complete
   requestBlock.wait();
   // Build output buffer for I2C
@@ -270,6 +322,49 @@ size_t SSD1306AsciiWire::writeNative(uint8_t ch) {
 }
 
 
+#if defined(SSD1306_FRAMEBUFFER)
+//------------------------------------------------------------------------------
+
+// Callers check isBusy before each setRowNative or writeNative, so this
+// is where the framebuffer is sent. Pages other than the one being drawn
+// go straight away; that one waits until a call finds no drawing since
+// the last. Returns true while anything is still to be sent.
+bool SSD1306AsciiWire::isBusy() {
+  if (requestBlock.isBusy()) return true;
+  if (!m_frame) return false;
+  bool all = !m_drawing;
+  m_drawing = false;
+  return flush(all);
+}
+
+// Send one burst of changed columns, with the page and column
+// positioning commands in front of it in the same transaction
+// (control byte 0x80 means a single command byte follows).
+// Returns false if there was nothing to send.
+bool SSD1306AsciiWire::flush(bool all) {
+  for (uint8_t page = 0; page < m_displayHeight/8; page++) {
+    if (m_dirtyFirst[page] >= m_dirtyEnd[page]) continue;
+    if (!all && page == m_row/8) continue;
+    uint8_t col = m_dirtyFirst[page];
+    uint8_t len = m_dirtyEnd[page] - col;
+    if (len > SSD1306_BURST) len = SSD1306_BURST;
+    uint8_t pos = 0;
+    outputBuffer[pos++] = 0x80;
+    outputBuffer[pos++] = SSD1306_SETLOWCOLUMN | (col & 0XF);
+    outputBuffer[pos++] = 0x80;
+    outputBuffer[pos++] = SSD1306_SETHIGHCOLUMN | (col >> 4);
+    outputBuffer[pos++] = 0x80;
+    outputBuffer[pos++] = SSD1306_SETSTARTPAGE | page;
+    outputBuffer[pos++] = 0x40;  // Remainder is data
+    memcpy(outputBuffer+pos, m_frame + page*m_displayWidth + col, len);
+    m_dirtyFirst[page] = col + len;
+    I2CManager.write(m_i2cAddr, outputBuffer, pos+len, &requestBlock);
+    return true;
+  }
+  return false;
+}
+#endif
+
 //------------------------------------------------------------------------------
 
 // Font characters, 6x8 pixels, starting at 0x20.
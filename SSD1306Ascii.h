@@ -32,6 +32,17 @@
 // Uncomment to remove lower-case letters to save 108 bytes of flash
 //#define NOLOWERCASE
 
+// On processors with RAM to spare the screen is drawn into a framebuffer
+// and only the changed pixel columns of each page are sent, in bursts of
+// up to SSD1306_BURST bytes. Define SSD1306_NO_FRAMEBUFFER in config.h
+// to write every character straight to the display instead.
+#if (defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_STM32)) && !defined(SSD1306_NO_FRAMEBUFFER)
+#define SSD1306_FRAMEBUFFER
+#endif
+#if !defined(SSD1306_BURST)
+#define SSD1306_BURST 96
+#endif
+
 
 
 //------------------------------------------------------------------------------
@@ -51,11 +62,18 @@ class SSD1306AsciiWire : public DisplayDevice {
 
   // Set cursor to start of specified text line
   void setRowNative(byte line) override;
+
+  // Set cursor to a character column of a text line
+  bool setRowColNative(byte line, byte col) override;
   
   // Write one character to OLED
   size_t writeNative(uint8_t c) override;
 
+#if defined(SSD1306_FRAMEBUFFER)
+  bool isBusy() override;
+#else
   bool isBusy() override { return requestBlock.isBusy(); }
+#endif
   uint16_t getNumCols() { return m_charsPerRow; }
   uint16_t getNumRows() { return m_charsPerColumn; }
 
@@ -88,7 +106,22 @@ class SSD1306AsciiWire : public DisplayDevice {
   I2CAddress m_i2cAddr = 0;
 
   I2CRB requestBlock;
+#if defined(SSD1306_FRAMEBUFFER)
+  // Page and column are set in the same transaction as the data
+  static const uint8_t burstHeader = 7;
+  uint8_t outputBuffer[burstHeader+SSD1306_BURST];
+  // m_displayWidth bytes per page, NULL if it could not be allocated
+  uint8_t *m_frame = NULL;
+  // Changed pixel columns of each page, first to end-1
+  uint8_t m_dirtyFirst[8];
+  uint8_t m_dirtyEnd[8];
+  // Set by writeNative, so that the page being drawn is only sent
+  // once drawing has paused.
+  bool m_drawing = false;
+  bool flush(bool all);
+#else
   uint8_t outputBuffer[fontWidth+1];
+#endif
 
   static const uint8_t blankPixels[];
 
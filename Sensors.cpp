@@ -41,6 +41,9 @@ sensor definitions using the following variation of the "S" command:
                                if sensor ID already exists, it is updated with specificed PIN and PULLUP
                                returns: <O> if successful and <X> if unsuccessful (e.g. out of memory)
 
+  <S ID PIN PULLUP DEBOUNCE>:  as above, with the number of extra read cycles (0-63, default 1) an input
+                               change must persist for before it is reported.  Not stored in EEPROM.
+
   <S ID>:                      deletes definition of sensor ID
                                returns: <O> if successful and <X> if unsuccessful (e.g. ID does not exist)
 
@@ -109,6 +112,10 @@ void Sensor::checkAll(){
       // so initiate new scan through the sensor list
       readingSensor = firstSensor;
       lastReadCycle = thisTime;
+      _cycleCount++;
+#ifdef USE_NOTIFY
+      processPending();
+#endif
     }
   }
 
@@ -122,23 +129,31 @@ void Sensor::checkAll(){
     // Also, on HAL drivers that support change notifications, the driver calls the notification callback
     // routine when an input signal change is detected, and this updates the inputState directly,
     // so these inputs don't need to be polled here.
+    // Polled sensors that have been quiet for a while are read less often.
     VPIN pin = readingSensor->data.pin;
-    if (readingSensor->pollingRequired && pin != VPIN_NONE)
-      readingSensor->inputState = IODevice::read(pin);
+    if (readingSensor->pollingRequired && pin != VPIN_NONE) {
+      if (readingSensor->quietCycles < SENSOR_QUIET_CYCLES 
+          || ((_cycleCount ^ readingSensor->data.snum) & (SENSOR_QUIET_DIVIDER-1)) == 0) {
+        readingSensor->inputState = IODevice::read(pin);
+        if (readingSensor->inputState != readingSensor->active) 
+          readingSensor->quietCycles = 0;
+        else if (readingSensor->quietCycles < SENSOR_QUIET_CYCLES)
+          readingSensor->quietCycles++;
+      }
+    }
 
     // Check if changed since last time, and process changes.
-    if (readingSensor->inputState == readingSensor->active) {
+    if (readingSensor->changeQueued) {
+      // being dealt with by processPending()
+    } else if (readingSensor->inputState == readingSensor->active) {
       // no change
-      readingSensor->latchDelay = minReadCount; // Reset counter
+      readingSensor->latchDelay = readingSensor->debounce; // Reset counter
     } else if (readingSensor->latchDelay > 0) {
       // change detected, but first decrement delay
       readingSensor->latchDelay--;
     } else { 
       // change validated, act on it.
-      readingSensor->active = readingSensor->inputState;
-      readingSensor->latchDelay = minReadCount;  // Reset counter
-      
-      CommandDistributor::broadcastSensor(readingSensor->data.snum,readingSensor->active);
+      readingSensor->setActive();
       pause = true;  // Don't check any more sensors on this entry
     }
 
@@ -158,18 +173,59 @@ void Sensor::checkAll(){
 
 #ifdef USE_NOTIFY
 // Callback from HAL (IODevice class) when a digital input change is recognised.
-// Updates the inputState field, which is subsequently scanned for changes in the checkAll 
-// method.  Ideally the <Q>/<q> message should be sent from here, instead of waiting for
-// the checkAll method, but the output stream is not available at this point.
+// Updates the inputState field and queues the sensor, so that the change is
+// acted on at the start of the next read cycle in checkAll.
 void Sensor::inputChangeCallback(VPIN vpin, int state) {
-  Sensor *tt;
-  // This bit is not ideal since it has, potentially, to look through the entire list of
-  // sensors to find the one that has changed.  Ideally this should be improved somehow.
-  for (tt=firstSensor; tt!=NULL ; tt=tt->nextSensor) {
-    if (tt->data.pin == vpin) break;
+  if (!_indexValid) buildIndex();
+  if (_index) {
+    // Binary search for the first sensor on this vpin in the vpin part of the index
+    Sensor **byVpin = _index + _indexSize;
+    uint16_t low = 0, high = _vpinIndexSize;
+    while (low < high) {
+      uint16_t mid = (low + high) / 2;
+      if (byVpin[mid]->data.pin < vpin) low = mid + 1;
+      else high = mid;
+    }
+    for (; low < _vpinIndexSize && byVpin[low]->data.pin == vpin; low++) 
+      notifyChange(byVpin[low], state);
+  } else {
+    // No memory for the index so search the list.
+    for (Sensor *tt=firstSensor; tt!=NULL ; tt=tt->nextSensor)
+      if (tt->data.pin == vpin) notifyChange(tt, state);
   }
-  if (tt != NULL) { // Sensor found
-    tt->inputState = (state != 0); 
+}
+
+void Sensor::notifyChange(Sensor *tt, int state) {
+  tt->inputState = (state != 0); 
+  if (tt->inputState != tt->active && !tt->changeQueued) queueChange(tt);
+}
+
+// Add the sensor to the end of the pending change queue, if there's room.
+void Sensor::queueChange(Sensor *tt) {
+  if (pendingCount >= SENSOR_PENDING_QUEUE) return;  // Left to the checkAll scan
+  pendingQueue[(pendingStart + pendingCount) % SENSOR_PENDING_QUEUE] = tt;
+  pendingCount++;
+  tt->changeQueued = 1;
+}
+
+// Take each queued sensor once, applying the same debounce as checkAll: 
+// a change must still be there after the sensor's debounce count of read cycles.  
+// Sensors still waiting go back on the queue.
+void Sensor::processPending() {
+  for (uint8_t n = pendingCount; n > 0; n--) {
+    Sensor *tt = pendingQueue[pendingStart];
+    pendingStart = (pendingStart + 1) % SENSOR_PENDING_QUEUE;
+    pendingCount--;
+    tt->changeQueued = 0;
+    if (tt->inputState == tt->active) {
+      // changed back again
+      tt->latchDelay = tt->debounce;
+    } else if (tt->latchDelay > 0) {
+      tt->latchDelay--;
+      queueChange(tt);
+    } else {
+      tt->setActive();
+    }
   }
 }
 #endif
@@ -180,6 +236,58 @@ void Sensor::inputChangeCallback(VPIN vpin, int state) {
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+void Sensor::setActive() {
+  active = inputState;
+  latchDelay = debounce;  // Reset counter
+  changeSequence++;
+#ifdef SENSOR_CHANGES
+  changedAt = changeSequence;
+#endif
+  CommandDistributor::broadcastSensor(data.snum, active);
+}
+
+// Send <jQS list sequence [states]>, where states has one hex digit for each
+//  four sensors in <JQ> order, most significant bit first, with the bit set
+//  for active. A client that sends back the list and sequence it holds gets
+//  <Q>/<q> for each sensor changed since, then <jQS list sequence> without
+//  states, unless the states are shorter.
+void Sensor::printStates(Print *stream, bool sameList, uint16_t since) {
+  // a sequence ahead of ours is from before a restart
+  bool sendBits = !sameList || (int16_t)(changeSequence - since) < 0;
+  if (!sendBits && since != changeSequence) {
+#ifdef SENSOR_CHANGES
+    uint16_t count = 0, changes = 0;
+    for (Sensor *tt = firstSensor; tt != NULL; tt = tt->nextSensor) {
+      count++;
+      if ((int16_t)(tt->changedAt - since) > 0) changes++;
+    }
+    // about 9 bytes a <Q id> against a digit for four sensors
+    if (changes * 9 > count / 4 + 1) sendBits = true;
+    else {
+      for (Sensor *tt = firstSensor; tt != NULL; tt = tt->nextSensor)
+        if ((int16_t)(tt->changedAt - since) > 0)
+          StringFormatter::send(stream, F("<%c %d>\n"), tt->active ? 'Q' : 'q', tt->data.snum);
+    }
+#else
+    sendBits = true;
+#endif
+  }
+  StringFormatter::send(stream, F("<jQS %d %u"), sensorlistHash, changeSequence);
+  if (sendBits) {
+    StringFormatter::send(stream, F(" "));
+    byte nibble = 0, bits = 0;
+    for (Sensor *tt = firstSensor; tt != NULL; tt = tt->nextSensor) {
+      nibble = (nibble << 1) | tt->active;
+      if (++bits == 4) {
+        StringFormatter::send(stream, F("%x"), nibble);
+        nibble = bits = 0;
+      }
+    }
+    if (bits) StringFormatter::send(stream, F("%x"), nibble << (4-bits));
+  }
+  StringFormatter::send(stream, F(">\n"));
+}
+
 void Sensor::printAll(Print *stream){
 
   if (stream != NULL) {
@@ -192,7 +300,7 @@ void Sensor::printAll(Print *stream){
 ///////////////////////////////////////////////////////////////////////////////
 // Static Function to create/find Sensor object.
 
-Sensor *Sensor::create(int snum, VPIN pin, int pullUp){
+Sensor *Sensor::create(int snum, VPIN pin, int pullUp, uint8_t debounce){
   Sensor *tt;
 
   if (pin > VPIN_MAX && pin != VPIN_NONE) return NULL;
@@ -201,6 +309,8 @@ Sensor *Sensor::create(int snum, VPIN pin, int pullUp){
 
   tt = (Sensor *)calloc(1,sizeof(Sensor));
   if (!tt) return tt;     // memory allocation failure
+  _indexValid = false;
+  sensorlistHash++;
 
   if (pin == VPIN_NONE) 
     tt->pollingRequired = false;
@@ -220,7 +330,9 @@ Sensor *Sensor::create(int snum, VPIN pin, int pullUp){
   tt->data.pullUp = pullUp;
   tt->active = 0;
   tt->inputState = 0;
-  tt->latchDelay = minReadCount;
+  if (debounce > maxReadCount) debounce = maxReadCount;
+  tt->debounce = debounce;
+  tt->latchDelay = debounce;
 
   if (pin != VPIN_NONE) 
     IODevice::configureInput(pin, pullUp);   
@@ -250,18 +362,70 @@ void Sensor::setState(int value) {
 ///////////////////////////////////////////////////////////////////////////////
 
 Sensor* Sensor::get(int n){
+  if (!_indexValid) buildIndex();
+  if (_index) {
+    uint16_t low = 0, high = _indexSize;
+    while (low < high) {
+      uint16_t mid = (low + high) / 2;
+      int snum = _index[mid]->data.snum;
+      if (snum == n) return _index[mid];
+      if (snum < n) low = mid + 1;
+      else high = mid;
+    }
+    return NULL;
+  }
+  // No memory for the index so search the list.
   Sensor *tt;
   for(tt=firstSensor;tt!=NULL && tt->data.snum!=n;tt=tt->nextSensor);
   return tt ;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+// Build the index from the sensor list.  Each part is sorted by insertion,
+// which is only done once after a batch of creates (e.g. from EEPROM or EXRAIL).
+
+void Sensor::buildIndex() {
+  _indexValid = true;
+  free(_index);
+  _index = NULL;
+  _indexSize = 0;
+  _vpinIndexSize = 0;
+
+  uint16_t count = 0;
+  for (Sensor *tt=firstSensor; tt!=NULL; tt=tt->nextSensor) count++;
+  Sensor **index = (Sensor **)malloc((count ? 2*count : 1) * sizeof(Sensor *));
+  if (!index) return;
+
+  uint16_t nIds = 0, nVpins = 0;
+  Sensor **byVpin = index + count;
+  for (Sensor *tt=firstSensor; tt!=NULL; tt=tt->nextSensor) {
+    uint16_t i = nIds++;
+    for (; i > 0 && index[i-1]->data.snum > tt->data.snum; i--) index[i] = index[i-1];
+    index[i] = tt;
+    if (tt->data.pin == VPIN_NONE) continue;
+    i = nVpins++;
+    for (; i > 0 && byVpin[i-1]->data.pin > tt->data.pin; i--) byVpin[i] = byVpin[i-1];
+    byVpin[i] = tt;
+  }
+  _index = index;
+  _indexSize = nIds;
+  _vpinIndexSize = nVpins;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 bool Sensor::remove(int n){
   Sensor *tt,*pp=NULL;
 
+  // If the index is up to date it can say quickly that there's nothing to remove.
+  // It's not rebuilt here, as create() removes before each new sensor.
+  if (_indexValid && _index && get(n)==NULL) return false;
+
   for(tt=firstSensor;tt!=NULL && tt->data.snum!=n;pp=tt,tt=tt->nextSensor);
 
   if (tt==NULL)  return false;
+  _indexValid = false;
+  sensorlistHash++;
 
   // Unlink the sensor from the list
   if(tt==firstSensor) 
@@ -279,6 +443,18 @@ bool Sensor::remove(int n){
   // make the following one the next one to be read.
   if (readingSensor==tt) readingSensor=tt->nextSensor;
 
+#ifdef USE_NOTIFY
+  // Take it off the pending change queue.
+  if (tt->changeQueued) {
+    uint8_t kept = 0;
+    for (uint8_t i=0; i<pendingCount; i++) {
+      Sensor *p = pendingQueue[(pendingStart + i) % SENSOR_PENDING_QUEUE];
+      if (p != tt) pendingQueue[(pendingStart + kept++) % SENSOR_PENDING_QUEUE] = p;
+    }
+    pendingCount = kept;
+  }
+#endif
+
   free(tt);
 
   return true;
@@ -319,9 +495,19 @@ void Sensor::store(){
 Sensor *Sensor::firstSensor=NULL;
 Sensor *Sensor::readingSensor=NULL;
 unsigned long Sensor::lastReadCycle=0;
+uint8_t Sensor::_cycleCount=0;
+Sensor **Sensor::_index = NULL;
+uint16_t Sensor::_indexSize = 0;
+uint16_t Sensor::_vpinIndexSize = 0;
+bool Sensor::_indexValid = false;
+int Sensor::sensorlistHash = 0;
+uint16_t Sensor::changeSequence = 0;
 
 #ifdef USE_NOTIFY
 Sensor *Sensor::firstPollSensor = NULL;
 Sensor *Sensor::lastSensor = NULL;
 bool Sensor::inputChangeCallbackRegistered = false;
+Sensor *Sensor::pendingQueue[SENSOR_PENDING_QUEUE];
+uint8_t Sensor::pendingStart = 0;
+uint8_t Sensor::pendingCount = 0;
 #endif
@@ -34,20 +34,46 @@
 //  implementation, the advantages are limited because (a) the Sensor class 
 //  performs debounce checks, and (b) the Sensor class does not have a 
 //  static reference to the output stream for sending <Q>/<q> messages
-//  when a change is detected.  These restrictions mean that the checkAll() 
-//  method still has to iterate through all of the Sensor objects looking 
-//  for changes.
+//  when a change is detected.  The callback therefore puts the sensor on a 
+//  queue of pending changes, and checkAll() takes them from the queue (with
+//  the same debounce) at the start of each read cycle, rather than waiting 
+//  for its scan through the sensor list to reach them.
 #define USE_NOTIFY
 
+// Polled sensors whose input hasn't changed for SENSOR_QUIET_CYCLES read
+// cycles are only read on one cycle in SENSOR_QUIET_DIVIDER (a power of two),
+// until a change is seen.  Quiet sensors are spread across the cycles by id.
+// Set SENSOR_QUIET_DIVIDER to 1 to read every sensor on every cycle.
+#ifndef SENSOR_QUIET_CYCLES
+#define SENSOR_QUIET_CYCLES 50
+#endif
+#ifndef SENSOR_QUIET_DIVIDER
+#define SENSOR_QUIET_DIVIDER 4
+#endif
+
+// Size of the queue of changes notified by the HAL.  If it fills, further
+// changes are picked up by the checkAll() scan as before.
+#ifndef SENSOR_PENDING_QUEUE
+#define SENSOR_PENDING_QUEUE 16
+#endif
+
 struct SensorData {
   int snum;
   VPIN pin;
   uint8_t pullUp;
 };
 
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_SENSOR_CHANGES)
+// Each sensor keeps the changeSequence of its last change, 2 bytes a
+// sensor, so that <JQS list sequence> can send just the sensors that
+// changed since.
+#define SENSOR_CHANGES
+#endif
+
 class Sensor{
   // The sensor list is a linked list where each sensor's 'nextSensor' field points to the next.
-  //   The pointer is null in the last on the list.
+  //   The pointer is null in the last on the list.  Lookups by id and by vpin use
+  //   a sorted index of the list.
 
 public:
   SensorData data;
@@ -75,24 +101,55 @@ public:
   static void load();
   static void store();
 #endif
-  static Sensor *create(int id, VPIN vpin, int pullUp);
+  static Sensor *create(int id, VPIN vpin, int pullUp, uint8_t debounce=minReadCount);
   static void createMultiple(VPIN firstPin, byte count=1);
   static Sensor* get(int id);  
   static bool remove(int id);  
   static void checkAll();
   static void printAll(Print *stream);
+  static void printStates(Print *stream, bool sameList, uint16_t since);
+  static int sensorlistHash;       // changed when sensors are added or removed
+  static uint16_t changeSequence;  // changed when any sensor goes active or inactive
   static unsigned long lastReadCycle; // value of micros at start of last read cycle
   static const unsigned int cycleInterval = 10000; // min time between consecutive reads of each sensor in microsecs.
                                                    // should not be less than device scan cycle time.
-  static const unsigned int minReadCount = 1; // number of additional scans before acting on change
+  static const unsigned int minReadCount = 1; // default number of additional scans before acting on change
                                         // E.g. 1 means that a change is ignored for one scan and actioned on the next.
-                                        // Max value is 63
-  bool pollingRequired = true;
+  static const unsigned int maxReadCount = 63;  // limit of per-sensor debounce (size of latchDelay)
+  struct {
+    uint8_t pollingRequired:1;
+    uint8_t changeQueued:1;  // on the pending change queue
+    uint8_t debounce:6;      // this sensor's read count before acting on change
+  };
+  uint8_t quietCycles;  // read cycles since the input last differed from the active state
+#ifdef SENSOR_CHANGES
+  uint16_t changedAt;   // changeSequence after this sensor's last change
+#endif
 
 #ifdef USE_NOTIFY
   static void inputChangeCallback(VPIN vpin, int state);
   static bool inputChangeCallbackRegistered;
 #endif
+
+private:
+  // Index of the sensor list, rebuilt on first use after a create or remove.
+  // The first _indexSize entries are ordered by id, followed by 
+  // _vpinIndexSize entries (sensors with a vpin) ordered by vpin.
+  static uint8_t _cycleCount;
+  static Sensor **_index;
+  static uint16_t _indexSize;
+  static uint16_t _vpinIndexSize;
+  static bool _indexValid;
+  static void buildIndex();
+  void setActive();  // takes on inputState and reports it
+#ifdef USE_NOTIFY
+  static Sensor *pendingQueue[SENSOR_PENDING_QUEUE];
+  static uint8_t pendingStart;
+  static uint8_t pendingCount;
+  static void notifyChange(Sensor *tt, int state);
+  static void queueChange(Sensor *tt);
+  static void processPending();
+#endif
   
 }; // Sensor
 
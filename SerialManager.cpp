@@ -24,6 +24,7 @@
 #include "DCCEXParser.h"
 #include "StringFormatter.h"
 #include "DIAG.h"
+#include "CommandTrace.h"
 
 #ifdef ARDUINO_ARCH_ESP32
 #ifdef SERIAL_BT_COMMANDS
@@ -49,6 +50,18 @@ SerialManager::SerialManager(Stream * myserial) {
   first=this;
   bufferLength=0;
   inCommandPayload=PAYLOAD_FALSE; 
+#if SERIAL_OUT_SIZE
+  // Ports that can't say how much room they have are written directly
+  // as before. The port has been started, so its TX buffer is empty.
+  outBuffered=serial->availableForWrite() > 0;
+  outHead=0;
+  outTail=0;
+  outDropped=0;
+#endif
+#ifdef BINARY_COMMANDS
+  binaryState=0;
+  binaryMode=false;
+#endif
 } 
 
 void SerialManager::init() {
@@ -105,55 +118,233 @@ void SerialManager::init() {
 #endif
 }
 
-void SerialManager::broadcast(char * stringBuffer) {
-    for (SerialManager * s=first;s;s=s->next) s->broadcast2(stringBuffer);
+void SerialManager::broadcast(const char * message, uint16_t length) {
+    for (SerialManager * s=first;s;s=s->next) s->broadcast2(message, length);
+}
+void SerialManager::broadcast2(const char * message, uint16_t length) {
+#ifdef BINARY_COMMANDS
+    if (binaryMode && binaryCovered) return;
+#endif
+#if SERIAL_OUT_SIZE
+    if (outBuffered) {
+      drain();
+      queue(message, length);
+      drain();
+      return;
+    }
+#endif
+    serial->write((const uint8_t *)message, length);
 }
-void SerialManager::broadcast2(char * stringBuffer) {
-    serial->print(stringBuffer);
+
+#if SERIAL_OUT_SIZE
+void SerialManager::queue(const char * message, uint16_t length) {
+  uint16_t used = (outHead + SERIAL_OUT_SIZE - outTail) % SERIAL_OUT_SIZE;
+  if (length > SERIAL_OUT_SIZE - 1 - used) {
+    outDropped++;
+    return;
+  }
+  for (uint16_t i = 0; i < length; i++) {
+    outRing[outHead] = message[i];
+    outHead = (outHead + 1) % SERIAL_OUT_SIZE;
+  }
 }
 
+// Write as much of the queue as the port will take without blocking
+void SerialManager::drain() {
+  while (outTail != outHead) {
+    int room = serial->availableForWrite();
+    if (room <= 0) return;
+    uint16_t length = (outHead > outTail ? outHead : SERIAL_OUT_SIZE) - outTail;
+    if (length > (uint16_t)room) length = room;
+    serial->write(outRing + outTail, length);
+    outTail = (outTail + length) % SERIAL_OUT_SIZE;
+  }
+  if (outDropped) {
+    DIAG(F("Serial output full, %d messages dropped"), outDropped);
+    outDropped = 0;
+  }
+}
+#endif
+
+#ifdef BINARY_COMMANDS
+bool SerialManager::binaryCovered=false;
+
+void SerialManager::broadcastBinary(byte opcode, const int16_t p[], byte count) {
+    for (SerialManager * s=first;s;s=s->next)
+      if (s->binaryMode) BinaryCommands::send(s->serial, opcode, p, count);
+}
+
+bool SerialManager::isBinary(Print * stream) {
+    for (SerialManager * s=first;s;s=s->next)
+      if (s->serial==stream) return s->binaryMode;
+    return false;
+}
+
+enum : byte { BINARY_NONE, BINARY_LENGTH, BINARY_DATA, BINARY_CHECK };
+
+// Collects a binary frame into the command buffer.
+// Returns false if ch is not part of a frame.
+bool SerialManager::receiveBinary(byte ch) {
+  switch (binaryState) {
+  case BINARY_NONE:
+    if (ch != BinaryCommands::SYNC) return false;
+    binaryState = BINARY_LENGTH;
+    return true;
+  case BINARY_LENGTH:
+    if (ch == 0 || ch > BinaryCommands::MAX_LENGTH) {
+      DIAG(F("Binary frame length %d"), ch);
+      binaryState = BINARY_NONE;
+      return true;
+    }
+    binaryLength = ch;
+    bufferLength = 0;
+    binaryState = BINARY_DATA;
+    return true;
+  case BINARY_DATA:
+    buffer[bufferLength++] = ch;
+    if (bufferLength == binaryLength) binaryState = BINARY_CHECK;
+    return true;
+  default: { // BINARY_CHECK
+    binaryState = BINARY_NONE;
+    byte check = binaryLength;
+    for (byte i = 0; i < binaryLength; i++) check ^= buffer[i];
+    if (check != ch) {
+      DIAG(F("Binary frame checksum"));
+      return true;
+    }
+    binaryMode = true;
+    BinaryCommands::parse(serial, buffer, binaryLength);
+    return true;
+  }
+  }
+}
+#endif
+
 void SerialManager::loop() {
     for (SerialManager * s=first;s;s=s->next) s->loop2();
 }
 
+#ifdef HAS_ENOUGH_MEMORY
+enum : byte { TOKENS_NO_OPCODE, TOKENS_PARAMS, TOKENS_DONE, TOKENS_FAILED };
+
+// Feed the byte just added to the buffer into the tokenizer.
+// Anything unusual (an extra '<', a split error) marks the tokens
+// as failed and the whole buffer is parsed again at the '>'.
+void SerialManager::tokenize() {
+  byte at = bufferLength - 1;
+  byte ch = buffer[at];
+  switch (tokenState) {
+  case TOKENS_NO_OPCODE:
+    if (ch == ' ') return;
+    if (ch == '<' || ch == '>') {
+      tokenState = TOKENS_FAILED;
+      return;
+    }
+    opcodeAt = at;
+    tokenizer.begin(params, DCCEXParser::isHexOpcode(ch));
+    tokenState = TOKENS_PARAMS;
+    return;
+  case TOKENS_PARAMS:
+    if (ch == '<') {
+      tokenState = TOKENS_FAILED;
+      return;
+    }
+    switch (tokenizer.feed(buffer[at], at - opcodeAt)) {
+    case CommandTokenizer::TOKEN_MORE: return;
+    case CommandTokenizer::TOKEN_DONE:
+      tokenState = TOKENS_DONE;
+      return;
+    default:
+      tokenState = TOKENS_FAILED;
+      return;
+    }
+  default:
+    return;
+  }
+}
+#endif
+
+// Bytes are taken from the port in chunks of up to SERIAL_READ_CHUNK,
+// and every command that is complete within them is parsed. Another
+// chunk is only read while this port is within its SERIAL_LOOP_BUDGET
+// so that a burst from one client cannot starve the rest of the loop.
 void SerialManager::loop2() {
-  while (serial->available()) {
-    char ch = serial->read();
-    if (!inCommandPayload) {
-      if (ch == '<') {
-        inCommandPayload = PAYLOAD_NORMAL;
-        bufferLength = 0;
-        buffer[0] = '\0';
+#if SERIAL_OUT_SIZE
+  if (outBuffered) drain();  // ahead of any replies to new commands
+#endif
+  unsigned long start = micros();
+  byte chunk[SERIAL_READ_CHUNK];
+  do {
+    int available = serial->available();
+    if (available <= 0) return;
+    if (available > SERIAL_READ_CHUNK) available = SERIAL_READ_CHUNK;
+    // no more than available, so readBytes never waits for its timeout
+    size_t count = serial->readBytes(chunk, available);
+    for (size_t i = 0; i < count; i++) receive(chunk[i]);
+  } while (micros() - start < SERIAL_LOOP_BUDGET);
+}
+
+void SerialManager::receive(char ch) {
+#ifdef BINARY_COMMANDS
+  if (!inCommandPayload && receiveBinary(ch)) return;
+#endif
+  if (!inCommandPayload) {
+    if (ch == '<') {
+      inCommandPayload = PAYLOAD_NORMAL;
+      bufferLength = 0;
+      buffer[0] = '\0';
+#ifdef HAS_ENOUGH_MEMORY
+      tokenState = TOKENS_NO_OPCODE;
+#endif
+    }
+  } else { // if (inCommandPayload)
+    if (bufferLength <  (COMMAND_BUFFER_SIZE-1)) {
+      buffer[bufferLength++] = ch;          // advance bufferLength
+#ifdef HAS_ENOUGH_MEMORY
+      tokenize();
+#endif
+      if (inCommandPayload > PAYLOAD_NORMAL) {
+        if (inCommandPayload > 32 + 2) {    // String way too long
+          ch = '>';                         // we end this nonsense
+#ifdef HAS_ENOUGH_MEMORY
+          tokenState = TOKENS_FAILED;       // let the parser report it
+#endif
+          inCommandPayload = PAYLOAD_NORMAL;
+          DIAG(F("Parse error: Unbalanced string"));
+          // fall through to ending parsing below
+        } else if (ch == '"') {               // String end
+          inCommandPayload = PAYLOAD_NORMAL;
+          return; // do not fall through
+        } else
+          inCommandPayload++;
       }
-    } else { // if (inCommandPayload)
-      if (bufferLength <  (COMMAND_BUFFER_SIZE-1)) {
-        buffer[bufferLength++] = ch;          // advance bufferLength
-	if (inCommandPayload > PAYLOAD_NORMAL) {
-	  if (inCommandPayload > 32 + 2) {    // String way too long
-	    ch = '>';                         // we end this nonsense
-	    inCommandPayload = PAYLOAD_NORMAL;
-	    DIAG(F("Parse error: Unbalanced string"));
-	    // fall through to ending parsing below
-	  } else if (ch == '"') {               // String end
-	    inCommandPayload = PAYLOAD_NORMAL;
-	    continue; // do not fall through
-	  } else
-	    inCommandPayload++;
-	}
-	if (inCommandPayload == PAYLOAD_NORMAL) {
-	  if (ch == '>') {
-	    buffer[bufferLength] = '\0';               // This \0 is after the '>'
-	    DCCEXParser::parse(serial, buffer, NULL);  // buffer parsed with trailing '>'
-	    inCommandPayload = PAYLOAD_FALSE;
-	    break;
-	  } else if (ch == '"') {
-	    inCommandPayload = PAYLOAD_STRING;
-	  }
-	}
-      } else {
-	DIAG(F("Parse error: input buffer overflow"));
-	inCommandPayload = PAYLOAD_FALSE;
+      if (inCommandPayload == PAYLOAD_NORMAL) {
+        if (ch == '>') {
+          buffer[bufferLength] = '\0';               // This \0 is after the '>'
+          TRACE_COMMAND(CommandTrace::TRACE_SERIAL_CLIENT, buffer, bufferLength - 1);
+#ifdef HAS_ENOUGH_MEMORY
+          if (tokenState == TOKENS_DONE) {
+            DIAGLOG(Diag::CMD, F("PARSING:%s"), buffer + opcodeAt);
+            DCCEXParser::parseSplit(serial, buffer + opcodeAt, params, tokenizer.count(), NULL);
+          }
+          else {
+            // put back any closing quotes the tokenizer has already terminated
+            for (byte i = 0; i < bufferLength; i++)
+              if (buffer[i] == '\0') buffer[i] = '"';
+            DCCEXParser::parse(serial, buffer, NULL);
+          }
+#else
+          DCCEXParser::parse(serial, buffer, NULL);  // buffer parsed with trailing '>'
+#endif
+          inCommandPayload = PAYLOAD_FALSE;
+          return;
+        } else if (ch == '"') {
+          inCommandPayload = PAYLOAD_STRING;
+        }
       }
+    } else {
+      DIAG(F("Parse error: input buffer overflow"));
+      inCommandPayload = PAYLOAD_FALSE;
     }
   }
 }
@@ -23,27 +23,85 @@
 
 #include "Arduino.h"
 #include "defines.h"
+#include "DCCEXParser.h"
+#ifdef HAS_ENOUGH_MEMORY
+#include "CommandTokenizer.h"
+#endif
+#include "BinaryCommands.h"
+#include "Arena.h"
 
 
 #ifndef COMMAND_BUFFER_SIZE
  #define COMMAND_BUFFER_SIZE 100
 #endif
+// Bytes read from a port at a time, and the microseconds one port
+// may keep reading (and parsing) for in one loop.
+#ifndef SERIAL_READ_CHUNK
+ #define SERIAL_READ_CHUNK 32
+#endif
+#ifndef SERIAL_LOOP_BUDGET
+ #define SERIAL_LOOP_BUDGET 2000
+#endif
+// Broadcasts are queued per port and written as the port has room,
+// so a host that stops reading can't hold up the loop. A message
+// that doesn't fit is dropped whole and counted. 0 turns this off.
+#ifndef SERIAL_OUT_SIZE
+ #if !defined(HAS_ENOUGH_MEMORY)
+  #define SERIAL_OUT_SIZE 0
+ #elif defined(ARDUINO_ARCH_AVR)
+  #define SERIAL_OUT_SIZE 128
+ #else
+  #define SERIAL_OUT_SIZE 512
+ #endif
+#endif
 
 class SerialManager {
 public:
+  ARENA_NEW(ARENA_SERIAL)
   static void init();
   static void loop();
-  static void broadcast(char * stringBuffer);
+  static void broadcast(const char * message, uint16_t length);
+#ifdef BINARY_COMMANDS
+  static void broadcastBinary(byte opcode, const int16_t p[], byte count);
+  static bool isBinary(Print * stream);
+  // set while a broadcast already sent as binary goes out as text
+  static bool binaryCovered;
+#endif
   
 private:  
   static SerialManager * first;
   SerialManager(Stream * myserial);
   void loop2();
-  void broadcast2(char * stringBuffer);
+  void receive(char ch);
+  void broadcast2(const char * message, uint16_t length);
   Stream * serial;
   SerialManager * next;
   byte bufferLength;
   byte buffer[COMMAND_BUFFER_SIZE]; 
   byte inCommandPayload;
+#if SERIAL_OUT_SIZE
+  void queue(const char * message, uint16_t length);
+  void drain();
+  bool outBuffered;   // port reports availableForWrite()
+  uint16_t outHead;
+  uint16_t outTail;
+  uint16_t outDropped;
+  byte outRing[SERIAL_OUT_SIZE];
+#endif
+#ifdef HAS_ENOUGH_MEMORY
+  // Parameters are split as the command arrives. The buffer is still
+  // kept for quoted strings, diagnostics and the fallback parse.
+  void tokenize();
+  CommandTokenizer tokenizer;
+  int16_t params[DCCEXParser::MAX_COMMAND_PARAMS];
+  byte opcodeAt;      // buffer index of the opcode
+  byte tokenState;    // TOKENS_xxx
+#endif
+#ifdef BINARY_COMMANDS
+  bool receiveBinary(byte ch);
+  byte binaryState;   // BINARY_xxx
+  byte binaryLength;
+  bool binaryMode;    // port has sent a good binary frame
+#endif
 };
 #endif
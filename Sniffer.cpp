@@ -21,7 +21,10 @@
 #include "DIAG.h"
 //extern Sniffer *DCCSniffer;
 
+static volatile uint32_t packetErrors = 0;
+
 static void packeterror() {
+  packetErrors++;
 #ifndef WIFI_LED
 #ifdef SNIFFER_LED
   digitalWrite(SNIFFER_LED,HIGH);
@@ -118,6 +121,10 @@ Sniffer::Sniffer(byte snifferpin) {
   ESP_ERROR_CHECK(mcpwm_capture_enable_channel(MCPWM_UNIT_0, MCPWM_SELECT_CAP0, &MCPWM_cap_config));
 }
 
+uint32_t Sniffer::getErrors() {
+  return packetErrors;
+}
+
 #define SNIFFER_TIMEOUT 100L // 100 Milliseconds
 bool Sniffer::inputActive(){
   unsigned long now = millis();
@@ -186,7 +193,7 @@ void IRAM_ATTR Sniffer::processInterrupt(int32_t capticks, bool posedge) {
 	case 0x03:
 	  // byte end
 	  uint16_t b = (bitfield & 0x3FFFF)>>2; // take 18 halfbits and use 16 of them
-	  if (!halfbits2byte(b, dccbytes + currentbyte)) {
+	  if (!halfbits2byte(b, slots[head].data + currentbyte)) {
 	    // broken halfbits
 	    inpacket = false;
 	    packeterror();
@@ -196,26 +203,19 @@ void IRAM_ATTR Sniffer::processInterrupt(int32_t capticks, bool posedge) {
 	    inpacket = false;
 	    dcclen = currentbyte+1;
 	    debugfield = bitfield;
-	    // We have something we want to give to the outpacket queue
-	    // Check length of outpacket queue
-	    if (outpacket.size() > 3) {
-	      // not good, these should have been fetched
-	      // the arbitraty number to check is THREE (see the holy grail)
-              // blink_diag(1); DO NOT DO THIS HERE -> will crash
-	      packeterror(); // or what to do better?
-	      // take emergency action:
-	      while (!outpacket.empty()) {
-		outpacket.pop_front();
-	      }
-	    }
 	    lastendofpacket = millis();
-	    DCCPacket temppacket(dccbytes, dcclen);
-	    if (!(temppacket == prevpacket)) {
-	      // we have something new to offer to the fetch routine
-	      // put it into the outpacket queue
-	      outpacket.push_back(temppacket);
-	      prevpacket = temppacket;
+	    // repeats of the previous packet are not passed on
+	    SLOT & prev = slots[(head + SLOTS - 1) % SLOTS];
+	    if (prev.len == dcclen && memcmp(prev.data, slots[head].data, dcclen) == 0)
+	      return;
+	    byte next = (head + 1) % SLOTS;
+	    if (next == tail) {
+	      // loop has not kept up, drop this one and keep what is queued
+	      overruns++;
+	      return;
 	    }
+	    slots[head].len = dcclen;
+	    head = next;
 	    return;
 	  }
 	  break;
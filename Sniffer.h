@@ -18,12 +18,10 @@
  */
 #ifdef ARDUINO_ARCH_ESP32
 #include <Arduino.h>
-#include <list>
 #include "driver/mcpwm.h"
 #include "soc/mcpwm_struct.h"
 #include "soc/mcpwm_reg.h"
 
-#define MAXDCCPACKETLEN 8
 #include "DCCPacket.h"
 
 class Sniffer {
@@ -42,18 +40,20 @@ public:
     interrupts();
     return i;
   };
-  inline DCCPacket fetchPacket() {
-    // if there is no new data, this will create a
-    // packet with length 0 (which is no packet)
-    DCCPacket p;
-    noInterrupts();
-    if (!outpacket.empty()) {
-      p = outpacket.front();
-      outpacket.pop_front();
-    }
-    interrupts();
-    return p;
+  // The ISR assembles each packet straight into a free slot of a ring
+  // that only it advances head of and only the loop advances tail of,
+  // so no locking is needed. peekPacket returns a copy of the oldest
+  // slot (length 0 if empty), which stays in the ring until releasePacket.
+  inline DCCPacket peekPacket() {
+    if (tail == head) return DCCPacket();
+    return DCCPacket(slots[tail].data, slots[tail].len);
   };
+  inline void releasePacket() {
+    if (tail != head) tail = (tail + 1) % SLOTS;
+  };
+  // packets lost because the ring was full, and damaged on the wire
+  inline uint32_t getOverruns() { return overruns; };
+  uint32_t getErrors();
   bool inputActive();
 private:
   // keep these vars in processInterrupt only
@@ -63,13 +63,19 @@ private:
   int32_t lastticks;
   bool lastedge;
   byte currentbyte = 0;
-  byte dccbytes[MAXDCCPACKETLEN];
+  static const byte SLOTS = 16;
+  struct SLOT {
+    byte len;
+    byte data[MAXDCCPACKETLEN];
+  };
+  SLOT slots[SLOTS] = {};
+  volatile byte head = 0;   // slot the ISR is filling
+  volatile byte tail = 0;   // oldest slot not yet released by the loop
+  volatile uint32_t overruns = 0;
   byte dcclen = 0;
   bool inpacket = false;
   // these vars are used as interface to other parts of sniffer
   byte halfbitcounter = 0;
-  std::list<DCCPacket> outpacket;
-  DCCPacket prevpacket;
   volatile unsigned long lastendofpacket = 0; // timestamp millis
 
 };
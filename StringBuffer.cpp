@@ -21,21 +21,37 @@
 #include "StringBuffer.h"
 #include "DIAG.h"
 
-StringBuffer::StringBuffer() {
+StringBuffer::StringBuffer(int16_t maxLength) {
+    _max=maxLength;
+    _size=maxLength<buffer_start ? maxLength : buffer_start;
+    _buffer=(char *)malloc(_size+1);
+    if (!_buffer) _size=_max=0; // out of memory, so write() fails
     flush();
 };
 
+StringBuffer::~StringBuffer() {
+    free(_buffer);
+}
+
 char * StringBuffer::getString() { 
-   return _buffer;
+   return _buffer ? _buffer : (char *)"";
 }
 
 void StringBuffer::flush() {
     _pos_write=0;
-    _buffer[0]='\0';
+    if (_buffer) _buffer[0]='\0';
 }
 
 size_t StringBuffer::write(uint8_t b) {
-  if (_pos_write>=buffer_max) return 0;
+  if (_pos_write>=_size) {
+    // Double up to _max, the string is truncated when that fails
+    if (_size>=_max) return 0;
+    int16_t size=_size>_max/2 ? _max : _size*2;
+    char * larger=(char *)realloc(_buffer, size+1);
+    if (!larger) return 0;
+    _buffer=larger;
+    _size=size;
+  }
   _buffer[_pos_write] = b;
   ++_pos_write;
   _buffer[_pos_write]='\0';
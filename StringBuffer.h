@@ -21,18 +21,27 @@
 #ifndef StringBuffer_h
 #define StringBuffer_h
 #include <Arduino.h>
+#include "Arena.h"
 
+// The buffer starts at 64 bytes, enough for most text msgs to throttles,
+// and grows on the heap up to maxLength when a longer string is written.
+// It never shrinks, so a reused buffer settles at the longest string seen.
 class StringBuffer : public Print {
   public:
-    StringBuffer(); 
+    ARENA_NEW(ARENA_OTHER)
+    StringBuffer(int16_t maxLength=64); 
+    ~StringBuffer();
     // Override Print default
     virtual size_t write(uint8_t b);
     void flush();
     char * getString();
+    int16_t length() { return _pos_write; }
   private:
-    static const int  buffer_max=64; // enough for long text msgs to throttles  
+    static const int16_t buffer_start=64;
     int16_t _pos_write;
-    char _buffer[buffer_max+2];
+    int16_t _size;         // bytes in _buffer excluding the terminator
+    int16_t _max;
+    char * _buffer;
 };
 
 #endif
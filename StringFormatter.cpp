@@ -20,22 +20,81 @@
 #include <stdarg.h>
 #include "DisplayInterface.h"
 #include "CommandDistributor.h"
+#include "StringBuffer.h"
+#include "DiagLog.h"
 
 bool Diag::ACK=false;
-bool Diag::CMD=false;
-bool Diag::WIFI=false;
-bool Diag::WITHROTTLE=false;
-bool Diag::ETHERNET=false;
-bool Diag::LCN=false;
+byte Diag::CMD=Diag::OFF;
+byte Diag::WIFI=Diag::OFF;
+byte Diag::WITHROTTLE=Diag::OFF;
+byte Diag::ETHERNET=Diag::OFF;
+byte Diag::LCN=Diag::OFF;
 bool Diag::SNIFFER=false;
 
+// Takes the arguments of a send2 call from (a copy of) its va_list
+class VaArgs {
+public:
+  VaArgs(va_list args) { va_copy(this->args, args); }
+  ~VaArgs() { va_end(args); }
+  int i() { return va_arg(args, int); }
+  unsigned int u() { return va_arg(args, unsigned int); }
+  long l() { return va_arg(args, long); }
+  unsigned long ul() { return va_arg(args, unsigned long); }
+  char * str() { return va_arg(args, char*); }
+  void * ptr() { return va_arg(args, void*); }
+private:
+  va_list args;
+};
+
+
  
 void StringFormatter::diag( const FSH* input...) {
- USB_SERIAL.print(F("<* "));   
   va_list args;
   va_start(args, input);
-  send2(&USB_SERIAL,input,args);
+  VaArgs reader(args);
+  diagLine(input,reader);
+  va_end(args);
+}
+
+void StringFormatter::diagLevel(byte level, const FSH* input...) {
+  va_list args;
+  va_start(args, input);
+#ifdef DIAG_LOG
+  // The log walks its own copy so the line can still be written
+  // here if it is not queued.
+  if (level<Diag::SYNC) {
+    va_list copy;
+    va_copy(copy, args);
+    bool queued=DiagLog::add(input,copy);
+    va_end(copy);
+    if (queued) {
+      va_end(args);
+      return;
+    }
+  }
+#else
+  (void)level;
+#endif
+  VaArgs reader(args);
+  diagLine(input,reader);
+  va_end(args);
+}
+
+template <class ARGS>
+void StringFormatter::diagLine(const FSH* input, ARGS & args) {
+#ifdef WIFI_TASK_ON_CORE0
+  // Both cores write diags, so each line is put together first and
+  // written in one go, which the serial driver does not split.
+  StringBuffer line(BROADCAST_MAX);
+  line.print(F("<* "));
+  format2(&line,input,args);
+  line.print(F(" *>\n"));
+  USB_SERIAL.write(line.getString(), line.length());
+#else
+ USB_SERIAL.print(F("<* "));   
+  format2(&USB_SERIAL,input,args);
   USB_SERIAL.print(F(" *>\n"));
+#endif
 }
 
 void StringFormatter::lcd(byte row, const FSH* input...) {
@@ -47,7 +106,11 @@ void StringFormatter::lcd(byte row, const FSH* input...) {
 #endif
   // Issue the LCD as a diag first
   // Unless the same serial is asking for the virtual @ respomnse
+#ifdef VLCD_DIFF
+  if (!CommandDistributor::virtualLCDOnUSB()) {
+#else
   if (virtualLCD!=&USB_SERIAL) {
+#endif
     send(&USB_SERIAL,F("<* LCD%d:"),row);
     va_start(args, input);
     send2(&USB_SERIAL,input,args);
@@ -97,7 +160,34 @@ void StringFormatter::send(Print & stream, const FSH* input...) {
   send2(&stream,input,args);
 }
 
+void StringFormatter::emitOne(Print * stream, const FSH * flash) {
+#if WIFI_ON | ETHERNET_ON
+  // as %S in send2
+  if (stream->availableForWrite()==RingStream::THIS_IS_A_RINGSTREAM) {
+    ((RingStream *)stream)->printFlash(flash);
+    return;
+  }
+#endif
+  stream->print(flash);
+}
+
 void StringFormatter::send2(Print * stream,const FSH* format, va_list args) {
+  VaArgs reader(args);
+  format2(stream,format,reader);
+  va_end(args);
+}
+
+#ifdef DIAG_LOG
+void StringFormatter::diagLogged(const FSH* input, const byte * args) {
+  DiagLogArgs reader(args);
+  diagLine(input,reader);
+}
+#endif
+
+// The format walk behind send2, also used to replay the arguments
+// DiagLog saved for a queued diag.
+template <class ARGS>
+void StringFormatter::format2(Print * stream,const FSH* format, ARGS & args) {
     
   // thanks to Jan Turoň  https://arduino.stackexchange.com/questions/56517/formatting-strings-in-arduino-for-output
 
@@ -117,13 +207,13 @@ void StringFormatter::send2(Print * stream,const FSH* format, va_list args) {
     c=GETFLASH(flash+i);
     switch(c) {
       case '%': stream->print('%'); break;
-      case 'c': stream->print((char) va_arg(args, int)); break;
-      case 's': stream->print(va_arg(args, char*)); break;
-      case 'e': printEscapes(stream,va_arg(args, char*)); break;
-      case 'E': printEscapes(stream,(const FSH*)va_arg(args, char*)); break;
+      case 'c': stream->print((char) args.i()); break;
+      case 's': stream->print(args.str()); break;
+      case 'e': printEscapes(stream,args.str()); break;
+      case 'E': printEscapes(stream,(const FSH*)args.ptr()); break;
       case 'S':
       { 
-        const FSH*  flash= (const FSH*)va_arg(args, char*);
+        const FSH*  flash= (const FSH*)args.ptr();
 
 #if WIFI_ON | ETHERNET_ON
         // RingStream has special logic to handle flash strings
@@ -136,19 +226,20 @@ void StringFormatter::send2(Print * stream,const FSH* format, va_list args) {
         stream->print(flash);
         break;
              }
-      case 'P': stream->print((uint32_t)va_arg(args, void*), HEX); break;
-      case 'd': printPadded(stream,va_arg(args, int), formatWidth, formatLeft); break;
-      case 'u': printPadded(stream,va_arg(args, unsigned int), formatWidth, formatLeft); break;
-      case 'l': printPadded(stream,va_arg(args, long), formatWidth, formatLeft); break;
-      case 'L': stream->print(va_arg(args, unsigned long), DEC); break;
-      case 'b': stream->print(va_arg(args, int), BIN); break;
-      case 'o': stream->print(va_arg(args, int), OCT); break;
-      case 'x': stream->print((unsigned int)va_arg(args, unsigned int), HEX); break;
-      case 'X': stream->print((unsigned long)va_arg(args, unsigned long), HEX); break;
-      case 'h': printHex(stream,(unsigned int)va_arg(args, unsigned int)); break;
+      case 'F': printFar(stream,args.ul()); break;
+      case 'P': stream->print((uintptr_t)args.ptr(), HEX); break;
+      case 'd': printPadded(stream,args.i(), formatWidth, formatLeft); break;
+      case 'u': printPadded(stream,args.u(), formatWidth, formatLeft); break;
+      case 'l': printPadded(stream,args.l(), formatWidth, formatLeft); break;
+      case 'L': printDecimal(stream,args.ul()); break;
+      case 'b': stream->print(args.i(), BIN); break;
+      case 'o': stream->print(args.i(), OCT); break;
+      case 'x': printHexDigits(stream,args.u(),0); break;
+      case 'X': printHexDigits(stream,args.ul(),0); break;
+      case 'h': printHex(stream,args.u()); break;
       case 'M':
       { // this prints a unsigned long microseconds time in readable format
-	unsigned long time = va_arg(args, long);
+	unsigned long time = args.l();
 	if (time >= 2000) {
 	  time = time / 1000;
 	  if (time >= 2000) {
@@ -186,7 +277,6 @@ void StringFormatter::send2(Print * stream,const FSH* format, va_list args) {
     }
   } while(formatContinues);
   }
-  va_end(args);
 }
 
 void StringFormatter::printEscapes(Print * stream,char * input) {
@@ -226,35 +316,116 @@ void StringFormatter::printEscape(Print * stream, char c) {
  }
 
  
+// Two ASCII digits for each value 0..99 so that the conversion
+// below needs one division per pair of digits.
+const char FLASH digitPairs[]=
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+// Writes the digits of value to the end of buf (returns the first)
+// Divides by 100 as uint16_t once the value fits, which AVR does
+// several times faster than the long division in Print::print.
+static char * formatDecimal(char * end, unsigned long value) {
+  *end='\0';
+  while (value > 0xFFFF) {
+    byte pair=value % 100;
+    value /= 100;
+    *--end=GETFLASH(digitPairs+2*pair+1);
+    *--end=GETFLASH(digitPairs+2*pair);
+  }
+  uint16_t v=value;
+  while (v >= 100) {
+    byte pair=v % 100;
+    v /= 100;
+    *--end=GETFLASH(digitPairs+2*pair+1);
+    *--end=GETFLASH(digitPairs+2*pair);
+  }
+  if (v >= 10) {
+    *--end=GETFLASH(digitPairs+2*v+1);
+    *--end=GETFLASH(digitPairs+2*v);
+  }
+  else *--end='0'+v;
+  return end;
+}
+
+void StringFormatter::printDecimal(Print* stream, long value) {
+  char buf[12];
+  char * p;
+  if (value<0) {
+    p=formatDecimal(buf+sizeof(buf)-1, -(unsigned long)value);
+    *--p='-';
+  }
+  else p=formatDecimal(buf+sizeof(buf)-1, value);
+  stream->print(p);
+}
+
+void StringFormatter::printDecimal(Print* stream, unsigned long value) {
+  char buf[11];
+  stream->print(formatDecimal(buf+sizeof(buf)-1, value));
+}
+
 void StringFormatter::printPadded(Print* stream, long value, byte width, bool formatLeft) {
-  if (width==0) {
-    stream->print(value, DEC);
-    return;
+  char buf[12];
+  char * end=buf+sizeof(buf)-1;
+  char * p;
+  if (value<0) {
+    p=formatDecimal(end, -(unsigned long)value);
+    *--p='-';
   }
+  else p=formatDecimal(end, value);
   
-    int digits=(value <= 0)? 1: 0;  // zero and negative need extra digot
-    long v=value;
-    while (v) {
-        v /= 10;
-        digits++;
-    }
-    
-    if (formatLeft) stream->print(value, DEC);
-    while(digits<width) {
-      stream->print(' ');
-      digits++;
-    }
-    if (!formatLeft) stream->print(value, DEC);    
+  byte digits=end-p;
+  if (formatLeft) stream->print(p);
+  while(digits<width) {
+    stream->print(' ');
+    digits++;
   }
+  if (!formatLeft) stream->print(p);
+}
+
+// Copied from flash straight to the stream, in chunks where the
+// far reads need a buffer
+void StringFormatter::printFar(Print * stream, uint32_t strfar) {
+#if defined(ARDUINO_AVR_MEGA) || defined(ARDUINO_AVR_MEGA2560)
+  byte chunk[16];
+  for (;;) {
+    byte n=0;
+    while (n<sizeof(chunk) && (chunk[n]=pgm_read_byte_far(strfar+n))) n++;
+    if (n) stream->write(chunk, n);
+    if (n<sizeof(chunk)) return;
+    strfar+=n;
+  }
+#else
+  // UNO/NANO CPUs dont have high memory
+  // 32 bit cpus dont care anyway
+  const FSH * flash=(const FSH *)(uintptr_t)strfar;
+#if WIFI_ON | ETHERNET_ON
+  if (stream->availableForWrite()==RingStream::THIS_IS_A_RINGSTREAM) {
+    ((RingStream *)stream)->printFlash(flash);
+    return;
+  }
+#endif
+  stream->print(flash);
+#endif
+}
 
 // printHex prints the full 2 byte hex with leading zeros, unlike print(value,HEX)
-const char FLASH hexchars[]="0123456789ABCDEF";
 void StringFormatter::printHex(Print * stream,uint16_t value) {
-    char result[5];
-    for (int i=3;i>=0;i--) {
-      result[i]=GETFLASH(hexchars+(value & 0x0F));
-      value>>=4;
-    }
-    result[4]='\0';
-     stream->print(result);
+  printHexDigits(stream,value,4);
+}
+
+// Hex with at least minDigits digits, by shifting rather than the
+// division by base in Print::print(value,HEX)
+void StringFormatter::printHexDigits(Print * stream, unsigned long value, byte minDigits) {
+  char result[9];
+  char * p=result+sizeof(result)-1;
+  *p='\0';
+  do {
+    byte nibble=value & 0x0F;
+    *--p= nibble<10 ? '0'+nibble : 'A'-10+nibble;
+    value>>=4;
+    if (minDigits) minDigits--;
+  } while (value || minDigits);
+  stream->print(p);
 }
@@ -24,12 +24,18 @@
 #include "Display.h"
 class Diag {
   public:
+  // Levels of the categories written with DIAGLOG. ON diags are
+  // queued in the DiagLog ring (if there is one) and written from
+  // loop(), SYNC diags are written at once like DIAG.
+  static const byte OFF=0;
+  static const byte ON=1;
+  static const byte SYNC=2;
   static bool ACK;
-  static bool CMD;
-  static bool WIFI;
-  static bool WITHROTTLE;
-  static bool ETHERNET;
-  static bool LCN;
+  static byte CMD;
+  static byte WIFI;
+  static byte WITHROTTLE;
+  static byte ETHERNET;
+  static byte LCN;
   static bool SNIFFER;
 };
 
@@ -45,14 +51,42 @@ class StringFormatter
 
     // DIAG support
     static void diag( const FSH* input...);
+    static void diagLevel(byte level, const FSH* input...);
+    static void diagLogged(const FSH* input, const byte * args);
     static void lcd(byte row, const FSH* input...);
     static void lcd2(uint8_t display, byte row, const FSH* input...);
     static void printEscapes(char * input);
     static void printEscape( char c);
     static void printHex(Print * stream,uint16_t value);
+    static void printHexDigits(Print * stream, unsigned long value, byte minDigits);
+    static void printDecimal(Print * stream, long value);
+    static void printDecimal(Print * stream, unsigned long value);
+    // a string in HIGHFLASH by its far address, as printed by %F
+    static void printFar(Print * stream, uint32_t strfar);
+
+    // Type directed output for hot replies and broadcasts. The pieces
+    // are printed in order by the print overload matching their types,
+    // which the compiler picks, so there is no format for send2 to walk.
+    // e.g. emit(stream, F("<Q "), id, F(">\n"))
+    // A char prints as a character, a byte as a number, a long is signed.
+    template<typename T, typename... Targs>
+    static void emit(Print * stream, T first, Targs... rest) {
+      emitOne(stream, first);
+      emit(stream, rest...);
+    }
+    static void emit(Print * stream) { (void)stream; }
 
     private: 
     static void send2(Print * serial, const FSH* input,va_list args);
+    template <class ARGS> static void format2(Print * serial, const FSH* input, ARGS & args);
+    template <class ARGS> static void diagLine(const FSH* input, ARGS & args);
     static void printPadded(Print* stream, long value, byte width, bool formatLeft);
+    template<typename T> static void emitOne(Print * stream, T value) { stream->print(value); }
+    static void emitOne(Print * stream, int value) { printDecimal(stream,(long)value); }
+    static void emitOne(Print * stream, long value) { printDecimal(stream,value); }
+    static void emitOne(Print * stream, byte value) { printDecimal(stream,(unsigned long)value); }
+    static void emitOne(Print * stream, unsigned int value) { printDecimal(stream,(unsigned long)value); }
+    static void emitOne(Print * stream, unsigned long value) { printDecimal(stream,value); }
+    static void emitOne(Print * stream, const FSH * flash);
 };
 #endif
@@ -32,6 +32,7 @@
 #include "CommandDistributor.h"
 #include "DCCEXParser.h"
 #include "KeywordHasher.h"
+#include "CVCache.h"
 // Virtualised Motor shield multi-track hardware Interface
 #define FOR_EACH_TRACK(t) for (byte t=0;t<=lastTrack;t++)
     
@@ -40,8 +41,29 @@
 	    if (track[t]->getMode() & findmode)	\
                 track[t]->function;
 
+// MAIN tracks driven by one MAIN packet stream
+#ifdef DCC_DISTRICTS
+#define IS_MAIN_STREAM(t,stream) \
+        ((track[t]->getMode() & TRACK_MODE_MAIN) && trackDistrict[t]==(stream))
+#else
+#define IS_MAIN_STREAM(t,stream) (track[t]->getMode() & TRACK_MODE_MAIN)
+#endif
+#define APPLY_BY_STREAM(stream,function) \
+        FOR_EACH_TRACK(t) \
+	    if (IS_MAIN_STREAM(t,stream)) \
+                track[t]->function;
+
 MotorDriver * TrackManager::track[MAX_TRACKS] = { NULL };
 int16_t TrackManager::trackDCAddr[MAX_TRACKS] = { 0 };
+byte TrackManager::trackChangeDepth=0;
+byte TrackManager::trackStateDirty=0;
+byte TrackManager::trackPowerDirty=0;
+uint16_t TrackManager::stateGeneration=0;
+// no mode and an impossible power, so the first broadcasts always go
+TRACK_MODE TrackManager::sentMode[MAX_TRACKS];
+int16_t TrackManager::sentDCAddr[MAX_TRACKS];
+POWERMODE TrackManager::sentPower[MAX_TRACKS]={ (POWERMODE)0xFF, (POWERMODE)0xFF, 
+  (POWERMODE)0xFF, (POWERMODE)0xFF, (POWERMODE)0xFF, (POWERMODE)0xFF, (POWERMODE)0xFF, (POWERMODE)0xFF };
 
 int8_t TrackManager::lastTrack=-1;
 bool TrackManager::progTrackSyncMain=false; 
@@ -50,6 +72,36 @@ int16_t TrackManager::joinRelay=UNUSED_PIN;
 #ifdef ARDUINO_ARCH_ESP32
 byte TrackManager::tempProgTrack=MAX_TRACKS+1; // MAX_TRACKS+1 is the unused flag
 #endif
+#ifdef SIGNAL_PORT_MASKS
+SIGNAL_PORT TrackManager::signalPorts[2*MAX_TRACKS];
+byte TrackManager::mainSignalPortCount=0;
+byte TrackManager::progSignalPortCount=0;
+bool TrackManager::signalPWM=false;
+#endif
+#ifdef SIGNAL_COMPARE
+SIGNAL_OCR TrackManager::signalCompare[2*MAX_TRACKS];
+byte TrackManager::mainSignalCompareCount=0;
+byte TrackManager::progSignalCompareCount=0;
+#endif
+#ifdef DCC_DISTRICTS
+byte TrackManager::trackDistrict[MAX_TRACKS]={0};
+#ifdef SIGNAL_PORT_MASKS
+byte TrackManager::districtPortFirst[DCC_DISTRICTS];
+byte TrackManager::districtPortCount[DCC_DISTRICTS]={0};
+#endif
+#ifdef SIGNAL_COMPARE
+byte TrackManager::districtCompareFirst[DCC_DISTRICTS];
+byte TrackManager::districtCompareCount[DCC_DISTRICTS]={0};
+#endif
+#endif
+#ifdef DC_KICKSTART
+bool TrackManager::dcKicking=false;
+#endif
+#ifdef FAST_REVERSER
+volatile byte TrackManager::reverserTracks=0;
+byte TrackManager::reverserNext=0;
+uint16_t TrackManager::reverserTick=0;
+#endif
 
 #ifdef ANALOG_READ_INTERRUPT
 /*
@@ -142,9 +194,10 @@ void TrackManager::addTrack(byte t, MotorDriver* driver) {
      } 
 }
 
-// setDCCSignal(), called from interrupt context
-// does assume ports are shadowed if they can be
-void TrackManager::setDCCSignal( bool on) {
+#ifndef SIGNAL_PORT_MASKS
+// The signal pins write to these copies of the port registers so that
+// all tracks on a waveform change together
+__attribute__((always_inline)) static inline void loadShadowPorts() {
   HAVE_PORTA(shadowPORTA=PORTA);
   HAVE_PORTB(shadowPORTB=PORTB);
   HAVE_PORTC(shadowPORTC=PORTC);
@@ -153,7 +206,9 @@ void TrackManager::setDCCSignal( bool on) {
   HAVE_PORTF(shadowPORTF=PORTF);
   HAVE_PORTG(shadowPORTG=PORTG);
   HAVE_PORTH(shadowPORTH=PORTH);
-  APPLY_BY_MODE(TRACK_MODE_MAIN,setSignal(on));
+}
+
+__attribute__((always_inline)) static inline void storeShadowPorts() {
   HAVE_PORTA(PORTA=shadowPORTA);
   HAVE_PORTB(PORTB=shadowPORTB);
   HAVE_PORTC(PORTC=shadowPORTC);
@@ -163,28 +218,195 @@ void TrackManager::setDCCSignal( bool on) {
   HAVE_PORTG(PORTG=shadowPORTG);
   HAVE_PORTH(PORTH=shadowPORTH);
 }
+#endif
+
+// setDCCSignal(), called from interrupt context
+// does assume ports are shadowed if they can be
+void TrackManager::setDCCSignal( bool on) {
+#ifdef SIGNAL_PORT_MASKS
+  if (signalPWM) {
+#ifdef SIGNAL_COMPARE
+    for (byte p=0; p<mainSignalCompareCount; p++)
+      *signalCompare[p].ocr = signalCompare[p].value[on];
+#else
+    APPLY_BY_STREAM(0,setSignal(on));
+#endif
+    return;
+  }
+#ifdef SIGNAL_DMA
+  byte first=1;  // the DMA has written the first port
+#else
+  byte first=0;
+#endif
+  for (byte p=first; p<mainSignalPortCount; p++)
+    setSignalPort(signalPorts[p], on);
+#else
+  loadShadowPorts();
+  APPLY_BY_STREAM(0,setSignal(on));
+  storeShadowPorts();
+#endif
+}
 
 // setPROGSignal(), called from interrupt context
 // does assume ports are shadowed if they can be
 void TrackManager::setPROGSignal( bool on) {
-  HAVE_PORTA(shadowPORTA=PORTA);
-  HAVE_PORTB(shadowPORTB=PORTB);
-  HAVE_PORTC(shadowPORTC=PORTC);
-  HAVE_PORTD(shadowPORTD=PORTD);
-  HAVE_PORTE(shadowPORTE=PORTE);
-  HAVE_PORTF(shadowPORTF=PORTF);
-  HAVE_PORTG(shadowPORTG=PORTG);
-  HAVE_PORTH(shadowPORTH=PORTH);
+#ifdef SIGNAL_PORT_MASKS
+  if (signalPWM) {
+#ifdef SIGNAL_COMPARE
+    for (byte p=mainSignalCompareCount; p<mainSignalCompareCount+progSignalCompareCount; p++)
+      *signalCompare[p].ocr = signalCompare[p].value[on];
+#else
+    APPLY_BY_MODE(TRACK_MODE_PROG,setSignal(on));
+#endif
+    return;
+  }
+  for (byte p=mainSignalPortCount; p<mainSignalPortCount+progSignalPortCount; p++)
+    setSignalPort(signalPorts[p], on);
+#else
+  loadShadowPorts();
   APPLY_BY_MODE(TRACK_MODE_PROG,setSignal(on));
-  HAVE_PORTA(PORTA=shadowPORTA);
-  HAVE_PORTB(PORTB=shadowPORTB);
-  HAVE_PORTC(PORTC=shadowPORTC);
-  HAVE_PORTD(PORTD=shadowPORTD);
-  HAVE_PORTE(PORTE=shadowPORTE);
-  HAVE_PORTF(PORTF=shadowPORTF);
-  HAVE_PORTG(PORTG=shadowPORTG);
-  HAVE_PORTH(PORTH=shadowPORTH);
+  storeShadowPorts();
+#endif
+}
+
+#ifdef DCC_DISTRICTS
+// setDistrictSignal(), called from interrupt context for streams 1 up
+void TrackManager::setDistrictSignal(byte stream, bool on) {
+#ifdef SIGNAL_PORT_MASKS
+  if (signalPWM) {
+#ifdef SIGNAL_COMPARE
+    byte first=districtCompareFirst[stream];
+    for (byte p=first; p<first+districtCompareCount[stream]; p++)
+      *signalCompare[p].ocr = signalCompare[p].value[on];
+#else
+    APPLY_BY_STREAM(stream,setSignal(on));
+#endif
+    return;
+  }
+  byte first=districtPortFirst[stream];
+  for (byte p=first; p<first+districtPortCount[stream]; p++)
+    setSignalPort(signalPorts[p], on);
+#else
+  loadShadowPorts();
+  APPLY_BY_STREAM(stream,setSignal(on));
+  storeShadowPorts();
+#endif
+}
+
+// <= A DISTRICT n>, the track takes the packets of district n when MAIN
+bool TrackManager::setTrackDistrict(byte t, int16_t district) {
+  if (t>lastTrack || track[t]==NULL) return false;
+  if (district<1 || district>DCC_DISTRICTS) return false;
+  trackDistrict[t]=district-1;
+#ifdef SIGNAL_PORT_MASKS
+  buildSignalPorts();
+#endif
+  return true;
+}
+#endif
+
+#ifdef SIGNAL_PORT_MASKS
+// Precompute the port writes for every signal edge from the current
+// track modes and phase inversions. Called whenever these change.
+// The MAIN ports come first in signalPorts, followed by the PROG ports
+// and then those of any districts from 2 up.
+// In HA mode the signal comes from the PWM timer instead, so the tracks
+// are then set one by one, or on AVR their compare registers are loaded
+// from signalCompare. With SIGNAL_DMA the first MAIN port is the one
+// the DMA writes.
+void TrackManager::buildSignalPorts() {
+  SIGNAL_PORT ports[2*MAX_TRACKS];
+  byte count=0;
+  bool pwm=false;
+#ifdef SIGNAL_COMPARE
+  SIGNAL_OCR compare[2*MAX_TRACKS];
+  byte compareCount=0;
+#endif
+  FOR_EACH_TRACK(t) {
+    if (IS_MAIN_STREAM(t,0)) {
+      track[t]->addSignalPorts(ports, count);
+      pwm |= track[t]->trackPWM;
+#ifdef SIGNAL_COMPARE
+      if (track[t]->trackPWM) track[t]->addSignalCompare(compare, compareCount);
+#endif
+    }
+  }
+  byte mainCount=count;
+#ifdef SIGNAL_COMPARE
+  byte mainCompareCount=compareCount;
+#endif
+  FOR_EACH_TRACK(t) {
+    if (track[t]->getMode() & TRACK_MODE_PROG) {
+      // a PROG pin on a MAIN port gets its own entry after the MAIN ones
+      SIGNAL_PORT * progPorts=ports+mainCount;
+      byte progCount=count-mainCount;
+      track[t]->addSignalPorts(progPorts, progCount);
+      count=mainCount+progCount;
+      pwm |= track[t]->trackPWM;
+#ifdef SIGNAL_COMPARE
+      if (track[t]->trackPWM) track[t]->addSignalCompare(compare, compareCount);
+#endif
+    }
+    else if (!(track[t]->getMode() & TRACK_MODE_MAIN))
+      track[t]->signalMapDirty=false;
+  }
+  byte progEnd=count;
+#ifdef SIGNAL_COMPARE
+  byte progCompareEnd=compareCount;
+#endif
+#ifdef DCC_DISTRICTS
+  // each district merges its own pins, apart from all the others
+  byte portFirst[DCC_DISTRICTS], portCount[DCC_DISTRICTS];
+#ifdef SIGNAL_COMPARE
+  byte compareFirst[DCC_DISTRICTS], compareCounts[DCC_DISTRICTS];
+#endif
+  for (byte stream=1; stream<DCC_DISTRICTS; stream++) {
+    portFirst[stream]=count;
+    portCount[stream]=0;
+#ifdef SIGNAL_COMPARE
+    compareFirst[stream]=compareCount;
+#endif
+    FOR_EACH_TRACK(t) {
+      if (!IS_MAIN_STREAM(t,stream)) continue;
+      track[t]->addSignalPorts(ports+portFirst[stream], portCount[stream]);
+      count=portFirst[stream]+portCount[stream];
+      pwm |= track[t]->trackPWM;
+#ifdef SIGNAL_COMPARE
+      if (track[t]->trackPWM) track[t]->addSignalCompare(compare, compareCount);
+#endif
+    }
+#ifdef SIGNAL_COMPARE
+    compareCounts[stream]=compareCount-compareFirst[stream];
+#endif
+  }
+#endif
+  noInterrupts();
+  memcpy(signalPorts, ports, count*sizeof(SIGNAL_PORT));
+  mainSignalPortCount=mainCount;
+  progSignalPortCount=progEnd-mainCount;
+#ifdef SIGNAL_COMPARE
+  memcpy(signalCompare, compare, compareCount*sizeof(SIGNAL_OCR));
+  mainSignalCompareCount=mainCompareCount;
+  progSignalCompareCount=progCompareEnd-mainCompareCount;
+#endif
+#ifdef DCC_DISTRICTS
+  for (byte stream=1; stream<DCC_DISTRICTS; stream++) {
+    districtPortFirst[stream]=portFirst[stream];
+    districtPortCount[stream]=portCount[stream];
+#ifdef SIGNAL_COMPARE
+    districtCompareFirst[stream]=compareFirst[stream];
+    districtCompareCount[stream]=compareCounts[stream];
+#endif
+  }
+#endif
+  signalPWM=pwm;
+#ifdef SIGNAL_DMA
+  if (mainCount) DCCTimer::setSignalDMAPort(signalPorts[0].bsrr);
+  DCCWaveform::refreshSignalDMA();
+#endif
+  interrupts();
 }
+#endif
 
 // setDCSignal(), called from normal context
 // MotorDriver::setDCSignal handles shadowed IO port changes.
@@ -193,11 +415,41 @@ void TrackManager::setDCSignal(int16_t cab, byte speedbyte) {
   FOR_EACH_TRACK(t) {
     if (trackDCAddr[t]!=cab && cab != 0) continue;
     if (track[t]->getMode() & TRACK_MODE_DC)
-      track[t]->setDCSignal(speedbyte, DCC::getThrottleFrequency(trackDCAddr[t]));
+      applyDCSignal(t, speedbyte);
   }
 }    
 
+// The DC track is driven by the PWM timer of its brake pin alone, so
+// nothing here runs in the waveform ISR. Only a kick-start needs ending
+// from loop().
+void TrackManager::applyDCSignal(byte t, byte speedbyte) {
+  int16_t cab=trackDCAddr[t];
+#ifdef DC_KICKSTART
+  if (track[t]->setDCSignal(speedbyte, DCC::getThrottleFrequency(cab), DCC::getThrottleKick(cab)))
+    dcKicking=true;
+#else
+  track[t]->setDCSignal(speedbyte, DCC::getThrottleFrequency(cab));
+#endif
+}
+
+#ifdef DC_KICKSTART
+void TrackManager::endDCKicks() {
+  unsigned long now=millis();
+  bool still=false;
+  FOR_EACH_TRACK(t)
+    if (track[t]->endDCKick(now)) still=true;
+  dcKicking=still;
+}
+#endif
+
 bool TrackManager::setTrackMode(byte trackToSet, TRACK_MODE mode, int16_t dcAddr, bool offAtChange) {
+    beginTrackChanges();
+    bool done=changeTrackMode(trackToSet, mode, dcAddr, offAtChange);
+    endTrackChanges();
+    return done;
+}
+
+bool TrackManager::changeTrackMode(byte trackToSet, TRACK_MODE mode, int16_t dcAddr, bool offAtChange) {
     if (trackToSet>lastTrack || track[trackToSet]==NULL) return false;
 
     // Remember track mode we came from for later
@@ -372,22 +624,26 @@ bool TrackManager::setTrackMode(byte trackToSet, TRACK_MODE mode, int16_t dcAddr
     if (mode != oldmode && offAtChange) {
       track[trackToSet]->setPower(POWERMODE::OFF);
     }
+#ifdef SIGNAL_PORT_MASKS
+    buildSignalPorts();
+#endif
+#ifdef FAST_REVERSER
+    updateReversers();
+#endif
     streamTrackState(NULL,trackToSet);
     //DIAG(F("TrackMode=%d"),mode);
     return true; 
 }
 
 void TrackManager::applyDCSpeed(byte t) {
-  track[t]->setDCSignal(DCC::getThrottleSpeedByte(trackDCAddr[t]),
-			DCC::getThrottleFrequency(trackDCAddr[t]));
+  applyDCSignal(t, DCC::getThrottleSpeedByte(trackDCAddr[t]));
 }
 
-bool TrackManager::parseEqualSign(Print *stream, int16_t params, int16_t p[])
+bool TrackManager::parseEqualSign2(Print *stream, int16_t params, int16_t p[])
 {
     
     if (params==0) { // <=>  List track assignments
-        FOR_EACH_TRACK(t)
-             streamTrackState(stream,t);
+        ReplyCache::reply(stream, REPLY_TRACK_STATES, stateGeneration, streamTrackStates);
         return true;
         
     }
@@ -397,50 +653,86 @@ bool TrackManager::parseEqualSign(Print *stream, int16_t params, int16_t p[])
     if (params>1 && (p[0]<0 || p[0]>=MAX_TRACKS)) 
         return false;
     
-    if (params==2  && p[1]=="MAIN"_hk)                     // <= id MAIN>
+    if (params<2) return false;
+    // A switch on the keyword hash compiles to a balanced compare tree
+    // rather than a chain of tests, and duplicate hashes fail to compile.
+    switch (p[1]) {
+    case "MAIN"_hk:                                       // <= id MAIN>
+        if (params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_MAIN);
-    if (params==2  && p[1]=="MAIN_INV"_hk)                 // <= id MAIN_INV>
+    case "MAIN_INV"_hk:                                   // <= id MAIN_INV>
+        if (params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_MAIN_INV);
-    if (params==2  && p[1]=="MAIN_AUTO"_hk)                // <= id MAIN_AUTO>
+    case "MAIN_AUTO"_hk:                                  // <= id MAIN_AUTO>
+        if (params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_MAIN_AUTO);
     
 #ifndef DISABLE_PROG
-    if (params==2  && p[1]=="PROG"_hk)                     // <= id PROG>
+    case "PROG"_hk:                                       // <= id PROG>
+        if (params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_PROG);
 #endif
     
-    if (params==2  && (p[1]=="OFF"_hk || p[1]=="NONE"_hk)) // <= id OFF> <= id NONE>
+    case "OFF"_hk:                                        // <= id OFF>
+    case "NONE"_hk:                                       // <= id NONE>
+        if (params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_NONE);
 
-    if (params==2  && p[1]=="EXT"_hk) // <= id EXT>
+    case "EXT"_hk:                                        // <= id EXT>
+        if (params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_EXT);
 #ifdef BOOSTER_INPUT
-    if (TRACK_MODE_BOOST != 0 &&        // compile time optimization
-	params==2  && p[1]=="BOOST"_hk)                    // <= id BOOST>
+    case "BOOST"_hk:                                      // <= id BOOST>
+        if (TRACK_MODE_BOOST == 0 || params!=2) return false; // compile time optimization
         return setTrackMode(p[0],TRACK_MODE_BOOST);
-    if (TRACK_MODE_BOOST_INV != 0 &&        // compile time optimization
-	params==2  && p[1]=="BOOST_INV"_hk)                // <= id BOOST_INV>
+    case "BOOST_INV"_hk:                                  // <= id BOOST_INV>
+        if (TRACK_MODE_BOOST_INV == 0 || params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_BOOST_INV);
-    if (TRACK_MODE_BOOST_AUTO != 0 &&        // compile time optimization
-	params==2  && p[1]=="BOOST_AUTO"_hk)               // <= id BOOST_AUTO>
+    case "BOOST_AUTO"_hk:                                 // <= id BOOST_AUTO>
+        if (TRACK_MODE_BOOST_AUTO == 0 || params!=2) return false;
         return setTrackMode(p[0],TRACK_MODE_BOOST_AUTO);
 #endif
-    if (params==2  && p[1]=="AUTO"_hk)                     // <= id AUTO>
-      return setTrackMode(p[0], track[p[0]]->getMode() | TRACK_MODIFIER_AUTO);
+    case "AUTO"_hk:                                       // <= id AUTO>
+        if (params!=2) return false;
+        return setTrackMode(p[0], track[p[0]]->getMode() | TRACK_MODIFIER_AUTO);
 
-    if (params==2  && p[1]=="INV"_hk)                      // <= id INV>
-      return setTrackMode(p[0], track[p[0]]->getMode() | TRACK_MODIFIER_INV);
+    case "INV"_hk:                                        // <= id INV>
+        if (params!=2) return false;
+        return setTrackMode(p[0], track[p[0]]->getMode() | TRACK_MODIFIER_INV);
 
-    if (params==3  && p[1]=="DC"_hk && p[2]>0)             // <= id DC cab>
+    case "DC"_hk:                                         // <= id DC cab>
+        if (params!=3 || p[2]<=0) return false;
         return setTrackMode(p[0],TRACK_MODE_DC,p[2]);
     
-    if (params==3  && (p[1]=="DC_INV"_hk ||                // <= id DC_INV cab>
-		       p[1]=="DCX"_hk) && p[2]>0)          // <= id DCX cab>
+    case "DC_INV"_hk:                                     // <= id DC_INV cab>
+    case "DCX"_hk:                                        // <= id DCX cab>
+        if (params!=3 || p[2]<=0) return false;
         return setTrackMode(p[0],TRACK_MODE_DC_INV,p[2]);
+#ifdef DCC_DISTRICTS
+    case "DISTRICT"_hk:                                   // <= id DISTRICT n>
+        if (params!=3) return false;
+        return setTrackDistrict(p[0],p[2]);
+#endif
+    }
 
     return false;
 }
 
+bool TrackManager::parseEqualSign(Print *stream, int16_t params, int16_t p[])
+{
+    if (params<2) return parseEqualSign2(stream, params, p);
+#ifdef DCC_DISTRICTS
+    // <= LOCO cab n>, where the loco is now, 0 for anywhere
+    if (params==3 && p[0]=="LOCO"_hk) return DCC::setLocoDistrict(p[1],p[2]);
+#endif
+    beginTrackChanges();
+    bool done=parseEqualSign2(stream, params, p);
+    byte sent=endTrackChanges();
+    // the sender is told even when nothing changed 
+    if (done && !(sent & (1<<p[0]))) streamTrackState(stream,p[0]);
+    return done;
+}
+
 const FSH* TrackManager::getModeName(TRACK_MODE tm) {
   const FSH *modename=F("---");
   
@@ -478,6 +770,11 @@ const FSH* TrackManager::getModeName(TRACK_MODE tm) {
 }
 
 // null stream means send to commandDistributor for broadcast
+void TrackManager::streamTrackStates(Print* stream) {
+  FOR_EACH_TRACK(t)
+    streamTrackState(stream,t);
+}
+
 void TrackManager::streamTrackState(Print* stream, byte t) {
   const FSH *format;
   
@@ -492,26 +789,165 @@ void TrackManager::streamTrackState(Print* stream, byte t) {
   if (stream) {  // null stream means send to commandDistributor for broadcast
     StringFormatter::send(stream,format,'A'+t, modename, trackDCAddr[t]);
   } else {
-    CommandDistributor::broadcastTrackState(format,'A'+t, modename, trackDCAddr[t]);
-    CommandDistributor::broadcastPower();
+    beginTrackChanges();
+    trackStateDirty|=1<<t;
+    endTrackChanges();
   }
   
 }
 
+void TrackManager::beginTrackChanges() {
+  trackChangeDepth++;
+}
+
+byte TrackManager::endTrackChanges() {
+  if (--trackChangeDepth) return 0;
+  byte sent=0;
+  byte powerTracks=trackPowerDirty;
+  FOR_EACH_TRACK(t) {
+    byte bit=1<<t;
+    if (!(trackStateDirty & bit) || track[t]==NULL) continue;
+    TRACK_MODE tm=track[t]->getMode();
+    if (tm!=sentMode[t] || trackDCAddr[t]!=sentDCAddr[t]) {
+      sentMode[t]=tm;
+      sentDCAddr[t]=trackDCAddr[t];
+      stateGeneration++;
+      CommandDistributor::broadcastTrackState((tm & TRACK_MODE_DC) ? F("<= %c %S %d>\n") : F("<= %c %S>\n"),
+                                              'A'+t, getModeName(tm), trackDCAddr[t]);
+      sent|=bit;
+    }
+    if (track[t]->getPower()!=sentPower[t]) powerTracks|=bit;
+  }
+  trackStateDirty=0;
+  trackPowerDirty=0;
+  if (powerTracks) {
+    FOR_EACH_TRACK(t) if (track[t] && (powerTracks & (1<<t))) sentPower[t]=track[t]->getPower();
+    CommandDistributor::broadcastPower(powerTracks);
+  }
+  return sent;
+}
+
+// Broadcast with the next endTrackChanges, or now if not in one
+void TrackManager::powerChanged(byte tracks) {
+  beginTrackChanges();
+  trackPowerDirty|=tracks;
+  endTrackChanges();
+}
+
 byte TrackManager::nextCycleTrack=MAX_TRACKS;
+unsigned long TrackManager::lastSweepStart=0;
+unsigned long TrackManager::maxSweepTime=0;
 
 void TrackManager::loop() {
     DCCWaveform::loop();
 #ifndef DISABLE_PROG
     DCCACK::loop();
+#endif
+#ifdef DC_KICKSTART
+    if (dcKicking) endDCKicks();
+#endif
+#if defined(FAST_REVERSER) && defined(ARDUINO_ARCH_ESP32)
+    checkReversers();
 #endif
     bool dontLimitProg=DCCACK::isActive() || progTrackSyncMain || progTrackBoosted;
-    nextCycleTrack++;
-    if (nextCycleTrack>lastTrack) nextCycleTrack=0;
-    if (track[nextCycleTrack]==NULL) return;
-    MotorDriver * motorDriver=track[nextCycleTrack];
-    bool useProgLimit=dontLimitProg ? false : (bool)(track[nextCycleTrack]->getMode() & TRACK_MODE_PROG);
-    motorDriver->checkPowerOverload(useProgLimit, nextCycleTrack);   
+    unsigned long start=micros();
+#ifdef HAS_ENOUGH_MEMORY
+    unsigned long nowMillis=millis();
+#endif
+    for (int8_t checked=0; checked<=lastTrack; checked++) {
+      nextCycleTrack++;
+      if (nextCycleTrack>lastTrack) {
+        nextCycleTrack=0;
+        // a new round starts, so every track has been checked since the last one
+        unsigned long now=micros();
+        if (lastSweepStart!=0 && now-lastSweepStart>maxSweepTime) maxSweepTime=now-lastSweepStart;
+        lastSweepStart=now;
+      }
+      if (track[nextCycleTrack]==NULL) continue;
+      MotorDriver * motorDriver=track[nextCycleTrack];
+      bool useProgLimit=dontLimitProg ? false : (bool)(track[nextCycleTrack]->getMode() & TRACK_MODE_PROG);
+      motorDriver->checkPowerOverload(useProgLimit, nextCycleTrack);   
+#ifdef HAS_ENOUGH_MEMORY
+      motorDriver->recordCurrent(nowMillis);
+#endif
+#ifdef SIGNAL_PORT_MASKS
+      // overload handling may have inverted the phase (AUTO tracks)
+      if (motorDriver->signalMapDirty) buildSignalPorts();
+#endif
+      if (micros()-start>TRACK_CHECK_BUDGET) break;
+    }
+    CommandDistributor::streamCurrent();
+}
+
+#ifdef FAST_REVERSER
+void TrackManager::updateReversers() {
+  byte tracks=0;
+  FOR_EACH_TRACK(t)
+    if (track[t]->fastReverser()) tracks|=1<<t;
+  reverserTracks=tracks;
+}
+
+#pragma GCC push_options
+#pragma GCC optimize ("-O3")
+// From the DCC interrupt one reverse loop track is checked per call,
+// on ESP32 all of them on each loop. A flip is put straight into the
+// signal port masks, buildSignalPorts catches up from loop.
+void TrackManager::checkReversers() {
+  byte tracks=reverserTracks;
+  if (!tracks) return;
+#ifdef ARDUINO_ARCH_ESP32
+  uint16_t now=micros();
+  FOR_EACH_TRACK(t)
+    if (tracks & (1<<t)) track[t]->checkReverser(now);
+#else
+  reverserTick++;
+  byte t=reverserNext;
+  do {
+    t=(t+1) & (MAX_TRACKS-1);
+  } while (!(tracks & (1<<t)));
+  reverserNext=t;
+  if (track[t]->checkReverser(reverserTick)) {
+#ifdef SIGNAL_PORT_MASKS
+#ifdef DCC_DISTRICTS
+    byte stream=trackDistrict[t];
+    if (stream) {
+      if (!signalPWM) track[t]->flipSignalPorts(signalPorts+districtPortFirst[stream],
+                                               districtPortCount[stream]);
+#ifdef SIGNAL_COMPARE
+      else track[t]->flipSignalCompare(signalCompare+districtCompareFirst[stream],
+                                       districtCompareCount[stream]);
+#endif
+      return;
+    }
+#endif
+    if (!signalPWM) {
+      track[t]->flipSignalPorts(signalPorts, mainSignalPortCount);
+#ifdef SIGNAL_DMA
+      DCCWaveform::refreshSignalDMA();
+#endif
+    }
+#ifdef SIGNAL_COMPARE
+    else track[t]->flipSignalCompare(signalCompare, mainSignalCompareCount);
+#endif
+#endif
+  }
+#endif
+}
+#pragma GCC pop_options
+
+void TrackManager::showReverserStats(bool reset) {
+  FOR_EACH_TRACK(t)
+    if (track[t]->isReverser()) track[t]->showReverser(reset);
+}
+#endif
+
+void TrackManager::showCheckStats(bool reset) {
+    DIAG(F("Overload check: %d tracks, worst round %M, budget %dus"),
+         lastTrack+1, maxSweepTime, TRACK_CHECK_BUDGET);
+    if (reset) {
+      maxSweepTime=0;
+      lastSweepStart=0;
+    }
 }
 
 MotorDriver * TrackManager::getProgDriver() {
@@ -531,13 +967,13 @@ std::vector<MotorDriver *>TrackManager::getMainDrivers() {
 
 // Set track power for all tracks with this mode
 void TrackManager::setTrackPower(TRACK_MODE trackmodeToMatch, POWERMODE powermode) {
-  bool didChange=false;
+  byte changed=0;
   FOR_EACH_TRACK(t) {
     MotorDriver *driver=track[t];
     TRACK_MODE trackmodeOfTrack = driver->getMode();
     if (trackmodeToMatch & trackmodeOfTrack) {
       if (powermode != driver->getPower())
-	didChange=true;
+	changed|=1<<t;
       if (powermode == POWERMODE::ON) {
 	if (trackmodeOfTrack & TRACK_MODE_DC) {
 	  driver->setBrake(true);   // DC starts with brake on
@@ -552,8 +988,12 @@ void TrackManager::setTrackPower(TRACK_MODE trackmodeToMatch, POWERMODE powermod
       driver->setPower(powermode);
     }
   }
-  if (didChange)
-    CommandDistributor::broadcastPower();
+#ifdef CV_CACHE
+  // the loco on the prog track may be changed while it is off
+  if ((trackmodeToMatch & TRACK_MODE_PROG) && powermode==POWERMODE::OFF)
+    CVCache::progTrackOff();
+#endif
+  if (changed) powerChanged(changed);
 }
 
 // Set track power for this track, inependent of mode
@@ -582,8 +1022,7 @@ void TrackManager::setTrackPower(POWERMODE powermode, byte t) {
     }
   }
   driver->setPower(powermode);
-  if (oldpower != driver->getPower())
-    CommandDistributor::broadcastPower();
+  if (oldpower != driver->getPower()) powerChanged(1<<t);
 }
 
 // returns state of the one and only prog track
@@ -643,6 +1082,21 @@ void TrackManager::reportCurrent(Print* stream) {
     StringFormatter::send(stream,F(">\n"));    
 }
 
+#ifdef HAS_ENOUGH_MEMORY
+// <jIH track min max avg ...> per track, oldest summary first
+void TrackManager::reportCurrentHistory(Print* stream, int16_t interval) {
+    if (interval>0 && (uint16_t)interval!=MotorDriver::historyInterval) {
+      MotorDriver::historyInterval=interval;
+      FOR_EACH_TRACK(t) track[t]->clearHistory();
+    }
+    FOR_EACH_TRACK(t) {
+      StringFormatter::send(stream, F("<jIH %c"), t+'A');
+      track[t]->reportHistory(stream);
+      StringFormatter::send(stream, F(">\n"));
+    }
+}
+#endif
+
 void TrackManager::reportGauges(Print* stream) {
     StringFormatter::send(stream,F("<jG"));
     FOR_EACH_TRACK(t) {
@@ -43,6 +43,13 @@ const byte TRACK_NUMBER_7=7, TRACK_NUMBER_H=7;
 const byte TRACK_POWER_0=0, TRACK_POWER_OFF=0;    
 const byte TRACK_POWER_1=1, TRACK_POWER_ON=1;   
 
+// TrackManager::loop checks the overload state of every track in each
+// call, but stops early once this many microseconds have been spent. The
+// remaining tracks are checked first in the next call.
+#ifndef TRACK_CHECK_BUDGET
+#define TRACK_CHECK_BUDGET 500
+#endif
+
 class TrackManager {
   public:
     static void Setup(const FSH * shieldName,
@@ -58,6 +65,17 @@ class TrackManager {
     
     static void setDCCSignal( bool on);
     static void setPROGSignal( bool on);
+#ifdef SIGNAL_DMA
+    // the word the DMA writes to the first MAIN port for a MAIN level
+    static inline uint32_t signalDMAWord(bool on) {
+      return mainSignalPortCount ? signalPorts[0].word[on] : 0;
+    }
+#endif
+#ifdef DCC_DISTRICTS
+    // MAIN tracks in district 1 follow setDCCSignal, the others this
+    static void setDistrictSignal(byte stream, bool on);
+    static bool setTrackDistrict(byte t, int16_t district);
+#endif
     static void setDCSignal(int16_t cab, byte speedbyte);
     static MotorDriver * getProgDriver();
 #ifdef ARDUINO_ARCH_ESP32
@@ -88,8 +106,23 @@ class TrackManager {
     static void sampleCurrent();
     static void reportGauges(Print* stream);
     static void reportCurrent(Print* stream);
+#ifdef HAS_ENOUGH_MEMORY
+    static void reportCurrentHistory(Print* stream, int16_t interval=0);
+#endif
     static void reportObsoleteCurrent(Print* stream); 
+    static void showCheckStats(bool reset);  // <D OVERLOAD [RESET]>
+#ifdef FAST_REVERSER
+    static void checkReversers();  // from the DCC interrupt, loop on ESP32
+    static void showReverserStats(bool reset);  // <D REVERSER [RESET]>
+#endif
     static void streamTrackState(Print* stream, byte t);
+    static void streamTrackStates(Print* stream); // all tracks, the <=> reply
+    static uint16_t stateGeneration; // changed when a track mode or DC address is sent
+    // Track state broadcasts between these are held back and then only
+    // the tracks that differ from what clients last got are sent, with 
+    // one power report. endTrackChanges returns the tracks it sent.
+    static void beginTrackChanges();
+    static byte endTrackChanges();
     static bool isPowerOn(byte t);
     static bool isProg(byte t);
     static TRACK_MODE getMode(byte t);
@@ -109,13 +142,59 @@ class TrackManager {
 
   private:
     static void addTrack(byte t, MotorDriver* driver);
+    static bool parseEqualSign2(Print * stream,  int16_t params, int16_t p[]);
+    static bool changeTrackMode(byte track, TRACK_MODE mode, int16_t DCaddr, bool offAtChange);
+    static void powerChanged(byte tracks);
+    static byte trackChangeDepth;
+    static byte trackStateDirty;  // tracks to compare with what was sent
+    static byte trackPowerDirty;  // tracks whose power was changed
+    static TRACK_MODE sentMode[MAX_TRACKS];   // as last broadcast
+    static int16_t sentDCAddr[MAX_TRACKS];
+    static POWERMODE sentPower[MAX_TRACKS];
     static int8_t lastTrack;
     static byte nextCycleTrack;
+    static unsigned long lastSweepStart; // micros() when the last round of checks started
+    static unsigned long maxSweepTime;   // longest time between two rounds, worst case reaction
     static void applyDCSpeed(byte t);
+    static void applyDCSignal(byte t, byte speedbyte);
+#ifdef DC_KICKSTART
+    static bool dcKicking; // some track is in a kick-start
+    static void endDCKicks();
+#endif
 
     static int16_t trackDCAddr[MAX_TRACKS];  // dc address if TRACK_MODE_DC
+#ifdef FAST_REVERSER
+    static void updateReversers();
+    static volatile byte reverserTracks;  // tracks checked by checkReversers
+    static byte reverserNext;
+    static uint16_t reverserTick;
+#endif
 #ifdef ARDUINO_ARCH_ESP32
     static byte tempProgTrack; // holds the prog track number during join
+#endif
+#ifdef SIGNAL_PORT_MASKS
+    static void buildSignalPorts();
+    static SIGNAL_PORT signalPorts[2*MAX_TRACKS]; // MAIN ports then PROG ports
+    static byte mainSignalPortCount;
+    static byte progSignalPortCount;
+    static bool signalPWM; // HA mode, set the tracks one by one
+#endif
+#ifdef SIGNAL_COMPARE
+    static SIGNAL_OCR signalCompare[2*MAX_TRACKS]; // MAIN then PROG, HA mode
+    static byte mainSignalCompareCount;
+    static byte progSignalCompareCount;
+#endif
+#ifdef DCC_DISTRICTS
+    static byte trackDistrict[MAX_TRACKS]; // MAIN stream, district-1
+#ifdef SIGNAL_PORT_MASKS
+    // ports of the districts from 2 up, after the PROG ports
+    static byte districtPortFirst[DCC_DISTRICTS];
+    static byte districtPortCount[DCC_DISTRICTS];
+#endif
+#ifdef SIGNAL_COMPARE
+    static byte districtCompareFirst[DCC_DISTRICTS];
+    static byte districtCompareCount[DCC_DISTRICTS];
+#endif
 #endif
     };
 
@@ -43,17 +43,39 @@
    */ 
 
   /* static */ Turnout *Turnout::_firstTurnout = 0;
+  /* static */ Turnout **Turnout::_index = 0;
+  /* static */ uint16_t Turnout::_indexSize = 0;
+  /* static */ uint16_t Turnout::_indexCapacity = 0;
+  /* static */ bool Turnout::_indexValid = true;
 
   /* 
    * Public static data
    */
   /* static */ int Turnout::turnoutlistHash = 0;
+  /* static */ uint16_t Turnout::stateGeneration = 0;
  
   /*
    * Protected static functions
    */
 
+  // Binary search of the index for the position of the first turnout with an 
+  // id not less than the one given.
+  /* static */ uint16_t Turnout::indexPosition(uint16_t id) {
+    uint16_t low = 0, high = _indexSize;
+    while (low < high) {
+      uint16_t mid = (low + high) / 2;
+      if (_index[mid]->_turnoutData.id < id) low = mid + 1;
+      else high = mid;
+    }
+    return low;
+  }
+
   /* static */ Turnout *Turnout::get(uint16_t id) {
+    if (_indexValid) {
+      uint16_t pos = indexPosition(id);
+      if (pos < _indexSize && _index[pos]->_turnoutData.id == id) return _index[pos];
+      return NULL;
+    }
     // Find turnout object from list.
     for (Turnout *tt = _firstTurnout; tt != NULL; tt = tt->_nextTurnout)
       if (tt->_turnoutData.id == id) return tt;
@@ -72,7 +94,107 @@
       ptr->_nextTurnout = tt;
     }
     turnoutlistHash++;
+
+    // Insert into the index, growing it a few entries at a time.
+    if (!_indexValid) return;
+    if (_indexSize == _indexCapacity) {
+      Turnout **index = (Turnout **)realloc(_index, (_indexCapacity + 8) * sizeof(Turnout *));
+      if (!index) {
+        free(_index);
+        _index = NULL;
+        _indexSize = _indexCapacity = 0;
+        _indexValid = false;
+        return;
+      }
+      _index = index;
+      _indexCapacity += 8;
+    }
+    uint16_t pos = indexPosition(tt->_turnoutData.id);
+    memmove(&_index[pos+1], &_index[pos], (_indexSize - pos) * sizeof(Turnout *));
+    _index[pos] = tt;
+    _indexSize++;
+  }
+
+#ifdef TURNOUT_PACING
+  // Throws waiting for their power group to recharge, oldest first.
+  struct PacedThrow {
+    Turnout *tt;
+    bool close;
+  };
+  static PacedThrow paceQueue[TURNOUT_PACING_QUEUE];
+  static byte paceCount = 0;
+  // Time each firing slot is free again, the DCC group's slots first.
+  static unsigned long slotFree[TURNOUT_DCC_CONCURRENT + TURNOUT_VPIN_CONCURRENT] = {0};
+  static const byte slotFirst[] = {0, TURNOUT_DCC_CONCURRENT,
+                                   TURNOUT_DCC_CONCURRENT + TURNOUT_VPIN_CONCURRENT};
+  static const uint16_t slotRecharge[] = {TURNOUT_DCC_RECHARGE, TURNOUT_VPIN_RECHARGE};
+
+  // Actuate now if a slot in the turnout's power group has recharged.
+  /* static */ bool Turnout::fire(Turnout *tt, bool close) {
+    byte group = tt->powerGroup();
+    unsigned long now = millis();
+    for (byte s = slotFirst[group]; s < slotFirst[group+1]; s++) {
+      if ((long)(now - slotFree[s]) < 0) continue;
+      slotFree[s] = now + slotRecharge[group];
+      tt->actuate(close);
+      return true;
+    }
+    return false;
+  }
+
+  /* static */ byte Turnout::pacedIndex(Turnout *tt) {
+    byte i = 0;
+    while (i < paceCount && paceQueue[i].tt != tt) i++;
+    return i;
+  }
+
+  /* static */ bool Turnout::pacePending(Turnout *tt) {
+    return pacedIndex(tt) < paceCount;
+  }
+
+  // Called by setClosedInternal in place of actuate().
+  /* static */ bool Turnout::pace(Turnout *tt, bool close) {
+    byte i = pacedIndex(tt);
+    if (i < paceCount) {
+      // Still waiting, so just change the way it will go.
+      paceQueue[i].close = close;
+      return true;
+    }
+    byte group = tt->powerGroup();
+    bool groupWaiting = false;
+    for (i = 0; i < paceCount; i++)
+      if (paceQueue[i].tt->powerGroup() == group) groupWaiting = true;
+    if (!groupWaiting && fire(tt, close)) return true;
+    if (paceCount == TURNOUT_PACING_QUEUE) {
+      // Better to risk the CDU than leave a turnout set wrong under a train.
+      tt->actuate(close);
+      return true;
+    }
+    paceQueue[paceCount].tt = tt;
+    paceQueue[paceCount].close = close;
+    paceCount++;
+    return true;
+  }
+
+  /* static */ void Turnout::paceLoop() {
+    byte blocked = 0;  // groups with an earlier throw still waiting
+    for (byte i = 0; i < paceCount; i++) {
+      PacedThrow p = paceQueue[i];
+      byte groupBit = 1 << p.tt->powerGroup();
+      if ((blocked & groupBit) || !fire(p.tt, p.close)) {
+        blocked |= groupBit;
+        continue;
+      }
+      paceCount--;
+      memmove(&paceQueue[i], &paceQueue[i+1], (paceCount - i) * sizeof(PacedThrow));
+      // One per call, as the event may queue more throws.
+#if defined(EXRAIL_ACTIVE)
+      RMFT2::turnoutEvent(p.tt->getId(), p.close);
+#endif
+      return;
+    }
   }
+#endif
   
   
 
@@ -88,6 +210,20 @@
     else
       pp->_nextTurnout = tt->_nextTurnout;
 
+    if (_indexValid) {
+      uint16_t pos = indexPosition(id);
+      _indexSize--;
+      memmove(&_index[pos], &_index[pos+1], (_indexSize - pos) * sizeof(Turnout *));
+    }
+
+#ifdef TURNOUT_PACING
+    byte i = pacedIndex(tt);
+    if (i < paceCount) {
+      paceCount--;
+      memmove(&paceQueue[i], &paceQueue[i+1], (paceCount - i) * sizeof(PacedThrow));
+    }
+#endif
+
     delete (ServoTurnout *)tt;
 
     turnoutlistHash++;
@@ -115,14 +251,41 @@
     // really has been a change.
     if (tt->_turnoutData.closed != closeFlag) {
       tt->_turnoutData.closed = closeFlag;
+      stateGeneration++;
       CommandDistributor::broadcastTurnout(id, closeFlag);
     }
 #if defined(EXRAIL_ACTIVE)
+#ifdef TURNOUT_PACING
+    // A paced throw still waiting sends its event when it fires.
+    if (!pacePending(tt))
+#endif
     RMFT2::turnoutEvent(id, closeFlag);
 #endif
     return true;
   }
 
+  // Send <jTS list generation [states]>, where states has one hex digit for each 
+  //  four visible turnouts in <JT> order, most significant bit first, with the
+  //  bit set for thrown.  The list and generation values let a client that holds
+  //  the complete state ask again and just be told nothing has changed.
+  /* static */ void Turnout::printStates(Print *stream, bool sendBits) {
+    StringFormatter::send(stream, F("<jTS %d %u"), turnoutlistHash, stateGeneration);
+    if (sendBits) {
+      StringFormatter::send(stream, F(" "));
+      byte nibble = 0, bits = 0;
+      for (Turnout *tt = _firstTurnout; tt != 0; tt = tt->_nextTurnout) {
+        if (tt->isHidden()) continue;
+        nibble = (nibble << 1) | tt->isThrown();
+        if (++bits == 4) {
+          StringFormatter::send(stream, F("%x"), nibble);
+          nibble = bits = 0;
+        }
+      }
+      if (bits) StringFormatter::send(stream, F("%x"), nibble << (4-bits));
+    }
+    StringFormatter::send(stream, F(">\n"));
+  }
+
   // Static setClosed function is invoked from close(), throw() etc. to perform the 
   //  common parts of the turnout operation.  Code which is specific to a turnout
   //  type should be placed in the virtual function setClosedInternal(bool) which is
@@ -141,7 +304,7 @@
       // Write byte containing new closed/thrown state to EEPROM if required.  Note that eepromAddress
       // is always zero for LCN turnouts.
       if (EEStore::eeStore->data.nTurnouts > 0 && tt->_eepromAddress > 0) 
-        EEPROM.put(tt->_eepromAddress, tt->_turnoutData.flags);
+        EEStore::update(tt->_eepromAddress, tt->_turnoutData.flags);
 #endif
     }
     return ok;
@@ -376,6 +539,15 @@
   }
 
   bool DCCTurnout::setClosedInternal(bool close) {
+#ifdef TURNOUT_PACING
+    return pace(this, close);
+#else
+    actuate(close);
+    return true;
+#endif
+  }
+
+  void DCCTurnout::actuate(bool close) {
     // DCC++ Classic behaviour is that Throw writes a 1 in the packet,
     // and Close writes a 0.  
     // RCN-213 specifies that Throw is 0 and Close is 1.
@@ -383,7 +555,6 @@
     close = !close;
 #endif
     DCC::setAccessory(_dccTurnoutData.address, _dccTurnoutData.subAddress, close);
-    return true;
   }
 
   void DCCTurnout::save() {
@@ -457,8 +628,16 @@
   }
 
   bool VpinTurnout::setClosedInternal(bool close) {
-    IODevice::write(_vpinTurnoutData.vpin, close);
+#ifdef TURNOUT_PACING
+    return pace(this, close);
+#else
+    actuate(close);
     return true;
+#endif
+  }
+
+  void VpinTurnout::actuate(bool close) {
+    IODevice::write(_vpinTurnoutData.vpin, close);
   }
 
   void VpinTurnout::save() {
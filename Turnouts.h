@@ -28,6 +28,7 @@
 
 //#define EESTOREDEBUG 
 #include "Arduino.h"
+#include "defines.h"
 #include "IODevice.h"
 #include "StringFormatter.h"
 
@@ -39,6 +40,34 @@ enum {
   TURNOUT_LCN = 4,
 };
 
+// With TURNOUT_PACING defined in config.h, DCC and VPIN turnouts are
+// thrown through a queue so that a route does not fire every solenoid
+// at once and brown out the CDU. Each power group allows CONCURRENT
+// throws per RECHARGE ms; requests beyond that wait in the queue and
+// are fired by Turnout::paceLoop() at the fastest rate that allows.
+// The turnout state changes at once, but EXRAIL ONTHROW/ONCLOSE run
+// when the throw is actually sent. About 60 bytes of RAM on a Mega.
+#if defined(TURNOUT_PACING) && !defined(HAS_ENOUGH_MEMORY)
+  #undef TURNOUT_PACING
+#endif
+#ifdef TURNOUT_PACING
+  #ifndef TURNOUT_DCC_CONCURRENT
+    #define TURNOUT_DCC_CONCURRENT 1
+  #endif
+  #ifndef TURNOUT_DCC_RECHARGE
+    #define TURNOUT_DCC_RECHARGE 250
+  #endif
+  #ifndef TURNOUT_VPIN_CONCURRENT
+    #define TURNOUT_VPIN_CONCURRENT 1
+  #endif
+  #ifndef TURNOUT_VPIN_RECHARGE
+    #define TURNOUT_VPIN_RECHARGE 250
+  #endif
+  #ifndef TURNOUT_PACING_QUEUE
+    #define TURNOUT_PACING_QUEUE 16
+  #endif
+#endif
+
 /*************************************************************************************
  * Turnout - Base class for turnouts.
  * 
@@ -97,12 +126,27 @@ protected:
   static Turnout *_firstTurnout;
   static int _turnoutlistHash;
 
+  // Turnouts in ascending order of id, kept up to date by add() and remove().
+  // If memory for it runs out, it's dropped and lookups search the list.
+  static Turnout **_index;
+  static uint16_t _indexSize;
+  static uint16_t _indexCapacity;
+  static bool _indexValid;
+
   /* 
    * Virtual functions
    */
 
   virtual bool setClosedInternal(bool close) = 0;  // Mandatory in subclass
   virtual void save() {}
+#ifdef TURNOUT_PACING
+  // Power group the turnout is paced in, or NOT_PACED.
+  static const byte NOT_PACED = 255;
+  enum { PACE_DCC, PACE_VPIN, PACE_GROUPS };
+  virtual byte powerGroup() { return NOT_PACED; }
+#endif
+  // Drives the hardware, paced by power group with TURNOUT_PACING.
+  virtual void actuate(bool close) { (void)close; }
   
   /*
    * Static functions
@@ -110,13 +154,21 @@ protected:
 
 
   static void add(Turnout *tt);
+  static uint16_t indexPosition(uint16_t id);
+#ifdef TURNOUT_PACING
+  static bool pace(Turnout *tt, bool close);
+  static bool fire(Turnout *tt, bool close);
+  static byte pacedIndex(Turnout *tt);
+  static bool pacePending(Turnout *tt);
+#endif
   
 public:
   static Turnout *get(uint16_t id);
   /* 
    * Static data
    */
-  static int turnoutlistHash;
+  static int turnoutlistHash;   // changed when turnouts are added, removed or hidden
+  static uint16_t stateGeneration;  // changed when any turnout is thrown or closed
   static const bool useClassicTurnoutCommands;
   
   /*
@@ -125,7 +177,7 @@ public:
   inline bool isClosed() { return _turnoutData.closed; };
   inline bool isThrown() { return !_turnoutData.closed; }
   inline bool isHidden() { return _turnoutData.hidden; }
-  inline void setHidden(bool h) { _turnoutData.hidden=h; }
+  inline void setHidden(bool h) { _turnoutData.hidden=h; turnoutlistHash++; }
   inline bool isType(uint8_t type) { return _turnoutData.turnoutType == type; }
   inline uint16_t getId() { return _turnoutData.id; }
   inline Turnout *next() { return _nextTurnout; }
@@ -182,7 +234,11 @@ public:
       }
     return gotOne;
   }
-
+  static void printStates(Print *stream, bool sendBits);
+#ifdef TURNOUT_PACING
+  // Fire queued throws as power groups recharge, called from loop().
+  static void paceLoop();
+#endif
 
 };
 
@@ -248,7 +304,11 @@ public:
 
 protected:
   bool setClosedInternal(bool close) override;
+  void actuate(bool close) override;
   void save() override;
+#ifdef TURNOUT_PACING
+  byte powerGroup() override { return PACE_DCC; }
+#endif
 
 };
 
@@ -278,7 +338,11 @@ public:
 
 protected:
   bool setClosedInternal(bool close) override;
+  void actuate(bool close) override;
   void save() override;
+#ifdef TURNOUT_PACING
+  byte powerGroup() override { return PACE_VPIN; }
+#endif
 
 };
 
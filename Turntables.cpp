@@ -64,37 +64,19 @@ void Turntable::addPosition(uint8_t idx, uint16_t value, uint16_t angle) {
 
 // Get value for position
 uint16_t Turntable::getPositionValue(uint8_t position) {
-  TurntablePosition* currentPosition = _turntablePositions.getHead();
-  while (currentPosition) {
-    if (currentPosition->index == position) {
-      return currentPosition->data;
-    }
-    currentPosition = currentPosition->next;
-  }
-  return false;
+  TurntablePosition* currentPosition = _turntablePositions.get(position);
+  return currentPosition ? currentPosition->data : false;
 }
 
 // Get value for position
 uint16_t Turntable::getPositionAngle(uint8_t position) {
-  TurntablePosition* currentPosition = _turntablePositions.getHead();
-  while (currentPosition) {
-    if (currentPosition->index == position) {
-      return currentPosition->angle;
-    }
-    currentPosition = currentPosition->next;
-  }
-  return false;
+  TurntablePosition* currentPosition = _turntablePositions.get(position);
+  return currentPosition ? currentPosition->angle : false;
 }
 
 // Get the count of positions associated with the turntable
 uint8_t Turntable::getPositionCount()  {
-  TurntablePosition* currentPosition = _turntablePositions.getHead();
-  uint8_t count = 0;
-  while (currentPosition) {
-    count++;
-    currentPosition = currentPosition->next;
-  }
-  return count;
+  return _turntablePositions.getCount();
 }
 
 /*
@@ -44,32 +44,56 @@ struct TurntablePosition {
   uint8_t index;
   uint16_t data;
   uint16_t angle;
-  TurntablePosition* next;
-  
-  TurntablePosition(uint8_t idx, uint16_t value, uint16_t angle) : index(idx), data(value), angle(angle), next(nullptr) {}
 };
 
+// Positions are held in an array in ascending order of index, so that a 
+// position is found by binary search.  Adding an index that's already
+// there replaces it.
 class TurntablePositionList {
 public:
-  TurntablePositionList() : head(nullptr) {}
+  TurntablePositionList() : positions(nullptr), count(0), capacity(0) {}
 
   void insert(uint8_t idx, uint16_t value, uint16_t angle) {
-    TurntablePosition* newPosition = new TurntablePosition(idx, value, angle);
-    if(!head) {
-      head = newPosition;
-    } else {
-      newPosition->next = head;
-      head = newPosition;
+    uint8_t pos = find(idx);
+    if (pos >= count || positions[pos].index != idx) {
+      if (count == capacity) {
+        TurntablePosition *p = (TurntablePosition *)realloc(positions, (capacity + 4) * sizeof(TurntablePosition));
+        if (!p) return;
+        positions = p;
+        capacity += 4;
+      }
+      memmove(&positions[pos+1], &positions[pos], (count - pos) * sizeof(TurntablePosition));
+      count++;
     }
+    positions[pos].index = idx;
+    positions[pos].data = value;
+    positions[pos].angle = angle;
   }
 
-  TurntablePosition* getHead() {
-    return head;
+  // Returns the position with the given index, or nullptr if not defined
+  TurntablePosition* get(uint8_t idx) {
+    uint8_t pos = find(idx);
+    if (pos < count && positions[pos].index == idx) return &positions[pos];
+    return nullptr;
   }
 
+  uint8_t getCount() { return count; }
+
 private:
-  TurntablePosition* head;
+  // Binary search for the first position with an index not less than idx
+  uint8_t find(uint8_t idx) {
+    uint8_t low = 0, high = count;
+    while (low < high) {
+      uint8_t mid = (low + high) / 2;
+      if (positions[mid].index < idx) low = mid + 1;
+      else high = mid;
+    }
+    return low;
+  }
 
+  TurntablePosition* positions;
+  uint8_t count;
+  uint8_t capacity;
 };
 
 
@@ -100,7 +124,7 @@ protected:
   // Pointer to next turntable object
   Turntable *_nextTurntable = 0;
 
-  // Linked list for positions
+  // Table of positions
   TurntablePositionList _turntablePositions;
   
   // Store the previous position to allow checking for changes
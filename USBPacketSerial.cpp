@@ -0,0 +1,62 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "defines.h"
+#ifdef USB_PACKETS
+#include "USBPacketSerial.h"
+
+USBPacketSerial usbSerial;
+
+size_t USBPacketSerial::write(uint8_t b) {
+  packet[length++]=b;
+  if (b=='\n' || length==USB_PACKET_SIZE) flush();
+  return 1;
+}
+
+size_t USBPacketSerial::write(const uint8_t * buffer, size_t size) {
+  // ends of line inside the buffer need not split the packets,
+  // only the last one matters for promptness.
+  bool lineEnd=size && buffer[size-1]=='\n';
+  for (size_t done=0; done<size;) {
+    size_t chunk=USB_PACKET_SIZE-length;
+    if (chunk>size-done) chunk=size-done;
+    memcpy(packet+length, buffer+done, chunk);
+    length+=chunk;
+    done+=chunk;
+    if (length==USB_PACKET_SIZE) flush();
+  }
+  if (lineEnd) flush();
+  return size;
+}
+
+int USBPacketSerial::availableForWrite() {
+  // SerialManager queues broadcasts by this, the staged bytes are
+  // already spoken for.
+  int room=USB_SERIAL_PORT.availableForWrite()-length;
+  return room>0 ? room : 0;
+}
+
+void USBPacketSerial::flush() {
+  if (length==0) return;
+  USB_SERIAL_PORT.write(packet, length);
+  length=0;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef USBPacketSerial_h
+#define USBPacketSerial_h
+#include <Arduino.h>
+
+// Included by defines.h when USB_PACKETS is defined, USB_SERIAL is then
+// the usbSerial wrapper around the core CDC port USB_SERIAL_PORT.
+// Output is staged into a full speed bulk packet and written to the
+// port in one call when the packet is full, at the end of each line
+// (so each reply or broadcast goes promptly) and from flush(), which
+// the loop calls once per pass for anything without a line end yet.
+// Input is read straight from the port.
+#ifdef USB_PACKETS
+#ifndef USB_PACKET_SIZE
+  #define USB_PACKET_SIZE 64
+#endif
+
+class USBPacketSerial : public Stream {
+public:
+  void begin(unsigned long baud) { USB_SERIAL_PORT.begin(baud); }
+  operator bool() { return (bool)USB_SERIAL_PORT; }
+
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t * buffer, size_t size) override;
+  using Print::write;
+  int availableForWrite() override;
+  void flush() override;
+
+  int available() override { return USB_SERIAL_PORT.available(); }
+  int read() override { return USB_SERIAL_PORT.read(); }
+  int peek() override { return USB_SERIAL_PORT.peek(); }
+
+private:
+  uint8_t packet[USB_PACKET_SIZE];
+  uint8_t length=0;
+};
+
+extern USBPacketSerial usbSerial;
+
+#endif
+#endif
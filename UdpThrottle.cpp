@@ -0,0 +1,140 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "UdpThrottle.h"
+#ifdef UDP_THROTTLE_ON
+#if defined(ARDUINO_ARCH_ESP32)
+#include <WiFi.h>
+#include <WiFiUdp.h>
+static WiFiUDP udp;
+#else
+#include "EthernetInterface.h"
+#if defined(STM32_ETHERNET)
+#include <EthernetUdp.h>
+#endif
+static EthernetUDP udp;
+#endif
+#include "DCCEXParser.h"
+#include "CommandTokenizer.h"
+#include "StringBuffer.h"
+#include "StringFormatter.h"
+#include "DCC.h"
+#include "DIAG.h"
+
+UdpThrottle::SENDER UdpThrottle::senders[MAX_SENDERS];
+
+void UdpThrottle::setup() {
+  udp.begin(UDP_THROTTLE_PORT);
+  DIAG(F("UDP throttle port %d"), UDP_THROTTLE_PORT);
+}
+
+void UdpThrottle::loop() {
+  // a few datagrams per call so a flood can not hold up the loop
+  for (byte n=0; n<4; n++) {
+    if (udp.parsePacket()<=0) return;
+    byte buffer[MAX_DATAGRAM+1];
+    int length=udp.read(buffer, MAX_DATAGRAM);
+    if (length<=0) continue;
+    buffer[length]='\0';
+
+    byte * c=buffer;
+    uint16_t seq=0;
+    while (*c>='0' && *c<='9') seq=seq*10+(*c++ - '0');
+    if (c==buffer) continue; // no seq, not for us
+    if (!fresh((uint32_t)udp.remoteIP(), udp.remotePort(), seq)) continue; // stale
+
+    int16_t cab=0;
+    bool ok=execute(c, cab);
+    int16_t slot= ok ? DCC::lookupSpeedTable(cab, false) : -1;
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    if (!ok) StringFormatter::send(&udp, F("%d <X>\n"), seq);
+    else if (slot<0) StringFormatter::send(&udp, F("%d <O>\n"), seq);
+    else StringFormatter::send(&udp, F("%d <l %d %d %d %l>\n"), seq,
+                               cab, slot, DCC::speedTable.speedCode[slot],
+                               (long)DCC::speedTable.functions[slot]);
+    udp.endPacket();
+  }
+}
+
+// true if seq is newer than the last one from this sender
+bool UdpThrottle::fresh(uint32_t ip, uint16_t port, uint16_t seq) {
+  unsigned long now=millis();
+  SENDER * oldest=&senders[0];
+  for (byte i=0; i<MAX_SENDERS; i++) {
+    SENDER * s=&senders[i];
+    if (s->ip==ip && s->port==port) {
+      bool isNew = (int16_t)(seq - s->seq) > 0 || now - s->lastSeen > SENDER_TIMEOUT;
+      if (isNew) {
+        s->seq=seq;
+        s->lastSeen=now;
+      }
+      return isNew;
+    }
+    if (now - s->lastSeen > now - oldest->lastSeen) oldest=s;
+  }
+  // not seen before, take the slot idle longest
+  oldest->ip=ip;
+  oldest->port=port;
+  oldest->seq=seq;
+  oldest->lastSeen=now;
+  return true;
+}
+
+// Split and check the command, then run it through parseSplit
+// like a command from any other throttle.
+bool UdpThrottle::execute(byte * command, int16_t & cab) {
+  while (*command==' ') command++;
+  if (*command!='<') return false;
+  byte * opcodeAt=command+1;
+  byte opcode=*opcodeAt;
+  int16_t p[DCCEXParser::MAX_COMMAND_PARAMS];
+  CommandTokenizer tokenizer;
+  tokenizer.begin(p, false);
+  for (byte * c=opcodeAt+1; ; c++) {
+    CommandTokenizer::RESULT r=tokenizer.feed(*c, c-opcodeAt);
+    if (r==CommandTokenizer::TOKEN_DONE) break;
+    if (r==CommandTokenizer::TOKEN_ERROR) return false;
+  }
+  byte params=tokenizer.count();
+  switch (opcode) {
+  case 't':
+    if (params!=3 && params!=4) return false;
+    cab=p[params-3];
+    break;
+  case 'F':
+    if (params!=3 || p[1]<0 || p[1]>127) return false; // a function, not DCFREQ
+    cab=p[0];
+    break;
+  case '!':
+    if (params!=0) return false;
+    cab=0;
+    break;
+  default:
+    return false;
+  }
+  // the reply to the caller is replaced by the state datagram,
+  // anything written is only looked at for the <X> of a refusal
+  static StringBuffer reply;
+  reply.flush();
+  byte com[2]={opcode,'\0'};
+  DCCEXParser::parseSplit(&reply, com, p, params, NULL);
+  char * r=reply.getString();
+  return !(r[0]=='<' && r[1]=='X');
+}
+#endif
@@ -0,0 +1,59 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef UdpThrottle_h
+#define UdpThrottle_h
+#include <Arduino.h>
+#include "defines.h"
+
+// Low latency throttle channel over UDP, compiled in when
+// UDP_THROTTLE_PORT is defined in config.h on ESP32 or Ethernet builds.
+//
+// A datagram is "seq <command>", seq being a number from 0 to 65535 the
+// sender increments for each datagram. Only commands that set absolute
+// state are accepted, so a lost datagram is made good by the next one:
+//   <t cab speed dir>  <t reg cab speed dir>  <F cab fn 0|1>  <!>
+// A datagram with a seq older than the latest one from the same sender
+// is dropped. The reply is "seq <l cab slot speedbyte functions>" with the
+// loco state after the command, "seq <O>" if there is no loco to report
+// and "seq <X>" if the command was refused.
+
+#if defined(UDP_THROTTLE_PORT) && (defined(ARDUINO_ARCH_ESP32) || ETHERNET_ON)
+#define UDP_THROTTLE_ON
+
+class UdpThrottle {
+public:
+  static void setup();
+  static void loop();
+private:
+  static const byte MAX_SENDERS=8;
+  static const int MAX_DATAGRAM=48;
+  static const unsigned long SENDER_TIMEOUT=10000; // then any seq is taken (sender restarted)
+  struct SENDER {
+    uint32_t ip;
+    uint16_t port;
+    uint16_t seq;
+    unsigned long lastSeen;
+  };
+  static SENDER senders[MAX_SENDERS];
+  static bool fresh(uint32_t ip, uint16_t port, uint16_t seq);
+  static bool execute(byte * command, int16_t & cab);
+};
+#endif
+#endif
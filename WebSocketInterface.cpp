@@ -21,6 +21,22 @@ AsyncWebSocket* WebSocketInterface::ws = nullptr;
 bool WebSocketInterface::enabled = false;
 uint8_t WebSocketInterface::clientCount = 0;
 
+// Start of a command cut off by the end of a frame (or of the part of
+// a frame received so far), kept until the rest arrives.
+struct WebSocketCarry {
+    uint32_t id;
+    uint8_t length;   // 0 when the slot is free
+    char buffer[WS_COMMAND_BUFFER_SIZE + 1];
+};
+static WebSocketCarry carries[WS_MAX_CLIENTS];
+
+static WebSocketCarry* findCarry(uint32_t id, bool create) {
+    for (auto& c : carries) if (c.length && c.id == id) return &c;
+    if (!create) return nullptr;
+    for (auto& c : carries) if (!c.length) { c.id = id; return &c; }
+    return nullptr;
+}
+
 // Response stream that captures output and sends to WebSocket client
 class WebSocketPrint : public Print {
 public:
@@ -31,8 +47,9 @@ public:
     size_t write(uint8_t c) override {
         if (pos < sizeof(buffer) - 1) {
             buffer[pos++] = c;
-            // Send on newline or buffer full
-            if (c == '\n' || pos >= sizeof(buffer) - 2) {
+            // Send when full, otherwise all the replies to one
+            // frame go back together at the final flush()
+            if (pos >= sizeof(buffer) - 2) {
                 flush();
             }
         }
@@ -118,9 +135,9 @@ void WebSocketInterface::loop() {
     }
 }
 
-void WebSocketInterface::broadcast(const char* message) {
+void WebSocketInterface::broadcast(const char* message, size_t length) {
     if (enabled && ws && clientCount > 0) {
-        ws->textAll(message);
+        ws->textAll(message, length);
     }
 }
 
@@ -151,11 +168,15 @@ void WebSocketInterface::onWebSocketEvent(AsyncWebSocket* server,
             
         case WS_EVT_DISCONNECT:
             if (clientCount > 0) clientCount--;
+            {
+                WebSocketCarry* carry = findCarry(client->id(), false);
+                if (carry) carry->length = 0;
+            }
             DIAG(F("WebSocket: Client #%u disconnected"), client->id());
             break;
             
         case WS_EVT_DATA:
-            handleCommand(client, data, len);
+            handleData(client, (AwsFrameInfo*)arg, data, len);
             break;
             
         case WS_EVT_PONG:
@@ -168,16 +189,66 @@ void WebSocketInterface::onWebSocketEvent(AsyncWebSocket* server,
     }
 }
 
-void WebSocketInterface::handleCommand(AsyncWebSocketClient* client, uint8_t* data, size_t len) {
-    if (len == 0 || len > WS_COMMAND_BUFFER_SIZE) return;
-    
-    // Null-terminate the command
-    char command[WS_COMMAND_BUFFER_SIZE + 1];
-    memcpy(command, data, len);
-    command[len] = '\0';
-    
+// Called for each frame, or part of a frame, with the data already
+// unmasked by AsyncWebSocket. The complete commands in it are parsed
+// where they are, a frame may hold any number of them. Only a command
+// split between frames (or fragments) is copied, into its client's carry.
+void WebSocketInterface::handleData(AsyncWebSocketClient* client, AwsFrameInfo* info, uint8_t* data, size_t len) {
+    bool messageEnd = info->final && (info->index + len == info->len);
+    WebSocketPrint wsPrint(client);
+    size_t start = 0;
+
+    WebSocketCarry* carry = findCarry(client->id(), false);
+    if (carry) {
+        // finish the carried command with the data up to its '>'
+        while (start < len && data[start] != '>') start++;
+        bool complete = start < len;
+        if (complete) start++;
+        if (carry->length + start > WS_COMMAND_BUFFER_SIZE) {
+            DIAG(F("WebSocket: command from #%u too long"), client->id());
+            carry->length = 0;
+        } else {
+            memcpy(carry->buffer + carry->length, data, start);
+            carry->length += start;
+            if (complete || messageEnd) {
+                carry->buffer[carry->length] = '\0';
+                parseCommand(&wsPrint, client, carry->buffer);
+                carry->length = 0;
+            }
+        }
+    }
+
+    // everything up to the last '>' is made of complete commands
+    size_t end = len;
+    while (end > start && data[end - 1] != '>') end--;
+    if (end > start) {
+        data[end - 1] = '\0';  // the parser takes the end of string as '>'
+        parseCommand(&wsPrint, client, (char*)data + start);
+    }
+    else end = start;
+
+    // whatever follows waits for the next frame, unless this is the end
+    size_t tail = len - end;
+    if (tail > 0) {
+        if (tail > WS_COMMAND_BUFFER_SIZE) {
+            DIAG(F("WebSocket: command from #%u too long"), client->id());
+        } else if ((carry = findCarry(client->id(), true))) {
+            memcpy(carry->buffer, data + end, tail);
+            carry->length = tail;
+            if (messageEnd) {
+                carry->buffer[tail] = '\0';
+                parseCommand(&wsPrint, client, carry->buffer);
+                carry->length = 0;
+            }
+        }
+    }
+
+    // Flush any remaining output
+    wsPrint.flush();
+}
+
+void WebSocketInterface::parseCommand(Print* stream, AsyncWebSocketClient* client, char* cmd) {
     // Trim whitespace
-    char* cmd = command;
     while (*cmd == ' ' || *cmd == '\n' || *cmd == '\r') cmd++;
     size_t cmdLen = strlen(cmd);
     while (cmdLen > 0 && (cmd[cmdLen-1] == ' ' || cmd[cmdLen-1] == '\n' || cmd[cmdLen-1] == '\r')) {
@@ -186,25 +257,18 @@ void WebSocketInterface::handleCommand(AsyncWebSocketClient* client, uint8_t* da
     
     if (cmdLen == 0) return;
     
-    DIAG(F("WebSocket: CMD from #%u: %s"), client->id(), cmd);
-    
-    // Create a Print stream that sends responses back to this WebSocket client
-    WebSocketPrint wsPrint(client);
+    DIAGLOG(Diag::CMD, F("WebSocket: CMD from #%u: %s"), client->id(), cmd);
     
     // Check if it looks like a DCC-EX command (starts with <)
     if (cmd[0] == '<') {
         // Parse as DCC-EX native command
-        // The command includes the < > brackets
-        DCCEXParser::parse(&wsPrint, (byte*)cmd, nullptr);
+        DCCEXParser::parse(stream, (byte*)cmd, nullptr);
     } else {
         // Try parsing without brackets (user convenience)
         char bracketedCmd[WS_COMMAND_BUFFER_SIZE + 3];
         snprintf(bracketedCmd, sizeof(bracketedCmd), "<%s>", cmd);
-        DCCEXParser::parse(&wsPrint, (byte*)bracketedCmd, nullptr);
+        DCCEXParser::parse(stream, (byte*)bracketedCmd, nullptr);
     }
-    
-    // Flush any remaining output
-    wsPrint.flush();
 }
 
 void WebSocketInterface::sendResponse(AsyncWebSocketClient* client, const char* response) {
@@ -41,7 +41,7 @@ class WebSocketInterface {
 public:
     static void setup();
     static void loop();
-    static void broadcast(const char* message);
+    static void broadcast(const char* message, size_t length);
     static bool isEnabled();
     
 private:
@@ -51,7 +51,8 @@ private:
                                   void* arg, 
                                   uint8_t* data, 
                                   size_t len);
-    static void handleCommand(AsyncWebSocketClient* client, uint8_t* data, size_t len);
+    static void handleData(AsyncWebSocketClient* client, AwsFrameInfo* info, uint8_t* data, size_t len);
+    static void parseCommand(Print* stream, AsyncWebSocketClient* client, char* cmd);
     static void sendResponse(AsyncWebSocketClient* client, const char* response);
     
     static AsyncWebServer* webServer;
@@ -66,7 +67,7 @@ class WebSocketInterface {
 public:
     static void setup() {}
     static void loop() {}
-    static void broadcast(const char* message) { (void)message; }
+    static void broadcast(const char* message, size_t length) { (void)message; (void)length; }
     static bool isEnabled() { return false; }
 };
 #endif
@@ -58,10 +58,56 @@
 #include "TrackManager.h"
 #include "DCCTimer.h"
 
-#define LOOPLOCOS(THROTTLECHAR, CAB)  for (int loco=0;loco<MAX_MY_LOCO;loco++) \
-      if ((myLocos[loco].throttle==THROTTLECHAR || '*'==THROTTLECHAR) && (CAB<0 || myLocos[loco].cab==CAB))
+// Visits the slots of THROTTLECHAR ('*' for all) holding CAB (-1 for all)
+#define LOOPLOCOS(THROTTLECHAR, CAB)  for (uint16_t slots=locoSlots(THROTTLECHAR), loco=0; slots; slots>>=1, loco++) \
+      if ((slots&1) && (CAB<0 || myLocos[loco].cab==CAB))
 
 WiThrottle * WiThrottle::firstThrottle=NULL;
+byte WiThrottle::cabFilter[CAB_FILTER_BITS/8];
+
+bool WiThrottle::mayBeHeld(int cab) {
+  byte h=cab & (CAB_FILTER_BITS-1);
+  return cabFilter[h>>3] & (1<<(h&7));
+}
+
+void WiThrottle::addToCabFilter(int cab) {
+  byte h=cab & (CAB_FILTER_BITS-1);
+  cabFilter[h>>3] |= 1<<(h&7);
+}
+
+// called when locos are released, acquiring just sets the bit
+void WiThrottle::rebuildCabFilter() {
+  memset(cabFilter,0,sizeof(cabFilter));
+  for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle)
+    for (int loco=0;loco<MAX_MY_LOCO;loco++)
+      if (wt->myLocos[loco].throttle!='\0') addToCabFilter(wt->myLocos[loco].cab);
+}
+
+uint16_t WiThrottle::locoSlots(char throttleChar) {
+  if (throttleChar=='*') return usedSlots;
+  for (byte t=0;t<throttleCount;t++)
+    if (throttleLetter[t]==throttleChar) return throttleSlots[t];
+  return 0;
+}
+
+// called whenever a loco is added to or removed from myLocos
+void WiThrottle::indexLocos() {
+  usedSlots=0;
+  throttleCount=0;
+  for (int loco=0;loco<MAX_MY_LOCO;loco++) {
+    char throttle=myLocos[loco].throttle;
+    if (throttle=='\0') continue;
+    usedSlots |= 1<<loco;
+    byte t=0;
+    while (t<throttleCount && throttleLetter[t]!=throttle) t++;
+    if (t==throttleCount) {
+      throttleLetter[t]=throttle;
+      throttleSlots[t]=0;
+      throttleCount++;
+    }
+    throttleSlots[t] |= 1<<loco;
+  }
+}
 
 WiThrottle* WiThrottle::getThrottle( int wifiClient) {
   for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle)  
@@ -79,6 +125,7 @@ void WiThrottle::forget( byte clientId) {
 }
 
 bool WiThrottle::isThrottleInUse(int cab) {
+  if (!mayBeHeld(cab)) return false;
   for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle)  
      if (wt->areYouUsingThrottle(cab)) return true;
   return false;
@@ -93,27 +140,29 @@ bool WiThrottle::areYouUsingThrottle(int cab) {
  // One instance of WiThrottle per connected client, so we know what the locos are 
  
 WiThrottle::WiThrottle( int wificlientid) {
-   if (Diag::WITHROTTLE) DIAG(F("%l Creating new WiThrottle for client %d"),millis(),wificlientid); 
+   DIAGLOG(Diag::WITHROTTLE, F("%l Creating new WiThrottle for client %d"),millis(),wificlientid); 
    nextThrottle=firstThrottle;
    firstThrottle= this;
    clientid=wificlientid;
    heartBeatEnable=false; // until client turns it on
    mostRecentCab=0;                
+   locosPending=false;
    for (int loco=0;loco<MAX_MY_LOCO; loco++) myLocos[loco].throttle='\0';
+   indexLocos();
 }
 
 WiThrottle::~WiThrottle() {
-  if (Diag::WITHROTTLE) DIAG(F("Deleting WiThrottle client %d"),this->clientid);
+  DIAGLOG(Diag::WITHROTTLE, F("Deleting WiThrottle client %d"),this->clientid);
   if (firstThrottle== this) {
     firstThrottle=this->nextThrottle;
-    return;
   }
-  for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) {
+  else for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) {
     if (wt->nextThrottle==this) {
       wt->nextThrottle=this->nextThrottle;
-      return;  
+      break;  
      }
   }
+  rebuildCabFilter(); // without this client's locos
 }
 
 void WiThrottle::parse(RingStream * stream, byte * cmdx) {
@@ -121,7 +170,7 @@ void WiThrottle::parse(RingStream * stream, byte * cmdx) {
   byte * cmd=cmdx;
   
   heartBeat=millis();
-  if (Diag::WITHROTTLE) DIAG(F("%l WiThrottle(%d)<-[%e]"),millis(),clientid,cmd);
+  DIAGLOG(Diag::WITHROTTLE, F("%l WiThrottle(%d)<-[%e]"),millis(),clientid,cmd);
   
   // On first few commands, send turnout, roster and routes 
   if (introSent) {  
@@ -204,7 +253,7 @@ void WiThrottle::parse(RingStream * stream, byte * cmdx) {
 	  StringFormatter::send(stream, F("M%c-%c%d<;>\n"), myLocos[loco].throttle, LorS(myLocos[loco].cab), myLocos[loco].cab);
 	}
       }
-      if (Diag::WITHROTTLE) DIAG(F("WiThrottle(%d) Quit"),clientid);
+      DIAGLOG(Diag::WITHROTTLE, F("WiThrottle(%d) Quit"),clientid);
       delete this; 
       break;           
     }
@@ -214,7 +263,8 @@ void WiThrottle::parse(RingStream * stream, byte * cmdx) {
   }           
 }
 
-int WiThrottle::getInt(byte * cmd) {
+// end (if given) is set to the first character after the number
+int WiThrottle::getInt(byte * cmd, byte ** end) {
   int i=0;
   bool negate=cmd[0]=='-';
   if (negate) cmd++;
@@ -222,26 +272,37 @@ int WiThrottle::getInt(byte * cmd) {
     i=i*10 + (cmd[0]-'0');
     cmd++;
   }
+  if (end) *end=cmd;
   if (negate) i=0-i;
   return i ;    
 }
 
-int WiThrottle::getLocoId(byte * cmd) {
-    if (cmd[0]=='*') return -1;  // match all locos 
-    if (cmd[0]!='L' && cmd[0]!='S') return 0; // should not match any locos
-    return getInt(cmd+1); 
+int WiThrottle::getLocoId(byte * cmd, byte ** end) {
+    if (cmd[0]=='*') {  // match all locos 
+      if (end) *end=cmd+1;
+      return -1;
+    }
+    if (cmd[0]!='L' && cmd[0]!='S') {  // should not match any locos
+      if (end) *end=cmd;
+      return 0;
+    }
+    return getInt(cmd+1, end); 
 }
 
 void WiThrottle::multithrottle(RingStream * stream, byte * cmd){ 
+  // M<throttle><+-A><L|S|*><cab><;><action> read in one pass
   char throttleChar=cmd[1];
-  int locoid=getLocoId(cmd+3); // -1 for *
+  byte * aval;
+  int locoid=getLocoId(cmd+3, &aval); // -1 for *
   if (locoid > 10239 || locoid < -1) {
     StringFormatter::send(stream, F("No valid DCC loco %d\n"), locoid);
     return;
   }
-  byte * aval=cmd;
-  while(*aval !=';' && *aval !='\0') aval++;
-  if (*aval) aval+=2;  // skip ;>
+  if (aval[0]=='<' && aval[1]==';' && aval[2]=='>') aval+=3;
+  else {
+    while(*aval !=';' && *aval !='\0') aval++;
+    if (*aval) aval+=2;  // skip ;>
+  }
   
   //       DIAG(F("Multithrottle aval=%c cab=%d"), aval[0],locoid);    
   switch(cmd[2]) {
@@ -272,9 +333,11 @@ void WiThrottle::multithrottle(RingStream * stream, byte * cmd){
       if (myLocos[loco].throttle=='\0') {
 	      myLocos[loco].throttle=throttleChar;
 	      myLocos[loco].cab=locoid; 
+	      indexLocos();
 	      myLocos[loco].functionMap=DCC::getFunctionMap(locoid); 
-	      myLocos[loco].broadcastPending=true; // means speed/dir will be sent later
+	      flagBroadcast(loco); // means speed/dir will be sent later
 	      mostRecentCab=locoid;
+	      addToCabFilter(locoid);
 	      StringFormatter::send(stream, F("M%c+%c%d<;>\n"), throttleChar, cmd[3] ,locoid); //tell client to add loco
 	      sendFunctions(stream,loco);
 	      //speed and direction will be published at next broadcast cycle
@@ -289,7 +352,8 @@ void WiThrottle::multithrottle(RingStream * stream, byte * cmd){
       myLocos[loco].throttle='\0';
       StringFormatter::send(stream, F("M%c-%c%d<;>\n"), throttleChar, LorS(myLocos[loco].cab), myLocos[loco].cab);
     }
-    
+    indexLocos();
+    rebuildCabFilter();
     break;
   case 'A':
     locoAction(stream,aval, throttleChar, locoid);
@@ -337,7 +401,7 @@ void WiThrottle::locoAction(RingStream * stream, byte* aval, char throttleChar,
       bool foundone = false;
       LOOPLOCOS(throttleChar, cab) {
 	foundone = true;
-	myLocos[loco].broadcastPending=true;
+	flagBroadcast(loco);
       }
       if (!foundone)
 	StringFormatter::send(stream,F("HMCS loco list empty\n"));
@@ -388,19 +452,37 @@ int WiThrottle::WiTToDCCSpeed(int WiTSpeed) {
   return WiTSpeed + 1; //offset others by 1
 }
 
+bool WiThrottle::anyBroadcastPending=false;
+unsigned long WiThrottle::nextEstopCheck=0;
+
+void WiThrottle::flagBroadcast(byte loco) {
+  myLocos[loco].broadcastPending=true;
+  locosPending=true;
+  anyBroadcastPending=true;
+}
+
 void WiThrottle::loop(RingStream * stream) {
+  // Nothing to do until a broadcast is flagged or the earliest eStop
+  // deadline. nextEstopCheck is never later than the real deadline
+  // because heartbeats only move deadlines on.
+  if (!anyBroadcastPending && (long)(millis()-nextEstopCheck) < 0) return;
+  anyBroadcastPending=false;
+  nextEstopCheck=millis()+ESTOP_SECONDS*1000UL;
   // for each WiThrottle, check the heartbeat and broadcast needed
-  for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) 
+  for (WiThrottle* wt=firstThrottle; wt!=NULL ; ) {
+    WiThrottle* next=wt->nextThrottle; // wt may delete itself
     wt->checkHeartbeat(stream);
+    wt=next;
+  }
 }
 
 void WiThrottle::checkHeartbeat(RingStream * stream) {
   // if eStop time passed... eStop any locos still assigned to this client and then drop the connection
   if(heartBeatEnable && (millis()-heartBeat > ESTOP_SECONDS*1000)) {
-    if (Diag::WITHROTTLE)  DIAG(F("%l WiThrottle(%d) eStop(%ds) timeout, drop connection"), millis(), clientid, ESTOP_SECONDS);
+    DIAGLOG(Diag::WITHROTTLE, F("%l WiThrottle(%d) eStop(%ds) timeout, drop connection"), millis(), clientid, ESTOP_SECONDS);
     LOOPLOCOS('*', -1) { 
       if (myLocos[loco].throttle!='\0') {
-        if (Diag::WITHROTTLE) DIAG(F("%l  eStopping cab %d"),millis(),myLocos[loco].cab);
+        DIAGLOG(Diag::WITHROTTLE, F("%l  eStopping cab %d"),millis(),myLocos[loco].cab);
         DCC::setThrottle(myLocos[loco].cab, 1, DCC::getThrottleDirection(myLocos[loco].cab)); // speed 1 is eStop
 	heartBeat=millis(); // We have just stopped everyting, we don't need to do that again at next loop.
       }
@@ -409,6 +491,12 @@ void WiThrottle::checkHeartbeat(RingStream * stream) {
     delete this;
     return;
   }
+  if (heartBeatEnable) {
+    unsigned long deadline=heartBeat+ESTOP_SECONDS*1000UL+1;
+    if ((long)(deadline-nextEstopCheck) < 0) nextEstopCheck=deadline;
+  }
+  if (!locosPending) return;
+  locosPending=false;
    
    // send any outstanding speed/direction/function changes for this clients locos
    // Changes may have been caused by this client, or another non-Withrottle or Exrail
@@ -450,12 +538,13 @@ void WiThrottle::checkHeartbeat(RingStream * stream) {
 }
 
 void WiThrottle::markForBroadcast(int cab) {
+  if (!mayBeHeld(cab)) return;
   for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) 
       wt->markForBroadcast2(cab);
 }
 void WiThrottle::markForBroadcast2(int cab) {
   LOOPLOCOS('*', cab) { 
-    myLocos[loco].broadcastPending=true;
+    flagBroadcast(loco);
   }
 }
 
@@ -529,7 +618,7 @@ void WiThrottle::sendTurnouts(Print* stream) {
           #ifdef EXRAIL_ACTIVE
           tdesc=RMFT2::getTurnoutDescription(id);
           #endif
-          char tchar=Turnout::isClosed(id)?'2':'4';
+          char tchar=tt->isClosed()?'2':'4';
           if (tdesc==NULL) // turnout with no description
               StringFormatter::send(stream,F("]\\[%d}|{T%d}|{T%c"), id,id,tchar);
 	        else 
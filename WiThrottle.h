@@ -49,8 +49,17 @@ class WiThrottle {
       static const int HEARTBEAT_PRELOAD=2; // request fast callback when connecting multiple messages
       static const int ESTOP_SECONDS=20;     // eStop if no incoming messages for more than 8secs
       static WiThrottle* firstThrottle;
-      static int getInt(byte * cmd);
-      static int getLocoId(byte * cmd);
+      // One bit per cab hash, set while some client may hold a cab with
+      // that hash, so updates to cabs no WiThrottle uses skip the scan.
+      static const int CAB_FILTER_BITS=256;
+      static byte cabFilter[CAB_FILTER_BITS/8];
+      static bool mayBeHeld(int cab);
+      static void addToCabFilter(int cab);
+      static void rebuildCabFilter();
+      static bool anyBroadcastPending;     // some client has locosPending
+      static unsigned long nextEstopCheck; // millis() of the earliest eStop deadline (or sooner)
+      static int getInt(byte * cmd, byte ** end=NULL);
+      static int getLocoId(byte * cmd, byte ** end=NULL);
       static char LorS(int cab); 
       static bool isThrottleInUse(int cab);
       static void setSendTurnoutList();
@@ -60,6 +69,15 @@ class WiThrottle {
       char uniq[17] = "";
        
       MYLOCO myLocos[MAX_MY_LOCO];   
+      // Slot masks of myLocos in use, overall and per throttle letter,
+      // so actions for a throttle (MTA*) visit only its locos.
+      uint16_t usedSlots;
+      byte throttleCount;
+      char throttleLetter[MAX_MY_LOCO];
+      uint16_t throttleSlots[MAX_MY_LOCO];
+      uint16_t locoSlots(char throttleChar);
+      void indexLocos();
+      bool locosPending;  // some myLocos[].broadcastPending is set
       bool heartBeatEnable;
       unsigned long heartBeat;
       bool introSent=false; 
@@ -77,6 +95,7 @@ class WiThrottle {
       void accessory(RingStream *, byte* cmd);
       void checkHeartbeat(RingStream * stream); 
       void markForBroadcast2(int cab);
+      void flagBroadcast(byte loco);
       void sendIntro(Print * stream);
       void sendTurnouts(Print * stream);
       void sendRoster(Print * stream);
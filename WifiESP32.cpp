@@ -20,16 +20,17 @@
 */
 
 #if defined(ARDUINO_ARCH_ESP32)
-#include <vector>
 #include "defines.h"
 #include "ESPmDNS.h"
 #include "esp_wifi.h"
+#include "lwip/sockets.h"
 #include "WifiESP32.h"
 #include "DIAG.h"
 #include "RingStream.h"
 #include "CommandDistributor.h"
 #include "WiThrottle.h"
 #include "DCC.h"
+#include "UdpThrottle.h"
 /*
 #include "soc/rtc_wdt.h"
 #include "esp_task_wdt.h"
@@ -70,18 +71,38 @@ void disableCoreWDT(byte core){
 }
 */
 
+#ifdef WIFI_TASK_ON_CORE0
+// With the wifi task on core 0 that task only moves bytes: commands
+// read from clients go to core 1 through inboundRing and are parsed
+// there by parseLoop, along with the WiThrottle and UDP throttle work,
+// so no DCC state is touched from core 0. Clients that went away are
+// flagged in forgetPending for parseLoop to forget.
+static RingStream *inboundRing = new RingStream(4096);
+static byte forgetPending = 0;
+#ifndef WIFI_PARSE_BUDGET
+#define WIFI_PARSE_BUDGET 2000  // microseconds of parsing per loop
+#endif
+#endif
+
+static void forgetClient(byte clientId) {
+#ifdef WIFI_TASK_ON_CORE0
+  RING_OR(forgetPending, (byte)(1<<clientId));
+#else
+  CommandDistributor::forget(clientId);
+#endif
+}
+
 class NetworkClient {
 public:
-  NetworkClient(WiFiClient c) {
-    wifi = c;
-    inUse = true;
+  NetworkClient() {
+    inUse = false;
   };
   bool active(byte clientId) {
     if (!inUse)
       return false;
     if(!wifi.connected()) {
       DIAG(F("Remove client %d"), clientId);
-      CommandDistributor::forget(clientId);
+      forgetClient(clientId);
       wifi.stop();
       inUse = false;
       return false;
@@ -104,15 +125,35 @@ public:
     }
     return false;
   };
+  bool isUsed() {
+    return inUse;
+  };
+  void release(byte clientId) {
+    if (inUse)
+      forgetClient(clientId);
+    wifi.stop();
+    inUse = false;
+  };
   WiFiClient wifi;
 private:
   bool inUse;
 };
 
 // file scope variables
-static std::vector<NetworkClient> clients; // a list to hold all clients
+// Fixed pool of client slots, the slot number is the clientId
+// used by CommandDistributor and the outbound ring (8 at most).
+static const byte MAX_CLIENTS = 8;
+static NetworkClient clients[MAX_CLIENTS];
+// All clients are read in turn into this buffer before
+// CommandDistributor::parse, one TCP segment fits.
+static const int INBOUND_BUFFER = 1460;
+static byte inboundBuffer[INBOUND_BUFFER+1];
 static RingStream *outboundRing = new RingStream(10240);
 static bool APmode = false;
+// STA reconnect in progress, started at staKickedAt
+static bool staKicked = false;
+static unsigned long staKickedAt = 0;
+static const unsigned long STA_RECONNECT_WAIT = 20000; // as long as setup waits
 // init of static class scope variables
 bool WifiESP::wifiUp = false;
 WiFiServer *WifiESP::server = NULL;
@@ -135,11 +176,8 @@ void WifiESP::teardown() {
   // stop all locos
   DCC::setThrottle(0,1,1); // this broadcasts speed 1(estop) and sets all reminders to speed 1.
   // terminate all clients connections
-  while (!clients.empty()) {
-    // pop_back() should invoke destructor which does stop()
-    // on the underlying TCP connction
-    clients.pop_back();
-  }
+  for (byte clientId=0; clientId<MAX_CLIENTS; clientId++)
+    clients[clientId].release(clientId);
   // stop server
   if (server != NULL) {
     server->stop();
@@ -312,6 +350,9 @@ bool WifiESP::setup(const char *SSid,
   server = new WiFiServer(port); // start listening on tcp port
   server->begin();
   // server started here
+#ifdef UDP_THROTTLE_ON
+  UdpThrottle::setup();
+#endif
 
 #ifdef WIFI_TASK_ON_CORE0
   //start loop task
@@ -352,40 +393,110 @@ void WifiESP::loop() {
   // really no good way to check for LISTEN especially in AP mode?
   wl_status_t wlStatus;
   if (APmode || (wlStatus = WiFi.status()) == WL_CONNECTED) {
+    if (staKicked) {
+      DIAG(F("Wifi reconnected after %Lms"), millis() - staKickedAt);
+      staKicked = false;
+    }
     if (server->hasClient()) {
       WiFiClient client;
       while (client = server->available()) {
-	for (clientId=0; clientId<clients.size(); clientId++){
+	for (clientId=0; clientId<MAX_CLIENTS; clientId++){
 	  if (clients[clientId].recycle(client)) {
-	    DIAG(F("Recycle client %d %s:%d"), clientId, client.remoteIP().toString().c_str(),client.remotePort());
+	    DIAG(F("Client %d %s:%d"), clientId, client.remoteIP().toString().c_str(),client.remotePort());
 	    break;
 	  }
 	}
-	if (clientId>=clients.size()) {
-	  NetworkClient nc(client);
-	  clients.push_back(nc);
-	  DIAG(F("New client %d, %s:%d"), clientId, client.remoteIP().toString().c_str(),client.remotePort());
+	if (clientId>=MAX_CLIENTS) {
+	  DIAG(F("No free client slot, refused %s:%d"), client.remoteIP().toString().c_str(),client.remotePort());
+	  client.stop();
 	}
       }
     }
-    // loop over all connected clients
-    // this removes as a side effect inactive clients when checking ::active()
-    for (clientId=0; clientId<clients.size(); clientId++){
-      if(clients[clientId].active(clientId)) {
-	int len;
-	if ((len = clients[clientId].wifi.available()) > 0) {
-	  // read data from client
-	  byte cmd[len+1];
-	  for(int i=0; i<len; i++) {
-	    cmd[i]=clients[clientId].wifi.read();
+    // Ask lwIP once which client sockets have something for us instead of
+    // polling every client with available() and connected(). A socket
+    // that was closed by the other end shows as readable as well.
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    int maxfd=-1;
+    for (clientId=0; clientId<MAX_CLIENTS; clientId++){
+      if (!clients[clientId].isUsed())
+	continue;
+      int fd=clients[clientId].wifi.fd();
+      if (fd<0) {
+	clients[clientId].active(clientId); // stopped by us, forget it
+	continue;
+      }
+      FD_SET(fd, &readfds);
+      if (fd>maxfd)
+	maxfd=fd;
+    }
+    struct timeval noWait={0,0};
+    // clients left with data in their WiFiClient buffer, because they
+    // had their turn, were over their share of commands or inboundRing
+    // was full. select() would not show them again.
+    static byte readAgain=0;
+    int ready = (maxfd>=0) ? select(maxfd+1, &readfds, NULL, NULL, &noWait) : 0;
+    if (ready <= 0)
+      FD_ZERO(&readfds);
+    if (ready > 0 || readAgain) {
+      for (clientId=0; clientId<MAX_CLIENTS; clientId++){
+	if (!clients[clientId].isUsed())
+	  continue;
+	int fd=clients[clientId].wifi.fd();
+	if (fd<0 || !(FD_ISSET(fd, &readfds) || (readAgain & (1<<clientId))))
+	  continue;
+	readAgain &= ~(1<<clientId);
+	// this removes the client if the socket was closed
+	if(clients[clientId].active(clientId)) {
+	  if (!CommandDistributor::mayParse(clientId)) {
+	    readAgain |= (1<<clientId);
+	    continue;
+	  }
+	  // one buffer per client each time round so that a flood
+	  // from one does not hold up the others
+	  int len = clients[clientId].wifi.available();
+	  if (len > 0) {
+	    if (len > INBOUND_BUFFER) {
+	      len = INBOUND_BUFFER;
+	      readAgain |= (1<<clientId);
+	    }
+#ifdef WIFI_TASK_ON_CORE0
+	    int room = inboundRing->freeSpace();
+	    if (len > room) {
+	      readAgain |= (1<<clientId);
+	      len = room;
+	      if (len <= 0)
+		continue;
+	    }
+#endif
+	    len = clients[clientId].wifi.read(inboundBuffer, len);
+	    if (len <= 0)
+	      continue;
+	    inboundBuffer[len]=0;
+#ifdef WIFI_TASK_ON_CORE0
+	    inboundRing->mark(clientId);
+	    inboundRing->write(inboundBuffer, len);
+	    inboundRing->commit();
+#else
+	    CommandDistributor::parse(clientId,inboundBuffer,outboundRing);
+#endif
 	  }
-	  cmd[len]=0;
-	  CommandDistributor::parse(clientId,cmd,outboundRing);
 	}
       }
-    } // all clients
+    }
 
+#ifndef WIFI_TASK_ON_CORE0
     WiThrottle::loop(outboundRing);
+#ifdef UDP_THROTTLE_ON
+    UdpThrottle::loop();
+#endif
+#endif
+
+    // drop clients that have stopped reading their broadcasts
+    byte evictions=outboundRing->takeEvictions();
+    for (clientId=0; evictions && clientId<MAX_CLIENTS; clientId++, evictions>>=1) {
+      if (evictions & 1) clients[clientId].wifi.stop(); // forgotten by active()
+    }
 
     // something to write out?
     clientId=outboundRing->read();
@@ -409,9 +520,8 @@ void WifiESP::loop() {
 	}
 	// buffer filled, end with '\0' so we can use it as C string
 	buffer[count]='\0';
-	if((unsigned int)clientId <= clients.size() && clients[clientId].active(clientId)) {
-	  if (Diag::CMD || Diag::WITHROTTLE)
-	    DIAG(F("SEND %d:%s"), clientId, buffer);
+	if(clientId < MAX_CLIENTS && clients[clientId].active(clientId)) {
+	  DIAGLOG(Diag::WIFI, F("SEND %d:%s"), clientId, buffer);
 	  clients[clientId].wifi.write(buffer,count);
 	} else {
 	  DIAG(F("Unsent(%d): %s"), clientId, buffer);
@@ -419,17 +529,14 @@ void WifiESP::loop() {
       }
     }
   } else if (!APmode) { // in STA mode but not connected any more
-    // kick it again
-    if (wlStatus <= 6) {
+    // kick it again, then leave it to connect while the loop carries on
+    // with DCC and the other throttles, kick again if it has not made it
+    if (wlStatus <= 6 && (!staKicked || millis() - staKickedAt > STA_RECONNECT_WAIT)) {
       DIAG(F("Wifi aborted with error %s. Kicking Wifi!"), wlerror[wlStatus]);
       esp_wifi_start();
       esp_wifi_connect();
-      uint8_t tries=40;
-      while (WiFi.status() != WL_CONNECTED && tries) {
-	Serial.print('.');
-	tries--;
-	delay(500);
-      }
+      staKicked = true;
+      staKickedAt = millis();
     } else {
       // all well, probably
       //DIAG(F("Running BT"));
@@ -447,4 +554,33 @@ void WifiESP::loop() {
     yield();
   }
 }
+#ifdef WIFI_TASK_ON_CORE0
+// Runs on core 1 from loop(): forget clients that have gone, parse what
+// core 0 has read from the clients, within WIFI_PARSE_BUDGET, then the
+// throttle housekeeping that would otherwise touch DCC from core 0.
+void WifiESP::parseLoop() {
+  static byte parseBuffer[INBOUND_BUFFER+1];
+  byte forget=RING_TAKE(forgetPending);
+  for (byte clientId=0; forget; clientId++, forget>>=1)
+    if (forget & 1) CommandDistributor::forget(clientId);
+
+  unsigned long start=micros();
+  do {
+    int clientId=inboundRing->read();
+    if (clientId < 0)
+      break;
+    int count=inboundRing->count();
+    if (count > INBOUND_BUFFER) count=INBOUND_BUFFER; // never by construction
+    for (int i=0; i<count; i++)
+      parseBuffer[i]=inboundRing->read();
+    parseBuffer[count]=0;
+    CommandDistributor::parse(clientId,parseBuffer,outboundRing);
+  } while (micros()-start < WIFI_PARSE_BUDGET);
+
+  WiThrottle::loop(outboundRing);
+#ifdef UDP_THROTTLE_ON
+  UdpThrottle::loop();
+#endif
+}
+#endif
 #endif //ESP32
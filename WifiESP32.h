@@ -36,6 +36,10 @@ public:
 		    const byte channel,
 			const bool forceAP);
   static void loop();
+#ifdef WIFI_TASK_ON_CORE0
+  // The part of the wifi work that touches DCC state, run from loop()
+  static void parseLoop();
+#endif
 private:
   static void teardown();
   static bool wifiUp;
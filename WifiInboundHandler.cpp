@@ -44,6 +44,10 @@ WifiInboundHandler::WifiInboundHandler(Stream * ESStream) {
   inboundRing=new RingStream(INBOUND_RING);
   outboundRing=new RingStream(OUTBOUND_RING);
   pendingCipsend=false;
+  clientsToClose=0;
+  sendBuffer=new byte[SEND_BUFFER];
+  sendFromRing=false;
+  sendInFlight=false;
 } 
 
 
@@ -55,18 +59,29 @@ void WifiInboundHandler::loop1() {
    if (loop2()!=INBOUND_IDLE) return;
 
    WiThrottle::loop(outboundRing);
+
+    // The ES takes one CIPSEND at a time, a CIPSEND before the SEND OK
+    // of the previous one is answered busy and costs a CIPSENDgap.
+    if (sendInFlight && millis()-sendStarted > SENDOKtimeout) sendInFlight=false;
+    bool awaitingPrompt = clientPendingCIPSEND>=0 && !pendingCipsend;
+
+    // close a client that has stopped reading, the ES replies x,CLOSED
+    clientsToClose |= outboundRing->takeEvictions();
+    if (clientsToClose && !awaitingPrompt && !sendInFlight) {
+      for (byte c=0; c<8; c++) {
+        if (clientsToClose & (1<<c)) {
+          clientsToClose &= ~(1<<c);
+          StringFormatter::send(wifiStream, F("AT+CIPCLOSE=%d\r\n"), c);
+          return;
+        }
+      }
+    }
    
-    // if nothing is already CIPSEND pending, we can CIPSEND one reply
-    if (clientPendingCIPSEND<0) {
-       clientPendingCIPSEND=outboundRing->read();
-       if (clientPendingCIPSEND>=0) {
-         currentReplySize=outboundRing->count();
-         pendingCipsend=true;
-       }
-     }
-    
+    // if nothing is already CIPSEND pending, collect the next one
+    // while the previous is still being transmitted by the ES
+    if (clientPendingCIPSEND<0) collectCIPSEND();
 
-    if (pendingCipsend && millis()-lastCIPSEND > CIPSENDgap) {
+    if (pendingCipsend && !sendInFlight && millis()-lastCIPSEND > CIPSENDgap) {
          if (Diag::WIFI) DIAG( F("WiFi: [[CIPSEND=%d,%d]]"), clientPendingCIPSEND, currentReplySize);
          StringFormatter::send(wifiStream, F("AT+CIPSEND=%d,%d\r\n"),  clientPendingCIPSEND, currentReplySize);
          pendingCipsend=false;
@@ -112,14 +127,26 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
         }
         
         if (ch=='>') { 
+           if (clientPendingCIPSEND<0 || pendingCipsend) { // not for us
+             loopState=SKIPTOEND;
+             break;
+           }
            if (Diag::WIFI) DIAG(F("[XMIT %d]"),currentReplySize); 
-           for (int i=0;i<currentReplySize;i++) {
-             int cout=outboundRing->read();
-             wifiStream->write(cout);
-             if (Diag::WIFI) StringFormatter::printEscape(cout); // DIAG in disguise
+           if (sendFromRing) {
+             for (int i=0;i<currentReplySize;i++) {
+               int cout=outboundRing->read();
+               wifiStream->write(cout);
+               if (Diag::WIFI) StringFormatter::printEscape(cout); // DIAG in disguise
+             }
+           }
+           else {
+             wifiStream->write(sendBuffer,currentReplySize);
+             if (Diag::WIFI) for (int i=0;i<currentReplySize;i++) StringFormatter::printEscape(sendBuffer[i]);
            }
            clientPendingCIPSEND=-1;
            pendingCipsend=false;
+           sendInFlight=true;
+           sendStarted=millis();
            loopState=SKIPTOEND;
            break;
         }
@@ -129,9 +156,10 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
           break;
         }
        
-        if (ch=='S') { // SEND OK probably 
+        if (ch=='S') { // SEND OK or SEND FAIL, the ES can take the next CIPSEND
           loopState=SKIPTOEND;
           lastCIPSEND=0; // no need to wait next time 
+          sendInFlight=false;
           break;
         }
         
@@ -149,7 +177,8 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
         }
 
         if (ch=='E' || ch=='l') { // ERROR or "link is not valid"
-          if (clientPendingCIPSEND>=0) {
+          sendInFlight=false;
+          if (clientPendingCIPSEND>=0 && !pendingCipsend) {
             // A CIPSEND was errored... just toss it away
             purgeCurrentCIPSEND(); 
           }
@@ -247,9 +276,45 @@ void WifiInboundHandler::purgeCurrentCIPSEND() {
          // A CIPSEND was sent but errored... or the client closed just toss it away
          CommandDistributor::forget(clientPendingCIPSEND); 
          DIAG(F("Wifi: DROPPING CIPSEND=%d,%d"),clientPendingCIPSEND,currentReplySize);
-         for (int i=0;i<currentReplySize;i++) outboundRing->read();
+         if (sendFromRing) for (int i=0;i<currentReplySize;i++) outboundRing->read();
          pendingCipsend=false;  
          clientPendingCIPSEND=-1;
 }
 
+// Take the next reply from the outboundRing into sendBuffer together
+// with the replies to the same client that follow it, so they go out
+// in one CIPSEND. The header of the first reply for another client is
+// held over for the next call. A reply bigger than sendBuffer is sent
+// straight from the ring as before.
+void WifiInboundHandler::collectCIPSEND() {
+  int clientId=heldClientId;
+  int count=heldReplySize;
+  heldClientId=-1;
+  if (clientId<0) {
+    clientId=outboundRing->read();
+    if (clientId<0) return;
+    count=outboundRing->count();
+  }
+  clientPendingCIPSEND=clientId;
+  pendingCipsend=true;
+  if (count>SEND_BUFFER) {
+    sendFromRing=true;
+    currentReplySize=count;
+    return;
+  }
+  sendFromRing=false;
+  currentReplySize=0;
+  for (;;) {
+    for (int i=0;i<count;i++) sendBuffer[currentReplySize++]=outboundRing->read();
+    int next=outboundRing->read();
+    if (next<0) return;
+    count=outboundRing->count();
+    if (next!=clientId || currentReplySize+count>SEND_BUFFER) {
+      heldClientId=next;
+      heldReplySize=count;
+      return;
+    }
+  }
+}
+
 #endif
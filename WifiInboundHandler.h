@@ -65,13 +65,18 @@ class WifiInboundHandler {
    void loop1();
    INBOUND_STATE loop2();
    void purgeCurrentCIPSEND();
+   void collectCIPSEND();
    Stream * wifiStream;
    
    static const int INBOUND_RING = 512;
    static const int OUTBOUND_RING = sizeof(void*)==2?2048:8192;
+   // replies to the same client are joined up to this size per CIPSEND
+   static const int SEND_BUFFER = sizeof(void*)==2?256:1024;
  
    static const int CIPSENDgap=100; // millis() between retries of cipsend. 
+   static const int SENDOKtimeout=500; // millis() to wait for SEND OK
  
+   byte clientsToClose; // evicted by the outbound ring, closed one at a time
    RingStream * inboundRing;
    RingStream * outboundRing;
      
@@ -82,6 +87,12 @@ class WifiInboundHandler {
   int currentReplySize;
   bool pendingCipsend;
   uint32_t lastCIPSEND=0; // millis() of previous cipsend
+  byte * sendBuffer;
+  bool sendFromRing;  // reply too big for sendBuffer, still in outboundRing
+  int heldClientId=-1; // next reply, its header already read from outboundRing
+  int heldReplySize;
+  bool sendInFlight;   // data written, waiting for SEND OK
+  uint32_t sendStarted;
   
 };
 #endif
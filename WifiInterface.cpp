@@ -108,8 +108,7 @@ bool WifiInterface::setup(long serial_link_speed,
 
 // See if the WiFi is attached to the first serial port
 #if NUM_SERIAL > 0 && !defined(SERIAL1_COMMANDS)
-  SERIAL1.begin(serial_link_speed);
-  wifiUp = setup(SERIAL1, wifiESSID, wifiPassword, hostname, port, channel, forceAP);
+  wifiUp = setup(SERIAL1, serial_link_speed, wifiESSID, wifiPassword, hostname, port, channel, forceAP);
 #endif
 
 // Other serials are tried, depending on hardware.
@@ -118,8 +117,7 @@ bool WifiInterface::setup(long serial_link_speed,
 #if NUM_SERIAL > 1 && !defined(SERIAL2_COMMANDS)
   if (wifiUp == WIFI_NOAT)
   {
-    Serial2.begin(serial_link_speed);
-    wifiUp = setup(Serial2, wifiESSID, wifiPassword, hostname, port, channel, forceAP);
+    wifiUp = setup(Serial2, serial_link_speed, wifiESSID, wifiPassword, hostname, port, channel, forceAP);
   }
 #endif
 #endif
@@ -129,8 +127,7 @@ bool WifiInterface::setup(long serial_link_speed,
 #if NUM_SERIAL > 2 && !defined(SERIAL3_COMMANDS)
   if (wifiUp == WIFI_NOAT)
   {
-    SERIAL3.begin(serial_link_speed);
-    wifiUp = setup(SERIAL3, wifiESSID, wifiPassword, hostname, port, channel, forceAP);
+    wifiUp = setup(SERIAL3, serial_link_speed, wifiESSID, wifiPassword, hostname, port, channel, forceAP);
   }
 #endif
 
@@ -147,6 +144,72 @@ bool WifiInterface::setup(long serial_link_speed,
   return connected; 
 }
 
+wifiSerialState WifiInterface::setup(HardwareSerial & setupSerial, long linkSpeed, const FSH* SSid, const FSH* password,
+				     const FSH* hostname,  int port, byte channel, bool forceAP) {
+  setupSerial.begin(linkSpeed);
+  wifiSerialState wifiState = setup(setupSerial, SSid, password, hostname, port, channel, forceAP);
+#ifdef WIFI_UART_SPEED
+  if (wifiState == WIFI_NOAT) {
+    // Restarting the Arduino does not restart the ES, it may
+    // still be at the speed an earlier run moved it to.
+    if (WIFI_UART_SPEED == linkSpeed) return wifiState;
+    setupSerial.begin(WIFI_UART_SPEED);
+    return setup(setupSerial, SSid, password, hostname, port, channel, forceAP);
+  }
+  raiseLinkSpeed(setupSerial, linkSpeed);
+#endif
+  return wifiState;
+}
+
+#ifdef WIFI_UART_SPEED
+#if defined(WIFI_UART_RTS_PIN) && defined(WIFI_UART_CTS_PIN)
+#if defined(ARDUINO_ARCH_STM32)
+#define WIFI_UART_FLOW
+#else
+#warning WIFI_UART_RTS_PIN and WIFI_UART_CTS_PIN ignored, flow control only supported on STM32
+#endif
+#endif
+// Move the AT link to WIFI_UART_SPEED with AT+UART_CUR, which the ES does
+// not save so a reset of the ES brings it back to linkSpeed.
+// If the ES does not answer at the new speed ask it to go back.
+void WifiInterface::raiseLinkSpeed(HardwareSerial & setupSerial, long linkSpeed) {
+  if (WIFI_UART_SPEED <= linkSpeed) return;
+  byte flowControl = 0;
+#ifdef WIFI_UART_FLOW
+  flowControl = 3; // RTS and CTS
+#endif
+  StringFormatter::send(wifiStream, F("AT+UART_CUR=%l,8,1,0,%d\r\n"), (long)WIFI_UART_SPEED, flowControl);
+  if (!checkForOK(200, true)) {
+    DIAG(F("WiFi link stays at %l baud"), linkSpeed);
+    return;
+  }
+  setupSerial.end();
+#ifdef WIFI_UART_FLOW
+  setupSerial.setRts(WIFI_UART_RTS_PIN);
+  setupSerial.setCts(WIFI_UART_CTS_PIN);
+#endif
+  setupSerial.begin(WIFI_UART_SPEED);
+  delay(20);
+  StringFormatter::send(wifiStream, F("AT\r\n"));
+  if (checkForOK(200, true)) {
+    DIAG(F("WiFi link at %l baud"), (long)WIFI_UART_SPEED);
+    return;
+  }
+  StringFormatter::send(wifiStream, F("AT+UART_CUR=%l,8,1,0,0\r\n"), linkSpeed);
+  checkForOK(200, true);
+  setupSerial.end();
+#ifdef WIFI_UART_FLOW
+  setupSerial.setRts(NC);
+  setupSerial.setCts(NC);
+#endif
+  setupSerial.begin(linkSpeed);
+  delay(20);
+  StringFormatter::send(wifiStream, F("AT\r\n"));
+  if (checkForOK(200, true)) DIAG(F("WiFi link stays at %l baud"), linkSpeed);
+  else DIAG(F("WiFi link lost at %l baud, reset the ES"), (long)WIFI_UART_SPEED);
+}
+#endif
+
 wifiSerialState WifiInterface::setup(Stream & setupStream,  const FSH* SSid, const FSH* password,
 				     const FSH* hostname,  int port, byte channel, bool forceAP) {
   wifiSerialState wifiState;
@@ -43,6 +43,11 @@ public:
   static void ATCommand(HardwareSerial * stream,const byte *command);
   
 private:
+  static wifiSerialState setup(HardwareSerial &setupSerial, long linkSpeed, const FSH *SSSid, const FSH *password,
+                    const FSH *hostname, int port, byte channel, bool forceAP);
+#ifdef WIFI_UART_SPEED
+  static void raiseLinkSpeed(HardwareSerial &setupSerial, long linkSpeed);
+#endif
   static wifiSerialState setup(Stream &setupStream, const FSH *SSSid, const FSH *password,
                     const FSH *hostname, int port, byte channel, bool forceAP);
   static Stream *wifiStream;
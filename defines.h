@@ -148,6 +148,13 @@
   // #define I2C_USE_WIRE
   // #endif
 
+#elif defined(ARDUINO_ARCH_HOST)
+  // Host (x86/Linux) simulation build, see host/HostBench.cpp
+  #define ARDUINO_TYPE "HOST"
+  #ifndef I2C_USE_WIRE
+    #define I2C_USE_WIRE
+  #endif
+
 /* TODO when ready 
 #elif defined(ARDUINO_ARCH_RP2040)
   #define ARDUINO_TYPE "RP2040"
@@ -163,6 +170,29 @@
   #define ARDUINO_TYPE BOARD_NAME
 #endif
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// USB_PACKETS: on native USB boards each write to the CDC port may become
+// a USB packet of its own, so a reply printed a character at a time costs
+// one packet per character. USB_SERIAL is then a USBPacketSerial which
+// stages output into full packets and sends them at each end of line and
+// at the end of each loop pass. Define DISABLE_USB_PACKETS in config.h
+// to write to the port directly.
+//
+#if !defined(DISABLE_USB_PACKETS) && (defined(ARDUINO_ARCH_SAMD) \
+    || defined(ARDUINO_TEENSY31) || defined(ARDUINO_TEENSY35) || defined(ARDUINO_TEENSY36) \
+    || defined(ARDUINO_TEENSY40) || defined(ARDUINO_TEENSY41) \
+    || (defined(ARDUINO_ARCH_STM32) && defined(USBCON) && defined(USBD_USE_CDC)))
+  #define USB_PACKETS
+  #if defined(ARDUINO_ARCH_STM32)
+    #define USB_SERIAL_PORT Serial
+  #else
+    #define USB_SERIAL_PORT SerialUSB
+  #endif
+  #undef USB_SERIAL
+  #define USB_SERIAL usbSerial
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // WIFI_ON: All prereqs for running with WIFI are met
@@ -212,6 +242,11 @@
 // Currently only devices which can communicate at 115200 are supported.
 //
 #define WIFI_SERIAL_LINK_SPEED 115200
+// Define WIFI_UART_SPEED (for example 460800) in config.h to move the link
+// to that speed with AT+UART_CUR once the ES is found. It falls back to
+// WIFI_SERIAL_LINK_SPEED if the ES does not answer at the new speed.
+// On STM32 also define WIFI_UART_RTS_PIN and WIFI_UART_CTS_PIN to turn on
+// hardware flow control, AVR serial ports have no RTS/CTS.
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -231,6 +266,31 @@
 
 #endif
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Reverse loop tracks (TRACK_MODIFIER_AUTO) with a current sense pin are
+// checked for a short from the DCC interrupt (from loop on ESP32) and
+// their phase is flipped there, before the overload handling notices.
+// Shown by <D REVERSER [RESET]>. Define DISABLE_FAST_REVERSER in config.h
+// to leave the flip to the overload handling, which takes milliseconds.
+//
+#if defined(HAS_ENOUGH_MEMORY) && !defined(DISABLE_FAST_REVERSER)
+#define FAST_REVERSER
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// HOT_RESTART (config.h) keeps a snapshot of the locos and tracks in the
+// EEPROM to resume from after a reset, see HotRestart.h.
+//
+#if defined(HOT_RESTART) && (defined(DISABLE_EEPROM) || !defined(HAS_ENOUGH_MEMORY))
+#undef HOT_RESTART
+#endif
+
+#ifdef USB_PACKETS
+  #include "USBPacketSerial.h"
+#endif
+
 #if __has_include ( "myAutomation.h")
   #if defined(HAS_ENOUGH_MEMORY) || defined(DISABLE_EEPROM) || defined(DISABLE_PROG)
     #define EXRAIL_ACTIVE
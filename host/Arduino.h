@@ -0,0 +1,201 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Minimal Arduino core for the host (x86/Linux) simulation build, see 
+// HostBench.cpp.  Only what the command station uses is provided.  Time 
+// is real time since start, pins are bits in simulated port registers, 
+// and the serial ports are in-memory queues the benchmark feeds and counts.
+
+#ifndef Arduino_h
+#define Arduino_h
+#ifndef ARDUINO_ARCH_HOST
+#define ARDUINO_ARCH_HOST
+#endif
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+#define SERIAL_8N1 0x06
+
+#define F_CPU 16000000L
+#define NUM_DIGITAL_PINS 70
+#define NUM_ANALOG_INPUTS 16
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define SDA 20
+#define SCL 21
+#define LED_BUILTIN 13
+#define NOT_A_PIN 255
+#define NOT_A_PORT 0
+#define NOT_AN_INTERRUPT -1
+
+#define PROGMEM
+#define F(s) (s)
+#define pgm_read_byte(a) (*(const uint8_t *)(a))
+#define pgm_read_word(a) (*(const uint16_t *)(a))
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define bit(b) (1UL << (b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+template<class T, class U> auto min(T a, U b) -> decltype(a<b?a:b) { return a<b?a:b; }
+template<class T, class U> auto max(T a, U b) -> decltype(a<b?a:b) { return a>b?a:b; }
+
+class __FlashStringHelper;
+
+// Time and interrupts
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void noInterrupts();
+void interrupts();
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+#define digitalPinToInterrupt(p) NOT_AN_INTERRUPT
+
+// Periodic timer interrupt, standing in for the hardware timer that 
+// drives the DCC waveform.  The handler is called as time passes whenever 
+// interrupts are enabled.
+void hostTimerBegin(void (*isr)(), unsigned long periodMicros);
+// Number of timer periods that were skipped because the host was busy.
+unsigned long hostTimerMissed();
+
+// Pins.  Each group of 8 pins is one simulated port register.
+extern volatile uint8_t hostPorts[(NUM_DIGITAL_PINS+7)/8];
+#define digitalPinToPort(p) ((p)/8 + 1)
+#define digitalPinToBitMask(p) (1 << ((p) % 8))
+#define portOutputRegister(port) (&hostPorts[(port)-1])
+#define portInputRegister(port) (&hostPorts[(port)-1])
+#define portModeRegister(port) ((volatile uint8_t *)0)
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout=1000000L);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+char *itoa(int value, char *str, int base);
+char *ltoa(long value, char *str, int base);
+char *utoa(unsigned value, char *str, int base);
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base=DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base=DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base=DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base=DEC);
+  size_t print(unsigned long n, int base=DEC);
+  size_t print(double n, int digits=2);
+  size_t println() { return write("\r\n"); }
+  size_t println(const char *s) { return print(s) + println(); }
+  size_t println(int n, int base=DEC) { return print(n, base) + println(); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(char *buffer, size_t length);
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+protected:
+  unsigned long _timeout = 1000;
+};
+
+// Serial port with in-memory queues.  The benchmark pushes command text 
+// into the input and counts (and optionally echoes) the output.
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud, int config=SERIAL_8N1) { (void)baud; (void)config; }
+  void end() {}
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int availableForWrite() override { return 4096; }
+  operator bool() { return true; }
+
+  void hostInput(const char *text);     // queue text to be read
+  size_t hostPending() const;           // input bytes not yet read
+  unsigned long hostOutputBytes = 0;    // bytes written so far
+  FILE *hostEcho = NULL;                // if set, output is copied here
+private:
+  char *_input = NULL;
+  size_t _inputSize = 0;
+  size_t _inputHead = 0;
+  size_t _inputTail = 0;
+};
+extern HardwareSerial Serial, Serial1, Serial2, Serial3, Serial4, Serial5, Serial6;
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Host simulation build: EEPROM held in memory, initially erased.
+#ifndef EEPROM_h
+#define EEPROM_h
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+  static const int SIZE = 4096;
+  uint8_t read(int address) { return (address >= 0 && address < SIZE) ? _data[address] : 0xff; }
+  void write(int address, uint8_t value) { if (address >= 0 && address < SIZE) _data[address] = value; }
+  void update(int address, uint8_t value) { write(address, value); }
+  template<class T> T &get(int address, T &t) {
+    for (size_t i = 0; i < sizeof(T); i++) ((uint8_t *)&t)[i] = read(address + i);
+    return t;
+  }
+  template<class T> const T &put(int address, const T &t) {
+    for (size_t i = 0; i < sizeof(T); i++) write(address + i, ((const uint8_t *)&t)[i]);
+    return t;
+  }
+  uint16_t length() { return SIZE; }
+  void begin(int size) { (void)size; }
+  bool commit() { return true; }
+  EEPROMClass() { memset(_data, 0xff, sizeof(_data)); }
+private:
+  uint8_t _data[SIZE];
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host (x86/Linux) simulation build and throughput benchmark.
+ *
+ * The whole command station, including the DCC waveform interrupt, runs 
+ * against the simulated core in this directory (Arduino.h, HostCore.cpp 
+ * and ../DCCTimerHOST.cpp).  A trace of commands is replayed into Serial as
+ * fast as it is consumed, and the benchmark reports commands per second,
+ * main loop iterations, the bytes sent back and broadcast, and the DCC 
+ * packet scheduling latency histograms from DCC_PACKET_STATS.
+ *
+ * Build with "pio run -e native", then run
+ *     .pio/build/native/program [-v] [-b [-t]] [-r repeats] [-s settle_ms] [trace]
+ * where trace is a file of commands, e.g. "<1>" or "<t 3 50 1>", one or 
+ * more per line, with # starting a comment line.  The trace is read from 
+ * standard input if no file is given.  -v echoes the serial output.
+ * -b reads a binary trace captured with TRACE_SERIAL (see ../CommandTrace.h)
+ * instead, replaying its commands from all clients into Serial, and -t 
+ * replays them at the times they were recorded rather than flat out.
+ */
+
+#if defined(ARDUINO_ARCH_HOST)
+#include "../CommandStation-EX.ino"
+#include <unistd.h>
+
+// Run the main loop for a while, e.g. to let setup broadcasts settle.
+static void runFor(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) loop();
+}
+
+// Read the whole trace into memory as a list of lines, comments removed.
+static char **readTrace(FILE *file, int &lineCount, unsigned long &commandCount) {
+  size_t size = 0, used = 0;
+  char *text = NULL;
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (used + 2 > size) {
+      size = size ? size * 2 : 4096;
+      text = (char *)realloc(text, size);
+    }
+    text[used++] = (char)c;
+  }
+  if (!text) text = (char *)malloc(1);
+  text[used] = '\0';
+
+  char **lines = NULL;
+  lineCount = 0;
+  commandCount = 0;
+  for (char *line = strtok(text, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '#') continue;
+    lines = (char **)realloc(lines, (lineCount + 1) * sizeof(char *));
+    lines[lineCount++] = line;
+    for (char *p = line; *p; p++) 
+      if (*p == '<') commandCount++;
+  }
+  return lines;
+}
+
+static unsigned long get32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+// Read the commands from a binary trace, with the micros() each arrived at.
+static char **readBinaryTrace(FILE *file, int &lineCount, unsigned long &commandCount, 
+                              unsigned long *&times) {
+  char **lines = NULL;
+  lineCount = 0;
+  commandCount = 0;
+  times = NULL;
+  unsigned long now = 0, lost = 0;
+  unsigned char header[4], payload[256];  // type, length, delta (16 bits)
+  // shortest payload of each record type that is read here
+  static const unsigned char minLength[] = {5, 4, 1, 0, 0, 0, 2};
+  while (fread(header, 1, sizeof(header), file) == sizeof(header)
+      && fread(payload, 1, header[1], file) == header[1]) {
+    if (header[0] < sizeof(minLength) && header[1] < minLength[header[0]]) {
+      fprintf(stderr, "Trace record type %d too short (%d bytes), rest of trace ignored\n", 
+              header[0], header[1]);
+      break;
+    }
+    now += header[2] | (header[3] << 8);
+    switch (header[0]) {
+      case TRACE_RECORD_START: now = get32(payload + 1); break;
+      case TRACE_RECORD_TIME: now = get32(payload); break;
+      case TRACE_RECORD_LOST: lost += payload[0] | (payload[1] << 8); break;
+      case TRACE_RECORD_COMMAND: {
+          char *line = (char *)malloc(header[1]);
+          memcpy(line, payload + 1, header[1] - 1);
+          line[header[1] - 1] = '\0';
+          lines = (char **)realloc(lines, (lineCount + 1) * sizeof(char *));
+          times = (unsigned long *)realloc(times, (lineCount + 1) * sizeof(unsigned long));
+          times[lineCount] = now;
+          lines[lineCount++] = line;
+          for (char *p = line; *p; p++) 
+            if (*p == '<') commandCount++;
+        }
+        break;
+      default: break;  // packets and sensor/turnout changes are outputs
+    }
+  }
+  if (lost) fprintf(stderr, "Trace dropped %lu records\n", lost);
+  return lines;
+}
+
+int main(int argc, char **argv) {
+  bool verbose = false;
+  bool binary = false;
+  bool timed = false;
+  unsigned long repeats = 1;
+  unsigned long settleMillis = 500;
+  int option;
+  while ((option = getopt(argc, argv, "vbtr:s:")) != -1) {
+    switch (option) {
+      case 'v': verbose = true; break;
+      case 'b': binary = true; break;
+      case 't': timed = true; break;
+      case 'r': repeats = strtoul(optarg, NULL, 10); break;
+      case 's': settleMillis = strtoul(optarg, NULL, 10); break;
+      default: 
+        fprintf(stderr, "Usage: %s [-v] [-b [-t]] [-r repeats] [-s settle_ms] [trace]\n", argv[0]);
+        return 1;
+    }
+  }
+  FILE *file = stdin;
+  if (optind < argc) {
+    file = fopen(argv[optind], binary ? "rb" : "r");
+    if (!file) {
+      perror(argv[optind]);
+      return 1;
+    }
+  }
+  int lineCount;
+  unsigned long commandCount;
+  unsigned long *times = NULL;
+  char **lines = binary ? readBinaryTrace(file, lineCount, commandCount, times)
+                        : readTrace(file, lineCount, commandCount);
+  if (!timed) times = NULL;
+  if (file != stdin) fclose(file);
+  commandCount *= repeats;
+
+  Serial.hostEcho = verbose ? stdout : NULL;
+  setup();
+  runFor(settleMillis);
+
+  Serial.hostOutputBytes = 0;
+  Serial1.hostOutputBytes = 0;
+  unsigned long loops = 0;
+  unsigned long start = micros();
+  for (unsigned long r = 0; r < repeats; r++) {
+    unsigned long repeatStart = micros();
+    for (int l = 0; l < lineCount; l++) {
+      if (times) 
+        while (micros() - repeatStart < times[l] - times[0]) {
+          loop();
+          loops++;
+        }
+      Serial.hostInput(lines[l]);
+      Serial.hostInput("\n");
+      do {
+        loop();
+        loops++;
+      } while (Serial.hostPending());
+    }
+  }
+  unsigned long elapsed = micros() - start;
+  if (elapsed == 0) elapsed = 1;
+  unsigned long broadcastBytes = Serial1.hostOutputBytes;
+  unsigned long responseBytes = Serial.hostOutputBytes - broadcastBytes;
+
+  // Give the waveform time to send what was queued before the latency 
+  // figures are taken.
+  runFor(settleMillis);
+
+  printf("\nCommands %lu in %lums, %lu/s\n", commandCount, elapsed / 1000, 
+    (unsigned long)(commandCount * 1000000.0 / elapsed));
+  printf("Loops %lu, mean %luus\n", loops, loops ? elapsed / loops : 0);
+  if (commandCount) {
+    printf("Response bytes %lu (%lu/command)\n", responseBytes, responseBytes / commandCount);
+    printf("Broadcast bytes %lu (%lu/command)\n", broadcastBytes, broadcastBytes / commandCount);
+  }
+  unsigned long missed = hostTimerMissed();
+  printf("Timer periods missed %lu\n", missed);
+  if (missed) 
+    printf("The timer thread fell behind, so the latencies are understated (needs 2 cores)\n");
+  Serial.hostEcho = stdout;
+  for (byte stream=0; stream<MAIN_STREAMS; stream++)
+    DCCWaveform::mainStream(stream).showLatencyStats(false);
+  DCCWaveform::progTrack.showLatencyStats(false);
+  DCC::showReminderStats(false);
+  printf("\n");
+  return 0;
+}
+#endif
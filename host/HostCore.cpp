@@ -0,0 +1,282 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Host simulation build: implementation of the Arduino core in Arduino.h.
+#if defined(ARDUINO_ARCH_HOST)
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+HardwareSerial Serial, Serial1, Serial2, Serial3, Serial4, Serial5, Serial6;
+EEPROMClass EEPROM;
+TwoWire Wire;
+
+volatile uint8_t hostPorts[(NUM_DIGITAL_PINS+7)/8];
+static uint8_t hostPinModes[NUM_DIGITAL_PINS];
+
+/////////////////////////////////////////////////////////////////////////////
+// Time and interrupts.  The timer interrupt runs on its own thread so that
+// it preempts the main code as it would on the hardware, e.g. while the 
+// main code waits for a free packet slot.  Disabling interrupts takes a 
+// lock that the timer thread holds while the handler runs.
+
+static std::mutex interruptLock;
+static bool interruptsDisabled = false;
+static thread_local bool inInterrupt = false;
+static void (*timerIsr)() = NULL;
+static unsigned long timerPeriod;
+static volatile unsigned long timerMissed = 0;
+
+// Periods this far behind are dropped rather than run back to back.
+static const unsigned long TIMER_MAX_CATCHUP = 50;
+
+unsigned long micros() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned long millis() {
+  return micros() / 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+  unsigned long start = micros();
+  while (micros() - start < us) {}
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void noInterrupts() {
+  if (inInterrupt || interruptsDisabled) return;
+  interruptLock.lock();
+  interruptsDisabled = true;
+}
+
+void interrupts() {
+  if (inInterrupt || !interruptsDisabled) return;
+  interruptsDisabled = false;
+  interruptLock.unlock();
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode) {
+  (void)interrupt; (void)isr; (void)mode;
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  (void)interrupt;
+}
+
+// Call the handler once per period, spinning until the next one is due.
+static void timerThread() {
+  inInterrupt = true;
+  unsigned long next = micros() + timerPeriod;
+  while (true) {
+    unsigned long now = micros();
+    if ((long)(now - next) < 0) {
+      std::this_thread::yield();  // sleeping is too coarse for 58us
+      continue;
+    }
+    unsigned long behind = (now - next) / timerPeriod;
+    if (behind > TIMER_MAX_CATCHUP) {
+      timerMissed += behind - TIMER_MAX_CATCHUP;
+      next += (behind - TIMER_MAX_CATCHUP) * timerPeriod;
+    }
+    interruptLock.lock();
+    timerIsr();
+    interruptLock.unlock();
+    next += timerPeriod;
+  }
+}
+
+void hostTimerBegin(void (*isr)(), unsigned long periodMicros) {
+  if (timerIsr) return;
+  timerPeriod = periodMicros;
+  timerIsr = isr;
+  std::thread(timerThread).detach();
+}
+
+unsigned long hostTimerMissed() {
+  return timerMissed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Pins.  Inputs read back what was last written, or high with a pullup 
+// (so that sensors are inactive), and analogue inputs read 0 (no current).
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= NUM_DIGITAL_PINS) return;
+  hostPinModes[pin] = mode;
+  if (mode == INPUT_PULLUP) digitalWrite(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= NUM_DIGITAL_PINS) return;
+  if (value) hostPorts[pin/8] |= digitalPinToBitMask(pin);
+  else hostPorts[pin/8] &= ~digitalPinToBitMask(pin);
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) return LOW;
+  return (hostPorts[pin/8] & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  (void)pin;
+  return 0;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  digitalWrite(pin, value > 127);
+}
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout) {
+  (void)pin; (void)state; (void)timeout;
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Utilities
+
+long random(long howbig) {
+  return howbig > 0 ? rand() % howbig : 0;
+}
+
+long random(long howsmall, long howbig) {
+  return howsmall < howbig ? howsmall + random(howbig - howsmall) : howsmall;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+static char *toBase(unsigned long value, bool negative, char *str, int base) {
+  char digits[sizeof(long)*8];
+  int n = 0;
+  do {
+    int d = value % base;
+    digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+    value /= base;
+  } while (value);
+  char *p = str;
+  if (negative) *p++ = '-';
+  while (n) *p++ = digits[--n];
+  *p = '\0';
+  return str;
+}
+
+char *ltoa(long value, char *str, int base) {
+  bool negative = value < 0 && base == 10;
+  return toBase(negative ? -(unsigned long)value : (unsigned long)value, negative, str, base);
+}
+
+char *itoa(int value, char *str, int base) {
+  return ltoa(value, str, base);
+}
+
+char *utoa(unsigned value, char *str, int base) {
+  return toBase(value, false, str, base);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Print, Stream and serial ports
+
+size_t Print::print(unsigned long n, int base) {
+  char buffer[sizeof(long)*8+1];
+  if (base == 10) snprintf(buffer, sizeof(buffer), "%lu", n);
+  else if (base == 16) snprintf(buffer, sizeof(buffer), "%lx", n);
+  else if (base == 8) snprintf(buffer, sizeof(buffer), "%lo", n);
+  else toBase(n, false, buffer, base);
+  return write(buffer);
+}
+
+size_t Print::print(long n, int base) {
+  if (base != 10) return print((unsigned long)n, base);
+  char buffer[sizeof(long)*3+2];
+  snprintf(buffer, sizeof(buffer), "%ld", n);
+  return write(buffer);
+}
+
+size_t Print::print(double n, int digits) {
+  char buffer[40];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return write(buffer);
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  unsigned long start = millis();
+  while (count < length && millis() - start < _timeout) {
+    int c = read();
+    if (c >= 0) buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+void HardwareSerial::hostInput(const char *text) {
+  size_t length = strlen(text);
+  // Compact, then grow if need be
+  if (_inputHead > 0) {
+    memmove(_input, _input + _inputHead, _inputTail - _inputHead);
+    _inputTail -= _inputHead;
+    _inputHead = 0;
+  }
+  if (_inputTail + length > _inputSize) {
+    _inputSize = (_inputTail + length) * 2;
+    _input = (char *)realloc(_input, _inputSize);
+  }
+  memcpy(_input + _inputTail, text, length);
+  _inputTail += length;
+}
+
+size_t HardwareSerial::hostPending() const {
+  return _inputTail - _inputHead;
+}
+
+int HardwareSerial::available() {
+  return hostPending();
+}
+
+int HardwareSerial::read() {
+  if (_inputHead == _inputTail) return -1;
+  return (uint8_t)_input[_inputHead++];
+}
+
+int HardwareSerial::peek() {
+  if (_inputHead == _inputTail) return -1;
+  return (uint8_t)_input[_inputHead];
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  hostOutputBytes += size;
+  if (hostEcho) fwrite(buffer, 1, size, hostEcho);
+  return size;
+}
+#endif
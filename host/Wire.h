@@ -0,0 +1,50 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Host simulation build: an I2C bus with nothing connected, so every
+// address is NAKed and the HAL treats I2C devices as not present.
+#ifndef TwoWire_h
+#define TwoWire_h
+#include <Arduino.h>
+
+#define WIRE_HAS_TIMEOUT
+
+class TwoWire : public Stream {
+public:
+  void begin() {}
+  void setClock(uint32_t clock) { (void)clock; }
+  void setWireTimeout(uint32_t timeout, bool reset=false) { (void)timeout; (void)reset; }
+  void clearWireTimeoutFlag() {}
+  bool getWireTimeoutFlag() { return false; }
+  void beginTransmission(uint8_t address) { (void)address; }
+  uint8_t endTransmission(bool sendStop=true) { (void)sendStop; return 2; }  // address NAK
+  uint8_t requestFrom(uint8_t address, size_t quantity, bool sendStop=true) { 
+    (void)address; (void)quantity; (void)sendStop; 
+    return 0; 
+  }
+  size_t write(uint8_t c) override { (void)c; return 1; }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+extern TwoWire Wire;
+
+#endif
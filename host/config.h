@@ -0,0 +1,30 @@
+/*
+ *  © 2026 DCC-EX
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Configuration for the host simulation build, used when there is no 
+// config.h in the main directory.  Serial1 is a second throttle that sends 
+// nothing, so what it receives is exactly the broadcast traffic.
+#define MOTOR_SHIELD_TYPE STANDARD_MOTOR_SHIELD
+#define ENABLE_WIFI false
+#define ENABLE_ETHERNET false
+#define IP_PORT 2560
+#define SCROLLMODE 1
+#define SERIAL1_COMMANDS
+#define DCC_PACKET_STATS
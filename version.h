@@ -3,7 +3,143 @@
 
 #include "StringFormatter.h"
 
-#define VERSION "5.4.18"
+#define VERSION "5.4.152"
+// 5.4.152 - MAIN tracks in power districts with their own packet streams (DCC_DISTRICTS)
+// 5.4.151 - WiThrottle M commands read in one pass, throttle actions visit only that throttle's locos
+// 5.4.150 - USB_SERIAL on native USB boards stages output into full 64 byte packets
+// 5.4.149 - <JQ> sensor list and <JQS [list sequence]> packed sensor states or changes since
+// 5.4.148 - EXRAIL strings stream from flash into their destination with %F
+// 5.4.147 - EXRAIL ON* events queued with per item coalescing and a per loop budget
+// 5.4.146 - Cache repeated <s> turnouts, <=>, <JG>, <JT>, <JR> and <JA> replies by generation
+// 5.4.145 - Virtual LCD rows are sent once per refresh and only when changed
+// 5.4.144 - HA mode on AVR loads the Timer1 compare registers from a precomputed table
+// 5.4.143 - HOT_RESTART snapshots loco slots and track modes/power to EEPROM and resumes them after a watchdog or brownout reset
+// 5.4.142 - ESP32, STM32 and Teensy 3.5+ grow the loco table in chunks up to LOCO_TABLE_MAX
+//         - A full table reuses the slot of the loco stopped longest (LOCO_EVICT_SECONDS)
+// 5.4.141 - Queue category diags (<D CMD ON> etc) in a ring written from loop()
+//         - <D CMD SYNC> etc writes them at once
+// 5.4.140 - I2C devices declare their own clock speed and the bus switches per request
+// 5.4.139 - ADS111x samples channels at their own rates, with ALERT/RDY and threshold notifications
+// 5.4.138 - TimerPWM HAL driver for servo pulses from ESP32 ledc or STM32 timers
+// 5.4.137 - Optional TURNOUT_PACING queues DCC and VPIN turnout throws per power group
+// 5.4.136 - DCC_PACKET_STATS measures the time between speed packets to each loco, <D LATENCY> shows p95 and worst, LOCO_REFRESH_ALARM reports long gaps
+// 5.4.135 - A network client may fill up to half of what the others leave of the outbound ring
+// 5.4.134 - RingStream takes strings and 32 bit flash strings in one copy
+// 5.4.133 - Ethernet replies are copied out of the outbound ring in blocks, STM32 Ethernet reads and writes up to 512 bytes
+// 5.4.132 - Waiting accessory commands for the same address and port merge, repeats take turns with loco reminders
+// 5.4.131 - Reminder cycle only inserts an idle packet when it would come straight back to the same decoder
+// 5.4.130 - <JZ> sends power, track, loco, turnout, sensor and route states in one reply
+// 5.4.129 - Network clients get a fair share of commands, superseded <t> commands in one buffer are dropped
+// 5.4.128 - WIFI_TASK_ON_CORE0 diag lines are written whole so the two cores do not split them
+// 5.4.127 - F29-F68 kept per loco and reminded in feature expansion groups at a low rate
+// 5.4.126 - DCCPacket keeps its bytes inline, no heap use on the sniffer path
+// 5.4.125 - Ack detection with a running baseline, hysteresis on the pulse and an averaged initial baseline
+// 5.4.124 - FAST_REVERSER flips AUTO tracks from the DCC interrupt on a short, <D REVERSER [RESET]> shows flips and reaction times
+// 5.4.123 - Track state broadcasts coalesced and sent only for tracks that changed
+// 5.4.122 - EXRAIL BLOCK, ATBLOCK and WAITFREE; waiting tasks parked until the block changes
+// 5.4.121 - EXRAIL signal definitions in RAM, unchanged aspects not resent
+// 5.4.120 - ONTIME cursor with catch-up of skipped clock minutes, EX-FastClock polled by rate
+// 5.4.119 - Broadcasts up to BROADCAST_MAX long, written by length to every transport
+// 5.4.118 - <JT> <JO> <JR> <JA> lists stream to network clients in ring sized chunks
+// 5.4.117 - DC tracks: brake PWM only rewritten when changed, per loco kick-start <F cab DCKICK ms>, DCFREQ applies at once
+// 5.4.116 - DCC signal pins written with precomputed per port masks (DISABLE_SIGNAL_MASKS to revert)
+// 5.4.115 - Optional ISR_LOAD waveform ISR cycle timing, <D ISR [RESET]>
+// 5.4.114 - CV cache per loco answers repeated prog track reads, updated by all CV writes, <D CVCACHE [CLEAR]>
+// 5.4.113 - EXRAIL loads all event/route lookups in two passes over the script
+// 5.4.112 - <= > track mode keywords dispatched by switch
+// 5.4.111 - Command station consists <G id [ADVANCED] [-]loco ...>, one packet per speed change for CV19 consists, fan-out for others, reminded once per consist
+// 5.4.110 - Command station momentum, <m cab accel [decel]> in ms per speed step, ramped by one updater in DCC::loop
+// 5.4.109 - Optional TRACE_SERIAL binary trace of commands, packets, sensors and turnouts, <D TRACE ON/OFF>, replayed by the host benchmark -b
+// 5.4.108 - Host (x86/Linux) simulation build, pio env native, with trace replay benchmark
+// 5.4.107 - Optional HAL_BENCHMARK per-device call timings and I2C bytes, <D HAL STATS [RESET]> and <D HAL BENCH>
+// 5.4.106 - TCA8418 reads the key FIFO in one burst, only on INT; TouchKeypad scans adaptively; both notify changes
+// 5.4.105 - EncoderThrottle uses ESP32 PCNT hardware counting with speed acceleration
+// 5.4.104 - LCN reads in chunks with a loop budget, batches turnout broadcasts and outbound commands
+// 5.4.103 - VL53L0X continuous ranging, non-blocking register access, optional GPIO1 ready pin
+// 5.4.102 - EX-SensorCAM delta reads of changed sensor banks, change notifications
+// 5.4.101 - duinoNodes optional hardware SPI (DUINONODES_SPI), duinoNodes and TM1638 inputs notify only changed pins
+// 5.4.100 - I2CDFPlayer loop uses queued I2C requests only, optional SC16IS752 IRQ pin, no bus clock change
+// 5.4.99 - NeoPixel sends changed pixels in multi-pixel runs, non-blocking
+// 5.4.98 - HC-SR04 echo timed by pin interrupt, no busy waiting
+// 5.4.97 - DCC engine starts before the network, boot times reported
+// 5.4.96 - Arena allocator for never freed objects, <D ARENA> shows usage
+// 5.4.95 - ESP32 WIFI_TASK_ON_CORE0: core 0 only does network I/O, commands are parsed on core 1
+// 5.4.94 - Display, EEPROM and memory report only run in time left over in each loop
+// 5.4.93 - Optional LOOP_PROFILE main loop profiler, <D LOOP [RESET]>
+// 5.4.92 - Serial broadcasts are queued per port and drained without blocking
+// 5.4.91 - Serial ports read in chunks and parse every complete command within a time budget
+// 5.4.90 - LCD start-up and clear no longer block the loop
+// 5.4.89 - SSD1306 framebuffer with burst page updates on ESP32 and STM32
+// 5.4.88 - Display only rewrites the changed span of each screen line
+// 5.4.87 - Sniffer decoder skips repeats of the last packet per loco address and instruction kind
+// 5.4.86 - Sniffer fixed slot ring with zero-copy packet views and overrun counters
+// 5.4.85 - Queue up to 4 prog track commands while one runs, run them in one DCCACK session
+// 5.4.84 - Railcom receiver on RAILCOM_SERIAL, <K cab cv> POM read on main, railcom only accepted where a cutout exists
+// 5.4.83 - Prog track sessions learn the decoder ack and use 5 verify repeats
+// 5.4.82 - <R LIST cv ...> reads several CVs in one prog track session
+// 5.4.81 - raw2mA/mA2raw inline with shift and precomputed reciprocal, no run time division
+// 5.4.80 - Per-track current history <JI HISTORY [ms]> and <JI ms> current streaming to network clients
+// 5.4.79 - Check overload on all tracks each loop within TRACK_CHECK_BUDGET, <D OVERLOAD [RESET]> shows worst round time
+// 5.4.78 - Optional ADC_USE_DMA for STM32F4 continuous current sampling into per-pin rings
+// 5.4.77 - HAL writeMasked and GPIO writeRange in one port write; signal aspects in one write per device
+// 5.4.76 - EX-Turntable status read without blocking, fast only while moving; turntable positions in sorted table
+// 5.4.75 - Startup pin writes from EEPROM are batched per GPIO port, outputs restored on first loop
+// 5.4.74 - Turnout and output state changes are written to EEPROM from a queue, one byte per loop
+// 5.4.73 - Accessory packet repeats are interleaved across all waiting accessories
+// 5.4.72 - <JTS [list gen]> packed turnout state snapshot with generation counter
+// 5.4.71 - Turnout lookups by id use a sorted index
+// 5.4.70 - Per-sensor debounce <S id pin pullup debounce>, quiet polled sensors are read less often
+// 5.4.69 - Sensor lookups by id and by vpin use a sorted index
+// 5.4.68 - Sensor changes notified by the HAL are queued and reported at the start of the next read cycle
+// 5.4.67 - PCA9685 servo steps written as auto-increment bursts of adjacent channels
+// 5.4.66 - EXIOExpander polls for changed inputs only when the expander supports EXIORDCHG
+// 5.4.65 - GPIO extenders with interrupt pin only read on interrupt or 1s refresh, shared pins serviced together; EXIOExpander interrupt pin
+// 5.4.64 - I2C_STATS per device, bus and subbus statistics <D I2C [RESET]>
+// 5.4.63 - Optional I2C_USE_DMA for STM32F4 native I2C data transfers
+// 5.4.62 - I2C queue groups requests by mux subbus, counter in <D HAL SHOW>
+// 5.4.61 - I2C mux subbus kept selected between requests, deselected only when needed
+// 5.4.60 - HAL IODevice::readRange reads up to 32 digital vpins as a bit mask
+// 5.4.59 - HAL devices looped in order of due time, optional IO_LOOP_MICROS budget
+// 5.4.58 - HAL vpin lookups use a sorted range index
+// 5.4.57 - EXRAIL stash sized by ids used, not highest id
+// 5.4.56 - EXRAIL flags stored as bit planes
+// 5.4.55 - EXRAIL tasks from a fixed pool (EXRAIL_TASK_POOL), usage in </>
+// 5.4.54 - Optional EXRAIL_PROFILE with </ PROFILE [RESET]>
+// 5.4.53 - EXRAIL ONBUTTON/ONSENSOR use change notification where the device has it
+// 5.4.52 - EXRAIL if block table also on Mega
+// 5.4.51 - EXRAIL if block ends resolved at startup on non AVR boards
+// 5.4.50 - EXRAIL lookups sorted and binary searched
+// 5.4.49 - EXRAIL runs straight line opcodes in one slice (EXRAIL_SLICE_OPCODES/MICROS)
+// 5.4.48 - EXRAIL keeps delayed tasks in a timer queue, only runnable tasks are serviced
+// 5.4.47 - Optional UDP throttle channel for absolute speed and function state
+// 5.4.46 - ESP32 wifi reconnects without blocking the loop
+// 5.4.45 - WiThrottle loop idles until a broadcast is flagged or an eStop deadline
+// 5.4.44 - WiThrottle skips loco update scans for cabs no client holds
+// 5.4.43 - WebSocket commands parsed in place, split commands carried, broadcasts sent to browsers
+// 5.4.42 - Ethernet reads every client each pass, carries split commands, joins replies per write
+// 5.4.41 - Optional WIFI_UART_SPEED raises the ESP AT link speed with fallback
+// 5.4.40 - WifiInboundHandler joins replies per client and waits for SEND OK instead of hitting busy
+// 5.4.39 - ESP32 wifi clients in a fixed pool of 8 slots
+// 5.4.38 - ESP32 wifi reads only the client sockets select() reports ready
+// 5.4.37 - Faster decimal and hex number output in StringFormatter
+// 5.4.36 - Type directed StringFormatter::emit for <l> and <Q>/<q> broadcasts
+// 5.4.35 - Slow network clients miss broadcasts over their ring quota and are then disconnected
+// 5.4.34 - RingStream publishes only committed messages, safe across ESP32 cores
+// 5.4.33 - Broadcasts to several network clients are stored once in the outbound ring
+// 5.4.32 - <JS> broadcast subscriptions for network clients
+// 5.4.31 - Batch command <( cmd | cmd ... )> with one <) count failed> reply
+// 5.4.30 - Optional BINARY_COMMANDS framed binary commands and broadcasts on serial ports
+// 5.4.29 - Serial commands are tokenized as they arrive (CommandTokenizer)
+// 5.4.28 - Parser checks parameter counts of fixed format commands from a flash table
+// 5.4.27 - Optional DCC_PACKET_STATS packet latency histograms, <D LATENCY [RESET]>
+// 5.4.26 - ESP32: RMT channel queues encoded packets back to back, stats in <D QUEUE>
+// 5.4.25 - STM32: optional STM32_SIGNAL_BSRR, precomputed atomic signal writes
+// 5.4.24 - Speed reminders reuse a per loco prebuilt packet (not on Uno/Nano)
+// 5.4.23 - Loco state broadcasts coalesced per slot, LOCO_BROADCAST_INTERVAL
+// 5.4.22 - Sniffer and DCC share one loco store held as parallel arrays
+// 5.4.21 - Feature: Hashed cab index for speed table lookups (not on Uno/Nano)
+// 5.4.20 - Feature: Adaptive reminders, boost recently changed speeds and slow down stale function groups
+// 5.4.19 - Feature: Priority packet queue for the main track, <D QUEUE> shows queue stats
 // 5.4.18 - Bugfix: EXRAIL failed TURNTABLE create commands (I2C off) can crash CS
 //        - Bugfix: EXRAIL be extra careful not to deref nullptr
 // 5.4.17 - Replace the SC power status with something better